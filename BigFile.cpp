@@ -761,7 +761,11 @@ bool BigFile::readwrite ( void         *buf      ,
 	// . this returns false and sets g_errno on error, true on success
 	// . we should return false cuz we blocked
 	// . thread will add signal to g_loop on completion to call
-	if ( g_jobScheduler.submit_io(readwriteWrapper_r, doneWrapper, fstate, thread_type_unspecified_io, niceness, doWrite) ) {
+	// . niceness 0 reads are for queries, they get the threads reserved
+	//   for queries in the i/o pool
+	if ( g_jobScheduler.submit_io(readwriteWrapper_r, doneWrapper, fstate,
+				      ( niceness == 0 && ! doWrite ) ? thread_type_query_read : thread_type_unspecified_io,
+				      niceness, doWrite) ) {
 		return false;
 	}
 
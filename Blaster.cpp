@@ -8,6 +8,8 @@
 #include "Titledb.h" // TITLEREC_CURRENT_VERSION
 #include "Linkdb.h"
 #include "Process.h"
+#include "Json.h"
+#include <math.h>
 
 Blaster g_blaster;
 static void gotDocWrapper1 ( void *state , TcpSocket *s ) ;
@@ -1218,3 +1220,534 @@ void Blaster::freeStateBD(StateBD *st){
 	        mfree(st->m_buf1,st->m_buf1MaxLen,"Blaster5");
 	mdelete(st,sizeof(StateBD),"Blaster3");
 }
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Query replay
+
+static void replaySleepWrapper ( int fd , void *state ) {
+	g_blaster.replayTick();
+}
+
+static void gotReplayDocWrapper ( void *state , TcpSocket *s ) {
+	g_blaster.gotReplayDoc ( (StateReplay *)state , s );
+}
+
+bool Blaster::parseRateSchedule ( const char *rateSchedule ) {
+	m_replaySteps.clear();
+	const char *p = rateSchedule;
+	while ( *p ) {
+		ReplayRateStep step;
+		char *end;
+		step.m_qpsStart = strtod ( p , &end );
+		if ( end == p ) return false;
+		step.m_qpsEnd = step.m_qpsStart;
+		p = end;
+		if ( *p == '-' ) {
+			p++;
+			step.m_qpsEnd = strtod ( p , &end );
+			if ( end == p ) return false;
+			p = end;
+		}
+		if ( *p != ':' ) return false;
+		p++;
+		step.m_seconds = strtol ( p , &end , 10 );
+		if ( end == p || step.m_seconds <= 0 ) return false;
+		if ( step.m_qpsStart < 0 || step.m_qpsEnd < 0 ) return false;
+		p = end;
+		m_replaySteps.push_back ( step );
+		if ( *p == ',' ) p++;
+		else if ( *p ) return false;
+	}
+	return ! m_replaySteps.empty();
+}
+
+// . get the scheduled arrival rate at "offsetUs" into the replay
+// . sets *stepEndUs to the end of the step "offsetUs" falls in
+// . returns -1 if the schedule has ended
+double Blaster::getReplayRate ( int64_t offsetUs, int64_t *stepEndUs ) const {
+	int64_t stepStartUs = 0;
+	for ( size_t i = 0 ; i < m_replaySteps.size() ; i++ ) {
+		const ReplayRateStep &step = m_replaySteps[i];
+		int64_t durationUs = step.m_seconds * 1000000LL;
+		if ( offsetUs < stepStartUs + durationUs ) {
+			*stepEndUs = stepStartUs + durationUs;
+			double fraction = (double)(offsetUs - stepStartUs) /
+				durationUs;
+			return step.m_qpsStart +
+				(step.m_qpsEnd - step.m_qpsStart) * fraction;
+		}
+		stepStartUs += durationUs;
+	}
+	*stepEndUs = stepStartUs;
+	return -1.0;
+}
+
+// . get the arrival after the one at "offsetUs", where the scheduled rate
+//   adds up to one query
+// . the rate changes within a ramp step and may be 0 at its start, so
+//   solve for where the integral of the ramp reaches the query instead of
+//   using the rate at "offsetUs" for the whole gap
+// . returns the end of the schedule if there is no arrival left
+int64_t Blaster::getNextReplayArrival ( int64_t offsetUs ) const {
+	// fraction of the query still to come
+	double need = 1.0;
+	// true if the rate was 0 since "offsetUs" so far
+	bool idle = false;
+	int64_t stepStartUs = 0;
+	for ( size_t i = 0 ; i < m_replaySteps.size() ; i++ ) {
+		const ReplayRateStep &step = m_replaySteps[i];
+		int64_t stepEndUs = stepStartUs + step.m_seconds * 1000000LL;
+		if ( offsetUs >= stepEndUs ) {
+			stepStartUs = stepEndUs;
+			continue;
+		}
+		// after an idle step the first query arrives when it ends
+		if ( idle && step.m_qpsStart > 0.0 )
+			return stepStartUs;
+		// qps at "offsetUs" and its change per second
+		double slope = (step.m_qpsEnd - step.m_qpsStart) / step.m_seconds;
+		double qps   = step.m_qpsStart +
+			slope * ( (offsetUs - stepStartUs) / 1000000.0 );
+		double left  = ( stepEndUs - offsetUs ) / 1000000.0;
+		// queries scheduled in the rest of the step
+		double avail = qps * left + slope / 2.0 * left * left;
+		if ( avail >= need ) {
+			// . solve qps*d + slope/2*d^2 = need for d
+			// . this form does not lose precision for a small slope
+			//   and is need/qps for a constant rate
+			double disc = qps * qps + 2.0 * slope * need;
+			if ( disc < 0.0 ) disc = 0.0;
+			double d = 2.0 * need / ( qps + sqrt ( disc ) );
+			int64_t gapUs = (int64_t)( d * 1000000.0 + 0.5 );
+			// at least a microsecond so we always make progress
+			if ( gapUs < 1 ) gapUs = 1;
+			if ( gapUs > stepEndUs - offsetUs )
+				gapUs = stepEndUs - offsetUs;
+			return offsetUs + gapUs;
+		}
+		if ( avail <= 0.0 && need >= 1.0 ) idle = true;
+		need       -= avail;
+		offsetUs    = stepEndUs;
+		stepStartUs = stepEndUs;
+	}
+	return stepStartUs;
+}
+
+bool Blaster::loadReplayQueries ( const char *file, const char *baseUrl ) {
+	FILE *fp = fopen ( file , "r" );
+	if ( ! fp ) {
+		log("blaster: fopen %s: %s",file,mstrerror(errno));
+		return false;
+	}
+	m_replayUrlBuf.reset();
+	m_replayUrlOffsets.clear();
+	char line[64*1024];
+	while ( fgets ( line , sizeof(line) , fp ) ) {
+		int32_t len = strlen ( line );
+		while ( len > 0 && is_wspace_a(line[len-1]) ) line[--len] = '\0';
+		char *p = line;
+		while ( is_wspace_a ( *p ) ) p++;
+		if ( ! *p || *p == '#' ) continue;
+
+		int32_t offset = m_replayUrlBuf.length();
+		if ( *p == '{' ) {
+			// a captured request in json, use its url or query
+			Json json;
+			json.parseJsonStringIntoJsonItems ( p , 0 );
+			JsonItem *ji = json.getItem ( "url" );
+			if ( ! ji ) ji = json.getItem ( "path" );
+			if ( ji && ji->getValue() ) {
+				char *v = ji->getValue();
+				if ( v[0] == '/' ) m_replayUrlBuf.safeStrcpy(baseUrl);
+				m_replayUrlBuf.safeStrcpy ( v );
+			}
+			else {
+				ji = json.getItem ( "q" );
+				if ( ! ji ) ji = json.getItem ( "query" );
+				if ( ! ji || ! ji->getValue() ) {
+					log("blaster: no url or query in %s",p);
+					continue;
+				}
+				m_replayUrlBuf.safePrintf("%s/search?format=json&q=",
+							  baseUrl);
+				m_replayUrlBuf.urlEncode ( ji->getValue() );
+			}
+		}
+		else if ( *p == '/' ) {
+			m_replayUrlBuf.safePrintf ( "%s%s" , baseUrl , p );
+		}
+		else {
+			m_replayUrlBuf.safeStrcpy ( p );
+		}
+		m_replayUrlBuf.pushChar ( '\0' );
+		m_replayUrlOffsets.push_back ( offset );
+	}
+	fclose ( fp );
+	return ! m_replayUrlOffsets.empty();
+}
+
+void Blaster::runReplay ( const char *file, const char *baseUrl,
+			  int32_t maxOutstanding, const char *rateSchedule,
+			  int32_t warmupSecs, const char *outPrefix ) {
+	if ( ! parseRateSchedule ( rateSchedule ) ) {
+		log("blaster: bad rate schedule \"%s\"",rateSchedule);
+		return;
+	}
+	if ( ! init() )
+		return;
+	if ( ! loadReplayQueries ( file , baseUrl ) ) {
+		log("blaster: no queries to replay in %s",file);
+		return;
+	}
+
+	if ( strlen ( outPrefix ) >= sizeof(m_replayOutPrefix) ) {
+		log("blaster: output prefix %s is too long",outPrefix);
+		return;
+	}
+	strcpy ( m_replayOutPrefix , outPrefix );
+	// room for the prefix and the longest suffix
+	char filename[sizeof(m_replayOutPrefix) + 16];
+	snprintf ( filename , sizeof(filename) , "%s.results" ,
+		   m_replayOutPrefix );
+	m_replayResultsFile = fopen ( filename , "w" );
+	if ( ! m_replayResultsFile ) {
+		log("blaster: fopen %s: %s",filename,mstrerror(errno));
+		return;
+	}
+	fprintf ( m_replayResultsFile ,
+		  "#querynum\tseq\tscheduled_ms\tlatency_us\thttp_status"
+		  "\terror\thits\tresults\tsignature\n" );
+
+	int64_t stepEndUs;
+	getReplayRate ( INT64_MAX , &stepEndUs );
+	m_replayEndUs           = stepEndUs;
+	m_replayWarmupUs        = warmupSecs * 1000000LL;
+	m_replayMaxOutstanding  = maxOutstanding > 0 ? maxOutstanding : 1;
+	m_replayOutstanding     = 0;
+	// the first query arrives at the start unless the schedule starts
+	// idle or with a ramp from 0
+	m_replayNextArrivalUs   = 0;
+	if ( getReplayRate ( 0 , &stepEndUs ) <= 0.0 )
+		m_replayNextArrivalUs = getNextReplayArrival ( 0 );
+	m_replayNextSeq         = 0;
+	m_replayLastReportUs    = 0;
+	m_replayMaxBacklog      = 0;
+	m_replayNumDone         = 0;
+	m_replayNumErrors       = 0;
+	m_replayNumHttpErrors   = 0;
+	m_replayNumLate         = 0;
+	m_replayBacklog.clear();
+	m_replayHistogram.reset();
+	m_replayIntervalHistogram.reset();
+
+	log(LOG_INIT,"blaster: replaying %" PRId32" queries for %" PRId64
+	    " seconds (warmup %" PRId32"s) with up to %" PRId32
+	    " outstanding",
+	    (int32_t)m_replayUrlOffsets.size(), m_replayEndUs/1000000,
+	    warmupSecs, m_replayMaxOutstanding);
+
+	m_replayStartUs = gettimeofdayInMicroseconds();
+	// tick every ms so arrivals are launched close to their schedule
+	g_loop.registerSleepCallback ( 1 , NULL , replaySleepWrapper );
+	g_loop.runLoop();
+}
+
+void Blaster::replayTick ( ) {
+	int64_t nowUs = gettimeofdayInMicroseconds() - m_replayStartUs;
+
+	// queue up every arrival that is due by now. this is open-loop: the
+	// schedule does not care how many requests are still outstanding
+	while ( m_replayNextArrivalUs <= nowUs &&
+		m_replayNextArrivalUs < m_replayEndUs ) {
+		m_replayBacklog.push_back ( std::make_pair ( m_replayNextSeq++ ,
+						     m_replayNextArrivalUs ) );
+		m_replayNextArrivalUs =
+			getNextReplayArrival ( m_replayNextArrivalUs );
+	}
+	if ( (int64_t)m_replayBacklog.size() > m_replayMaxBacklog )
+		m_replayMaxBacklog = m_replayBacklog.size();
+
+	// launch as many as we have slots for
+	while ( ! m_replayBacklog.empty() &&
+		m_replayOutstanding < m_replayMaxOutstanding ) {
+		std::pair<int64_t,int64_t> a = m_replayBacklog.front();
+		m_replayBacklog.pop_front();
+		// count arrivals that could not be sent within 10ms
+		if ( nowUs - a.second > 10000 ) m_replayNumLate++;
+		launchReplayQuery ( a.first , a.second );
+	}
+
+	// progress report every 10 seconds
+	if ( nowUs - m_replayLastReportUs >= 10000000 ) {
+		m_replayLastReportUs = nowUs;
+		log(LOG_INFO,"blaster: t=%" PRId64"s done=%" PRId64
+		    " outstanding=%" PRId32" backlog=%" PRId32
+		    " p50=%.1fms p99=%.1fms errors=%" PRId64,
+		    nowUs/1000000, m_replayNumDone, m_replayOutstanding,
+		    (int32_t)m_replayBacklog.size(),
+		    m_replayIntervalHistogram.getValueAtPercentile(50.0)/1000.0,
+		    m_replayIntervalHistogram.getValueAtPercentile(99.0)/1000.0,
+		    m_replayNumErrors + m_replayNumHttpErrors);
+		m_replayIntervalHistogram.reset();
+	}
+
+	if ( m_replayNextArrivalUs >= m_replayEndUs &&
+	     m_replayBacklog.empty() && m_replayOutstanding == 0 )
+		finishReplay();
+}
+
+void Blaster::launchReplayQuery ( int64_t seq, int64_t scheduledUs ) {
+	StateReplay *st;
+	try { st = new (StateReplay); }
+	catch ( ... ) {
+		g_errno = ENOMEM;
+		log("blaster: Failed. Could not allocate %" PRId32" bytes "
+		    "for replay query.", (int32_t)sizeof(StateReplay));
+		return;
+	}
+	mnew ( st , sizeof(StateReplay) , "BlasterReplay" );
+	st->m_queryNum    = seq % m_replayUrlOffsets.size();
+	st->m_seq         = seq;
+	st->m_scheduledUs = scheduledUs;
+	st->m_warmup      = scheduledUs < m_replayWarmupUs;
+
+	char *url = m_replayUrlBuf.getBufStart() +
+		m_replayUrlOffsets[st->m_queryNum];
+	m_replayOutstanding++;
+	g_errno = 0;
+	bool status = g_httpServer.getDoc ( url ,
+					    0 , // ip
+					    0 , // offset
+					    -1 , // size
+					    0 , // ifModifiedSince
+					    st , // state
+					    gotReplayDocWrapper ,
+					    60*1000 , // timeout
+					    0 , // proxy ip
+					    0 , // proxy port
+					    30*1024*1024 , // maxLen
+					    30*1024*1024 ); // maxOtherLen
+	// it blocked, wait for the callback
+	if ( ! status ) return;
+	// otherwise there was an error, record it
+	gotReplayDoc ( st , NULL );
+}
+
+// . hash the docids of the results in order so we can tell whether two
+//   runs returned the same result list
+// . handles the xml and json formats, returns -1 results otherwise
+static int32_t getResultSignature ( const char *content , uint32_t *sig ) {
+	*sig = 0;
+	int32_t numResults = -1;
+	const char *tags[2] = { "<docId>" , "\"docId\":" };
+	for ( int32_t i = 0 ; i < 2 && numResults < 0 ; i++ ) {
+		const char *p = strstr ( content , tags[i] );
+		if ( ! p ) continue;
+		numResults = 0;
+		for ( ; p ; p = strstr ( p , tags[i] ) ) {
+			p += strlen ( tags[i] );
+			int64_t docId = atoll ( p );
+			*sig = hash32h ( (uint32_t)docId , *sig );
+			*sig = hash32h ( (uint32_t)(docId>>32) , *sig );
+			numResults++;
+		}
+	}
+	return numResults;
+}
+
+static int64_t getTotalHits ( const char *content ) {
+	const char *p = strstr ( content , "<hits>" );
+	if ( p ) return atoll ( p + 6 );
+	p = strstr ( content , "\"hits\":" );
+	if ( p ) return atoll ( p + 7 );
+	return -1;
+}
+
+void Blaster::gotReplayDoc ( StateReplay *st, TcpSocket *s ) {
+	int64_t nowUs = gettimeofdayInMicroseconds() - m_replayStartUs;
+	int64_t latencyUs = nowUs - st->m_scheduledUs;
+	m_replayOutstanding--;
+
+	int32_t err = g_errno;
+	int32_t httpStatus = 0;
+	int64_t hits = -1;
+	int32_t numResults = -1;
+	uint32_t sig = 0;
+	if ( ! err && s && s->m_readOffset > 0 ) {
+		HttpMime mime;
+		mime.set ( s->m_readBuf , s->m_readOffset , NULL );
+		httpStatus = mime.getHttpStatus();
+		// getDoc() null terminates the content
+		char *content = s->m_readBuf + mime.getMimeLen();
+		hits = getTotalHits ( content );
+		numResults = getResultSignature ( content , &sig );
+		if ( numResults < 0 )
+			sig = hash32 ( content ,
+				       s->m_readOffset - mime.getMimeLen() );
+	}
+	else if ( ! err ) {
+		err = EBADREPLY;
+	}
+
+	if ( ! st->m_warmup ) {
+		m_replayNumDone++;
+		if ( err ) m_replayNumErrors++;
+		else if ( httpStatus != 200 ) m_replayNumHttpErrors++;
+		m_replayHistogram.record ( latencyUs );
+		m_replayIntervalHistogram.record ( latencyUs );
+		fprintf ( m_replayResultsFile ,
+			  "%" PRId32"\t%" PRId64"\t%" PRId64"\t%" PRId64
+			  "\t%" PRId32"\t%" PRId32"\t%" PRId64"\t%" PRId32
+			  "\t%08" PRIx32"\n",
+			  st->m_queryNum, st->m_seq, st->m_scheduledUs/1000,
+			  latencyUs, httpStatus, err, hits, numResults, sig );
+	}
+	if ( err && g_conf.m_logDebugTcp )
+		log("blaster: query #%" PRId32" failed: %s",
+		    st->m_queryNum, mstrerror(err));
+
+	mdelete ( st , sizeof(StateReplay) , "BlasterReplay" );
+	delete st;
+	g_errno = 0;
+}
+
+void Blaster::finishReplay ( ) {
+	g_loop.unregisterSleepCallback ( NULL , replaySleepWrapper );
+	fclose ( m_replayResultsFile );
+	m_replayResultsFile = NULL;
+
+	char filename[sizeof(m_replayOutPrefix) + 16];
+	snprintf ( filename , sizeof(filename) , "%s.hgrm" , m_replayOutPrefix );
+	FILE *fp = fopen ( filename , "w" );
+	if ( fp ) {
+		// values are in microseconds, print milliseconds
+		m_replayHistogram.printPercentileDistribution ( fp , 1000.0 );
+		fclose ( fp );
+	}
+	else
+		log("blaster: fopen %s: %s",filename,mstrerror(errno));
+
+	const LatencyHistogram &h = m_replayHistogram;
+	double elapsed = (m_replayEndUs - m_replayWarmupUs) / 1000000.0;
+	int64_t n = m_replayNumDone;
+	log(LOG_INFO,"blaster: replay done. %" PRId64" queries, %.1f qps, "
+	    "%" PRId64" errors (%.3f%%), %" PRId64" non-200 replies, "
+	    "%" PRId64" late launches, max backlog %" PRId64,
+	    n, elapsed > 0 ? n / elapsed : 0.0,
+	    m_replayNumErrors, n ? 100.0*m_replayNumErrors/n : 0.0,
+	    m_replayNumHttpErrors, m_replayNumLate, m_replayMaxBacklog);
+	log(LOG_INFO,"blaster: latency ms min=%.2f p50=%.2f p95=%.2f "
+	    "p99=%.2f p999=%.2f max=%.2f mean=%.2f",
+	    h.getMin()/1000.0,
+	    h.getValueAtPercentile(50.0)/1000.0,
+	    h.getValueAtPercentile(95.0)/1000.0,
+	    h.getValueAtPercentile(99.0)/1000.0,
+	    h.getValueAtPercentile(99.9)/1000.0,
+	    h.getMax()/1000.0,
+	    h.getMean()/1000.0);
+	exit ( 0 );
+}
+
+// one line of a replay .results file
+struct ReplayResult {
+	int32_t  m_queryNum;
+	int64_t  m_latencyUs;
+	int32_t  m_httpStatus;
+	int32_t  m_error;
+	int64_t  m_hits;
+	int32_t  m_numResults;
+	uint32_t m_sig;
+};
+
+static bool loadReplayResults ( const char *file ,
+				std::vector<ReplayResult> *results ,
+				LatencyHistogram *histogram ) {
+	FILE *fp = fopen ( file , "r" );
+	if ( ! fp ) {
+		log("blaster: fopen %s: %s",file,mstrerror(errno));
+		return false;
+	}
+	ReplayResult empty;
+	memset ( &empty , 0 , sizeof(empty) );
+	empty.m_queryNum = -1;
+	char line[1024];
+	while ( fgets ( line , sizeof(line) , fp ) ) {
+		if ( line[0] == '#' ) continue;
+		ReplayResult r;
+		int64_t seq, scheduledMs;
+		if ( sscanf ( line , "%" SCNd32"\t%" SCNd64"\t%" SCNd64"\t%" SCNd64
+			      "\t%" SCNd32"\t%" SCNd32"\t%" SCNd64"\t%" SCNd32
+			      "\t%" SCNx32,
+			      &r.m_queryNum, &seq, &scheduledMs, &r.m_latencyUs,
+			      &r.m_httpStatus, &r.m_error, &r.m_hits,
+			      &r.m_numResults, &r.m_sig ) != 9 )
+			continue;
+		if ( r.m_queryNum < 0 ) continue;
+		histogram->record ( r.m_latencyUs );
+		// keep the first result of each query for the diff
+		if ( (int32_t)results->size() <= r.m_queryNum )
+			results->resize ( r.m_queryNum + 1 , empty );
+		if ( (*results)[r.m_queryNum].m_queryNum < 0 )
+			(*results)[r.m_queryNum] = r;
+	}
+	fclose ( fp );
+	return true;
+}
+
+bool Blaster::compareReplayRuns ( const char *file1, const char *file2 ) {
+	std::vector<ReplayResult> r1, r2;
+	LatencyHistogram h1, h2;
+	if ( ! loadReplayResults ( file1 , &r1 , &h1 ) ) return false;
+	if ( ! loadReplayResults ( file2 , &r2 , &h2 ) ) return false;
+
+	static const double percentiles[] = { 50.0, 90.0, 95.0, 99.0, 99.9 };
+	printf("%-10s %12s %12s %10s\n","latency","run1 (ms)","run2 (ms)",
+	       "change");
+	for ( size_t i = 0 ; i < sizeof(percentiles)/sizeof(percentiles[0]) ; i++ ) {
+		double v1 = h1.getValueAtPercentile(percentiles[i]) / 1000.0;
+		double v2 = h2.getValueAtPercentile(percentiles[i]) / 1000.0;
+		char name[16];
+		sprintf ( name , "p%g" , percentiles[i] );
+		printf("%-10s %12.2f %12.2f %+9.1f%%\n", name, v1, v2,
+		       v1 > 0 ? 100.0*(v2-v1)/v1 : 0.0);
+	}
+	printf("%-10s %12.2f %12.2f\n","mean",h1.getMean()/1000.0,
+	       h2.getMean()/1000.0);
+	printf("%-10s %12.2f %12.2f\n\n","max",h1.getMax()/1000.0,
+	       h2.getMax()/1000.0);
+
+	int64_t common = 0, errors1 = 0, errors2 = 0;
+	int64_t hitsDiff = 0, countDiff = 0, sigDiff = 0;
+	size_t n = r1.size() < r2.size() ? r1.size() : r2.size();
+	for ( size_t i = 0 ; i < n ; i++ ) {
+		const ReplayResult &a = r1[i];
+		const ReplayResult &b = r2[i];
+		if ( a.m_queryNum < 0 || b.m_queryNum < 0 ) continue;
+		common++;
+		bool bad1 = a.m_error || a.m_httpStatus != 200;
+		bool bad2 = b.m_error || b.m_httpStatus != 200;
+		if ( bad1 ) errors1++;
+		if ( bad2 ) errors2++;
+		if ( bad1 || bad2 ) continue;
+		if ( a.m_hits != b.m_hits ) hitsDiff++;
+		if ( a.m_numResults != b.m_numResults ) countDiff++;
+		if ( a.m_sig != b.m_sig ) {
+			sigDiff++;
+			printf("query #%" PRId32": results differ "
+			       "(%" PRId32" vs %" PRId32" results, "
+			       "%" PRId64" vs %" PRId64" hits)\n",
+			       a.m_queryNum, a.m_numResults, b.m_numResults,
+			       a.m_hits, b.m_hits);
+		}
+	}
+	printf("\n%" PRId64" queries in both runs\n", common);
+	printf("errors:              %" PRId64" (%.3f%%) vs %" PRId64
+	       " (%.3f%%)\n",
+	       errors1, common ? 100.0*errors1/common : 0.0,
+	       errors2, common ? 100.0*errors2/common : 0.0);
+	printf("hit count differs:   %" PRId64"\n", hitsDiff);
+	printf("result count differs: %" PRId64"\n", countDiff);
+	printf("result list differs: %" PRId64"\n", sigDiff);
+	return true;
+}
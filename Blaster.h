@@ -7,7 +7,10 @@
 #include "HashTableT.h"
 #include "Loop.h"
 #include "iana_charset.h"
+#include "LatencyHistogram.h"
 #include <sys/resource.h>  // setrlimit
+#include <deque>
+#include <vector>
 
 struct StateBD {
 	//Url m_u1,m_u2;
@@ -29,6 +32,22 @@ struct StateBD2 {
 	char *m_url;
 };
 
+// one request of a query replay
+struct StateReplay {
+	int32_t m_queryNum;    // line # in the query file
+	int64_t m_seq;         // arrival sequence #
+	int64_t m_scheduledUs; // scheduled arrival, relative to replay start
+	bool    m_warmup;      // not counted in the statistics
+};
+
+// one step of a replay rate schedule. the rate goes linearly from
+// m_qpsStart to m_qpsEnd over m_seconds (equal for a constant rate)
+struct ReplayRateStep {
+	double  m_qpsStart;
+	double  m_qpsEnd;
+	int32_t m_seconds;
+};
+
 class Blaster {
  public:
 	Blaster();
@@ -60,6 +79,29 @@ class Blaster {
 
 	void processLogFile(void *state);
 
+	// . replay the queries in "file" against a running instance with an
+	//   open-loop arrival schedule, so slow replies do not slow down
+	//   the offered load
+	// . "baseUrl" is prepended to query lines that are just a path
+	//   ("/search?q=...") or a json object with a "q" or "query" member
+	// . "rateSchedule" is a comma separated list of <qps>:<seconds> or
+	//   <qps1>-<qps2>:<seconds> (linear ramp) steps
+	// . latency is measured from the scheduled arrival time, so time
+	//   spent waiting for one of the "maxOutstanding" slots is included
+	// . writes <outPrefix>.results (one line per query) and
+	//   <outPrefix>.hgrm (latency percentile distribution)
+	void runReplay ( const char *file, const char *baseUrl,
+			 int32_t maxOutstanding, const char *rateSchedule,
+			 int32_t warmupSecs, const char *outPrefix );
+
+	void replayTick();
+
+	void gotReplayDoc ( StateReplay *st, TcpSocket *s );
+
+	// compare two <outPrefix>.results files from runReplay() and print
+	// latency, error rate and result differences. returns false on error
+	static bool compareReplayRuns ( const char *file1, const char *file2 );
+
 	bool m_doInjection;
 	bool m_doInjectionWithLinks;
 
@@ -87,6 +129,36 @@ class Blaster {
 	char **m_lineStart;
 	bool m_blasterDiff;
 	bool m_print;
+
+ private:
+	bool parseRateSchedule ( const char *rateSchedule );
+	bool loadReplayQueries ( const char *file, const char *baseUrl );
+	double getReplayRate ( int64_t offsetUs, int64_t *stepEndUs ) const;
+	int64_t getNextReplayArrival ( int64_t offsetUs ) const;
+	void launchReplayQuery ( int64_t seq, int64_t scheduledUs );
+	void finishReplay();
+
+	SafeBuf m_replayUrlBuf;
+	std::vector<int32_t> m_replayUrlOffsets;
+	std::vector<ReplayRateStep> m_replaySteps;
+	std::deque<std::pair<int64_t,int64_t> > m_replayBacklog; //(seq,scheduledUs)
+	int32_t m_replayMaxOutstanding;
+	int32_t m_replayOutstanding;
+	int64_t m_replayStartUs;
+	int64_t m_replayWarmupUs;
+	int64_t m_replayEndUs;
+	int64_t m_replayNextArrivalUs;
+	int64_t m_replayNextSeq;
+	int64_t m_replayLastReportUs;
+	int64_t m_replayMaxBacklog;
+	int64_t m_replayNumDone;
+	int64_t m_replayNumErrors;
+	int64_t m_replayNumHttpErrors;
+	int64_t m_replayNumLate;
+	FILE *m_replayResultsFile;
+	char m_replayOutPrefix[1024];
+	LatencyHistogram m_replayHistogram;
+	LatencyHistogram m_replayIntervalHistogram;
 };
 
 extern Blaster g_blaster;
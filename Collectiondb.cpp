@@ -17,6 +17,7 @@
 #include "Repair.h"
 #include "Parms.h"
 #include "Process.h"
+#include "Msg40.h"
 
 
 static HashTableX g_collTable;
@@ -528,6 +529,9 @@ bool Collectiondb::deleteRec2 ( collnum_t collnum ) { //, WaitEntry *we ) {
 		return true;
 	}
 	CollectionRec *cr = m_recs [ collnum ];
+
+	// do not serve its search results any more
+	Msg40::invalidateResultsCache ( collnum );
 	if ( ! cr ) {
 		log(LOG_WARN, "admin: Collection id problem. Delete failed.");
 		g_errno = ENOTFOUND;
@@ -755,6 +759,10 @@ bool Collectiondb::resetColl2( collnum_t oldCollnum, collnum_t newCollnum, bool
 
 	CollectionRec *cr = m_recs [ oldCollnum ];
 
+	// do not serve search results of the old index
+	Msg40::invalidateResultsCache ( oldCollnum );
+	Msg40::invalidateResultsCache ( newCollnum );
+
 	// let's reset crawlinfo crap
 	cr->m_globalCrawlInfo.reset();
 	cr->m_localCrawlInfo.reset();
@@ -117,6 +117,7 @@ class Conf {
 	// posdb
 	int64_t m_posdbFileCacheSize;
 	int32_t  m_posdbMaxTreeMem;
+	int32_t  m_posdbMergeThreads; // split big termlist merges in this many
 
 	// tagdb
 	int64_t m_tagdbFileCacheSize;
@@ -131,6 +132,8 @@ class Conf {
 	// titledb
 	int64_t m_titledbFileCacheSize;
 	int32_t  m_titledbMaxTreeMem;
+	// train dictionaries for titlerecs and recompress them when merging
+	bool     m_titleRecDicts;
 
 	// spiderdb
 	int64_t m_spiderdbFileCacheSize;
@@ -139,6 +142,8 @@ class Conf {
 	// linkdb for storing linking relations
 	int32_t  m_linkdbMaxTreeMem;
 	int32_t  m_linkdbMinFilesToMerge;
+	// reuse the link text in the old link info if at most this many days old
+	int32_t  m_linkInfoReuseMaxAge;
 
 	// statdb
 	int32_t m_statsdbMaxTreeMem;
@@ -152,6 +157,9 @@ class Conf {
 	int32_t  m_maxCpuThreads;
 	int32_t  m_maxIOThreads;
 	int32_t  m_maxExternalThreads;
+	int32_t  m_queryThreadsReserved;   //threads of each pool kept for query jobs
+	int32_t  m_maxMergeThreads;        //most file merge jobs running at once, 0=no limit
+	bool     m_pinJobThreads;          //pin the job threads to cores/numa nodes
 
 	int32_t  m_deadHostTimeout;
 	int32_t  m_sendEmailTimeout;
@@ -165,8 +173,22 @@ class Conf {
 	int64_t  m_msg40_msg39_timeout; //timeout for entire get-docid-list phase, in milliseconds.
 	int64_t  m_msg3a_msg39_network_overhead; //additional latency/overhead of sending reqeust+response over network.
 
+	// send msg39/msg20/msg0 requests to a twin too if the first host is slow
+	bool     m_useHedgedRequests;
+	int32_t  m_hedgePercentile;
+	// send to the twin with the lowest reply time times outstanding requests
+	bool     m_useLatencyRouting;
+
 	char	m_useHighFrequencyTermCache;
 
+	// posdb termlists of the most queried terms kept in memory
+	int64_t m_termListCacheMaxMem;
+	int32_t m_termListCacheMinHits;
+	bool    m_termListCacheUseHugePages;
+
+	// read only the docid ranges of a rare term's docids from big termlists
+	int32_t m_partialTermListReadMaxDocIds;
+
 	bool  m_spideringEnabled     ;
 	bool  m_injectionsEnabled     ;
 	bool  m_queryingEnabled ;
@@ -190,10 +212,21 @@ class Conf {
 	int32_t  m_httpsMaxSockets    ;
 	int32_t  m_httpMaxSendBufSize ;
 
+	// persistent incoming http connections
+	bool     m_httpKeepAlive            ;
+	int32_t  m_httpKeepAliveTimeout     ; // idle ms before we close it
+	int32_t  m_httpKeepAliveMaxRequests ;
+
 	// a search results cache (for Msg40)
 	int32_t  m_searchResultsMaxCacheMem    ;
 	int32_t  m_searchResultsMaxCacheAge    ; // in seconds
 	int64_t m_docSummaryWithDescriptionMaxCacheAge; //cache timeout for document summaries for documents with a meta-tag with description, in milliseconds
+	// get the summaries of a shard with one msg 0x21 request
+	bool     m_batchSummaryRequests;
+	// trace this percent of the queries across the hosts, keep the traces
+	// of the ones taking at least m_queryTraceMinTime ms
+	float    m_queryTraceSamplePercent;
+	int32_t  m_queryTraceMinTime;
 
 	// for Weights.cpp
 	int32_t   m_sliderParm;
@@ -298,6 +331,11 @@ class Conf {
 
 	// calls fsync(fd) if true after each write
 	bool   m_flushWrites ; 
+
+	// . log lists added to the rdb trees instead of saving the trees
+	// . the log is group committed every m_rdbWalSyncInterval ms
+	bool    m_useRdbWal;
+	int32_t m_rdbWalSyncInterval;
 	bool   m_verifyWrites;
 	int32_t   m_corruptRetries;
 
@@ -339,6 +377,11 @@ class Conf {
 	// defaults to "Gigabot/1.0"
 	char m_spiderUserAgent [ USERAGENTMAXSIZE ];
 
+	// keep connections to web servers open between downloads
+	bool    m_spiderKeepAlive;
+	int32_t m_spiderKeepAliveTimeout; // idle ms before we close it
+	int32_t m_spiderMaxIdleSockets;
+
 	char m_spiderBotName [ USERAGENTMAXSIZE ];
 
 	int32_t m_autoSaveFrequency;
@@ -347,9 +390,6 @@ class Conf {
 
 	bool m_profilingEnabled;
 	bool m_dynamicPerfGraph;
-	int32_t m_minProfThreshold;
-	bool m_sequentialProfiling;
-	int32_t m_realTimeProfilerMinQuickPollDelta;
 
 	//
 	// See Log.h for an explanation of the switches below
@@ -369,6 +409,8 @@ class Conf {
 	bool  m_logSpideredUrls;
 	// log informational messages, they are not indicative of any error.
 	bool  m_logInfo;
+	// hand the log lines to the log writer thread instead of writing them
+	bool  m_logAsynchronously;
 	// when out of udp slots
 	bool  m_logNetCongestion;
 	// doc quota limits, url truncation limits
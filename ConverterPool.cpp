@@ -0,0 +1,442 @@
+#include "gb-include.h"
+
+#include "ConverterPool.h"
+#include "ScopedLock.h"
+#include "Conf.h"
+#include "Hostdb.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+// a global class extern'd in ConverterPool.h
+ConverterPool g_converterPool;
+
+static int64_t getMonotonicMS ( ) {
+	timespec ts;
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// . wait until "fd" is ready for "events" or "deadline" (from
+//   getMonotonicMS(), 0 for none) is reached
+// . returns false and sets errno on timeout or error
+static bool waitForFd ( int fd, short events, int64_t deadline ) {
+	for ( ; ; ) {
+		int timeout = -1;
+		if ( deadline ) {
+			int64_t left = deadline - getMonotonicMS();
+			if ( left <= 0 ) {
+				errno = ETIMEDOUT;
+				return false;
+			}
+			timeout = (int)left;
+		}
+		pollfd pfd;
+		pfd.fd      = fd;
+		pfd.events  = events;
+		pfd.revents = 0;
+		int n = poll ( &pfd, 1, timeout );
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n < 0 ) return false;
+		if ( n > 0 ) return true;
+	}
+}
+
+// returns false and sets errno on error, timeout or if the other end closed
+static bool writeAll ( int fd, const void *buf, int32_t size,
+		       int64_t deadline ) {
+	const char *p = (const char *)buf;
+	while ( size > 0 ) {
+		if ( ! waitForFd ( fd, POLLOUT, deadline ) ) return false;
+		ssize_t n = write ( fd, p, size );
+		if ( n < 0 && ( errno == EINTR || errno == EAGAIN ) ) continue;
+		if ( n < 0 ) return false;
+		p    += n;
+		size -= n;
+	}
+	return true;
+}
+
+// returns false and sets errno on error, timeout or if the other end closed
+static bool readAll ( int fd, void *buf, int32_t size, int64_t deadline ) {
+	char *p = (char *)buf;
+	while ( size > 0 ) {
+		if ( ! waitForFd ( fd, POLLIN, deadline ) ) return false;
+		ssize_t n = read ( fd, p, size );
+		if ( n < 0 && ( errno == EINTR || errno == EAGAIN ) ) continue;
+		if ( n < 0 ) return false;
+		if ( n == 0 ) {
+			errno = EPIPE;
+			return false;
+		}
+		p    += n;
+		size -= n;
+	}
+	return true;
+}
+
+ConverterPool::ConverterPool ( ) {
+	for ( int32_t i = 0 ; i < MAX_CONVERTER_WORKERS ; i++ ) {
+		m_workers[i].m_pid    = -1;
+		m_workers[i].m_toFd   = -1;
+		m_workers[i].m_fromFd = -1;
+		m_workers[i].m_busy   = false;
+	}
+	m_extraTimeoutMS = 10000;
+	pthread_mutex_init ( &m_mtx, NULL );
+	pthread_cond_init ( &m_cond, NULL );
+}
+
+void ConverterPool::reset ( ) {
+	ScopedLock sl ( m_mtx );
+	for ( int32_t i = 0 ; i < MAX_CONVERTER_WORKERS ; i++ )
+		killWorker ( &m_workers[i] );
+}
+
+// . get an idle worker, waiting for one if all are busy
+// . we have as many workers as external threads, those run the conversions
+int32_t ConverterPool::getWorker ( ) {
+	ScopedLock sl ( m_mtx );
+	for ( ; ; ) {
+		int32_t n = g_conf.m_maxExternalThreads;
+		if ( n < 1 ) n = 1;
+		if ( n > MAX_CONVERTER_WORKERS ) n = MAX_CONVERTER_WORKERS;
+		for ( int32_t i = 0 ; i < n ; i++ ) {
+			if ( m_workers[i].m_busy ) continue;
+			m_workers[i].m_busy = true;
+			return i;
+		}
+		pthread_cond_wait ( &m_cond, &m_mtx );
+	}
+}
+
+void ConverterPool::returnWorker ( int32_t i ) {
+	ScopedLock sl ( m_mtx );
+	m_workers[i].m_busy = false;
+	pthread_cond_signal ( &m_cond );
+}
+
+// . start a "gb convertworker" process
+// . posix_spawn() does not copy our page tables like fork() does
+bool ConverterPool::spawnWorker ( Worker *w ) {
+	char exe[1024];
+	ssize_t len = readlink ( "/proc/self/exe", exe, sizeof(exe) - 1 );
+	if ( len < 0 ) return false;
+	exe[len] = '\0';
+
+	int toPipe[2];
+	int fromPipe[2];
+	if ( pipe2 ( toPipe, O_CLOEXEC ) != 0 ) return false;
+	if ( pipe2 ( fromPipe, O_CLOEXEC ) != 0 ) {
+		close ( toPipe[0] );
+		close ( toPipe[1] );
+		return false;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init ( &actions );
+	posix_spawn_file_actions_adddup2 ( &actions, toPipe[0], 0 );
+	posix_spawn_file_actions_adddup2 ( &actions, fromPipe[1], 1 );
+
+	// our threads block most signals, do not pass that on
+	posix_spawnattr_t attr;
+	posix_spawnattr_init ( &attr );
+	sigset_t sigs;
+	sigemptyset ( &sigs );
+	posix_spawnattr_setsigmask ( &attr, &sigs );
+	sigfillset ( &sigs );
+	posix_spawnattr_setsigdefault ( &attr, &sigs );
+	posix_spawnattr_setflags ( &attr,
+				   POSIX_SPAWN_SETSIGMASK |
+				   POSIX_SPAWN_SETSIGDEF );
+
+	char cmd[] = "convertworker";
+	char *argv[] = { exe, cmd, g_hostdb.m_dir, NULL };
+	pid_t pid;
+	int rc = posix_spawn ( &pid, exe, &actions, &attr, argv, environ );
+
+	posix_spawn_file_actions_destroy ( &actions );
+	posix_spawnattr_destroy ( &attr );
+	close ( toPipe[0] );
+	close ( fromPipe[1] );
+
+	if ( rc != 0 ) {
+		close ( toPipe[1] );
+		close ( fromPipe[0] );
+		errno = rc;
+		return false;
+	}
+
+	w->m_pid    = pid;
+	w->m_toFd   = toPipe[1];
+	w->m_fromFd = fromPipe[0];
+	log ( LOG_INFO, "build: Started converter worker pid=%" PRId32".",
+	      (int32_t)pid );
+	return true;
+}
+
+void ConverterPool::killWorker ( Worker *w ) {
+	if ( w->m_pid <= 0 ) return;
+	kill ( w->m_pid, SIGKILL );
+	waitpid ( w->m_pid, NULL, 0 );
+	close ( w->m_toFd );
+	close ( w->m_fromFd );
+	w->m_pid    = -1;
+	w->m_toFd   = -1;
+	w->m_fromFd = -1;
+}
+
+bool ConverterPool::convert ( const ConverterRequest *req, const char *cmd,
+			      const char *input, char *out,
+			      ConverterReply *reply ) {
+	int32_t i = getWorker();
+	Worker *w = &m_workers[i];
+
+	if ( w->m_pid <= 0 && ! spawnWorker ( w ) ) {
+		int err = errno;
+		log ( LOG_WARN, "build: Could not start converter worker: %s",
+		      mstrerror(err) );
+		returnWorker ( i );
+		errno = err;
+		return false;
+	}
+
+	int64_t deadline = 0;
+	if ( req->m_timeout > 0 )
+		deadline = getMonotonicMS() + req->m_timeout * 1000 +
+			m_extraTimeoutMS;
+
+	bool status =
+		writeAll ( w->m_toFd, req, sizeof(*req), deadline ) &&
+		writeAll ( w->m_toFd, cmd, req->m_cmdLen, deadline ) &&
+		writeAll ( w->m_toFd, input, req->m_inputSize, deadline ) &&
+		readAll ( w->m_fromFd, reply, sizeof(*reply), deadline );
+
+	if ( status ) {
+		int32_t outSize = reply->m_outputSize;
+		if ( outSize > req->m_maxOutputSize )
+			outSize = req->m_maxOutputSize;
+		if ( outSize < 0 ) {
+			errno  = EBADENGINEER;
+			status = false;
+		}
+		else
+			status = readAll ( w->m_fromFd, out, outSize, deadline );
+	}
+
+	if ( ! status ) {
+		int err = errno;
+		log ( LOG_WARN, "build: Converter worker pid=%" PRId32" failed: "
+		      "%s. Killing it.", (int32_t)w->m_pid, mstrerror(err) );
+		killWorker ( w );
+		errno = err;
+	}
+
+	returnWorker ( i );
+	return status;
+}
+
+//
+// the worker process
+//
+
+// . run the converter and collect its output
+// . sets reply->m_errno on error
+static void runConverter ( const ConverterRequest *req, const char *cmd,
+			   const std::vector<char> &input,
+			   const char *inFile, ConverterReply *reply,
+			   std::vector<char> *out ) {
+	reply->m_errno      = 0;
+	reply->m_status     = 0;
+	reply->m_outputSize = 0;
+
+	if ( req->m_inputAsFile ) {
+		int fd = open ( inFile, O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+		if ( fd < 0 ) {
+			reply->m_errno = errno;
+			return;
+		}
+		bool ok = writeAll ( fd, input.data(), input.size(), 0 );
+		int err = errno;
+		close ( fd );
+		if ( ! ok ) {
+			reply->m_errno = err;
+			unlink ( inFile );
+			return;
+		}
+	}
+
+	int inPipe[2]  = { -1, -1 };
+	int outPipe[2] = { -1, -1 };
+	if ( ( ! req->m_inputAsFile && pipe ( inPipe ) != 0 ) ||
+	     pipe ( outPipe ) != 0 ) {
+		reply->m_errno = errno;
+		if ( inPipe[0] >= 0 ) {
+			close ( inPipe[0] );
+			close ( inPipe[1] );
+		}
+		if ( req->m_inputAsFile ) unlink ( inFile );
+		return;
+	}
+
+	pid_t pid = fork();
+	if ( pid == 0 ) {
+		// a group of its own so we can kill the whole pipeline
+		setpgid ( 0, 0 );
+		int inFd = inPipe[0];
+		if ( req->m_inputAsFile ) inFd = open ( "/dev/null", O_RDONLY );
+		dup2 ( inFd, 0 );
+		dup2 ( outPipe[1], 1 );
+		if ( inPipe[0] >= 0 ) {
+			close ( inPipe[0] );
+			close ( inPipe[1] );
+		}
+		close ( outPipe[0] );
+		close ( outPipe[1] );
+		rlimit rl;
+		if ( req->m_maxMemKB > 0 ) {
+			rl.rlim_cur = rl.rlim_max = (rlim_t)req->m_maxMemKB*1024;
+			setrlimit ( RLIMIT_AS, &rl );
+		}
+		if ( req->m_maxCpu > 0 ) {
+			rl.rlim_cur = rl.rlim_max = req->m_maxCpu;
+			setrlimit ( RLIMIT_CPU, &rl );
+		}
+		if ( req->m_nice ) nice ( req->m_nice );
+		signal ( SIGPIPE, SIG_DFL );
+		execl ( "/bin/sh", "sh", "-c", cmd, "sh", inFile, (char *)NULL );
+		_exit ( 127 );
+	}
+	if ( inPipe[0] >= 0 ) close ( inPipe[0] );
+	close ( outPipe[1] );
+	if ( pid < 0 ) {
+		reply->m_errno = errno;
+		if ( inPipe[1] >= 0 ) close ( inPipe[1] );
+		close ( outPipe[0] );
+		if ( req->m_inputAsFile ) unlink ( inFile );
+		return;
+	}
+
+	// feed the input and read the output at the same time so neither
+	// of us blocks on a full pipe
+	int inFd  = inPipe[1];
+	int outFd = outPipe[0];
+	if ( inFd >= 0 ) fcntl ( inFd, F_SETFL, O_NONBLOCK );
+	fcntl ( outFd, F_SETFL, O_NONBLOCK );
+	int64_t deadline = 0;
+	if ( req->m_timeout > 0 )
+		deadline = getMonotonicMS() + req->m_timeout * 1000;
+	size_t inOff = 0;
+	char buf[64*1024];
+	for ( ; ; ) {
+		if ( inFd >= 0 && inOff == input.size() ) {
+			close ( inFd );
+			inFd = -1;
+		}
+		pollfd pfds[2];
+		int numFds = 0;
+		pfds[numFds].fd = outFd;
+		pfds[numFds].events = POLLIN;
+		pfds[numFds++].revents = 0;
+		if ( inFd >= 0 ) {
+			pfds[numFds].fd = inFd;
+			pfds[numFds].events = POLLOUT;
+			pfds[numFds++].revents = 0;
+		}
+		int timeout = -1;
+		if ( deadline ) {
+			int64_t left = deadline - getMonotonicMS();
+			if ( left <= 0 ) {
+				kill ( -pid, SIGKILL );
+				reply->m_errno = ETIMEDOUT;
+				break;
+			}
+			timeout = (int)left;
+		}
+		int n = poll ( pfds, numFds, timeout );
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n < 0 ) {
+			kill ( -pid, SIGKILL );
+			reply->m_errno = errno;
+			break;
+		}
+		if ( inFd >= 0 && pfds[1].revents ) {
+			ssize_t w = write ( inFd, input.data() + inOff,
+					    input.size() - inOff );
+			// it stopped reading, let it finish anyway
+			if ( w < 0 && errno != EAGAIN && errno != EINTR )
+				inOff = input.size();
+			else if ( w > 0 )
+				inOff += w;
+		}
+		if ( ! pfds[0].revents ) continue;
+		ssize_t r = read ( outFd, buf, sizeof(buf) );
+		if ( r < 0 && ( errno == EAGAIN || errno == EINTR ) ) continue;
+		if ( r <= 0 ) break;
+		// count all of it, but only keep what the caller can take
+		int32_t keep = req->m_maxOutputSize - (int32_t)out->size();
+		if ( keep > r ) keep = r;
+		if ( keep > 0 ) out->insert ( out->end(), buf, buf + keep );
+		reply->m_outputSize += r;
+	}
+	if ( inFd >= 0 ) close ( inFd );
+	close ( outFd );
+
+	int status = 0;
+	while ( waitpid ( pid, &status, 0 ) < 0 && errno == EINTR ) ;
+	reply->m_status = status;
+
+	if ( req->m_inputAsFile ) unlink ( inFile );
+}
+
+int ConverterPool::workerMain ( const char *tmpDir ) {
+	// we got all of gb's open fds, keep just stdin, stdout and stderr
+	DIR *d = opendir ( "/proc/self/fd" );
+	if ( d ) {
+		std::vector<int> fds;
+		int dfd = dirfd ( d );
+		while ( dirent *e = readdir ( d ) ) {
+			int fd = atoi ( e->d_name );
+			if ( fd > 2 && fd != dfd ) fds.push_back ( fd );
+		}
+		closedir ( d );
+		for ( size_t i = 0 ; i < fds.size() ; i++ ) close ( fds[i] );
+	}
+
+	// a converter that stopped reading its input must not kill us
+	signal ( SIGPIPE, SIG_IGN );
+
+	char inFile[1024];
+	snprintf ( inFile, sizeof(inFile), "%sconvert.%" PRId32,
+		   tmpDir ? tmpDir : "/tmp/", (int32_t)getpid() );
+
+	for ( ; ; ) {
+		ConverterRequest req;
+		// gb closed the pipe, we are done
+		if ( ! readAll ( 0, &req, sizeof(req), 0 ) ) return 0;
+		if ( req.m_cmdLen <= 0 || req.m_inputSize < 0 ||
+		     req.m_maxOutputSize < 0 ) {
+			fprintf ( stderr, "convertworker: bad request\n" );
+			return 1;
+		}
+		std::string cmd ( req.m_cmdLen, '\0' );
+		std::vector<char> input ( req.m_inputSize );
+		if ( ! readAll ( 0, &cmd[0], req.m_cmdLen, 0 ) ||
+		     ! readAll ( 0, input.data(), req.m_inputSize, 0 ) )
+			return 0;
+
+		ConverterReply reply;
+		std::vector<char> out;
+		runConverter ( &req, cmd.c_str(), input, inFile, &reply, &out );
+
+		if ( ! writeAll ( 1, &reply, sizeof(reply), 0 ) ||
+		     ! writeAll ( 1, out.data(), out.size(), 0 ) )
+			return 0;
+	}
+}
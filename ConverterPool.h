@@ -0,0 +1,95 @@
+// . a pool of long-lived converter worker processes
+// . XmlDoc (pdf/doc/xls/ppt/ps to html) and Images (thumbnails) used to
+//   call system() for every document, which forks the whole gb process
+//   and passes the data through temp files
+// . now a job thread hands the content to an idle worker over a pipe, the
+//   worker runs the converter with the time and memory limits of the
+//   request and sends the converter's stdout back over the pipe
+// . a worker is a small "gb convertworker" process spawned on first use,
+//   so forking the converters is cheap, and is reused across documents
+// . a worker that times out or dies is killed and respawned on next use
+
+#ifndef GB_CONVERTERPOOL_H
+#define GB_CONVERTERPOOL_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+#define MAX_CONVERTER_WORKERS 32
+
+// what a worker reads from its stdin, followed by the command and input
+struct ConverterRequest {
+	// the /bin/sh command to run. it reads the input from stdin, or
+	// from the file named by $1 if m_inputAsFile is set
+	int32_t m_cmdLen;
+	int32_t m_inputSize;
+	// most output bytes to send back
+	int32_t m_maxOutputSize;
+	// kill the converter after this many seconds, 0 for no limit
+	int32_t m_timeout;
+	// RLIMIT_AS of the converter in kilobytes, 0 for no limit
+	int32_t m_maxMemKB;
+	// RLIMIT_CPU of the converter in seconds, 0 for no limit
+	int32_t m_maxCpu;
+	int32_t m_nice;
+	char    m_inputAsFile;
+};
+
+// what a worker writes to its stdout, followed by the output
+struct ConverterReply {
+	// 0 or an errno if the worker could not run the converter
+	int32_t m_errno;
+	// exit status of the converter as returned by waitpid()
+	int32_t m_status;
+	// all output of the converter. only up to m_maxOutputSize bytes of
+	// it follow the reply.
+	int32_t m_outputSize;
+};
+
+class ConverterPool {
+public:
+	ConverterPool();
+
+	// kill the workers
+	void reset();
+
+	// . run "req" in a worker, blocking until it is done
+	// . only call this from a job thread
+	// . fills "out" with up to req->m_maxOutputSize bytes of output
+	// . returns false and sets errno on error
+	bool convert ( const ConverterRequest *req, const char *cmd,
+		       const char *input, char *out, ConverterReply *reply );
+
+	// the main() of the "gb convertworker <tmpdir>" process
+	static int workerMain ( const char *tmpDir );
+
+	// pid of worker #i, -1 if it is not running
+	pid_t getWorkerPid ( int32_t i ) const { return m_workers[i].m_pid; }
+
+	// give a worker this much more time than its converter before we
+	// decide it is hung
+	int32_t m_extraTimeoutMS;
+
+private:
+	struct Worker {
+		pid_t m_pid;
+		// our end of the worker's stdin and stdout
+		int   m_toFd;
+		int   m_fromFd;
+		bool  m_busy;
+	};
+
+	int32_t getWorker ( );
+	void returnWorker ( int32_t i );
+	bool spawnWorker ( Worker *w );
+	void killWorker ( Worker *w );
+
+	Worker m_workers[MAX_CONVERTER_WORKERS];
+	pthread_mutex_t m_mtx;
+	pthread_cond_t  m_cond;
+};
+
+extern ConverterPool g_converterPool;
+
+#endif // GB_CONVERTERPOOL_H
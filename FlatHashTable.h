@@ -0,0 +1,354 @@
+// . open addressing hash table with the key size fixed at compile time
+// . a drop-in for the HashTableX tables on hot paths that have no dups,
+//   it has the same set(), addKey(), isInTable(), getValue() and slot
+//   calls so moving a table over is mostly changing its type
+// . every slot has a control byte, kept apart from the keys and values:
+//   0x80 if empty, 0xfe if deleted or else 7 bits of the key's hash.
+//   a lookup checks the 16 control bytes of a group at once with sse2 and
+//   only compares the keys whose 7 bits match, so most lookups touch one
+//   cache line of control bytes and one key
+// . groups are probed in a triangular sequence, which visits them all
+//   because the number of groups is a power of 2
+// . keys are hashed, so unlike HashTableX they need not be random already
+
+#ifndef GB_FLATHASHTABLE_H
+#define GB_FLATHASHTABLE_H
+
+#include "gb-include.h"
+#include "Mem.h"
+#include "Sanity.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FHT_EMPTY      ((char)0x80)
+#define FHT_DELETED    ((char)0xfe)
+#define FHT_GROUP_SIZE 16
+
+template<int32_t KS>
+class FlatHashTable {
+
+ public:
+
+	FlatHashTable ( ) {
+		m_ctrl = NULL;
+		m_keys = NULL;
+		m_vals = NULL;
+		m_numSlots = 0;
+		m_numSlotsUsed = 0;
+		m_numDeleted = 0;
+		m_ds = 0;
+		m_buf = NULL;
+		m_bufSize = 0;
+		m_doFree = false;
+		m_isInitialized = false;
+		m_niceness = 0;
+		m_allocName = "FlatHashTable";
+	}
+
+	~FlatHashTable ( ) { reset(); }
+
+	// . same args as HashTableX::set(), "ks" must be KS and there can be
+	//   no dups
+	// . "initialNumSlots" slots are made, the table grows once it is
+	//   7/8 full
+	// . returns false and sets g_errno on error
+	bool set ( int32_t ks , int32_t ds , int32_t initialNumSlots ,
+		   char *buf , int32_t bufSize , bool allowDups ,
+		   int32_t niceness , const char *allocName ) {
+		reset();
+		if ( ks != KS || ds < 0 || allowDups ) gbshutdownAbort(true);
+		m_ds = ds;
+		m_niceness = niceness;
+		m_allocName = allocName;
+		m_isInitialized = true;
+		return setTableSize ( initialNumSlots , buf , bufSize );
+	}
+
+	// like HashTableX, true after set() even if reset() since
+	bool isInitialized ( ) const { return m_isInitialized; }
+
+	// frees the used memory
+	void reset ( ) {
+		if ( m_doFree && m_buf ) mfree ( m_buf , m_bufSize , m_allocName );
+		m_buf = NULL;
+		m_bufSize = 0;
+		m_doFree = false;
+		m_ctrl = NULL;
+		m_keys = NULL;
+		m_vals = NULL;
+		m_numSlots = 0;
+		m_numSlotsUsed = 0;
+		m_numDeleted = 0;
+	}
+
+	// removes all key/value pairs, keeps the memory
+	void clear ( ) {
+		if ( m_ctrl ) memset ( m_ctrl , FHT_EMPTY , m_numSlots );
+		m_numSlotsUsed = 0;
+		m_numDeleted = 0;
+	}
+
+	// . add key/value, replacing the value if the key is there
+	// . will grow the table if it needs to
+	// . returns false and sets g_errno on error
+	bool addKey ( const void *key , const void *val , int32_t *slot = NULL ) {
+		uint64_t h = hashKey ( key );
+		int32_t n = findSlot ( key , h );
+		if ( n < 0 ) {
+			// keep at least one empty slot per 8 so lookups end
+			if ( 8 * ( m_numSlotsUsed + m_numDeleted + 1 ) >
+			     7 * m_numSlots ) {
+				// just drop the deleted slots if that does it
+				int32_t grow = m_numSlots;
+				if ( 2 * m_numDeleted < m_numSlotsUsed )
+					grow *= 2;
+				if ( ! setTableSize ( grow , NULL , 0 ) )
+					return false;
+			}
+			n = findFreeSlot ( h );
+			if ( m_ctrl[n] == FHT_DELETED ) m_numDeleted--;
+			m_ctrl[n] = (char)( h & 0x7f );
+			memcpy ( m_keys + (int64_t)n * KS , key , KS );
+			m_numSlotsUsed++;
+		}
+		if ( val ) setValue ( n , val );
+		if ( slot ) *slot = n;
+		return true;
+	}
+
+	// for value-less tables
+	bool addKey ( const void *key ) {
+		if ( m_ds != 0 ) gbshutdownAbort(true);
+		return addKey ( key , NULL , NULL );
+	}
+
+	bool removeKey ( const void *key ) {
+		return removeSlot ( getSlot ( key ) );
+	}
+
+	bool removeSlot ( int32_t n ) {
+		if ( n < 0 || isEmpty ( n ) ) return true;
+		// . no probe for a key can have gone past a group with an empty
+		//   slot, so the slot can just be empty again
+		// . otherwise mark it deleted so the probes keep going
+		const char *group = m_ctrl + ( n & ~(FHT_GROUP_SIZE - 1) );
+		if ( matchByte ( group , FHT_EMPTY ) ) {
+			m_ctrl[n] = FHT_EMPTY;
+		}
+		else {
+			m_ctrl[n] = FHT_DELETED;
+			m_numDeleted++;
+		}
+		m_numSlotsUsed--;
+		return true;
+	}
+
+	bool deleteSlot ( int32_t n ) { return removeSlot ( n ); }
+
+	// returns -1 if key not in table
+	int32_t getSlot ( const void *key ) const {
+		if ( m_numSlots <= 0 ) return -1;
+		return findSlot ( key , hashKey ( key ) );
+	}
+
+	// returns NULL if key not in table
+	void *getValue ( const void *key ) {
+		int32_t n = getSlot ( key );
+		if ( n < 0 ) return NULL;
+		return m_vals + (int64_t)n * m_ds;
+	}
+
+	bool isInTable ( const void *key ) const { return ( getSlot(key) >= 0 ); }
+
+	bool isEmpty ( const void *key ) const { return ( getSlot(key) < 0 ); }
+
+	// the slot is empty or deleted
+	bool isEmpty ( int32_t n ) const { return ( m_ctrl[n] & 0x80 ); }
+
+	bool isTableEmpty ( ) const { return ( m_numSlotsUsed == 0 ); }
+
+	void *      getKeyFromSlot ( int32_t n )       { return m_keys + (int64_t)n * KS; }
+	const void *getKeyFromSlot ( int32_t n ) const { return m_keys + (int64_t)n * KS; }
+
+	void *      getValueFromSlot ( int32_t n )       { return m_vals + (int64_t)n * m_ds; }
+	const void *getValueFromSlot ( int32_t n ) const { return m_vals + (int64_t)n * m_ds; }
+
+	void setValue ( int32_t n , const void *val ) {
+		if      ( m_ds == 4 ) memcpy ( m_vals + (int64_t)n * 4 , val , 4 );
+		else if ( m_ds == 8 ) memcpy ( m_vals + (int64_t)n * 8 , val , 8 );
+		else    memcpy ( m_vals + (int64_t)n * m_ds , val , m_ds );
+	}
+
+	int32_t getNumSlots     ( ) const { return m_numSlots; }
+	int32_t getNumSlotsUsed ( ) const { return m_numSlotsUsed; }
+	int32_t getNumUsedSlots ( ) const { return m_numSlotsUsed; }
+
+	// . make room for "numSlots" slots, rounded up to a power of 2 and
+	//   to hold the keys we have, and re-add the keys
+	// . uses "buf" if it is big enough, see getBufSize()
+	// . returns false and sets g_errno on error
+	bool setTableSize ( int32_t numSlots , char *buf , int32_t bufSize ) {
+		int64_t n = FHT_GROUP_SIZE;
+		while ( n < numSlots || 8 * m_numSlotsUsed > 7 * n ) n *= 2;
+		if ( n > 0x40000000 ) gbshutdownAbort(true);
+		int64_t need = getBufSize ( n , m_ds );
+
+		char *oldBuf     = m_buf;
+		int32_t oldBufSize = m_bufSize;
+		bool  oldDoFree  = m_doFree;
+		char *oldCtrl    = m_ctrl;
+		char *oldKeys    = m_keys;
+		char *oldVals    = m_vals;
+		int32_t oldNumSlots = m_numSlots;
+
+		if ( buf && bufSize >= need ) {
+			m_buf = buf;
+			m_bufSize = bufSize;
+			m_doFree = false;
+		}
+		else {
+			m_buf = (char *)mmalloc ( need , m_allocName );
+			if ( ! m_buf ) {
+				m_buf = oldBuf;
+				return false;
+			}
+			m_bufSize = need;
+			m_doFree = true;
+		}
+
+		m_ctrl = m_buf;
+		m_keys = m_buf + n;
+		m_vals = m_keys + n * KS;
+		m_numSlots = n;
+		memset ( m_ctrl , FHT_EMPTY , n );
+		m_numSlotsUsed = 0;
+		m_numDeleted = 0;
+
+		// re-add the old keys, they are unique so just find a free slot
+		for ( int32_t i = 0 ; i < oldNumSlots ; i++ ) {
+			if ( oldCtrl[i] & 0x80 ) continue;
+			const char *key = oldKeys + (int64_t)i * KS;
+			uint64_t h = hashKey ( key );
+			int32_t slot = findFreeSlot ( h );
+			m_ctrl[slot] = (char)( h & 0x7f );
+			memcpy ( m_keys + (int64_t)slot * KS , key , KS );
+			if ( m_ds )
+				memcpy ( m_vals + (int64_t)slot * m_ds ,
+					 oldVals + (int64_t)i * m_ds , m_ds );
+			m_numSlotsUsed++;
+		}
+
+		if ( oldDoFree && oldBuf ) mfree ( oldBuf , oldBufSize , m_allocName );
+		return true;
+	}
+
+	// bytes needed for a table of "numSlots" slots, a power of 2
+	static int64_t getBufSize ( int64_t numSlots , int32_t ds ) {
+		return numSlots * ( 1 + KS + ds );
+	}
+
+ private:
+
+	FlatHashTable ( const FlatHashTable & );
+	FlatHashTable& operator= ( const FlatHashTable & );
+
+	static uint64_t hashKey ( const void *key ) {
+		const char *p = (const char *)key;
+		uint64_t h = KS;
+		int32_t i = 0;
+		for ( ; i + 8 <= KS ; i += 8 ) {
+			uint64_t w;
+			memcpy ( &w , p + i , 8 );
+			h = ( h ^ w ) * 0x9e3779b97f4a7c15ULL;
+			h ^= h >> 32;
+		}
+		if ( i < KS ) {
+			uint64_t w = 0;
+			memcpy ( &w , p + i , KS - i );
+			h = ( h ^ w ) * 0x9e3779b97f4a7c15ULL;
+		}
+		// murmur3 finalizer
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// bit i is set if control byte i of the group is "c"
+	static uint32_t matchByte ( const char *group , char c ) {
+#ifdef __SSE2__
+		__m128i v = _mm_loadu_si128 ( (const __m128i *)group );
+		return _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( v , _mm_set1_epi8(c) ) );
+#else
+		uint32_t mask = 0;
+		for ( int32_t i = 0 ; i < FHT_GROUP_SIZE ; i++ )
+			if ( group[i] == c ) mask |= 1U << i;
+		return mask;
+#endif
+	}
+
+	// bit i is set if slot i of the group is empty or deleted
+	static uint32_t matchFree ( const char *group ) {
+#ifdef __SSE2__
+		return _mm_movemask_epi8 ( _mm_loadu_si128 ( (const __m128i *)group ) );
+#else
+		uint32_t mask = 0;
+		for ( int32_t i = 0 ; i < FHT_GROUP_SIZE ; i++ )
+			if ( group[i] & 0x80 ) mask |= 1U << i;
+		return mask;
+#endif
+	}
+
+	int32_t findSlot ( const void *key , uint64_t h ) const {
+		if ( m_numSlots <= 0 ) return -1;
+		uint32_t groupMask = m_numSlots / FHT_GROUP_SIZE - 1;
+		uint32_t g = (uint32_t)( h >> 7 ) & groupMask;
+		char h2 = (char)( h & 0x7f );
+		for ( uint32_t step = 1 ; step <= groupMask + 1 ; step++ ) {
+			const char *group = m_ctrl + g * FHT_GROUP_SIZE;
+			uint32_t match = matchByte ( group , h2 );
+			while ( match ) {
+				int32_t n = g * FHT_GROUP_SIZE + __builtin_ctz ( match );
+				if ( memcmp ( m_keys + (int64_t)n * KS , key , KS ) == 0 )
+					return n;
+				match &= match - 1;
+			}
+			if ( matchByte ( group , FHT_EMPTY ) ) return -1;
+			g = ( g + step ) & groupMask;
+		}
+		return -1;
+	}
+
+	// the table must have a free slot
+	int32_t findFreeSlot ( uint64_t h ) const {
+		uint32_t groupMask = m_numSlots / FHT_GROUP_SIZE - 1;
+		uint32_t g = (uint32_t)( h >> 7 ) & groupMask;
+		for ( uint32_t step = 1 ; ; step++ ) {
+			uint32_t match = matchFree ( m_ctrl + g * FHT_GROUP_SIZE );
+			if ( match ) return g * FHT_GROUP_SIZE + __builtin_ctz ( match );
+			g = ( g + step ) & groupMask;
+		}
+	}
+
+	char    *m_ctrl;
+	char    *m_keys;
+	char    *m_vals;
+	int32_t  m_numSlots;
+	int32_t  m_numSlotsUsed;
+	int32_t  m_numDeleted;
+	int32_t  m_ds;
+
+	char    *m_buf;
+	int32_t  m_bufSize;
+	bool     m_doFree;
+	bool     m_isInitialized;
+	int32_t  m_niceness;
+	const char *m_allocName;
+};
+
+#endif // GB_FLATHASHTABLE_H
@@ -1,7 +1,6 @@
 #include "gb-include.h"
 
 #include "HashTableT.h"
-#include "Profiler.h" //For fnInfo struct
 #include "Title.h" // For Title::InLinkInfo
 #include "Dns.h"
 #include "types.h"
@@ -518,9 +517,6 @@ template class HashTableT<int64_t , bool>;
 template class HashTableT<uint64_t, float>;
 template class HashTableT<uint64_t, char>;
 template class HashTableT<uint32_t, char*>;
-template class HashTableT<uint32_t, FnInfo>;
-template class HashTableT<uint32_t, FnInfo*>;
-template class HashTableT<uint32_t, QuickPollInfo*>;
 template class HashTableT<uint32_t, HashTableT<uint64_t, float>* >;
 template class HashTableT<int64_t, char>;
 template class HashTableT<uint32_t, int64_t>;
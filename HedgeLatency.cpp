@@ -0,0 +1,93 @@
+#include "gb-include.h"
+
+#include "HedgeLatency.h"
+#include "Conf.h"
+#include <algorithm>
+#include <vector>
+
+// upper bound in ms of each bucket, each about 8% above the previous one.
+// everything above s_maxDelay goes into the last bucket.
+struct BucketBounds {
+	int32_t m_bound [ HedgeLatency::s_numBuckets ];
+
+	BucketBounds ( ) {
+		int32_t b = HedgeLatency::s_minDelay;
+		for ( int32_t i = 0 ; i < HedgeLatency::s_numBuckets ; i++ ) {
+			m_bound[i] = b;
+			if ( b > HedgeLatency::s_maxDelay )
+				m_bound[i] = HedgeLatency::s_maxDelay;
+			int32_t next = ( b * 108 + 99 ) / 100;
+			b = next > b ? next : b + 1;
+		}
+		m_bound[HedgeLatency::s_numBuckets-1] = INT32_MAX;
+	}
+};
+
+static const BucketBounds s_bounds;
+
+HedgeLatency::HedgeLatency ( ) : m_cur(0), m_delay(-1) {
+	resetWindow ( 0 );
+	resetWindow ( 1 );
+}
+
+void HedgeLatency::resetWindow ( int32_t w ) {
+	memset ( m_counts[w] , 0 , sizeof(m_counts[w]) );
+	m_total[w] = 0;
+}
+
+void HedgeLatency::record ( int64_t ms ) {
+	if ( ms < 0 ) ms = 0;
+	if ( ms > s_maxDelay ) ms = s_maxDelay + 1;
+	const int32_t *bounds = s_bounds.m_bound;
+	int32_t b = std::lower_bound ( bounds , bounds + s_numBuckets ,
+				       (int32_t)ms ) - bounds;
+	m_counts[m_cur][b]++;
+	uint32_t n = ++m_total[m_cur];
+	if ( n >= s_windowSize ) {
+		m_delay = getPercentile ( m_cur );
+		m_cur ^= 1;
+		resetWindow ( m_cur );
+	}
+	// do not wait for the first window to fill up
+	else if ( m_delay < 0 && n >= s_minSamples && n % 64 == 0 )
+		m_delay = getPercentile ( m_cur );
+}
+
+// . the response time "percentile" percent of the requests in window "w"
+//   were faster than
+// . do not flood the twins when everything is fast, and the regular
+//   reroute in sleepWrapper1() handles really slow hosts
+int32_t HedgeLatency::getPercentile ( int32_t w ) const {
+	int32_t percentile = g_conf.m_hedgePercentile;
+	if ( percentile > 100 ) percentile = 100;
+	if ( percentile < 0   ) percentile = 0;
+	uint64_t want = ( (uint64_t)m_total[w] * percentile + 99 ) / 100;
+	if ( want < 1 ) want = 1;
+	uint64_t sum = 0;
+	int32_t b = 0;
+	for ( ; b < s_numBuckets - 1 ; b++ ) {
+		sum += m_counts[w][b];
+		if ( sum >= want ) break;
+	}
+	int32_t ms = s_bounds.m_bound[b];
+	if ( ms > s_maxDelay ) ms = s_maxDelay;
+	return ms;
+}
+
+// only the msg types of a query get hedged
+static std::vector<HedgeLatency> s_hedgeLatency39;
+static std::vector<HedgeLatency> s_hedgeLatency20;
+static std::vector<HedgeLatency> s_hedgeLatency0;
+
+HedgeLatency *getHedgeLatency ( int32_t hostId , msg_type_t msgType ) {
+	std::vector<HedgeLatency> *v;
+	switch ( msgType ) {
+		case msg_type_39: v = &s_hedgeLatency39; break;
+		case msg_type_20: v = &s_hedgeLatency20; break;
+		case msg_type_0:  v = &s_hedgeLatency0;  break;
+		default:          return NULL;
+	}
+	if ( hostId < 0 ) return NULL;
+	if ( (size_t)hostId >= v->size() ) v->resize ( hostId + 1 );
+	return &(*v)[hostId];
+}
@@ -0,0 +1,44 @@
+#ifndef GB_HEDGELATENCY_H
+#define GB_HEDGELATENCY_H
+
+#include "MsgType.h"
+#include <inttypes.h>
+
+// . response times of the requests of one msg type to one host, in ms
+// . we record into one window while the hedge delay is taken from the
+//   last full window, so the delay follows the current load of the host
+// . a host that is always slower than its twins, because it has a bigger
+//   shard or slower disks, gets a longer delay instead of being hedged
+//   on every request
+// . the counts are kept in buckets about 8% wide between the smallest and
+//   largest delay we use, so there can be one of these for every host
+class HedgeLatency {
+public:
+	HedgeLatency();
+
+	void record ( int64_t ms );
+
+	// -1 if we do not know enough yet
+	int32_t getDelay ( ) const { return m_delay; }
+
+	static const int32_t s_minDelay = 5;
+	static const int32_t s_maxDelay = 2000;
+	static const uint32_t s_windowSize = 2000;
+	static const uint32_t s_minSamples = 200;
+	static const int32_t s_numBuckets = 80;
+
+private:
+	void    resetWindow ( int32_t w );
+	int32_t getPercentile ( int32_t w ) const;
+
+	uint32_t m_counts [ 2 ] [ s_numBuckets ];
+	uint32_t m_total  [ 2 ];
+	int32_t  m_cur;
+	int32_t  m_delay;
+};
+
+// . the HedgeLatency of "hostId" for "msgType"
+// . returns NULL if we do not hedge requests of "msgType"
+HedgeLatency *getHedgeLatency ( int32_t hostId , msg_type_t msgType );
+
+#endif // GB_HEDGELATENCY_H
@@ -1296,6 +1296,42 @@ bool Hostdb::isDead ( Host *h ) {
 	return true;
 }
 
+// weight of the newest reply in the moving average of the reply times
+static const float s_replyTimeWeight = 0.2;
+// a reply time this old only counts half
+static const int64_t s_replyTimeHalfLife = 5000;
+
+void Hostdb::noteRequestSent ( Host *h , msg_type_t msgType ) {
+	h->m_outstanding[msgType]++;
+}
+
+void Hostdb::noteReplyReceived ( Host *h , msg_type_t msgType , int64_t took ,
+				 int64_t nowms ) {
+	// the host may have been replaced while the request was out
+	if ( h->m_outstanding[msgType] > 0 ) h->m_outstanding[msgType]--;
+	// a cancelled request tells us nothing about the host
+	if ( took < 0 ) return;
+	float avg = h->m_avgReplyTime[msgType];
+	if ( avg <= 0 ) avg = took;
+	else            avg += s_replyTimeWeight * ( took - avg );
+	// 0 means no replies yet
+	if ( avg < 0.1 ) avg = 0.1;
+	h->m_avgReplyTime [msgType] = avg;
+	h->m_lastReplyTime[msgType] = nowms;
+}
+
+// . the average reply time times the requests already queued on the host
+// . the average fades out when we have not heard from the host in a while
+//   so a host that was slow gets another chance once it recovered
+double Hostdb::getLoadScore ( Host *h , msg_type_t msgType , int64_t nowms ) {
+	double avg = h->m_avgReplyTime[msgType];
+	if ( avg <= 0 ) return 0;
+	int64_t age = nowms - h->m_lastReplyTime[msgType];
+	if ( age > s_replyTimeHalfLife )
+		avg = avg * s_replyTimeHalfLife / age;
+	return avg * ( 1 + h->m_outstanding[msgType] );
+}
+
 int64_t Hostdb::getNumGlobalRecs ( ) {
 	int64_t n = 0;
 	for ( int32_t i = 0 ; i < m_numHosts ; i++ )
@@ -1379,6 +1415,8 @@ bool Hostdb::replaceHost ( int32_t origHostId, int32_t spareHostId ) {
 	oldHost->m_repairMode          = 0;
 	oldHost->m_splitsDone          = 0;
 	oldHost->m_splitTimes          = 0;
+	memset ( oldHost->m_avgReplyTime  , 0 , sizeof(oldHost->m_avgReplyTime) );
+	memset ( oldHost->m_lastReplyTime , 0 , sizeof(oldHost->m_lastReplyTime) );
 
 	// write this hosts conf out
 	saveHostsConf();
@@ -16,6 +16,8 @@
 #include <net/if.h>               // for struct ifreq passed to ioctl()    
 #include "Xml.h" // host file in xml
 #include "Sanity.h"
+#include "MsgType.h"
+#include "UdpProtocol.h" // MAX_MSG_TYPES
 
 
 enum {
@@ -207,6 +209,14 @@ public:
 	int32_t           m_splitsDone;
 	int64_t      m_splitTimes;
 
+	// . moving average of how long this host took to reply to our
+	//   multicast requests in ms, by msg type. 0 if we have no replies yet
+	// . Multicast uses these to pick the least loaded twin
+	float          m_avgReplyTime  [ MAX_MSG_TYPES ];
+	int64_t      m_lastReplyTime [ MAX_MSG_TYPES ];
+	// our requests to this host still waiting for a reply, by msg type
+	int16_t        m_outstanding   [ MAX_MSG_TYPES ];
+
 	// . the hostdb to which this host belongs!
 	// . getHost(ip,port) will return a Host ptr from either 
 	//   g_hostdb or g_hostdb2, so UdpServer.cpp needs to know which it
@@ -292,6 +302,16 @@ class Hostdb {
 
 	bool kernelErrors (Host *h) { return h->m_pingInfo.m_kernelErrors; }
 
+	// . keep track of the response times and outstanding requests of
+	//   the hosts we multicast to
+	void noteRequestSent ( Host *h , msg_type_t msgType );
+	// . "took" is -1 if the request was cancelled
+	void noteReplyReceived ( Host *h , msg_type_t msgType , int64_t took ,
+				 int64_t nowms );
+	// . expected cost of sending a request of msgType to this host now,
+	//   lower is better. 0 if we know nothing about the host
+	double getLoadScore ( Host *h , msg_type_t msgType , int64_t nowms );
+
 	int64_t getNumGlobalRecs ( );
 
 	bool isShardDead ( int32_t shardNum ) ;
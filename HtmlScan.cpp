@@ -0,0 +1,94 @@
+#include "gb-include.h"
+
+#include "HtmlScan.h"
+#include "XmlNode.h" // isTagStart()
+
+int32_t htmlPrepareContent ( char *s , int32_t slen ) {
+	int32_t count = 0;
+	int32_t i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lt   = _mm_set1_epi8 ( '<' );
+	const __m128i sp   = _mm_set1_epi8 ( ' ' );
+	for ( ; i + 16 <= slen ; i += 16 ) {
+		__m128i v = _mm_loadu_si128 ( (const __m128i *)(s + i) );
+		__m128i isNul = _mm_cmpeq_epi8 ( v , zero );
+		if ( _mm_movemask_epi8 ( isNul ) ) {
+			v = _mm_or_si128 ( _mm_andnot_si128 ( isNul , v ) ,
+					   _mm_and_si128 ( isNul , sp ) );
+			_mm_storeu_si128 ( (__m128i *)(s + i) , v );
+		}
+		count += __builtin_popcount (
+			_mm_movemask_epi8 ( _mm_cmpeq_epi8 ( v , lt ) ) );
+	}
+#endif
+	for ( ; i < slen ; i++ ) {
+		if ( s[i] == '\0' ) s[i] = ' ';
+		else if ( s[i] == '<' ) count++;
+	}
+	return count;
+}
+
+// . count the word starts in the first "n" bytes of a block
+// . bit i of "high" and "alnum" is set if byte i is non-ascii or an ascii
+//   alnum, *prevHigh and *prevAlnum are the bits of the byte before
+static inline int32_t countWordStarts ( uint32_t high , uint32_t alnum ,
+					int32_t n ,
+					uint32_t *prevHigh ,
+					uint32_t *prevAlnum ) {
+	uint32_t mask = ( n >= 32 ) ? 0xffffffff : ( (1U << n) - 1 );
+	uint32_t starts = high | ( high << 1 ) | *prevHigh |
+			  ( alnum ^ ( ( alnum << 1 ) | *prevAlnum ) );
+	*prevHigh  = ( high  >> (n - 1) ) & 1;
+	*prevAlnum = ( alnum >> (n - 1) ) & 1;
+	return __builtin_popcount ( starts & mask );
+}
+
+int32_t htmlScanText ( const char *s , const char *end , bool stopAtTags ,
+		       int32_t *maxNumWords ) {
+	const char *p = s;
+	int32_t count = 0;
+	// the first byte always starts a word
+	uint32_t prevHigh  = 1;
+	uint32_t prevAlnum = 0;
+#ifdef __SSE2__
+	const __m128i lt = _mm_set1_epi8 ( '<' );
+	while ( p + 16 <= end ) {
+		__m128i v = _mm_loadu_si128 ( (const __m128i *)p );
+		uint32_t high  = _mm_movemask_epi8 ( v );
+		uint32_t alnum = getAsciiAlnumMask ( v );
+		uint32_t tags  = 0;
+		if ( stopAtTags )
+			tags = _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( v , lt ) );
+		if ( ! tags ) {
+			count += countWordStarts ( high , alnum , 16 ,
+						   &prevHigh , &prevAlnum );
+			p += 16;
+			continue;
+		}
+		// stop at the first '<' that starts a tag
+		int32_t n = __builtin_ctz ( tags );
+		if ( isTagStart ( p + n ) ) {
+			if ( n > 0 )
+				count += countWordStarts ( high , alnum , n ,
+							   &prevHigh ,
+							   &prevAlnum );
+			*maxNumWords = count;
+			return p + n - s;
+		}
+		// it is just punct, include it
+		count += countWordStarts ( high , alnum , n + 1 ,
+					   &prevHigh , &prevAlnum );
+		p += n + 1;
+	}
+#endif
+	for ( ; p < end ; p++ ) {
+		if ( stopAtTags && *p == '<' && isTagStart ( p ) ) break;
+		uint32_t high  = ( *p & 0x80 ) ? 1 : 0;
+		uint32_t alnum = is_alnum_a ( *p ) ? 1 : 0;
+		count += countWordStarts ( high , alnum , 1 ,
+					   &prevHigh , &prevAlnum );
+	}
+	*maxNumWords = count;
+	return p - s;
+}
@@ -0,0 +1,83 @@
+// . byte scanning of html/xml content done 16 bytes at a time with sse2
+//   where we have it
+// . Xml::set() uses these to make its nodes in one pass over the content
+//   and to size the Words arrays of the text nodes while it finds them, so
+//   Words::set() does not have to walk the content again just to count
+// . Words::addWords() uses them to find the ends of ascii words
+
+#ifndef GB_HTMLSCAN_H
+#define GB_HTMLSCAN_H
+
+#include <inttypes.h>
+#include "fctypes.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// . replace the \0 bytes in "s" with spaces, utf8 has none
+// . returns the number of '<' in "s", the most tags it can have
+int32_t htmlPrepareContent ( char *s , int32_t slen );
+
+// . returns the length of the text starting at "s", up to "end" or, if
+//   "stopAtTags" is true, the first '<' that isTagStart()
+// . sets *maxNumWords to the most words, alnum and punct, that
+//   Words::addWords() can make of that text
+// . the bound counts every position where the ascii alnum class changes
+//   and every position in or right after a non-ascii char. the extensions
+//   in addWords(), like "c++" and "1,000", start at most one word after a
+//   position they swallowed, so they are covered.
+// . "end" must point to a \0 if "stopAtTags" is true, isTagStart() looks
+//   a few bytes past the '<'
+int32_t htmlScanText ( const char *s , const char *end , bool stopAtTags ,
+		       int32_t *maxNumWords );
+
+#ifdef __SSE2__
+// bit i is set if byte i of "v" is an ascii alnum
+static inline uint32_t getAsciiAlnumMask ( __m128i v ) {
+	// non-ascii bytes are negative so they fail these compares
+	__m128i digit = _mm_and_si128 ( _mm_cmpgt_epi8(v,_mm_set1_epi8('0'-1)),
+					_mm_cmplt_epi8(v,_mm_set1_epi8('9'+1)) );
+	__m128i lower = _mm_or_si128 ( v , _mm_set1_epi8 ( 0x20 ) );
+	__m128i alpha = _mm_and_si128 (
+		_mm_cmpgt_epi8 ( lower , _mm_set1_epi8 ( 'a' - 1 ) ) ,
+		_mm_cmplt_epi8 ( lower , _mm_set1_epi8 ( 'z' + 1 ) ) );
+	return _mm_movemask_epi8 ( _mm_or_si128 ( digit , alpha ) );
+}
+#endif
+
+// . the number of ascii alnum bytes starting at "s", not past "end"
+// . Words::addWords() skips over the ascii part of words with this and
+//   only decodes utf8 and looks up UCProps for the rest
+static inline int32_t htmlAsciiAlnumRun ( const char *s , const char *end ) {
+	const char *p = s;
+#ifdef __SSE2__
+	for ( ; p + 16 <= end ; p += 16 ) {
+		__m128i v = _mm_loadu_si128 ( (const __m128i *)p );
+		uint32_t alnum = getAsciiAlnumMask ( v );
+		if ( alnum != 0xffff )
+			return p + __builtin_ctz ( ~alnum ) - s;
+	}
+#endif
+	while ( p < end && is_ascii3 ( *p ) && is_alnum_a ( *p ) ) p++;
+	return p - s;
+}
+
+// . same for ascii punct bytes, stops at a \0 too
+static inline int32_t htmlAsciiPunctRun ( const char *s , const char *end ) {
+	const char *p = s;
+#ifdef __SSE2__
+	for ( ; p + 16 <= end ; p += 16 ) {
+		__m128i v = _mm_loadu_si128 ( (const __m128i *)p );
+		uint32_t stop = getAsciiAlnumMask ( v ) |
+			_mm_movemask_epi8 ( v ) |
+			_mm_movemask_epi8 ( _mm_cmpeq_epi8 ( v , _mm_setzero_si128() ) );
+		if ( stop )
+			return p + __builtin_ctz ( stop ) - s;
+	}
+#endif
+	while ( p < end && *p && is_ascii3 ( *p ) && ! is_alnum_a ( *p ) ) p++;
+	return p - s;
+}
+
+#endif // GB_HTMLSCAN_H
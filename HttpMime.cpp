@@ -762,7 +762,8 @@ void HttpMime::makeMime  ( int32_t    totalContentLen    ,
 			   const char   *contentType        ,
 			   const char   *charset            ,
 			   int32_t    httpStatus         ,
-			   const char   *cookie             ) {
+			   const char   *cookie             ,
+			   bool    keepAlive          ) {
 	// assume UTF-8
 	//if ( ! charset ) charset = "utf-8";
 	// . make the content type line
@@ -831,6 +832,9 @@ void HttpMime::makeMime  ( int32_t    totalContentLen    ,
 			   timeStruct );
 		pns = tmp;
 	}
+	// the client can only tell where the reply ends if we give the length
+	if ( totalContentLen < 0 ) keepAlive = false;
+	const char *conn = keepAlive ? "Keep-Alive" : "Close";
 	// . set httpStatus
 	// . a reply to a POST (not a GET or HEAD) should be 201
 	char *p = m_buf;
@@ -849,7 +853,7 @@ void HttpMime::makeMime  ( int32_t    totalContentLen    ,
 			  "Content-Length: %" PRId32"\r\n"
 			  //"Expires: Wed, 23 Dec 2003 10:23:01 GMT\r\n"
 			  //"Expires: -1\r\n"
-			  "Connection: Close\r\n"
+			  "Connection: %s\r\n"
 			  "%s"
 			  "Content-Type: %s\r\n",
 			  //"Connection: Keep-Alive\r\n"
@@ -858,7 +862,7 @@ void HttpMime::makeMime  ( int32_t    totalContentLen    ,
 			  //"Location: http://192.168.0.4:8000/cgi/3.cgi\r\n"
 			  //"Last-Modified: %s\r\n\r\n" ,
 			  httpStatus , smsg ,
-			  ns , totalContentLen , enc , contentType  );
+			  ns , totalContentLen , conn , enc , contentType  );
 			  //pns ,
 	                  //ns );
 			  //lms );
@@ -874,7 +878,7 @@ void HttpMime::makeMime  ( int32_t    totalContentLen    ,
 			      "%s"
 			      "Content-Length: %" PRId32"\r\n"
 			      "Content-Range: %" PRId32"-%" PRId32"(%" PRId32")\r\n"// added "bytes"
-			      "Connection: Close\r\n"
+			      "Connection: %s\r\n"
 			      //"P3P: CP=\"CAO PSA OUR\"\r\n"
 			      // for ajax support
 			      "Access-Control-Allow-Origin: *\r\n"
@@ -887,6 +891,7 @@ void HttpMime::makeMime  ( int32_t    totalContentLen    ,
 			      enc ,bytesToSend ,
 			      offset , offset + bytesToSend , 
 			      totalContentLen ,
+			      conn ,
 			      pns ,
 			      ns , 
 			      lms , contentType );
@@ -921,14 +926,14 @@ void HttpMime::makeMime  ( int32_t    totalContentLen    ,
 		if ( charset ) p += sprintf ( p , "; charset=%s", charset );
 		p += sprintf ( p , "\r\n");
 		p += sprintf ( p ,
-			       //"Connection: Keep-Alive\r\n"
-			       "Connection: Close\r\n"
+			       "Connection: %s\r\n"
 			       //"P3P: CP=\"CAO PSA OUR\"\r\n"
 			       "Access-Control-Allow-Origin: *\r\n"
 			       "Server: Gigablast/1.0\r\n"
 			       "%s"
 			       "Date: %s\r\n"
 			       "Last-Modified: %s\r\n" ,
+			       conn ,
 			       pns ,
 			       ns , 
 			       lms );
@@ -102,6 +102,8 @@ class HttpMime {
 	// . a cache time of 0 means use local caching rules
 	// . any other cacheTime is an explicit time to cache the page for
 	// . httpStatus of -1 means to auto determine
+	// . keepAlive says "Connection: Keep-Alive" instead of close, but only
+	//   if the content length is known
 	void makeMime   ( int32_t    totalContentLen        , 
 			  int32_t    cacheTime        =-1   , // -1-->noBackCache
 			  time_t  lastModified     = 0   ,
@@ -112,7 +114,8 @@ class HttpMime {
 			  const char   *contentType      = NULL ,
 			  const char   *charset          = NULL ,
 			  int32_t    httpStatus       = -1   ,
-			  const char   *cookie           = NULL );
+			  const char   *cookie           = NULL ,
+			  bool    keepAlive        = false );
 
 	// make a redirect mime
 	void makeRedirMime ( const char *redirUrl , int32_t redirUrlLen );
@@ -81,6 +81,7 @@ void HttpRequest::reset() {
 	m_cookiePtr = NULL;
 	m_cookieLen = 0;
 	m_userIP = 0;
+	m_isKeepAlive = false;
 	m_reqBufValid = false;
 	m_reqBuf.purge();
 
@@ -157,7 +158,8 @@ bool HttpRequest::set (char *url,int32_t offset,int32_t size,time_t ifModifiedSi
 		       // are we sending the request through an http proxy?
 		       // if so this will be non-zero
 		       int32_t proxyIp ,
-		       const char *proxyUsernamePwd ) {
+		       const char *proxyUsernamePwd ,
+		       bool keepAlive ) {
 
 	m_reqBufValid = false;
 
@@ -360,8 +362,7 @@ bool HttpRequest::set (char *url,int32_t offset,int32_t size,time_t ifModifiedSi
 			   "Accept: */*\r\n" 
 			   "Host: %s\r\n"
 			   "%s"
-			   "Connection: Close\r\n"
-			   //"Connection: Keep-Alive\r\n"
+			   "Connection: %s\r\n"
 			   //"Accept-Language: en\r\n"
 				"%s"
 			   "%s"
@@ -374,6 +375,9 @@ bool HttpRequest::set (char *url,int32_t offset,int32_t size,time_t ifModifiedSi
 			   userAgent ,
 			   host ,
 			   ims ,
+			   // only plain GETs, the reply to a POST is not
+			   // worth keeping the connection for
+			   ( keepAlive && ! doPost ) ? "Keep-Alive" : "Close",
 			   acceptEncoding,
 				      up );
 			   //accept );
@@ -819,6 +823,23 @@ bool HttpRequest::set ( char *origReq , int32_t origReqLen , TcpSocket *sock ) {
 	 // NULL terminate it
 	 m_userAgent [ len ] = '\0';
 
+	 // . does the client want to keep the connection open for more requests?
+	 // . http 1.1 keeps it open unless it says "Connection: close", http 1.0
+	 //   only if it says "Connection: keep-alive"
+	 char *eol = req;
+	 while ( *eol && *eol != '\n' && *eol != '\r' ) eol++;
+	 m_isKeepAlive = ( eol - req >= 8 && strncmp ( eol - 8 , "HTTP/1.1" , 8 ) == 0 );
+	 s = strcasestr ( req , "\nConnection:" );
+	 if ( s ) {
+		 // skip "\nConnection:"
+		 s += 12;
+		 while ( *s==' ' || *s=='\t' ) s++;
+		 if      ( strncasecmp ( s , "close"      , 5  ) == 0 )
+			 m_isKeepAlive = false;
+		 else if ( strncasecmp ( s , "keep-alive" , 10 ) == 0 )
+			 m_isKeepAlive = true;
+	 }
+
 	 // get Cookie: field
 	 s = strstr ( req, "Cookie:" );
 	 // find another
@@ -55,7 +55,9 @@ class HttpRequest {
 		   const char *additionalHeader = NULL , // does not incl \r\n
 		   int32_t postContentLen = -1 , // for content-length of POST
 		   int32_t proxyIp = 0 ,
-		   const char *proxyUsernamePwdAuth = NULL );
+		   const char *proxyUsernamePwdAuth = NULL ,
+		   // ask the server to keep the connection open
+		   bool keepAlive = false );
 
 	// use this
 	SafeBuf m_reqBuf;
@@ -113,6 +115,10 @@ class HttpRequest {
 	bool isHEADRequest () { return (m_requestType == 1); }
 	bool isPOSTRequest () { return (m_requestType == 2); }
 
+	// . did the client ask to keep the connection open after the reply?
+	// . from the http version and the "Connection:" header
+	bool isKeepAlive   () { return m_isKeepAlive; }
+
 	char *getFilename    () { return m_filename; }
 	int32_t  getFilenameLen () { return m_filenameLen; }
 	int32_t  getFileOffset  () { return m_fileOffset; }
@@ -256,6 +262,7 @@ class HttpRequest {
 
 	int32_t m_userIP;
 	bool m_isSSL;
+	bool m_isKeepAlive;
 
 	// . ptr to the thing we're getting in the request
 	// . used by PageAddUrl4.cpp
@@ -136,7 +136,8 @@ bool HttpServer::getDoc ( char   *url      ,
 			  const char    *additionalHeader ,
 			  const char    *fullRequest ,
 			  const char    *postContent ,
-			  const char    *proxyUsernamePwdAuth ) {
+			  const char    *proxyUsernamePwdAuth ,
+			  bool     keepAlive ) {
 	// sanity
 	if ( ip == -1 ) {
 		log(LOG_WARN, "http: you probably didn't mean to set ip=-1 did you? try setting to 0.");
@@ -206,7 +207,8 @@ bool HttpServer::getDoc ( char   *url      ,
 			       // say "GET http://www.xyz.com/" the full
 			       // url, not just a relative path.
 			       additionalHeader , pcLen , proxyIp ,
-			       proxyUsernamePwdAuth ) ) {
+			       proxyUsernamePwdAuth ,
+			       keepAlive && ! proxyIp ) ) {
 			log(LOG_WARN, "http: http req error: %s",mstrerror(g_errno));
 			// TODO: ensure we close the socket on this error!
 			return true;
@@ -584,6 +586,15 @@ void HttpServer::requestHandler ( TcpSocket *s ) {
 		return;
 	}
 
+	// . keep the connection open after the reply if the client wants it,
+	//   but not if we are short on sockets
+	// . the reply mime must say so too, see TcpServer::sendMsg()
+	s->m_keepAlive = ( g_conf.m_httpKeepAlive &&
+			   r.isKeepAlive() &&
+			   ! s->m_udpSlot &&
+			   s->m_numRequests < g_conf.m_httpKeepAliveMaxRequests &&
+			   tcp->m_numIncomingUsed < max );
+
 	// log the request iff filename does not end in .gif .jpg .
 	char *f     = r.getFilename();
 	int32_t  flen  = r.getFilenameLen();
@@ -1048,9 +1059,9 @@ bool HttpServer::sendReply ( TcpSocket  *s , HttpRequest *r , bool isAdmin) {
 
 	if ( partialContent )
 		m.makeMime (fileSize,ct,lastModified,offset,bytesToSend,ext,
-			    false,NULL,charset,-1,NULL);
+			    false,NULL,charset,-1,NULL,s->m_keepAlive);
 	else	m.makeMime (fileSize,ct,lastModified,0     ,-1         ,ext,
-			    false,NULL,charset,-1,NULL);
+			    false,NULL,charset,-1,NULL,s->m_keepAlive);
 	// sanity check, compression not supported for files
 	if ( s->m_readBuf[0] == 'Z' ) { 
 		int32_t len = s->m_readOffset;
@@ -1847,6 +1858,27 @@ int32_t getMsgPiece ( TcpSocket *s ) {
 	exit ( -1 );
 }
 
+// . does the web server keep the connection open after this reply?
+// . http 1.1 does unless it says "Connection: close", http 1.0 only if it
+//   says "Connection: keep-alive"
+static bool isPersistentReply ( const char *buf , int32_t mimeSize ) {
+	if ( mimeSize < 12 || strncmp ( buf , "HTTP/1." , 7 ) != 0 )
+		return false;
+	bool keepAlive = ( buf[7] == '1' );
+	const char *end = buf + mimeSize;
+	for ( const char *p = buf ; p + 16 < end ; p++ ) {
+		if ( *p != '\n' ) continue;
+		if ( strncasecmp ( p + 1 , "Connection:" , 11 ) != 0 ) continue;
+		const char *v = p + 12;
+		while ( v < end && ( *v == ' ' || *v == '\t' ) ) v++;
+		if ( v + 5 <= end && strncasecmp ( v , "close" , 5 ) == 0 )
+			keepAlive = false;
+		if ( v + 10 <= end && strncasecmp ( v , "keep-alive" , 10 ) == 0 )
+			keepAlive = true;
+	}
+	return keepAlive;
+}
+
 // . we call this to try to figure out the size of the WHOLE HTTP msg
 //   being recvd so that we might pre-allocate memory for it
 // . it could be an HTTP request or reply
@@ -1964,8 +1996,9 @@ int32_t getMsgSize ( char *buf, int32_t bufSize, TcpSocket *s ) {
 		// flag it as a post
 		isPost = true;
 	}
-	// if has no content then it must end  in \n\r\n\r or \r\n\r\n
-	if ( ! hasContent ) return bufSize;
+	// . if has no content then it must end  in \n\r\n\r or \r\n\r\n
+	// . anything after the mime is the next pipelined request
+	if ( ! hasContent ) return mimeSize;
 
 	// look for a Content-Type: field because we now limit how much
 	// we read based on this
@@ -2033,6 +2066,21 @@ int32_t getMsgSize ( char *buf, int32_t bufSize, TcpSocket *s ) {
 		break;
 	}
 
+	// . TcpServer can only reuse a kept-alive connection to a web server
+	//   if we read exactly this reply, so it needs a length and can not
+	//   be truncated. 204 and 304 replies never have content.
+	if ( s->m_keepAlive && ! s->m_isIncoming ) {
+		bool noContent = ( mimeSize > 12 &&
+				   ( strncmp ( buf + 9 , "204" , 3 ) == 0 ||
+				     strncmp ( buf + 9 , "304" , 3 ) == 0 ) );
+		if ( ! isPersistentReply ( buf , mimeSize ) ||
+		     ( ! totalReplySize && ! noContent ) ||
+		     totalReplySize > max )
+			s->m_keepAlive = false;
+		else if ( noContent )
+			return mimeSize;
+	}
+
 	// all-or-nothing filter
 	if ( totalReplySize > max && allOrNothing ) {
 		log(LOG_INFO,
@@ -2302,7 +2350,8 @@ bool HttpServer::sendDynamicPage ( TcpSocket *s, const char *page, int32_t pageL
 		     ct, // contentType ,
 		     charset     , // charset
 		     httpStatus  ,
-		     cookie      );
+		     cookie      ,
+		     s->m_keepAlive );
 
 	return sendReply2 ( m.getMime(), m.getMimeLen(), page, pageLen, s, false, hr);
 }
@@ -83,7 +83,10 @@ class HttpServer {
 		      // specify your own mime and post data here...
 		      const char *fullRequest = NULL ,
 		      const char *postContent = NULL ,
-		      const char *proxyUsernamePwdAuth = NULL );
+		      const char *proxyUsernamePwdAuth = NULL ,
+		      // . keep the connection for the next download from
+		      //   this ip. not used with proxies or fullRequest
+		      bool keepAlive = false );
 
 	bool gotDoc ( int32_t n , TcpSocket *s );
 
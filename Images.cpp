@@ -9,7 +9,9 @@
 #include "Hostdb.h"
 #include "Process.h"
 #include "Posdb.h"
+#include "ConverterPool.h"
 #include <pthread.h>
+#include <sys/wait.h>
 
 // TODO: image is bad if repeated on same page, check for that
 
@@ -871,70 +873,6 @@ void Images::thumbStart_r ( bool amThread ) {
 	
 	log( LOG_DEBUG, "image: thumbStart_r entered." );
 
-	//DIR  *d;
-	//char  cmd[2500];
-	//sprintf( cmd, "%strash", g_hostdb.m_dir );
-
-	makeTrashDir();
-
-	// get thread id. pthread_t is 64 bit and pid_t is 32 bit on
-	// 64 bit oses
-	pthread_t id = pthread_self();
-
-	// pass the input to the program through this file
-	// rather than a pipe, since popen() seems broken.
-	// m_dir ends in / so this should work.
-	char in[364];
-	snprintf ( in , 363,"%strash/in.%" PRId64
-		   , g_hostdb.m_dir, (int64_t)id );
-	unlink ( in );
-
-	log( LOG_DEBUG, "image: thumbStart_r create in file." );
-
-	// collect the output from the filter from this file
-	// m_dir ends in / so this should work.
-	char out[364];
-	snprintf ( out , 363,"%strash/out.%" PRId64
-		   , g_hostdb.m_dir, (int64_t)id );
-        unlink ( out );
-
-	log( LOG_DEBUG, "image: thumbStart_r create out file." );
-
-        // ignore errno from those unlinks        
-        errno = 0;
-
-        // Open/Create temporary file to store image to
-        int   fhndl;
-        if( (fhndl = open( in, O_RDWR+O_CREAT ,
-			   getFileCreationFlags()
-			   // //			   S_IWUSR+S_IRUSR 
-			   )) < 0 ) {
-               log( "image: Could not open file, %s, for writing: %s - %d.",
-       		    in, mstrerror( m_errno ), fhndl );
-	       m_imgDataSize = 0;
-       	       return;
-        }
-
-        // Write image data into temporary file
-        if( write( fhndl, m_imgData, m_imgDataSize ) < 0 ) {
-               log( "image: Could not write to file, %s: %s.",
-       		    in, mstrerror( m_errno ) );
-       	       close( fhndl );
-	       unlink( in );
-	       m_imgDataSize = 0;
-       	       return;
-        }
-
-        // Close temporary image file now that we have finished writing
-        if( close( fhndl ) < 0 ) {
-               log( "image: Could not close file, %s, for writing: %s.",
-       	            in, mstrerror( m_errno ) );
-	       unlink( in );
-	       m_imgDataSize = 0;
-      	       return;
-        }
-	fhndl = 0;
-
         // Grab content type from mime
 	//int32_t imgType = mime.getContentType();
         char  ext[5];
@@ -958,18 +896,17 @@ void Images::thumbStart_r ( bool amThread ) {
 
 	char  cmd[2500];
 
-	//sprintf( cmd, scmd, ext, in, out);
+	// . the converter worker pipes the image into this and sends us
+	//   back its stdout, no temp files
 	const char *wdir = g_hostdb.m_dir;
 	// wdir ends in / so this should work.
 	snprintf( cmd, sizeof(cmd),
-		 "LD_LIBRARY_PATH=%s %s%stopnm %s | "
+		 "LD_LIBRARY_PATH=%s %s%stopnm | "
 		 "LD_LIBRARY_PATH=%s %spnmscale -xysize %" PRId32" %" PRId32" - | "
-		  // put all its stderr msgs into /dev/null
-		  // so "jpegtopnm: WRITING PPM FILE" doesn't clog console
-		 "LD_LIBRARY_PATH=%s %sppmtojpeg - > %s"
-		  , wdir, wdir, ext, in
+		 "LD_LIBRARY_PATH=%s %sppmtojpeg -"
+		  , wdir, wdir, ext
 		  , wdir, wdir, m_xysize, m_xysize
-		  , wdir, wdir, out
+		  , wdir, wdir
 		 );
 	cmd[sizeof(cmd)-1] = '\0';
 
@@ -984,55 +921,47 @@ void Images::thumbStart_r ( bool amThread ) {
 	}
 	if ( s_hasNetpbm )
 		snprintf( cmd, sizeof(cmd),
-			  "%stopnm %s | "
+			  "%stopnm | "
 			  "pnmscale -xysize %" PRId32" %" PRId32" - | "
-			  "ppmtojpeg - > %s"
-			  , ext, in
+			  "ppmtojpeg -"
+			  , ext
 			  , m_xysize, m_xysize
-			  , out
 			  );
-		
-        
-        // Call clone function for the shell to execute command
-	int err = system( cmd ); // m_thmbconvTimeout );
 
-	//if( (m_dx != 0) && (m_dy != 0) )
-	//	unlink( in );
-	unlink ( in );
+	ConverterRequest req;
+	memset ( &req, 0, sizeof(req) );
+	req.m_cmdLen        = strlen ( cmd );
+	req.m_inputSize     = m_imgDataSize;
+	// the thumbnail overwrites the original image
+	req.m_maxOutputSize = m_imgDataSize;
+	req.m_timeout       = 30;
+	req.m_maxMemKB      = 512*1024;
+
+	ConverterReply reply;
+	if ( ! g_converterPool.convert ( &req, cmd, m_imgData, m_imgData,
+					 &reply ) ) {
+		m_errno = errno;
+		log("image: Could not run \"%s\": %s.", cmd, mstrerror(m_errno));
+		m_stopDownloading = true;
+		return;
+	}
 
-	if ( err == 127 ) {
+	if ( WIFEXITED(reply.m_status) && WEXITSTATUS(reply.m_status) == 127 ) {
 		m_errno = EBADENGINEER;
-		log("image: /bin/sh does not exist.");
-		unlink ( out );
+		log("image: /bin/sh or netpbm does not exist.");
 		m_stopDownloading = true;
 		return;
 	}
 	// this will happen if you don't upgrade glibc to 2.2.4-32 or above
-	if ( err != 0 ) {
+	if ( reply.m_errno || reply.m_status != 0 ) {
 		m_errno = EBADENGINEER;
-		log("image: Call to system(\"%s\") had error.",cmd);
-		unlink ( out );
+		log("image: Call to \"%s\" had error: %s.",cmd,
+		    mstrerror(reply.m_errno));
 		m_stopDownloading = true;
 		return;
 	}
 
-        // Open new file with thumbnail image
-        if( (fhndl = open( out, O_RDONLY )) < 0 ) {
-               log( "image: Could not open file, %s, for reading: %s.",
-		    out, mstrerror( m_errno ) );
-		unlink ( out );
-		m_stopDownloading = true;
-	       return;
-        }
-
-	if( (m_thumbnailSize = lseek( fhndl, 0, SEEK_END )) < 0 ) {
-		log( "image: Seek of file, %s, returned invalid size: %" PRId32,
-		     out, m_thumbnailSize );
-		m_stopDownloading = true;
-		close(fhndl);
-		unlink ( out );
-		return;
-	}
+	m_thumbnailSize = reply.m_outputSize;
 
 	if( m_thumbnailSize > m_imgReplyMaxLen ) {
 		log(LOG_DEBUG,"image: Image thumbnail larger than buffer!" );
@@ -1041,41 +970,13 @@ void Images::thumbStart_r ( bool amThread ) {
 		log(LOG_DEBUG,"image: -----------------------" );
 		log(LOG_DEBUG,"image: Diff           : %" PRId32,
 		     m_imgReplyMaxLen-m_thumbnailSize );
-		close(fhndl);
-		unlink ( out );
 		return;
 
 	}
 
-	if( lseek( fhndl, 0, SEEK_SET ) < 0 ) {
-		log( "image: Seek couldn't rewind file, %s.", out );
-		m_stopDownloading = true;
-		close(fhndl);
-		unlink ( out );
-		return;
-	}
+	// we only got this much of it
+	if ( m_thumbnailSize > m_imgDataSize ) m_thumbnailSize = m_imgDataSize;
 
-        // . Read contents back into image ptr
-	// . this is somewhat of a hack since it overwrites the original img
-        if( (m_thumbnailSize = read( fhndl, m_imgData, m_imgDataSize )) < 0 ) {
-                log( "image: Could not read from file, %s: %s.",
- 		     out, mstrerror( m_errno ) );
-	        close( fhndl );
-		m_stopDownloading = true;
-		unlink( out );
-	        return;
-        }
-
-        if( close( fhndl ) < 0 ) {
-                log( "image: Could not close file, %s, for reading: %s.",
- 		     out, mstrerror( m_errno ) );
-		unlink( out );
-		m_stopDownloading = true;
-		unlink ( out );
- 	        return;
-        }
-	fhndl = 0;
-       	unlink( out );
 	int64_t stop = gettimeofdayInMilliseconds();
 	// tell the loop above not to download anymore, we got one
 	m_thumbnailValid = true;
@@ -2,11 +2,16 @@
 #include "ScopedLock.h"
 #include "BigFile.h" //for FileState definition
 #include <pthread.h>
+#include <sched.h>
 #include <vector>
+#include <deque>
 #include <list>
+#include <atomic>
 #include <algorithm>
 #include <stdexcept>
 #include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <sys/time.h>
 
 
@@ -37,6 +42,7 @@ struct JobEntry {
 	uint64_t          start_deadline;     //latest time when this job must be started
 	bool              is_io_write_job;    //valid for I/O jobs: mostly read or mostly write?
 	int               initial_priority;   //priority when queued
+	bool              counted_reserved;   //counted as running a type with reserved threads
 	
 	//for statistics:
 	thread_type_t     thread_type;
@@ -49,115 +55,148 @@ struct JobEntry {
 
 
 
-//a set of jobs, prioritized
-class JobQueue : public std::vector<JobEntry> {
-public:
-	pthread_cond_t cond_not_empty;
-	unsigned potential_worker_threads;
+typedef std::vector<std::pair<JobEntry,job_exit_t>> ExitSet;
+typedef std::list<JobEntry> RunningSet;
+
 
-	JobQueue()
-	  : vector(),
-	    cond_not_empty PTHREAD_COND_INITIALIZER,
-	    potential_worker_threads(0)
+//how many jobs of a thread type may run at the same time
+struct ThreadTypeLimits {
+	std::atomic<unsigned> max_running;            //0 = no limit
+	std::atomic<unsigned> reserved_threads;       //threads kept for the types with a reservation
+};
+
+
+//what the pools share with the scheduler
+struct SharedState {
+	RunningSet             *running_set;               //set to store the job in while executing it
+	ExitSet                *exit_set;                  //set to store the finished job+exit-cause in
+	unsigned               *num_io_write_jobs_running; //global counter for scheduling
+	const ThreadTypeLimits *limits;                    //indexed by thread type
+	pthread_mutex_t        *mtx;                       //mutex covering above 3
+	job_done_notify_t      job_done_notify;            //notifycation callback whenever a job returns
+};
+
+
+class ThreadPool;
+
+
+//The queue of a pool thread. The thread takes jobs from its own queue first
+//and steals from the queues of the other threads of the pool when it is
+//empty. Jobs submitted from a pool thread go into its own queue.
+struct WorkerQueue {
+	ThreadPool            *pool;
+	unsigned              index;           //in the pool
+	int                   numa_node;       //-1 if not pinned
+	std::vector<unsigned> steal_order;     //own queue, same numa node, other nodes
+	pthread_mutex_t       mtx;             //covers jobs
+	std::deque<JobEntry>  jobs;
+	std::atomic<int>      best_priority;   //lowest priority in jobs, INT_MAX if none
+	
+	WorkerQueue(ThreadPool *pool_, unsigned index_)
+	  : pool(pool_),
+	    index(index_),
+	    numa_node(-1),
+	    steal_order(),
+	    mtx PTHREAD_MUTEX_INITIALIZER,
+	    jobs(),
+	    best_priority(INT_MAX)
 	{
 	}
 	
-	~JobQueue() {
-		pthread_cond_destroy(&cond_not_empty);
+	~WorkerQueue() {
+		pthread_mutex_destroy(&mtx);
 	}
 	
-	void add(const JobEntry &e) {
-		push_back(e);
-		pthread_cond_signal(&cond_not_empty);
+	void update_best_priority() {
+		int best = INT_MAX;
+		for(const auto &e : jobs)
+			best = std::min(best,e.initial_priority);
+		best_priority = best;
 	}
-	
-	JobEntry pop_top_priority();
-	
-	
 };
 
 
-JobEntry JobQueue::pop_top_priority()
-{
-	assert(!empty());
-	//todo: age old entries
-	std::vector<JobEntry>::iterator best_iter = begin();
-	std::vector<JobEntry>::iterator iter = best_iter;
-	++iter;
-	for( ; iter!=end(); ++iter)
-		if(iter->initial_priority<best_iter->initial_priority)
-			best_iter = iter;
-	JobEntry tmp = *best_iter;
-	erase(best_iter);
-	return tmp;
-}
-
+//the queue of the pool thread we are running in, if any
+static __thread WorkerQueue *s_own_queue = NULL;
 
 
-typedef std::vector<std::pair<JobEntry,job_exit_t>> ExitSet;
-typedef std::list<JobEntry> RunningSet;
-
-
-//parameters given to a pool thread
-struct PoolThreadParameters {
-	JobQueue          *job_queue;                 //queue to fetch jobs from
-	RunningSet        *running_set;               //set to store the job in while executing it
-	ExitSet           *exit_set;                  //set to store the finished job+exit-cause in
-	unsigned          *num_io_write_jobs_running; //global counter for scheduling
-	pthread_mutex_t   *mtx;                       //mutex covering above 3 containers
-	job_done_notify_t job_done_notify;            //notifycation callback whenever a job returns
-	bool              stop;
+//a cpu we may run on and the numa node it is on
+struct CpuInfo {
+	int cpu;
+	int node;
 };
 
 
-extern "C" {
-static void *job_pool_thread_function(void *pv) {
-	PoolThreadParameters *ptp= static_cast<PoolThreadParameters*>(pv);
-	pthread_mutex_lock(ptp->mtx);
-	while(!ptp->stop) {
-		if(ptp->job_queue->empty())
-			pthread_cond_wait(&ptp->job_queue->cond_not_empty,ptp->mtx);
-		if(ptp->stop)
+//parse a cpu list such as "0-3,8-11"
+static void parse_cpu_list(const char *s, std::vector<int> *cpus) {
+	while(*s) {
+		char *end;
+		long first = strtol(s,&end,10);
+		if(end==s)
 			break;
-		if(ptp->job_queue->empty()) //spurious wakeup
-			continue;
-		
-		//take the top-priority job and move it into the running set
-		RunningSet::iterator iter = ptp->running_set->insert(ptp->running_set->begin(),ptp->job_queue->pop_top_priority());
-		if(iter->is_io_job && iter->is_io_write_job)
-			++*(ptp->num_io_write_jobs_running);
-		pthread_mutex_unlock(ptp->mtx);
-		
-		job_exit_t job_exit;
-		uint64_t now = now_ms();
-		iter->start_time = now;
-		if(iter->start_deadline==0 || iter->start_deadline>now) {
-			// clear thread specific g_errno
-			g_errno = 0;
+		long last = first;
+		s = end;
+		if(*s=='-') {
+			last = strtol(s+1,&end,10);
+			s = end;
+		}
+		for(long cpu=first; cpu<=last && cpu<CPU_SETSIZE; cpu++)
+			cpus->push_back((int)cpu);
+		if(*s!=',')
+			break;
+		s++;
+	}
+}
 
-			iter->start_routine(iter->state);
-			iter->stop_time = now_ms();
-			job_exit = job_exit_normal;
-		} else {
-			job_exit = job_exit_deadline;
+
+//the cpus we are allowed to run on, ordered by numa node
+static std::vector<CpuInfo> get_usable_cpus() {
+	std::vector<CpuInfo> v;
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if(sched_getaffinity(0,sizeof(allowed),&allowed)!=0)
+		return v;
+	
+	//without the numa information in /sys everything is on node 0
+	std::vector<int> node_of(CPU_SETSIZE,0);
+	for(int node=0; node<256; node++) {
+		char filename[128];
+		sprintf(filename,"/sys/devices/system/node/node%d/cpulist",node);
+		FILE *fp = fopen(filename,"r");
+		if(!fp)
+			continue; //node numbers can have holes
+		char buf[1024];
+		if(fgets(buf,sizeof(buf),fp)) {
+			std::vector<int> cpus;
+			parse_cpu_list(buf,&cpus);
+			for(auto cpu : cpus)
+				node_of[cpu] = node;
 		}
-		
-		pthread_mutex_lock(ptp->mtx);
-		if(iter->is_io_job && iter->is_io_write_job)
-			--*(ptp->num_io_write_jobs_running);
-		//copy+delete it into the exit queue
-		ptp->exit_set->push_back(std::make_pair(*iter,job_exit));
-		ptp->running_set->erase(iter);
-		pthread_mutex_unlock(ptp->mtx);
-		
-		(ptp->job_done_notify)();
-		
-		pthread_mutex_lock(ptp->mtx);
+		fclose(fp);
 	}
 	
-	pthread_mutex_unlock(ptp->mtx);
-	return 0;
+	for(int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+		if(CPU_ISSET(cpu,&allowed)) {
+			CpuInfo ci;
+			ci.cpu = cpu;
+			ci.node = node_of[cpu];
+			v.push_back(ci);
+		}
+	}
+	std::stable_sort(v.begin(), v.end(), [](const CpuInfo &a, const CpuInfo &b) { return a.node<b.node; });
+	return v;
 }
+
+
+enum thread_pinning_t {
+	pinning_none,
+	pinning_core,      //each thread on a cpu of its own (as far as they go)
+	pinning_node       //each thread on the cpus of a numa node
+};
+
+
+extern "C" {
+static void *job_pool_thread_function(void *pv);
 }
 
 
@@ -167,39 +206,130 @@ static void job_done_notify_noop() {
 
 class ThreadPool {
 public:
-	ThreadPool(unsigned num_threads,
-	           JobQueue *job_queue, RunningSet *running_set, ExitSet *exit_set,
-		   unsigned *num_io_write_jobs_running,
-		   pthread_mutex_t *mtx,
-		   job_done_notify_t job_done_notify_);
+	ThreadPool(unsigned num_threads, const SharedState *shared, thread_pinning_t pinning);
 	void initiate_stop();
 	void join_all();
 	~ThreadPool();
 	
+	unsigned num_threads() const { return queues.size(); }
+	
+	bool add(const JobEntry &e);
+	unsigned num_queued() const { return queued; }
+	
+	//call f on each queued job
+	template<class F> void for_each_queued(F f) const;
+	//remove the queued jobs matching pred into 'removed'
+	template<class P> void remove_queued_if(P pred, std::vector<JobEntry> *removed);
+	
+	//have a thread look at the queues again
+	void wake_one();
+	//the limits of the thread types changed. Have all the threads look at the queues again
+	void limits_changed();
+	
+	void run(WorkerQueue *wq);
+	
 private:
-	PoolThreadParameters ptp;
+	bool take_job(WorkerQueue *wq, RunningSet::iterator *job);
+	bool take_job_from(WorkerQueue *q, uint64_t now, RunningSet::iterator *job);
+	bool may_start(const JobEntry &e, uint64_t now) const;
+	bool try_admit(JobEntry *e, uint64_t now);
+	void release(const JobEntry &e);
+	void update_reserved();
+	void wait_for_job(uint64_t generation);
+	
+	const SharedState *shared;
+	std::vector<WorkerQueue*> queues;
 	std::vector<pthread_t> tid;
-	job_done_notify_t job_done_notify;
+	std::atomic<unsigned> next_queue;       //round-robin for jobs submitted from outside the pool
+	std::atomic<unsigned> queued;           //jobs in all the queues
+	std::atomic<unsigned> queued_top;       //jobs with priority 0 (or better) in all the queues
+	
+	pthread_mutex_t idle_mtx;               //covers generation and stop
+	pthread_cond_t  cond_job;
+	uint64_t        generation;             //bumped when there may be a job to take
+	bool            stop;
+	
+	std::atomic<unsigned> running_total;
+	std::atomic<unsigned> running_by_type[thread_type_end];
+	std::atomic<unsigned> running_reserved;  //running jobs of types with reserved threads
+	std::atomic<unsigned> reserved;          //threads kept for them, for the types seen so far
+	
+	std::atomic<bool> type_submitted[thread_type_end];   //has the pool ever seen jobs of the type
 };
 
 
-ThreadPool::ThreadPool(unsigned num_threads,
-                       JobQueue *job_queue, RunningSet *running_set, ExitSet *exit_set,
-		       unsigned *num_io_write_jobs_running,
-		       pthread_mutex_t *mtx,
-                       job_done_notify_t job_done_notify_)
-  : tid(num_threads)
-{
-	job_queue->potential_worker_threads += num_threads;
-	ptp.job_queue = job_queue;
-	ptp.running_set = running_set;
-	ptp.exit_set = exit_set;
-	ptp.num_io_write_jobs_running = num_io_write_jobs_running;
-	ptp.mtx = mtx;
-	ptp.job_done_notify = job_done_notify_?job_done_notify_:job_done_notify_noop;
-	ptp.stop = false;
-	for(unsigned i=0; i<tid.size(); i++) {
-		int rc = pthread_create(&tid[i], NULL, job_pool_thread_function, &ptp);
+ThreadPool::ThreadPool(unsigned num_threads, const SharedState *shared_, thread_pinning_t pinning)
+  : shared(shared_),
+    queues(),
+    tid(),
+    next_queue(0),
+    queued(0),
+    queued_top(0),
+    idle_mtx PTHREAD_MUTEX_INITIALIZER,
+    cond_job PTHREAD_COND_INITIALIZER,
+    generation(0),
+    stop(false),
+    running_total(0),
+    running_reserved(0),
+    reserved(0)
+{
+	for(int i=0; i<thread_type_end; i++) {
+		running_by_type[i] = 0;
+		type_submitted[i] = false;
+	}
+	
+	std::vector<CpuInfo> cpus;
+	std::vector<int> nodes;
+	if(pinning!=pinning_none) {
+		cpus = get_usable_cpus();
+		for(const auto &ci : cpus)
+			if(nodes.empty() || nodes.back()!=ci.node)
+				nodes.push_back(ci.node);
+	}
+	
+	std::vector<cpu_set_t> cpu_sets(num_threads);
+	for(unsigned i=0; i<num_threads; i++) {
+		WorkerQueue *wq = new WorkerQueue(this,i);
+		queues.push_back(wq);
+		CPU_ZERO(&cpu_sets[i]);
+		if(cpus.empty())
+			continue;
+		if(pinning==pinning_core) {
+			const CpuInfo &ci = cpus[i%cpus.size()];
+			CPU_SET(ci.cpu,&cpu_sets[i]);
+			wq->numa_node = ci.node;
+		} else {
+			wq->numa_node = nodes[i%nodes.size()];
+			for(const auto &ci : cpus)
+				if(ci.node==wq->numa_node)
+					CPU_SET(ci.cpu,&cpu_sets[i]);
+		}
+	}
+	
+	//steal from the threads on the same numa node first
+	for(unsigned i=0; i<num_threads; i++) {
+		WorkerQueue *wq = queues[i];
+		for(int same_node=1; same_node>=0; same_node--) {
+			for(unsigned j=0; j<num_threads; j++) {
+				unsigned victim = (i+j)%num_threads;
+				if((queues[victim]->numa_node==wq->numa_node) == (same_node!=0))
+					wq->steal_order.push_back(victim);
+			}
+		}
+	}
+	
+	tid.resize(num_threads);
+	for(unsigned i=0; i<num_threads; i++) {
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		if(queues[i]->numa_node>=0)
+			pthread_attr_setaffinity_np(&attr,sizeof(cpu_sets[i]),&cpu_sets[i]);
+		int rc = pthread_create(&tid[i], &attr, job_pool_thread_function, queues[i]);
+		pthread_attr_destroy(&attr);
+		if(rc!=0 && queues[i]->numa_node>=0) {
+			//the cpus may have gone offline. Run it unpinned then
+			rc = pthread_create(&tid[i], NULL, job_pool_thread_function, queues[i]);
+		}
 		if(rc!=0)
 			throw std::runtime_error("pthread_create() failed");
 	}
@@ -208,8 +338,9 @@ ThreadPool::ThreadPool(unsigned num_threads,
 
 void ThreadPool::initiate_stop()
 {
-	for(unsigned i=0; i<tid.size(); i++)
-		ptp.stop = true;
+	ScopedLock sl(idle_mtx);
+	stop = true;
+	pthread_cond_broadcast(&cond_job);
 }
 
 void ThreadPool::join_all()
@@ -221,7 +352,290 @@ void ThreadPool::join_all()
 
 ThreadPool::~ThreadPool()
 {
+	initiate_stop();
 	join_all();
+	for(auto wq : queues)
+		delete wq;
+	pthread_cond_destroy(&cond_job);
+	pthread_mutex_destroy(&idle_mtx);
+}
+
+
+bool ThreadPool::add(const JobEntry &e)
+{
+	if(queues.empty())
+		return false;
+	if(!type_submitted[e.thread_type] && !type_submitted[e.thread_type].exchange(true))
+		update_reserved();
+	
+	//keep the jobs submitted by a pool thread local to it. Others are spread out
+	WorkerQueue *wq;
+	if(s_own_queue && s_own_queue->pool==this)
+		wq = s_own_queue;
+	else
+		wq = queues[next_queue++ % queues.size()];
+	
+	{
+		ScopedLock sl(wq->mtx);
+		wq->jobs.push_back(e);
+		if(e.initial_priority<wq->best_priority)
+			wq->best_priority = e.initial_priority;
+		if(e.initial_priority<=0)
+			++queued_top;
+		++queued;
+	}
+	
+	wake_one();
+	return true;
+}
+
+
+template<class F> void ThreadPool::for_each_queued(F f) const
+{
+	for(auto wq : queues) {
+		ScopedLock sl(wq->mtx);
+		for(const auto &e : wq->jobs)
+			f(e);
+	}
+}
+
+
+template<class P> void ThreadPool::remove_queued_if(P pred, std::vector<JobEntry> *removed)
+{
+	for(auto wq : queues) {
+		ScopedLock sl(wq->mtx);
+		bool any_removed = false;
+		for(std::deque<JobEntry>::iterator iter = wq->jobs.begin(); iter!=wq->jobs.end(); ) {
+			if(pred(*iter)) {
+				if(iter->initial_priority<=0)
+					--queued_top;
+				removed->push_back(*iter);
+				iter = wq->jobs.erase(iter);
+				--queued;
+				any_removed = true;
+			} else
+				++iter;
+		}
+		if(any_removed)
+			wq->update_best_priority();
+	}
+}
+
+
+void ThreadPool::wake_one()
+{
+	ScopedLock sl(idle_mtx);
+	generation++;
+	pthread_cond_signal(&cond_job);
+}
+
+
+void ThreadPool::limits_changed()
+{
+	update_reserved();
+	ScopedLock sl(idle_mtx);
+	generation++;
+	pthread_cond_broadcast(&cond_job);
+}
+
+
+void ThreadPool::wait_for_job(uint64_t seen_generation)
+{
+	ScopedLock sl(idle_mtx);
+	while(generation==seen_generation && !stop)
+		pthread_cond_wait(&cond_job,&idle_mtx);
+}
+
+
+//the most threads reserved by a type the pool has seen jobs of
+void ThreadPool::update_reserved()
+{
+	unsigned r = 0;
+	for(int t=0; t<thread_type_end; t++)
+		if(type_submitted[t])
+			r = std::max(r,shared->limits[t].reserved_threads.load());
+	if(r>=num_threads() && r>0)
+		r = num_threads()-1; //never shut the others out completely
+	reserved = r;
+}
+
+
+//May the job start now? Only a hint, try_admit() decides
+bool ThreadPool::may_start(const JobEntry &e, uint64_t now) const
+{
+	if(e.start_deadline!=0 && e.start_deadline<=now)
+		return true; //it won't run anyway, just be finished with job_exit_deadline
+	const ThreadTypeLimits &limits = shared->limits[e.thread_type];
+	unsigned max_running = limits.max_running;
+	if(max_running!=0 && running_by_type[e.thread_type]>=max_running)
+		return false;
+	if(limits.reserved_threads!=0)
+		return true;
+	//keep the reserved threads idle for the types having a reservation
+	unsigned r = reserved;
+	unsigned rr = running_reserved;
+	unsigned owed = r>rr ? r-rr : 0;
+	return num_threads()-running_total > owed;
+}
+
+
+//Count the job as running if the limits allow it
+bool ThreadPool::try_admit(JobEntry *e, uint64_t now)
+{
+	bool expired = e->start_deadline!=0 && e->start_deadline<=now;
+	const ThreadTypeLimits &limits = shared->limits[e->thread_type];
+	std::atomic<unsigned> &running_of_type = running_by_type[e->thread_type];
+	
+	unsigned max_running = expired ? 0 : limits.max_running.load();
+	unsigned n = running_of_type;
+	do {
+		if(max_running!=0 && n>=max_running)
+			return false;
+	} while(!running_of_type.compare_exchange_weak(n,n+1));
+	
+	e->counted_reserved = limits.reserved_threads!=0;
+	unsigned owed = 0;
+	if(e->counted_reserved)
+		++running_reserved;
+	else if(!expired) {
+		unsigned r = reserved;
+		unsigned rr = running_reserved;
+		owed = r>rr ? r-rr : 0;
+	}
+	unsigned total = running_total;
+	do {
+		if(num_threads()-total<=owed) {
+			--running_of_type;
+			return false;
+		}
+	} while(!running_total.compare_exchange_weak(total,total+1));
+	return true;
+}
+
+
+void ThreadPool::release(const JobEntry &e)
+{
+	--running_total;
+	--running_by_type[e.thread_type];
+	if(e.counted_reserved)
+		--running_reserved;
+}
+
+
+//Take the oldest of the top-priority jobs of the queue we may start and move
+//it into the running set. Only the queue is locked while looking.
+bool ThreadPool::take_job_from(WorkerQueue *q, uint64_t now, RunningSet::iterator *job)
+{
+	ScopedLock sl_queue(q->mtx);
+	std::deque<JobEntry>::iterator best_iter = q->jobs.end();
+	for(std::deque<JobEntry>::iterator iter = q->jobs.begin(); iter!=q->jobs.end(); ++iter) {
+		if(best_iter!=q->jobs.end() && iter->initial_priority>=best_iter->initial_priority)
+			continue;
+		if(may_start(*iter,now))
+			best_iter = iter;
+	}
+	if(best_iter==q->jobs.end())
+		return false;
+	if(!try_admit(&*best_iter,now))
+		return false; //another thread took the last slot
+	
+	//lock order: queue, then scheduler
+	pthread_mutex_lock(shared->mtx);
+	if(best_iter->is_io_job && best_iter->is_io_write_job)
+		++*(shared->num_io_write_jobs_running);
+	*job = shared->running_set->insert(shared->running_set->begin(),*best_iter);
+	pthread_mutex_unlock(shared->mtx);
+	
+	if(best_iter->initial_priority<=0)
+		--queued_top;
+	q->jobs.erase(best_iter);
+	q->update_best_priority();
+	--queued;
+	return true;
+}
+
+
+//Take the job to run next. Own queue first, then steal from the threads on
+//the same numa node and then the others. Priority-0 jobs of other threads go
+//before our own lower-priority jobs.
+bool ThreadPool::take_job(WorkerQueue *wq, RunningSet::iterator *job)
+{
+	if(queued==0)
+		return false;
+	uint64_t now = now_ms();
+	
+	if(queued_top!=0 && wq->best_priority>0) {
+		for(auto victim : wq->steal_order) {
+			WorkerQueue *q = queues[victim];
+			if(q->best_priority<=0 && take_job_from(q,now,job))
+				return true;
+		}
+	}
+	for(auto victim : wq->steal_order) {
+		WorkerQueue *q = queues[victim];
+		if(q->best_priority!=INT_MAX && take_job_from(q,now,job))
+			return true;
+	}
+	return false;
+}
+
+
+void ThreadPool::run(WorkerQueue *wq)
+{
+	s_own_queue = wq;
+	for(;;) {
+		pthread_mutex_lock(&idle_mtx);
+		uint64_t seen_generation = generation;
+		bool stopping = stop;
+		pthread_mutex_unlock(&idle_mtx);
+		if(stopping)
+			break;
+		
+		RunningSet::iterator iter;
+		if(!take_job(wq,&iter)) {
+			wait_for_job(seen_generation);
+			continue;
+		}
+		
+		job_exit_t job_exit;
+		uint64_t now = now_ms();
+		iter->start_time = now;
+		if(iter->start_deadline==0 || iter->start_deadline>now) {
+			// clear thread specific g_errno
+			g_errno = 0;
+			
+			iter->start_routine(iter->state);
+			iter->stop_time = now_ms();
+			job_exit = job_exit_normal;
+		} else {
+			job_exit = job_exit_deadline;
+		}
+		
+		release(*iter);
+		pthread_mutex_lock(shared->mtx);
+		if(iter->is_io_job && iter->is_io_write_job)
+			--*(shared->num_io_write_jobs_running);
+		//copy+delete it into the exit queue
+		shared->exit_set->push_back(std::make_pair(*iter,job_exit));
+		shared->running_set->erase(iter);
+		pthread_mutex_unlock(shared->mtx);
+		
+		//a job held back by the limits may be startable now, and we may
+		//not be the one taking it
+		if(queued!=0)
+			wake_one();
+		
+		(shared->job_done_notify)();
+	}
+}
+
+
+extern "C" {
+static void *job_pool_thread_function(void *pv) {
+	WorkerQueue *wq = static_cast<WorkerQueue*>(pv);
+	wq->pool->run(wq);
+	return 0;
+}
 }
 
 } //anonymous namespace
@@ -234,16 +648,16 @@ ThreadPool::~ThreadPool()
 class JobScheduler_impl {
 	mutable pthread_mutex_t mtx;
 	
-	JobQueue   cpu_job_queue;
-	JobQueue   io_job_queue;
-	JobQueue   external_job_queue;
-	
 	RunningSet running_set;
 	
 	ExitSet    exit_set;
 	
 	unsigned   num_io_write_jobs_running;
 	
+	ThreadTypeLimits limits[thread_type_end];
+	
+	SharedState shared;
+	
 	ThreadPool cpu_thread_pool;
 	ThreadPool io_thread_pool;
 	ThreadPool external_thread_pool;
@@ -253,17 +667,16 @@ class JobScheduler_impl {
 	
 	bool submit(thread_type_t thread_type, JobEntry &e);
 public:
-	JobScheduler_impl(unsigned num_cpu_threads, unsigned num_io_threads, unsigned num_external_threads, job_done_notify_t job_done_notify)
+	JobScheduler_impl(unsigned num_cpu_threads, unsigned num_io_threads, unsigned num_external_threads, job_done_notify_t job_done_notify, bool pin_threads)
 	  : mtx PTHREAD_MUTEX_INITIALIZER,
-	    cpu_job_queue(),
-	    io_job_queue(),
-	    external_job_queue(),
 	    running_set(),
 	    exit_set(),
 	    num_io_write_jobs_running(0),
-	    cpu_thread_pool(num_cpu_threads,&cpu_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
-	    io_thread_pool(num_io_threads,&io_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
-	    external_thread_pool(num_external_threads,&external_job_queue,&running_set,&exit_set,&num_io_write_jobs_running,&mtx,job_done_notify),
+	    limits(),
+	    shared{&running_set,&exit_set,&num_io_write_jobs_running,limits,&mtx,job_done_notify?job_done_notify:job_done_notify_noop},
+	    cpu_thread_pool(num_cpu_threads,&shared,pin_threads?pinning_core:pinning_none),
+	    io_thread_pool(num_io_threads,&shared,pin_threads?pinning_node:pinning_none),
+	    external_thread_pool(num_external_threads,&shared,pin_threads?pinning_node:pinning_none),
 	    no_threads(num_cpu_threads==0 && num_io_threads==0 && num_external_threads==0),
 	    new_jobs_allowed(true)
 	{
@@ -274,10 +687,6 @@ public:
 		io_thread_pool.initiate_stop();
 		external_thread_pool.initiate_stop();
 		
-		pthread_cond_broadcast(&cpu_job_queue.cond_not_empty);
-		pthread_cond_broadcast(&io_job_queue.cond_not_empty);
-		pthread_cond_broadcast(&external_job_queue.cond_not_empty);
-		
 		cpu_thread_pool.join_all();
 		io_thread_pool.join_all();
 		external_thread_pool.join_all();
@@ -285,6 +694,8 @@ public:
 		pthread_mutex_destroy(&mtx);
 	}
 	
+	void set_thread_type_limits(thread_type_t thread_type, unsigned max_running, unsigned reserved_threads);
+	
 	bool submit(start_routine_t   start_routine,
 	            finish_routine_t  finish_callback,
 		    void             *state,
@@ -323,6 +734,18 @@ public:
 
 
 
+void JobScheduler_impl::set_thread_type_limits(thread_type_t thread_type, unsigned max_running, unsigned reserved_threads)
+{
+	assert(thread_type>=0 && thread_type<thread_type_end);
+	limits[thread_type].max_running = max_running;
+	limits[thread_type].reserved_threads = reserved_threads;
+	
+	cpu_thread_pool.limits_changed();
+	io_thread_pool.limits_changed();
+	external_thread_pool.limits_changed();
+}
+
+
 bool JobScheduler_impl::submit(thread_type_t thread_type, JobEntry &e)
 {
 	if(!new_jobs_allowed) //note: unprotected read
@@ -333,43 +756,38 @@ bool JobScheduler_impl::submit(thread_type_t thread_type, JobEntry &e)
 	//i/o jobs should have the is_io_job=true, but if they don't we will
 	//just treat them as CPU-bound. All this looks over-engineered but we
 	//need some flexibility to make experiments.
-	JobQueue *job_queue;
+	ThreadPool *thread_pool;
 	if(e.is_io_job)
-		job_queue = &io_job_queue;
+		thread_pool = &io_thread_pool;
 	else {
 		switch(thread_type) {
-			case thread_type_query_read:         job_queue = &cpu_job_queue;      break;
-			case thread_type_query_constrain:    job_queue = &cpu_job_queue;      break;
-			case thread_type_query_merge:        job_queue = &cpu_job_queue;      break;
-			case thread_type_query_intersect:    job_queue = &cpu_job_queue;      break;
-			case thread_type_query_summary:      job_queue = &cpu_job_queue;      break;
-			case thread_type_spider_read:        job_queue = &cpu_job_queue;      break;
-			case thread_type_spider_write:       job_queue = &cpu_job_queue;      break;
-			case thread_type_spider_filter:      job_queue = &external_job_queue; break;
-			case thread_type_spider_query:       job_queue = &cpu_job_queue;      break;
-			case thread_type_replicate_write:    job_queue = &cpu_job_queue;      break;
-			case thread_type_replicate_read:     job_queue = &cpu_job_queue;      break;
-			case thread_type_file_merge:         job_queue = &cpu_job_queue;      break;
-			case thread_type_file_meta_data:     job_queue = &cpu_job_queue;      break;
-			case thread_type_statistics:         job_queue = &cpu_job_queue;      break;
-			case thread_type_unspecified_io:     job_queue = &cpu_job_queue;      break;
-			case thread_type_unlink:             job_queue = &cpu_job_queue;      break;
-			case thread_type_twin_sync:          job_queue = &cpu_job_queue;      break;
-			case thread_type_hdtemp:             job_queue = &cpu_job_queue;      break;
-			case thread_type_generate_thumbnail: job_queue = &external_job_queue; break;
+			case thread_type_query_read:         thread_pool = &cpu_thread_pool;      break;
+			case thread_type_query_constrain:    thread_pool = &cpu_thread_pool;      break;
+			case thread_type_query_merge:        thread_pool = &cpu_thread_pool;      break;
+			case thread_type_query_intersect:    thread_pool = &cpu_thread_pool;      break;
+			case thread_type_query_summary:      thread_pool = &cpu_thread_pool;      break;
+			case thread_type_spider_read:        thread_pool = &cpu_thread_pool;      break;
+			case thread_type_spider_write:       thread_pool = &cpu_thread_pool;      break;
+			case thread_type_spider_filter:      thread_pool = &external_thread_pool; break;
+			case thread_type_spider_query:       thread_pool = &cpu_thread_pool;      break;
+			case thread_type_replicate_write:    thread_pool = &cpu_thread_pool;      break;
+			case thread_type_replicate_read:     thread_pool = &cpu_thread_pool;      break;
+			case thread_type_file_merge:         thread_pool = &cpu_thread_pool;      break;
+			case thread_type_file_meta_data:     thread_pool = &cpu_thread_pool;      break;
+			case thread_type_statistics:         thread_pool = &cpu_thread_pool;      break;
+			case thread_type_unspecified_io:     thread_pool = &cpu_thread_pool;      break;
+			case thread_type_unlink:             thread_pool = &cpu_thread_pool;      break;
+			case thread_type_twin_sync:          thread_pool = &cpu_thread_pool;      break;
+			case thread_type_hdtemp:             thread_pool = &cpu_thread_pool;      break;
+			case thread_type_generate_thumbnail: thread_pool = &external_thread_pool; break;
 			default:
 				assert(false);
 
 		}
 	}
 	
-	if(job_queue->potential_worker_threads==0)
-		return false;
-	
 	e.queue_enter_time = now_ms();
-	ScopedLock sl(mtx);
-	job_queue->add(e);
-	return true;
+	return thread_pool->add(e);
 }
 
 
@@ -425,20 +843,25 @@ bool JobScheduler_impl::are_io_write_jobs_running() const
 
 
 
+static bool is_reading_bigfile(const JobEntry &e, const BigFile *bf)
+{
+	if(e.is_io_job && !e.is_io_write_job) {
+		const FileState *fstate = reinterpret_cast<const FileState*>(e.state);
+		return fstate->m_bigfile==bf;
+	}
+	return false;
+}
+
+
 void JobScheduler_impl::cancel_file_read_jobs(const BigFile *bf)
 {
+	std::vector<JobEntry> cancelled;
+	io_thread_pool.remove_queued_if([bf](const JobEntry &e) {
+		return is_reading_bigfile(e,bf);
+	}, &cancelled);
 	ScopedLock sl(mtx);
-	for(JobQueue::iterator iter = io_job_queue.begin(); iter!=io_job_queue.end(); ) {
-		if(iter->is_io_job && !iter->is_io_write_job) {
-			const FileState *fstate = reinterpret_cast<const FileState*>(iter->state);
-			if(fstate->m_bigfile==bf) {
-				exit_set.push_back(std::make_pair(*iter,job_exit_cancelled));
-				iter = io_job_queue.erase(iter);
-				continue;
-			}
-		}
-		++iter;
-	}
+	for(const auto &e : cancelled)
+		exit_set.push_back(std::make_pair(e,job_exit_cancelled));
 }
 
 
@@ -447,20 +870,17 @@ bool JobScheduler_impl::is_reading_file(const BigFile *bf)
 	//The old thread stuff tested explicitly if the start_routine was
 	//readwriteWrapper_r() in BigFile.cpp but that is fragile. Besides,
 	//we have the 'is_io_write_job' field.
+	bool found = false;
+	io_thread_pool.for_each_queued([bf,&found](const JobEntry &e) {
+		if(is_reading_bigfile(e,bf))
+			found = true;
+	});
+	if(found)
+		return true;
 	ScopedLock sl(mtx);
-	for(const auto &e : io_job_queue) {
-		if(e.is_io_job && !e.is_io_write_job) {
-			const FileState *fstate = reinterpret_cast<const FileState*>(e.state);
-			if(fstate->m_bigfile==bf)
-				return true;
-		}
-	}
 	for(const auto &e : running_set) {
-		if(e.is_io_job && !e.is_io_write_job) {
-			const FileState *fstate = reinterpret_cast<const FileState*>(e.state);
-			if(fstate->m_bigfile==bf)
-				return true;
-		}
+		if(is_reading_bigfile(e,bf))
+			return true;
 	}
 	return false;
 }
@@ -469,8 +889,7 @@ bool JobScheduler_impl::is_reading_file(const BigFile *bf)
 
 unsigned JobScheduler_impl::num_queued_jobs() const
 {
-	ScopedLock sl(mtx);
-	return cpu_job_queue.size() + io_job_queue.size() + external_job_queue.size();
+	return cpu_thread_pool.num_queued() + io_thread_pool.num_queued() + external_thread_pool.num_queued();
 }
 
 void JobScheduler_impl::cleanup_finished_jobs()
@@ -507,14 +926,13 @@ static JobDigest job_entry_to_job_digest(const JobEntry& je, JobDigest::job_stat
 std::vector<JobDigest> JobScheduler_impl::query_job_digests() const
 {
 	std::vector<JobDigest> v;
-	ScopedLock sl(mtx);
-	//v.reserve(cpu_job_queue.size() + io_job_queue.size() + external_job_queue.size() + running_set().size() + exit_set().size());
-	for(const auto &je : cpu_job_queue)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
-	for(const auto &je : io_job_queue)
-		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
-	for(const auto &je : external_job_queue)
+	auto add_queued = [&v](const JobEntry &je) {
 		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_queued));
+	};
+	cpu_thread_pool.for_each_queued(add_queued);
+	io_thread_pool.for_each_queued(add_queued);
+	external_thread_pool.for_each_queued(add_queued);
+	ScopedLock sl(mtx);
 	for(const auto &je : running_set)
 		v.push_back(job_entry_to_job_digest(je,JobDigest::job_state_running));
 	for(const auto &je : exit_set)
@@ -542,10 +960,10 @@ JobScheduler::~JobScheduler()
 }
 
 
-bool JobScheduler::initialize(unsigned num_cpu_threads, unsigned num_io_threads, unsigned num_external_threads, job_done_notify_t job_done_notify)
+bool JobScheduler::initialize(unsigned num_cpu_threads, unsigned num_io_threads, unsigned num_external_threads, job_done_notify_t job_done_notify, bool pin_threads)
 {
 	assert(!impl);
-	impl = new JobScheduler_impl(num_cpu_threads,num_io_threads,num_external_threads,job_done_notify);
+	impl = new JobScheduler_impl(num_cpu_threads,num_io_threads,num_external_threads,job_done_notify,pin_threads);
 	return true;
 }
 
@@ -558,6 +976,13 @@ void JobScheduler::finalize()
 }
 
 
+void JobScheduler::set_thread_type_limits(thread_type_t thread_type, unsigned max_running, unsigned reserved_threads)
+{
+	if(impl)
+		impl->set_thread_type_limits(thread_type,max_running,reserved_threads);
+}
+
+
 bool JobScheduler::submit(start_routine_t   start_routine,
                           finish_routine_t  finish_callback,
                           void             *state,
@@ -41,6 +41,7 @@ enum thread_type_t {
 	thread_type_twin_sync,
 	thread_type_hdtemp,
 	thread_type_generate_thumbnail,
+	thread_type_end                 //not a type, the number of them
 };
 
 
@@ -73,9 +74,16 @@ public:
 	JobScheduler();
 	~JobScheduler();
 	
-	bool initialize(unsigned num_cpu_threads, unsigned num_io_threads, unsigned num_external_threads, job_done_notify_t job_done_notify=0);
+	//pin_threads: pin the cpu threads to a core each and the i/o and
+	//external threads to the cores of a numa node
+	bool initialize(unsigned num_cpu_threads, unsigned num_io_threads, unsigned num_external_threads, job_done_notify_t job_done_notify=0, bool pin_threads=false);
 	void finalize();
 	
+	//max_running: most jobs of the type running at the same time, 0 for no limit
+	//reserved_threads: threads of a pool kept for the types with a reservation
+	//(shared among them) in the pools their jobs are submitted to
+	void set_thread_type_limits(thread_type_t thread_type, unsigned max_running, unsigned reserved_threads);
+	
 	bool submit(start_routine_t   start_routine,
 	            finish_routine_t  finish_callback,
 		    void             *state,
@@ -0,0 +1,178 @@
+#include "LatencyHistogram.h"
+#include <math.h>
+
+
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+
+
+void LatencyHistogram::reset() {
+	for(size_t i=0; i<bucket_count; i++)
+		m_counts[i].store(0,std::memory_order_relaxed);
+	m_totalCount.store(0,std::memory_order_relaxed);
+	m_totalSum.store(0,std::memory_order_relaxed);
+	m_minValue.store(UINT64_MAX,std::memory_order_relaxed);
+	m_maxValue.store(0,std::memory_order_relaxed);
+}
+
+
+size_t LatencyHistogram::valueToIndex(uint64_t value) {
+	if(value>max_trackable_value)
+		value = max_trackable_value;
+	if(value<sub_bucket_count)
+		return (size_t)value;
+	//position of highest set bit
+	unsigned log2 = 63 - __builtin_clzll(value);
+	unsigned magnitude = log2 - (sub_bucket_bits-1);
+	uint64_t sub = value >> magnitude; //in [half_count..count)
+	return sub_bucket_count + (magnitude-1)*sub_bucket_half_count + (sub-sub_bucket_half_count);
+}
+
+
+uint64_t LatencyHistogram::lowestEquivalentValue(size_t index) {
+	if(index<sub_bucket_count)
+		return index;
+	size_t i = index - sub_bucket_count;
+	unsigned magnitude = i/sub_bucket_half_count + 1;
+	uint64_t sub = i%sub_bucket_half_count + sub_bucket_half_count;
+	return sub << magnitude;
+}
+
+
+uint64_t LatencyHistogram::highestEquivalentValue(size_t index) {
+	if(index+1>=bucket_count)
+		return max_trackable_value;
+	return lowestEquivalentValue(index+1) - 1;
+}
+
+
+void LatencyHistogram::record(uint64_t value) {
+	record(value,1);
+}
+
+
+void LatencyHistogram::record(uint64_t value, uint64_t count) {
+	if(count==0)
+		return;
+	m_counts[valueToIndex(value)].fetch_add(count,std::memory_order_relaxed);
+	m_totalCount.fetch_add(count,std::memory_order_relaxed);
+	m_totalSum.fetch_add(value*count,std::memory_order_relaxed);
+
+	uint64_t cur = m_minValue.load(std::memory_order_relaxed);
+	while(value<cur && !m_minValue.compare_exchange_weak(cur,value,std::memory_order_relaxed))
+		;
+	cur = m_maxValue.load(std::memory_order_relaxed);
+	while(value>cur && !m_maxValue.compare_exchange_weak(cur,value,std::memory_order_relaxed))
+		;
+}
+
+
+void LatencyHistogram::add(const LatencyHistogram &other) {
+	if(other.getCount()==0)
+		return;
+	for(size_t i=0; i<bucket_count; i++) {
+		uint64_t c = other.m_counts[i].load(std::memory_order_relaxed);
+		if(c)
+			m_counts[i].fetch_add(c,std::memory_order_relaxed);
+	}
+	m_totalCount.fetch_add(other.getCount(),std::memory_order_relaxed);
+	m_totalSum.fetch_add(other.m_totalSum.load(std::memory_order_relaxed),std::memory_order_relaxed);
+
+	uint64_t omin = other.m_minValue.load(std::memory_order_relaxed);
+	uint64_t cur = m_minValue.load(std::memory_order_relaxed);
+	while(omin<cur && !m_minValue.compare_exchange_weak(cur,omin,std::memory_order_relaxed))
+		;
+	uint64_t omax = other.getMax();
+	cur = m_maxValue.load(std::memory_order_relaxed);
+	while(omax>cur && !m_maxValue.compare_exchange_weak(cur,omax,std::memory_order_relaxed))
+		;
+}
+
+
+uint64_t LatencyHistogram::getMin() const {
+	if(getCount()==0)
+		return 0;
+	return m_minValue.load(std::memory_order_relaxed);
+}
+
+
+double LatencyHistogram::getMean() const {
+	uint64_t count = getCount();
+	if(count==0)
+		return 0.0;
+	return (double)m_totalSum.load(std::memory_order_relaxed) / count;
+}
+
+
+double LatencyHistogram::getStdDeviation() const {
+	uint64_t count = getCount();
+	if(count==0)
+		return 0.0;
+	double mean = getMean();
+	double sumSquares = 0.0;
+	for(size_t i=0; i<bucket_count; i++) {
+		uint64_t c = getBucketCount(i);
+		if(c==0)
+			continue;
+		//use the middle of the bucket as representative value
+		double v = (lowestEquivalentValue(i) + highestEquivalentValue(i)) / 2.0;
+		sumSquares += (v-mean)*(v-mean)*c;
+	}
+	return sqrt(sumSquares/count);
+}
+
+
+uint64_t LatencyHistogram::getValueAtPercentile(double percentile) const {
+	uint64_t count = getCount();
+	if(count==0)
+		return 0;
+	if(percentile>100.0)
+		percentile = 100.0;
+	uint64_t wanted = (uint64_t)ceil(percentile/100.0*count);
+	if(wanted==0)
+		wanted = 1;
+	uint64_t seen = 0;
+	for(size_t i=0; i<bucket_count; i++) {
+		seen += getBucketCount(i);
+		if(seen>=wanted) {
+			uint64_t v = highestEquivalentValue(i);
+			uint64_t max = getMax();
+			return v<max ? v : max;
+		}
+	}
+	return getMax();
+}
+
+
+uint64_t LatencyHistogram::getCountAtOrBelow(uint64_t value) const {
+	size_t last = valueToIndex(value);
+	uint64_t count = 0;
+	for(size_t i=0; i<=last; i++)
+		count += getBucketCount(i);
+	return count;
+}
+
+
+void LatencyHistogram::printPercentileDistribution(FILE *fp, double outputScale) const {
+	uint64_t count = getCount();
+	fprintf(fp,"%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+	uint64_t seen = 0;
+	for(size_t i=0; i<bucket_count; i++) {
+		uint64_t c = getBucketCount(i);
+		if(c==0)
+			continue;
+		seen += c;
+		double fraction = (double)seen/count;
+		uint64_t v = highestEquivalentValue(i);
+		if(v>getMax())
+			v = getMax();
+		if(seen<count)
+			fprintf(fp,"%12.3f %2.12f %10" PRIu64" %14.2f\n", v/outputScale, fraction, seen, 1.0/(1.0-fraction));
+		else
+			fprintf(fp,"%12.3f %2.12f %10" PRIu64"\n", v/outputScale, fraction, seen);
+	}
+	fprintf(fp,"#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", getMean()/outputScale, getStdDeviation()/outputScale);
+	fprintf(fp,"#[Max     = %12.3f, Total count    = %12" PRIu64"]\n", getMax()/outputScale, count);
+	fprintf(fp,"#[Buckets = %12u, SubBuckets     = %12u]\n", max_magnitude+1, sub_bucket_count);
+}
@@ -0,0 +1,75 @@
+#ifndef GB_LATENCYHISTOGRAM_H
+#define GB_LATENCYHISTOGRAM_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <atomic>
+
+// Log-linear (HDR-style) histogram for latency measurements.
+//
+// Values below 2*sub_bucket_half_count are counted exactly. Above that each
+// power-of-two range is split into sub_bucket_half_count linear sub-buckets,
+// so the relative error of any reported value is less than 1/64 (~1.6%).
+// Values above max_trackable_value are clamped into the last bucket.
+//
+// record() is lock-free and may be called concurrently from any thread.
+// The readers (percentiles, printing) give a consistent-enough snapshot for
+// reporting but are not atomic with respect to concurrent recording.
+class LatencyHistogram {
+public:
+	static const unsigned sub_bucket_bits = 7;
+	static const unsigned sub_bucket_count = 1u<<sub_bucket_bits;         //128
+	static const unsigned sub_bucket_half_count = sub_bucket_count/2;    //64
+	static const unsigned max_magnitude = 40 - sub_bucket_bits;          //values up to 2^40
+	static const size_t   bucket_count = sub_bucket_count + max_magnitude*sub_bucket_half_count;
+	static const uint64_t max_trackable_value = (1ULL<<40) - 1;
+
+	LatencyHistogram();
+
+	void reset();
+
+	void record(uint64_t value);
+	void record(uint64_t value, uint64_t count);
+
+	// add all counts from another histogram into this one
+	void add(const LatencyHistogram &other);
+
+	uint64_t getCount() const { return m_totalCount.load(std::memory_order_relaxed); }
+	uint64_t getMin() const;
+	uint64_t getMax() const { return m_maxValue.load(std::memory_order_relaxed); }
+	uint64_t getSum() const { return m_totalSum.load(std::memory_order_relaxed); }
+	double getMean() const;
+	double getStdDeviation() const;
+
+	// percentile is 0..100. Returns the highest value that is equivalent (same
+	// bucket) to the value at that percentile, capped at the recorded max.
+	uint64_t getValueAtPercentile(double percentile) const;
+
+	// number of recorded values in bucket 'index'
+	uint64_t getBucketCount(size_t index) const { return m_counts[index].load(std::memory_order_relaxed); }
+
+	// number of recorded values that are equivalent to a value <= 'value'
+	uint64_t getCountAtOrBelow(uint64_t value) const;
+
+	// Print the percentile distribution in the text format used by
+	// HdrHistogram ("Value Percentile TotalCount 1/(1-Percentile)"), with
+	// values divided by outputScale (eg. 1000.0 to print microseconds as ms)
+	void printPercentileDistribution(FILE *fp, double outputScale) const;
+
+	static size_t valueToIndex(uint64_t value);
+	static uint64_t lowestEquivalentValue(size_t index);
+	static uint64_t highestEquivalentValue(size_t index);
+
+private:
+	LatencyHistogram(const LatencyHistogram&);
+	LatencyHistogram& operator=(const LatencyHistogram&);
+
+	std::atomic<uint64_t> m_counts[bucket_count];
+	std::atomic<uint64_t> m_totalCount;
+	std::atomic<uint64_t> m_totalSum;
+	std::atomic<uint64_t> m_minValue;
+	std::atomic<uint64_t> m_maxValue;
+};
+
+#endif // GB_LATENCYHISTOGRAM_H
@@ -12,21 +12,6 @@
 #include <valgrind/memcheck.h>
 #endif
 
-static LinkInfo *makeLinkInfo ( const char        *coll                    ,
-			 int32_t         ip                      ,
-			 int32_t         siteNumInlinks          ,
-			 Msg20Reply **replies                 ,
-			 int32_t         numReplies              ,
-			 // if link spam give this weight
-			 int32_t         spamWeight              ,
-			 bool         oneVotePerIpTop         ,
-			 int64_t    linkeeDocId             ,
-			 int32_t         lastUpdateTime          ,
-			 bool         onlyNeedGoodInlinks      ,
-			 int32_t         niceness                ,
-			 class Msg25 *msg25 ,
-			 SafeBuf *linkInfoBuf ) ;
-
 Linkdb g_linkdb;
 Linkdb g_linkdb2;
 
@@ -403,11 +388,9 @@ void Msg25::reset() {
 	m_fullIpTable.reset();
 	m_firstIpTable.reset();
 	m_docIdTable.reset();
+	m_oldInlinkTable.reset();
 }
 
-#define MODE_PAGELINKINFO 1
-#define MODE_SITELINKINFO 2
-
 // . we got a reply back from the msg25 request
 // . reply should just be a LinkInfo class
 // . set XmlDoc::m_linkInfoBuf safebuf to that reply
@@ -937,6 +920,7 @@ bool Msg25::getLinkInfo2( char      *site                ,
 	m_docIdDupsLinkdb     = 0;
 	m_lostLinks           = 0;
 	m_ipDups              = 0;
+	m_reusedInlinks       = 0;
 	m_linkSpamLinkdb      = 0;
 	//m_url                 = url;
 	m_docId               = docId;
@@ -1227,6 +1211,9 @@ bool Msg25::gotList() {
 		if ( ! m_docIdTable.set(8,0,needSlots,
 					NULL,0,false,m_niceness,"msg25docid") )
 			return true;
+		// the linkers we can reuse the old link text of
+		if ( ! setOldInlinkTable() )
+			return true;
 		// . how many link spam inlinks can we accept?
 		// . they do not contribute to quality
 		// . they only contribute to link text
@@ -1322,6 +1309,8 @@ bool Msg25::sendRequests ( ) {
 		int32_t     discovered = 0;
 		// was the link lost?
 		int32_t     lostDate = 0; 
+		// the linker's site rank, -1 if not known
+		char     siteRank = -1;
 
 		// . recycle inlinks from the old link info guy
 		// . this keeps our inlinks persistent!!! very nice...
@@ -1351,6 +1340,7 @@ bool Msg25::sendRequests ( ) {
 			ip32       = g_linkdb.getLinkerIp_uk     ( &key );
 			isLinkSpam = g_linkdb.isLinkSpam_uk  ( &key );
 			docId      = g_linkdb.getLinkerDocId_uk    ( &key );
+			siteRank   = g_linkdb.getLinkerSiteRank_uk ( &key );
 			discovered = g_linkdb.getDiscoveryDate_uk(&key);
 			// is it expired?
 			lostDate = g_linkdb.getLostDate_uk(&key);
@@ -1536,6 +1526,23 @@ bool Msg25::sendRequests ( ) {
 			continue;
 		}
 
+		// . the linker is still in linkdb and was in the old link
+		//   info, so reuse its link text we got when we last made
+		//   the link info instead of getting its titlerec again
+		Inlink *old = NULL;
+		if ( m_oldInlinkTable.getNumSlots() > 0 &&
+		     ( ! m_k || m_k == (Inlink *)-1 ) ) {
+			Inlink **op = (Inlink **)m_oldInlinkTable.getValue(&docId);
+			if ( op ) old = *op;
+		}
+		if ( old && reuseOldInlink ( old , j , ip32 , siteRank ) ) {
+			// . this returns true if we are done
+			// . g_errno is set on error, and true is returned
+			if ( gotLinkText ( r ) ) return true;
+			// keep going
+			continue;
+		}
+
 		// debug log
 		if ( g_conf.m_logDebugLinkInfo ) {
 			const char *ms = "page";
@@ -1572,6 +1579,57 @@ bool Msg25::sendRequests ( ) {
 	return gotLinkText ( NULL );
 }
 
+// . map the docids of the inlinks in the old link info to their Inlink
+// . only for page link info and only if the old link info is recent enough
+// . returns false and sets g_errno on error
+bool Msg25::setOldInlinkTable ( ) {
+	m_oldInlinkTable.reset();
+	if ( m_mode != MODE_PAGELINKINFO ) return true;
+	if ( ! m_oldLinkInfo ) return true;
+	if ( g_conf.m_linkInfoReuseMaxAge <= 0 ) return true;
+	int32_t age = getTimeGlobal() - m_oldLinkInfo->getLastUpdated();
+	if ( age > g_conf.m_linkInfoReuseMaxAge * 86400 ) return true;
+	int32_t n = m_oldLinkInfo->getNumLinkTexts();
+	if ( n <= 0 ) return true;
+	if ( ! m_oldInlinkTable.set ( 8 , sizeof(Inlink *) , n * 2 , NULL , 0 ,
+				      false , m_niceness , "msg25old" ) )
+		return false;
+	for ( Inlink *k = m_oldLinkInfo->getNextInlink ( NULL ) ; k ;
+	      k = m_oldLinkInfo->getNextInlink ( k ) ) {
+		// recycled ones were not in linkdb last time either
+		if ( k->m_recycled ) continue;
+		if ( ! m_oldInlinkTable.addKey ( &k->m_docId , &k ) )
+			return false;
+	}
+	return true;
+}
+
+// . use the old Inlink "k" as the Msg20Reply of m_msg20s[j]
+// . "ip32" and "siteRank" are from the linkdb key, so more recent
+// . returns false if out of memory, we get the linker's titlerec then
+bool Msg25::reuseOldInlink ( Inlink *k , int32_t j , uint32_t ip32 ,
+			     char siteRank ) {
+	// gotLinkText() stores it or frees it like a Msg20 reply
+	Msg20Reply *rep = (Msg20Reply *)mmalloc ( sizeof(Msg20Reply) , "msg25r" );
+	if ( ! rep ) {
+		g_errno = 0;
+		return false;
+	}
+	rep->reset();
+	k->setMsg20Reply ( rep );
+	rep->m_ip = ip32;
+	if ( siteRank >= 0 ) rep->m_siteRank = siteRank;
+	Msg20 *m = &m_msg20s[j];
+	m->m_r            = rep;
+	m->m_replyMaxSize = sizeof(Msg20Reply);
+	m->m_ownReply     = true;
+	m_reusedInlinks++;
+	if ( g_conf.m_logDebugLinkInfo )
+		log("msg25: reusing link text of docid=%" PRId64" url=%s",
+		    k->m_docId,m_url);
+	return true;
+}
+
 bool gotLinkTextWrapper ( void *state ) { // , LinkTextReply *linkText ) {
 	Msg20Request *req = (Msg20Request *)state;
 	// get our Msg25
@@ -2965,7 +3023,7 @@ bool Msg25::addNote ( const char *note , int32_t noteLen , int64_t docId ) {
 //   LinkInfo's Inlinks to get their weights, etc.
 // . returns the LinkInfo on success
 // . returns NULL and sets g_errno on error
-static LinkInfo *makeLinkInfo ( const char        *coll                    ,
+LinkInfo *makeLinkInfo ( const char        *coll                    ,
 			 int32_t         ip                      ,
 			 int32_t         siteNumInlinks          ,
 			 Msg20Reply **replies                 ,
@@ -3262,17 +3320,11 @@ void Inlink::set ( const Msg20Reply *r ) {
 	int32_t poff = 0;
 	char *p = m_buf;
 
-	int32_t need = 
-		r->size_ubuf + 
-		r->size_linkText +
-		r->size_surroundingText +
-		r->size_rssItem +
-		r->size_categories +
-		r->size_templateVector;
-
-	char *pend = p + need;
-	// -10 to add \0's for remaining guys in case of breach
-	pend -= 10;
+	// . the strings after the link text are cut if they do not fit in
+	//   m_buf, not if they do not fit in what "r" needs, otherwise an
+	//   Inlink made from the Msg20Reply of another Inlink would differ
+	// . -10 to add \0's for remaining guys in case of breach
+	char *pend = m_buf + MAXINLINKSTRINGBUFSIZE - 10;
 
 
 	size_urlBuf           = r->size_ubuf;
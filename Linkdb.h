@@ -383,6 +383,10 @@ extern class Linkdb g_linkdb2;
 
 #define MSG25_MAX_REQUEST_SIZE (MAX_URL_LEN+MAX_COLL_LEN+64)
 
+// Msg25::m_mode
+#define MODE_PAGELINKINFO 1
+#define MODE_SITELINKINFO 2
+
 
 class Msg25 {
 
@@ -588,12 +592,20 @@ class Msg25 {
 	//HashTableT <int64_t, char> m_docIdTable;
 	HashTableX m_docIdTable;
 
+	// . docid to Inlink in m_oldLinkInfo of the linkers whose link
+	//   text we can reuse instead of getting their titlerec again
+	HashTableX m_oldInlinkTable;
+	bool setOldInlinkTable ( );
+	bool reuseOldInlink ( Inlink *k , int32_t j , uint32_t ip32 ,
+			      char siteRank );
+
 	// special counts
 	int32_t      m_ipDupsLinkdb;
 	int32_t      m_docIdDupsLinkdb;
 	int32_t      m_linkSpamLinkdb;
 	int32_t      m_lostLinks;
 	int32_t      m_ipDups;
+	int32_t      m_reusedInlinks;
 
 	uint32_t  m_groupId;
 	int64_t      m_probDocId;
@@ -703,6 +715,15 @@ class LinkInfo {
 	char   m_buf[0];
 } __attribute__((packed, aligned(4)));
 
+// . makes the LinkInfo of the Msg20Replies of the inlinkers in "linkInfoBuf"
+// . returns NULL and sets g_errno on error
+LinkInfo *makeLinkInfo ( const char *coll , int32_t ip , int32_t siteNumInlinks ,
+			 class Msg20Reply **replies , int32_t numReplies ,
+			 int32_t spamWeight , bool oneVotePerIpTop ,
+			 int64_t linkeeDocId , int32_t lastUpdateTime ,
+			 bool onlyNeedGoodInlinks , int32_t niceness ,
+			 class Msg25 *msg25 , class SafeBuf *linkInfoBuf ) ;
+
 
 #define MAXINLINKSTRINGBUFSIZE 2048
 
@@ -14,7 +14,12 @@
 Log g_log;
 
 #include <pthread.h>
-// the thread lock
+#include <signal.h>
+#include <atomic>
+#include <algorithm>
+#include <new>
+// . the thread lock
+// . protects the log file and draining the rings
 static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
@@ -194,47 +199,158 @@ static bool g_loggingEnabled = true;
 // 1GB max log file size
 #define MAXLOGFILESIZE 1000000000
 
-bool Log::logR ( int64_t now, int32_t type, const char *msg, bool forced ) {
-	if ( ! g_loggingEnabled ) {
-		return true;
-	}
+// . each thread that logs gets its own ring of raw msgs, the writer thread
+//   formats them and writes them out in batches
+// . must be a power of 2
+#define LOG_RING_SIZE   (64*1024)
+#define MAX_LOG_RINGS   1024
+// most entries we take out of the rings per batch
+#define MAX_LOG_BATCH_ENTRIES 8192
+// how long the writer thread sleeps if no ring is getting full
+#define LOG_WRITER_WAIT_MS 20
+
+// a msg in a ring. the msg itself follows, it is not \0 terminated.
+struct LogEntry {
+	// size of the whole entry, a multiple of 8
+	int32_t  m_size;
+	// -1 for the padding at the end of the ring
+	int32_t  m_type;
+	int64_t  m_now;
+	uint32_t m_tid;
+	int32_t  m_msgLen;
+};
+
+struct LogRing {
+	LogRing ( ) : m_head(0), m_inUse(true), m_busy(0), m_tail(0) { }
+	// only changed by the thread owning the ring
+	std::atomic<uint32_t> m_head;
+	// false once the owning thread exited, another thread can take it
+	std::atomic<bool>     m_inUse;
+	// set while the owning thread adds to the ring, so a signal handler
+	// on that thread does not add to it at the same time
+	volatile sig_atomic_t m_busy;
+	// keep the producer and consumer offsets on their own cache lines
+	char m_pad[64];
+	// only changed by whoever drains the rings, under s_lock
+	std::atomic<uint32_t> m_tail;
+	char m_buf[LOG_RING_SIZE];
+};
+
+static std::atomic<LogRing *> s_rings[MAX_LOG_RINGS];
+static std::atomic<int32_t>   s_numRings(0);
+static __thread LogRing *s_ring = NULL;
+static __thread uint32_t s_ringTid = 0;
+static pthread_key_t s_ringKey;
+static bool s_ringKeyCreated = false;
+
+static std::atomic<bool> s_writerRunning(false);
+// set by logSynchronously(), the rings are not used any more
+static std::atomic<bool> s_synchronous(false);
+static bool s_stopWriter = false;
+static pthread_t s_writerThread;
+static pthread_mutex_t s_writerMtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_writerCond = PTHREAD_COND_INITIALIZER;
+
+static std::atomic<uint64_t> s_numDropped(0);
+static std::atomic<uint64_t> s_numOverflowed(0);
+// how many of the dropped msgs we logged about. protected by s_lock.
+static uint64_t s_numDroppedLogged = 0;
+
+// entries taken out of the rings and the formatted lines of a batch.
+// protected by s_lock.
+static const LogEntry *s_batchEntries[MAX_LOG_BATCH_ENTRIES];
+static char s_batchBuf[256*1024];
+
+extern "C" {
+// called when a thread that logged exits
+static void releaseLogRing ( void *ring ) {
+	((LogRing *)ring)->m_inUse.store ( false, std::memory_order_release );
+}
+}
 
-	// return true if we should not log this
-	if ( ! forced && ! shouldLog ( type , msg ) ) {
-		return true;
+// . get the ring of the calling thread, returns NULL if none available
+// . not allocated with mmalloc() because Mem logs
+static LogRing *getLogRing ( ) {
+	if ( s_ring ) return s_ring;
+	int32_t n = s_numRings.load ( std::memory_order_acquire );
+	if ( n > MAX_LOG_RINGS ) n = MAX_LOG_RINGS;
+	// take over the ring of a thread that exited
+	for ( int32_t i = 0 ; i < n && ! s_ring ; i++ ) {
+		LogRing *r = s_rings[i].load ( std::memory_order_acquire );
+		if ( ! r ) continue;
+		bool inUse = false;
+		if ( r->m_inUse.compare_exchange_strong ( inUse, true ) )
+			s_ring = r;
 	}
+	if ( ! s_ring ) {
+		int32_t i = s_numRings.fetch_add ( 1 );
+		if ( i >= MAX_LOG_RINGS ) return NULL;
+		LogRing *r = new (std::nothrow) LogRing();
+		if ( ! r ) return NULL;
+		s_rings[i].store ( r, std::memory_order_release );
+		s_ring = r;
+	}
+	s_ringTid = (uint32_t)syscall(SYS_gettid);
+	pthread_setspecific ( s_ringKey, s_ring );
+	return s_ring;
+}
 
-	// get "msg"'s length
-	int32_t msgLen = strlen ( msg );
-
-	// lock for threads
-	pthread_mutex_lock ( &s_lock );
-
-	// do a timestamp, too. use the time synced with host #0 because
-	// it is easier to debug because all log timestamps are in sync.
-	if ( now == 0 ) now = gettimeofdayInMillisecondsGlobalNoCore();
-
-	// . skip all logging if power out, we do not want to screw things up
-	// . allow logging for 10 seconds after power out though
-	if ( ! g_process.m_powerIsOn && now - g_process.m_powerOffTime >10000){
-		pthread_mutex_unlock ( &s_lock );
+// . add a msg to the ring of the calling thread without taking any lock
+// . returns false if it did not fit
+bool Log::logToRing ( int64_t now, int32_t type, const char *msg,
+		      int32_t msgLen ) {
+	LogRing *r = getLogRing();
+	if ( ! r || r->m_busy ) return false;
+	uint32_t size = ( sizeof(LogEntry) + msgLen + 7 ) & ~7;
+	if ( size > LOG_RING_SIZE / 2 ) return false;
+	r->m_busy = 1;
+	uint32_t head   = r->m_head.load ( std::memory_order_relaxed );
+	uint32_t tail   = r->m_tail.load ( std::memory_order_acquire );
+	uint32_t off    = head & ( LOG_RING_SIZE - 1 );
+	uint32_t contig = LOG_RING_SIZE - off;
+	// entries do not wrap, pad to the end of the ring instead
+	uint32_t need   = size;
+	if ( contig < size ) need += contig;
+	if ( head - tail + need > LOG_RING_SIZE ) {
+		r->m_busy = 0;
 		return false;
 	}
+	if ( contig < size ) {
+		LogEntry *pad = (LogEntry *)(r->m_buf + off);
+		pad->m_size = contig;
+		pad->m_type = -1;
+		head += contig;
+		off   = 0;
+	}
+	LogEntry *e = (LogEntry *)(r->m_buf + off);
+	e->m_size   = size;
+	e->m_type   = type;
+	e->m_now    = now;
+	e->m_tid    = s_ringTid;
+	e->m_msgLen = msgLen;
+	memcpy ( e + 1, msg, msgLen );
+	head += size;
+	r->m_head.store ( head, std::memory_order_release );
+	r->m_busy = 0;
+	// wake up the writer thread if the ring is getting full
+	if ( head - tail > LOG_RING_SIZE / 2 )
+		pthread_cond_signal ( &s_writerCond );
+	return true;
+}
 
-	// chop off any spaces at the end of the msg.
-	while ( is_wspace_a ( msg [ msgLen - 1 ] ) && msgLen > 0 ) msgLen--;
-
-	// a tmp buffer
-	char tt [ MAX_LINE_LEN ];
-	char *p    = tt;
-
+// . format a log line into "dst", which is MAX_LINE_LEN bytes
+// . returns the length of the line, not including the \0
+int32_t Log::formatLine ( char *dst, int64_t now, int32_t type, uint32_t tid,
+			  const char *msg, int32_t msgLen ) {
+	char *p = dst;
 
 	if ( m_logTimestamps ) 
 	{
         if( m_logReadableTimestamps )
         {
             time_t now_t = (time_t)(now / 1000);
-            struct tm *stm = localtime(&now_t);
+            struct tm tm1;
+            struct tm *stm = localtime_r(&now_t, &tm1);
 
             p += sprintf ( p , "%04d%02d%02d-%02d%02d%02d-%03d %04" PRId32" ", stm->tm_year+1900,stm->tm_mon+1,stm->tm_mday,stm->tm_hour,stm->tm_min,stm->tm_sec,(int)(now%1000), g_hostdb.m_hostId );
         }
@@ -252,40 +368,33 @@ bool Log::logR ( int64_t now, int32_t type, const char *msg, bool forced ) {
         }
 	}
 
-
-
-	// Get thread id. pthread_self instead?
-	unsigned tid=(unsigned)syscall(SYS_gettid);
 	p += sprintf(p, "%06u ", tid);
 
 	// Log level
 	p += sprintf(p, "%s ", getTypeString(type));
-	
 
 	// then message itself
 	const char *x = msg;
-	int32_t avail = (MAX_LINE_LEN) - (p - tt) - 1;
+	if ( msgLen > 0 && *x == ':' ) { x++; msgLen--; }
+	if ( msgLen > 0 && *x == ' ' ) { x++; msgLen--; }
+	int32_t avail = (MAX_LINE_LEN) - (p - dst) - 1;
 	if ( msgLen > avail ) msgLen = avail;
-	if ( *x == ':' ) x++;
-	if ( *x == ' ' ) x++;
-	strncpy ( p , x , avail );
-	// capitalize for consistency. no, makes grepping log msgs harder.
-	//if ( is_alpha_a(*p) ) *p = to_upper_a(*p);
-	p += strlen(p);
+	// stop at a \0 like strncpy() did
+	const char *nul = (const char *)memchr ( x , '\0' , msgLen );
+	if ( nul ) msgLen = nul - x;
+	memcpy ( p , x , msgLen );
+	p += msgLen;
 	// back up over spaces
-	while ( p[-1] == ' ' ) p--;
-	// end in period or ? or !
-	//if ( p[-1] != '?' && p[-1] != '.' && p[-1] != '!' )
-	//	*p++ = '.';
+	while ( p > dst && p[-1] == ' ' ) p--;
 	*p ='\0';
 	// the total length, not including the \0
-	int32_t tlen = p - tt;
+	int32_t tlen = p - dst;
 
 	// . filter out nasty chars from the message
 	// . replace with ~'s
 	char cs;
-	char *ttp    = tt;
-	char *ttpend = tt + tlen;
+	char *ttp    = dst;
+	char *ttpend = dst + tlen;
 	for ( ; ttp < ttpend ; ttp += cs ) {
 		cs = getUtf8CharSize ( ttp );
 		if ( is_binary_utf8 ( ttp ) ) {
@@ -295,23 +404,243 @@ bool Log::logR ( int64_t now, int32_t type, const char *msg, bool forced ) {
 			continue;
 		}
 	}
+	return tlen;
+}
 
+// write out formatted lines. caller must hold s_lock.
+void Log::writeBuf ( const char *buf, int32_t len ) {
 	// . if filesize would be too big then make a new log file
 	// . should make a new m_fd
-	if ( m_logFileSize + tlen+1 > MAXLOGFILESIZE && g_conf.m_logToFile )
+	if ( m_logFileSize + len > MAXLOGFILESIZE && g_conf.m_logToFile )
 		makeNewLogFile();
 
 	if ( m_fd >= 0 ) {
-		write ( m_fd , tt , tlen );
-		write ( m_fd , "\n", 1 );
-		m_logFileSize += tlen + 1;
+		write ( m_fd , buf , len );
+		m_logFileSize += len;
 	}
 	else {
 		// print it out for now
-		fprintf ( stderr, "%s\n", tt );
+		fwrite ( buf , 1 , len , stderr );
+	}
+}
+
+// format and write a single line. caller must hold s_lock.
+void Log::writeLine ( int64_t now, int32_t type, uint32_t tid,
+		      const char *msg, int32_t msgLen ) {
+	char tt [ MAX_LINE_LEN + 1 ];
+	int32_t tlen = formatLine ( tt, now, type, tid, msg, msgLen );
+	tt[tlen++] = '\n';
+	writeBuf ( tt, tlen );
+}
+
+static bool logEntryCmp ( const LogEntry *a, const LogEntry *b ) {
+	return a->m_now < b->m_now;
+}
+
+// . take up to MAX_LOG_BATCH_ENTRIES msgs out of the rings, and write them
+//   out in time order with as few writes as possible
+// . caller must hold s_lock
+// . returns the number of msgs written
+int32_t Log::drainRings ( ) {
+	int32_t numRings = s_numRings.load ( std::memory_order_acquire );
+	if ( numRings > MAX_LOG_RINGS ) numRings = MAX_LOG_RINGS;
+	// . the rings we take entries out of and their new tails
+	// . a ring published while we drain is left for the next time
+	LogRing *rings [ MAX_LOG_RINGS ];
+	uint32_t newTails [ MAX_LOG_RINGS ];
+	int32_t numEntries = 0;
+	for ( int32_t i = 0 ; i < numRings ; i++ ) {
+		LogRing *r = s_rings[i].load ( std::memory_order_acquire );
+		rings[i] = r;
+		if ( ! r ) continue;
+		uint32_t tail = r->m_tail.load ( std::memory_order_relaxed );
+		uint32_t head = r->m_head.load ( std::memory_order_acquire );
+		while ( tail != head && numEntries < MAX_LOG_BATCH_ENTRIES ) {
+			const LogEntry *e = (const LogEntry *)
+				(r->m_buf + ( tail & ( LOG_RING_SIZE - 1 ) ));
+			tail += e->m_size;
+			if ( e->m_type == -1 ) continue;
+			s_batchEntries[numEntries++] = e;
+		}
+		newTails[i] = tail;
 	}
 
+	uint64_t numDropped = s_numDropped.load ( std::memory_order_relaxed );
+	if ( numEntries == 0 && numDropped == s_numDroppedLogged )
+		return 0;
+
+	// each ring is in order already, but the threads are not
+	std::stable_sort ( s_batchEntries, s_batchEntries + numEntries,
+			   logEntryCmp );
+
+	char *p   = s_batchBuf;
+	char *end = s_batchBuf + sizeof(s_batchBuf);
+	for ( int32_t i = 0 ; i < numEntries ; i++ ) {
+		if ( end - p < MAX_LINE_LEN + 1 ) {
+			writeBuf ( s_batchBuf, p - s_batchBuf );
+			p = s_batchBuf;
+		}
+		const LogEntry *e = s_batchEntries[i];
+		p += formatLine ( p, e->m_now, e->m_type, e->m_tid,
+				  (const char *)(e + 1), e->m_msgLen );
+		*p++ = '\n';
+	}
+
+	if ( numDropped != s_numDroppedLogged ) {
+		if ( end - p < MAX_LINE_LEN + 1 ) {
+			writeBuf ( s_batchBuf, p - s_batchBuf );
+			p = s_batchBuf;
+		}
+		char msg[128];
+		int32_t msgLen = snprintf ( msg, sizeof(msg),
+			"log: Dropped %" PRIu64" msgs because the log ring "
+			"was full.", numDropped - s_numDroppedLogged );
+		p += formatLine ( p, gettimeofdayInMillisecondsGlobalNoCore(),
+				  LOG_WARN, (uint32_t)syscall(SYS_gettid),
+				  msg, msgLen );
+		*p++ = '\n';
+		s_numDroppedLogged = numDropped;
+	}
+
+	if ( p > s_batchBuf )
+		writeBuf ( s_batchBuf, p - s_batchBuf );
+
+	// the ring space can be reused now
+	for ( int32_t i = 0 ; i < numRings ; i++ ) {
+		if ( ! rings[i] ) continue;
+		rings[i]->m_tail.store ( newTails[i], std::memory_order_release );
+	}
+	return numEntries;
+}
+
+void Log::flush ( ) {
+	pthread_mutex_lock ( &s_lock );
+	while ( drainRings() == MAX_LOG_BATCH_ENTRIES ) ;
+	pthread_mutex_unlock ( &s_lock );
+}
+
+void Log::logSynchronously ( ) {
+	s_synchronous.store ( true, std::memory_order_relaxed );
+}
+
+uint64_t Log::getNumDropped ( ) const {
+	return s_numDropped.load ( std::memory_order_relaxed );
+}
+
+uint64_t Log::getNumOverflowed ( ) const {
+	return s_numOverflowed.load ( std::memory_order_relaxed );
+}
+
+extern "C" {
+static void *logWriterThread ( void * ) {
+	pthread_mutex_lock ( &s_writerMtx );
+	while ( ! s_stopWriter ) {
+		timespec ts;
+		clock_gettime ( CLOCK_REALTIME, &ts );
+		ts.tv_nsec += LOG_WRITER_WAIT_MS * 1000000;
+		if ( ts.tv_nsec >= 1000000000 ) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait ( &s_writerCond, &s_writerMtx, &ts );
+		pthread_mutex_unlock ( &s_writerMtx );
+		g_log.flush();
+		pthread_mutex_lock ( &s_writerMtx );
+	}
+	pthread_mutex_unlock ( &s_writerMtx );
+	return NULL;
+}
+
+static void stopLogWriterAtExit ( ) {
+	g_log.stopWriterThread();
+}
+}
+
+bool Log::startWriterThread ( ) {
+	if ( s_writerRunning ) return true;
+	if ( ! s_ringKeyCreated ) {
+		if ( pthread_key_create ( &s_ringKey, releaseLogRing ) != 0 ) {
+			log( LOG_ERROR, "log: pthread_key_create() failed" );
+			return false;
+		}
+		s_ringKeyCreated = true;
+		atexit ( stopLogWriterAtExit );
+	}
+	s_stopWriter = false;
+	int rc = pthread_create ( &s_writerThread, NULL, logWriterThread, NULL );
+	if ( rc != 0 ) {
+		log( LOG_ERROR, "log: pthread_create() failed with rc=%d (%s)",
+		     rc, strerror(rc) );
+		return false;
+	}
+	s_writerRunning = true;
+	return true;
+}
+
+void Log::stopWriterThread ( ) {
+	if ( ! s_writerRunning ) return;
+	// everyone writes synchronously again
+	s_writerRunning = false;
+	pthread_mutex_lock ( &s_writerMtx );
+	s_stopWriter = true;
+	pthread_cond_signal ( &s_writerCond );
+	pthread_mutex_unlock ( &s_writerMtx );
+	pthread_join ( s_writerThread, NULL );
+	flush();
+}
+
+bool Log::logR ( int64_t now, int32_t type, const char *msg, bool forced ) {
+	if ( ! g_loggingEnabled ) {
+		return true;
+	}
+
+	// return true if we should not log this
+	if ( ! forced && ! shouldLog ( type , msg ) ) {
+		return true;
+	}
+
+	// get "msg"'s length
+	int32_t msgLen = strlen ( msg );
+
+	// do a timestamp, too. use the time synced with host #0 because
+	// it is easier to debug because all log timestamps are in sync.
+	if ( now == 0 ) now = gettimeofdayInMillisecondsGlobalNoCore();
+
+	// . skip all logging if power out, we do not want to screw things up
+	// . allow logging for 10 seconds after power out though
+	if ( ! g_process.m_powerIsOn && now - g_process.m_powerOffTime >10000){
+		return false;
+	}
+
+	// chop off any spaces at the end of the msg.
+	while ( msgLen > 0 && is_wspace_a ( msg [ msgLen - 1 ] ) ) msgLen--;
+
+	// . hand it to the writer thread. the line is formatted by it.
+	// . if the ring is full we drop the debug msgs, the others are
+	//   written below so we do not lose them
+	if ( s_writerRunning.load ( std::memory_order_relaxed ) &&
+	     ! s_synchronous.load ( std::memory_order_relaxed ) &&
+	     g_conf.m_logAsynchronously ) {
+		if ( logToRing ( now, type, msg, msgLen ) ) return false;
+		if ( type == LOG_DEBUG || type == LOG_TRACE ||
+		     type == LOG_TIMING ) {
+			s_numDropped++;
+			return false;
+		}
+		s_numOverflowed++;
+	}
+
+	// Get thread id. pthread_self instead?
+	unsigned tid=(unsigned)syscall(SYS_gettid);
+
+	// lock for threads
+	pthread_mutex_lock ( &s_lock );
+
+	// write what is in the rings first so the lines stay in order
+	if ( s_numRings.load ( std::memory_order_relaxed ) > 0 )
+		while ( drainRings() == MAX_LOG_BATCH_ENTRIES ) ;
 
+	writeLine ( now, type, tid, msg, msgLen );
 
 	// unlock for threads
 	pthread_mutex_unlock ( &s_lock );
@@ -130,6 +130,27 @@ class Log {
 	// returns false if msg should not be logged, true if it should
 	bool shouldLog ( int32_t type , const char *msg ) ;
 
+	// . start the thread that writes the log lines for us
+	// . until it is started, or if "log asynchronously" is off, logR()
+	//   writes each line itself under the log lock
+	// . each thread then appends its raw msgs to its own lock-free ring
+	//   and the writer thread formats them and writes them in batches
+	bool startWriterThread ( );
+	void stopWriterThread ( );
+
+	// write out everything that is in the rings now. call before abort()
+	void flush ( );
+
+	// . stop using the rings, every msg is written under the log lock
+	// . safe to call from a signal handler, so a thread that crashes
+	//   before it logged does not allocate a ring in sigbadHandler()
+	void logSynchronously ( );
+
+	// msgs thrown away because the thread's ring was full
+	uint64_t getNumDropped ( ) const;
+	// msgs written synchronously because they did not fit in the ring
+	uint64_t getNumOverflowed ( ) const;
+
 	// just initialize with no file
 	Log () ;
 	~Log () ;
@@ -151,6 +172,15 @@ class Log {
 
 	int64_t m_logFileSize;
 	bool makeNewLogFile ( );
+
+	bool logToRing ( int64_t now, int32_t type, const char *msg,
+			 int32_t msgLen );
+	int32_t formatLine ( char *dst, int64_t now, int32_t type, uint32_t tid,
+			     const char *msg, int32_t msgLen );
+	void writeLine ( int64_t now, int32_t type, uint32_t tid,
+			 const char *msg, int32_t msgLen );
+	void writeBuf ( const char *buf, int32_t len );
+	int32_t drainRings ( );
 };
 
 extern class Log g_log;
@@ -701,6 +701,11 @@ void sigbadHandler ( int x , siginfo_t *info , void *y ) {
 	// turn off sigalarms
 	g_loop.disableQuickpollTimer();
 
+	// . write what we log from here on ourselves, getting a log ring for
+	//   this thread would allocate it in the signal handler
+	// . also keeps the lines if the log writer thread is the one crashing
+	g_log.logSynchronously();
+
 	log("loop: sigbadhandler. disabling handler from recall.");
 	// . don't allow this handler to be called again
 	// . does this work if we're in a thread?
@@ -736,7 +741,7 @@ void sigbadHandler ( int x , siginfo_t *info , void *y ) {
 static void sigprofHandler(int signo, siginfo_t *info, void *context)
 {
 	//This is called on SIGPROF meaning that profiling is enabled
-	g_profiler.getStackFrame();
+	g_profiler.getStackFrame(context);
 }
 
 // shit, we can't make this realtime!! RdbClose() cannot be called by a
@@ -4,7 +4,6 @@
 #include "Clusterdb.h"
 #include "Spider.h"
 #include "Rdb.h"
-#include "Profiler.h"
 #include "Repair.h"
 #include "Process.h"
 
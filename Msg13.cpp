@@ -894,6 +894,16 @@ void downloadTheDocForReals3b ( Msg13Request *r ) {
 	if ( maxDocLen2 < 0 || maxDocLen2 > MAX_ABSDOCLEN )
 		maxDocLen2 = MAX_ABSDOCLEN;
 
+	// . keep the connection to the web server for the next download
+	//   from this ip, but only if the hammer logic above lets us back
+	//   before TcpServer closes it as idle
+	// . not through proxies, those are different web servers each time
+	bool keepAlive = ( g_conf.m_spiderKeepAlive &&
+			   ! r->m_proxyIp &&
+			   ! exactRequest &&
+			   r->m_numBannedProxies == 0 &&
+			   r->m_crawlDelayMS < g_conf.m_spiderKeepAliveTimeout );
+
 	// . download it
 	// . if m_proxyIp is non-zero it will make requests like:
 	//   GET http://xyz.com/abc
@@ -917,7 +927,8 @@ void downloadTheDocForReals3b ( Msg13Request *r ) {
 				     exactRequest , // our own mime!
 				     NULL , // postContent
 				     // this is NULL or '\0' if not there
-				     r->m_proxyUsernamePwdAuth ) ) {
+				     r->m_proxyUsernamePwdAuth ,
+				     keepAlive ) ) {
 		// return false if blocked
 		return;
 	}
@@ -2,18 +2,31 @@
 
 #include "Msg2.h"
 #include "Stats.h"
+#include "Statistics.h"
+#include "QueryTrace.h"
 #include "RdbList.h"
 #include "Rdb.h"
 #include "Posdb.h" // getTermId()
 #include "Msg3a.h" // DEFAULT_POSDB_READ_SIZE
 #include "HighFrequencyTermShortcuts.h"
+#include "TermListCache.h"
 #include "Sanity.h"
+#include "Conf.h"
+#include <algorithm>
+#include <vector>
 
+// do not bother reading docid ranges of termlists smaller than this
+#define MIN_PARTIAL_READ_SIZE (1024*1024)
 
 
 Msg2::Msg2()
-  : m_msg5(0),
+  : m_inFirstPass(0),
+    m_nextRange(0),
+    m_rangeLists(0),
+    m_msg5(0),
     m_avail(0),
+    m_msg5StartUs(0),
+    m_trace(0),
     m_numLists(0)
 {
 }
@@ -30,7 +43,16 @@ void Msg2::reset ( ) {
 	m_msg5 = 0;
 	delete[] m_avail;
 	m_avail = 0;
+	delete[] m_msg5StartUs;
+	m_msg5StartUs = 0;
+	m_trace = 0;
 	m_lists = 0;
+	delete[] m_inFirstPass;
+	m_inFirstPass = 0;
+	delete[] m_nextRange;
+	m_nextRange = 0;
+	delete[] m_rangeLists;
+	m_rangeLists = 0;
 }
 
 // . returns false if blocked, true otherwise
@@ -57,7 +79,8 @@ bool Msg2::getLists ( int32_t     rdbId       ,
 		      void   (* callback)(void *state ) ,
 		      bool allowHighFrequencyTermCache,
 		      int32_t     niceness    ,
-		      bool     isDebug ) {
+		      bool     isDebug ,
+		      bool     allowPartialReads ) {
 	// warning
 	if ( collnum < 0 ) log(LOG_LOGIC,"net: bad collection. msg2.");
 	if ( ! minRecSizes ) { 
@@ -90,11 +113,17 @@ bool Msg2::getLists ( int32_t     rdbId       ,
 	m_numRequests = 0;
 	// start the timer
 	m_startTime = gettimeofdayInMilliseconds();
+	m_startUs = gettimeofdayInMicroseconds();
 	// set this
 	m_numLists = numQterms;
 
+	m_allowPartialReads = allowPartialReads;
+	m_pass = 0;
+	m_numRanges = -1;
+
 	m_msg5 = new Msg5[m_numLists+MAX_WHITELISTS];
 	m_avail = new bool[m_numLists+MAX_WHITELISTS];
+	m_msg5StartUs = new uint64_t[m_numLists+MAX_WHITELISTS];
 	for ( int32_t i = 0; i < m_numLists+MAX_WHITELISTS; i++ )
 		m_avail[i] = true;
 		
@@ -106,10 +135,294 @@ bool Msg2::getLists ( int32_t     rdbId       ,
 	m_errno = 0;
 	// reset list counter
 	m_i = 0;
+	// read the termlists of a rare term first if it saves reading
+	setFirstPass();
 	// fetch what we need
 	return getLists ( );
 }
 
+// is query term #j in the required group of query term #i, the way
+// PosdbTable::setQueryTermInfo() groups them?
+static bool isInRequiredGroup ( const QueryTerm *qterms, int32_t j, int32_t i ) {
+	const QueryTerm *qt = &qterms[i];
+	const QueryTerm *t  = &qterms[j];
+	if ( t == qt ) return true;
+	const QueryTerm *left  = qt->m_leftPhraseTermNum  >= 0 ? qt->m_leftPhraseTerm  : NULL;
+	const QueryTerm *right = qt->m_rightPhraseTermNum >= 0 ? qt->m_rightPhraseTerm : NULL;
+	if ( left  && t == left  ) return true;
+	if ( right && t == right ) return true;
+	// synonyms of the term and of its bigrams
+	const QueryTerm *syn = t->m_synonymOf;
+	if ( ! syn ) return false;
+	return syn == qt || ( left && syn == left ) || ( right && syn == right );
+}
+
+// numeric termlists do not restrict the docids of the search results
+static bool isNumericField ( char fieldCode ) {
+	switch ( fieldCode ) {
+	case FIELD_GBSORTBYFLOAT:
+	case FIELD_GBREVSORTBYFLOAT:
+	case FIELD_GBNUMBERMIN:
+	case FIELD_GBNUMBERMAX:
+	case FIELD_GBNUMBEREQUALFLOAT:
+	case FIELD_GBSORTBYINT:
+	case FIELD_GBREVSORTBYINT:
+	case FIELD_GBNUMBERMININT:
+	case FIELD_GBNUMBERMAXINT:
+	case FIELD_GBNUMBEREQUALINT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// . use the rdb maps to estimate the termlist size in this key range
+int64_t Msg2::getListSizeEstimate ( const char *startKey , const char *endKey ) {
+	char maxKey[MAX_KEY_BYTES];
+	return g_posdb.getRdb()->getListSize ( m_collnum, (char *)startKey, (char *)endKey, maxKey, -1 );
+}
+
+// . every search result of a non-boolean query has a docid from the
+//   termlists of each required term, its bigrams and synonyms included
+// . so if one required term is much rarer than another we read its
+//   termlists first, and then only the docid ranges of its docids from the
+//   bigger termlists, see startSecondPass()
+// . the termlist sizes are estimated from the rdb maps, within the current
+//   docid split range
+// . returns false if it is not worth it, we read all termlists at once then
+bool Msg2::setFirstPass ( ) {
+	// from the last call
+	delete[] m_inFirstPass;
+	m_inFirstPass = 0;
+	delete[] m_nextRange;
+	m_nextRange = 0;
+	delete[] m_rangeLists;
+	m_rangeLists = 0;
+
+	if ( ! m_allowPartialReads ) return false;
+	if ( m_rdbId != RDB_POSDB ) return false;
+	if ( g_conf.m_partialTermListReadMaxDocIds <= 0 ) return false;
+
+	int32_t best = -1;
+	int64_t bestSize = 0;
+	int64_t maxSize = 0;
+	for ( int32_t i = 0 ; i < m_numLists ; i++ ) {
+		const QueryTerm *qt = &m_qterms[i];
+		// keep it simple for the pipe operator
+		if ( qt->m_piped ) return false;
+		if ( ! qt->m_isRequired ) continue;
+		int64_t size = 0;
+		for ( int32_t j = 0 ; j < m_numLists ; j++ ) {
+			if ( ! isInRequiredGroup ( m_qterms, j, i ) ) continue;
+			if ( m_minRecSizes[j] == 0 ) continue;
+			size += getListSizeEstimate ( m_qterms[j].m_startKey, m_qterms[j].m_endKey );
+		}
+		if ( size > maxSize ) maxSize = size;
+		// negative terms are not in the search results
+		if ( qt->m_termSign == '-' ) continue;
+		if ( isNumericField ( qt->m_fieldCode ) ) continue;
+		if ( best >= 0 && size >= bestSize ) continue;
+		best = i;
+		bestSize = size;
+	}
+	if ( best < 0 ) return false;
+	// not worth it unless another term has a much bigger termlist
+	if ( maxSize < MIN_PARTIAL_READ_SIZE ) return false;
+	if ( maxSize < bestSize * 4 ) return false;
+
+	try {
+		m_inFirstPass = new bool[m_numLists];
+		m_nextRange = new int32_t[m_numLists];
+		m_rangeLists = new RdbList[m_numLists];
+	} catch ( std::bad_alloc & ) {
+		// just read them all at once
+		delete[] m_inFirstPass;
+		m_inFirstPass = 0;
+		delete[] m_nextRange;
+		m_nextRange = 0;
+		return false;
+	}
+	for ( int32_t j = 0 ; j < m_numLists ; j++ ) {
+		m_inFirstPass[j] = isInRequiredGroup ( m_qterms, j, best );
+		m_nextRange[j] = -1;
+	}
+
+	if ( m_isDebug )
+		log("query: reading termlists of term #%" PRId32" first. "
+		    "estimated size=%" PRId64" biggest=%" PRId64,
+		    best, bestSize, maxSize);
+	return true;
+}
+
+// . split the sorted docids at the "maxRanges-1" biggest gaps between them
+int32_t Msg2::getDocIdRanges ( const int64_t *docIds, int32_t numDocIds, int32_t maxRanges,
+			       int64_t *rangeStart, int64_t *rangeEnd ) {
+	if ( numDocIds <= 0 || maxRanges <= 0 ) return 0;
+	if ( numDocIds <= maxRanges ) {
+		for ( int32_t i = 0 ; i < numDocIds ; i++ ) {
+			rangeStart[i] = docIds[i];
+			rangeEnd  [i] = docIds[i];
+		}
+		return numDocIds;
+	}
+	// a range ends at each of these docids
+	std::vector<int32_t> splits ( numDocIds - 1 );
+	for ( int32_t i = 0 ; i < numDocIds - 1 ; i++ )
+		splits[i] = i;
+	std::nth_element ( splits.begin(), splits.begin() + maxRanges - 1, splits.end(),
+			   [docIds] ( int32_t a, int32_t b ) {
+				   return docIds[a+1] - docIds[a] > docIds[b+1] - docIds[b]; } );
+	splits.resize ( maxRanges - 1 );
+	std::sort ( splits.begin(), splits.end() );
+
+	int32_t n = 0;
+	int32_t first = 0;
+	for ( int32_t i = 0 ; i < maxRanges - 1 ; i++ ) {
+		rangeStart[n] = docIds[first];
+		rangeEnd  [n] = docIds[splits[i]];
+		n++;
+		first = splits[i] + 1;
+	}
+	rangeStart[n] = docIds[first];
+	rangeEnd  [n] = docIds[numDocIds-1];
+	return n + 1;
+}
+
+// . we got the termlists of the rare term, get the docid ranges of its docids
+//   and decide which of the other termlists to read just those ranges of
+void Msg2::startSecondPass ( ) {
+	m_pass = 1;
+	m_i = 0;
+
+	const int32_t maxDocIds = g_conf.m_partialTermListReadMaxDocIds;
+	std::vector<int64_t> docIds;
+	bool tooMany = false;
+	for ( int32_t i = 0 ; i < m_numLists && ! tooMany ; i++ ) {
+		if ( ! m_inFirstPass[i] ) continue;
+		RdbList *list = &m_lists[i];
+		int64_t last = -1;
+		int32_t count = 0;
+		for ( list->resetListPtr() ; ! list->isExhausted() ; list->skipCurrentRecord() ) {
+			char key[MAX_KEY_BYTES];
+			list->getCurrentKey ( key );
+			int64_t docId = g_posdb.getDocId ( key );
+			if ( docId == last ) continue;
+			last = docId;
+			docIds.push_back ( docId );
+			if ( ++count > maxDocIds ) { tooMany = true; break; }
+		}
+		list->resetListPtr();
+	}
+	std::sort ( docIds.begin(), docIds.end() );
+	docIds.erase ( std::unique ( docIds.begin(), docIds.end() ), docIds.end() );
+	if ( tooMany || (int32_t)docIds.size() > maxDocIds ) {
+		if ( m_isDebug )
+			log("query: rare term has too many docids, reading whole termlists");
+		return;
+	}
+
+	m_numRanges = getDocIdRanges ( docIds.data(), docIds.size(), MAX_PARTIAL_READ_RANGES,
+				       m_rangeStart, m_rangeEnd );
+
+	// only read the docid ranges of a termlist if it saves reading
+	for ( int32_t i = 0 ; i < m_numLists ; i++ ) {
+		if ( m_inFirstPass[i] ) continue;
+		const QueryTerm *qt = &m_qterms[i];
+		int64_t size = getListSizeEstimate ( qt->m_startKey, qt->m_endKey );
+		if ( size < MIN_PARTIAL_READ_SIZE ) continue;
+		int64_t termId = g_posdb.getTermId ( qt->m_startKey );
+		int64_t rangesSize = 0;
+		for ( int32_t r = 0 ; r < m_numRanges ; r++ ) {
+			char sk[MAX_KEY_BYTES];
+			char ek[MAX_KEY_BYTES];
+			g_posdb.makeStartKey ( sk, termId, m_rangeStart[r] );
+			g_posdb.makeEndKey   ( ek, termId, m_rangeEnd[r] );
+			rangesSize += getListSizeEstimate ( sk, ek );
+		}
+		if ( rangesSize * 2 > size ) continue;
+		m_nextRange[i] = 0;
+		if ( m_isDebug )
+			log("query: reading %" PRId32" docid ranges of termlist #%" PRId32". "
+			    "estimated size=%" PRId64" of %" PRId64,
+			    m_numRanges, i, rangesSize, size);
+	}
+}
+
+// . read the remaining docid ranges of termlist #i, one at a time, and add
+//   them to m_lists[i]
+// . returns false if blocked, true otherwise
+// . sets m_errno on error
+bool Msg2::readRanges ( int32_t i ) {
+	int64_t termId = g_posdb.getTermId ( m_qterms[i].m_startKey );
+	while ( m_nextRange[i] < m_numRanges ) {
+		// enough read?
+		if ( m_minRecSizes[i] != -1 && m_lists[i].m_listSize >= m_minRecSizes[i] )
+			break;
+		int32_t r = m_nextRange[i]++;
+		char sk[MAX_KEY_BYTES];
+		char ek[MAX_KEY_BYTES];
+		g_posdb.makeStartKey ( sk, termId, m_rangeStart[r] );
+		g_posdb.makeEndKey   ( ek, termId, m_rangeEnd[r] );
+
+		Msg5 *msg5 = getAvailMsg5();
+		if(!msg5) gbshutdownLogicError();
+
+		if ( ! msg5->getList ( m_rdbId          , // rdbid
+				       m_collnum        ,
+				       &m_rangeLists[i] , // listPtr
+				       sk,
+				       ek,
+				       m_minRecSizes[i] ,
+				       true           , // include tree?
+				       false          , // addtocache
+				       0              , // maxcacheage
+				       0              , // start file num
+				       -1             , // num files
+				       this,
+				       gotListWrapper ,
+				       m_niceness     ,
+				       false          , // error correction
+				       NULL           , // cachekeyptr
+				       0              , // retrynum
+				       -1             , // maxretries
+				       true           , // compensateformerge?
+				       -1             , // syncpoint
+				       false          , // isrealmerge?
+				       true ) )         // allow disk page cache?
+			return false;
+
+		returnMsg5 ( msg5 );
+		if ( g_errno ) {
+			m_errno = g_errno;
+			log("query: Got error reading termlist: %s.", mstrerror(g_errno));
+			return true;
+		}
+		if ( ! addRange ( i ) ) return true;
+	}
+	m_lists[i].resetListPtr();
+	return true;
+}
+
+// . add the docid range we read of termlist #i to the end of m_lists[i]
+// . returns false and sets m_errno on error
+bool Msg2::addRange ( int32_t i ) {
+	RdbList *range = &m_rangeLists[i];
+	RdbList *list  = &m_lists[i];
+	// the keys compress at least as well as in the range
+	if ( ! list->growList ( list->m_listSize + range->m_listSize ) ) {
+		m_errno = g_errno;
+		log("query: Could not grow termlist: %s.", mstrerror(g_errno));
+		return false;
+	}
+	for ( range->resetListPtr() ; ! range->isExhausted() ; range->skipCurrentRecord() ) {
+		char key[MAX_KEY_BYTES];
+		range->getCurrentKey ( key );
+		list->addRecord ( key, 0, NULL );
+	}
+	range->freeList();
+	return true;
+}
+
 bool Msg2::getLists ( ) {
 	// if we're just using the root file of indexdb to save seeks
 	int32_t numFiles = -1;
@@ -165,6 +478,10 @@ bool Msg2::getLists ( ) {
 		     ! qt->m_synonymOf )
 			continue;
 
+		// just the termlists of the rare term in the first pass
+		if ( m_inFirstPass && m_inFirstPass[m_i] != ( m_pass == 0 ) )
+			continue;
+
 		//if the term is a high-frequency one then use the PosDB shortcuts
 		const void *hfterm_shortcut_posdb_buffer;
 		size_t hfterm_shortcut_buffer_bytes;
@@ -201,6 +518,27 @@ bool Msg2::getLists ( ) {
 			continue;
 		}
 
+		// complete termlists of the most queried terms are in memory
+		if ( m_rdbId == RDB_POSDB &&
+		     g_termListCache.getList ( m_collnum, qt->m_termId, sk2, ek2,
+					       minRecSize, includeTree, numFiles,
+					       &m_lists[m_i] ) ) {
+			if ( m_isDebug )
+				log("query: termlist #%" PRId32" termId=%" PRId64" "
+				    "from termlist cache",m_i,qt->m_termId);
+			continue;
+		}
+
+		// just the docid ranges of the rare term's docids
+		if ( m_pass == 1 && m_nextRange[m_i] >= 0 ) {
+			m_lists[m_i].set ( NULL, 0, NULL, 0, sk2, ek2, 0, true, true, sizeof(POSDBKEY) );
+			m_numRequests++;
+			if ( ! readRanges ( m_i ) ) continue;
+			m_numReplies++;
+			if ( m_errno ) goto skip;
+			continue;
+		}
+
 		Msg5 *msg5 = getAvailMsg5();
 		if(!msg5) gbshutdownLogicError();
 
@@ -359,6 +697,11 @@ bool Msg2::getLists ( ) {
 
 	// . did anyone block? if so, return false for now
 	if ( m_numRequests > m_numReplies ) return false;
+	// got the termlists of the rare term, now read the others
+	if ( m_pass == 0 && m_inFirstPass && ! m_errno ) {
+		startSecondPass();
+		return getLists();
+	}
 	// . otherwise, we got everyone, so go right to the merge routine
 	// . returns false if not all replies have been received 
 	// . returns true if done
@@ -370,6 +713,7 @@ Msg5 *Msg2::getAvailMsg5 ( ) {
 	for ( int32_t i = 0; i < m_numLists+MAX_WHITELISTS; i++ ) {
 		if ( ! m_avail[i] ) continue;
 		m_avail[i] = false;
+		m_msg5StartUs[i] = gettimeofdayInMicroseconds();
 		return &m_msg5[i];
 	}
 	return NULL;
@@ -383,6 +727,19 @@ void Msg2::returnMsg5 ( Msg5 *msg5 ) {
 	if ( i >= m_numLists+MAX_WHITELISTS ) gbshutdownLogicError();
 	// make it available
 	m_avail[i] = true;
+	uint64_t now = gettimeofdayInMicroseconds();
+	Statistics::register_stage_time ( Statistics::stage_query_msg5,
+					  now - m_msg5StartUs[i] );
+	if ( m_trace ) {
+		// the term # of the list, -1 for a whitelist
+		RdbList *list = msg5->m_list;
+		int32_t term = -1;
+		if ( list >= m_lists && list < m_lists + m_numLists )
+			term = list - m_lists;
+		else if ( m_rangeLists && list >= m_rangeLists && list < m_rangeLists + m_numLists )
+			term = list - m_rangeLists;
+		m_trace->addSpan ( span_msg5, 2, term, m_msg5StartUs[i], now );
+	}
 	// reset it
 	msg5->reset();
 }
@@ -402,9 +759,16 @@ void Msg2::gotListWrapper( Msg5 *msg5 ) {
 		m_errno = g_errno;
 		g_errno = 0;
 	}
+	returnMsg5 ( msg5 );
+	// a docid range of a termlist, read the next one
+	if ( m_rangeLists && list >= m_rangeLists && list < m_rangeLists + m_numLists ) {
+		int32_t i = list - m_rangeLists;
+		if ( ! m_errno ) addRange ( i );
+		if ( ! m_errno && ! readRanges ( i ) ) return;
+		list = &m_lists[i];
+	}
 	// identify the msg0 slot we use
 	int32_t i  = list - m_lists;
-	returnMsg5 ( msg5 );
 	m_numReplies++;
 	// note it
 	if ( m_isDebug ) {
@@ -417,6 +781,12 @@ void Msg2::gotListWrapper( Msg5 *msg5 ) {
 	
 	if ( m_numRequests > m_numReplies )
 		return; //still more to go
+	// got the termlists of the rare term, now read the others
+	if ( m_pass == 0 && m_inFirstPass && ! m_errno ) {
+		startSecondPass();
+		if ( ! getLists() ) return;
+	}
+	recordStats();
 	// set g_errno if any one list read had error
 	if ( m_errno ) g_errno = m_errno;
 	// now call callback, we're done
@@ -463,6 +833,17 @@ bool Msg2::gotList ( RdbList *list ) {
 		    i,m_lists[i].m_listSize,m_minRecSizes[i]);
 	}
 
+	recordStats();
+
+	// set this i guess
+	g_errno = m_errno;
+
+	// all done
+	return true;
+}
+
+
+void Msg2::recordStats ( ) {
 	// debug msg
 	int64_t now = gettimeofdayInMilliseconds();
 	// . add the stat
@@ -475,10 +856,6 @@ bool Msg2::gotList ( RdbList *list ) {
 		//"get_termlists"
 		g_stats.addStat_r ( 0, m_startTime, now, 0x00ffff00 );
 	}
-
-	// set this i guess
-	g_errno = m_errno;
-
-	// all done
-	return true;
+	Statistics::register_stage_time ( Statistics::stage_query_msg2,
+					  gettimeofdayInMicroseconds() - m_startUs );
 }
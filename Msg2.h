@@ -10,8 +10,13 @@
 // support the &sites=xyz.com+abc.com+... to restrict search results to provided sites.
 #define MAX_WHITELISTS 500
 
+// read at most this many docid ranges of a termlist when only reading the
+// docids of a rare query term from it
+#define MAX_PARTIAL_READ_RANGES 64
+
 
 class QueryTerm;
+class QueryTrace;
 
 
 /**
@@ -61,7 +66,11 @@ public:
 			void (*callback)(void *state),
 			bool allowHighFrequencyTermCache,
 			int32_t niceness = MAX_NICENESS,
-			bool isDebug = false);
+			bool isDebug = false,
+			// read the termlists of the rarest required term first,
+			// then just its docids from the other termlists. not
+			// for boolean queries.
+			bool allowPartialReads = false);
 
 	/** Get the list "i". Once we got the lists, (getLists(...) has been called), we cache them in m_lists.*/
 	RdbList *getList(int32_t i) {
@@ -76,9 +85,17 @@ public:
 	int64_t docIdStart() const { return m_docIdStart; }
 	int64_t docIdEnd() const { return m_docIdEnd; }
 
+	/** add a span for every termlist read to "trace", NULL to not. Set after reset(). */
+	void setTrace(QueryTrace *trace) { m_trace = trace; }
+
 	int32_t getNumWhiteLists() const { return m_w; }
 	RdbList *getWhiteList(int32_t i) { return &(m_whiteLists[i]); }
 
+	/** Split the sorted "docIds" into at most "maxRanges" ranges, splitting at the biggest
+	 *  gaps between them. returns the number of ranges. */
+	static int32_t getDocIdRanges(const int64_t *docIds, int32_t numDocIds, int32_t maxRanges,
+				      int64_t *rangeStart, int64_t *rangeEnd);
+
 private:
 	// helper (handles index of list)
 	int32_t m_i;
@@ -98,10 +115,35 @@ private:
 	void returnMsg5(Msg5 *msg5);
 
 	bool gotList(RdbList *list);
+	// record how long getting the lists took, whether or not we blocked
+	void recordStats();
+
+	// . reading the termlists of the rarest required term in a first
+	//   pass and only the docid ranges of its docids from the others
+	bool setFirstPass();
+	void startSecondPass();
+	bool readRanges(int32_t i);
+	bool addRange(int32_t i);
+	int64_t getListSizeEstimate(const char *startKey, const char *endKey);
+
+	bool m_allowPartialReads;
+	int32_t m_pass;
+	// which termlists are read in the first pass, NULL if just one pass
+	bool *m_inFirstPass;
+	// next docid range to read of each termlist, -1 to read it whole
+	int32_t *m_nextRange;
+	// the docid range of a termlist being read
+	RdbList *m_rangeLists;
+	int32_t m_numRanges;
+	int64_t m_rangeStart[MAX_PARTIAL_READ_RANGES];
+	int64_t m_rangeEnd[MAX_PARTIAL_READ_RANGES];
 
 	// we can get up to MAX_QUERY_TERMS term frequencies at the same time
 	Msg5 *m_msg5;
 	bool *m_avail; // which msg5s are available?
+	uint64_t *m_msg5StartUs; // when each msg5 was taken
+
+	QueryTrace *m_trace;
 
 	int32_t m_errno;
 
@@ -132,6 +174,7 @@ private:
 
 	// start time
 	int64_t m_startTime;
+	uint64_t m_startUs;
 };
 
 #endif // GB_MSG2_H
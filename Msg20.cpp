@@ -4,9 +4,11 @@
 #include <valgrind/memcheck.h>
 #endif
 #include "SummaryCache.h"
+#include "QueryTrace.h"
 
 static void gotReplyWrapper20 ( void *state , void *state20 ) ;
 static void handleRequest20   ( UdpSlot *slot , int32_t netnice );
+static void handleRequest21   ( UdpSlot *slot , int32_t netnice );
 static bool gotReplyWrapperxd ( void *state ) ;
 
 
@@ -82,6 +84,8 @@ bool Msg20::registerHandler ( ) {
     // . it calls our callback when it receives a msg of type 0x20
     if ( ! g_udpServer.registerHandler ( msg_type_20, handleRequest20 ))
 		return false;
+	if ( ! g_udpServer.registerHandler ( msg_type_21, handleRequest21 ))
+		return false;
 
 	return true;
 }
@@ -99,50 +103,10 @@ void Msg20::copyFrom ( Msg20 *src ) {
 	src->destructor();
 }
 
-// returns true and sets g_errno on error, otherwise, blocks and returns false
-bool Msg20::getSummary ( Msg20Request *req ) {
-	// reset ourselves in case recycled
-	reset();
-
-	// consider it "launched"
-	m_launched = true;
-
-	// save it
-	m_requestDocId = req->m_docId;
-	m_state        = req->m_state;
-	m_callback     = req->m_callback;
-	m_callback2    = req->m_callback2;
-	m_expected     = req->m_expected;
-
-	// does this ever happen?
-	if ( g_hostdb.getNumHosts() <= 0 ) {
-		log("build: hosts2.conf is not in working directory, or "
-		    "contains no valid hosts.");
-		g_errno = EBADENGINEER;
-		return true;
-	}
-
-	if ( req->m_docId < 0 && ! req->ptr_ubuf ) {
-		log("msg20: docid<0 and no url for msg20::getsummary");
-		g_errno = EBADREQUEST;
-		return true;
-	}
-
-	// get groupId from docId, if positive
-	uint32_t shardNum;
-	if ( req->m_docId >= 0 ) 
-		shardNum = g_hostdb.getShardNumFromDocId(req->m_docId);
-	else {
-		int64_t pdocId = g_titledb.getProbableDocId(req->ptr_ubuf);
-		shardNum = getShardNumFromDocId(pdocId);
-	}
-
-	// we might be getting inlinks for a spider request
-	// so make sure timeout is inifinite for that...
-	const int32_t timeout = (req->m_niceness==0)
-	                      ? multicast_msg20_summary_timeout
-	                      : multicast_infinite_send_timeout;
-
+// . pick the host of shard "shardNum" to send "req" to first
+// . returns -1 and sets g_errno if the shard has no queryable hosts
+static int32_t getFirstHostId ( const Msg20Request *req, uint32_t shardNum,
+				int64_t *probDocIdPtr ) {
 	// get our group
 	int32_t  allNumHosts = g_hostdb.getNumHostsPerShard();
 	Host *allHosts    = g_hostdb.getShard ( shardNum );
@@ -175,8 +139,7 @@ bool Msg20::getSummary ( Msg20Request *req ) {
 		log("msg20: error sending mcast: no queryable hosts "
 		    "availble to handle summary generation");
 		g_errno = EBADENGINEER;
-		m_gotReply = true;
-		return true;
+		return -1;
 	}
 
 	// route based on docid region, not parity, because we want to hit
@@ -199,7 +162,60 @@ bool Msg20::getSummary ( Msg20Request *req ) {
 	int32_t hostNum = (probDocId % (128LL*1024*1024)) / sectionWidth;
 	if ( hostNum < 0 ) hostNum = 0; // watch out for negative docids
 	if ( hostNum >= nc ) { g_process.shutdownAbort(true); }
-	int32_t firstHostId = cand [ hostNum ]->m_hostId ;
+	*probDocIdPtr = probDocId;
+	return cand [ hostNum ]->m_hostId ;
+}
+
+// returns true and sets g_errno on error, otherwise, blocks and returns false
+bool Msg20::getSummary ( Msg20Request *req ) {
+	// reset ourselves in case recycled
+	reset();
+
+	// consider it "launched"
+	m_launched = true;
+
+	// save it
+	m_requestDocId = req->m_docId;
+	m_state        = req->m_state;
+	m_callback     = req->m_callback;
+	m_callback2    = req->m_callback2;
+	m_expected     = req->m_expected;
+
+	// does this ever happen?
+	if ( g_hostdb.getNumHosts() <= 0 ) {
+		log("build: hosts2.conf is not in working directory, or "
+		    "contains no valid hosts.");
+		g_errno = EBADENGINEER;
+		return true;
+	}
+
+	if ( req->m_docId < 0 && ! req->ptr_ubuf ) {
+		log("msg20: docid<0 and no url for msg20::getsummary");
+		g_errno = EBADREQUEST;
+		return true;
+	}
+
+	// get groupId from docId, if positive
+	uint32_t shardNum;
+	if ( req->m_docId >= 0 ) 
+		shardNum = g_hostdb.getShardNumFromDocId(req->m_docId);
+	else {
+		int64_t pdocId = g_titledb.getProbableDocId(req->ptr_ubuf);
+		shardNum = getShardNumFromDocId(pdocId);
+	}
+
+	// we might be getting inlinks for a spider request
+	// so make sure timeout is inifinite for that...
+	const int32_t timeout = (req->m_niceness==0)
+	                      ? multicast_msg20_summary_timeout
+	                      : multicast_infinite_send_timeout;
+
+	int64_t probDocId;
+	int32_t firstHostId = getFirstHostId ( req , shardNum , &probDocId );
+	if ( firstHostId < 0 ) {
+		m_gotReply = true;
+		return true;
+	}
 
 	m_requestSize = 0;
 	m_request = req->serialize ( &m_requestSize );
@@ -519,10 +535,30 @@ bool Msg20Reply::sendReply ( Msg20Request *req, XmlDoc *xd ) {
 		return true;
 	}
 
+	// now create a buffer to store title/summary/url/docLen and send back
+	int32_t  need;
+	char *buf = makeReply ( req , xd , &need );
+	if ( ! buf ) goto haderror;
+
+	// . del the list at this point, we've copied all the data into reply
+	// . this will free a non-null State20::m_ps (ParseState) for us
+	mdelete ( xd , sizeof(XmlDoc) , "xd20" );
+	delete ( xd );
+	
+	g_udpServer.sendReply_ass ( buf , need , buf , need , slot );
+
+	return true;
+}
+
+
+// . serialize us into a new buffer to send back for "req"
+// . returns NULL and sets g_errno on error
+char *Msg20Reply::makeReply ( Msg20Request *req, XmlDoc *xd, int32_t *size ) {
 	// now create a buffer to store title/summary/url/docLen and send back
 	int32_t  need = getStoredSize();
+	*size = need;
 	char *buf  = (char *)mmalloc ( need , "Msg20Reply" );
-	if ( ! buf ) goto haderror;
+	if ( ! buf ) return NULL;
 
 	// should never have an error!
 	int32_t used = serialize ( buf , need );
@@ -556,17 +592,9 @@ bool Msg20Reply::sendReply ( Msg20Request *req, XmlDoc *xd ) {
 	else
 		g_unstable_summary_cache.insert(req->makeCacheKey(), buf, need);
 
-	// . del the list at this point, we've copied all the data into reply
-	// . this will free a non-null State20::m_ps (ParseState) for us
-	mdelete ( xd , sizeof(XmlDoc) , "xd20" );
-	delete ( xd );
-	
-	g_udpServer.sendReply_ass ( buf , need , buf , need , slot );
-
-	return true;
+	return buf;
 }
 
-
 static bool sendCachedReply ( Msg20Request *req, const void *cached_summary, size_t cached_summary_len, UdpSlot *slot )
 {
 	//copy the cached summary to a new temporary buffer, so that UDPSlot/Server can free it when possible
@@ -747,3 +775,525 @@ int32_t Msg20Reply::deserialize ( ) {
 	// return how many bytes we used
 	return bytesParsed;
 }
+
+
+////////
+//
+// BATCHED SUMMARIES (msg 0x21)
+//
+// . the request is an int32_t count, padded to 8 bytes, followed by that
+//   many int32_t sizes each followed by a serialized Msg20Request
+// . the reply is an int32_t count, padded to 8 bytes, followed by that
+//   many int32_t errno and int32_t size pairs each followed by a
+//   serialized Msg20Reply, in the order of the requests
+// . if the query is traced the reply ends with an int32_t size, padded to
+//   8 bytes, followed by the QuerySpans of the host
+// . the requests and replies are padded to 8 bytes
+//
+////////
+
+static inline int32_t align8 ( int32_t size ) {
+	return ( size + 7 ) & ~7;
+}
+
+Msg20Batch::Msg20Batch ( ) {
+	m_shardNum   = 0;
+	m_numMsg20s  = 0;
+	m_niceness   = 0;
+	m_state      = NULL;
+	m_callback   = NULL;
+	m_sendUs     = 0;
+	m_replyUs    = 0;
+	m_spans.setLabel ( "m20bspan" );
+}
+
+bool Msg20Batch::addRequest ( Msg20 *m, Msg20Request *req ) {
+	// like Msg20::getSummary() sets it
+	m->reset();
+	m->m_launched     = true;
+	m->m_requestDocId = req->m_docId;
+	m->m_state        = req->m_state;
+	m->m_callback     = req->m_callback;
+	m->m_callback2    = req->m_callback2;
+	m->m_expected     = req->m_expected;
+
+	// . send() picks the host from the docid of the first request
+	// . on error it is like we got an error reply for "m"
+	if ( m_numMsg20s >= MAX_MSG20_BATCH || req->m_docId < 0 ) {
+		g_errno = EBADENGINEER;
+		m->gotBatchReply ( g_errno , NULL , 0 );
+		return false;
+	}
+
+	int32_t size = req->getStoredSize();
+	if ( ! m_request.reserve ( 16 + align8 ( size ) ) ) {
+		m->gotBatchReply ( g_errno , NULL , 0 );
+		return false;
+	}
+	if ( m_numMsg20s == 0 ) {
+		m_niceness = req->m_niceness;
+		m_request.pushLong ( 0 );
+		m_request.pushLong ( 0 );
+	}
+	m_request.pushLong ( size );
+	m_request.pushLong ( 0 );
+	int32_t used;
+	serializeMsg ( sizeof(*req),
+		       &req->size_qbuf, &req->size_displayMetas,
+		       &req->ptr_qbuf,
+		       req,
+		       &used,
+		       m_request.getBufPtr(), size,
+		       false );
+	if ( used != size ) { g_process.shutdownAbort(true); }
+	// zero the padding
+	memset ( m_request.getBufPtr() + size , 0 , align8(size) - size );
+	m_request.incrementLength ( align8 ( size ) );
+
+	m_msg20s[m_numMsg20s++] = m;
+	*(int32_t *)m_request.getBufStart() = m_numMsg20s;
+	return true;
+}
+
+static void gotReplyWrapper21 ( void *state , void */*state2*/ ) {
+	Msg20Batch *THIS = (Msg20Batch *)state;
+	THIS->gotReply ( );
+	THIS->m_callback ( THIS->m_state , THIS );
+}
+
+bool Msg20Batch::send ( void *state, void (*callback)(void *, Msg20Batch *)) {
+	m_state    = state;
+	m_callback = callback;
+
+	if ( m_numMsg20s == 0 ) {
+		g_errno = EBADENGINEER;
+		log(LOG_LOGIC,"query: msg20: sending an empty batch");
+		return true;
+	}
+
+	// all are on one shard, the first docid picks the host like it
+	// does for a single summary
+	Msg20Request *first = (Msg20Request *)(m_request.getBufStart() + 16);
+	int64_t probDocId;
+	int32_t firstHostId = getFirstHostId ( first , m_shardNum , &probDocId );
+	if ( firstHostId < 0 ) {
+		setErrno ( g_errno );
+		return true;
+	}
+
+	// . give it more time than a single summary since the host makes
+	//   them all
+	// . we might be getting inlinks for a spider request
+	//   so make sure timeout is inifinite for that...
+	const int32_t timeout = (m_niceness==0)
+	                      ? multicast_msg20_summary_timeout * 2
+	                      : multicast_infinite_send_timeout;
+
+	for ( int32_t i = 0 ; i < m_numMsg20s ; i++ )
+		m_msg20s[i]->m_inProgress = true;
+
+	m_sendUs = gettimeofdayInMicroseconds();
+	if ( ! m_mcast.send ( m_request.getBufStart(),
+			      m_request.length(),
+			      msg_type_21       ,
+			      false             , // m_mcast own m_request?
+			      m_shardNum        , // send to group (groupKey)
+			      false             , // send to whole group?
+			      probDocId         , // key is lower bits of docId
+			      this              , // state data
+			      NULL              , // state data
+			      gotReplyWrapper21 ,
+			      timeout           , // timeout
+			      m_niceness        ,
+			      firstHostId       , // first hostid
+			      NULL              , // reply buffer
+			      0                 , // reply buffer size
+			      false             , // free reply buf?
+			      false             , // do disk load balancing?
+			      -1                , // max cache age
+			      0                 , // cacheKey
+			      0                 , // bogus rdbId
+			      -1                , // minRecSizes(unknownRDsize)
+			      true              )) { // sendToSelf
+		log("msg20: error sending batch mcast %s",mstrerror(g_errno));
+		for ( int32_t i = 0 ; i < m_numMsg20s ; i++ )
+			m_msg20s[i]->m_inProgress = false;
+		setErrno ( g_errno );
+		return true;
+	}
+
+	// we blocked
+	return false;
+}
+
+void Msg20Batch::setErrno ( int32_t err ) {
+	for ( int32_t i = 0 ; i < m_numMsg20s ; i++ )
+		m_msg20s[i]->gotBatchReply ( err , NULL , 0 );
+}
+
+// . hand each Msg20 its part of the reply
+// . does not call their callbacks
+void Msg20Batch::gotReply ( ) {
+	m_replyUs = gettimeofdayInMicroseconds();
+	if ( g_errno ) {
+		log( LOG_WARN, "query: msg20: got batch reply for %" PRId32
+		     " docids from shard %" PRIu32": %s",
+		     m_numMsg20s, m_shardNum, mstrerror(g_errno));
+		setErrno ( g_errno );
+		return;
+	}
+
+	int32_t replySize;
+	int32_t replyMaxSize;
+	bool freeit;
+	char *reply = m_mcast.getBestReply ( &replySize, &replyMaxSize, &freeit );
+	setReply ( reply , replySize );
+	if ( reply && ! freeit ) mfree ( reply , replyMaxSize , "Msg20Batch" );
+}
+
+void Msg20Batch::setReply ( const char *reply , int32_t replySize ) {
+	const char *p    = reply;
+	const char *pend = reply + replySize;
+	int32_t i = 0;
+	if ( ! reply || replySize < 8 || *(int32_t *)p != m_numMsg20s ) {
+		log("query: Bad summary batch reply.");
+		goto corrupt;
+	}
+	p += 8;
+	for ( ; i < m_numMsg20s ; i++ ) {
+		if ( pend - p < 8 ) goto corrupt;
+		int32_t err  = ((int32_t *)p)[0];
+		int32_t size = ((int32_t *)p)[1];
+		p += 8;
+		if ( size < 0 || pend - p < size ) goto corrupt;
+		m_msg20s[i]->gotBatchReply ( err , p , size );
+		p += align8 ( size );
+	}
+
+	// the spans of a traced query
+	if ( pend - p >= 8 ) {
+		int32_t size = *(int32_t *)p;
+		p += 8;
+		if ( size > 0 && pend - p >= size )
+			m_spans.safeMemcpy ( p , size );
+	}
+	return;
+
+ corrupt:
+	for ( ; i < m_numMsg20s ; i++ )
+		m_msg20s[i]->gotBatchReply ( ECORRUPTDATA , NULL , 0 );
+}
+
+int32_t Msg20Batch::parseRequest ( char *buf , int32_t bufSize ,
+				   Msg20Request **reqs ) {
+	char *p    = buf;
+	char *pend = buf + bufSize;
+	int32_t n = 0;
+	if ( bufSize >= 8 ) n = *(int32_t *)p;
+	if ( n <= 0 || n > MAX_MSG20_BATCH ) return -1;
+	p += 8;
+	for ( int32_t i = 0 ; i < n ; i++ ) {
+		int32_t size = 0;
+		if ( pend - p >= 8 ) size = *(int32_t *)p;
+		p += 8;
+		reqs[i] = (Msg20Request *)p;
+		if ( size < (int32_t)sizeof(Msg20Request) || pend - p < size ||
+		     reqs[i]->deserialize() != size )
+			return -1;
+		p += align8 ( size );
+	}
+	return n;
+}
+
+char *Msg20Batch::makeReply ( int32_t n , const int32_t *errnos ,
+			      char * const *replies ,
+			      const int32_t *replySizes ,
+			      const char *spans , int32_t spansSize ,
+			      int32_t *size ) {
+	int32_t need = 8;
+	for ( int32_t i = 0 ; i < n ; i++ )
+		need += 8 + align8 ( replySizes[i] );
+	if ( spansSize ) need += 8 + spansSize;
+
+	char *buf = (char *)mmalloc ( need , "Msg20Reply" );
+	if ( ! buf ) return NULL;
+	memset ( buf , 0 , need );
+	char *p = buf;
+	*(int32_t *)p = n;
+	p += 8;
+	for ( int32_t i = 0 ; i < n ; i++ ) {
+		((int32_t *)p)[0] = errnos[i];
+		((int32_t *)p)[1] = replySizes[i];
+		p += 8;
+		if ( replySizes[i] )
+			memcpy ( p , replies[i] , replySizes[i] );
+		p += align8 ( replySizes[i] );
+	}
+	if ( spansSize ) {
+		*(int32_t *)p = spansSize;
+		p += 8;
+		memcpy ( p , spans , spansSize );
+	}
+	*size = need;
+	return buf;
+}
+
+void Msg20::gotBatchReply ( int32_t err, const char *reply, int32_t replySize ) {
+	// like gotReply() does it
+	m_gotReply   = true;
+	m_inProgress = false;
+	if ( m_r ) { g_process.shutdownAbort(true); }
+
+	if ( ! err && replySize < (int32_t)sizeof(Msg20Reply) ) {
+		log("query: Summary reply is too small.");
+		err = EREPLYTOOSMALL;
+	}
+
+	if ( err ) {
+		m_errno = err;
+		// not found is normal if not expected
+		if ( err != ENOTFOUND || m_expected )
+			log( LOG_WARN, "query: msg20: got reply for docid %" PRId64" : %s",
+			     m_requestDocId, mstrerror(err));
+		return;
+	}
+
+	// copy it so we own it like a single reply
+	char *buf = (char *)mmalloc ( replySize , "Msg20b" );
+	if ( ! buf ) {
+		m_errno = g_errno;
+		return;
+	}
+	memcpy ( buf , reply , replySize );
+	m_r            = (Msg20Reply *)buf;
+	m_replySize    = replySize;
+	m_replyMaxSize = replySize;
+	m_ownReply     = true;
+	m_r->deserialize();
+}
+
+// the state of a msg 0x21 request on the host making the summaries
+struct State21;
+
+struct Summary21 {
+	State21      *m_st;
+	Msg20Request *m_req;
+	XmlDoc       *m_xd;
+	char         *m_reply;
+	int32_t       m_replySize;
+	int32_t       m_errno;
+	uint64_t      m_startUs;
+};
+
+struct State21 {
+	UdpSlot  *m_slot;
+	int32_t   m_numSummaries;
+	// summaries still being made, plus one while we are launching them
+	int32_t   m_numPending;
+	int64_t   m_startTime;
+	// timing of the summaries if the query is traced
+	QueryTrace m_trace;
+	Summary21 m_summaries[MAX_MSG20_BATCH];
+};
+
+static void sendReply21 ( State21 *st ) {
+	UdpSlot *slot = st->m_slot;
+
+	int32_t errnos[MAX_MSG20_BATCH];
+	char   *replies[MAX_MSG20_BATCH];
+	int32_t replySizes[MAX_MSG20_BATCH];
+	for ( int32_t i = 0 ; i < st->m_numSummaries ; i++ ) {
+		errnos[i]     = st->m_summaries[i].m_errno;
+		replies[i]    = st->m_summaries[i].m_reply;
+		replySizes[i] = st->m_summaries[i].m_replySize;
+	}
+	st->m_trace.endRootSpan();
+	int32_t need = 0;
+	char *buf = Msg20Batch::makeReply ( st->m_numSummaries, errnos, replies,
+					    replySizes, st->m_trace.getSpans(),
+					    st->m_trace.getSpansSize(), &need );
+
+	for ( int32_t i = 0 ; i < st->m_numSummaries ; i++ ) {
+		Summary21 *s = &st->m_summaries[i];
+		if ( s->m_reply ) mfree ( s->m_reply , s->m_replySize , "Msg20Reply" );
+	}
+
+	int64_t took = gettimeofdayInMilliseconds() - st->m_startTime;
+	if ( took > 100 )
+		log(LOG_TIMING, "query: Took %" PRId64" ms to compute %" PRId32" summaries",
+		    took, st->m_numSummaries);
+
+	mdelete ( st , sizeof(State21) , "State21" );
+	delete ( st );
+
+	if ( ! buf ) {
+		log(LOG_ERROR,"%s:%s:%d: call sendErrorReply. error=%s", __FILE__, __func__, __LINE__, mstrerror( g_errno ));
+		g_udpServer.sendErrorReply ( slot , g_errno );
+		return;
+	}
+	g_udpServer.sendReply_ass ( buf , need , buf , need , slot );
+}
+
+// one less summary to wait for
+static void doneSummary21 ( Summary21 *s ) {
+	State21 *st = s->m_st;
+	st->m_trace.addSpan ( span_summary, 1, s->m_req->m_docId,
+			      s->m_startUs, gettimeofdayInMicroseconds() );
+	if ( --st->m_numPending > 0 ) return;
+	sendReply21 ( st );
+}
+
+// called when the XmlDoc of "s" made its msg20 reply, or failed to
+static bool gotSummary21 ( void *state ) {
+	Summary21 *s = (Summary21 *)state;
+	XmlDoc *xd = s->m_xd;
+
+	Msg20Reply *reply = NULL;
+	if ( ! g_errno ) {
+		// this should not block now
+		reply = xd->getMsg20Reply ( );
+		if ( reply == (void *)-1 ) { g_process.shutdownAbort(true); }
+		if ( ! reply && ! g_errno ) { g_process.shutdownAbort(true); }
+	}
+	if ( reply )
+		s->m_reply = reply->makeReply ( s->m_req , xd , &s->m_replySize );
+	if ( ! s->m_reply ) {
+		s->m_errno = g_errno ? g_errno : EBADENGINEER;
+		s->m_replySize = 0;
+		log(LOG_ERROR, "query: Had error generating msg20 reply for d=%" PRId64": %s",
+		    s->m_req->m_docId, mstrerror(s->m_errno));
+	}
+
+	mdelete ( xd , sizeof(XmlDoc) , "xd20" );
+	delete ( xd );
+	s->m_xd = NULL;
+	g_errno = 0;
+
+	doneSummary21 ( s );
+	return true;
+}
+
+// start making the summary of "s", like handleRequest20() does
+static void startSummary21 ( Summary21 *s ) {
+	Msg20Request *req = s->m_req;
+	s->m_startUs = gettimeofdayInMicroseconds();
+
+	int64_t cache_key = req->makeCacheKey();
+	const void *cached_summary;
+	size_t cached_summary_len;
+	if(g_stable_summary_cache.lookup(cache_key, &cached_summary, &cached_summary_len) ||
+	   g_unstable_summary_cache.lookup(cache_key, &cached_summary, &cached_summary_len))
+	{
+		log(LOG_DEBUG, "query: Summary cache hit");
+		s->m_reply = (char *)mmalloc ( cached_summary_len , "Msg20Reply" );
+		if ( ! s->m_reply ) s->m_errno = g_errno;
+		else {
+			memcpy ( s->m_reply , cached_summary , cached_summary_len );
+			s->m_replySize = cached_summary_len;
+		}
+		doneSummary21 ( s );
+		return;
+	}
+	log(LOG_DEBUG, "query: Summary cache miss");
+
+	if ( req->m_collnum < 0 ) {
+		s->m_errno = ENOTFOUND;
+		doneSummary21 ( s );
+		return;
+	}
+
+	// if it's not stored locally that's an error
+	if ( req->m_docId >= 0 && ! g_titledb.isLocal ( req->m_docId ) ) {
+		log(LOG_WARN, "query: Got msg20 request for non-local docId %" PRId64, req->m_docId);
+		s->m_errno = ENOTLOCAL;
+		doneSummary21 ( s );
+		return;
+	}
+
+	if ( req->m_docId == 0 && ! req->ptr_ubuf ) {
+		s->m_errno = ENOTFOUND;
+		doneSummary21 ( s );
+		return;
+	}
+
+	XmlDoc *xd;
+	try { xd = new (XmlDoc); }
+	catch ( ... ) { 
+		g_errno = ENOMEM;
+		log("query: msg20 new(%" PRId32"): %s", (int32_t)sizeof(XmlDoc),
+		    mstrerror(g_errno));
+		s->m_errno = ENOMEM;
+		doneSummary21 ( s );
+		return;
+	}
+	mnew ( xd , sizeof(XmlDoc) , "xd20" );
+
+	xd->set20 ( req );
+	xd->m_slot = s->m_st->m_slot;
+	xd->setCallback ( s , gotSummary21 );
+	xd->m_setTime = gettimeofdayInMilliseconds();
+	xd->m_cpuSummaryStartTime = 0;
+	s->m_xd = xd;
+
+	// . all the XmlDocs block on their title recs at the same time so
+	//   the summaries are made in parallel
+	// . gotSummary21() is called when it is done if this blocks
+	Msg20Reply *reply = xd->getMsg20Reply ( );
+	if ( reply == (void *)-1 ) return;
+	gotSummary21 ( s );
+}
+
+static void handleRequest21 ( UdpSlot *slot , int32_t netnice ) {
+	if ( g_errno ) {
+		log(LOG_WARN, "net: Msg20 batch handler got error: %s.",mstrerror(g_errno));
+		g_udpServer.sendErrorReply ( slot , g_errno );
+		return;
+	}
+
+	// . turn the string offsets into ptrs in the requests
+	// . this is "destructive" on the request
+	Msg20Request *reqs[MAX_MSG20_BATCH];
+	int32_t n = Msg20Batch::parseRequest ( slot->m_readBuf ,
+					       slot->m_readBufSize , reqs );
+	if ( n < 0 ) {
+		log(LOG_ERROR,"%s:%s:%d: call sendErrorReply. Bad request", __FILE__, __func__, __LINE__);
+		g_udpServer.sendErrorReply ( slot , EBADREQUEST );
+		return;
+	}
+
+	State21 *st;
+	try { st = new (State21); }
+	catch ( ... ) {
+		g_errno = ENOMEM;
+		log(LOG_ERROR,"%s:%s:%d: call sendErrorReply. error=%s", __FILE__, __func__, __LINE__, mstrerror( g_errno ));
+		g_udpServer.sendErrorReply ( slot , g_errno );
+		return;
+	}
+	mnew ( st , sizeof(State21) , "State21" );
+	st->m_slot         = slot;
+	st->m_numSummaries = n;
+	st->m_numPending   = n + 1;
+	st->m_startTime    = gettimeofdayInMilliseconds();
+
+	for ( int32_t i = 0 ; i < n ; i++ ) {
+		Summary21 *s = &st->m_summaries[i];
+		s->m_st        = st;
+		s->m_req       = reqs[i];
+		s->m_xd        = NULL;
+		s->m_reply     = NULL;
+		s->m_replySize = 0;
+		s->m_errno     = 0;
+	}
+
+	if ( st->m_summaries[0].m_req->m_traceId ) {
+		st->m_trace.start ( st->m_summaries[0].m_req->m_traceId, span_msg21, n );
+		st->m_trace.setMaxSpans ( QUERY_TRACE_MAX_REPLY_SPANS );
+	}
+
+	for ( int32_t i = 0 ; i < n ; i++ )
+		startSummary21 ( &st->m_summaries[i] );
+
+	// sends the reply if all were done without blocking
+	if ( --st->m_numPending > 0 ) return;
+	sendReply21 ( st );
+}
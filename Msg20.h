@@ -13,6 +13,7 @@
 #include "Titledb.h"
 #include "Query.h"
 #include "Tagdb.h" // TagRec
+#include "SafeBuf.h"
 
 #define MSG20_CURRENT_VERSION 0
 
@@ -54,6 +55,8 @@ class Msg20Request {
 	int32_t       m_summaryMaxNumCharsPerLine ;
 	int64_t       m_maxCacheAge               ;
 	int32_t       m_discoveryDate             ;
+	// the QueryTrace of Msg40, 0 if the query is not traced
+	int64_t       m_traceId                   ;
 
 	// special shit so we can remove an inlinker to a related docid
 	// if they also link to the main url we are processing seo for.
@@ -116,6 +119,11 @@ public:
 
 	bool  sendReply ( Msg20Request *req, class XmlDoc *xd ) ;
 
+	// . serialize us into a new buffer for the reply to "req" and add it
+	//   to the summary cache
+	// . returns NULL and sets g_errno on error
+	char *makeReply ( Msg20Request *req, class XmlDoc *xd, int32_t *size );
+
 	// after calling these, when serialize() is called again it will 
 	// exclude these strings which were "cleared". Used by Msg40 to 
 	// reduce the memory required for caching the Msg40 which includes an
@@ -301,6 +309,9 @@ public:
 
 	void gotReply ( class UdpSlot *slot );
 
+	// set our reply to a copy of our part of a Msg20Batch reply
+	void gotBatchReply ( int32_t err, const char *reply, int32_t replySize );
+
 	// general purpose routines
 	Msg20();
 	~Msg20();
@@ -326,4 +337,72 @@ public:
 	void      *m_state;
 };
 
+// most summaries in one Msg20Batch
+#define MAX_MSG20_BATCH 50
+
+// . gets the summaries of several docids on the same shard with one
+//   msg 0x21 request instead of a msg 0x20 request per docid
+// . the host that gets it generates the summaries in parallel and sends
+//   them all back in one reply
+// . Msg40 uses these so a page of results needs a UdpSlot per shard, not
+//   one per result
+class Msg20Batch {
+public:
+	Msg20Batch();
+
+	// . add the request for "m" as if we called m->getSummary(req)
+	// . all requests must be for docids on shard "m_shardNum"
+	// . returns false and sets g_errno on error
+	bool addRequest ( Msg20 *m, Msg20Request *req );
+
+	// . send the requests we added
+	// . returns false if blocked, true otherwise
+	// . sets the Msg20s' m_errno on error
+	// . "callback" is called when all of the Msg20s got their reply
+	bool send ( void *state, void (*callback)(void *state, Msg20Batch *b) );
+
+	uint32_t m_shardNum;
+	int32_t  m_numMsg20s;
+	Msg20   *m_msg20s[MAX_MSG20_BATCH];
+
+	void gotReply ( );
+
+	// . hand each Msg20 its part of the serialized reply "reply"
+	// . does not call their callbacks
+	void setReply ( const char *reply , int32_t replySize );
+
+	// . point "reqs" to the requests of the serialized batch "buf"
+	// . this is destructive on "buf", it converts offsets to ptrs
+	// . returns the number of requests or -1 if the batch is bad
+	static int32_t parseRequest ( char *buf , int32_t bufSize ,
+				      Msg20Request **reqs );
+
+	// . serialize the reply to a batch of "n" requests from the errno
+	//   and serialized Msg20Reply of each request, and the QuerySpans
+	//   of a traced query
+	// . returns NULL and sets g_errno on error
+	static char *makeReply ( int32_t n , const int32_t *errnos ,
+				 char * const *replies ,
+				 const int32_t *replySizes ,
+				 const char *spans , int32_t spansSize ,
+				 int32_t *size );
+
+	// the serialized requests
+	SafeBuf  m_request;
+	Multicast m_mcast;
+	int32_t  m_niceness;
+
+	// when we sent it and got the reply, and the QuerySpans of the
+	// host that made the summaries if the query is traced
+	uint64_t m_sendUs;
+	uint64_t m_replyUs;
+	SafeBuf  m_spans;
+
+	void    *m_state;
+	void   (*m_callback)(void *state, Msg20Batch *b);
+
+private:
+	void setErrno ( int32_t err );
+};
+
 #endif // GB_MSG20_H
@@ -4,6 +4,7 @@
 #include "Titledb.h"
 #include "UdpServer.h"
 #include "Process.h"
+#include "TitleRecDict.h"
 
 static void handleRequest22 ( UdpSlot *slot , int32_t netnice ) ;
 
@@ -156,6 +157,15 @@ bool Msg22::getTitleRec ( Msg22Request  *r              ,
 	// if niceness 0 can't pick noquery host.
 	// if niceness 1 can't pick nospider host.
 	firstHost = g_hostdb.getLeastLoadedInShard ( shardNum, r->m_niceness );
+	// . read it ourselves if we are in the shard, so a record compressed
+	//   with one of our titledb dictionaries does not have to be
+	//   recompressed without it
+	Host *myHost = g_hostdb.getMyHost();
+	if ( g_conf.m_titleRecDicts && myHost->m_shardNum == shardNum &&
+	     ! g_hostdb.isDead ( myHost ) &&
+	     ( r->m_niceness > 0 ? myHost->m_spiderEnabled : myHost->m_queryEnabled ) ) {
+		firstHost = myHost;
+	}
 	int32_t firstHostId = firstHost->m_hostId;
 
 	m_outstanding = true;
@@ -572,6 +582,27 @@ void gotTitleList ( void *state , RdbList *list , Msg5 *msg5 ) {
 			return;
 		}
 
+		// . the other hosts do not have our titledb dictionaries, so
+		//   recompress a record compressed with one without it
+		if ( getTitleRecDictId ( rec , recSize ) &&
+		     ( ! st->m_slot->m_host ||
+		       st->m_slot->m_host->m_hostId != g_hostdb.getMyHostId() ) ) {
+			RdbBase *tbase = getRdbBase ( RDB_TITLEDB , r->m_collnum );
+			SafeBuf sb;
+			if ( ! tbase ||
+			     ! recompressTitleRec ( rec , recSize , tbase->getTitleRecDicts() ,
+						    NULL , &sb , NULL ) )
+				goto hadError;
+			char   *reply     = sb.getBufStart();
+			int32_t replySize = sb.getLength();
+			int32_t allocSize = sb.getCapacity();
+			sb.detachBuf();
+			us->sendReply_ass ( reply , replySize , reply , allocSize , st->m_slot );
+			mdelete ( st , sizeof(State22) , "Msg22" );
+			delete ( st );
+			return;
+		}
+
 		// use rec as reply
 		char *reply = rec;
 
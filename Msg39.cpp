@@ -82,7 +82,11 @@ bool Msg39::registerHandler ( ) {
 
 
 Msg39::Msg39 ()
-  : m_lists(NULL)
+  : m_lists(NULL),
+    m_getListsStartUs(0),
+    m_intersectStartUs(0),
+    m_intersectEndUs(0),
+    m_clusterStartUs(0)
 {
 	m_inUse = false;
 	reset();
@@ -273,6 +277,14 @@ void Msg39::getDocIds2() {
 		logf(LOG_DEBUG,"query: msg39: [%" PTRFMT"] Got request "
 		     "for q=%s", (PTRTYPE) this,m_query.m_orig);
 
+	// time our part of a traced query
+	m_trace.reset();
+	if ( m_msg39req->m_traceId ) {
+		m_trace.start ( m_msg39req->m_traceId, span_msg39,
+				m_msg39req->m_numDocIdSplits );
+		m_trace.setMaxSpans ( QUERY_TRACE_MAX_REPLY_SPANS );
+	}
+
 	// reset this
 	m_toptree.reset();
 
@@ -391,6 +403,8 @@ bool Msg39::controlLoop ( ) {
 			// . use darker green if rat is false (default OR)
 			g_stats.addStat_r ( 0, m_posdbTable.m_t1, m_posdbTable.m_t2, 0x0000ff00 );
 		}
+		m_trace.addSpan ( span_intersect, 1, m_docIdSplitNumber - 1,
+				  m_intersectStartUs, m_intersectEndUs );
 		// accumulate total hits count over each docid split
 		m_numTotalHits += m_posdbTable.m_docIdVoteBuf.length() / 6;
 		// minus the shit we filtered out because of gbminint/gbmaxint/
@@ -416,12 +430,16 @@ bool Msg39::controlLoop ( ) {
 		// . this loads them using msg51 from clusterdb
 		// . if m_msg39req->m_doSiteClustering is false it just returns true
 		// . this sets m_gotClusterRecs to true if we get them
+		m_clusterStartUs = gettimeofdayInMicroseconds();
 		if ( ! setClusterRecs ( ) ) return false;
 		// error setting clusterrecs?
 		if ( g_errno ) goto hadError;
 	}
 
 	// process the cluster recs if we got them
+	if ( m_gotClusterRecs )
+		m_trace.addSpan ( span_msg51, 1, m_numClusterDocIds,
+				  m_clusterStartUs, gettimeofdayInMicroseconds() );
 	if ( m_gotClusterRecs && ! gotClusterRecs() )
 		goto hadError;
 
@@ -447,6 +465,7 @@ hadError:
 bool Msg39::getLists () {
 
 	if ( m_debug ) m_startTime = gettimeofdayInMilliseconds();
+	m_getListsStartUs = gettimeofdayInMicroseconds();
 	// . ask Indexdb for the IndexLists we need for these termIds
 	// . each rec in an IndexList is a termId/score/docId tuple
 
@@ -641,6 +660,7 @@ bool Msg39::getLists () {
 	}
 
 	// call msg2
+	if ( m_trace.isStarted() ) m_msg2.setTrace ( &m_trace );
 	if ( ! m_msg2.getLists ( RDB_POSDB,
 				 m_msg39req->m_collnum,
 				 m_msg39req->m_addToCache,
@@ -661,7 +681,10 @@ bool Msg39::getLists () {
 				 &controlLoopWrapper,
 				 m_msg39req->m_allowHighFrequencyTermCache,
 				 m_msg39req->m_niceness,
-				 m_debug                      )) {
+				 m_debug,
+				 // every result has the docid of each
+				 // required term unless boolean
+				 ! m_query.m_isBoolean        )) {
 		return false;
 	}
 
@@ -690,6 +713,8 @@ bool Msg39::intersectLists ( ) { // bool updateReadInfo ) {
 		     gettimeofdayInMilliseconds() - m_startTime);
 		m_startTime = gettimeofdayInMilliseconds();
 	}
+	m_trace.addSpan ( span_msg2, 1, m_docIdSplitNumber - 1,
+			  m_getListsStartUs, gettimeofdayInMicroseconds() );
 
 	// ensure collection not deleted from under us
 	CollectionRec *cr = g_collectiondb.getRec ( m_msg39req->m_collnum );
@@ -797,7 +822,9 @@ bool Msg39::intersectLists ( ) { // bool updateReadInfo ) {
 		gbshutdownLogicError();
 	}
 
+	m_intersectStartUs = gettimeofdayInMicroseconds();
 	m_posdbTable.intersectLists10_r ( );
+	m_intersectEndUs = gettimeofdayInMicroseconds();
 
 	// time it
 	diff = gettimeofdayInMilliseconds() - start;
@@ -822,7 +849,9 @@ void Msg39::intersectListsThreadFunction ( void *state ) {
 	// . this returns false and sets g_errno on error
 	// . Msg2 always compresses the lists so be aware that the termId
 	//   has been discarded
+	that->m_intersectStartUs = gettimeofdayInMicroseconds();
 	that->m_posdbTable.intersectLists10_r ( );
+	that->m_intersectEndUs = gettimeofdayInMicroseconds();
 
 	// . exit the thread
 	// . threadDoneWrapper will be called by g_loop when he gets the 
@@ -1034,6 +1063,10 @@ void Msg39::estimateHitsAndSendReply ( ) {
 			mr.size_clusterRecs = sizeof(key_t) *numDocIds;
 		else    
 			mr.size_clusterRecs = 0;
+		// how long we took, for the waterfall of the query
+		m_trace.endRootSpan();
+		mr.ptr_spans  = (char *)m_trace.getSpans();
+		mr.size_spans = m_trace.getSpansSize();
 
 		// . that is pretty much it,so serialize it into buffer,"reply"
 		// . mr.ptr_docIds, etc., will point into the buffer so we can
@@ -1043,7 +1076,7 @@ void Msg39::estimateHitsAndSendReply ( ) {
 		//   newly  serialized buffer.
 		reply = serializeMsg ( sizeof(Msg39Reply), // baseSize
 				       &mr.size_docIds, // firstSizeParm
-				       &mr.size_clusterRecs,//lastSizePrm
+				       &mr.size_spans,//lastSizePrm
 				       &mr.ptr_docIds , // firstStrPtr
 				       &mr , // thisPtr
 				       &replySize , 
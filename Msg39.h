@@ -12,6 +12,7 @@
 #include "TopTree.h"
 #include "Msg51.h"
 #include "JobScheduler.h"
+#include "QueryTrace.h"
 
 
 class UdpSlot;
@@ -69,6 +70,9 @@ class Msg39Request {
 
 	char       m_queryId[32];
 
+	// the QueryTrace of Msg40, 0 if the query is not traced
+	int64_t    m_traceId;
+
 	// do not add new string parms before ptr_readSizes or
 	// after ptr_whiteList so serializeMsg() calls still work
 	char   *ptr_readSizes;
@@ -107,22 +111,24 @@ public:
 	int32_t   m_errno;
 
 	// do not add new string parms before ptr_docIds or
-	// after ptr_clusterRecs so serializeMsg() calls still work
+	// after ptr_spans so serializeMsg() calls still work
 	char  *ptr_docIds         ; // the results, int64_t
 	char  *ptr_scores         ; // now doubles! so we can have intScores
 	char  *ptr_scoreInfo      ; // transparency info
 	char  *ptr_pairScoreBuf   ; // transparency info
 	char  *ptr_singleScoreBuf ; // transparency info
 	char  *ptr_clusterRecs    ; // key_t (might be empty)
+	char  *ptr_spans          ; // QuerySpans if traced (might be empty)
 	
 	// do not add new string parms before size_docIds or
-	// after size_clusterRecs so serializeMsg() calls still work
+	// after size_spans so serializeMsg() calls still work
 	int32_t   size_docIds;
 	int32_t   size_scores;
 	int32_t   size_scoreInfo;
 	int32_t   size_pairScoreBuf  ;
 	int32_t   size_singleScoreBuf;
 	int32_t   size_clusterRecs;
+	int32_t   size_spans;
 
 	// variable data comes here
 };
@@ -206,6 +212,13 @@ private:
 
 	int32_t m_phase;
 	int32_t m_docIdSplitNumber; //next split range to do
+
+	// timing of the request if m_msg39req->m_traceId is set
+	QueryTrace m_trace;
+	uint64_t    m_getListsStartUs;
+	uint64_t    m_intersectStartUs;
+	uint64_t    m_intersectEndUs;
+	uint64_t    m_clusterStartUs;
 	
 	void        estimateHitsAndSendReply   ();
 	bool        setClusterRecs ();
@@ -5,6 +5,8 @@
 #include "sort.h"
 
 #include "Stats.h"
+#include "Statistics.h"
+#include "QueryTrace.h"
 #include "HashTableT.h"
 #include "SearchInput.h"
 #include "Process.h"
@@ -32,6 +34,7 @@ void Msg3a::constructor ( ) {
 	for ( int32_t j = 0; j < MAX_SHARDS; j++ )
 		m_reply[j] = NULL;
 	m_rbufPtr = NULL;
+	m_trace   = NULL;
 	for ( int32_t j = 0; j < MAX_SHARDS; j++ )
 		m_mcast[j].constructor();
 }
@@ -222,6 +225,8 @@ bool Msg3a::getDocIds ( Msg39Request *r          ,
 
 	// time how long to get each shard's docids
 	m_startTime = gettimeofdayInMilliseconds();
+	m_fanOutStartUs = gettimeofdayInMicroseconds();
+	memset ( m_replyUs, 0, sizeof(m_replyUs) );
 
 	// reset replies received count
 	m_numReplies  = 0;
@@ -469,6 +474,8 @@ void gotReplyWrapper3a ( void *state , void *state2 ) {
 
 	// update time
 	int64_t endTime = gettimeofdayInMilliseconds();
+	uint64_t now = gettimeofdayInMicroseconds();
+	THIS->m_replyUs[m - THIS->m_mcast] = now;
 
 	
 	// timestamp log
@@ -524,6 +531,10 @@ void gotReplyWrapper3a ( void *state , void *state2 ) {
 	THIS->m_numReplies++;
 	// bail if still awaiting more replies
 	if ( THIS->m_numReplies < THIS->m_numQueriedHosts ) return;
+	Statistics::register_stage_time ( Statistics::stage_query_msg3a,
+					  now - THIS->m_fanOutStartUs );
+	if ( THIS->m_trace )
+		THIS->m_trace->addSpan ( span_msg3a, 1, 0, THIS->m_fanOutStartUs, now );
 	// return if gotAllShardReplies() blocked
 	if ( ! THIS->gotAllShardReplies( ) ) return;
 	// set g_errno i guess so parent knows
@@ -644,7 +655,7 @@ bool Msg3a::gotAllShardReplies ( ) {
 		//mr->deserialize ( );
 		if ( ! deserializeMsg ( sizeof(Msg39Reply) ,
 					&mr->size_docIds,
-					&mr->size_clusterRecs,
+					&mr->size_spans,
 					&mr->ptr_docIds,
 					((char*)mr) + sizeof(*mr) ) ) {
 			g_errno = ECORRUPTDATA;
@@ -663,6 +674,13 @@ bool Msg3a::gotAllShardReplies ( ) {
 		m_numTotalEstimatedHits += mr->m_estimatedHits;
 		pctSearchedSum += mr->m_pctSearched;
 
+		// the round trip to the shard and what its host did
+		if ( m_trace && m_replyUs[i] ) {
+			m_trace->addSpan ( span_shard, 2, i, m_fanOutStartUs, m_replyUs[i] );
+			m_trace->addReplySpans ( mr->ptr_spans, mr->size_spans,
+						 m_fanOutStartUs, m_replyUs[i], 3 );
+		}
+
 		// debug log stuff
 		if ( ! m_debug ) continue;
 		// cast these for printing out
@@ -1001,7 +1019,9 @@ int32_t Msg3a::getStoredSize ( ) {
 	// eventIds=1
 	int32_t need = m_numDocIds * ( 8 + sizeof(double) + 1 ) +
 		4 + // m_numDocIds
-		8 ; // m_numTotalEstimatedHits (estimated # of results)
+		8 + // m_numTotalEstimatedHits (estimated # of results)
+		4 + // m_skippedShards
+		sizeof(double) ; // m_pctSearched
 	return need;
 }
 
@@ -1011,7 +1031,10 @@ int32_t Msg3a::serialize   ( char *buf , char *bufEnd ) {
 	// store # of docids we have
 	*(int32_t *)p = m_numDocIds; p += 4;
 	// estimated # of total hits
-	*(int32_t *)p = m_numTotalEstimatedHits; p += 8;
+	*(int64_t *)p = m_numTotalEstimatedHits; p += 8;
+	// for the "results may be incomplete" note
+	*(int32_t *)p = m_skippedShards; p += 4;
+	*(double  *)p = m_pctSearched; p += sizeof(double);
 	// store each docid, 8 bytes each
 	gbmemcpy ( p , m_docIds , m_numDocIds * 8 ); p += m_numDocIds * 8;
 	// store scores
@@ -1031,7 +1054,11 @@ int32_t Msg3a::deserialize ( char *buf , char *bufEnd ) {
 	// get # of docids we have
 	m_numDocIds = *(int32_t *)p; p += 4;
 	// estimated # of total hits
-	m_numTotalEstimatedHits = *(int32_t *)p; p += 8;
+	m_numTotalEstimatedHits = *(int64_t *)p; p += 8;
+	m_skippedShards = *(int32_t *)p; p += 4;
+	m_pctSearched   = *(double  *)p; p += sizeof(double);
+	// not stored
+	m_scoreInfos    = NULL;
 	// get each docid, 8 bytes each
 	m_docIds = (int64_t *)p; p += m_numDocIds * 8;
 	// get scores
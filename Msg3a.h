@@ -103,6 +103,13 @@ public:
 
 	// for timing how long things take
 	int64_t  m_startTime;
+	// when we sent the requests to the shards, in microseconds
+	uint64_t m_fanOutStartUs;
+	// when we got the reply of each shard, 0 if none
+	uint64_t m_replyUs[MAX_SHARDS];
+
+	// the trace of the query to add the shard spans to, NULL if not traced
+	class QueryTrace *m_trace;
 
 	// this buffer should be big enough to hold all requests
 	//char       m_request [MAX_MSG39_REQUEST_SIZE * MAX_SHARDS];
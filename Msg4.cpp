@@ -7,11 +7,12 @@
 #include "Clusterdb.h"
 #include "Spider.h"
 #include "Rdb.h"
-#include "Profiler.h"
+#include "Parms.h"
 #include "Repair.h"
 #include "Multicast.h"
 #include "JobScheduler.h"
 #include "Process.h"
+#include "Statistics.h"
 
 #ifdef _VALGRIND_
 #include <valgrind/memcheck.h>
@@ -784,6 +785,9 @@ void gotReplyWrapper4 ( void *state , void *state2 ) {
 	UdpSlot *replyingSlot = mcast->m_slot;
 	if ( ! replyingSlot ) { g_process.shutdownAbort(true); }
 
+	Statistics::register_stage_time ( Statistics::stage_spider_msg4_add,
+		( gettimeofdayInMilliseconds() - mcast->m_startTime ) * 1000 );
+
 	returnMulticast ( mcast );
 
 	storeLineWaiters ( ); // try to launch more msg4 requests in waiting
@@ -2,6 +2,7 @@
 
 #include "Msg40.h"
 #include "Stats.h"        // for timing and graphing time to get all summaries
+#include "Statistics.h"
 #include "Collectiondb.h"
 #include "LanguageIdentifier.h"
 #include "sort.h"
@@ -14,6 +15,8 @@
 #include "HashTable.h"
 #include "AdultCheck.h"
 #include "Process.h"
+#include "SummaryCache.h"
+#include <map>
 
 
 // increasing this doesn't seem to improve performance any on a single
@@ -27,6 +30,23 @@ static bool gotSummaryWrapper            ( void *state );
 
 bool isSubDom(char *s , int32_t len);
 
+// . the serialized Msg40s of recent result pages keyed by
+//   SearchInput::makeKey() and the generations of the searched collections
+// . every page starts with the time it was cached
+static SummaryCache s_resultsCache;
+
+// the Msg40s getting the results for a key right now
+static std::map<int64_t,Msg40 *> s_resultsLeaders;
+
+// . bumped when a collection is reset or deleted or one of its parms
+//   changes, so its cached pages are not used any more. the old pages
+//   just expire
+// . numbers are never reused, so a new collection with the collnum of a
+//   deleted one does not get its pages
+static std::map<collnum_t,uint32_t> s_collGenerations;
+static uint32_t s_confGeneration = 0;
+static uint32_t s_lastGeneration = 0;
+
 Msg40::Msg40() {
 	m_socketHadError = 0;
 	m_buf           = NULL;
@@ -50,6 +70,11 @@ Msg40::Msg40() {
 	m_numCollsToSearch = 0;
 	m_numMsg20sIn = 0;
 	m_numMsg20sOut = 0;
+	m_resultsCacheKey = 0;
+	m_isResultsLeader = false;
+	m_resultsLeader   = NULL;
+	m_firstWaiter     = NULL;
+	m_nextWaiter      = NULL;
 }
 
 void Msg40::resetBuf2 ( ) {
@@ -70,6 +95,15 @@ void Msg40::resetBuf2 ( ) {
 }
 
 Msg40::~Msg40() {
+	// stop waiting for the leader
+	if ( m_resultsLeader ) {
+		Msg40 **pp = &m_resultsLeader->m_firstWaiter;
+		while ( *pp && *pp != this ) pp = &(*pp)->m_nextWaiter;
+		if ( *pp ) *pp = m_nextWaiter;
+		m_resultsLeader = NULL;
+	}
+	// the queries waiting for us have to get their own results now
+	releaseResultsWaiters();
 	// free tmp msg3as now
 	for ( int32_t i = 0 ; i < m_numCollsToSearch ; i++ ) {
 		if ( ! m_msg3aPtrs[i] ) continue;
@@ -115,6 +149,7 @@ bool Msg40::getResults ( SearchInput *si      ,
 	m_numMsg20s      = 0;
 	// reset our error keeper
 	m_errno = 0;
+	m_trace.reset();
 
 	// take search parms i guess from first collnum
 	collnum_t *cp = (collnum_t *)m_si->m_collnumBuf.getBufStart();
@@ -206,9 +241,25 @@ bool Msg40::getResults ( SearchInput *si      ,
 	if ( g_conf.m_logTimingQuery || m_si->m_debug || g_conf.m_logDebugQuery) 
 		m_startTime = gettimeofdayInMilliseconds();
 
+	// . serve the page from the results cache if we can
+	// . or wait for an identical query that is running right now
+	if ( checkResultsCache() ) return true;
+	if ( m_resultsLeader ) return false;
+
+	// . trace a sample of the queries we compute across the hosts
+	// . always trace the debug ones
+	int64_t traceId = QueryTrace::sampleTraceId ( m_si->m_debug );
+	if ( traceId ) m_trace.start ( traceId, span_query, 0 );
+
 	// keep going
 	bool status = prepareToGetDocIds ( );
 
+	// let the identical queries that came in meanwhile have our page
+	if ( status ) {
+		m_trace.finish ( m_si->m_q.getQuery() );
+		releaseResultsWaiters();
+	}
+
 	if ( status && m_si->m_streamResults ) {
 		log("msg40: setting streamresults to false. "
 		    "prepare did not block.");
@@ -321,6 +372,7 @@ bool Msg40::federatedLoop ( ) {
 	mr.m_maxSerpScore              = m_si->m_maxSerpScore;
 	mr.m_sameLangWeight            = m_si->m_sameLangWeight;
 	memcpy(mr.m_queryId, m_si->m_queryId, sizeof(m_si->m_queryId));
+	mr.m_traceId                   = m_trace.getTraceId();
 
 	if ( mr.m_timeout < m_si->m_minMsg3aTimeout )
 		mr.m_timeout = m_si->m_minMsg3aTimeout;
@@ -383,6 +435,7 @@ bool Msg40::federatedLoop ( ) {
 		gbmemcpy ( &mp->m_rrr , &mr , sizeof(Msg39Request) );
 		// then customize it to just search this collnum
 		mp->m_rrr.m_collnum = cp[i];
+		mp->m_trace = m_trace.isStarted() ? &m_trace : NULL;
 
 		// launch a search request
 		m_num3aRequests++;
@@ -418,7 +471,7 @@ void gotDocIdsWrapper ( void *state ) {
 	// return if this blocked
 	if ( ! THIS->gotDocIds() ) return;
 	// now call callback, we're done
-	THIS->m_callback ( THIS->m_state );
+	THIS->callCallback ( );
 }
 
 // . return false if blocked, true otherwise
@@ -763,8 +816,16 @@ bool Msg40::launchMsg20s ( bool recalled ) {
 		maxCacheAge = g_conf.m_docSummaryWithDescriptionMaxCacheAge;
 
 	int32_t maxOut = (int32_t)MAX_OUTSTANDING_MSG20S;
-	if ( g_udpServer.getNumUsedSlots() > 500 ) maxOut = 10;
-	if ( g_udpServer.getNumUsedSlots() > 800 ) maxOut = 1;
+	// . batched summary requests need a UdpSlot per shard, not one per
+	//   result, so only throttle single requests when slots are scarce
+	// . the batches are sent after the loop below
+	bool batch = g_conf.m_batchSummaryRequests;
+	Msg20Batch *batches[MAX_OUTSTANDING_MSG20S];
+	int32_t numBatches = 0;
+	if ( ! batch ) {
+		if ( g_udpServer.getNumUsedSlots() > 500 ) maxOut = 10;
+		if ( g_udpServer.getNumUsedSlots() > 800 ) maxOut = 1;
+	}
 
 	// if not deduping or site clustering, then
 	// just skip over docids for speed.
@@ -871,6 +932,8 @@ bool Msg40::launchMsg20s ( bool recalled ) {
 
 		if ( ! cr ) {
 			log("msg40: missing coll");
+			for ( int32_t j = 0 ; j < numBatches ; j++ )
+				sendBatch ( batches[j] );
 			g_errno = ENOCOLLREC;
 			if ( m_numReplies < m_numRequests ) return false;
 			return true;
@@ -908,6 +971,7 @@ bool Msg40::launchMsg20s ( bool recalled ) {
 		req.m_state              = this;
 		req.m_callback           = gotSummaryWrapper;
 		req.m_niceness           = m_si->m_niceness;
+		req.m_traceId            = m_trace.getTraceId();
 		req.m_showBanned         = m_si->m_showBanned;
 		req.m_includeCachedCopy  = m_si->m_includeCachedCopy;
 		req.m_expected           = true;
@@ -933,7 +997,12 @@ bool Msg40::launchMsg20s ( bool recalled ) {
 			req.m_getLinkInfo     = true;
 
 		// it copies this using a serialize() function
-		if ( ! m->getSummary ( &req ) ) continue;
+		if ( batch ) {
+			if ( addToBatch ( batches , &numBatches , shardNum ,
+					  m , &req ) )
+				continue;
+		}
+		else if ( ! m->getSummary ( &req ) ) continue;
 
 		// got reply
 		m_numReplies++;
@@ -948,6 +1017,9 @@ bool Msg40::launchMsg20s ( bool recalled ) {
 		// reset g_errno
 		g_errno   = 0;
 	}
+	// send the batched summary requests
+	for ( int32_t j = 0 ; j < numBatches ; j++ )
+		sendBatch ( batches[j] );
 	// return false if still waiting on replies
 	if ( m_numReplies < m_numRequests ) return false;
 	// do not re-call gotSummary() to avoid a possible recursive stack
@@ -975,6 +1047,74 @@ bool Msg40::launchMsg20s ( bool recalled ) {
 	return gotSummary ( );
 }
 
+// . add the summary request "req" of "m" to the batch of shard "shardNum"
+// . returns false and sets g_errno on error
+bool Msg40::addToBatch ( Msg20Batch **batches, int32_t *numBatches,
+			 uint32_t shardNum, Msg20 *m, Msg20Request *req ) {
+	Msg20Batch *b = NULL;
+	for ( int32_t j = 0 ; j < *numBatches ; j++ ) {
+		if ( batches[j]->m_shardNum != shardNum ) continue;
+		if ( batches[j]->m_numMsg20s >= MAX_MSG20_BATCH ) continue;
+		b = batches[j];
+		break;
+	}
+	if ( b ) return b->addRequest ( m , req );
+
+	try { b = new (Msg20Batch); }
+	catch ( ... ) {
+		g_errno = ENOMEM;
+		m->m_launched = true;
+		m->m_gotReply = true;
+		m->m_errno    = g_errno;
+		return false;
+	}
+	mnew ( b , sizeof(Msg20Batch) , "Msg20Batch" );
+	b->m_shardNum = shardNum;
+	// only keep a batch with a request in it, sendBatch() can not send
+	// an empty one
+	if ( ! b->addRequest ( m , req ) ) {
+		mdelete ( b , sizeof(Msg20Batch) , "Msg20Batch" );
+		delete ( b );
+		return false;
+	}
+	batches[(*numBatches)++] = b;
+	return true;
+}
+
+static void gotSummariesWrapper ( void *state , Msg20Batch *b ) {
+	Msg40 *THIS  = (Msg40 *)state;
+	THIS->m_numReplies += b->m_numMsg20s;
+	// the round trip to the shard and what its host did
+	THIS->m_trace.addSpan ( span_summaries, 1, b->m_shardNum,
+				b->m_sendUs, b->m_replyUs );
+	THIS->m_trace.addReplySpans ( b->m_spans.getBufStart(), b->m_spans.length(),
+				      b->m_sendUs, b->m_replyUs, 2 );
+	mdelete ( b , sizeof(Msg20Batch) , "Msg20Batch" );
+	delete ( b );
+
+	// it returns false if we're still awaiting replies
+	if ( !THIS->gotSummary() ) {
+		return;
+	}
+
+	// now call callback, we're done
+	THIS->callCallback ( );
+}
+
+// send the batch "b" of summary requests, it frees "b" when done
+void Msg40::sendBatch ( Msg20Batch *b ) {
+	if ( ! b->send ( this , gotSummariesWrapper ) ) return;
+	// did not block, so it had an error
+	m_numReplies += b->m_numMsg20s;
+	for ( int32_t i = 0 ; i < b->m_numMsg20s ; i++ ) {
+		if ( ! b->m_msg20s[i]->m_errno ) continue;
+		if ( ! m_errno ) m_errno = b->m_msg20s[i]->m_errno;
+	}
+	log("query: Had error getting summaries: %s.", mstrerror(m_errno));
+	mdelete ( b , sizeof(Msg20Batch) , "Msg20Batch" );
+	delete ( b );
+}
+
 Msg20 *Msg40::getAvailMsg20 ( ) {
 	for ( int32_t i = 0 ; i < m_numMsg20s ; i++ ) {
 		// m_inProgress is set to false right before it
@@ -1020,7 +1160,7 @@ bool gotSummaryWrapper ( void *state ) {
 	}
 
 	// now call callback, we're done
-	THIS->m_callback ( THIS->m_state );
+	THIS->callCallback ( );
 
 	return true;
 }
@@ -1054,7 +1194,7 @@ void doneSendingWrapper9 ( void *state , TcpSocket *sock ) {
 	if ( ! THIS->gotSummary() ) return;
 
 	// all done!!!???
-	THIS->m_callback ( THIS->m_state );
+	THIS->callCallback ( );
 }
 
 // . returns false if not all replies have been received (or timed/erroredout)
@@ -1684,6 +1824,8 @@ bool Msg40::gotSummary ( ) {
 	// . can we subtract that?
 	//"get_all_summaries"
 	g_stats.addStat_r ( 0, m_startTime, now, 0x008220ff );
+	Statistics::register_stage_time ( Statistics::stage_query_msg20,
+					  ( now - m_startTime ) * 1000 );
 
 	// timestamp log
 	if ( g_conf.m_logTimingQuery || m_si->m_debug )
@@ -1768,66 +1910,213 @@ bool Msg40::gotSummary ( ) {
 	// END HACK
 	// 
 
-	// . uc = use cache?
-	// . store in cache now if we need to
-	bool uc = false;
-	if ( m_si->m_useCache   ) uc = true;
-	if ( m_si->m_wcache     ) uc = true;
+	// store in the results cache now if we need to
+	if ( m_resultsCacheKey ) addToResultsCache ( );
+	return true;
+}
+
+// . is it ok to serve our results from the results cache, or to
+//   wait for an identical query for them, and to cache them?
+// . the scoring info and the streamed results are not cached
+bool Msg40::isResultsCacheable ( ) {
+	if ( g_conf.m_searchResultsMaxCacheAge <= 0 ) return false;
+	if ( g_conf.m_searchResultsMaxCacheMem <= 0 ) return false;
+	if ( ! m_si->m_rcache              ) return false;
+	if ( ! m_si->m_wcache              ) return false;
+	if ( m_si->m_streamResults         ) return false;
+	if ( m_si->m_docIdsOnly            ) return false;
+	if ( m_si->m_getDocIdScoringInfo   ) return false;
+	if ( m_si->m_debug                 ) return false;
+	return true;
+}
+
+// . returns true if we got our results from the results cache
+// . otherwise sets m_resultsLeader if we are waiting for an identical
+//   query, or makes us the leader for the queries that come after us
+bool Msg40::checkResultsCache ( ) {
+	m_resultsCacheKey = 0;
+	if ( ! isResultsCacheable() ) return false;
+
+	// mix in the generations of the collections we search
+	uint64_t h = m_si->makeKey();
+	h = hash64 ( h , s_confGeneration );
+	collnum_t *cp = (collnum_t *)m_si->m_collnumBuf.getBufStart();
+	int32_t ncp = m_si->m_collnumBuf.length() / sizeof(collnum_t);
+	for ( int32_t i = 0 ; i < ncp ; i++ ) {
+		std::map<collnum_t,uint32_t>::iterator it =
+			s_collGenerations.find ( cp[i] );
+		if ( it != s_collGenerations.end() ) h = hash64 ( h , it->second );
+	}
+	// 0 means not cacheable
+	if ( h == 0 ) h = 1;
+	m_resultsCacheKey = (int64_t)h;
+
+	if ( getFromResultsCache() ) {
+		g_stats.m_resultsCacheHits++;
+		if ( m_si->m_debug || g_conf.m_logDebugQuery )
+			logf(LOG_DEBUG,"query: msg40: [%" PTRFMT"] got %" PRId32" "
+			     "results from cache",(PTRTYPE)this,
+			     m_msg3a.m_numDocIds);
+		return true;
+	}
+
+	std::map<int64_t,Msg40 *>::iterator it =
+		s_resultsLeaders.find ( m_resultsCacheKey );
+	if ( it != s_resultsLeaders.end() ) {
+		// get in line
+		Msg40 *leader   = it->second;
+		m_resultsLeader = leader;
+		m_nextWaiter    = leader->m_firstWaiter;
+		leader->m_firstWaiter = this;
+		g_stats.m_resultsCoalesced++;
+		return false;
+	}
+
+	g_stats.m_resultsCacheMisses++;
+	s_resultsLeaders[m_resultsCacheKey] = this;
+	m_isResultsLeader = true;
+	return false;
+}
+
+// the max age parm is in seconds, the cache wants milliseconds
+static void configureResultsCache ( ) {
+	s_resultsCache.configure ( g_conf.m_searchResultsMaxCacheAge * 1000LL ,
+				   g_conf.m_searchResultsMaxCacheMem );
+}
+
+// . returns false if our page is not in the results cache
+// . otherwise deserializes it into us
+bool Msg40::getFromResultsCache ( ) {
+	configureResultsCache ( );
+	const void *data;
+	size_t      dataSize;
+	if ( ! s_resultsCache.lookup ( m_resultsCacheKey , &data , &dataSize ) )
+		return false;
+	if ( dataSize <= sizeof(int64_t) ) return false;
+	// deserialize() converts offsets to ptrs, so it needs its own copy
+	int32_t bufSize = dataSize - sizeof(int64_t);
+	char *buf = (char *)mmalloc ( bufSize , "Msg40" );
+	if ( ! buf ) {
+		// just get the results again
+		g_errno = 0;
+		return false;
+	}
+	memcpy ( buf , (char *)data + sizeof(int64_t) , bufSize );
+	// this makes buf our m_buf
+	if ( deserialize ( buf , bufSize ) != bufSize ) {
+		log(LOG_WARN,"query: msg40: could not deserialize cached "
+		    "results: %s",mstrerror(g_errno));
+		g_errno = 0;
+		resetBuf2();
+		m_numToFree = 0;
+		m_numMsg20s = 0;
+		m_msg20     = NULL;
+		m_msg3a.m_numDocIds = 0;
+		mfree ( m_buf , m_bufMaxSize , "Msg40" );
+		m_buf = NULL;
+		return false;
+	}
+	m_cachedTime = (time_t)*(int64_t *)data;
+	return true;
+}
+
+void Msg40::addToResultsCache ( ) {
 	// . do not store if there was an error
-	// . no, allow errors in cache since we often have lots of 
-	//   docid not founds and what not, due to index corruption and
-	//   being out of sync with titledb
-	if ( m_errno            &&
-	     // forgive "Record not found" errors, they are quite common
-	     m_errno != ENOTFOUND ) {
+	// . forgive "Record not found" errors, they are quite common
+	if ( m_errno && m_errno != ENOTFOUND ) {
 		logf(LOG_DEBUG,"query: not storing in cache: %s",
 		     mstrerror(m_errno));
-		uc = false;
+		return;
 	}
-	if ( m_si->m_docIdsOnly ) uc = false;
-
-	// all done if not storing in cache
-	if ( ! uc ) return true;
+	// a result without a summary is not stored, so can not be restored
+	for ( int32_t i = 0 ; i < m_msg3a.m_numDocIds ; i++ )
+		if ( m_msg3a.m_clusterLevels[i] == CR_OK &&
+		     ( ! m_msg20[i] || ! m_msg20[i]->m_r ) )
+			return;
 
 	// debug
 	if ( m_si->m_debug )
 		logf(LOG_DEBUG,"query: [%" PTRFMT"] Storing output in cache.",
 		     (PTRTYPE)this);
-	// store in this buffer
-	char tmpBuf [ 64 * 1024 ];
-	// use that
-	char *p = tmpBuf;
 	// how much room?
-	int32_t tmpSize = getStoredSize();
-	// unless too small
-	if ( tmpSize > 64*1024 ) 
-		p = (char *)mmalloc(tmpSize,"Msg40Cache");
+	int32_t tmpSize = sizeof(int64_t) + getStoredSize();
+	char *p = (char *)mmalloc ( tmpSize , "Msg40Cache" );
 	if ( ! p ) {
-		// this is just for cachinig, not critical... ignore errors
+		// this is just for caching, not critical... ignore errors
 		g_errno = 0;
-		logf ( LOG_INFO ,
-		       "query: Size of cached search results page (and "
-		       "all associated data) is %" PRId32" bytes. Max is %i. "
-		       "Page not cached.", tmpSize, 32*1024 );
-		return true;
+		return;
 	}
+	// the time it was cached, for the "results were cached" note
+	*(int64_t *)p = getTime();
 	// serialize into tmp
-	int32_t nb = serialize ( p , tmpSize );
+	int32_t nb = serialize ( p + sizeof(int64_t) , tmpSize - sizeof(int64_t) );
 	// it must fit exactly
-	if ( nb != tmpSize || nb == 0 ) {
-		g_errno = EBADENGINEER;
+	if ( nb != tmpSize - (int32_t)sizeof(int64_t) ) {
 		log (LOG_LOGIC,
 		     "query: Size of cached search results page (%" PRId32") "
 		     "does not match what it should be. (%" PRId32")",
-		     nb, tmpSize );
-		return true;
+		     nb, tmpSize - (int32_t)sizeof(int64_t) );
+		mfree ( p , tmpSize , "Msg40Cache" );
+		g_errno = 0;
+		return;
 	}
-
-	// free it, cache will copy it into its ring buffer
-	if ( p != tmpBuf ) mfree ( p , tmpSize , "Msg40Cache" );
+	configureResultsCache ( );
+	// the cache makes its own copy
+	s_resultsCache.insert ( m_resultsCacheKey , p , tmpSize );
+	mfree ( p , tmpSize , "Msg40Cache" );
 	// ignore errors
 	g_errno = 0;
- 	return true;
+}
+
+void Msg40::callCallback ( ) {
+	// keep the trace if the query was slow
+	m_trace.finish ( m_si->m_q.getQuery() );
+	// we might be deleted by the callback
+	releaseResultsWaiters();
+	m_callback ( m_state );
+}
+
+// let the Msg40s waiting for us have our page, if we cached it
+void Msg40::releaseResultsWaiters ( ) {
+	if ( ! m_isResultsLeader ) return;
+	m_isResultsLeader = false;
+	std::map<int64_t,Msg40 *>::iterator it =
+		s_resultsLeaders.find ( m_resultsCacheKey );
+	if ( it != s_resultsLeaders.end() && it->second == this )
+		s_resultsLeaders.erase ( it );
+	// our own caller still wants to see our g_errno
+	int32_t saved = g_errno;
+	Msg40 *w = m_firstWaiter;
+	m_firstWaiter = NULL;
+	while ( w ) {
+		// the callback might delete it
+		Msg40 *next = w->m_nextWaiter;
+		w->m_nextWaiter    = NULL;
+		w->m_resultsLeader = NULL;
+		w->gotLeaderResults();
+		w = next;
+	}
+	g_errno = saved;
+}
+
+void Msg40::gotLeaderResults ( ) {
+	g_errno = 0;
+	// the leader's page was not "cached" for the user
+	if ( getFromResultsCache() ) {
+		m_cachedTime = 0;
+		m_callback ( m_state );
+		return;
+	}
+	// . the leader had an error or did not store its page
+	// . get our own results then, but do not lead anyone
+	m_resultsCacheKey = 0;
+	if ( ! prepareToGetDocIds ( ) ) return;
+	m_callback ( m_state );
+}
+
+void Msg40::invalidateResultsCache ( collnum_t collnum ) {
+	if ( collnum < 0 ) s_confGeneration = ++s_lastGeneration;
+	else s_collGenerations[collnum] = ++s_lastGeneration;
 }
 
 int32_t Msg40::getStoredSize ( ) {
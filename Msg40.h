@@ -14,7 +14,9 @@
 #include "Msg39.h"      // getTermFreqs()
 #include "Msg20.h"      // for getting summary from docId
 #include "Msg3a.h"
+#include "QueryTrace.h"
 #include "HashTableT.h"
+#include "FlatHashTable.h"
 
 // make it 2B now. no reason not too limit it so low.
 #define MAXDOCIDSTOCOMPUTE 2000000000
@@ -50,16 +52,28 @@ public:
 	bool federatedLoop ( ) ;
 	bool gotDocIds        ( ) ;
 	bool launchMsg20s     ( bool recalled ) ;
+	bool addToBatch ( class Msg20Batch **batches, int32_t *numBatches,
+			  uint32_t shardNum, class Msg20 *m,
+			  class Msg20Request *req );
+	void sendBatch ( class Msg20Batch *b );
 	class Msg20 *getAvailMsg20();
 	class Msg20 *getCompletedSummary ( int32_t ix );
 	bool gotSummary       ( ) ;
 	bool reallocMsg20Buf ( ) ;
 
-	// serialization routines used for caching Msg40s by Msg17
+	// serialization routines used for caching Msg40s in the results cache
 	int32_t  getStoredSize ( ) ;
 	int32_t  serialize     ( char *buf , int32_t bufLen ) ;
 	int32_t  deserialize   ( char *buf , int32_t bufLen ) ;
 
+	// . forget the cached result pages of this collection, -1 for all
+	// . called when a collection is reset or deleted or a parm changes
+	static void invalidateResultsCache ( collnum_t collnum );
+
+	// . wake up the identical queries waiting for our results, then
+	//   call our caller back
+	void callCallback ( ) ;
+
 	// . estimated # of total hits
 	// . this is now an EXACT count... since we read all posdb termlists
 	int64_t getNumTotalHits () { return m_msg3a.getNumTotalEstimatedHits(); }
@@ -94,7 +108,7 @@ public:
 
 	int32_t m_omitCount;
 
-	HashTableX m_dedupTable;
+	FlatHashTable<4> m_dedupTable;
 
 	int32_t m_msg3aRecallCnt;
 
@@ -126,6 +140,9 @@ public:
 	// use msg3a to get docIds
 	Msg3a      m_msg3a;
 
+	// the hosts' timing of a sampled query, for the perf page
+	QueryTrace m_trace;
+
 	// count summary replies (msg20 replies) we get
 	int32_t       m_numRequests;
 	int32_t       m_numReplies;
@@ -171,6 +188,23 @@ public:
 	collnum_t m_firstCollnum;
 
 	HashTableT<uint64_t, uint64_t> m_urlTable;
+
+	bool isResultsCacheable ( ) ;
+	bool checkResultsCache ( ) ;
+	bool getFromResultsCache ( ) ;
+	void addToResultsCache ( ) ;
+	void releaseResultsWaiters ( ) ;
+	void gotLeaderResults ( ) ;
+
+	// our key in the results cache, 0 if our results are not cacheable
+	int64_t m_resultsCacheKey;
+	// are we getting the results for this key for other Msg40s too?
+	bool    m_isResultsLeader;
+	// the Msg40 we are waiting for, if any
+	Msg40  *m_resultsLeader;
+	// the list of Msg40s waiting for the leader
+	Msg40  *m_firstWaiter;
+	Msg40  *m_nextWaiter;
 };
 
 #endif // GB_MSG40_H
@@ -9,6 +9,8 @@
 #include "PingServer.h"
 #include "Process.h"
 #include "Sanity.h"
+#include "Posdb.h"
+#include "Conf.h"
 
 
 //#define GBSANITYCHECK
@@ -20,6 +22,7 @@ Msg5::Msg5() {
 	m_waitingForList = false;
 	//m_waitingForMerge = false;
 	m_numListPtrs = 0;
+	m_numMergeRanges = 0;
 	reset();
 }
 
@@ -943,6 +946,11 @@ bool Msg5::gotList2 ( ) {
 	// . it seems to core dump if we spawn a thread with totalSizes too low
 	// . why???
 	if ( m_totalSize >= 32*1024 ) {
+		// a huge posdb merge is split up and merged by several threads
+		if ( splitMerge() ) {
+			return false;
+		}
+
 		// . if size is big, make a thread
 		// . let's always make niceness 0 since it wasn't being very
 		//   aggressive before
@@ -1027,6 +1035,138 @@ void Msg5::mergeDone(job_exit_t /*exit_type*/) {
 	m_callback ( m_state, m_list, this );
 }
 
+// . split the posdb merge into docid ranges and merge them in parallel if
+//   it is big and the ranges can be merged completely, without minRecSizes
+//   cutting the merge short
+// . returns true if it blocked
+bool Msg5::splitMerge() {
+	int32_t numRanges = g_conf.m_posdbMergeThreads;
+	if ( numRanges > MAX_MERGE_RANGES ) numRanges = MAX_MERGE_RANGES;
+	if ( numRanges <= 1 ) return false;
+	if ( m_rdbId != RDB_POSDB ) return false;
+	if ( m_totalSize < MIN_SPLIT_MERGE_SIZE ) return false;
+	if ( m_numListPtrs < 2 ) return false;
+	if ( m_list->m_mergeMinListSize < m_list->m_listSize + m_totalSize ) return false;
+
+	// only split up the docids of one termlist
+	int64_t termId = Posdb::getTermId ( m_startKey );
+	if ( Posdb::getTermId ( m_minEndKey ) != termId ) return false;
+	int64_t startDocId = Posdb::getDocId ( m_startKey );
+	int64_t endDocId   = Posdb::getDocId ( m_minEndKey );
+	if ( endDocId - startDocId < numRanges ) return false;
+
+	// docids are hashes so equal docid ranges have about as many keys
+	for ( int32_t i = 0 ; i < numRanges ; i++ ) {
+		MergeRange *r = &m_mergeRanges[i];
+		r->m_msg5 = this;
+		r->m_ok = true;
+		r->m_hasStartKey = ( i > 0 );
+		r->m_hasStopKey = ( i < numRanges - 1 );
+		if ( r->m_hasStopKey ) {
+			int64_t docId = startDocId +
+				( endDocId - startDocId ) * ( i + 1 ) / numRanges;
+			Posdb::makeStartKey ( r->m_stopKey , termId , docId );
+		}
+		if ( r->m_hasStartKey )
+			KEYSET ( r->m_startKey , m_mergeRanges[i-1].m_stopKey , m_ks );
+	}
+	m_numMergeRanges = numRanges;
+	m_numMergeRangesDone = 0;
+
+	// repair the lists first, then merge the ranges
+	if ( ! g_jobScheduler.submit(repairListsWrapper, repairDoneWrapper, this, thread_type_query_merge, m_niceness) ) {
+		g_errno = 0;
+		return false;
+	}
+	return true;
+}
+
+void Msg5::repairListsWrapper(void *state) {
+	Msg5 *that = static_cast<Msg5*>(state);
+	that->repairLists();
+}
+
+void Msg5::repairDoneWrapper(void *state, job_exit_t exit_type) {
+	Msg5 *that = static_cast<Msg5*>(state);
+	// if the job did not run just do the merge here
+	if ( exit_type != job_exit_normal ) {
+		that->repairLists();
+		that->mergeLists();
+		that->mergeDone(exit_type);
+		return;
+	}
+	// the merge is skipped if a list was corrupt, see mergeLists()
+	if ( that->m_hadCorruption ) {
+		that->mergeDone(exit_type);
+		return;
+	}
+	that->launchMergeRanges();
+}
+
+void Msg5::launchMergeRanges() {
+	int32_t numLaunched = 0;
+	for ( int32_t i = 0 ; i < m_numMergeRanges ; i++ ) {
+		MergeRange *r = &m_mergeRanges[i];
+		if ( g_jobScheduler.submit(mergeRangeWrapper, mergeRangeDoneWrapper, r, thread_type_query_merge, m_niceness) ) {
+			numLaunched++;
+			continue;
+		}
+		g_errno = 0;
+		// do it without a thread then
+		mergeRange ( r );
+		m_numMergeRangesDone++;
+	}
+	// the callbacks finish up if any were launched
+	if ( numLaunched == 0 ) mergeRangesDone();
+}
+
+void Msg5::mergeRange ( MergeRange *r ) {
+	r->m_ok = r->m_list.posdbMergeRange_r ( m_listPtrs ,
+						m_numListPtrs ,
+						r->m_hasStartKey ? r->m_startKey : NULL ,
+						r->m_hasStopKey  ? r->m_stopKey  : NULL ,
+						m_removeNegRecs );
+}
+
+void Msg5::mergeRangeWrapper(void *state) {
+	MergeRange *r = static_cast<MergeRange*>(state);
+	r->m_msg5->mergeRange ( r );
+}
+
+void Msg5::mergeRangeDoneWrapper(void *state, job_exit_t exit_type) {
+	MergeRange *r = static_cast<MergeRange*>(state);
+	Msg5 *that = r->m_msg5;
+	if ( exit_type != job_exit_normal ) that->mergeRange ( r );
+	if ( ++that->m_numMergeRangesDone < that->m_numMergeRanges ) return;
+	that->mergeRangesDone();
+}
+
+void Msg5::mergeRangesDone() {
+	bool ok = true;
+	RdbList *ranges[MAX_MERGE_RANGES];
+	for ( int32_t i = 0 ; i < m_numMergeRanges ; i++ ) {
+		ranges[i] = &m_mergeRanges[i].m_list;
+		if ( ! m_mergeRanges[i].m_ok ) ok = false;
+	}
+
+	if ( ok ) {
+		m_list->posdbAddMergedRanges ( ranges, m_numMergeRanges, m_startKey, m_minEndKey );
+		gotMergedList();
+	}
+	else {
+		// out of memory for a range, merge it all at once here
+		log( LOG_WARN, "db: Msg5: Failed to merge posdb list in ranges. Doing blocking merge." );
+		mergeLists();
+	}
+
+	for ( int32_t i = 0 ; i < m_numMergeRanges ; i++ ) {
+		m_mergeRanges[i].m_list.freeList();
+	}
+	m_numMergeRanges = 0;
+
+	mergeDone(job_exit_normal);
+}
+
 // check lists in the thread
 void Msg5::repairLists() {
 	// assume none
@@ -1142,6 +1282,11 @@ void Msg5::mergeLists() {
 	//   to do the merge to do the annihilation
 	//else
 	m_list->merge_r ( m_listPtrs, m_numListPtrs, m_startKey, m_minEndKey, m_minRecSizes, m_removeNegRecs, m_rdbId, niceness );
+
+	gotMergedList();
+}
+
+void Msg5::gotMergedList() {
 	m_list->resetListPtr(); //merge_r() doesn't rewind the list iterator/pointer (?)
 	
 	// maintain this info for truncation purposes
@@ -11,6 +11,11 @@
 #include "JobScheduler.h" //job_exit_t
 
 
+// . a posdb merge of more than this many bytes is split into docid ranges
+//   merged by g_conf.m_posdbMergeThreads threads
+#define MIN_SPLIT_MERGE_SIZE (1024*1024)
+#define MAX_MERGE_RANGES     8
+
 extern int32_t g_numCorrupt;
 
 extern int32_t g_isDumpingRdbFromMain;
@@ -223,6 +228,31 @@ private:
 
 	void repairLists();
 	void mergeLists();
+	void gotMergedList();
+
+	// one docid range of a posdb merge split up by splitMerge()
+	struct MergeRange {
+		Msg5    *m_msg5;
+		RdbList  m_list;
+		char     m_startKey[MAX_KEY_BYTES];
+		char     m_stopKey[MAX_KEY_BYTES];
+		bool     m_hasStartKey;
+		bool     m_hasStopKey;
+		bool     m_ok;
+	};
+
+	MergeRange m_mergeRanges[MAX_MERGE_RANGES];
+	int32_t    m_numMergeRanges;
+	int32_t    m_numMergeRangesDone;
+
+	bool splitMerge();
+	static void repairListsWrapper(void *state);
+	static void repairDoneWrapper(void *state, job_exit_t exit_type);
+	void launchMergeRanges();
+	void mergeRange(MergeRange *r);
+	static void mergeRangeWrapper(void *state);
+	static void mergeRangeDoneWrapper(void *state, job_exit_t exit_type);
+	void mergeRangesDone();
 };
 
 #endif // GB_MSG5_H
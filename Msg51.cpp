@@ -7,6 +7,7 @@
 
 #include "Clusterdb.h"
 #include "Stats.h"
+#include "Statistics.h"
 #include "HashTableT.h"
 #include "HashTableX.h"
 #include "RdbCache.h"
@@ -136,13 +137,17 @@ bool Msg51::getClusterRecs ( int64_t     *docIds                   ,
 	// reset these
 	m_numRequests = 0;
 	m_numReplies  = 0;
+	m_startUs     = gettimeofdayInMicroseconds();
 	// clear these
 	for ( int32_t i = 0 ; i < MSG51_MAX_REQUESTS ; i++ )
 		m_msg0[i].m_inUse = false;
 	// . do gathering
 	// . returns false if blocked, true otherwise
 	// . send up to MSG51_MAX_REQUESTS requests at the same time
-	return sendRequests ( -1 );
+	if ( ! sendRequests ( -1 ) ) return false;
+	Statistics::register_stage_time ( Statistics::stage_query_msg51,
+					  gettimeofdayInMicroseconds() - m_startUs );
+	return true;
 }
 
 // . returns false if blocked, true otherwise
@@ -348,6 +353,8 @@ void gotClusterRecWrapper51 ( void *state ) {//, RdbList *rdblist ) {
 	// . if not all done, launch the next one
 	// . this returns false if blocks, true otherwise
 	if ( ! THIS->sendRequests ( k ) ) return;
+	Statistics::register_stage_time ( Statistics::stage_query_msg51,
+					  gettimeofdayInMicroseconds() - THIS->m_startUs );
 	// we don't need to go on if we're not doing deduping
 	THIS->m_callback ( THIS->m_state );
 	return;
@@ -149,6 +149,9 @@ class Msg51 {
 	void     (*m_callback ) ( void *state );
 	void      *m_state;
 
+	// when getClusterRecs() started, for the msg51 stage time
+	uint64_t   m_startUs;
+
 	// next cluster rec # to get (for m_docIds[m_nexti])
 	int32_t      m_nexti;
 	// so we don't re-get cluster recs we got last call
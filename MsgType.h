@@ -11,6 +11,7 @@ enum msg_type_t {
 	msg_type_13 = 0x13,
 	msg_type_1f = 0x1f,
 	msg_type_20 = 0x20,
+	msg_type_21 = 0x21,
 	msg_type_22 = 0x22,
 	msg_type_25 = 0x25,
 	msg_type_39 = 0x39,
@@ -8,9 +8,9 @@
 #include "Multicast.h"
 #include "Rdb.h"       // RDB_TITLEDB
 #include "Msg20.h"
-#include "Profiler.h"
 #include "Stats.h"
 #include "Process.h"
+#include "HedgeLatency.h"
 
 // up to 10 twins in a group
 //#define MAX_HOSTS_PER_GROUP 10
@@ -23,6 +23,7 @@ static void sleepWrapper1       ( int bogusfd , void    *state ) ;
 static void sleepWrapper2       ( int bogusfd , void    *state ) ;
 static void gotReplyWrapperM1    ( void *state , UdpSlot *slot  ) ;
 static void gotReplyWrapperM2    ( void *state , UdpSlot *slot  ) ;
+static void sleepWrapperHedge   ( int bogusfd , void    *state ) ;
 
 void Multicast::constructor ( ) {
 	m_msg      = NULL;
@@ -128,6 +129,9 @@ bool Multicast::send ( char         *msg              ,
 	m_registeredSleep  = false;
 	m_sendToSelf       = sendToSelf;
 	m_sentToTwin       = false;
+	m_hedged           = false;
+	m_registeredHedge  = false;
+	m_hedgeHostNum     = -1;
 	m_retryCount       = 0;
 	m_key              = key;
 	m_rdbId               = rdbId;
@@ -534,6 +538,14 @@ int32_t Multicast::pickBestHost ( uint32_t key , int32_t firstHostId ) {
 	// . this will prevent a ton of msg39s from hitting one host and
 	//   "spiking" it.
 	if ( balance ) n = g_hostdb.m_myHost->m_stripe;
+	// . if no key or stripe picks the host, send to the least loaded
+	//   twin if we know how fast they reply
+	// . this moves the load away from hosts that are merging or are
+	//   otherwise slow without waiting for them to time out
+	if ( g_conf.m_useLatencyRouting && key == 0 && ! balance ) {
+		int32_t i = pickLeastLoadedHost();
+		if ( i >= 0 ) return i;
+	}
 	// . if key is not zero, use it to select a host in this group
 	// . if the host we want is dead then do it the old way
 	// . ignore the key if balance is true though! MDW
@@ -604,6 +616,35 @@ int32_t Multicast::pickBestHost ( uint32_t key , int32_t firstHostId ) {
 	//return i;
 }
 
+// . pick two random live hosts we have not tried yet and return the one
+//   with the lower load score from Hostdb. that is enough to keep the load
+//   even without all the requests going to the one fastest host
+// . returns -1 if we know nothing about either, or have less than two
+int32_t Multicast::pickLeastLoadedHost ( ) {
+	int32_t cand[32];
+	int32_t nc = 0;
+	for ( int32_t i = 0 ; i < m_numHosts && nc < 32 ; i++ ) {
+		Host *h = m_hostPtrs[i];
+		if ( m_retired[i] ) continue;
+		if ( g_hostdb.isDead ( h ) || g_hostdb.kernelErrors ( h ) )
+			continue;
+		cand[nc++] = i;
+	}
+	if ( nc < 2 ) return -1;
+	int32_t ka = rand() % nc;
+	int32_t kb = ( ka + 1 + rand() % ( nc - 1 ) ) % nc;
+	int32_t a  = cand[ka];
+	int32_t b  = cand[kb];
+	int64_t nowms = gettimeofdayInMilliseconds();
+	double sa = g_hostdb.getLoadScore ( m_hostPtrs[a] , m_msgType , nowms );
+	double sb = g_hostdb.getLoadScore ( m_hostPtrs[b] , m_msgType , nowms );
+	if ( sa <= 0 && sb <= 0 ) return -1;
+	// try a host we have no reply times for so we learn about it
+	if ( sa <= 0 ) return a;
+	if ( sb <= 0 ) return b;
+	return sa <= sb ? a : b;
+}
+
 // . pick the fastest host from m_hosts based on avg roundtrip time for ACKs
 // . skip hosts in our m_retired[] list of hostIds
 // . returns -1 if none left to pick
@@ -741,10 +782,19 @@ bool Multicast::sendToHost ( int32_t i ) {
 	}
 	// mark it as outstanding
 	m_inProgress[i] = 1;
+	g_hostdb.noteRequestSent ( h , m_msgType );
 	// set our last launch date
 	m_lastLaunch = nowms ; // gettimeofdayInMilliseconds();
 	// save the host, too
 	m_lastLaunchHost = h;
+	// . send the request to a twin as well if this host does not reply
+	//   within the usual time for this msg type
+	if ( ! m_hedged && ! m_registeredHedge ) {
+		int32_t delay = getHedgeDelay();
+		if ( delay > 0 &&
+		     g_loop.registerSleepCallback ( delay, this, sleepWrapperHedge, m_niceness ) )
+			m_registeredHedge = true;
+	}
 	// timing debug
 	//log("Multicast sent to hostId %" PRId32", this=%" PRId32", transId=%" PRId32,
 	//    h->m_hostId, (int32_t)this , m_slots[i]->m_transId );
@@ -961,6 +1011,61 @@ redirectTimedout:
 	//    THIS->m_msgType);
 }
 
+// . how long to wait for a reply before sending a hedged request to a twin
+// . returns -1 if we should not hedge this request
+int32_t Multicast::getHedgeDelay ( ) const {
+	if ( ! g_conf.m_useHedgedRequests ) return -1;
+	// only for queries, spider traffic can wait
+	if ( m_niceness != 0 ) return -1;
+	if ( m_numHosts < 2 ) return -1;
+	// two slots can not read their replies into the caller's buffer
+	if ( m_replyBuf ) return -1;
+	// the caller asked for its own reroute timeout
+	if ( m_redirectTimeout != -1 ) return -1;
+	// how slow the host we just sent to usually is
+	if ( ! m_lastLaunchHost ) return -1;
+	HedgeLatency *hl = getHedgeLatency ( m_lastLaunchHost->m_hostId ,
+					     m_msgType );
+	if ( ! hl ) return -1;
+	return hl->getDelay();
+}
+
+static void sleepWrapperHedge ( int bogusfd , void *state ) {
+	Multicast *THIS = (Multicast *)state;
+	THIS->sendHedge();
+}
+
+void Multicast::sendHedge ( ) {
+	// this is a one shot
+	g_loop.unregisterSleepCallback ( this , sleepWrapperHedge );
+	m_registeredHedge = false;
+	if ( ! m_inUse ) return;
+	// if the first request failed or was rerouted already leave it be
+	int32_t numInProgress = 0;
+	for ( int32_t i = 0 ; i < m_numHosts ; i++ )
+		if ( m_inProgress[i] ) numInProgress++;
+	if ( numInProgress != 1 ) return;
+	// do not hedge the hedge
+	m_hedged = true;
+	Host *first = m_lastLaunchHost;
+	int64_t elapsed = gettimeofdayInMilliseconds() - m_lastLaunch;
+	// . send to the best twin we have not tried yet
+	// . fails with ENOHOSTS if there is no live one
+	if ( ! sendToHostLoop ( 0 , -1 , -1 ) ) {
+		g_errno = 0;
+		return;
+	}
+	for ( int32_t i = 0 ; i < m_numHosts ; i++ )
+		if ( m_hostPtrs[i] == m_lastLaunchHost ) m_hedgeHostNum = i;
+	g_stats.m_hedges[(int)m_msgType][m_niceness]++;
+	if ( g_conf.m_logDebugQuery )
+		log(LOG_DEBUG,"net: multicast: host #%" PRId32" did not reply "
+		    "to msgType=0x%02x in %" PRId64" ms, sent hedged request "
+		    "to host #%" PRId32,
+		    first ? first->m_hostId : -1, m_msgType, elapsed,
+		    m_lastLaunchHost->m_hostId);
+}
+
 // C wrapper for the C++ callback
 void gotReplyWrapperM1 ( void *state , UdpSlot *slot ) {
 	Multicast *THIS = (Multicast *)state;
@@ -1002,6 +1107,22 @@ void Multicast::gotReply1 ( UdpSlot *slot ) {
 	m_replyingHost    = h;
 	m_replyLaunchTime = m_launchTime[i];
 
+	// . update the reply time average of the host
+	// . errors other than timeouts come back fast and say nothing
+	//   about the load of the host
+	int64_t nowms = gettimeofdayInMilliseconds();
+	int64_t took  = nowms - m_launchTime[i];
+	if ( g_errno && g_errno != EUDPTIMEDOUT ) took = -1;
+	g_hostdb.noteReplyReceived ( h , m_msgType , took , nowms );
+
+	if ( ! g_errno && m_niceness == 0 ) {
+		// keep track of the response times for the hedge delay
+		HedgeLatency *hl = getHedgeLatency ( h->m_hostId , m_msgType );
+		if ( hl ) hl->record ( nowms - m_launchTime[i] );
+		if ( m_hedged && i == m_hedgeHostNum )
+			g_stats.m_hedgeWins[(int)m_msgType][m_niceness]++;
+	}
+
 	if ( m_sentToTwin ) 
 		log("net: Twin msgType=0x%" PRIx32" (this=0x%" PTRFMT") "
 		    "reply: %s.",
@@ -1040,6 +1161,17 @@ void Multicast::gotReply1 ( UdpSlot *slot ) {
 		// if this slot had an error we may have to tell UdpServer
 		// not to free the read buf
 		if ( m_replyBuf == slot->m_readBuf ) slot->m_readBuf = NULL;
+		// if the other request of a hedged pair is still out, wait
+		// for its reply instead of giving up or trying a third host
+		if ( m_hedged ) {
+			int32_t j;
+			for ( j = 0 ; j < m_numHosts ; j++ )
+				if ( m_inProgress[j] ) break;
+			if ( j < m_numHosts ) {
+				g_errno = 0;
+				return;
+			}
+		}
 		// . try to send to another host
 		// . on successful sending return, we'll be called on reply
 		// . this also returns false if no new hosts left to send to
@@ -1158,6 +1290,10 @@ void Multicast::closeUpShop ( UdpSlot *slot ) {
 		g_loop.unregisterSleepCallback ( this , sleepWrapper1 );
 		m_registeredSleep = false;
 	}
+	if ( m_registeredHedge ) {
+		g_loop.unregisterSleepCallback ( this , sleepWrapperHedge );
+		m_registeredHedge = false;
+	}
 	if ( ! g_errno && m_retryCount > 0 ) 
 	       log("net: Multicast succeeded after %" PRId32" retries.",m_retryCount);
 	// allow us to be re-used now, callback might relaunch
@@ -1191,6 +1327,14 @@ void Multicast::destroySlotsInProgress ( UdpSlot *slot ) {
 		// contains it (or m_readBuf)
 		if ( m_replyBuf == m_slots[i]->m_readBuf )
 			m_slots[i]->m_readBuf = NULL;
+		// . the host was slower than the one that replied, so its
+		//   time so far is worth noting if it is above its average
+		// . otherwise just note the request is done
+		Host *h = m_hostPtrs[i];
+		int64_t nowms = gettimeofdayInMilliseconds();
+		int64_t took  = nowms - m_launchTime[i];
+		if ( took <= h->m_avgReplyTime[m_msgType] ) took = -1;
+		g_hostdb.noteReplyReceived ( h , m_msgType , took , nowms );
 		// destroy this slot that's in progress
 		g_udpServer.destroySlot ( m_slots[i] );
 		// do not re-destroy. consider no longer in progress.
@@ -118,12 +118,19 @@ class Multicast {
 	bool sendToHostLoop ( int32_t key, int32_t hostNumToTry, int32_t firstHostId );
 	bool sendToHost    ( int32_t i ); 
 	int32_t pickBestHost  ( uint32_t key , int32_t hostNumToTry );
+	int32_t pickLeastLoadedHost ( );
 	void gotReply1     ( UdpSlot *slot ) ;
 	void closeUpShop   ( UdpSlot *slot ) ;
 
 	void sendToGroup   ( ) ;
 	void gotReply2     ( UdpSlot *slot ) ;
 
+	// . hedged requests: if the host we sent to is slower than it
+	//   usually is for this msg type, send the same request to a twin
+	//   and take whichever reply comes first
+	int32_t getHedgeDelay ( ) const;
+	void sendHedge     ( ) ;
+
 	// . stuff set directly by send() parameters
 	char       *m_msg;
 	int32_t        m_msgSize;
@@ -199,6 +206,12 @@ class Multicast {
 
 	char        m_sentToTwin;
 
+	// did we send a hedged request to a twin? only one per multicast.
+	bool        m_hedged;
+	bool        m_registeredHedge;
+	// m_hostPtrs[] index of the twin we sent the hedged request to
+	int32_t     m_hedgeHostNum;
+
 	int32_t        m_redirectTimeout;
 	char        m_inUse;
 
@@ -0,0 +1,16 @@
+#include "gb-include.h"
+
+#include "TcpServer.h"
+#include "Pages.h"
+#include "SafeBuf.h"
+#include "Statistics.h"
+
+
+// . the stage latency histograms in the prometheus text format
+// . public like the health check so a scraper needs no login
+bool sendPageMetrics( TcpSocket *s , HttpRequest *r ) {
+	SafeBuf p;
+	Statistics::print_metrics(&p);
+
+	return g_httpServer.sendDynamicPage (s, p.getBufStart(), p.length(), -1, false, "text/plain; version=0.0.4", -1, NULL, "utf8" );
+}
@@ -2,6 +2,10 @@
 
 #include "Stats.h"
 #include "Pages.h"
+#include "Profiler.h"
+#include "QueryTrace.h"
+
+static void printProfiler ( SafeBuf *p , const char *coll );
 
 // . returns false if blocked, true otherwise
 // . sets errno on error
@@ -13,6 +17,31 @@ bool sendPagePerf ( TcpSocket *s , HttpRequest *r ) {
 	SafeBuf p(buf, 64*1024);
 	p.setLabel ( "perfgrph" );
 
+	const char *coll = r->getString ( "c" );
+	if ( ! coll || ! coll[0] )
+		coll = g_conf.getDefaultColl ( r->getHost(), r->getHostLen() );
+
+	// start/stop the sampling profiler
+	const char *prof = r->getString ( "prof" );
+	if ( prof && g_conf.isMasterAdmin ( s , r ) && g_conf.m_profilingEnabled ) {
+		if ( strcmp ( prof , "start" ) == 0 )
+			g_profiler.startRealTimeProfiler (
+				r->getLong ( "profhz" , DEFAULT_PROFILER_HZ ) );
+		else if ( strcmp ( prof , "stop" ) == 0 )
+			g_profiler.stopRealTimeProfiler ( true );
+		else if ( strcmp ( prof , "clear" ) == 0 )
+			g_profiler.stopRealTimeProfiler ( false );
+	}
+
+	// the sampled stacks in the format of flamegraph.pl
+	if ( r->getLong ( "profcollapsed" , 0 ) ) {
+		SafeBuf sb;
+		sb.setLabel ( "profcoll" );
+		g_profiler.printCollapsedStacks ( &sb );
+		return g_httpServer.sendDynamicPage ( s, sb.getBufStart(), sb.length(),
+						      -1, false, "text/plain" );
+	}
+
 	// print standard header
 	g_pages.printAdminTop ( &p , s , r );
 
@@ -280,6 +309,12 @@ bool sendPagePerf ( TcpSocket *s , HttpRequest *r ) {
 		       //g_stats.m_keyCols.getBufStart() : ""
 		       );
 
+	// no flame graph while it reloads every half second
+	if ( autoRefresh <= 0 ) {
+		printProfiler ( &p , coll );
+		QueryTrace::printTraces ( &p , coll , r->getLongLong ( "qtrace" , 0 ) );
+	}
+
 	if(autoRefresh > 0) p.safePrintf("</body>"); 
 
 	// print the final tail
@@ -291,3 +326,47 @@ bool sendPagePerf ( TcpSocket *s , HttpRequest *r ) {
 	// . make a Mime
 	return g_httpServer.sendDynamicPage ( s, p.getBufStart(), bufLen );
 }
+
+static void printProfiler ( SafeBuf *p , const char *coll ) {
+	p->safePrintf ( "<br><br>"
+			"<table %s>"
+			"<tr class=hdrow><td><b>Sampling profiler</b></td></tr>"
+			"<tr bgcolor=#%s><td>"
+			, TABLE_STYLE , LIGHT_BLUE );
+
+	if ( ! g_conf.m_profilingEnabled ) {
+		p->safePrintf ( "<font color=#ff0000><b>"
+				"Profiling is disabled in the master controls."
+				"</b></font></td></tr></table>" );
+		return;
+	}
+
+	int64_t now = gettimeofdayInMillisecondsLocal();
+	if ( g_profiler.m_realTimeProfilerRunning )
+		p->safePrintf ( "<b>Running</b> for %" PRId64" seconds at %" PRId32" hz "
+				"of cpu time. "
+				, ( now - g_profiler.getStartTime() ) / 1000
+				, g_profiler.getHz() );
+	else
+		p->safePrintf ( "<b>Stopped.</b> " );
+	p->safePrintf ( "%" PRId64" samples, %" PRId64" dropped. &nbsp; "
+			, g_profiler.getNumSamples()
+			, g_profiler.getNumDropped() );
+
+	if ( g_profiler.m_realTimeProfilerRunning )
+		p->safePrintf ( "<a href=/admin/perf?c=%s&prof=stop>stop</a> | "
+				"<a href=/admin/perf?c=%s>refresh</a> | "
+				, coll , coll );
+	else
+		p->safePrintf ( "<a href=/admin/perf?c=%s&prof=start>start</a> | "
+				, coll );
+	p->safePrintf ( "<a href=/admin/perf?c=%s&prof=clear>clear</a> | "
+			"<a href=/admin/perf?c=%s&profcollapsed=1>collapsed stacks</a>"
+			"</td></tr>"
+			"<tr bgcolor=#%s><td>"
+			, coll , coll , LIGHT_BLUE );
+
+	g_profiler.printFlameGraph ( p );
+
+	p->safePrintf ( "</td></tr></table>" );
+}
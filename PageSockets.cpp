@@ -463,6 +463,8 @@ void printUdpTable ( SafeBuf *p, const char *title, UdpServer *server ,
 			desc = "get titlerec";
 		} else if ( msgType == msg_type_20 ) {
 			desc = "get summary";
+		} else if ( msgType == msg_type_21 ) {
+			desc = "get summaries";
 		} else if ( msgType == msg_type_39 ) {
 			desc = "get docids";
 		} else if ( msgType == msg_type_7 ) {
@@ -455,6 +455,36 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 	if ( format == FORMAT_JSON )
 		p.safePrintf ( "\t\"totalDocIdsGenerated\":%" PRId64",\n",total);
 
+	if ( format == FORMAT_HTML )
+		p.safePrintf ( "<tr class=poo><td><b>Results Cache Hits"
+			       "</b></td><td>%" PRId32"</td></tr>\n"
+			       "<tr class=poo><td><b>Results Cache Misses"
+			       "</b></td><td>%" PRId32"</td></tr>\n"
+			       "<tr class=poo><td><b>Coalesced Queries"
+			       "</b></td><td>%" PRId32"</td></tr>\n"
+			       , g_stats.m_resultsCacheHits
+			       , g_stats.m_resultsCacheMisses
+			       , g_stats.m_resultsCoalesced );
+
+	if ( format == FORMAT_XML )
+		p.safePrintf ( "\t<resultsCacheHits>%" PRId32
+			       "</resultsCacheHits>\n"
+			       "\t<resultsCacheMisses>%" PRId32
+			       "</resultsCacheMisses>\n"
+			       "\t<coalescedQueries>%" PRId32
+			       "</coalescedQueries>\n"
+			       , g_stats.m_resultsCacheHits
+			       , g_stats.m_resultsCacheMisses
+			       , g_stats.m_resultsCoalesced );
+
+	if ( format == FORMAT_JSON )
+		p.safePrintf ( "\t\"resultsCacheHits\":%" PRId32",\n"
+			       "\t\"resultsCacheMisses\":%" PRId32",\n"
+			       "\t\"coalescedQueries\":%" PRId32",\n"
+			       , g_stats.m_resultsCacheHits
+			       , g_stats.m_resultsCacheMisses
+			       , g_stats.m_resultsCoalesced );
+
 	// print each filter stat
 	for ( int32_t i = 0 ; i < CR_END ; i++ ) {
 		if ( format == FORMAT_HTML )
@@ -1391,6 +1421,8 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 			      "<td><b>acks out</td>\n"
 
 			      "<td><b>reroutes</td>\n"
+			      "<td><b>hedges</td>\n"
+			      "<td><b>hedge wins</td>\n"
 			      "<td><b>dropped</td>\n"
 			      "<td><b>cancels read</td>\n"
 			      "<td><b>errors</td>\n"
@@ -1414,6 +1446,7 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 		// skip it if has no handler
 		if ( ! g_udpServer.m_handlers[i1] ) continue;
 		if ( ! g_stats.m_reroutes   [i1][i3] &&
+		     ! g_stats.m_hedges     [i1][i3] &&
 		     ! g_stats.m_packetsIn  [i1][i3] &&
 		     ! g_stats.m_packetsOut [i1][i3] &&
 		     ! g_stats.m_errors     [i1][i3] &&
@@ -1434,6 +1467,8 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 				     "<td>%" PRId32"</td>" // acks in
 				     "<td>%" PRId32"</td>" // acks out
 				     "<td>%" PRId32"</td>" // reroutes
+				     "<td>%" PRId32"</td>" // hedges
+				     "<td>%" PRId32"</td>" // hedge wins
 				     "<td>%" PRId32"</td>" // dropped
 				     "<td>%" PRId32"</td>" // cancel read
 				     "<td>%" PRId32"</td>" // errors
@@ -1448,6 +1483,8 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 				     g_stats.m_acksIn [i1][i3],
 				     g_stats.m_acksOut[i1][i3],
 				     g_stats.m_reroutes[i1][i3],
+				     g_stats.m_hedges[i1][i3],
+				     g_stats.m_hedgeWins[i1][i3],
 				     g_stats.m_dropped[i1][i3],
 				     g_stats.m_cancelRead[i1][i3],
 				     g_stats.m_errors[i1][i3],
@@ -1464,6 +1501,8 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 				     "\t\t<acksIn>%" PRId32"</acksIn>\n"
 				     "\t\t<acksOut>%" PRId32"</acksOut>\n"
 				     "\t\t<reroutes>%" PRId32"</reroutes>\n"
+				     "\t\t<hedges>%" PRId32"</hedges>\n"
+				     "\t\t<hedgeWins>%" PRId32"</hedgeWins>\n"
 				     "\t\t<dropped>%" PRId32"</dropped>\n"
 				     "\t\t<cancelsRead>%" PRId32"</cancelsRead>\n"
 				     "\t\t<errors>%" PRId32"</errors>\n"
@@ -1477,6 +1516,8 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 				     g_stats.m_acksIn [i1][i3],
 				     g_stats.m_acksOut[i1][i3],
 				     g_stats.m_reroutes[i1][i3],
+				     g_stats.m_hedges[i1][i3],
+				     g_stats.m_hedgeWins[i1][i3],
 				     g_stats.m_dropped[i1][i3],
 				     g_stats.m_cancelRead[i1][i3],
 				     g_stats.m_errors[i1][i3],
@@ -1493,6 +1534,8 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 				     "\t\t\"acksIn\":%" PRId32",\n"
 				     "\t\t\"acksOut\":%" PRId32",\n"
 				     "\t\t\"reroutes\":%" PRId32",\n"
+				     "\t\t\"hedges\":%" PRId32",\n"
+				     "\t\t\"hedgeWins\":%" PRId32",\n"
 				     "\t\t\"dropped\":%" PRId32",\n"
 				     "\t\t\"cancelsRead\":%" PRId32",\n"
 				     "\t\t\"errors\":%" PRId32",\n"
@@ -1506,6 +1549,8 @@ bool sendPageStats ( TcpSocket *s , HttpRequest *r ) {
 				     g_stats.m_acksIn [i1][i3],
 				     g_stats.m_acksOut[i1][i3],
 				     g_stats.m_reroutes[i1][i3],
+				     g_stats.m_hedges[i1][i3],
+				     g_stats.m_hedgeWins[i1][i3],
 				     g_stats.m_dropped[i1][i3],
 				     g_stats.m_cancelRead[i1][i3],
 				     g_stats.m_errors[i1][i3],
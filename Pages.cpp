@@ -185,10 +185,10 @@ static WebPage s_pages[] = {
 	  sendPageLogView  , 0 ,NULL,NULL,
 	  PG_STATUS|PG_NOAPI|PG_MASTERADMIN|PG_ACTIVE},
 
-	// deactivate until works on 64-bit... mdw 12/14/14
-	{ PAGE_PROFILER    , "admin/profiler"   , 0 , "profiler" ,  0 ,M_POST,
-	  "profiler",
-	  sendPageProfiler   , 0 ,NULL,NULL,
+	// the sampling profiler is on the perf page
+	{ PAGE_PROFILER    , "admin/profiler"   , 0 , "profiler" ,  0 , 0 ,
+	  "sampling profiler",
+	  sendPagePerf       , 0 ,NULL,NULL,
 	  PG_NOAPI|PG_MASTERADMIN|PG_ACTIVE},
 
 	{ PAGE_THREADS    , "admin/threads"   , 0 , "threads" ,  0 , 0 ,
@@ -237,6 +237,11 @@ static WebPage s_pages[] = {
 	  sendPageHealthCheck  , 0 ,NULL,NULL,
 	  PG_NOAPI|PG_ACTIVE},
 
+	{ PAGE_METRICS, "metrics"   , 0 , "metrics" ,  0 , 0 ,
+	  "stage latency histograms for prometheus",
+	  sendPageMetrics  , 0 ,NULL,NULL,
+	  PG_NOAPI|PG_ACTIVE},
+
 };
 static const int32_t s_numPages = sizeof(s_pages) / sizeof(WebPage);
 
@@ -345,6 +350,7 @@ bool Pages::sendDynamicReply ( TcpSocket *s , HttpRequest *r , int32_t page ) {
 	if ( page == PAGE_ADDURL ) publicPage = true;
 	if ( page == PAGE_GET ) publicPage = true;
 	if ( page == PAGE_HEALTHCHECK ) publicPage = true;
+	if ( page == PAGE_METRICS ) publicPage = true;
 
 	// now use this...
 	bool isMasterAdmin = g_conf.isMasterAdmin ( s , r );
@@ -1204,6 +1210,7 @@ bool  Pages::printAdminLinks ( SafeBuf *sb,
 		if ( i == PAGE_TITLEDB ) continue;
 		if ( i == PAGE_IMPORT ) continue;
 		if ( i == PAGE_HEALTHCHECK ) continue;
+		if ( i == PAGE_METRICS ) continue;
 		
 
 
@@ -2607,8 +2614,9 @@ bool printRedBox ( SafeBuf *mb , TcpSocket *sock , HttpRequest *hr ) {
 		adds++;
 		mb->safePrintf("%s",box);
 		mb->safePrintf("Profiler is running. Performance is "
-			       "somewhat compromised. Disable on the "
-			       "profiler page.");
+			       "somewhat compromised. Stop it on the "
+			       "<a href=/admin/perf?c=%s>performance</a> page.",
+			       coll);
 		mb->safePrintf("%s",boxEnd);
 	}
 
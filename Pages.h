@@ -60,12 +60,12 @@ bool sendPageInject   ( TcpSocket *s , HttpRequest *r );
 bool sendPageAddUrl2  ( TcpSocket *s , HttpRequest *r );
 bool sendPageGeneric  ( TcpSocket *s , HttpRequest *r ); // in Parms.cpp
 bool sendPageLogView    ( TcpSocket *s , HttpRequest *r );
-bool sendPageProfiler   ( TcpSocket *s , HttpRequest *r );
 bool sendPageThreads    ( TcpSocket *s , HttpRequest *r );
 bool sendPageAPI        ( TcpSocket *s , HttpRequest *r );
 bool sendPageHelp       ( TcpSocket *s , HttpRequest *r );
 bool sendPageGraph      ( TcpSocket *s , HttpRequest *r );
 bool sendPageHealthCheck ( TcpSocket *sock , HttpRequest *hr ) ;
+bool sendPageMetrics     ( TcpSocket *sock , HttpRequest *hr ) ;
 
 
 // values for m_usePost:
@@ -223,6 +223,7 @@ enum {
 	PAGE_PARSER      ,
 	PAGE_SITEDB      ,
 	PAGE_HEALTHCHECK ,
+	PAGE_METRICS     ,
 	PAGE_NONE     	};
 	
 
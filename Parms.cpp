@@ -10,6 +10,7 @@
 #include "Collectiondb.h"
 #include "HttpMime.h"      // atotime()
 #include "SearchInput.h"
+#include "Msg40.h"
 #include "Unicode.h"
 #include "Spider.h" // MAX_SPIDER_PRIORITIES
 #include "SpiderColl.h"
@@ -3453,16 +3454,6 @@ void Parms::init ( ) {
 	m->m_flags = PF_NOAPI;
 	m++;
 
-	m->m_title = "search results max cache mem";
-	m->m_desc  = "Bytes to use for caching search result pages.";
-	m->m_off   = offsetof(Conf,m_searchResultsMaxCacheMem);
-	m->m_def   = "100000";
-	m->m_type  = TYPE_LONG;
-	m->m_flags = PF_NOSYNC|PF_NOAPI;
-	m->m_page  = PAGE_NONE;
-	m->m_obj   = OBJ_CONF;
-	m++;
-
 	m->m_title = "read only mode";
 	m->m_desc  = "Read only mode does not allow spidering.";
 	m->m_cgi   = "readonlymode";
@@ -5185,6 +5176,45 @@ void Parms::init ( ) {
 	m->m_obj   = OBJ_CONF;
 	m++;
 
+	m->m_title = "http keep-alive";
+	m->m_desc  = "Keep incoming HTTP connections open after the reply "
+		"if the client asks for it, so API clients can send more "
+		"requests, also pipelined ones, over the same connection.";
+	m->m_cgi   = "hka";
+	m->m_off   = offsetof(Conf,m_httpKeepAlive);
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
+	m->m_title = "http keep-alive timeout";
+	m->m_desc  = "Close a kept-alive HTTP connection after it has been "
+		"idle this long.";
+	m->m_cgi   = "hkat";
+	m->m_off   = offsetof(Conf,m_httpKeepAliveTimeout);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "15000";
+	m->m_units = "milliseconds";
+	m->m_min   = 0;
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
+	m->m_title = "http keep-alive max requests";
+	m->m_desc  = "Close a kept-alive HTTP connection after serving this "
+		"many requests on it.";
+	m->m_cgi   = "hkam";
+	m->m_off   = offsetof(Conf,m_httpKeepAliveMaxRequests);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "100";
+	m->m_min   = 1;
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
 	m->m_title = "spider user agent";
 	m->m_desc  = "Identification seen by web servers when "
 		"the Gigablast spider downloads their web pages. "
@@ -5200,6 +5230,47 @@ void Parms::init ( ) {
 	m->m_obj   = OBJ_CONF;
 	m++;
 
+	m->m_title = "spider keep-alive";
+	m->m_desc  = "Keep the connection to a web server open after a "
+		"download, and resume its SSL session, so the next download "
+		"from the same IP does not have to connect again. Only used if "
+		"the crawl delay of the IP is shorter than the spider "
+		"keep-alive timeout and not when downloading through a proxy.";
+	m->m_cgi   = "ska";
+	m->m_off   = offsetof(Conf,m_spiderKeepAlive);
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
+	m->m_title = "spider keep-alive timeout";
+	m->m_desc  = "Close a kept-alive connection to a web server after it "
+		"has been idle this long.";
+	m->m_cgi   = "skat";
+	m->m_off   = offsetof(Conf,m_spiderKeepAliveTimeout);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "5000";
+	m->m_units = "milliseconds";
+	m->m_min   = 0;
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
+	m->m_title = "spider max idle sockets";
+	m->m_desc  = "Keep at most this many idle connections to web servers "
+		"open, and at most one per IP and port.";
+	m->m_cgi   = "smis";
+	m->m_off   = offsetof(Conf,m_spiderMaxIdleSockets);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "200";
+	m->m_min   = 0;
+	m->m_group = false;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
 	m->m_title = "bot name";
 	m->m_desc  = "Bot name used when checking robots.txt and metatags for specific allow/deny rules.";
 	m->m_cgi   = "botname";
@@ -5404,18 +5475,6 @@ void Parms::init ( ) {
 	m->m_obj   = OBJ_CONF;
 	m++;
 
-	m->m_title = "search results cache max age";
-	m->m_desc = "How many seconds should we cache a search results "
-		"page for?";
-	m->m_cgi  = "srcma";
-	m->m_off  = offsetof(Conf,m_searchResultsMaxCacheAge);
-	m->m_def  = "10800"; // 3 hrs
-	m->m_type = TYPE_LONG;
-	m->m_units = "seconds";
-	m->m_page  = PAGE_MASTER;
-	m->m_obj   = OBJ_CONF;
-	m++;
-
 	m->m_title = "document summary (w/desc) cache max age";
 	m->m_desc = "How many milliseconds should we cache document summaries";
 	m->m_cgi  = "dswdmca";
@@ -5427,6 +5486,45 @@ void Parms::init ( ) {
 	m->m_obj   = OBJ_CONF;
 	m++;
 
+	m->m_title = "batch summary requests";
+	m->m_desc  = "Get the summaries of a page of search results with one "
+		"request per shard instead of one request per result. "
+		"Only turn this on once all hosts run a version that "
+		"answers them.";
+	m->m_cgi   = "bsumreq";
+	m->m_off   = offsetof(Conf,m_batchSummaryRequests);
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
+	m->m_title = "query trace sample percent";
+	m->m_desc  = "Trace this percent of the queries across the hosts "
+		"they touch. The traces of the slow ones are shown on "
+		"the perf page. Queries with debug=1 are always traced. "
+		"Use 0 to disable.";
+	m->m_cgi   = "qtsp";
+	m->m_off   = offsetof(Conf,m_queryTraceSamplePercent);
+	m->m_type  = TYPE_FLOAT;
+	m->m_def   = "1.0";
+	m->m_units = "percent";
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
+	m->m_title = "query trace min time";
+	m->m_desc  = "Keep the trace of a traced query for the perf page "
+		"if it took at least this many milliseconds.";
+	m->m_cgi   = "qtmt";
+	m->m_off   = offsetof(Conf,m_queryTraceMinTime);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "500";
+	m->m_units = "milliseconds";
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
 	m->m_title = "max heartbeat delay in milliseconds";
 	m->m_desc  = "If a heartbeat is delayed this many milliseconds "
 		"dump a core so we can see where the CPU was. "
@@ -6147,6 +6245,37 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "search results max cache mem";
+	m->m_desc  = "How much memory to use for caching whole pages of search "
+		"results on the host that got the query. Identical queries "
+		"that come in while one is running wait for its results "
+		"instead of running again. 0 disables both.";
+	m->m_cgi   = "srcmm";
+	m->m_off   = offsetof(Conf,m_searchResultsMaxCacheMem);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "20000000";
+	m->m_units = "bytes";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "search results cache max age";
+	m->m_desc  = "How many seconds should we cache a search results "
+		"page for? Pages of a collection are dropped right away "
+		"when it is reset or its parms change.";
+	m->m_cgi   = "srcma";
+	m->m_off   = offsetof(Conf,m_searchResultsMaxCacheAge);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "300";
+	m->m_units = "seconds";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = false;
+	m++;
+
 	m->m_title = "TagRec (Msg8a) cache size";
 	m->m_desc  = "How much memory to use for caching TagRec";
 	m->m_cgi   = "tagreccachemem";
@@ -6535,6 +6664,51 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "query threads reserved";
+	m->m_desc  = "Number of threads of each thread pool kept free for "
+		"query jobs so they do not have to wait behind merges and "
+		"spidering. Takes effect on restart.";
+	m->m_cgi   = "qtr";
+	m->m_off   = offsetof(Conf,m_queryThreadsReserved);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "0";
+	m->m_units = "threads";
+	m->m_min   = 0;
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "max merge threads";
+	m->m_desc  = "Maximum number of file merge jobs running at the same "
+		"time. 0 for no limit. Takes effect on restart.";
+	m->m_cgi   = "mmt";
+	m->m_off   = offsetof(Conf,m_maxMergeThreads);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "0";
+	m->m_units = "threads";
+	m->m_min   = 0;
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "pin job threads";
+	m->m_desc  = "If enabled the cpu threads are pinned to a core each "
+		"and the I/O and external threads to the cores of a NUMA node. "
+		"Takes effect on restart.";
+	m->m_cgi   = "pjt";
+	m->m_off   = offsetof(Conf,m_pinJobThreads);
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = false;
+	m++;
+
 
 	m->m_title = "flush disk writes";
 	m->m_desc  = "If enabled then all writes will be flushed to disk. "
@@ -6550,6 +6724,41 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "use write-ahead log for rdb trees";
+	m->m_desc  = "If enabled the lists added to the in-memory rdb trees "
+		"are appended to a write-ahead log instead of saving the "
+		"whole trees periodically and on shutdown. The log is "
+		"replayed on startup and checkpointed whenever a tree is "
+		"dumped to disk. The dumped files are only fsync'ed with "
+		"flush disk writes on, so without that the log only protects "
+		"against crashes of gb, not of the machine. "
+		"Takes effect on restart.";
+	m->m_cgi   = "rdbwal";
+	m->m_off   = offsetof(Conf,m_useRdbWal);
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = false;
+	m++;
+
+	m->m_title = "rdb write-ahead log sync interval";
+	m->m_desc  = "The lists added in this many milliseconds are written "
+		"to the write-ahead log and fsync'ed together. A crash loses "
+		"at most this much.";
+	m->m_cgi   = "rdbwalsync";
+	m->m_off   = offsetof(Conf,m_rdbWalSyncInterval);
+	m->m_type  = TYPE_LONG;
+	m->m_def   = "100";
+	m->m_units = "milliseconds";
+	m->m_min   = 0;
+	m->m_flags = 0;
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = false;
+	m++;
+
 	m->m_title = "verify written lists";
 	m->m_desc  = "Ensure lists being written to disk are not corrupt. "
 		"That title recs appear valid, etc. Helps isolate sources "
@@ -6634,8 +6843,8 @@ void Parms::init ( ) {
 	m++;
 
 	m->m_title = "enable profiling";
-	m->m_desc  = "Enable profiler to do accounting of time taken by "
-		"functions. ";
+	m->m_desc  = "Allow the sampling profiler to be started on the "
+		"performance page.";
 	m->m_cgi   = "enp";
 	m->m_off   = offsetof(Conf,m_profilingEnabled);
 	m->m_type  = TYPE_BOOL;
@@ -6645,35 +6854,6 @@ void Parms::init ( ) {
 	m->m_obj   = OBJ_CONF;
 	m++;
 
-	m->m_title = "minimum profiling threshold";
-	m->m_desc  = "Profiler will not show functions which take less "
-		"than this many milliseconds "
-		"in the log or  on the perfomance graph.";
-	m->m_cgi   = "mpt";
-	m->m_off   = offsetof(Conf,m_minProfThreshold);
-	m->m_type  = TYPE_LONG;
-	m->m_def   = "10";
-	m->m_group = false;
-	m->m_flags = PF_HIDDEN | PF_NOSAVE;
-	m->m_page  = PAGE_MASTER;
-	m->m_obj   = OBJ_CONF;
-	m++;
-
-
-	m->m_title = "sequential profiling.";
-	m->m_desc  = "Produce a LOG_TIMING log message for each "
-		"callback called, along with the time it took.  "
-		"Profiler must be enabled.";
-	m->m_cgi   = "ensp";
-	m->m_off   = offsetof(Conf,m_sequentialProfiling);
-	m->m_type  = TYPE_BOOL;
-	m->m_def   = "0";
-	m->m_group = false;
-	m->m_flags = PF_HIDDEN | PF_NOSAVE;
-	m->m_page  = PAGE_MASTER;
-	m->m_obj   = OBJ_CONF;
-	m++;
-
 	m->m_title = "use statsdb";
 	m->m_desc  = "Archive system statistics information in Statsdb.";
 	m->m_cgi   = "usdb";
@@ -7975,6 +8155,55 @@ void Parms::init ( ) {
 	m->m_flags = 0;
 	m++;
 
+	m->m_title = "use hedged requests";
+	m->m_desc  = "If enabled, a msg39, msg20 or msg0 request that has not "
+		"been answered by the host it was sent to within the usual "
+		"time of that host for that msg type is sent to a twin as "
+		"well. The first "
+		"reply is used and the other request is cancelled.";
+	m->m_cgi   = "hedgedrequests";
+	m->m_off   = offsetof(Conf,m_useHedgedRequests);
+	m->m_xml   = "use_hedged_requests";
+	m->m_type  = TYPE_BOOL;
+	m->m_page  = PAGE_SEARCH;
+	m->m_obj   = OBJ_CONF;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m++;
+
+	m->m_title = "hedged request percentile";
+	m->m_desc  = "Send the hedged request when the first request has "
+		"taken longer than this percentile of the recent response "
+		"times of its host for its msg type. Lower values cut more "
+		"of the tail "
+		"latency but send more duplicate requests.";
+	m->m_cgi   = "hedgepercentile";
+	m->m_off   = offsetof(Conf,m_hedgePercentile);
+	m->m_xml   = "hedge_percentile";
+	m->m_type  = TYPE_LONG;
+	m->m_page  = PAGE_SEARCH;
+	m->m_obj   = OBJ_CONF;
+	m->m_def   = "95";
+	m->m_min   = 50;
+	m->m_flags = 0;
+	m++;
+
+	m->m_title = "use latency aware routing";
+	m->m_desc  = "If enabled, requests to a shard go to the twin with the "
+		"lowest recent response time times outstanding requests, "
+		"out of two picked at random. This moves load away from "
+		"hosts that are merging or otherwise slow. Only applies to "
+		"requests that do not pick the host by key or stripe.";
+	m->m_cgi   = "latencyrouting";
+	m->m_off   = offsetof(Conf,m_useLatencyRouting);
+	m->m_xml   = "use_latency_routing";
+	m->m_type  = TYPE_BOOL;
+	m->m_page  = PAGE_SEARCH;
+	m->m_obj   = OBJ_CONF;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m++;
+
 	m->m_title = "use high frequency term cache";
 	m->m_desc  = "If enabled, return generated DocIds from cache "
 		"when detecting a high frequency term.";
@@ -7987,6 +8216,59 @@ void Parms::init ( ) {
 	m->m_flags = 0;
 	m++;
 
+	m->m_title = "termlist cache size";
+	m->m_desc  = "How many bytes of memory to use for keeping the complete "
+		"posdb termlists of the most queried terms in memory. "
+		"Use 0 to disable.";
+	m->m_cgi   = "tlcmaxmem";
+	m->m_off   = offsetof(Conf,m_termListCacheMaxMem);
+	m->m_type  = TYPE_LONG_LONG;
+	m->m_page  = PAGE_SEARCH;
+	m->m_obj   = OBJ_CONF;
+	m->m_def   = "100000000";
+	m->m_flags = 0;
+	m++;
+
+	m->m_title = "termlist cache min hits";
+	m->m_desc  = "A term is queried at least this many times before its "
+		"termlist is loaded into the termlist cache.";
+	m->m_cgi   = "tlcminhits";
+	m->m_off   = offsetof(Conf,m_termListCacheMinHits);
+	m->m_type  = TYPE_LONG;
+	m->m_page  = PAGE_SEARCH;
+	m->m_obj   = OBJ_CONF;
+	m->m_def   = "20";
+	m->m_min   = 1;
+	m->m_flags = 0;
+	m++;
+
+	m->m_title = "termlist cache uses huge pages";
+	m->m_desc  = "If enabled, ask the kernel for transparent huge pages "
+		"for big termlists in the termlist cache.";
+	m->m_cgi   = "tlchugepages";
+	m->m_off   = offsetof(Conf,m_termListCacheUseHugePages);
+	m->m_type  = TYPE_BOOL;
+	m->m_page  = PAGE_SEARCH;
+	m->m_obj   = OBJ_CONF;
+	m->m_def   = "0";
+	m->m_flags = 0;
+	m++;
+
+	m->m_title = "partial termlist read max docids";
+	m->m_desc  = "If the termlists of a required query term have at most "
+		"this many docids, and another term's termlists are much "
+		"bigger, just read the docid ranges of those docids from the "
+		"bigger termlists. Use 0 to always read whole termlists.";
+	m->m_cgi   = "ptrmaxdocids";
+	m->m_off   = offsetof(Conf,m_partialTermListReadMaxDocIds);
+	m->m_type  = TYPE_LONG;
+	m->m_page  = PAGE_SEARCH;
+	m->m_obj   = OBJ_CONF;
+	m->m_def   = "5000";
+	m->m_min   = 0;
+	m->m_flags = 0;
+	m++;
+
 	m->m_title = "Results validity time";
 	m->m_desc  = "Default validity time of a a search result. Currently static but will be more dynamic in the future.";
 	m->m_cgi   = "qresultsvaliditytime";
@@ -8097,6 +8379,21 @@ void Parms::init ( ) {
 	m->m_group = true;
 	m++;
 
+	m->m_title = "link info reuse max age";
+	m->m_desc  = "When making the link info of a page, reuse the link "
+		"text of the linkers that were in its old link info instead "
+		"of getting their title records again, if the old link info "
+		"is at most this many days old. Use 0 to always get them.";
+	m->m_cgi   = "lirma";
+	m->m_off   = offsetof(Conf,m_linkInfoReuseMaxAge);
+	m->m_def   = "7";
+	m->m_type  = TYPE_LONG;
+	m->m_min   = 0;
+	m->m_page  = PAGE_RDB;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = false;
+	m++;
+
 	////////////////////
 	// posdb settings
 	////////////////////
@@ -8148,6 +8445,20 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "posdb merge threads";
+	m->m_desc  = "Merge a termlist of more than a megabyte from many "
+		"posdb files in this many docid ranges at once, each in its "
+		"own thread. Use 1 to always merge a termlist in one thread.";
+	m->m_cgi   = "pmth";
+	m->m_off   = offsetof(Conf,m_posdbMergeThreads);
+	m->m_def   = "1";
+	m->m_type  = TYPE_LONG;
+	m->m_min   = 1;
+	m->m_page  = PAGE_RDB;
+	m->m_obj   = OBJ_CONF;
+	m->m_group = false;
+	m++;
+
 	////////////////////
 	// statdb settings
 	////////////////////
@@ -8338,6 +8649,20 @@ void Parms::init ( ) {
 	m->m_group = false;
 	m++;
 
+	m->m_title = "titledb dictionary compression";
+	m->m_desc  = "Train a compression dictionary per collection from the "
+		"title records read by titledb merges and recompress the title "
+		"records with it when merging. The records are smaller on disk. "
+		"Only turn this on once all hosts run a version that can read "
+		"such records.";
+	m->m_cgi   = "tdictcomp";
+	m->m_off   = offsetof(Conf,m_titleRecDicts);
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "0";
+	m->m_page  = PAGE_MASTER;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
 	///////////////////////////////////////////
 	// PAGE SPIDER CONTROLS
 	///////////////////////////////////////////
@@ -9485,6 +9810,20 @@ void Parms::init ( ) {
 	m->m_obj   = OBJ_CONF;
 	m++;
 
+	m->m_title = "log asynchronously";
+	m->m_desc  = "If enabled, threads add their log messages to a buffer "
+		"of their own and a writer thread writes them to the log "
+		"file in batches, so logging does not block on the disk or "
+		"on the other threads. Debug messages are dropped if that "
+		"buffer is full.";
+	m->m_cgi   = "lasync";
+	m->m_off   = offsetof(Conf,m_logAsynchronously);
+	m->m_type  = TYPE_BOOL;
+	m->m_def   = "1";
+	m->m_page  = PAGE_LOG;
+	m->m_obj   = OBJ_CONF;
+	m++;
+
 	m->m_title = "log informational messages";
 	m->m_desc  = "Log messages not related to an error condition, "
 		"but meant more to give an idea of the state of "
@@ -12367,6 +12706,9 @@ bool Parms::updateParm ( char *rec , WaitEntry *we ) {
 
 	if ( cr ) cr->m_needsSave = true;
 
+	// the cached search results might depend on the old value
+	Msg40::invalidateResultsCache ( cr ? collnum : -1 );
+
 	// HACK #2
 	if ( base == cr && dst == (char *)&cr->m_importEnabled )
 		resetImportLoopFlag();
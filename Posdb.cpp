@@ -7,6 +7,7 @@
 #include "Rebalance.h"
 #include "RdbCache.h"
 #include "Sanity.h"
+#include "TermFreqTable.h"
 
 #ifdef _VALGRIND_
 #include <valgrind/memcheck.h>
@@ -444,6 +445,29 @@ int64_t Posdb::getTermFreq ( collnum_t collnum, int64_t termId ) {
 		return val;
 	}
 
+	// . if we have a term freq table use it instead of walking the maps
+	//   of every file
+	// . the table only covers the files, add the docs still in the tree
+	RdbBase *base = getRdbBase ( RDB_POSDB , collnum );
+	TermFreqTable *tft = base ? base->getTermFreqTable() : NULL;
+	if ( tft ) {
+		int64_t tf = tft->getTermFreq ( termId );
+		RdbList treeList;
+		if ( m_rdb.m_buckets.getList ( collnum ,
+					       (char *)&startKey ,
+					       (char *)&endKey ,
+					       -1 , &treeList , NULL , NULL ,
+					       true ) )
+			tf += TermFreqTable::countPosdbDocs ( &treeList );
+		else
+			g_errno = 0;
+		if ( tf < 0 ) tf = 0;
+		// and assume each shard has about the same #
+		tf *= g_hostdb.m_numShards;
+		g_termFreqCache.addLongLong2 ( collnum, termId, tf );
+		return tf;
+	}
+
 	// . ask rdb for an upper bound on this list size
 	// . but actually, it will be somewhat of an estimate 'cuz of RdbTree
 	key144_t maxKey;
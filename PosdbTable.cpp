@@ -10,6 +10,7 @@
 #include "Msg39.h"
 #include "Sanity.h"
 #include "Stats.h"
+#include "Statistics.h"
 #include "Conf.h"
 #include "TopTree.h"
 #include <math.h>
@@ -263,16 +264,6 @@ bool PosdbTable::allocWhiteListTable ( ) {
 		if ( ! m_whiteListTable.set(5,0,numSlots,NULL,0,false,
 					    0,"wtall"))
 			return false;
-		// try to speed up. wow, this slowed it down about 4x!!
-		//m_whiteListTable.m_maskKeyOffset = 1;
-		//
-		////////////
-		//
-		// this seems to make it like 20x faster... 1444ms vs 27000ms:
-		//
-		////////////
-		//
-		m_whiteListTable.m_useKeyMagic = true;
 	}
 	return true;
 }
@@ -3042,6 +3033,7 @@ void PosdbTable::shrinkSubLists ( QueryTermInfo *qti ) {
 //   we could also note that if a term was not in the title or
 //   inlink text it could never beat the 10th score.
 void PosdbTable::intersectLists10_r ( ) {
+	Statistics::StageTimer stageTimer ( Statistics::stage_query_intersect );
 	logTrace(g_conf.m_logTracePosdb, "BEGIN. numTerms: %" PRId32, m_q->m_numTerms);
 
 	m_finalScore = 0.0;
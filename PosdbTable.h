@@ -3,6 +3,7 @@
 
 #include "Rdb.h"
 #include "HashTableX.h"
+#include "FlatHashTable.h"
 #include "Query.h"         // MAX_QUERY_TERMS, qvec_t
 
 
@@ -228,7 +229,7 @@ class PosdbTable {
 	// the new intersection/scoring algo
 	void intersectLists10_r ( );	
 
-	HashTableX m_whiteListTable;
+	FlatHashTable<5> m_whiteListTable;
 	bool m_useWhiteTable;
 	bool m_addedSites;
 
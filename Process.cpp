@@ -33,6 +33,8 @@
 #include "PageInject.h"
 #include "Timezone.h"
 #include "CountryCode.h"
+#include "TermListCache.h"
+#include "ConverterPool.h"
 #include <sys/statvfs.h>
 #include <pthread.h>
 
@@ -647,6 +649,9 @@ void Process::shutdownAbort ( bool save_on_abort ) {
 		shutdown(true);
 	}
 
+	// write out what is still in the log rings
+	g_log.flush();
+
 	abort();
 }
 
@@ -904,7 +909,6 @@ bool Process::shutdown2() {
 	}
 
 	g_profiler.stopRealTimeProfiler(false);
-	g_profiler.cleanup();
 
 	// save the conf files and caches. these block the cpu.
 	if ( m_blockersNeedSave ) {
@@ -935,6 +939,8 @@ bool Process::shutdown2() {
 		// because they seem to not clean it up
 		//resetPageCaches();
 
+		// write out the msgs still in the log rings
+		g_log.flush();
 		abort();
 	}
 
@@ -1252,6 +1258,7 @@ bool Process::saveBlockingFiles2 ( ) {
 
 void Process::resetAll ( ) {
 	g_log             .reset();
+	g_converterPool   .reset();
 	g_hostdb          .reset();
 	g_spiderLoop      .reset();
 
@@ -1280,6 +1287,8 @@ void Process::resetAll ( ) {
 	// termfreq cache in Posdb.cpp
 	g_termFreqCache.reset();
 
+	g_termListCache.reset();
+
 	g_wiktionary.reset();
 
 	g_countryCode.reset();
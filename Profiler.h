@@ -1,283 +1,109 @@
+// . a sampling profiler
+// . setitimer(ITIMER_PROF) sends us a SIGPROF for every so many microseconds
+//   of cpu time the process uses, the kernel delivers it to the thread that
+//   is running, so the main loop and the JobScheduler threads are sampled
+//   in proportion to the cpu they use
+// . the signal handler takes the call stack with backtrace() and counts it
+//   in a lock-free table of stacks, nothing is allocated or locked there
+// . the stacks are symbolized with the ELF symbol tables of the executable
+//   and the shared libraries when they are printed, as collapsed stacks
+//   ("main;Loop::runLoop;...;leaf 123" lines that flamegraph.pl reads) or
+//   as an html flame graph on the admin perf page
+
 #ifndef GB_PROFILER_H
 #define GB_PROFILER_H
 
-#define EI_NIDENT 16
-#define SHT_SYMTAB 2
-#define SHT_DYNSYM 11
-
-#include "TcpServer.h"
-#include "HttpRequest.h"
-#include "Parms.h"
+#include <inttypes.h>
+#include <atomic>
+#include <vector>
 #include "SafeBuf.h"
-#include "Pages.h"
-#include "HashTableX.h"
-
-typedef struct elf_internal_ehdr {
-	unsigned char	e_ident[EI_NIDENT];   	/* ELF "magic number" */
-	uint32_t	e_entry;	/* Entry point virtual address */
-	uint32_t	e_phoff;	/* Program header table file offset */
-	uint32_t   e_shoff;     	/* Section header table file offset */
-	uint32_t   e_version;     	/* Identifies object file version */
-	uint32_t	e_flags;       	/* Processor-specific flags */
-	uint16_t	e_type;	       	/* Identifies object file type */
-	uint16_t	e_machine;     	/* Specifies required architecture */
-	uint16_t	e_ehsize;      	/* ELF header size in bytes */
-	uint16_t	e_phentsize;   	/* Program header table entry size */
-	uint16_t	e_phnum;       	/* Program header table entry count */
-	uint16_t	e_shentsize;   	/* Section header table entry size */
-	uint16_t	e_shnum;       	/* Section header table entry count */
-	uint16_t	e_shstrndx;    	/* Section header string table index */
-} Elf_Internal_Ehdr;
-
-
-typedef struct {
-	unsigned char	e_ident[16];   	/* ELF "magic number" */
-	unsigned char	e_type[2];     	/* Identifies object file type */
-	unsigned char	e_machine[2];  	/* Specifies required architecture */
-	unsigned char	e_version[4];  	/* Identifies object file version */
-	unsigned char	e_entry[4];    	/* Entry point virtual address */
-	unsigned char	e_phoff[4];    	/* Program header table file offset */
-	unsigned char	e_shoff[4];    	/* Section header table file offset */
-	unsigned char	e_flags[4];    	/* Processor-specific flags */
-	unsigned char	e_ehsize[2];   	/* ELF header size in bytes */
-	unsigned char	e_phentsize[2];	/* Program header table entry size */
-	unsigned char	e_phnum[2];    	/* Program header table entry count */
-	unsigned char	e_shentsize[2];	/* Section header table entry size */
-	unsigned char	e_shnum[2];    	/* Section header table entry count */
-	unsigned char	e_shstrndx[2]; 	/* Section header string table index */
-} Elf32_External_Ehdr;
-
-typedef struct elf_internal_shdr {
-	unsigned int	sh_name;       	/* Section name, index in string tbl */
-	unsigned int	sh_type;       	/* Type of section */
-	uint32_t	sh_flags;      	/* Miscellaneous section attributes */
-	uint32_t    sh_addr;      	/* Section virtual addr at execution */
-	uint32_t	sh_size;       	/* Size of section in bytes */
-	uint32_t	sh_entsize;    	/* Entry size if section holds table */
-	uint32_t	sh_link;       	/* Index of another section */
-	uint32_t	sh_info;       	/* Additional section information */
-	int32_t 	sh_offset;     	/* Section file offset */
-	unsigned int	sh_addralign;  	/* Section alignment */
-	
-	/* The internal rep also has some cached info associated with it. 
-	   asection *	bfd_section;		Associated BFD section. 
-	   PTR		contents;		Section contents.  */
-} Elf_Internal_Shdr;
-
-typedef struct {
-	unsigned char	sh_name[4];    	/* Section name, index in string tbl */
-	unsigned char	sh_type[4];    	/* Type of section */
-	unsigned char	sh_flags[4];   	/* Miscellaneous section attributes */
-	unsigned char	sh_addr[4];    	/* Section virtual addr at execution */
-	unsigned char	sh_offset[4];  	/* Section file offset */
-	unsigned char	sh_size[4];    	/* Size of section in bytes */
-	unsigned char	sh_link[4];    	/* Index of another section */
-	unsigned char	sh_info[4];    	/* Additional section information */
-	unsigned char	sh_addralign[4];/* Section alignment */
-	unsigned char	sh_entsize[4]; 	/* Entry size if section holds table */
-} Elf32_External_Shdr;
-
-typedef struct elf_internal_sym {
-	uint32_t st_value;        	/* Value of the symbol */
-	uint32_t st_size;	        /* Associated symbol size */
-	uint32_t	st_name;       	/* Symbol name, index in string tbl */
-	unsigned char	st_info;       	/* Type and binding attributes */
-	unsigned char	st_other;      	/* No defined meaning, 0 */
-	uint16_t st_shndx;       	/* Associated section index */
-} Elf_Internal_Sym;
-
-typedef struct {
-	unsigned char	st_name[4];    	/* Symbol name, index in string tbl */
-	unsigned char	st_value[4];   	/* Value of the symbol */
-	unsigned char	st_size[4];    	/* Associated symbol size */
-	unsigned char	st_info[1];    	/* Type and binding attributes */
-	unsigned char	st_other[1];   	/* No defined meaning, 0 */
-	unsigned char	st_shndx[2];   	/* Associated section index */
-} Elf32_External_Sym;
-
-struct FnInfo {
-	char m_fnName[256];
-	uint32_t m_timesCalled;
-	uint32_t m_totalTimeTaken;
-	uint32_t m_maxTimeTaken;
-	uint32_t m_numCalledFromThread;
-	uint32_t m_maxBlockedTime;
-	const char   *m_lastQpoll; 
-	const char   *m_prevQpoll; 
-	
-
-	int64_t     m_startTimeLocal;
-	int64_t     m_startTime;
-	int64_t     m_lastPauseTime;
-	int32_t          m_inFunction;
-};
-
 
-struct QuickPollInfo {
-	const char *m_caller;
-	int32_t        m_lineno;
-	const char *m_last;
-	int32_t        m_lastlineno;
-	int32_t        m_timeAcc;
-	int32_t        m_maxTime;
-	int32_t        m_times;
-};
+// frames kept of a sampled stack, the outermost ones are cut off
+#define MAX_PROFILER_FRAMES 48
 
-struct HitEntry {
-	char *funcName;
-	char *file;
-	uint32_t fileHash;
-	uint32_t line;
-	uint32_t numHits;
-	uint32_t numHitsPerFunc;
-	uint32_t address;
-	uint32_t baseAddress;
-	uint32_t missedQuickPolls;
-	uint32_t missedQuickPollsPerFunc;
-};
+// distinct stacks we count, samples of other stacks are dropped
+#define MAX_PROFILER_STACKS 8192
 
-class FrameTrace {
-	public:
-		FrameTrace();
-		~FrameTrace();
-		FrameTrace *set(const uint32_t addr);
-		FrameTrace *add(const uint32_t baseAddr);
-		void dump(	SafeBuf *out,
-				const uint32_t level = 0,
-				uint32_t printStart = 0) const;
-		uint32_t getPrintLen(const uint32_t level = 0) const;
-		uint32_t address;
-		static const uint16_t MAX_CHILDREN = 64;
-		FrameTrace *m_children[MAX_CHILDREN];
-		uint32_t m_numChildren;
-		uint32_t hits;
-		uint32_t missQuickPoll;
-};
+#define DEFAULT_PROFILER_HZ 199
 
 class Profiler {
  public:
 	Profiler();
 	~Profiler();
 
+	// stop and free the samples and the symbols
 	bool reset();
-	bool init();
-
-	bool addQuickPoll(int64_t took, const char* caller);
-	bool startTimer(int32_t address, const char* caller);
-	bool pause(const char *caller, int32_t lineno, int32_t took);
-	bool unpause();
-
-	//This function should get the function name from nm / addr2line
-	bool endTimer(int32_t address, 
-		      const char *caller,
-		      bool isThread=false);
-
-	bool printRealTimeInfo(SafeBuf *sb, const char *coll);
-	void resetLastQpoll() {m_lastQpoll = "main loop"; m_lastQpollLine =0;}
-
-	char *getFnName(PTRTYPE address,int32_t *nameLen=NULL);
 
-	//Functions for reading the symbol table of gb,
-	//which is a 32-bit ELF file. These functions are 
-	//a customized version of readelf program, found in
-	//GNU binutils, and works for 32-bit ELF files.
-	bool readSymbolTable();
-	static FrameTrace *getFrameTrace( 	void **trace,
-						const uint32_t numFrames);
+	// . start sampling "hz" times per second of cpu time
+	// . the samples of the previous run are cleared
+	bool startRealTimeProfiler ( int32_t hz = DEFAULT_PROFILER_HZ );
 
-	static FrameTrace *updateRealTimeData( 	void **trace,
-						const uint32_t numFrames,
-						uint32_t **ptr);
+	// . stop sampling, the samples are kept for printing unless !keepData
+	void stopRealTimeProfiler ( bool keepData );
 
-	static void checkMissedQuickPoll( 	FrameTrace *frame,
-						const uint32_t stackPtr,
-						uint32_t *ptr);
+	// . called from the SIGPROF handler with its ucontext_t
+	// . async-signal-safe
+	void getStackFrame ( void *context );
 
-	void getStackFrame();
+	// the function "address" is in, NULL if unknown
+	const char *getFnName ( uint64_t address , int32_t *nameLen = NULL );
 
-	void startRealTimeProfiler();
+	// "main;fn1;fn2 <count>" lines, one per distinct stack
+	bool printCollapsedStacks ( SafeBuf *sb );
 
-	void stopRealTimeProfiler(bool keepData);
+	// the samples as nested divs, the roots on top
+	bool printFlameGraph ( SafeBuf *sb );
 
-	void cleanup();
-	
-	FrameTrace *getNewFrameTrace(const uint32_t addr);
+	int64_t getNumSamples ( ) const { return m_numSamples; }
+	int64_t getNumDropped ( ) const { return m_numDropped; }
+	int32_t getHz ( ) const { return m_hz; }
+	int64_t getStartTime ( ) const { return m_startTime; }
 
-	bool m_realTimeProfilerRunning;
+	std::atomic<bool> m_realTimeProfilerRunning;
 
-	SafeBuf m_ipBuf;
+ private:
+	Profiler(const Profiler&);
+	Profiler& operator=(const Profiler&);
 
-protected:
-	bool processSymbolTable (FILE *file);
+	struct Stack {
+		// 0 if free, 1 while being filled in, else the hash of the frames
+		std::atomic<uint64_t> m_hash;
+		std::atomic<uint32_t> m_count;
+		int32_t  m_numFrames;
+		bool     m_isMainThread;
+		// return addresses, innermost first
+		uint64_t m_frames[MAX_PROFILER_FRAMES];
+	};
 
-	bool processSectionHeaders (FILE * file);
+	struct Symbol {
+		uint64_t m_start;
+		uint64_t m_end;
+		int32_t  m_nameOffset; // into m_symbolNames
+	};
 
-	bool get32bitSectionHeaders (FILE * file);
+	// add the symbols of the executable and every shared library
+	bool loadSymbols ( );
+	bool loadSymbols ( const char *filename , uint64_t base );
 
-	bool getFileHeader (FILE * file);
+	// "[libc.so.6]" if "address" is in the code of a loaded object
+	const char *getObjectName ( uint64_t address );
 
-	//bool fnReset (HashTableT<uint32_t, FnInfo*> *m_fn);
-	
-	FILE *m_file;
-	char *m_stringTable;
-	int32_t m_stringTableSize;
+	// "a;b;c" of the stack, outermost first
+	void getStackString ( const Stack *stack , SafeBuf *sb );
 
-	Elf_Internal_Ehdr       m_elfHeader;
-	Elf_Internal_Shdr*     m_sectionHeaders;
+	Stack  *m_stacks;
+	int64_t m_startTime;
+	int32_t m_hz;
 
-	Elf_Internal_Sym* get32bitElfSymbols (FILE *file,
-					      uint32_t offset,
-					      uint32_t number);
+	std::atomic<int64_t> m_numSamples;
+	std::atomic<int64_t> m_numDropped;
 
-	uint32_t getByte (unsigned char * field,int size);
-
-	//HashTableT<uint32_t, FnInfo> m_fn;
-	//HashTableT<uint32_t, FnInfo> m_fnTmp[11];
-	//HashTableT<uint32_t, FnInfo*> m_activeFns;
-	//HashTableT<uint32_t, QuickPollInfo*> m_quickpolls;
-
-	// IP (Instruction Pointer) addresses, force to 64 bits
-	//HashTableX m_ipCountTable;
-	//SafeBuf m_quickpollMissBuf;
-
-	HashTableX m_fn;
-	HashTableX m_fnTmp[11];
-	HashTableX m_activeFns;
-	HashTableX m_quickpolls;
-
-	int32_t m_totalFrames;
-
-	const char* m_lastQpoll;
-	int32_t m_lastQpollLine;
-	QuickPollInfo m_quickPollInfos[512];
-	int32_t          m_lastQPUsed;
-	
-	uint64_t m_fnTime[11];
- public://private:
-	// Realtime profiler stuff
-	uint32_t getFuncBaseAddr(const uint32_t address);
-	uint32_t getFuncBaseAddr(const char *funcName);
-	static int rtDataLocationCmp(const void *A, const void *B);
-	static int rtHitCmp(const void *A, const void *B);
-	static int rtFuncHitCmp(const void *A, const void *B);
-	static int rtAddressCmp(const void *A, const void *B);
-	static int rtMissedQuickPolls(const void *A, const void *B);
-	static int rtMissedQuickPollPerFunc(const void *A, const void *B);
-	void sortRealTimeData(const uint8_t type, const uint32_t num);
-	uint32_t rtNumEntries;
-	HitEntry *hitEntries;
-	uint32_t *m_addressMap;
-	uint32_t m_addressMapSize;
-	uint32_t m_lastAddressMapIndex;
-	FrameTrace *m_rootFrame;
-	uint32_t m_lastDeltaAddress;
-	uint64_t m_lastDeltaAddressTime;
-	static const uint32_t MAX_FRAME_TRACES = 1024 * 64;
-	FrameTrace *m_frameTraces;
-	uint32_t m_numUsedFrameTraces;
+	std::vector<Symbol> m_symbols;
+	std::vector<Symbol> m_objects;
+	SafeBuf             m_symbolNames;
+	bool                m_symbolsLoaded;
 };
 
 extern Profiler g_profiler;
 
-
 #endif // GB_PROFILER_H
@@ -0,0 +1,287 @@
+#include "gb-include.h"
+
+#include "QueryTrace.h"
+#include "Conf.h"
+#include "Hostdb.h"
+#include "Pages.h"
+
+static const char * const s_spanNames[] = {
+	"query",
+	"msg3a",
+	"shard",
+	"msg39",
+	"msg2",
+	"msg5",
+	"intersect",
+	"msg51",
+	"summaries",
+	"msg21",
+	"summary"
+};
+static_assert(sizeof(s_spanNames)/sizeof(s_spanNames[0])==span_end, "s_spanNames does not match query_span_t");
+
+// what the arg of a span is, NULL if it has none
+static const char * const s_argNames[] = {
+	NULL,
+	NULL,
+	"shard",
+	"splits",
+	"split",
+	"term",
+	"split",
+	"docids",
+	"shard",
+	"docids",
+	"docid"
+};
+static_assert(sizeof(s_argNames)/sizeof(s_argNames[0])==span_end, "s_argNames does not match query_span_t");
+
+static const char * const s_spanColors[] = {
+	"8220ff",  // query
+	"b58869",  // msg3a
+	"ff00ff",  // shard
+	"753d30",  // msg39
+	"ffff00",  // msg2
+	"aaaa00",  // msg5
+	"00ff00",  // intersect
+	"00ffff",  // msg51
+	"ff00ff",  // summaries
+	"0000b0",  // msg21
+	"0000ff"   // summary
+};
+static_assert(sizeof(s_spanColors)/sizeof(s_spanColors[0])==span_end, "s_spanColors does not match query_span_t");
+
+// the slow traces we keep, the oldest is overwritten
+struct KeptTrace {
+	int64_t  m_traceId;
+	int64_t  m_time;       // when it finished, ms since the epoch
+	int32_t  m_tookMs;
+	int32_t  m_numDropped;
+	SafeBuf  m_query;
+	SafeBuf  m_spans;
+};
+
+static KeptTrace s_kept[QUERY_TRACE_MAX_KEPT];
+static int32_t   s_numKept  = 0;
+static int32_t   s_nextKept = 0;
+
+
+QueryTrace::QueryTrace ( ) {
+	m_spans.setLabel ( "qtrace" );
+	reset();
+}
+
+void QueryTrace::reset ( ) {
+	m_traceId    = 0;
+	m_startUs    = 0;
+	m_maxSpans   = QUERY_TRACE_MAX_SPANS;
+	m_numDropped = 0;
+	m_spans.purge();
+}
+
+void QueryTrace::start ( int64_t traceId, query_span_t type, int64_t arg ) {
+	reset();
+	m_traceId = traceId;
+	m_startUs = gettimeofdayInMicroseconds();
+	addSpan ( type, 0, arg, m_startUs, m_startUs );
+}
+
+void QueryTrace::endRootSpan ( ) {
+	if ( m_spans.length() < (int32_t)sizeof(QuerySpan) ) return;
+	QuerySpan *root = (QuerySpan *)m_spans.getBufStart();
+	root->m_durationUs = (int32_t)( gettimeofdayInMicroseconds() - m_startUs );
+}
+
+int64_t QueryTrace::sampleTraceId ( bool force ) {
+	if ( ! force ) {
+		if ( g_conf.m_queryTraceSamplePercent <= 0.0 ) return 0;
+		if ( rand() % 1000000 >= g_conf.m_queryTraceSamplePercent * 10000.0 )
+			return 0;
+	}
+	int64_t traceId = ( (int64_t)rand() << 32 ) ^ (int64_t)rand() ^
+		(int64_t)gettimeofdayInMicroseconds();
+	if ( traceId == 0 ) traceId = 1;
+	return traceId;
+}
+
+void QueryTrace::addSpan ( query_span_t type, int32_t depth, int64_t arg,
+			   uint64_t startUs, uint64_t endUs ) {
+	if ( ! m_traceId ) return;
+	if ( getNumSpans() >= m_maxSpans ) {
+		m_numDropped++;
+		return;
+	}
+	QuerySpan span;
+	memset ( &span, 0, sizeof(span) );
+	span.m_startUs    = (int64_t)( startUs - m_startUs );
+	span.m_arg        = arg;
+	span.m_durationUs = endUs > startUs ? (int32_t)( endUs - startUs ) : 0;
+	span.m_hostId     = g_hostdb.m_hostId;
+	span.m_type       = type;
+	span.m_depth      = depth;
+	if ( ! m_spans.safeMemcpy ( &span, sizeof(span) ) )
+		m_numDropped++;
+}
+
+void QueryTrace::addReplySpans ( const char *spans, int32_t size,
+				 uint64_t sendUs, uint64_t replyUs, int32_t depth ) {
+	if ( ! m_traceId ) return;
+	int32_t n = size / sizeof(QuerySpan);
+	if ( n <= 0 ) return;
+	// . the first span is the root span of the host, how long it had
+	//   the request
+	// . we put it in the middle of the round trip
+	const QuerySpan *root = (const QuerySpan *)spans;
+	int64_t rtt = (int64_t)( replyUs - sendUs );
+	int64_t offset = (int64_t)( sendUs - m_startUs );
+	if ( rtt > root->m_durationUs ) offset += ( rtt - root->m_durationUs ) / 2;
+	for ( int32_t i = 0 ; i < n ; i++ ) {
+		if ( getNumSpans() >= m_maxSpans ) {
+			m_numDropped += n - i;
+			return;
+		}
+		QuerySpan span;
+		memcpy ( &span, spans + i * sizeof(QuerySpan), sizeof(span) );
+		if ( span.m_type < 0 || span.m_type >= span_end ) continue;
+		span.m_startUs += offset;
+		span.m_depth   += depth;
+		if ( ! m_spans.safeMemcpy ( &span, sizeof(span) ) ) {
+			m_numDropped += n - i;
+			return;
+		}
+	}
+}
+
+void QueryTrace::finish ( const char *query ) {
+	if ( ! m_traceId ) return;
+	endRootSpan();
+	int32_t tookMs = ((QuerySpan *)m_spans.getBufStart())->m_durationUs / 1000;
+	if ( tookMs >= g_conf.m_queryTraceMinTime ) {
+		KeptTrace *kt = &s_kept[s_nextKept];
+		s_nextKept = ( s_nextKept + 1 ) % QUERY_TRACE_MAX_KEPT;
+		if ( s_numKept < QUERY_TRACE_MAX_KEPT ) s_numKept++;
+		kt->m_traceId    = m_traceId;
+		kt->m_time       = gettimeofdayInMilliseconds();
+		kt->m_tookMs     = tookMs;
+		kt->m_numDropped = m_numDropped;
+		kt->m_query.setLabel ( "qtracekq" );
+		kt->m_query.purge();
+		kt->m_query.safeStrcpy ( query ? query : "" );
+		kt->m_query.nullTerm();
+		kt->m_spans.setLabel ( "qtraceks" );
+		kt->m_spans.purge();
+		kt->m_spans.safeMemcpy ( &m_spans );
+		log ( LOG_INFO, "query: trace %016" PRIx64" of q=%s took %" PRId32" ms",
+		      m_traceId, query ? query : "", tookMs );
+	}
+	reset();
+}
+
+void QueryTrace::resetKept ( ) {
+	for ( int32_t i = 0 ; i < QUERY_TRACE_MAX_KEPT ; i++ ) {
+		s_kept[i].m_query.purge();
+		s_kept[i].m_spans.purge();
+	}
+	s_numKept  = 0;
+	s_nextKept = 0;
+}
+
+const char *QueryTrace::getSpanName ( int32_t type ) {
+	if ( type < 0 || type >= span_end ) return "?";
+	return s_spanNames[type];
+}
+
+// one row per span, the bars are placed on the time line of the root span
+static void printWaterfall ( SafeBuf *sb, const KeptTrace *kt ) {
+	const QuerySpan *spans = (const QuerySpan *)kt->m_spans.getBufStart();
+	int32_t n = kt->m_spans.length() / sizeof(QuerySpan);
+	double total = n > 0 ? spans[0].m_durationUs : 0;
+	if ( total <= 0 ) total = 1;
+
+	sb->safePrintf ( "<tr bgcolor=#%s><td colspan=5><b>q=", DARK_BLUE );
+	sb->htmlEncode ( kt->m_query.getBufStart() );
+	sb->safePrintf ( "</b> &nbsp; trace %016" PRIx64" took %" PRId32" ms, "
+			 "%" PRId32" spans"
+			 , kt->m_traceId , kt->m_tookMs , n );
+	if ( kt->m_numDropped )
+		sb->safePrintf ( ", %" PRId32" dropped", kt->m_numDropped );
+	sb->safePrintf ( "</td></tr>"
+			 "<tr class=hdrow><td><b>span</b></td><td><b>host</b></td>"
+			 "<td><b>start ms</b></td><td><b>ms</b></td>"
+			 "<td width=60%%></td></tr>" );
+
+	for ( int32_t i = 0 ; i < n ; i++ ) {
+		const QuerySpan *s = &spans[i];
+		double left  = s->m_startUs * 100.0 / total;
+		double width = s->m_durationUs * 100.0 / total;
+		if ( left < 0.0 ) left = 0.0;
+		if ( left > 100.0 ) left = 100.0;
+		if ( left + width > 100.0 ) width = 100.0 - left;
+		sb->safePrintf ( "<tr bgcolor=#%s>"
+				 "<td style=\"padding-left:%" PRId32"px;white-space:nowrap;\">%s"
+				 , LIGHT_BLUE
+				 , 4 + 12 * (int32_t)s->m_depth
+				 , s_spanNames[s->m_type] );
+		if ( s_argNames[s->m_type] )
+			sb->safePrintf ( " %s=%" PRId64, s_argNames[s->m_type], s->m_arg );
+		sb->safePrintf ( "</td><td>%" PRId32"</td>"
+				 "<td>%.3f</td><td>%.3f</td>"
+				 "<td><div style=\"position:relative;height:12px;\">"
+				 "<div style=\"position:absolute;left:%.3f%%;width:%.3f%%;"
+				 "min-width:1px;height:12px;background:#%s;\"></div>"
+				 "</div></td></tr>\n"
+				 , s->m_hostId
+				 , s->m_startUs / 1000.0
+				 , s->m_durationUs / 1000.0
+				 , left , width
+				 , s_spanColors[s->m_type] );
+	}
+}
+
+bool QueryTrace::printTraces ( SafeBuf *sb, const char *coll, int64_t traceId ) {
+	sb->safePrintf ( "<br><br>"
+			 "<table %s>"
+			 "<tr class=hdrow><td colspan=5><b>Slow query traces</b></td></tr>"
+			 "<tr bgcolor=#%s><td colspan=5>"
+			 "%.3f%% of the queries are traced. "
+			 "The traces of the ones taking at least %" PRId32" ms are kept."
+			 "</td></tr>"
+			 , TABLE_STYLE , LIGHT_BLUE
+			 , (double)g_conf.m_queryTraceSamplePercent
+			 , g_conf.m_queryTraceMinTime );
+
+	if ( s_numKept == 0 ) {
+		sb->safePrintf ( "<tr bgcolor=#%s><td colspan=5><i>No traces.</i>"
+				 "</td></tr></table>", LIGHT_BLUE );
+		return true;
+	}
+
+	// the waterfall of the one they picked
+	for ( int32_t i = 0 ; traceId && i < s_numKept ; i++ ) {
+		if ( s_kept[i].m_traceId != traceId ) continue;
+		printWaterfall ( sb, &s_kept[i] );
+		break;
+	}
+
+	// newest first
+	sb->safePrintf ( "<tr class=hdrow><td><b>trace</b></td><td><b>age</b></td>"
+			 "<td><b>ms</b></td><td><b>spans</b></td>"
+			 "<td><b>query</b></td></tr>" );
+	int64_t now = gettimeofdayInMilliseconds();
+	for ( int32_t j = 1 ; j <= s_numKept ; j++ ) {
+		int32_t i = ( s_nextKept - j + QUERY_TRACE_MAX_KEPT ) % QUERY_TRACE_MAX_KEPT;
+		const KeptTrace *kt = &s_kept[i];
+		sb->safePrintf ( "<tr bgcolor=#%s>"
+				 "<td><a href=/admin/perf?c=%s&qtrace=%" PRId64">"
+				 "%016" PRIx64"</a></td>"
+				 "<td>%" PRId64" s</td><td>%" PRId32"</td><td>%" PRId32"</td><td>"
+				 , LIGHT_BLUE
+				 , coll , kt->m_traceId , kt->m_traceId
+				 , ( now - kt->m_time ) / 1000
+				 , kt->m_tookMs
+				 , kt->m_spans.length() / (int32_t)sizeof(QuerySpan) );
+		sb->htmlEncode ( kt->m_query.getBufStart() );
+		sb->safePrintf ( "</td></tr>\n" );
+	}
+	return sb->safePrintf ( "</table>" );
+}
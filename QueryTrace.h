@@ -0,0 +1,113 @@
+// . tracing of sampled queries across the hosts they touch
+// . Msg40 starts a trace for a sampled query and puts its id in the
+//   Msg39Request and in the Msg20Requests of its summaries
+// . the hosts handling them time their work in spans relative to when the
+//   request came in and send the spans back in their reply
+// . Msg40 places the spans of a reply in the middle of the round trip of
+//   the request, so the clocks of the hosts do not have to agree, and keeps
+//   the traces of the slow queries for the waterfall view of the perf page
+
+#ifndef GB_QUERYTRACE_H
+#define GB_QUERYTRACE_H
+
+#include <inttypes.h>
+#include "SafeBuf.h"
+
+// most spans of a trace, the ones after are dropped
+#define QUERY_TRACE_MAX_SPANS 8192
+
+// most spans a host sends back in a reply
+#define QUERY_TRACE_MAX_REPLY_SPANS 256
+
+// the slow traces we keep for the perf page
+#define QUERY_TRACE_MAX_KEPT 32
+
+enum query_span_t {
+	span_query = 0,   // the whole query (Msg40)
+	span_msg3a,       // getting the docids of all shards
+	span_shard,       // round trip of the msg39 request to a shard
+	span_msg39,       // handling the msg39 request
+	span_msg2,        // the termlists of one docid split
+	span_msg5,        // reading one termlist
+	span_intersect,   // intersecting the termlists of one docid split
+	span_msg51,       // the clusterdb recs of the top docids
+	span_summaries,   // round trip of a batch of summary requests
+	span_msg21,       // handling the batch of summary requests
+	span_summary,     // making one summary
+	span_end
+};
+
+class QuerySpan {
+public:
+	int64_t m_startUs;    // from the start of the trace
+	int64_t m_arg;        // shard, docid split, term number or docid
+	int32_t m_durationUs;
+	int32_t m_hostId;
+	int16_t m_type;       // query_span_t
+	int16_t m_depth;      // 0 for the root span, +1 for each nesting
+	int32_t m_reserved;
+};
+
+class QueryTrace {
+public:
+	QueryTrace();
+
+	void reset();
+
+	// . start a trace at the local "now", "traceId" must not be 0
+	// . the first span is the root span of "type" for all of the trace,
+	//   endRootSpan() sets how long it took
+	void start ( int64_t traceId, query_span_t type, int64_t arg );
+	void endRootSpan ( );
+
+	// . a sampled query gets a random trace id, 0 if not sampled
+	// . g_conf.m_queryTraceSamplePercent of the queries are sampled
+	static int64_t sampleTraceId ( bool force );
+
+	bool    isStarted  ( ) const { return m_traceId != 0; }
+	int64_t getTraceId ( ) const { return m_traceId; }
+
+	// when the trace started, in local microseconds
+	uint64_t getStartUs ( ) const { return m_startUs; }
+
+	// add a span that ran from "startUs" to "endUs" of the local clock
+	void addSpan ( query_span_t type, int32_t depth, int64_t arg,
+		       uint64_t startUs, uint64_t endUs );
+
+	// . add the spans of a reply to a request we sent at "sendUs" and got
+	//   the reply of at "replyUs", both of the local clock
+	// . they are nested "depth" deeper than in the reply
+	void addReplySpans ( const char *spans, int32_t size,
+			     uint64_t sendUs, uint64_t replyUs, int32_t depth );
+
+	// the spans to send back in a reply
+	const char *getSpans     ( ) const { return m_spans.getBufStart(); }
+	int32_t     getSpansSize ( ) const { return m_spans.length(); }
+	int32_t     getNumSpans  ( ) const { return m_spans.length() / (int32_t)sizeof(QuerySpan); }
+	int32_t     getNumDropped( ) const { return m_numDropped; }
+
+	// limit the spans to "maxSpans", like for a reply
+	void setMaxSpans ( int32_t maxSpans ) { m_maxSpans = maxSpans; }
+
+	// . end the trace of "query" and keep it for the perf page if it took
+	//   at least g_conf.m_queryTraceMinTime ms
+	// . resets the trace
+	void finish ( const char *query );
+
+	// a table of the kept traces, or the waterfall of "traceId"
+	static bool printTraces ( SafeBuf *sb, const char *coll, int64_t traceId );
+
+	static const char *getSpanName ( int32_t type );
+
+	// forget the kept traces
+	static void resetKept ( );
+
+private:
+	int64_t  m_traceId;
+	uint64_t m_startUs;
+	int32_t  m_maxSpans;
+	int32_t  m_numDropped;
+	SafeBuf  m_spans;
+};
+
+#endif // GB_QUERYTRACE_H
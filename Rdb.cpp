@@ -17,6 +17,17 @@
 #include "Doledb.h"
 #include "hash.h"
 #include "JobScheduler.h"
+#include "TermListCache.h"
+
+static void walCommitWrapper ( int fd , void *state );
+static void walReplayWrapper ( int fd , void *state );
+
+// how often the sleep callback checks if the write-ahead log is due for
+// a commit, the interval itself is g_conf.m_rdbWalSyncInterval
+static const int32_t s_walCommitTick = 10;
+
+// commit the write-ahead log early if this much is buffered
+static const int32_t s_maxWalBuffer = 4*1024*1024;
 
 Rdb::Rdb ( ) {
 
@@ -30,6 +41,8 @@ Rdb::Rdb ( ) {
 	m_collectionlessBase = NULL;
 	m_initialized = false;
 	m_numMergesOut = 0;
+	m_walRegistered = false;
+	m_walReplayRegistered = false;
 	//memset ( m_bases , 0 , sizeof(RdbBase *) * MAX_COLLS );
 	reset();
 }
@@ -67,6 +80,18 @@ void Rdb::reset ( ) {
 	m_isReallyClosing = false;
 	m_registered      = false;
 	m_lastTime        = 0LL;
+	if ( m_walRegistered )
+		g_loop.unregisterSleepCallback ( this , walCommitWrapper );
+	if ( m_walReplayRegistered )
+		g_loop.unregisterSleepCallback ( this , walReplayWrapper );
+	m_wal.reset();
+	m_useWal              = false;
+	m_walReplaying        = false;
+	m_walRegistered       = false;
+	m_walReplayRegistered = false;
+	m_lastWalCommit       = 0LL;
+	m_walCheckpointSeq    = 0;
+	m_walDumpIncomplete   = false;
 }
 
 Rdb::~Rdb ( ) {
@@ -237,6 +262,28 @@ bool Rdb::init ( const char     *dir                  ,
 		return false;
 	}
 
+	// . the secondary rdbs are rebuilt from scratch, doledb is never
+	//   dumped and statsdb is not added to with addList(), so they keep
+	//   saving their trees
+	// . look for segments even if the log is turned off, so one left over
+	//   from when it was on is replayed
+	if ( ! isSecondaryRdb() && m_rdbId != RDB_DOLEDB && m_rdbId != RDB_STATSDB ) {
+		if ( ! m_wal.init ( getDir() , m_dbname , m_ks ) ) {
+			log( LOG_ERROR, "db: Failed to init write-ahead log." );
+			return false;
+		}
+		m_useWal = g_conf.m_useRdbWal;
+	}
+
+	if ( m_useWal ) {
+		m_lastWalCommit = gettimeofdayInMilliseconds();
+		if ( ! g_loop.registerSleepCallback ( s_walCommitTick , this , walCommitWrapper , 0 ) ) {
+			log( LOG_ERROR, "db: Failed to register write-ahead log callback." );
+			return false;
+		}
+		m_walRegistered = true;
+	}
+
 	m_initialized = true;
 
 	// success
@@ -363,6 +410,7 @@ bool Rdb::updateToRebuildFiles ( Rdb *rdb2 , char *coll ) {
 	// clean out tree, newly rebuilt rdb does not have any data in tree
 	if ( m_useTree ) m_tree.delColl ( collnum );
 	else             m_buckets.delColl( collnum );
+	if ( m_useWal  ) m_wal.addDelColl ( collnum );
 	// reset our cache
 	//m_cache.clear ( collnum );
 
@@ -483,6 +531,7 @@ bool Rdb::resetBase ( collnum_t collnum ) {
 	RdbBase *base = cr->getBasePtr (m_rdbId);
 	if ( ! base ) return true;
 	base->reset();
+	if ( m_rdbId == RDB_POSDB ) g_termListCache.removeCollection ( collnum );
 	return true;
 }
 
@@ -548,6 +597,9 @@ bool Rdb::deleteColl ( collnum_t collnum , collnum_t newCollnum ) {
 	// remove these collnums from tree
 	if(m_useTree) m_tree.delColl    ( collnum );
 	else          m_buckets.delColl ( collnum );
+	if ( m_useWal ) m_wal.addDelColl ( collnum );
+
+	if ( m_rdbId == RDB_POSDB ) g_termListCache.removeCollection ( collnum );
 
 	// . close all files, set m_numFiles to 0 in RdbBase
 	// . TODO: what about outstanding merge or dump operations?
@@ -749,6 +801,19 @@ bool Rdb::close ( void *state , void (* callback)(void *state ), bool urgent ,
 		}
 	}
 
+	// everything in the tree is in the write-ahead log or the rdb files
+	if ( m_useWal ) {
+		if ( ! m_wal.commit ( false ) ) {
+			log( LOG_WARN, "db: Failed to commit %s write-ahead log: %s.",
+			     m_dbname, mstrerror( g_errno ) );
+			g_errno = 0;
+		}
+		if ( m_useTree ) m_tree.m_needsSave = false;
+		else             m_buckets.setNeedsSave ( false );
+		doneSaving();
+		return true;
+	}
+
 	// save it using a thread?
 	bool useThread ;
 	if      ( m_urgent          ) useThread = false;
@@ -822,7 +887,16 @@ void Rdb::doneSaving ( ) {
 	if ( m_dbname == NULL || m_dbname[0]=='\0' ) {
 		g_process.shutdownAbort(true); }
 	// display any error, if any, otherwise prints "Success"
-	logf(LOG_INFO,"db: Successfully saved %s-saved.dat.", m_dbname);
+	if ( m_useWal ) {
+		logf(LOG_INFO,"db: Successfully committed %s write-ahead log.", m_dbname);
+	} else {
+		logf(LOG_INFO,"db: Successfully saved %s-saved.dat.", m_dbname);
+		// the tree has what was replayed from a write-ahead log left
+		// over from when it was turned on, so that can go now
+		if ( m_wal.getNumSegments() > 0 && ! m_walReplaying ) {
+			m_wal.removeSegmentsBefore ( m_wal.getCurrentSeq() );
+		}
+	}
 
 	// i moved the rename to within the thread
 	// create the rdb file name we dumped to: "saving"
@@ -870,16 +944,46 @@ bool Rdb::saveTree ( bool useThread ) {
 		log( LOG_DEBUG, "db: saving buckets %s", dbn );
 	}
 
+	// . no need to rewrite the whole tree if we have a write-ahead log,
+	//   everything in the tree is in the log or in the rdb files
+	if ( m_useWal ) {
+		if ( ! m_wal.commit ( useThread ) ) {
+			log( LOG_WARN, "db: Failed to commit %s write-ahead log: %s.",
+			     dbn, mstrerror( g_errno ) );
+			return true;
+		}
+		if ( m_useTree ) m_tree.m_needsSave = false;
+		else             m_buckets.setNeedsSave ( false );
+		return true;
+	}
+
+	// . the tree has what was replayed from a write-ahead log left over
+	//   from when it was turned on. the old saved tree must stay what the
+	//   log segments are replayed on top of until they are removed, which
+	//   is when the next dump completes or after a save without a thread
+	bool hadWal = ( m_wal.getNumSegments() > 0 );
+	if ( hadWal && ( useThread || m_walReplaying ) ) {
+		log( LOG_DEBUG, "db: not saving %s until its replayed write-ahead log is checkpointed", dbn );
+		return true;
+	}
+
 	// . if RdbTree::m_needsSave is false this will return true
 	// . if RdbTree::m_isSaving  is true this will return false
 	// . returns false if blocked, true otherwise
 	// . sets g_errno on error
+	bool status;
 	if ( m_useTree ) {
-		return m_tree.fastSave ( getDir(), m_dbname, useThread, NULL, NULL );
+		status = m_tree.fastSave ( getDir(), m_dbname, useThread, NULL, NULL );
 	}
 	else {
-		return m_buckets.fastSave ( getDir(), useThread, NULL, NULL );
+		status = m_buckets.fastSave ( getDir(), useThread, NULL, NULL );
+	}
+
+	if ( hadWal && status && ! g_errno ) {
+		m_wal.removeSegmentsBefore ( m_wal.getCurrentSeq() );
 	}
+
+	return status;
 }
 
 bool Rdb::saveMaps () {
@@ -1156,6 +1260,21 @@ bool Rdb::dumpTree ( int32_t niceness ) {
 		}
 	}
 
+	// . start a new write-ahead log segment. what is in the older ones is
+	//   in the tree now and gets dumped, so they can go when we are done
+	// . not while replaying, the rest of the log is not in the tree yet
+	m_walCheckpointSeq  = 0;
+	m_walDumpIncomplete = false;
+	if ( m_wal.isInitialized() && ! m_walReplaying ) {
+		int32_t seq = m_wal.rotate();
+		if ( seq > 0 ) {
+			m_walCheckpointSeq = seq;
+		} else {
+			log( LOG_WARN, "db: Failed to start new %s write-ahead log segment: %s.",
+			     m_dbname, mstrerror( g_errno ) );
+		}
+	}
+
 	// loop through collections, dump each one
 	m_dumpCollnum = (collnum_t)-1;
 	// clear this for dumpCollLoop()
@@ -1207,6 +1326,7 @@ bool Rdb::dumpCollLoop ( ) {
 		}
 
 		log( LOG_ERROR, "build: Error dumping collection: %s.",mstrerror(g_errno));
+		m_walDumpIncomplete = true;
 		// . if we wrote nothing, remove the file
 		// . if coll was deleted under us, base will be NULL!
 		if ( base &&   (! base->getFile(m_fn)->doesExist() ||
@@ -1287,12 +1407,15 @@ bool Rdb::dumpCollLoop ( ) {
 			    "Need to wait for merge operation.",
 			    (int)m_dumpCollnum,m_dbname,base->getNumFiles());
 		s_flag++;
+		// the records stay in the tree, so keep them in the log
+		m_walDumpIncomplete = true;
 		goto loop;
 	}
 
 	// this file must not exist already, we are dumping the tree into it
 	m_fn = base->addNewFile ( id2 ) ;
 	if ( m_fn < 0 ) {
+		m_walDumpIncomplete = true;
 		return log( LOG_LOGIC, "db: rdb: Failed to add new file to dump %s: %s.", m_dbname, mstrerror( g_errno ) );
 	}
 
@@ -1484,6 +1607,25 @@ void Rdb::doneDumping ( ) {
 		m_mem.freeDumpedMem( &m_tree );
 	}
 
+	// . checkpoint the write-ahead log. everything in the segments before
+	//   the one started with the dump is in the rdb files now
+	// . so is everything in a tree saved before the log was used
+	if ( m_walCheckpointSeq > 0 && ! m_dumpErrno && ! m_walDumpIncomplete ) {
+		m_wal.removeSegmentsBefore ( m_walCheckpointSeq );
+		if ( m_useWal ) {
+			char filename[1024];
+			snprintf ( filename , sizeof(filename) , "%s/%s-saved.dat" , getDir() , m_dbname );
+			if ( ::unlink ( filename ) == 0 ) {
+				log( LOG_INFO, "db: Removed %s, it was dumped.", filename );
+			}
+			snprintf ( filename , sizeof(filename) , "%s/%s-buckets-saved.dat" , getDir() , m_dbname );
+			if ( ::unlink ( filename ) == 0 ) {
+				log( LOG_INFO, "db: Removed %s, it was dumped.", filename );
+			}
+		}
+	}
+	m_walCheckpointSeq = 0;
+
 	// . tell RdbDump it is done
 	// . we have to set this here otherwise RdbMem's memory ring buffer
 	//   will think the dumping is no longer going on and use the primary
@@ -1645,6 +1787,12 @@ bool Rdb::addList ( collnum_t collnum , RdbList *list, int32_t niceness/*, bool
 	if ( list->isExhausted() ) return true;
 	// sanity check
 	if ( list->m_ks != m_ks ) { g_process.shutdownAbort(true); }
+	// the rest of the write-ahead log goes into the tree first, otherwise
+	// it would override what is added now
+	if ( m_walReplaying ) {
+		g_errno = ETRYAGAIN;
+		return false;
+	}
 	// we now call getTimeGlobal() so we need to be in sync with host #0
 	if ( ! isClockInSync () ) {
 		// log("rdb: can not add data because clock not in sync with "
@@ -1776,6 +1924,16 @@ bool Rdb::addList ( collnum_t collnum , RdbList *list, int32_t niceness/*, bool
 			// stop it
 			m_inAddList = false;
 
+			// log the records that did make it into the tree
+			if ( m_useWal ) {
+				int32_t added = list->getListPtr() - list->getList();
+				int32_t saved = g_errno;
+				if ( ! m_wal.addList ( collnum, list->getList(), added, list->useHalfKeys() ) ) {
+					log( LOG_WARN, "db: Failed to add list to %s write-ahead log.", m_dbname );
+				}
+				g_errno = saved;
+			}
+
 			// discontinue adding any more of the list
 			return false;
 		}
@@ -1789,6 +1947,18 @@ bool Rdb::addList ( collnum_t collnum , RdbList *list, int32_t niceness/*, bool
 	// stop it
 	m_inAddList = false;
 
+	// . log the list, it is written and fsync'ed with the next commit
+	// . if a lot is buffered write it out now
+	if ( m_useWal ) {
+		if ( ! m_wal.addList ( collnum, list->getList(), list->getListSize(), list->useHalfKeys() ) ) {
+			log( LOG_WARN, "db: Failed to add list to %s write-ahead log.", m_dbname );
+		}
+		if ( m_wal.getBufferedBytes() >= s_maxWalBuffer ) {
+			commitWal();
+		}
+		g_errno = 0;
+	}
+
 	// if tree is >= 90% full dump it
 	if ( m_dump.isDumping() ) {
 		logTrace( g_conf.m_logTraceRdb, "END. %s: is already dumping. Returning true", m_dbname );
@@ -1820,6 +1990,148 @@ bool Rdb::addList ( collnum_t collnum , RdbList *list, int32_t niceness/*, bool
 	return true;
 }
 
+void walCommitWrapper ( int fd , void *state ) {
+	Rdb *THIS = (Rdb *)state;
+	THIS->commitWal();
+}
+
+void Rdb::commitWal ( ) {
+	if ( ! m_useWal ) return;
+	int64_t now = gettimeofdayInMilliseconds();
+	if ( now - m_lastWalCommit < g_conf.m_rdbWalSyncInterval &&
+	     m_wal.getBufferedBytes() < s_maxWalBuffer ) {
+		return;
+	}
+	m_lastWalCommit = now;
+	if ( ! m_wal.commit ( true ) ) {
+		log( LOG_WARN, "db: Failed to commit %s write-ahead log: %s.", m_dbname, mstrerror( g_errno ) );
+		g_errno = 0;
+	}
+}
+
+void walReplayWrapper ( int fd , void *state ) {
+	Rdb *THIS = (Rdb *)state;
+	THIS->replayWal();
+}
+
+void Rdb::replayWal ( ) {
+	if ( ! m_wal.isReplaying() ) return;
+
+	if ( ! m_walReplaying ) {
+		log( LOG_INFO, "db: Replaying write-ahead log of %s.", m_dbname );
+		m_walReplaying = true;
+	}
+
+	char      type;
+	char      flags;
+	collnum_t collnum;
+	char     *data;
+	int32_t   dataSize;
+	while ( m_wal.getReplayFrame ( &type , &flags , &collnum , &data , &dataSize ) ) {
+		// shutting down, the rest is replayed on the next start
+		if ( m_isClosing ) {
+			return;
+		}
+
+		if ( type == WAL_DEL_COLL ) {
+			if ( m_useTree ) m_tree.delColl    ( collnum );
+			else             m_buckets.delColl ( collnum );
+			m_wal.skipReplayFrame();
+			continue;
+		}
+
+		// skip collections deleted since
+		if ( type != WAL_ADD_LIST || collnum < 0 || collnum >= getNumBases() || ! getBase ( collnum ) ) {
+			m_wal.skipReplayFrame();
+			continue;
+		}
+
+		RdbList list;
+		list.set ( data, dataSize, data, dataSize, KEYMIN(), KEYMAX(), m_fixedDataSize,
+		           false, ( flags & WAL_HALF_KEYS ) != 0, m_ks );
+
+		// . wait for a dump to make room, like addList() does
+		// . add the whole frame again if only part of it got in, adding
+		//   a record twice does no harm
+		// . the buckets have no m_gettingList, they refuse adds while
+		//   they are dumped or saved instead
+		bool busy = m_useTree ? ( m_tree.m_gettingList != 0 )
+		                      : ( ! m_buckets.isWritable() || m_buckets.isSaving() );
+		bool tryAgain = false;
+		if ( busy ) {
+			tryAgain = true;
+		} else if ( ! hasRoom ( &list , 1 ) ) {
+			bool isEmpty = m_useTree ? ( m_tree.getNumUsedNodes() <= 0 ) : ( m_buckets.getNumKeys() <= 0 );
+			if ( isEmpty ) {
+				log( LOG_WARN, "db: %s write-ahead log has a list of %" PRId32" bytes that is too big to "
+				     "ever fit in memory, skipping it.", m_dbname, dataSize );
+				m_wal.skipReplayFrame();
+				continue;
+			}
+			dumpTree ( 1 );
+			tryAgain = true;
+		} else {
+			for ( ; ! list.isExhausted() ; list.skipCurrentRecord() ) {
+				char key[MAX_KEY_BYTES];
+				list.getCurrentKey ( key );
+				int32_t recSize = 0;
+				char *rec = NULL;
+				// negative keys have no data
+				if ( ! KEYNEG ( key ) ) {
+					recSize = list.getCurrentDataSize();
+					rec     = list.getCurrentData();
+				}
+				if ( ! addRecord ( collnum , key , rec , recSize , 0 ) ) {
+					break;
+				}
+			}
+			if ( ! list.isExhausted() ) {
+				if ( g_errno != ETRYAGAIN && g_errno != ENOMEM ) {
+					log( LOG_WARN, "db: Could not replay list from %s write-ahead log: %s.",
+					     m_dbname, mstrerror( g_errno ) );
+					g_errno = 0;
+					m_wal.skipReplayFrame();
+					continue;
+				}
+				if ( g_errno == ENOMEM ) {
+					dumpTree ( 1 );
+				}
+				tryAgain = true;
+			}
+		}
+
+		if ( tryAgain ) {
+			g_errno = 0;
+			if ( ! m_walReplayRegistered ) {
+				if ( ! g_loop.registerSleepCallback ( 1000 , this , walReplayWrapper ) ) {
+					log( LOG_ERROR, "db: Failed to register write-ahead log replay callback." );
+					return;
+				}
+				m_walReplayRegistered = true;
+			}
+			return;
+		}
+
+		m_wal.skipReplayFrame();
+	}
+
+	if ( m_walReplayRegistered ) {
+		g_loop.unregisterSleepCallback ( this , walReplayWrapper );
+		m_walReplayRegistered = false;
+	}
+	m_walReplaying = false;
+	g_errno = 0;
+
+	log( LOG_INFO, "db: Replayed %" PRId64" lists from write-ahead log of %s.",
+	     m_wal.getNumReplayedFrames(), m_dbname );
+
+	// with the log turned off get the replayed records into the rdb files
+	// so the old segments can go
+	if ( ! m_useWal ) {
+		dumpTree ( 1 );
+	}
+}
+
 bool Rdb::needsDump ( ) {
 	if ( m_mem.is90PercentFull () ) {
 		return true;
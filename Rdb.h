@@ -10,6 +10,7 @@
 #include "RdbMem.h"
 #include "RdbDump.h"
 #include "RdbBuckets.h"
+#include "RdbWal.h"
 
 bool makeTrashDir() ;
 
@@ -295,6 +296,16 @@ public:
 
 	bool needsDump ( );
 
+	// . replay the write-ahead log left over from the last run on top of
+	//   the saved tree. needs the rdb bases, so main.cpp calls it after
+	//   they were added
+	// . if there is no room in the tree it dumps and continues later
+	void replayWal ( );
+	bool isReplayingWal ( ) { return m_walReplaying; }
+
+	// group commit of the write-ahead log, called from a sleep callback
+	void commitWal ( );
+
 	// these are used for computing load on a machine
 	bool isMerging ( ) ;
 	bool isDumping ( ) { return m_dump.isDumping(); }
@@ -323,6 +334,21 @@ public:
 	// for dumping a table to an rdb file
 	RdbDump   m_dump;
 
+	// . write-ahead log of the lists added, see RdbWal.h
+	// . m_wal is also set up when the log is turned off so segments left
+	//   over from when it was on are replayed
+	RdbWal    m_wal;
+	bool      m_useWal;
+	bool      m_walReplaying;
+	bool      m_walRegistered;
+	bool      m_walReplayRegistered;
+	int64_t   m_lastWalCommit;
+	// the segment started when the current dump began, the older ones
+	// are removed when it completes. 0 if this dump does not checkpoint
+	int32_t   m_walCheckpointSeq;
+	// a collection could not be dumped so the dump can not checkpoint
+	bool      m_walDumpIncomplete;
+
 	// memory for us to use to avoid calling malloc()/mdup()/...
 	RdbMem    m_mem;
 
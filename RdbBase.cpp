@@ -15,6 +15,8 @@
 #include "Rebalance.h"
 #include "JobScheduler.h"
 #include "Process.h"
+#include "TermFreqTable.h"
+#include "TitleRecDict.h"
 
 // how many rdbs are in "urgent merge" mode?
 int32_t g_numUrgentMerges = 0;
@@ -39,6 +41,10 @@ RdbBase::RdbBase ( ) {
 
 	// use bogus collnum just in case
 	m_collnum = -1;
+	m_termFreqs = NULL;
+	m_termFreqsRebuild = NULL;
+	m_titleRecDicts = NULL;
+	m_titleRecDictTrainer = NULL;
 	reset();
 }
 
@@ -59,6 +65,26 @@ void RdbBase::reset ( ) {
 	m_isUnlinking  = false;
 	m_numThreads = 0;
 	m_checkedForMerge = false;
+	if ( m_termFreqs ) {
+		mdelete ( m_termFreqs , sizeof(TermFreqTable) , "RdbBTf" );
+		delete m_termFreqs;
+		m_termFreqs = NULL;
+	}
+	if ( m_termFreqsRebuild ) {
+		mdelete ( m_termFreqsRebuild , sizeof(TermFreqTable) , "RdbBTf" );
+		delete m_termFreqsRebuild;
+		m_termFreqsRebuild = NULL;
+	}
+	if ( m_titleRecDicts ) {
+		mdelete ( m_titleRecDicts , sizeof(TitleRecDicts) , "RdbBTd" );
+		delete m_titleRecDicts;
+		m_titleRecDicts = NULL;
+	}
+	if ( m_titleRecDictTrainer ) {
+		mdelete ( m_titleRecDictTrainer , sizeof(TitleRecDictTrainer) , "RdbBTd" );
+		delete m_titleRecDictTrainer;
+		m_titleRecDictTrainer = NULL;
+	}
 }
 
 RdbBase::~RdbBase ( ) {
@@ -170,6 +196,42 @@ bool RdbBase::init ( char  *dir            ,
 		// if no repair, give up
 		return false;
 	}
+
+	// load the posdb term frequency table if we have one
+	if ( rdb->m_rdbId == RDB_POSDB ) {
+		char filename[1024];
+		getTermFreqsFilename ( filename , sizeof(filename) );
+		TermFreqTable *tft;
+		try { tft = new TermFreqTable; }
+		catch ( ... ) {
+			g_errno = ENOMEM;
+			log( LOG_WARN, "db: Could not allocate term freq table." );
+			return false;
+		}
+		mnew ( tft , sizeof(TermFreqTable) , "RdbBTf" );
+		if ( tft->load ( filename ) ) {
+			m_termFreqs = tft;
+		} else {
+			mdelete ( tft , sizeof(TermFreqTable) , "RdbBTf" );
+			delete tft;
+		}
+	}
+
+	// load the dictionaries titlerecs may be compressed with
+	if ( rdb->m_rdbId == RDB_TITLEDB ) {
+		try { m_titleRecDicts = new TitleRecDicts; }
+		catch ( ... ) {
+			g_errno = ENOMEM;
+			log( LOG_WARN, "db: Could not allocate titledb dictionaries." );
+			return false;
+		}
+		mnew ( m_titleRecDicts , sizeof(TitleRecDicts) , "RdbBTd" );
+		// we could not read the records compressed with them
+		if ( ! m_titleRecDicts->load ( m_dir.getDir() , m_dbname ) ) {
+			return false;
+		}
+	}
+
 	//int32_t dataMem;
 	// if we're in read only mode, don't bother with *ANY* trees
 	//if ( g_conf.m_readOnlyMode ) goto preload;
@@ -874,6 +936,23 @@ bool RdbBase::incorporateMerge ( ) {
 		g_process.shutdownAbort();
 	}
 
+	// a merge of all files rebuilt the term freq table, switch to it
+	if ( m_termFreqsRebuild ) {
+		if ( m_termFreqs ) {
+			mdelete ( m_termFreqs , sizeof(TermFreqTable) , "RdbBTf" );
+			delete m_termFreqs;
+		}
+		m_termFreqs = m_termFreqsRebuild;
+		m_termFreqsRebuild = NULL;
+		log( LOG_INFO, "merge: Rebuilt term freq table for %s with %" PRId32" exact terms.",
+		     m_dbname, m_termFreqs->getNumExactTerms() );
+		saveTermFreqs();
+	}
+
+	if ( m_titleRecDictTrainer ) {
+		finishTitleRecDictTraining();
+	}
+
 	// print out info of newly merged file
 	int64_t tp = m_maps[x]->getNumPositiveRecs();
 	int64_t tn = m_maps[x]->getNumNegativeRecs();
@@ -2216,6 +2295,123 @@ void RdbBase::saveMaps() {
 			g_process.shutdownAbort();
 		}
 	}
+
+	// not fatal, the table is rebuilt by the next full merge
+	if ( ! saveTermFreqs() ) {
+		log( LOG_WARN, "db: Failed to save term freq table for %s.", m_dbname );
+	}
+}
+
+void RdbBase::getTermFreqsFilename ( char *buf , int32_t bufSize ) {
+	snprintf ( buf , bufSize , "%s/%s-termfreqs.dat" , m_dir.getDir() , m_dbname );
+}
+
+bool RdbBase::saveTermFreqs ( ) {
+	if ( ! m_termFreqs || ! m_termFreqs->needsSave() ) {
+		return true;
+	}
+
+	char filename[1024];
+	getTermFreqsFilename ( filename , sizeof(filename) );
+	return m_termFreqs->save ( filename );
+}
+
+void RdbBase::addDumpedListToTermFreqs ( RdbList *list ) {
+	if ( m_termFreqs ) {
+		m_termFreqs->addPosdbList ( list );
+	}
+
+	// . the merge rebuilding the table does not see files dumped while
+	//   it runs so count them in the new table too
+	if ( m_termFreqsRebuild ) {
+		m_termFreqsRebuild->addPosdbList ( list );
+	}
+}
+
+void RdbBase::addMergedListToTermFreqs ( RdbList *list ) {
+	if ( m_termFreqsRebuild ) {
+		m_termFreqsRebuild->addPosdbList ( list );
+	}
+}
+
+void RdbBase::startTermFreqRebuild ( ) {
+	if ( m_termFreqsRebuild ) {
+		mdelete ( m_termFreqsRebuild , sizeof(TermFreqTable) , "RdbBTf" );
+		delete m_termFreqsRebuild;
+		m_termFreqsRebuild = NULL;
+	}
+
+	TermFreqTable *tft;
+	try { tft = new TermFreqTable; }
+	catch ( ... ) {
+		log( LOG_WARN, "db: Could not allocate term freq table." );
+		return;
+	}
+	mnew ( tft , sizeof(TermFreqTable) , "RdbBTf" );
+	if ( ! tft->init() ) {
+		log( LOG_WARN, "db: Could not init term freq table: %s", mstrerror(g_errno) );
+		mdelete ( tft , sizeof(TermFreqTable) , "RdbBTf" );
+		delete tft;
+		g_errno = 0;
+		return;
+	}
+	m_termFreqsRebuild = tft;
+	log( LOG_INFO, "merge: Rebuilding term freq table for %s.", m_dbname );
+}
+
+void RdbBase::startTitleRecDictTraining ( ) {
+	if ( m_titleRecDictTrainer ) {
+		mdelete ( m_titleRecDictTrainer , sizeof(TitleRecDictTrainer) , "RdbBTd" );
+		delete m_titleRecDictTrainer;
+		m_titleRecDictTrainer = NULL;
+	}
+
+	if ( ! g_conf.m_titleRecDicts || ! m_titleRecDicts ||
+	     m_titleRecDicts->getNumDicts() >= MAX_TITLEREC_DICTS ) {
+		return;
+	}
+
+	TitleRecDictTrainer *trainer;
+	try { trainer = new TitleRecDictTrainer; }
+	catch ( ... ) {
+		log( LOG_WARN, "db: Could not allocate titledb dictionary trainer." );
+		return;
+	}
+	mnew ( trainer , sizeof(TitleRecDictTrainer) , "RdbBTd" );
+	m_titleRecDictTrainer = trainer;
+}
+
+// . train a dictionary from the records sampled by the merge
+// . keep it if it compresses the held out records a few percent better
+//   than the current one, every dictionary we keep is kept forever
+void RdbBase::finishTitleRecDictTraining ( ) {
+	TitleRecDictTrainer *trainer = m_titleRecDictTrainer;
+	m_titleRecDictTrainer = NULL;
+
+	TitleRecDict dict;
+	if ( ! trainer->train ( &dict ) ) {
+		log( LOG_INFO, "merge: Not training a dictionary for %s from %" PRId32" "
+		     "records: %s.", m_dbname, trainer->getNumSamples(), mstrerror(g_errno) );
+		g_errno = 0;
+	} else {
+		const TitleRecDict *current = m_titleRecDicts->getCurrentDict();
+		int64_t oldSize = trainer->getHeldOutSize ( current );
+		int64_t newSize = trainer->getHeldOutSize ( &dict );
+		if ( oldSize < 0 || newSize < 0 || newSize > oldSize * 97 / 100 ) {
+			log( LOG_INFO, "merge: Trained dictionary for %s does not compress "
+			     "better, %" PRId64" bytes instead of %" PRId64".",
+			     m_dbname, newSize, oldSize );
+		} else if ( m_titleRecDicts->add ( dict.m_buf.getBufStart() ,
+						   dict.m_buf.getLength() ) ) {
+			log( LOG_INFO, "merge: Trained dictionary #%" PRId32" for %s from %" PRId32" "
+			     "records, held out records compress to %" PRId64" bytes instead "
+			     "of %" PRId64".", m_titleRecDicts->getNumDicts() - 1, m_dbname,
+			     trainer->getNumSamples(), newSize, oldSize );
+		}
+	}
+
+	mdelete ( trainer , sizeof(TitleRecDictTrainer) , "RdbBTd" );
+	delete trainer;
 }
 
 void RdbBase::verifyDiskPageCache ( ) {
@@ -37,6 +37,10 @@
 #include "Dir.h"
 #include "RdbMem.h"
 
+class TermFreqTable;
+class TitleRecDicts;
+class TitleRecDictTrainer;
+
 // how many rdbs are in "urgent merge" mode?
 extern int32_t g_numUrgentMerges;
 
@@ -125,6 +129,25 @@ class RdbBase {
 	int64_t getNumTotalRecs ( ) ;
 
 	int64_t getNumGlobalRecs ( );
+
+	// . posdb only: table of term frequencies of the files on disk
+	// . NULL until a merge of all files has built it
+	TermFreqTable *getTermFreqTable ( ) { return m_termFreqs; }
+
+	// count a list that was dumped from the tree to disk
+	void addDumpedListToTermFreqs ( RdbList *list );
+	// count a list written by a merge of all files
+	void addMergedListToTermFreqs ( RdbList *list );
+	// called when a merge of all files starts from scratch
+	void startTermFreqRebuild ( );
+	bool saveTermFreqs ( );
+
+	// titledb only: the zlib preset dictionaries of the collection
+	const TitleRecDicts *getTitleRecDicts ( ) const { return m_titleRecDicts; }
+	// titledb only: samples the records of the current merge, or NULL
+	TitleRecDictTrainer *getTitleRecDictTrainer ( ) { return m_titleRecDictTrainer; }
+	// called when a titledb merge starts from scratch
+	void startTitleRecDictTraining ( );
 	
 	// private:
 
@@ -206,6 +229,17 @@ private:
 	bool parseFilename( const char* filename, int32_t *p_fileId, int32_t *p_fileId2,
 	                    int32_t *p_mergeNum, int32_t *p_endMergeFileId );
 
+	void getTermFreqsFilename ( char *buf , int32_t bufSize );
+
+	TermFreqTable *m_termFreqs;
+	// being rebuilt by the current merge
+	TermFreqTable *m_termFreqsRebuild;
+
+	void finishTitleRecDictTraining ( );
+
+	TitleRecDicts       *m_titleRecDicts;
+	TitleRecDictTrainer *m_titleRecDictTrainer;
+
 	// . we try to minimize the number of files to minimize disk seeks
 	// . records that end up as not found will hit all these files
 	// . when we get "m_minToMerge" or more files a merge kicks in
@@ -409,6 +409,9 @@ char* RdbBucket::getKeyVal( const char *key , char **data , int32_t* dataSize )
 	return rec;
 }
 
+// binary search for "key", a template on the key size so the compare is
+// inlined, see KEYSIZE_SWITCH() in types.h
+template <char KS>
 int32_t RdbBucket::getKeyNumExact(const char* key) const {
 	uint8_t ks = m_parent->getKeySize();
 	int32_t recSize = m_parent->getRecSize();
@@ -421,7 +424,7 @@ int32_t RdbBucket::getKeyNumExact(const char* key) const {
 		int32_t delta = high - low;
 		i = low + (delta >> 1);
 		kk = m_keys + (recSize * i);
-		v = KEYCMP(key,kk,ks);
+		v = KEYCMP<KS>(key,kk,ks);
 		if(v < 0) {
 			high = i - 1;
 			continue;
@@ -435,6 +438,10 @@ int32_t RdbBucket::getKeyNumExact(const char* key) const {
 	return -1;
 }
 
+int32_t RdbBucket::getKeyNumExact(const char* key) const {
+	return KEYSIZE_SWITCH(m_parent->getKeySize(), getKeyNumExact, key);
+}
+
 bool RdbBucket::selfTest (char* prevKey) {
 	sort();
 	char* last = NULL;
@@ -1281,16 +1288,12 @@ int32_t RdbBucket::getNumNegativeKeys ( ) const {
 }
 
 
-bool RdbBucket::getList(RdbList* list, 
-			const char* startKey, 
-			const char* endKey,
-			int32_t minRecSizes,
-			int32_t *numPosRecs, 
-			int32_t *numNegRecs, 
-			bool useHalfKeys) {
-
-	sort();
-	//get our bounds within the bucket:
+// . set "start" to the first key >= startKey and "end" to the last key
+//   <= endKey, used by getList() and getListSizeExact()
+// . a NULL startKey or endKey means the first or last key
+template <char KS>
+void RdbBucket::getRange(const char* startKey, const char* endKey,
+			 int32_t *startArg, int32_t *endArg) const {
 	uint8_t ks = m_parent->getKeySize();
 	int32_t recSize = m_parent->getRecSize();
 	int32_t start = 0;
@@ -1304,7 +1307,7 @@ bool RdbBucket::getList(RdbList* list,
 			int32_t delta = high - low;
 			start = low + (delta >> 1);
 			kk = m_keys + (recSize * start);
-			v = KEYCMP(startKey,kk,ks);
+			v = KEYCMP<KS>(startKey,kk,ks);
 			if(v < 0) {
 				high = start - 1;
 				continue;
@@ -1320,7 +1323,7 @@ bool RdbBucket::getList(RdbList* list,
 		//is <= start
 		while(start < m_numKeys) {
 			kk = m_keys + (recSize * start);
-			v = KEYCMP(startKey, kk, ks);
+			v = KEYCMP<KS>(startKey, kk, ks);
 			if(v > 0) start++;
 			else break;
 		}
@@ -1335,7 +1338,7 @@ bool RdbBucket::getList(RdbList* list,
 			int32_t delta = high - low;
 			end = low + (delta >> 1);
 			kk = m_keys + (recSize * end);
-			v = KEYCMP(endKey,kk,ks);
+			v = KEYCMP<KS>(endKey,kk,ks);
 			if(v < 0) {
 				high = end - 1;
 				continue;
@@ -1349,7 +1352,7 @@ bool RdbBucket::getList(RdbList* list,
 		}
 		while(end > 0) {
 			kk = m_keys + (recSize * end);
-			v = KEYCMP(endKey, kk, ks);
+			v = KEYCMP<KS>(endKey, kk, ks);
 			if(v < 0) end--;
 			else break;
 		}
@@ -1357,6 +1360,32 @@ bool RdbBucket::getList(RdbList* list,
 	}
 	else end = m_numKeys - 1;
 
+	*startArg = start;
+	*endArg = end;
+}
+
+void RdbBucket::getRange(const char* startKey, const char* endKey,
+			 int32_t *start, int32_t *end) const {
+	KEYSIZE_SWITCH(m_parent->getKeySize(), getRange,
+		       startKey, endKey, start, end);
+}
+
+bool RdbBucket::getList(RdbList* list, 
+			const char* startKey, 
+			const char* endKey,
+			int32_t minRecSizes,
+			int32_t *numPosRecs, 
+			int32_t *numNegRecs, 
+			bool useHalfKeys) {
+
+	sort();
+	//get our bounds within the bucket:
+	uint8_t ks = m_parent->getKeySize();
+	int32_t recSize = m_parent->getRecSize();
+	int32_t start;
+	int32_t end;
+	getRange(startKey, endKey, &start, &end);
+
 	//log(LOG_WARN, "numKeys %" PRId32" start %" PRId32" end %" PRId32,
 	//m_numKeys, start, end);
 	
@@ -1505,65 +1534,9 @@ int RdbBucket::getListSizeExact (const char* startKey, const char* endKey ) {
 	//get our bounds within the bucket:
 	uint8_t ks = m_parent->getKeySize();
 	int32_t recSize = m_parent->getRecSize();
-	int32_t start = 0;
-	int32_t end = m_numKeys - 1;
-	char v;
-	char* kk = NULL;
-
-	int32_t low = 0;
-	int32_t high = m_numKeys - 1;
-	while(low <= high) {
-		int32_t delta = high - low;
-		start = low + (delta >> 1);
-		kk = m_keys + (recSize * start);
-		v = KEYCMP(startKey,kk,ks);
-		if(v < 0) {
-			high = start - 1;
-			continue;
-		}
-		else if(v > 0) {
-			low = start + 1;
-			continue;
-		}
-		else break;
-
-	}
-	//now back up or move forward s.t. startKey
-	//is <= start
-	while(start < m_numKeys) {
-		kk = m_keys + (recSize * start);
-		v = KEYCMP(startKey, kk, ks);
-		if(v > 0) start++;
-		else break;
-	}
-
-
-
-
-	low = start;
-	high = m_numKeys - 1;
-	while(low <= high) {
-		int32_t delta = high - low;
-		end = low + (delta >> 1);
-		kk = m_keys + (recSize * end);
-		v = KEYCMP(endKey,kk,ks);
-		if(v < 0) {
-			high = end - 1;
-			continue;
-		}
-		else if(v > 0) {
-			low = end + 1;
-			continue;
-		}
-		else break;
-
-	}
-	while(end > 0) {
-		kk = m_keys + (recSize * end);
-		v = KEYCMP(endKey, kk, ks);
-		if(v < 0) end--;
-		else break;
-	}
+	int32_t start;
+	int32_t end;
+	getRange(startKey, endKey, &start, &end);
 
 	//keep track of our negative a positive recs
 	//int32_t numNeg = 0;
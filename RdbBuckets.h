@@ -51,6 +51,14 @@ public:
 	bool  addKey(const char *key , char *data , int32_t dataSize);
 	char *getKeyVal ( const char *key , char **data , int32_t* dataSize ); 
 	int32_t  getKeyNumExact(const char* key) const; //returns -1 if not found
+	template <char KS>
+	int32_t  getKeyNumExact(const char* key) const;
+	// the first and last key in [startKey,endKey]
+	void getRange(const char* startKey, const char* endKey,
+		      int32_t *start, int32_t *end) const;
+	template <char KS>
+	void getRange(const char* startKey, const char* endKey,
+		      int32_t *start, int32_t *end) const;
 	int32_t  getNumNegativeKeys() const;
 	void  resetLastSorted() { m_lastSorted = 0; }
 	bool  getList(RdbList* list, 
@@ -7,6 +7,7 @@
 #include "Tagdb.h"
 #include "Statsdb.h"
 #include "Process.h"
+#include "TermListCache.h"
 
 void doneReadingForVerifyWrapper ( void *state ) ;
 //void gotTfndbListWrapper ( void *state , RdbList *list, Msg5 *msg5 ) ;
@@ -989,6 +990,15 @@ bool RdbDump::doneReadingForVerify ( ) {
 		return true;
 	}
 
+	// keep the posdb term freq table up to date with what is on disk
+	if ( m_rdb && m_rdb->m_rdbId == RDB_POSDB ) {
+		RdbBase *base = m_rdb->getBase ( m_collnum );
+		if ( base ) {
+			base->addDumpedListToTermFreqs ( m_list );
+		}
+		g_termListCache.addDumpedList ( m_collnum , m_list );
+	}
+
 
 	// . merge the writeBuf into the cache at this point or after deleting
 	// . m_list should have it's m_lastKey set since we got called from
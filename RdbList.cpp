@@ -1233,6 +1233,21 @@ bool RdbList::constrain ( const char   *startKey    ,
 			  const char   *hintKey     ,
 			  const char   *filename    ,
 			  int32_t    niceness    ) {
+	return KEYSIZE_SWITCH ( m_ks , constrainKeys , startKey , endKey ,
+				minRecSizes , hintOffset , hintKey ,
+				filename , niceness );
+}
+
+// . the work of constrain(), a template on the key size so the key
+//   compares in the scans are inlined
+template <char KS>
+bool RdbList::constrainKeys ( const char   *startKey    ,
+			      char   *endKey      ,
+			      int32_t    minRecSizes ,
+			      int32_t    hintOffset  ,
+			      const char   *hintKey     ,
+			      const char   *filename    ,
+			      int32_t    niceness    ) {
 	// return false if we don't own the data
 	if ( ! m_ownData ) {
 		g_errno = EBADLIST;
@@ -1241,8 +1256,8 @@ bool RdbList::constrain ( const char   *startKey    ,
 	// bail if empty
 	if ( m_listSize == 0 ) {
 		// tighten the keys
-		KEYSET(m_startKey,startKey,m_ks);
-		KEYSET(m_endKey,endKey,m_ks);
+		KEYSET<KS>(m_startKey,startKey,m_ks);
+		KEYSET<KS>(m_endKey,endKey,m_ks);
 		return true;
 	}
 	// ensure we our first key is 12 bytes if m_useHalfKeys is true
@@ -1293,15 +1308,15 @@ bool RdbList::constrain ( const char   *startKey    ,
 		getKey(p,k);
 #ifdef GBSANITYCHECK
 		// check key order!
-		if ( KEYCMP(k,lastKey,m_ks)<= 0 ) {
+		if ( KEYCMP<KS>(k,lastKey,m_ks)<= 0 ) {
 			log("constrain: key=%s out of order",
 			    KEYSTR(k,m_ks));
 			g_process.shutdownAbort(true);
 		}
-		KEYSET(lastKey,k,m_ks);
+		KEYSET<KS>(lastKey,k,m_ks);
 #endif
 		// stop if we are >= startKey
-		if ( KEYCMP(k,startKey,m_ks) >= 0 ) break;
+		if ( KEYCMP<KS>(k,startKey,m_ks) >= 0 ) break;
 #ifdef GBSANITYCHECK
 		// debug msg
 		log("constrain: skipping key=%s rs=%" PRId32,
@@ -1336,13 +1351,13 @@ bool RdbList::constrain ( const char   *startKey    ,
 		getKey(p,k);
 
 	//if ( p >= m_listEnd || getKey(p) > endKey ) {
-	if ( p >= m_listEnd || KEYCMP(k,endKey,m_ks)>0 ) {
+	if ( p >= m_listEnd || KEYCMP<KS>(k,endKey,m_ks)>0 ) {
 		// make list empty
 		m_listSize  = 0;
 		m_listEnd   = m_list;
 		// tighten the keys
-		KEYSET(m_startKey,startKey,m_ks);
-		KEYSET(m_endKey,endKey,m_ks);
+		KEYSET<KS>(m_startKey,startKey,m_ks);
+		KEYSET<KS>(m_endKey,endKey,m_ks);
 		// reset to set m_listPtr and m_listPtrHi
 		resetListPtr();
 		return true;
@@ -1356,7 +1371,7 @@ bool RdbList::constrain ( const char   *startKey    ,
 		if ( p[0] & 0x04 ) p -= 12;
 		else               p -= 6;
 		// write the full key back into "p"
-		KEYSET(p,k,m_ks);
+		KEYSET<KS>(p,k,m_ks);
 	}
 	// . if p points to a 6 byte key, make it 12 bytes
 	// . this is the only destructive part of this function
@@ -1367,7 +1382,7 @@ bool RdbList::constrain ( const char   *startKey    ,
 		// write the key back 6 bytes
 		p -= 6;
 		//*(key_t *)p = k;
-		KEYSET(p,k,m_ks);
+		KEYSET<KS>(p,k,m_ks);
 	}
 
 #ifdef GBSANITYCHECK
@@ -1403,7 +1418,7 @@ bool RdbList::constrain ( const char   *startKey    ,
 	// . might it be a corrupt RdbMap?
 	// . reset "p" to beginning if hint is bad
 	//else if ( getKey(p) != hintKey || hintKey > endKey ) {
-	else if ( KEYCMP(k,hintKey,m_ks)!=0 || KEYCMP(hintKey,endKey,m_ks)>0) {
+	else if ( KEYCMP<KS>(k,hintKey,m_ks)!=0 || KEYCMP<KS>(hintKey,endKey,m_ks)>0) {
 		log("db: Corrupt data or map file. Bad hint for %s.",filename);
 		// . until we fix the corruption, drop a core
 		// . no, a lot of files could be corrupt, just do it for merge
@@ -1429,7 +1444,7 @@ bool RdbList::constrain ( const char   *startKey    ,
 	while ( p < m_listEnd ) {
 		QUICKPOLL(niceness);
 		getKey(p,k);
-		if ( KEYCMP(k,endKey,m_ks)>0 ) break;
+		if ( KEYCMP<KS>(k,endKey,m_ks)>0 ) break;
 		if ( p >= maxPtr ) break;
 		size = getRecSize ( p );
 		// watch out for corruption, let Msg5 fix it
@@ -1468,7 +1483,7 @@ bool RdbList::constrain ( const char   *startKey    ,
 	//   left over.
 	//if ( p < m_listEnd && getKey(p) <= endKey && p >= maxPtr && size >0){
 	if ( p < m_listEnd ) getKey(p,k);
-	if ( p < m_listEnd && KEYCMP(k,endKey,m_ks)<=0 && p>=maxPtr && size>0){
+	if ( p < m_listEnd && KEYCMP<KS>(k,endKey,m_ks)<=0 && p>=maxPtr && size>0){
 		// this line seemed to have made us make corrupt lists. So
 		// deal with the slack in Msg5 directly.
 		//(p == m_listEnd && p >= maxPtr && size >0) ) {
@@ -1506,8 +1521,8 @@ bool RdbList::constrain ( const char   *startKey    ,
 	// and the keys can be tightened
 	//m_startKey  = startKey;
 	//m_endKey    = endKey;
-	KEYSET(m_startKey,startKey,m_ks);
-	KEYSET(m_endKey,endKey,m_ks);
+	KEYSET<KS>(m_startKey,startKey,m_ks);
+	KEYSET<KS>(m_endKey,endKey,m_ks);
 	return true;
 }
 
@@ -1620,6 +1635,20 @@ void RdbList::merge_r ( RdbList **lists         ,
 		return;
 	}
 
+	KEYSIZE_SWITCH ( m_ks , mergeKeys_r , lists , numLists , endKey ,
+			 minRecSizes , removeNegRecs , rdbId , startListSize );
+}
+
+// . the merge loop of merge_r(), a template on the key size so the key
+//   compares and copies are inlined, see KEYSIZE_SWITCH() in types.h
+template <char KS>
+void RdbList::mergeKeys_r ( RdbList **lists         ,
+			    int32_t      numLists      ,
+			    const char     *endKey        ,
+			    int32_t      minRecSizes   ,
+			    bool      removeNegRecs ,
+			    char      rdbId         ,
+			    int32_t      startListSize ) {
 	int32_t required = -1;
 	// . if merge not necessary, print a warning message.
 	// . caller should have just called constrain() then
@@ -1651,7 +1680,7 @@ void RdbList::merge_r ( RdbList **lists         ,
 	int32_t  lastNegi = -1;
 
 	// init highestKey
-	KEYSET(highestKey,KEYMIN(),m_ks);
+	KEYSET<KS>(highestKey,KEYMIN(),m_ks);
 
 	// this is used for rolling back delete records
 	int32_t lastListSize = m_listSize;
@@ -1707,7 +1736,7 @@ void RdbList::merge_r ( RdbList **lists         ,
 
 top:
 	// get the biggest possible minKey so everyone's <= it
-	KEYSET(minKey,KEYMAX(),m_ks);
+	KEYSET<KS>(minKey,KEYMAX(),m_ks);
 
 	// assume we have no min key
 	mini = -1;
@@ -1722,7 +1751,7 @@ top:
 
 		// see if the current key from this scan's read buffer is 2 big
 		lists[i]->getCurrentKey(ckey);
-		KEYSET(mkey,minKey,m_ks);
+		KEYSET<KS>(mkey,minKey,m_ks);
 
 		// treat negatives and positives as equals for this
 		*ckey |= 0x01;
@@ -1752,12 +1781,12 @@ top:
 
         //if ( ckey > mkey ) continue;
 
-		if ( KEYCMP(ckey,mkey,m_ks) > 0 ) {
+		if ( KEYCMP<KS>(ckey,mkey,m_ks) > 0 ) {
 			continue;
 		}
 
 		// if this guy is newer and equal, skip the old guy
-		if ( KEYCMP(ckey,mkey,m_ks)==0 && mini >= 0 ) {
+		if ( KEYCMP<KS>(ckey,mkey,m_ks)==0 && mini >= 0 ) {
 			lists[ mini ]->skipCurrentRecord();
 		}
 		// now this new guy is the min key
@@ -1777,7 +1806,7 @@ top:
 	//   tfndblist in Msg5.cpp
 	//if ( minKey > endKey ) goto done;
 
-	if ( KEYCMP(minKey,endKey,m_ks)>0 ) {
+	if ( KEYCMP<KS>(minKey,endKey,m_ks)>0 ) {
 		goto done;
 	}
 
@@ -1807,7 +1836,7 @@ top:
 	// "i" was > our "i", and we match, then erase us...
 	if ( lastNegi > mini ) {
 		// does it annihilate us?
-		if ( KEYCMPNEGEQ(minKey,lastNegKey,m_ks)==0 ) {
+		if ( KEYCMPNEGEQ<KS>(minKey,lastNegKey,m_ks)==0 ) {
 			goto skip;
 		}
 
@@ -1853,10 +1882,10 @@ top:
 	// know the last positive key to set m_lastKey
 	//if ( (*(char *)&minKey & 0x01) == 0x01 ) lastPosKey = minKey;
 	if ( !KEYNEG(minKey) ) {
-		KEYSET(lastPosKey,minKey,m_ks);
+		KEYSET<KS>(lastPosKey,minKey,m_ks);
 	}
 
-	KEYSET(lastKey,minKey,m_ks);
+	KEYSET<KS>(lastKey,minKey,m_ks);
 	lastKeyIsValid = true;
 
 skip:
@@ -1878,7 +1907,7 @@ skip:
 	if ( removeNegRecs ) {
 		// . keep chugging if there MAY be keys left
 		// . they will replace us if they are added cuz "removeNegRecs" is true
-		if ( mini >= 0 && KEYCMP(minKey,endKey,m_ks)<0 ) {
+		if ( mini >= 0 && KEYCMP<KS>(minKey,endKey,m_ks)<0 ) {
 			goto top;
 		}
 		// . otherwise, all lists were exhausted
@@ -1889,7 +1918,7 @@ skip:
 		if ( required >= 0 ) {
 			required = lastListSize;
 		}
-		KEYSET(lastKey,lastPosKey,m_ks);
+		KEYSET<KS>(lastKey,lastPosKey,m_ks);
 	}
 
 	// if all lists are exhausted, we're really done
@@ -1909,8 +1938,8 @@ skip:
 		// with this one and be saved on the list and we have to
 		// peel it off and accept this dangling negative as unmatched
 		savedListSize   = m_listSize;
-		KEYSET(savedLastKey,lastKey,m_ks);
-		KEYSET(savedHighestKey,highestKey,m_ks);
+		KEYSET<KS>(savedLastKey,lastKey,m_ks);
+		KEYSET<KS>(savedHighestKey,highestKey,m_ks);
 		goto top;
 	}
 
@@ -1922,9 +1951,9 @@ skip:
 	//   expose our original negative key, an acceptable dangling negative
 	m_listSize = savedListSize;
 	//lastKey    = savedLastKey;
-	KEYSET(lastKey,savedLastKey,m_ks);
+	KEYSET<KS>(lastKey,savedLastKey,m_ks);
 	//highestKey = savedHighestKey;
-	KEYSET(highestKey,savedHighestKey,m_ks);
+	KEYSET<KS>(highestKey,savedHighestKey,m_ks);
 
  positive:
 	// but don't set the listSize negative
@@ -1941,7 +1970,7 @@ skip:
 	//   negative rec that we removed 3 lines above
 	if ( m_listSize > startListSize ) { // > 0 ) {
 		//m_lastKey = lastKey;
-		KEYSET(m_lastKey,lastKey,m_ks);
+		KEYSET<KS>(m_lastKey,lastKey,m_ks);
 		m_lastKeyIsValid = true;
 	}
 
@@ -1962,10 +1991,10 @@ skip:
 		//if ( m_lastKey < highestKey ) endKey = highestKey;
 		//else                          endKey = m_lastKey;
 		char endKey[MAX_KEY_BYTES];
-		if ( KEYCMP(m_lastKey,highestKey,m_ks)<0 )
-			KEYSET(endKey,highestKey,m_ks);
+		if ( KEYCMP<KS>(m_lastKey,highestKey,m_ks)<0 )
+			KEYSET<KS>(endKey,highestKey,m_ks);
 		else
-			KEYSET(endKey,m_lastKey ,m_ks);
+			KEYSET<KS>(endKey,m_lastKey ,m_ks);
 		// if endkey is now negative we must have a dangling negative
 		// so make it positive (dangling = unmatched)
 		//if ( (*(char *)&endKey & 0x01) == 0x00 )
@@ -1974,8 +2003,8 @@ skip:
 			KEYADD(endKey,m_ks);
 		// be careful not to increase original endkey, though
 		//if ( endKey < m_endKey ) m_endKey = endKey;
-		if ( KEYCMP(endKey,m_endKey,m_ks)<0 )
-			KEYSET(m_endKey,endKey,m_ks);
+		if ( KEYCMP<KS>(endKey,m_endKey,m_ks)<0 )
+			KEYSET<KS>(m_endKey,endKey,m_ks);
 	}
 
 	// . sanity check. if merging one list, make sure we get it
@@ -2046,7 +2075,239 @@ skip:
 //
 ///////
 
+// see Posdb.h for format of a 18/12/6-byte posdb key
+
+// . a list being merged. its current key may be compressed so we keep
+//   the lo and hi 6 bytes it shares with the keys before it here
+struct PosdbMergeSrc {
+	const char *m_ptr;
+	const char *m_end;
+	char        m_lo[6];
+	char        m_hi[6];
+};
+
+// set "s" to the keys of "list", which must start with a full key
+static void initPosdbMergeSrc ( PosdbMergeSrc *s , RdbList *list ) {
+	// . first key of a list must ALWAYS be 18 byte
+	// . bitch if it isn't, that should be fixed!
+	// . cheap sanity check
+	if ( (list->getList()[0]) & 0x06 ) {
+		errno = EBADENGINEER;
+		log(LOG_LOGIC,"db: posdbMerge_r: First key of list is "
+		    "a compressed key.");
+		g_process.shutdownAbort(true);
+	}
+	s->m_ptr = list->getList();
+	s->m_end = list->getListEnd();
+	memcpy ( s->m_lo , s->m_ptr +  6 , 6 );
+	memcpy ( s->m_hi , s->m_ptr + 12 , 6 );
+}
+
+static inline void advancePosdbMergeSrc ( PosdbMergeSrc *s ) {
+	if      ( s->m_ptr[0] & 0x04 ) s->m_ptr += 6;
+	else if ( s->m_ptr[0] & 0x02 ) s->m_ptr += 12;
+	else                           s->m_ptr += 18;
+	// is new key 6 bytes? then do not touch hi/lo
+	if ( s->m_ptr >= s->m_end || ( s->m_ptr[0] & 0x04 ) ) return;
+	memcpy ( s->m_lo , s->m_ptr + 6 , 6 );
+	// is new key 18 bytes? full key.
+	if ( ! ( s->m_ptr[0] & 0x02 ) ) memcpy ( s->m_hi , s->m_ptr + 12 , 6 );
+}
+
+// . advance "s" to its first key >= "key", the first key of a docid
+// . a 6 byte key has the docid of the key before it so only the 12 and 18
+//   byte keys need a compare
+static void seekPosdbMergeSrc ( PosdbMergeSrc *s , const char *key ) {
+	const char *keyLo = key +  6;
+	const char *keyHi = key + 12;
+	while ( s->m_ptr < s->m_end &&
+		bfcmpPosdb ( s->m_ptr , s->m_lo , s->m_hi ,
+			     key , keyLo , keyHi ) < 0 ) {
+		advancePosdbMergeSrc ( s );
+		while ( s->m_ptr < s->m_end && ( s->m_ptr[0] & 0x04 ) )
+			advancePosdbMergeSrc ( s );
+	}
+}
+
+// . a loser tree over the lists of a posdb merge. each inner node keeps
+//   the loser of the match played there so after the winner is advanced
+//   we only replay the log2(n) matches on its path to the root instead of
+//   comparing the keys of all n lists again
+// . a tie goes to the newer list, the one with the higher index, so we
+//   see the newest copy of a key first and can drop the older ones
+// . an exhausted list loses to everyone so if the winner is exhausted
+//   they all are
+class PosdbLoserTree {
+ public:
+	void init ( PosdbMergeSrc *srcs , int32_t numSrcs ) {
+		m_srcs    = srcs;
+		m_numSrcs = numSrcs;
+		if ( numSrcs == 1 ) { m_tree[0] = 0; return; }
+		// the winners of the inner nodes, the leaves are at
+		// numSrcs + i
+		int16_t win [ 2 * ( MAX_RDB_FILES + 1 ) ];
+		for ( int32_t i = 0 ; i < numSrcs ; i++ ) win[numSrcs+i] = i;
+		for ( int32_t node = numSrcs - 1 ; node >= 1 ; node-- ) {
+			int16_t a = win[2*node];
+			int16_t b = win[2*node+1];
+			if ( beats ( a , b ) ) { win[node] = a; m_tree[node] = b; }
+			else                   { win[node] = b; m_tree[node] = a; }
+		}
+		m_tree[0] = win[1];
+	}
+
+	PosdbMergeSrc *getWinner ( ) { return &m_srcs[m_tree[0]]; }
+
+	bool isExhausted ( ) const {
+		const PosdbMergeSrc *s = &m_srcs[m_tree[0]];
+		return ( s->m_ptr >= s->m_end );
+	}
+
+	// advance the winning list to its next key and replay its matches
+	void advanceWinner ( ) {
+		int16_t w = m_tree[0];
+		advancePosdbMergeSrc ( &m_srcs[w] );
+		for ( int32_t node = ( w + m_numSrcs ) >> 1 ; node > 0 ;
+		      node >>= 1 ) {
+			if ( ! beats ( m_tree[node] , w ) ) continue;
+			int16_t loser = w;
+			w = m_tree[node];
+			m_tree[node] = loser;
+		}
+		m_tree[0] = w;
+	}
+
+ private:
+	bool beats ( int16_t a , int16_t b ) const {
+		const PosdbMergeSrc *sa = &m_srcs[a];
+		const PosdbMergeSrc *sb = &m_srcs[b];
+		if ( sa->m_ptr >= sa->m_end ) return false;
+		if ( sb->m_ptr >= sb->m_end ) return true;
+		// treat negative and positive keys as identical for this
+		char ss = bfcmpPosdb ( sa->m_ptr , sa->m_lo , sa->m_hi ,
+				       sb->m_ptr , sb->m_lo , sb->m_hi );
+		if ( ss ) return ( ss < 0 );
+		return ( a > b );
+	}
+
+	PosdbMergeSrc *m_srcs;
+	int32_t        m_numSrcs;
+	// m_tree[0] is the winner, m_tree[1..n-1] the losers
+	int16_t        m_tree [ MAX_RDB_FILES + 1 ];
+};
+
+// . merge the keys of "srcs" into this list at m_listPtr until we reach
+//   "maxPtr"
+// . sets m_listSize and m_lastKey
+// . returns true if all the keys were merged
+bool RdbList::posdbMergeSrcs_r ( PosdbMergeSrc *srcs ,
+				 int32_t        numSrcs ,
+				 const char    *maxPtr ,
+				 bool           removeNegKeys ) {
+	PosdbLoserTree tree;
+	tree.init ( srcs , numSrcs );
+
+	// the last key we took from a list, stored or not
+	char lastBase[6];
+	char lastLo  [6];
+	char lastHi  [6];
+	bool haveLast = false;
+
+	char *pp = NULL;
+	char *new_listPtr = m_listPtr;
+
+	while ( ! tree.isExhausted() ) {
+		PosdbMergeSrc *s = tree.getWinner();
+		const char *minPtrBase = s->m_ptr; // lowest  6 bytes
+		const char *minPtrLo   = s->m_lo;  // next    6 bytes
+		const char *minPtrHi   = s->m_hi;  // highest 6 bytes
+
+		// . an older copy of the last key, skip it so the newest
+		//   copy wins
+		// . this is also the annihilation, if the newest copy was a
+		//   negative key this is the positive key it deletes
+		if ( haveLast &&
+		     bfcmpPosdb ( minPtrBase , minPtrLo , minPtrHi ,
+				  lastBase , lastLo , lastHi ) == 0 ) {
+			tree.advanceWinner();
+			continue;
+		}
+
+		if ( new_listPtr >= maxPtr ) break;
+
+		memcpy ( lastBase , minPtrBase , 6 );
+		memcpy ( lastLo   , minPtrLo   , 6 );
+		memcpy ( lastHi   , minPtrHi   , 6 );
+		haveLast = true;
+
+		// ignore if negative i guess, just skip it
+		if ( removeNegKeys && (minPtrBase[0] & 0x01) == 0x00 ) {
+			tree.advanceWinner();
+			continue;
+		}
+
+		// save ptr
+		pp = new_listPtr;
+
+		// store key
+		if ( m_listPtrHi && cmp_6bytes_equal(minPtrHi,m_listPtrHi)) {
+			if(m_listPtrLo && cmp_6bytes_equal(minPtrLo,m_listPtrLo)) {
+				// 6-byte entry
+				memcpy(new_listPtr, minPtrBase, 6);
+				new_listPtr += 6;
+				*pp |= 0x06; //turn on both compression bits
+			} else  {
+				// 12-byte entry
+				memcpy(new_listPtr, minPtrBase, 6);
+				new_listPtr += 6;
+				memcpy(new_listPtr, minPtrLo, 6);
+				m_listPtrLo  = new_listPtr; // point to the new lo key
+				new_listPtr += 6;
+				*pp = (*pp&~0x04)|0x02; //turn on exactly 1 compression bit
+			}
+		} else {
+			// 18-byte entry
+			memcpy(new_listPtr, minPtrBase, 6);
+			new_listPtr += 6;
+			memcpy(new_listPtr, minPtrLo, 6);
+			m_listPtrLo  = new_listPtr; // point to the new lo key
+			new_listPtr += 6;
+			memcpy(new_listPtr, minPtrHi, 6);
+			m_listPtrHi  = new_listPtr; // point to the new hi key
+			new_listPtr += 6;
+			*pp = *pp&~0x06; //turn off all compression bits
+		}
+
+		tree.advanceWinner();
+	}
 
+	m_listPtr = new_listPtr;
+
+	// set new size and end of this merged list
+	m_listSize = m_listPtr - m_list;
+	m_listEnd  = m_list    + m_listSize;
+
+	// if we are tacking this merge onto a non-empty list
+	// and we just had negative keys then pp could be NULL.
+	// we would log "storing recs in a non-empty list" from
+	// above and "pp" would be NULL.
+	if ( pp ) {
+		// the last key we stored
+		char *e = m_lastKey;
+		// record the last key we added in m_lastKey
+		gbmemcpy ( e , pp , 6 );
+		// take off compression bits
+		*e &= 0xf9;
+		e += 6;
+		gbmemcpy ( e , m_listPtrLo , 6 );
+		e += 6;
+		gbmemcpy ( e , m_listPtrHi , 6 );
+		// validate it now
+		m_lastKeyIsValid = true;
+	}
+
+	return tree.isExhausted();
+}
 
 bool RdbList::posdbMerge_r ( RdbList **lists         ,
 			     int32_t      numLists      ,
@@ -2122,14 +2383,9 @@ bool RdbList::posdbMerge_r ( RdbList **lists         ,
 		g_process.shutdownAbort(true);
 	}
 
-	// initialize the arrays, 1-1 with the unignored lists
-	const char  *ptrs[ MAX_RDB_FILES + 1 ];
-	const char  *ends[ MAX_RDB_FILES + 1 ];
-	char       hiKeys[ MAX_RDB_FILES + 1 ][6];
-	char       loKeys[ MAX_RDB_FILES + 1 ][6];
-	// set the ptrs that are non-empty
+	// initialize the sources, 1-1 with the non-empty lists
+	PosdbMergeSrc srcs [ MAX_RDB_FILES + 1 ];
 	int32_t n = 0;
-	// convenience ptr
 	for ( int32_t i = 0 ; i < numLists ; i++ ) {
 		// skip if empty
 		if ( lists[i]->isEmpty() ) continue;
@@ -2139,183 +2395,26 @@ bool RdbList::posdbMerge_r ( RdbList **lists         ,
 		lists[i]->printList(LOG_LOGIC);
 #endif
 
-		// . first key of a list must ALWAYS be 18 byte
-		// . bitch if it isn't, that should be fixed!
-		// . cheap sanity check
-		if ( (lists[i]->getList()[0]) & 0x06 ) {
-			errno = EBADENGINEER;
-			log(LOG_LOGIC,"db: posdbMerge_r: First key of list is "
-			    "a compressed key.");
-			g_process.shutdownAbort(true);
-		}
-		// set ptrs
-		ends    [n] = lists[i]->getListEnd ();
-		ptrs    [n] = lists[i]->getList    ();
-		memcpy(hiKeys[n], lists[i]->getList() + 12, 6);
-		memcpy(loKeys[n], lists[i]->getList() +  6, 6);
+		initPosdbMergeSrc ( &srcs[n] , lists[i] );
 		n++;
 	}
 
-	// new # of lists, in case any lists were empty
-	numLists = n;
-
 	// . are all lists and trash exhausted?
 	// . all their keys are supposed to be <= m_endKey
-	if ( numLists <= 0 ) return true;
-
-	char *pp = NULL;
+	if ( n <= 0 ) return true;
 
-	// see Posdb.h for format of a 18/12/6-byte posdb key
-
-	char *new_listPtr = m_listPtr;
-	while ( numLists > 0 && new_listPtr < maxPtr) {
-
-		// assume key in first list is the winner
-		const char *minPtrBase = ptrs  [0]; // lowest  6 bytes
-		const char *minPtrLo   = loKeys[0]; // next    6 bytes
-		const char *minPtrHi   = hiKeys[0]; // highest 6 bytes
-		int16_t mini     = 0;         // int16_t -> must be able to accomodate MAX_RDB_FILES!!
-
-		// merge loop over the lists, get the smallest key
-		for ( int32_t i = 1 ; i < numLists ; i++ ) {
-			char ss = bfcmpPosdb (minPtrBase,minPtrLo,minPtrHi,
-					 ptrs[i],loKeys[i],hiKeys[i]);
-			// . continue if tie, so we get the oldest first
-			// . treat negative and positive keys as identical for this
-			if ( ss <  0 ) continue;
-			// advance old winner. this happens if this key is positive
-			// and minPtrBase/Lo/Hi was a negative key! so this is
-			// the annihilation. skip the positive key.
-			if ( ss == 0 ) goto skip;
-			// we got a new min
-			minPtrBase = ptrs  [i];
-			minPtrLo   = loKeys[i];
-			minPtrHi   = hiKeys[i];
-			mini     = i;
-		}
-
-		// ignore if negative i guess, just skip it
-		if ( removeNegKeys && (minPtrBase[0] & 0x01) == 0x00 ) goto skip;
-
-		// save ptr
-		pp = new_listPtr;
-
-		// store key
-		if ( m_listPtrHi && cmp_6bytes_equal(minPtrHi,m_listPtrHi)) {
-			if(m_listPtrLo && cmp_6bytes_equal(minPtrLo,m_listPtrLo)) {
-				// 6-byte entry
-				memcpy(new_listPtr, minPtrBase, 6);
-				new_listPtr += 6;
-				*pp |= 0x06; //turn on both compression bits
-			} else  {
-				// 12-byte entry
-				memcpy(new_listPtr, minPtrBase, 6);
-				new_listPtr += 6;
-				memcpy(new_listPtr, minPtrLo, 6);
-				m_listPtrLo  = new_listPtr; // point to the new lo key
-				new_listPtr += 6;
-				*pp = (*pp&~0x04)|0x02; //turn on exactly 1 compression bit
-			}
-		} else {
-			// 18-byte entry
-			memcpy(new_listPtr, minPtrBase, 6);
-			new_listPtr += 6;
-			memcpy(new_listPtr, minPtrLo, 6);
-			m_listPtrLo  = new_listPtr; // point to the new lo key
-			new_listPtr += 6;
-			memcpy(new_listPtr, minPtrHi, 6);
-			m_listPtrHi  = new_listPtr; // point to the new hi key
-			new_listPtr += 6;
-			*pp = *pp&~0x06; //turn off all compression bits
-		}
-		
-		// . if it is truncated then we just skip it
-		// . it may have set oldList* stuff above, but that should not matter
-		// . TODO: BUT! if endKey has same termid as currently truncated key
-		//   then we should bail out now and boost the endKey to the max for
-		//   this termid (the we can fix Msg5::needsRecall() )
-		// . TODO: what if last key we were able to add was NEGATIVE???
-
-	 skip:
-		// advance winning src list ptr
-		if      ( ptrs[mini][0] & 0x04 ) ptrs [ mini ] += 6;
-		else if ( ptrs[mini][0] & 0x02 ) ptrs [ mini ] += 12;
-		else                             ptrs [ mini ] += 18;
-
-		// if the src list that we advanced is not exhausted, then continue
-		if ( ptrs[mini] < ends[mini] ) {
-			// is new key 6 bytes? then do not touch hi/lo ptrs
-			if ( ptrs[mini][0] & 0x04 ) {
-			}
-			// is new key 12 bytes?
-			else if ( ptrs[mini][0] & 0x02 ) {
-				memcpy(loKeys[mini], ptrs[mini] +  6, 6);
-			}
-			// is new key 18 bytes? full key.
-			else {
-				memcpy(hiKeys[mini], ptrs[mini] + 12, 6);
-				memcpy(loKeys[mini], ptrs[mini] +  6, 6);
-			}
-		} else {
-			//
-			// REMOVE THE LIST at mini
-			//
-
-			// otherwise, remove him from array
-			for ( int32_t i = mini ; i < numLists - 1 ; i++ ) {
-				ptrs    [i] = ptrs    [i+1];
-				ends    [i] = ends    [i+1];
-				memcpy(hiKeys[i], hiKeys[i+1], 6);
-				memcpy(loKeys[i], loKeys[i+1], 6);
-			}
-			// one less list to worry about
-			numLists--;
-		}
-	}
-
-	m_listPtr = new_listPtr;
+	bool allMerged = posdbMergeSrcs_r ( srcs , n , maxPtr , removeNegKeys );
 
 	// come here to try to fix any dangling negatives
 
-	// if last key we added is positive, skip this stuff
-	//if ( (*minPtrBase & 0x01) == 0x01 ) goto positive;
-
-	// if no lists left and no recyclable trash remains, nothing we can do
-	//if ( numLists <= 0 ) goto positive;
-
 	// . if there is a negative/positive key combo
 	//   they should annihilate in the primary for loop above!! UNLESS
 	//   one list was truncated at the end and we did not get its
 	//   annihilating key... strange, but i guess it could happen...
 
-	//positive:
-
-	// set new size and end of this merged list
-	m_listSize = m_listPtr - m_list;
-	m_listEnd  = m_list    + m_listSize;
-
 	// return now if we're empty... all our recs annihilated?
 	if ( m_listSize <= 0 ) return true;
 
-	// if we are tacking this merge onto a non-empty list
-	// and we just had negative keys then pp could be NULL.
-	// we would log "storing recs in a non-empty list" from
-	// above and "pp" would be NULL.
-	if ( pp ) {
-		// the last key we stored
-		char *e = m_lastKey;
-		// record the last key we added in m_lastKey
-		gbmemcpy ( e , pp , 6 );
-		// take off compression bits
-		*e &= 0xf9;
-		e += 6;
-		gbmemcpy ( e , m_listPtrLo , 6 );
-		e += 6;
-		gbmemcpy ( e , m_listPtrHi , 6 );
-		// validate it now
-		m_lastKeyIsValid = true;
-	}
-
 	if ( m_listSize && ! m_lastKeyIsValid )
 		log("db: why last key not valid?");
 
@@ -2329,7 +2428,7 @@ bool RdbList::posdbMerge_r ( RdbList **lists         ,
 	}
 
 	// or if no more lists
-	if ( numLists <= 0 ) {
+	if ( allMerged ) {
 #ifdef _MERGEDEBUG_
 		log(LOG_LOGIC,"%s:%s:%d: Done.", __FILE__,__func__, __LINE__);
 		printList(LOG_LOGIC);
@@ -2363,6 +2462,113 @@ bool RdbList::posdbMerge_r ( RdbList **lists         ,
 	return true;
 }
 
+// . merge the keys of "lists" in [startKey,stopKey) into this empty list
+// . startKey and stopKey must be the first key of a docid, like
+//   Posdb::makeStartKey() makes, or NULL for the start or end of the lists
+// . this is one docid range of a big posdb merge that Msg5 split up to
+//   run the ranges in parallel, posdbAddMergedRanges() puts them together
+// . returns false if out of memory
+bool RdbList::posdbMergeRange_r ( RdbList    **lists         ,
+				  int32_t      numLists      ,
+				  const char  *startKey      ,
+				  const char  *stopKey       ,
+				  bool         removeNegKeys ) {
+	if ( numLists > MAX_RDB_FILES + 1 ) { g_process.shutdownAbort(true); }
+
+	reset();
+
+	PosdbMergeSrc srcs [ MAX_RDB_FILES + 1 ];
+	int32_t n = 0;
+	int32_t size = 0;
+	for ( int32_t i = 0 ; i < numLists ; i++ ) {
+		if ( lists[i]->isEmpty() ) continue;
+		PosdbMergeSrc *s = &srcs[n];
+		initPosdbMergeSrc ( s , lists[i] );
+		if ( startKey ) seekPosdbMergeSrc ( s , startKey );
+		if ( stopKey ) {
+			PosdbMergeSrc stop = *s;
+			seekPosdbMergeSrc ( &stop , stopKey );
+			s->m_end = stop.m_ptr;
+		}
+		if ( s->m_ptr >= s->m_end ) continue;
+		size += s->m_end - s->m_ptr;
+		n++;
+	}
+
+	m_ks            = sizeof(key144_t);
+	m_fixedDataSize = 0;
+	m_useHalfKeys   = lists[0]->m_useHalfKeys;
+	if ( n <= 0 ) return true;
+
+	// . the first key of a list in the range may be compressed, our
+	//   first key in it is not
+	// . the other keys compress at least as well as they did in the lists
+	if ( ! growList ( size + 12 * n ) ) return false;
+
+	posdbMergeSrcs_r ( srcs , n , m_alloc + m_allocSize , removeNegKeys );
+	return true;
+}
+
+// . add the lists made by posdbMergeRange_r() to this list, in order,
+//   like posdbMerge_r() would have merged them
+// . prepareForMerge() must have made room for all the keys
+void RdbList::posdbAddMergedRanges ( RdbList    **ranges    ,
+				     int32_t      numRanges ,
+				     const char  *startKey  ,
+				     const char  *endKey    ) {
+	// sanity
+	if ( m_ks != sizeof(key144_t) ) { g_process.shutdownAbort(true); }
+	KEYSET(m_startKey,startKey,sizeof(key144_t));
+	KEYSET(m_endKey,endKey,sizeof(key144_t));
+
+	char *p = m_listPtr;
+	for ( int32_t i = 0 ; i < numRanges ; i++ ) {
+		RdbList *r = ranges[i];
+		if ( r->isEmpty() ) continue;
+		if ( p + r->m_listSize > m_alloc + m_allocSize ) {
+			g_process.shutdownAbort(true);
+		}
+		// . the first key of the range is a full key, compress it
+		//   against the last key we have
+		// . "skip" is how many bytes it shrinks by
+		const char *k = r->m_list;
+		int32_t skip = 0;
+		if ( m_listPtrHi && cmp_6bytes_equal ( k + 12 , m_listPtrHi ) ) {
+			if ( m_listPtrLo && cmp_6bytes_equal ( k + 6 , m_listPtrLo ) ) {
+				memcpy ( p , k , 6 );
+				*p |= 0x06;
+				skip = 12;
+			}
+			else {
+				memcpy ( p , k , 12 );
+				*p = (*p&~0x04)|0x02;
+				m_listPtrLo = p + 6;
+				skip = 6;
+			}
+		}
+		else {
+			memcpy ( p , k , 18 );
+			m_listPtrLo = p + 6;
+			m_listPtrHi = p + 12;
+		}
+		memcpy ( p + 18 - skip , k + 18 , r->m_listSize - 18 );
+		// the hi and lo keys of the range's last key, if not its first
+		if ( r->m_listPtrLo > k + 6 )
+			m_listPtrLo = p + ( r->m_listPtrLo - k ) - skip;
+		if ( r->m_listPtrHi > k + 12 )
+			m_listPtrHi = p + ( r->m_listPtrHi - k ) - skip;
+		p += r->m_listSize - skip;
+		if ( r->m_lastKeyIsValid ) {
+			memcpy ( m_lastKey , r->m_lastKey , sizeof(key144_t) );
+			m_lastKeyIsValid = true;
+		}
+	}
+
+	m_listPtr  = p;
+	m_listSize = m_listPtr - m_list;
+	m_listEnd  = m_list + m_listSize;
+}
+
 void RdbList::setFromPtr ( char *p , int32_t psize , char rdbId ) {
 
 	// free and NULLify any old m_list we had to make room for our new list
@@ -193,6 +193,15 @@ class RdbList {
 			 const char   *filename    ,
 			 int32_t    niceness    ) ;
 
+	template <char KS>
+	bool constrainKeys ( const char   *startKey    ,
+			     char   *endKey      ,
+			     int32_t    minRecSizes ,
+			     int32_t    hintOffset  ,
+			     const char   *hintKey     ,
+			     const char   *filename    ,
+			     int32_t    niceness    ) ;
+
 	// . this MUST be called before calling merge_r() 
 	// . will alloc enough space for m_listSize + sizes of "lists"
 	bool prepareForMerge ( RdbList **lists            , 
@@ -211,6 +220,16 @@ class RdbList {
 		       char      rdbId         ,
 		       int32_t      niceness      );
 
+	// the merge loop of merge_r() for a key size, see KEYSIZE_SWITCH()
+	template <char KS>
+	void mergeKeys_r ( RdbList **lists         ,
+			   int32_t      numLists      ,
+			   const char     *endKey        ,
+			   int32_t      minRecSizes   ,
+			   bool      removeNegRecs ,
+			   char      rdbId         ,
+			   int32_t      startListSize );
+
 	bool posdbMerge_r ( RdbList **lists         ,  
 			    int32_t      numLists      ,
 			    const char     *startKey      ,
@@ -219,6 +238,20 @@ class RdbList {
 			    bool      removeNegKeys ,
 			    int32_t      niceness       ) ;
 
+	// . merge one docid range of a big posdb merge into this list
+	// . Msg5 merges the ranges in parallel and then adds them to the
+	//   final list with posdbAddMergedRanges()
+	bool posdbMergeRange_r ( RdbList    **lists         ,
+				 int32_t      numLists      ,
+				 const char  *startKey      ,
+				 const char  *stopKey       ,
+				 bool         removeNegKeys );
+
+	void posdbAddMergedRanges ( RdbList    **ranges    ,
+				    int32_t      numRanges ,
+				    const char  *startKey  ,
+				    const char  *endKey    );
+
 
 	// returns false if we skipped into a black hole (end of list)
 	int32_t getRecSize ( const char *rec ) const {
@@ -330,6 +363,12 @@ class RdbList {
 
 	// keysize, usually 12, for 12 bytes. can be 16 for date index (datedb)
 	char   m_ks;
+
+ private:
+	bool posdbMergeSrcs_r ( struct PosdbMergeSrc *srcs ,
+				int32_t numSrcs ,
+				const char *maxPtr ,
+				bool removeNegKeys );
 };
 
 #endif // GB_RDBLIST_H
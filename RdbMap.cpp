@@ -6,8 +6,100 @@
 #include "BitOperations.h"
 #include "Conf.h"
 
+// . the first 8 bytes of a map file with packed segments. a map file in the
+//   old format starts with the size of the data file, which is never negative
+// . followed by a 4 byte version and then the same header as before
+#define MAP_PACKED_MAGIC   ((int64_t)0xf1a6d3b5c7e9028bULL)
+#define MAP_PACKED_VERSION 1
+
+// keep the full key of every this many pages of a packed segment
+#define PACKED_BLOCK_PAGES 16
+
+// . a packed segment is:
+//   int32_t size        total bytes including this
+//   int32_t numPages    pages in the segment
+//   int32_t blockOffs[] offset of each block's deltas in the delta bytes
+//   char    blockKeys[] full key of the first page of each block
+//   deltas              for the other pages of each block, one byte telling
+//                       how many of the top key bytes are the same as in the
+//                       previous page's key, then the key bytes below those
+#define PACKED_HDR_SIZE 8
+
+static int32_t getNumBlocks ( int32_t numPages ) {
+	return (numPages + PACKED_BLOCK_PAGES - 1) / PACKED_BLOCK_PAGES;
+}
+
+// how many of the top (most significant) bytes of the keys are equal
+static int32_t getSharedBytes ( const char *k1 , const char *k2 , char ks ) {
+	int32_t n = 0;
+	while ( n < ks && k1[ks-1-n] == k2[ks-1-n] ) n++;
+	return n;
+}
+
+// . pack "numPages" keys from "keys"
+// . returns NULL and sets g_errno on error
+static char *packKeys ( const char *keys , int32_t numPages , char ks ) {
+	int32_t numBlocks = getNumBlocks ( numPages );
+	int32_t deltaSize = 0;
+	for ( int32_t i = 0 ; i < numPages ; i++ ) {
+		if ( ( i % PACKED_BLOCK_PAGES ) == 0 ) continue;
+		deltaSize += 1 + ks - getSharedBytes ( keys+i*ks , keys+(i-1)*ks , ks );
+	}
+	int32_t size = PACKED_HDR_SIZE + numBlocks * (4 + ks) + deltaSize;
+	char *buf = (char *)mmalloc ( size , "RdbMap" );
+	if ( ! buf ) return NULL;
+	*(int32_t *)buf       = size;
+	*(int32_t *)(buf + 4) = numPages;
+	int32_t *blockOffs = (int32_t *)(buf + PACKED_HDR_SIZE);
+	char    *blockKeys = buf + PACKED_HDR_SIZE + numBlocks * 4;
+	char    *deltas    = blockKeys + numBlocks * ks;
+	char    *p         = deltas;
+	for ( int32_t i = 0 ; i < numPages ; i++ ) {
+		const char *k = keys + i * ks;
+		if ( ( i % PACKED_BLOCK_PAGES ) == 0 ) {
+			int32_t b = i / PACKED_BLOCK_PAGES;
+			blockOffs[b] = p - deltas;
+			gbmemcpy ( blockKeys + b * ks , k , ks );
+			continue;
+		}
+		int32_t shared = getSharedBytes ( k , k - ks , ks );
+		*p++ = (char)shared;
+		gbmemcpy ( p , k , ks - shared );
+		p += ks - shared;
+	}
+	return buf;
+}
+
+// . make sure a packed segment read from disk will not make us read past it
+// . returns the number of pages in it or -1 if it is bad
+static int32_t verifyPacked ( const char *buf , char ks ) {
+	int32_t size     = *(const int32_t *)buf;
+	int32_t numPages = *(const int32_t *)(buf + 4);
+	if ( numPages <= 0 || numPages > PAGES_PER_SEGMENT ) return -1;
+	int32_t numBlocks = getNumBlocks ( numPages );
+	int32_t deltaStart = PACKED_HDR_SIZE + numBlocks * (4 + ks);
+	if ( deltaStart > size ) return -1;
+	const int32_t *blockOffs = (const int32_t *)(buf + PACKED_HDR_SIZE);
+	const char *p   = buf + deltaStart;
+	const char *end = buf + size;
+	for ( int32_t i = 0 ; i < numPages ; i++ ) {
+		if ( ( i % PACKED_BLOCK_PAGES ) == 0 ) {
+			if ( buf + deltaStart + blockOffs[i/PACKED_BLOCK_PAGES] != p )
+				return -1;
+			continue;
+		}
+		if ( p >= end ) return -1;
+		int32_t shared = (unsigned char)*p++;
+		if ( shared > ks || p + ks - shared > end ) return -1;
+		p += ks - shared;
+	}
+	if ( p != end ) return -1;
+	return numPages;
+}
+
 RdbMap::RdbMap() {
 	m_numSegments = 0;
+	m_numPackedSegments = 0;
 	m_numSegmentPtrs = 0;
 	m_numSegmentOffs = 0;
 	m_newPagesPerSegment = 0;
@@ -80,7 +172,10 @@ void RdbMap::reset ( ) {
 
 	for ( int32_t i = 0 ; i < m_numSegments; i++ ) {
 		//mfree(m_keys[i],sizeof(key_t)*PAGES_PER_SEGMENT,"RdbMap");
-		mfree(m_keys[i],m_ks *pps,"RdbMap");
+		if ( i < m_numPackedSegments )
+			mfree(m_keys[i],*(int32_t *)m_keys[i],"RdbMap");
+		else
+			mfree(m_keys[i],m_ks *pps,"RdbMap");
 		mfree(m_offsets[i], 2*pps,"RdbMap");
 		// set to NULL so we know if accessed illegally
 		m_keys   [i] = NULL;
@@ -95,6 +190,11 @@ void RdbMap::reset ( ) {
 	m_numSegmentOffs = 0;
 
 	m_newPagesPerSegment = 0;
+	m_numPackedSegments  = 0;
+	m_packedMem          = 0;
+	m_keyBufSeg          = -1;
+	m_keyBufPage         = 0;
+	m_keyBufPtr          = NULL;
 
 	m_needToWrite     = false;
 	m_fileStartOffset = 0LL;
@@ -174,7 +274,20 @@ bool RdbMap::writeMap2 ( ) {
 		loghex(LOG_DEBUG, m_lastKey, m_ks, " m_lastKey........: (hexdump)");
 	}
 	
-	// first 8 bytes are the size of the DATA file we're mapping
+	// the magic and version of the packed format
+	int64_t magic = MAP_PACKED_MAGIC;
+	int32_t version = MAP_PACKED_VERSION;
+	m_file.write ( &magic , 8 , offset );
+	if ( ! g_errno ) m_file.write ( &version , 4 , offset + 8 );
+	if ( g_errno ) {
+		log(LOG_ERROR, "%s:%s: Failed to write to %s (magic): %s",
+		    __FILE__, __func__, m_file.getFilename(), mstrerror(g_errno));
+		return false;
+	}
+
+	offset += 12;
+
+	// next 8 bytes are the size of the DATA file we're mapping
 	m_file.write ( &m_offset , 8 , offset );
 	if ( g_errno )  {
 		log(LOG_ERROR, "%s:%s: Failed to write to %s (m_offset): %s",
@@ -244,6 +357,8 @@ bool RdbMap::writeMap2 ( ) {
 }
 
 
+// . segments are always written packed, followed by their offsets
+// . returns the new offset or 0 on error
 int64_t RdbMap::writeSegment ( int32_t seg , int64_t offset ) {
 	// how many pages have we written?
 	int32_t pagesWritten = seg * PAGES_PER_SEGMENT;
@@ -253,19 +368,24 @@ int64_t RdbMap::writeSegment ( int32_t seg , int64_t offset ) {
 	if ( pagesLeft <= 0 ) return offset;
 	// truncate to segment's worth of pages for writing purposes
 	if ( pagesLeft > PAGES_PER_SEGMENT ) pagesLeft = PAGES_PER_SEGMENT;
-	// determine writeSize for keys
-	//int32_t writeSize = pagesLeft * sizeof(key_t);
-	int32_t writeSize = pagesLeft * m_ks;
+	// pack the keys of the segment we are still adding to
+	char *packed = m_keys[seg];
+	if ( seg >= m_numPackedSegments ) {
+		packed = packKeys ( m_keys[seg] , pagesLeft , m_ks );
+		if ( ! packed ) return 0;
+	}
+	int32_t writeSize = *(int32_t *)packed;
 	// write the keys segment
 	g_errno = 0;
-	m_file.write ( (char *)m_keys[seg] , writeSize , offset );
-	if ( g_errno ) return false;//log("RdbMapFile::writeSegment: failed");
+	m_file.write ( packed , writeSize , offset );
+	if ( packed != m_keys[seg] ) mfree ( packed , writeSize , "RdbMap" );
+	if ( g_errno ) return 0;
 	offset += writeSize ;
 	// determine writeSize for relative 2-byte offsets
 	writeSize = pagesLeft * 2;
 	// write the offsets of segment
 	m_file.write ( (char *)m_offsets[seg] , writeSize , offset );
-	if ( g_errno ) return false;//log("RdbMapFile::writeSegment: failed");
+	if ( g_errno ) return 0;
 	offset += writeSize ;
 	// return the new offset
 	return offset ;
@@ -532,7 +652,8 @@ bool RdbMap::readMap2 ( ) {
 	int64_t offset = 0;
 	g_errno = 0;
 
-	// first 8 bytes are the size of the DATA file we're mapping
+	// first 8 bytes are the size of the DATA file we're mapping, unless
+	// it is the packed format
 	m_file.read ( &m_offset , 8 , offset );
 	if ( g_errno ) {
 		log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(),mstrerror(g_errno));
@@ -540,6 +661,30 @@ bool RdbMap::readMap2 ( ) {
 	}
 	offset += 8;
 
+	bool packed = false;
+	if ( m_offset == MAP_PACKED_MAGIC ) {
+		int32_t version = 0;
+		m_file.read ( &version , 4 , offset );
+		if ( g_errno ) {
+			log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(),mstrerror(g_errno));
+			return false;
+		}
+		if ( version != MAP_PACKED_VERSION ) {
+			g_errno = ECORRUPTDATA;
+			log( LOG_WARN, "db: Map file %s has unknown version %" PRId32".",
+			     m_file.getFilename(), version );
+			return false;
+		}
+		offset += 4;
+		packed = true;
+		m_file.read ( &m_offset , 8 , offset );
+		if ( g_errno ) {
+			log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(),mstrerror(g_errno));
+			return false;
+		}
+		offset += 8;
+	}
+
 	// when a BigFile gets chopped, keep up a start offset for it
 	m_file.read ( &m_fileStartOffset , 8 , offset );
 	if ( g_errno ) {
@@ -583,15 +728,83 @@ bool RdbMap::readMap2 ( ) {
 	for ( int32_t i = 0 ; offset < fileSize ; i++ ) {
 		// . this advance offset passed the read segment
 		// . it uses fileSize for reading the last partial segment
-		offset = readSegment ( i , offset , fileSize ) ;
+		if ( packed ) offset = readPackedSegment ( i , offset , fileSize );
+		else          offset = readSegment ( i , offset , fileSize ) ;
 		if ( offset<=0 ) {
 			log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(), mstrerror(g_errno));
 			return false;
 		}
 	}
+
+	// . we might resume a killed merge and add to the last segments, so
+	//   they can not stay packed
+	// . and pack the full segments of a map in the old format
+	while ( m_numPackedSegments > 0 &&
+		m_numPackedSegments * PAGES_PER_SEGMENT + 2 > m_numPages ) {
+		if ( ! unpackSegment ( m_numPackedSegments - 1 ) ) {
+			log( LOG_WARN, "db: Had error reading %s: %s.", m_file.getFilename(), mstrerror(g_errno));
+			return false;
+		}
+	}
+	packFullSegments();
 	return true;
 }
 
+// . read a packed segment and its offsets
+// . returns the new offset or -1 on error
+int64_t RdbMap::readPackedSegment ( int32_t seg , int64_t offset , int32_t fileSize ) {
+	// segments are read in order and all but the last are full
+	if ( seg != m_numSegments || m_numPackedSegments != m_numSegments ||
+	     ( m_numPages % PAGES_PER_SEGMENT ) != 0 ) {
+		g_errno = ECORRUPTDATA;
+		return -1;
+	}
+	int32_t hdr[2];
+	if ( offset + PACKED_HDR_SIZE > fileSize ) {
+		g_errno = ECORRUPTDATA;
+		return -1;
+	}
+	g_errno = 0;
+	m_file.read ( hdr , PACKED_HDR_SIZE , offset );
+	if ( g_errno ) return -1;
+	int32_t size     = hdr[0];
+	int32_t numPages = hdr[1];
+	if ( size < PACKED_HDR_SIZE || offset + size > fileSize ||
+	     numPages <= 0 || numPages > PAGES_PER_SEGMENT ||
+	     offset + size + numPages * 2 > fileSize ) {
+		g_errno = ECORRUPTDATA;
+		return -1;
+	}
+
+	if ( ! addSegmentPtr ( seg ) ) return -1;
+	char    *keys    = (char *)mmalloc ( size , "RdbMap" );
+	int16_t *offsets = (int16_t *)mmalloc ( 2 * PAGES_PER_SEGMENT , "RdbMap" );
+	if ( ! keys || ! offsets ) {
+		if ( keys    ) mfree ( keys , size , "RdbMap" );
+		if ( offsets ) mfree ( offsets , 2 * PAGES_PER_SEGMENT , "RdbMap" );
+		return -1;
+	}
+	m_file.read ( keys , size , offset );
+	if ( ! g_errno ) m_file.read ( offsets , numPages * 2 , offset + size );
+	if ( g_errno || verifyPacked ( keys , m_ks ) != numPages ) {
+		mfree ( keys , size , "RdbMap" );
+		mfree ( offsets , 2 * PAGES_PER_SEGMENT , "RdbMap" );
+		if ( ! g_errno ) g_errno = ECORRUPTDATA;
+		return -1;
+	}
+	for ( int32_t j = numPages ; j < PAGES_PER_SEGMENT ; j++ )
+		offsets[j] = -1;
+
+	m_keys   [seg] = keys;
+	m_offsets[seg] = offsets;
+	m_numSegments++;
+	m_numPackedSegments++;
+	m_packedMem   += size;
+	m_maxNumPages += PAGES_PER_SEGMENT;
+	m_numPages    += numPages;
+	return offset + size + numPages * 2;
+}
+
 int64_t RdbMap::readSegment ( int32_t seg , int64_t offset , int32_t fileSize ) {
 	// . add a new segment for this
 	// . increments m_numSegments and increases m_maxNumPages
@@ -754,11 +967,16 @@ bool RdbMap::addRecord ( char *key, char *rec , int32_t recSize ) {
 	// . add crc of this rec
 	// . this offset will be -1 for unstarted pages
 	// . tally the crc until we hit a new page
-	if ( getOffset ( pageNum ) >= 0 ) return true;
-	// . if no key has claimed this page then we'll claim it
-	// . by claiming it we are the first key to be wholly on this page
-	setOffset ( pageNum , ( m_offset - recSize ) & (m_pageSize-1) );
-	setKey    ( pageNum , key );
+	if ( getOffset ( pageNum ) < 0 ) {
+		// . if no key has claimed this page then we'll claim it
+		// . by claiming it we are the first key to be wholly on this page
+		setOffset ( pageNum , ( m_offset - recSize ) & (m_pageSize-1) );
+		setKey    ( pageNum , key );
+	}
+	// pack the segments we will not add to any more
+	if ( m_numPackedSegments < m_numSegments &&
+	     (m_numPackedSegments + 1) * PAGES_PER_SEGMENT + 2 <= m_numPages )
+		packFullSegments();
 	// success!
 	return true;
 }
@@ -1118,10 +1336,11 @@ bool RdbMap::getPageRange ( key_t  startKey  , key_t endKey  ,
 // . if m_keys[N] > startKey then m_keys[N-1] spans multiple pages so that
 //   the key immediately after it on disk is in fact, m_keys[N]
 //int32_t RdbMap::getPage ( key_t startKey ) {
+template <char KS>
 int32_t RdbMap::getPage ( const char *startKey ) {
 	// if the key exceeds our lastKey then return m_numPages
 	//if ( startKey > m_lastKey ) return m_numPages;
-	if ( KEYCMP(startKey,m_lastKey,m_ks)>0 ) return m_numPages;
+	if ( KEYCMP<KS>(startKey,m_lastKey,m_ks)>0 ) return m_numPages;
 	// . find the disk offset based on "startKey"
 	// . b-search over the map of pages
 	// . "n"   is the page # that has a key <= "startKey"
@@ -1131,19 +1350,19 @@ int32_t RdbMap::getPage ( const char *startKey ) {
 	while ( step > 0 ) {
 		//if   ( startKey <= getKey ( n ) ) n -= step;
 		//else                              n += step;
-		if   ( KEYCMP(startKey,getKeyPtr(n),m_ks)<=0 ) n -= step;
+		if   ( KEYCMP<KS>(startKey,getKeyPtr(n),m_ks)<=0 ) n -= step;
 		else                                        n += step;
 		step >>= 1; // divide by 2
 	}
 	// . let's adjust for the inadaquecies of the above algorithm...
 	// . increment n until our key is >= the key in the table
 	//while ( n < m_numPages - 1 &&  getKey(n) < startKey ) n++;
-	while ( n<m_numPages - 1 && KEYCMP(getKeyPtr(n),startKey,m_ks)<0 ) n++;
+	while ( n<m_numPages - 1 && KEYCMP<KS>(getKeyPtr(n),startKey,m_ks)<0 ) n++;
 	// . decrement n until page key is LESS THAN OR EQUAL to startKey
 	// . it is now <= the key, not just <, since, if the positive
 	//   key exists it, then the negative should not be in this file, too!
 	//while ( n > 0              &&  getKey(n) > startKey ) n--;
-	while ( n>0              && KEYCMP(getKeyPtr(n),startKey,m_ks)>0 ) n--;
+	while ( n>0              && KEYCMP<KS>(getKeyPtr(n),startKey,m_ks)>0 ) n--;
 	// debug point
 	//if ( m_offsets[n] == -1 && m_keys[n] == startKey &&
 	//m_keys[n-1] != startKey )
@@ -1166,6 +1385,10 @@ int32_t RdbMap::getPage ( const char *startKey ) {
 	//return n;
 }
 
+int32_t RdbMap::getPage ( const char *startKey ) {
+	return KEYSIZE_SWITCH ( m_ks , getPage , startKey );
+}
+
 void RdbMap::printMap () {
 	int32_t h = 0;
 	for ( int i = 0 ; i < m_numPages; i++ ) {
@@ -1206,7 +1429,85 @@ int64_t RdbMap::getMemAlloced ( ) {
 	//int64_t space = PAGES_PER_SEGMENT * (sizeof(key_t) + 2);
 	int64_t space = PAGES_PER_SEGMENT * (m_ks + 2);
 	// how many segments we use * segment allocation
-	return (int64_t)m_numSegments * space;
+	int64_t mem = (int64_t)(m_numSegments - m_numPackedSegments) * space;
+	// packed segments only keep their offsets unpacked
+	return mem + m_packedMem + (int64_t)m_numPackedSegments * PAGES_PER_SEGMENT * 2;
+}
+
+// . decode key #n of packed segment "seg" into m_keyBuf
+// . keeps where it left off, so going through the pages in order only
+//   decodes each key once
+char *RdbMap::getPackedKey ( int32_t seg , int32_t n ) {
+	const char *buf = m_keys[seg];
+	int32_t numBlocks = getNumBlocks ( *(const int32_t *)(buf + 4) );
+	int32_t b = n / PACKED_BLOCK_PAGES;
+	if ( seg == m_keyBufSeg && m_keyBufPage == n ) return m_keyBuf;
+	int32_t i;
+	const char *p;
+	if ( seg == m_keyBufSeg && m_keyBufPage < n &&
+	     m_keyBufPage / PACKED_BLOCK_PAGES == b ) {
+		i = m_keyBufPage;
+		p = m_keyBufPtr;
+	}
+	else {
+		const int32_t *blockOffs = (const int32_t *)(buf + PACKED_HDR_SIZE);
+		const char *blockKeys = buf + PACKED_HDR_SIZE + numBlocks * 4;
+		KEYSET ( m_keyBuf , blockKeys + b * m_ks , m_ks );
+		i = b * PACKED_BLOCK_PAGES;
+		p = blockKeys + numBlocks * m_ks + blockOffs[b];
+	}
+	for ( ; i < n ; i++ ) {
+		int32_t len = m_ks - (unsigned char)*p++;
+		gbmemcpy ( m_keyBuf , p , len );
+		p += len;
+	}
+	m_keyBufSeg  = seg;
+	m_keyBufPage = n;
+	m_keyBufPtr  = (char *)p;
+	return m_keyBuf;
+}
+
+// pack all the full segments below the last pages of the map
+void RdbMap::packFullSegments ( ) {
+	while ( m_numPackedSegments < m_numSegments &&
+		(m_numPackedSegments + 1) * PAGES_PER_SEGMENT + 2 <= m_numPages ) {
+		// keep them unpacked if out of memory, try again later
+		if ( ! packSegment ( m_numPackedSegments ) ) {
+			g_errno = 0;
+			return;
+		}
+	}
+}
+
+// . segment "seg" must be the first unpacked one and be full
+// . returns false and sets g_errno on error
+bool RdbMap::packSegment ( int32_t seg ) {
+	if ( seg != m_numPackedSegments ) { g_process.shutdownAbort(true); }
+	char *packed = packKeys ( m_keys[seg] , PAGES_PER_SEGMENT , m_ks );
+	if ( ! packed ) return false;
+	mfree ( m_keys[seg] , m_ks * PAGES_PER_SEGMENT , "RdbMap" );
+	m_keys[seg] = packed;
+	m_packedMem += *(int32_t *)packed;
+	m_numPackedSegments++;
+	return true;
+}
+
+// . segment "seg" must be the last packed one
+// . returns false and sets g_errno on error
+bool RdbMap::unpackSegment ( int32_t seg ) {
+	if ( seg != m_numPackedSegments - 1 ) { g_process.shutdownAbort(true); }
+	char *keys = (char *)mmalloc ( m_ks * PAGES_PER_SEGMENT , "RdbMap" );
+	if ( ! keys ) return false;
+	char *packed = m_keys[seg];
+	int32_t numPages = *(int32_t *)(packed + 4);
+	for ( int32_t i = 0 ; i < numPages ; i++ )
+		KEYSET ( keys + i * m_ks , getPackedKey ( seg , i ) , m_ks );
+	m_packedMem -= *(int32_t *)packed;
+	mfree ( packed , *(int32_t *)packed , "RdbMap" );
+	m_keys[seg] = keys;
+	m_numPackedSegments--;
+	m_keyBufSeg = -1;
+	return true;
 }
 
 bool RdbMap::addSegmentPtr ( int32_t n ) {
@@ -1386,7 +1687,12 @@ bool RdbMap::chopHead ( int32_t fileHeadSize ) {
 	int32_t ks = m_ks;
 	// remove segments before segNum
 	for ( int32_t i = 0 ; i < segNum ; i++ ) {
-		mfree ( m_keys   [i] , ks * PAGES_PER_SEGMENT , "RdbMap" );
+		if ( i < m_numPackedSegments ) {
+			m_packedMem -= *(int32_t *)m_keys[i];
+			mfree ( m_keys[i] , *(int32_t *)m_keys[i] , "RdbMap" );
+		}
+		else
+			mfree ( m_keys[i] , ks * PAGES_PER_SEGMENT , "RdbMap" );
 		mfree ( m_offsets[i] , 2  * PAGES_PER_SEGMENT , "RdbMap" );
 		// set to NULL so we know if accessed illegally
 		m_keys   [i] = NULL;
@@ -1394,6 +1700,9 @@ bool RdbMap::chopHead ( int32_t fileHeadSize ) {
 	}
 	// adjust # of segments down
 	m_numSegments -= segNum;
+	m_numPackedSegments -= segNum;
+	if ( m_numPackedSegments < 0 ) m_numPackedSegments = 0;
+	m_keyBufSeg = -1;
 	// same with max # of used pages
 	m_maxNumPages -= PAGES_PER_SEGMENT * segNum ;
 	// same with # of used pages, since the head was ALL used
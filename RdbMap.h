@@ -212,19 +212,17 @@ class RdbMap {
 	// . if page >= m_numPages use the lastKey in the file
 	//key_t getKey              ( int32_t page ) { 
 	void getKey ( int32_t page , char *k ) { 
-		if ( page >= m_numPages ) {KEYSET(k,m_lastKey,m_ks);return;}
-		//return m_keys[page/PAGES_PER_SEG][page%PAGES_PER_SEG];
-	 KEYSET(k,&m_keys[page/PAGES_PER_SEG][(page%PAGES_PER_SEG)*m_ks],m_ks);
-	 return;
+		KEYSET(k,getKeyPtr(page),m_ks);
 	}
-	//const key_t *getKeyPtr ( int32_t page ) { 
+	// . the keys of a packed segment are decoded into m_keyBuf, so the
+	//   returned ptr is only good until the next call
 	char *getKeyPtr ( int32_t page ) { 
-		//if ( page >= m_numPages ) return &m_lastKey;
-		//if ( page >= m_numPages ) return m_lastKey;
 		if ( page >= m_numPages ) return m_lastKey;
-		return &m_keys[page/PAGES_PER_SEG][(page%PAGES_PER_SEG)*m_ks];
+		int32_t seg = page / PAGES_PER_SEG;
+		if ( seg < m_numPackedSegments )
+			return getPackedKey ( seg , page % PAGES_PER_SEG );
+		return &m_keys[seg][(page%PAGES_PER_SEG)*m_ks];
 	}
-	//	return getKey ( page ); }
 	// if page >= m_numPages return 0
 	int16_t getOffset           ( int32_t page ) { 
 		if ( page >= m_numPages ) {
@@ -240,6 +238,9 @@ class RdbMap {
 			gbshutdownAbort(true);
 			log(LOG_LOGIC,"RdbMap::setKey: bad engineer");return; }
 		//#endif
+		// packed segments are read-only
+		if ( page / PAGES_PER_SEG < m_numPackedSegments ) {
+			gbshutdownAbort(true); }
 		//m_keys[page/PAGES_PER_SEG][page%PAGES_PER_SEG] = k; }
 		KEYSET(&m_keys[page/PAGES_PER_SEG][(page%PAGES_PER_SEG)*m_ks],
 		       k,m_ks);
@@ -262,6 +263,8 @@ class RdbMap {
 	bool readMap     ( BigFile *dataFile );
 	bool readMap2    ( );
 	int64_t readSegment ( int32_t segment, int64_t offset, int32_t fileSize);
+	int64_t readPackedSegment ( int32_t segment, int64_t offset,
+				    int32_t fileSize );
 
 	// due to disk corruption keys or offsets can be out of order in map
 	bool verifyMap   ( BigFile *dataFile );
@@ -283,6 +286,9 @@ class RdbMap {
 	//   that the key immediately after it on disk is in fact, m_keys[N]
 	//int32_t getPage ( key_t startKey ) ;
 	int32_t getPage ( const char *startKey );
+	// a template on the key size so the b-search compares are inlined
+	template <char KS>
+	int32_t getPage ( const char *startKey );
 
 	// used in Rdb class before calling setMapSize
 	//int32_t setMapSizeFromFile ( int32_t fileSize ) ;
@@ -325,6 +331,16 @@ class RdbMap {
 
 	void printMap ();
 
+	// . full segments we are done adding to are "packed", their keys are
+	//   prefix compressed against the key of the page before them
+	// . every PACKED_BLOCK_PAGES pages the full key is kept in a small
+	//   array we can jump to, so we only decode a few keys to get one
+	// . this is also the format of the segments in the map file
+	char *getPackedKey ( int32_t seg , int32_t n );
+	void  packFullSegments ( );
+	bool  packSegment ( int32_t seg );
+	bool  unpackSegment ( int32_t seg );
+
 	// the map file
         BigFile m_file;
 
@@ -343,6 +359,17 @@ class RdbMap {
 	int16_t         **m_offsets;
 	int32_t            m_numSegmentOffs;
 
+	// . the first m_numPackedSegments segments of m_keys are packed
+	// . they always come first since we only add to the last segments
+	int32_t   m_numPackedSegments;
+	int64_t   m_packedMem;
+
+	// the last key getPackedKey() decoded and where it left off
+	char      m_keyBuf[MAX_KEY_BYTES];
+	int32_t   m_keyBufSeg;
+	int32_t   m_keyBufPage;
+	char     *m_keyBufPtr;
+
 	bool m_reducedMem;
 
 	// number of valid pages in the map.
@@ -5,10 +5,14 @@
 #include "Msg3.h"
 #include "Process.h"
 #include "Spider.h"
+#include "TitleRecDict.h"
+#include "JobScheduler.h"
 
 static void dumpListWrapper ( void *state ) ;
 static void gotListWrapper  ( void *state , RdbList *list , Msg5 *msg5 ) ;
 static void tryAgainWrapper ( int fd , void *state ) ;
+static void recompressListWrapper_r ( void *state ) ;
+static void recompressDoneWrapper ( void *state , job_exit_t exit_type ) ;
 
 RdbMerge::RdbMerge   () {}
 RdbMerge::~RdbMerge  () {}
@@ -184,6 +188,19 @@ bool RdbMerge::gotLock ( ) {
 	// . yes, but we need to avoid fragmentation, so hold on to our mem!
 	//m_msg3 = new (Msg3);
 	//if ( ! m_msg3 ) return false;
+	// . a posdb merge of all files from scratch sees every key on disk,
+	//   so use it to rebuild the term freq table
+	// . the merge target is file #0 and the files merged follow it
+	if ( m_rdbId == RDB_POSDB && startOffset == 0 && m_startFileNum == 1 &&
+	     m_startFileNum + m_numFiles == base->getNumFiles() ) {
+		base->startTermFreqRebuild();
+	}
+	// a titledb merge from scratch samples its records to train a
+	// compression dictionary
+	if ( m_rdbId == RDB_TITLEDB && startOffset == 0 ) {
+		base->startTitleRecDictTraining();
+	}
+
 	// we're now merging since the dump was set up successfully
 	m_isMerging     = true;
 	// make it suspended for now
@@ -532,9 +549,43 @@ bool RdbMerge::dumpList ( ) {
 		dedupSpiderdbList( &m_list );
 	}
 
-	// if the startKey rolled over we're done
+	if ( m_rdbId == RDB_POSDB ) {
+		RdbBase *base = getRdbBase( m_rdbId, m_collnum );
+		if ( base ) {
+			base->addMergedListToTermFreqs ( &m_list );
+		}
+	}
+
+	// . if the startKey rolled over we're done
+	// . check it before recompressing, recompressDoneWrapper() dumps the
+	//   list directly
 	//if ( m_startKey.n0 == 0LL && m_startKey.n1 == 0 ) m_doneMerging=true;
 	if ( KEYCMP(m_startKey,KEYMIN(),m_ks)==0 ) m_doneMerging = true;
+
+	// . recompress the titlerecs with the collection's dictionary and
+	//   sample them for the next one in a job thread
+	// . recompressDoneWrapper() dumps the list when done
+	if ( m_rdbId == RDB_TITLEDB && ! m_list.isEmpty() ) {
+		RdbBase *base = getRdbBase( m_rdbId, m_collnum );
+		m_titleRecDicts = base ? base->getTitleRecDicts() : NULL;
+		m_titleRecDict = NULL;
+		m_titleRecDictTrainer = base ? base->getTitleRecDictTrainer() : NULL;
+		if ( m_titleRecDictTrainer && m_titleRecDictTrainer->isFull() ) {
+			m_titleRecDictTrainer = NULL;
+		}
+		if ( g_conf.m_titleRecDicts && m_titleRecDicts ) {
+			m_titleRecDict = m_titleRecDicts->getCurrentDict();
+		}
+		if ( m_titleRecDict || m_titleRecDictTrainer ) {
+			if ( g_jobScheduler.submit ( recompressListWrapper_r , recompressDoneWrapper ,
+						     this , thread_type_file_merge , m_niceness ) ) {
+				return false;
+			}
+			// no thread, do it here
+			recompressListWrapper_r ( this );
+		}
+	}
+
 	// debug msg
 	log(LOG_DEBUG,"db: Dumping list.");
 	// debug msg
@@ -553,6 +604,24 @@ bool RdbMerge::dumpList ( ) {
 	return m_dump.dumpList ( &m_list , m_niceness , false/*recall?*/ ) ;
 }
 
+void recompressListWrapper_r ( void *state ) {
+	RdbMerge *THIS = (RdbMerge *)state;
+	// on error the list is dumped as it is
+	if ( ! recompressTitledbList ( &THIS->m_list , THIS->m_titleRecDicts ,
+				       THIS->m_titleRecDict , THIS->m_titleRecDictTrainer ) ) {
+		log( LOG_WARN, "db: Could not recompress merged titledb list: %s",
+		     mstrerror(g_errno) );
+		g_errno = 0;
+	}
+}
+
+void recompressDoneWrapper ( void *state , job_exit_t /*exit_type*/ ) {
+	RdbMerge *THIS = (RdbMerge *)state;
+	// it calls dumpListWrapper when done dumping
+	if ( ! THIS->m_dump.dumpList ( &THIS->m_list , THIS->m_niceness , false ) ) return;
+	dumpListWrapper ( THIS );
+}
+
 void RdbMerge::doneMerging ( ) {
 	// save this
 	int32_t saved = g_errno;
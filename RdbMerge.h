@@ -141,6 +141,11 @@ class RdbMerge {
 	collnum_t m_collnum;
 
 	char      m_ks;
+
+	// for recompressing titledb lists, see TitleRecDict.h
+	const class TitleRecDicts *m_titleRecDicts;
+	const class TitleRecDict  *m_titleRecDict;
+	class TitleRecDictTrainer *m_titleRecDictTrainer;
 };
 
 #endif // GB_RDBMERGE_H
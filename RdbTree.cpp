@@ -257,23 +257,44 @@ int32_t RdbTree::clear ( ) {
 	return count;
 }
 
-// . used by cache 
-// . wrapper for getNode()
-int32_t RdbTree::getNode ( collnum_t collnum, const char *key ) {
+// . walk down the tree to the node with "collnum" and "key"
+// . returns that node, or -1 if none and then "parent" is the last node we
+//   visited, which is where the key would go
+// . if "allowDups" we always go right on an equal key, so never find one
+// . a template on the key size so the compare is inlined, see
+//   KEYSIZE_SWITCH() in types.h
+template <char KS>
+int32_t RdbTree::findNode ( collnum_t collnum, const char *key,
+			    int32_t *parent, bool allowDups ) const {
 	int32_t i = m_headNode;
+	*parent = -1;
 	// get the node (about 4 cycles per loop, 80cycles for 1 million items)
 	while ( i != -1 ) {
+		*parent = i;
 		if ( collnum < m_collnums[i] ) { i = m_left [i]; continue;}
 		if ( collnum > m_collnums[i] ) { i = m_right[i]; continue;}
-		//if ( key <  m_keys[i] ) { i = m_left [i]; continue;}
-		//if ( key >  m_keys[i] ) { i = m_right[i]; continue;}
-		if ( KEYCMP(key,0,m_keys,i,m_ks)<0) { i=m_left [i]; continue;}
-		if ( KEYCMP(key,0,m_keys,i,m_ks)>0) { i=m_right[i]; continue;}
-		return i;
-        }
+		char cmp = KEYCMP<KS> ( key , m_keys + i * m_ks , m_ks );
+		if ( cmp < 0 ) { i = m_left [i]; continue;}
+		if ( cmp > 0 ) { i = m_right[i]; continue;}
+		if ( ! allowDups ) return i;
+		i = m_right[i];
+	}
 	return -1;
 }
 
+int32_t RdbTree::findNode ( collnum_t collnum, const char *key,
+			    int32_t *parent, bool allowDups ) const {
+	return KEYSIZE_SWITCH ( m_ks , findNode , 
+				collnum , key , parent , allowDups );
+}
+
+// . used by cache 
+// . wrapper for getNode()
+int32_t RdbTree::getNode ( collnum_t collnum, const char *key ) {
+	int32_t parent;
+	return findNode ( collnum , key , &parent , false );
+}
+
 // . returns node # whose key is >= "key"
 // . returns -1 if none
 // . used by RdbTree::getList()
@@ -285,27 +306,9 @@ int32_t RdbTree::getNode ( collnum_t collnum, const char *key ) {
 int32_t RdbTree::getNextNode ( collnum_t collnum, const char *key ) {
 	// return -1 if no non-empty nodes in the tree
 	if ( m_headNode < 0 ) return -1;
-	// get the node (about 4 cycles per loop, 80cycles for 1 million items)
 	int32_t parent;
-	int32_t i = m_headNode ;
-	// . set i tom_hint if it's < key
-	// . this helps out severly unbalanced trees made by spiderdb
-	// . it may hurt other guys a bit though
-	//if (m_hint >= 0 && 
-	//m_lastStartNode < m_numNodes &&
-	//m_parents [m_hint ] != -2 &&
-	//m_keys    [m_hint ] <= key ) 
-	//i =m_hint;
-	while ( i != -1 ) {
-		parent = i;
-		if ( collnum < m_collnums[i] ) { i = m_left [i]; continue;}
-		if ( collnum > m_collnums[i] ) { i = m_right[i]; continue;}
-		//if ( key <  m_keys[i] ) { i = m_left [i]; continue;}
-		//if ( key >  m_keys[i] ) { i = m_right[i]; continue;}
-		if (KEYCMP(key,0,m_keys,i,m_ks)<0) { i = m_left [i]; continue;}
-		if (KEYCMP(key,0,m_keys,i,m_ks)>0) { i = m_right[i]; continue;}
-		return i;
-        }
+	int32_t i = findNode ( collnum , key , &parent , false );
+	if ( i >= 0 ) return i;
 	if ( m_collnums [ parent ] >  collnum ) return parent;
 	if ( m_collnums [ parent ] == collnum && //m_keys [ parent ] > key ) 
 	     KEYCMP(m_keys,parent,key,0,m_ks)>0 )
@@ -336,19 +339,9 @@ int32_t RdbTree::getLastNode ( ) {
 int32_t RdbTree::getPrevNode ( collnum_t collnum, const char *key ) {
 	// return -1 if no non-empty nodes in the tree
 	if ( m_headNode < 0  ) return -1;
-	// get the node (about 4 cycles per loop, 80cycles for 1 million items)
 	int32_t parent;
-	int32_t i = m_headNode ;
-	while ( i != -1 ) {
-		parent = i;
-		if ( collnum < m_collnums[i] ) { i = m_left [i]; continue;}
-		if ( collnum > m_collnums[i] ) { i = m_right[i]; continue;}
-		//if ( key <  m_keys[i] ) { i = m_left [i]; continue;}
-		//if ( key >  m_keys[i] ) { i = m_right[i]; continue;}
-		if ( KEYCMP(key,0,m_keys,i,m_ks)<0) {i=m_left [i];continue;}
-		if ( KEYCMP(key,0,m_keys,i,m_ks)>0) {i=m_right[i];continue;}
-		return i;
-        }
+	int32_t i = findNode ( collnum , key , &parent , false );
+	if ( i >= 0 ) return i;
 	if ( m_collnums [ parent ] <  collnum ) return parent;
 	if ( m_collnums [ parent ] == collnum && //m_keys [ parent ] < key ) 
 	     KEYCMP(m_keys,parent,key,0,m_ks) < 0 ) return parent;
@@ -479,21 +472,10 @@ int32_t RdbTree::addNode ( collnum_t collnum , const char *key , char *data , in
 		unprotect ( ); 
 	}
 	// . find the parent of node i and call it "iparent"
-	// . if a node exists with our key then replace it
-	while ( i != -1 ) {
-		iparent = i;
-		if ( collnum < m_collnums[i] ) { i = m_left [i]; continue;}
-		if ( collnum > m_collnums[i] ) { i = m_right[i]; continue;}
-		//if      ( key < m_keys[i] ) i = m_left [i]; 
-		//else if ( key > m_keys[i] ) i = m_right[i]; 
-		if      ( KEYCMP(key,0,m_keys,i,m_ks)<0) i = m_left [i];
-		else if ( KEYCMP(key,0,m_keys,i,m_ks)>0) i = m_right[i];
-		else    {
-			if ( ! m_allowDups ) goto replaceIt; 
-			// otherwise, always go right on equal
-			i = m_right[i];
-		}
-	}
+	// . if a node exists with our key then replace it, unless we allow
+	//   dups, then we always go right on equal
+	i = findNode ( collnum , key , &iparent , m_allowDups );
+	if ( i >= 0 ) goto replaceIt;
 
 	// . this overhead is key/left/right/parent
 	// . we inc it by the data and sizes array if we need to below
@@ -359,6 +359,14 @@ class RdbTree {
 			     RdbMem    *stack      ,
 			     int64_t  offset     );
 
+	// walk down the tree to a key, used by getNode(), getNextNode(),
+	// getPrevNode() and addNode()
+	int32_t findNode ( collnum_t collnum, const char *key,
+			   int32_t *parent, bool allowDups ) const;
+	template <char KS>
+	int32_t findNode ( collnum_t collnum, const char *key,
+			   int32_t *parent, bool allowDups ) const;
+
 	void setDepths    ( int32_t bottomNode );
 	int32_t rotateRight  ( int32_t pivotNode );
 	int32_t rotateLeft   ( int32_t pivotNode );
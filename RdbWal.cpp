@@ -0,0 +1,415 @@
+#include "gb-include.h"
+
+#include "RdbWal.h"
+#include "Conf.h"
+#include "Dir.h"
+#include "Log.h"
+#include "Mem.h"
+#include <zlib.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const uint32_t s_magic   = 0x4c415747; // "GWAL"
+static const uint32_t s_version = 1;
+
+// magic, version, key size and padding
+static const int32_t s_fileHeaderSize  = 12;
+// payload size, checksum, type, flags and collnum
+static const int32_t s_frameHeaderSize = 12;
+
+// sanity limit for the payload size of a frame read back
+static const int32_t s_maxFrameSize = 512*1024*1024;
+
+struct WalSyncState {
+	RdbWal *m_wal;
+	int     m_fd;
+	int     m_errno;
+	char    m_dbname[64];
+};
+
+static uint32_t getFrameChecksum ( char type , char flags , collnum_t collnum ,
+				   const char *data , int32_t dataSize ) {
+	unsigned char hdr[4];
+	hdr[0] = type;
+	hdr[1] = flags;
+	memcpy ( hdr + 2 , &collnum , 2 );
+	uLong crc = crc32 ( 0L , hdr , sizeof(hdr) );
+	if ( dataSize > 0 ) crc = crc32 ( crc , (const Bytef *)data , dataSize );
+	return (uint32_t)crc;
+}
+
+// read exactly "size" bytes unless at the end of the file
+static int32_t readFully ( int fd , char *buf , int32_t size ) {
+	int32_t done = 0;
+	while ( done < size ) {
+		ssize_t n = ::read ( fd , buf + done , size - done );
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n < 0 ) return -1;
+		if ( n == 0 ) break;
+		done += n;
+	}
+	return done;
+}
+
+static bool writeFully ( int fd , const char *buf , int32_t size , int32_t *written ) {
+	*written = 0;
+	while ( *written < size ) {
+		ssize_t n = ::write ( fd , buf + *written , size - *written );
+		if ( n < 0 && errno == EINTR ) continue;
+		if ( n < 0 ) return false;
+		*written += n;
+	}
+	return true;
+}
+
+RdbWal::RdbWal()
+  : m_buf(), m_replayBuf()
+{
+	m_dbname[0] = '\0';
+	m_fd = -1;
+	m_replayFd = -1;
+	reset();
+}
+
+RdbWal::~RdbWal() {
+	reset();
+}
+
+void RdbWal::reset ( ) {
+	if ( m_fd >= 0 ) ::close ( m_fd );
+	closeReplaySegment();
+	m_dir[0]    = '\0';
+	m_dbname[0] = '\0';
+	m_ks        = 0;
+	m_fd        = -1;
+	m_seq       = 1;
+	m_needsSync = false;
+	m_syncing   = false;
+	m_buf.purge();
+	m_segments.clear();
+	m_replaySegments.clear();
+	m_replayIndex       = 0;
+	m_replayHaveFrame   = false;
+	m_replayType        = 0;
+	m_replayFlags       = 0;
+	m_replayCollnum     = 0;
+	m_replayBuf.purge();
+	m_numReplayedFrames = 0;
+}
+
+void RdbWal::makeFilename ( char *buf , int32_t bufSize , int32_t seq ) const {
+	snprintf ( buf , bufSize , "%s/%s-wal%06" PRId32".dat" , m_dir , m_dbname , seq );
+}
+
+bool RdbWal::init ( const char *dir , const char *dbname , char keySize ) {
+	reset();
+	snprintf ( m_dir    , sizeof(m_dir)    , "%s" , dir    );
+	snprintf ( m_dbname , sizeof(m_dbname) , "%s" , dbname );
+	m_ks = keySize;
+
+	Dir d;
+	if ( ! d.set ( dir ) || ! d.open ( ) ) {
+		log(LOG_WARN,"db: could not open %s to look for %s write-ahead "
+		    "log segments",dir,dbname);
+		m_dbname[0] = '\0';
+		return false;
+	}
+	char pattern[96];
+	snprintf ( pattern , sizeof(pattern) , "%s-wal*" , dbname );
+	int32_t plen = strlen ( pattern ) - 1;
+	const char *filename;
+	while ( ( filename = d.getNextFilename ( pattern ) ) ) {
+		// <dbname>-wal<seq>.dat
+		const char *p = filename + plen;
+		if ( ! is_digit ( *p ) ) continue;
+		char *end;
+		long seq = strtol ( p , &end , 10 );
+		if ( strcmp ( end , ".dat" ) != 0 || seq <= 0 ) continue;
+		m_segments.push_back ( (int32_t)seq );
+	}
+	std::sort ( m_segments.begin() , m_segments.end() );
+
+	m_replaySegments = m_segments;
+	m_replayIndex    = 0;
+	if ( ! m_segments.empty() ) {
+		m_seq = m_segments.back() + 1;
+		log(LOG_INFO,"db: found %" PRId32" write-ahead log segments of %s",
+		    (int32_t)m_segments.size(), dbname);
+	}
+	return true;
+}
+
+bool RdbWal::openSegment ( ) {
+	char filename[1200];
+	makeFilename ( filename , sizeof(filename) , m_seq );
+	m_fd = ::open ( filename , O_WRONLY|O_CREAT|O_TRUNC , getFileCreationFlags() );
+	if ( m_fd < 0 ) {
+		g_errno = errno;
+		log(LOG_WARN,"db: open %s: %s",filename,mstrerror(g_errno));
+		return false;
+	}
+	char hdr[s_fileHeaderSize];
+	memset ( hdr , 0 , sizeof(hdr) );
+	memcpy ( hdr     , &s_magic   , 4 );
+	memcpy ( hdr + 4 , &s_version , 4 );
+	hdr[8] = m_ks;
+	int32_t written;
+	if ( ! writeFully ( m_fd , hdr , sizeof(hdr) , &written ) ) {
+		g_errno = errno;
+		log(LOG_WARN,"db: write %s: %s",filename,mstrerror(g_errno));
+		::close ( m_fd );
+		m_fd = -1;
+		::unlink ( filename );
+		return false;
+	}
+	m_segments.push_back ( m_seq );
+	m_needsSync = true;
+	return true;
+}
+
+bool RdbWal::appendFrame ( char type , char flags , collnum_t collnum ,
+			   const char *data , int32_t dataSize ) {
+	if ( ! isInitialized() ) return true;
+	if ( ! m_buf.reserve ( s_frameHeaderSize + dataSize , "RdbWal" ) ) {
+		log(LOG_WARN,"db: could not buffer %" PRId32" bytes for the "
+		    "%s write-ahead log",dataSize,m_dbname);
+		return false;
+	}
+	uint32_t size = dataSize;
+	uint32_t checksum = getFrameChecksum ( type , flags , collnum , data , dataSize );
+	int16_t cn = collnum;
+	char hdr[s_frameHeaderSize];
+	memcpy ( hdr     , &size     , 4 );
+	memcpy ( hdr + 4 , &checksum , 4 );
+	hdr[8] = type;
+	hdr[9] = flags;
+	memcpy ( hdr + 10 , &cn , 2 );
+	m_buf.safeMemcpy ( hdr , s_frameHeaderSize );
+	if ( dataSize > 0 ) m_buf.safeMemcpy ( data , dataSize );
+	return true;
+}
+
+bool RdbWal::addList ( collnum_t collnum , const char *list , int32_t listSize ,
+		       bool useHalfKeys ) {
+	if ( listSize <= 0 ) return true;
+	return appendFrame ( WAL_ADD_LIST , useHalfKeys ? WAL_HALF_KEYS : 0 ,
+			     collnum , list , listSize );
+}
+
+bool RdbWal::addDelColl ( collnum_t collnum ) {
+	return appendFrame ( WAL_DEL_COLL , 0 , collnum , NULL , 0 );
+}
+
+bool RdbWal::writeBuf ( ) {
+	if ( m_buf.length() <= 0 ) return true;
+	if ( m_fd < 0 && ! openSegment() ) return false;
+	int32_t written;
+	bool ok = writeFully ( m_fd , m_buf.getBufStart() , m_buf.length() , &written );
+	if ( written > 0 ) m_needsSync = true;
+	if ( ok ) {
+		m_buf.reset();
+		return true;
+	}
+	g_errno = errno;
+	log(LOG_WARN,"db: write to %s write-ahead log: %s",m_dbname,mstrerror(g_errno));
+	// keep what was not written for the next try
+	int32_t left = m_buf.length() - written;
+	memmove ( m_buf.getBufStart() , m_buf.getBufStart() + written , left );
+	m_buf.setLength ( left );
+	return false;
+}
+
+void RdbWal::syncWrapper_r ( void *state ) {
+	WalSyncState *ss = (WalSyncState *)state;
+	ss->m_errno = 0;
+	if ( fdatasync ( ss->m_fd ) != 0 ) ss->m_errno = errno;
+}
+
+void RdbWal::syncDoneWrapper ( void *state , job_exit_t exit_type ) {
+	WalSyncState *ss = (WalSyncState *)state;
+	if ( exit_type != job_exit_normal )
+		log(LOG_WARN,"db: %s write-ahead log sync was cancelled",ss->m_dbname);
+	else if ( ss->m_errno )
+		log(LOG_WARN,"db: fdatasync %s write-ahead log: %s",
+		    ss->m_dbname,mstrerror(ss->m_errno));
+	::close ( ss->m_fd );
+	ss->m_wal->m_syncing = false;
+	mfree ( ss , sizeof(WalSyncState) , "RdbWalSync" );
+}
+
+bool RdbWal::commit ( bool useThread ) {
+	if ( ! writeBuf() ) return false;
+	if ( ! m_needsSync || m_fd < 0 ) return true;
+
+	if ( useThread ) {
+		// the sync still going on will be followed by another one on
+		// the next commit
+		if ( m_syncing ) return true;
+		WalSyncState *ss = (WalSyncState *)mmalloc ( sizeof(WalSyncState) , "RdbWalSync" );
+		// use a dup of the fd so a rotation can close m_fd while the
+		// thread is still syncing
+		int fd = ss ? dup ( m_fd ) : -1;
+		if ( fd >= 0 ) {
+			ss->m_wal      = this;
+			ss->m_fd       = fd;
+			ss->m_errno    = 0;
+			snprintf ( ss->m_dbname , sizeof(ss->m_dbname) , "%s" , m_dbname );
+			m_needsSync = false;
+			m_syncing   = true;
+			if ( g_jobScheduler.submit ( syncWrapper_r , syncDoneWrapper , ss ,
+						     thread_type_unspecified_io , 0 ) )
+				return true;
+			// no threads, do it ourselves
+			syncWrapper_r ( ss );
+			syncDoneWrapper ( ss , job_exit_normal );
+			return true;
+		}
+		if ( ss ) mfree ( ss , sizeof(WalSyncState) , "RdbWalSync" );
+	}
+
+	if ( fdatasync ( m_fd ) != 0 ) {
+		g_errno = errno;
+		log(LOG_WARN,"db: fdatasync %s write-ahead log: %s",
+		    m_dbname,mstrerror(g_errno));
+		return false;
+	}
+	m_needsSync = false;
+	return true;
+}
+
+int32_t RdbWal::rotate ( ) {
+	if ( ! isInitialized() ) return -1;
+	if ( ! writeBuf() ) return -1;
+	// nothing in the current segment yet, keep using its number
+	if ( m_fd < 0 ) return m_seq;
+	// . the fsync of a segment has to be done before it can be replayed
+	//   from. the thread syncs a dup of m_fd, so we can close it below
+	// . if a sync of this segment is still going on, do not start another
+	//   one under it, fsync it here. that covers what it syncs too
+	m_needsSync = true;
+	if ( ! commit ( ! m_syncing ) ) return -1;
+	::close ( m_fd );
+	m_fd = -1;
+	m_seq++;
+	return m_seq;
+}
+
+void RdbWal::removeSegmentsBefore ( int32_t seq ) {
+	if ( isReplaying() ) {
+		log(LOG_LOGIC,"db: not removing %s write-ahead log segments "
+		    "before they were replayed",m_dbname);
+		return;
+	}
+	std::vector<int32_t> keep;
+	for ( size_t i = 0 ; i < m_segments.size() ; i++ ) {
+		if ( m_segments[i] >= seq || m_segments[i] == m_seq ) {
+			keep.push_back ( m_segments[i] );
+			continue;
+		}
+		char filename[1200];
+		makeFilename ( filename , sizeof(filename) , m_segments[i] );
+		if ( ::unlink ( filename ) != 0 && errno != ENOENT ) {
+			log(LOG_WARN,"db: unlink %s: %s",filename,mstrerror(errno));
+			keep.push_back ( m_segments[i] );
+			continue;
+		}
+		log(LOG_DEBUG,"db: removed write-ahead log segment %s",filename);
+	}
+	m_segments.swap ( keep );
+}
+
+bool RdbWal::openReplaySegment ( ) {
+	while ( m_replayIndex < (int32_t)m_replaySegments.size() ) {
+		char filename[1200];
+		makeFilename ( filename , sizeof(filename) , m_replaySegments[m_replayIndex] );
+		m_replayFd = ::open ( filename , O_RDONLY );
+		if ( m_replayFd < 0 ) {
+			log(LOG_WARN,"db: open %s: %s",filename,mstrerror(errno));
+			m_replayIndex++;
+			continue;
+		}
+		char hdr[s_fileHeaderSize];
+		uint32_t magic = 0;
+		uint32_t version = 0;
+		int32_t n = readFully ( m_replayFd , hdr , sizeof(hdr) );
+		if ( n == (int32_t)sizeof(hdr) ) {
+			memcpy ( &magic   , hdr     , 4 );
+			memcpy ( &version , hdr + 4 , 4 );
+		}
+		if ( n != (int32_t)sizeof(hdr) || magic != s_magic ||
+		     version != s_version || hdr[8] != m_ks ) {
+			// an empty file is what a crash right after creating
+			// the segment leaves
+			if ( n != 0 )
+				log(LOG_WARN,"db: %s is not a write-ahead log "
+				    "segment of %s, skipping it",filename,m_dbname);
+			closeReplaySegment();
+			m_replayIndex++;
+			continue;
+		}
+		log(LOG_INFO,"db: replaying %s",filename);
+		return true;
+	}
+	return false;
+}
+
+void RdbWal::closeReplaySegment ( ) {
+	if ( m_replayFd >= 0 ) ::close ( m_replayFd );
+	m_replayFd = -1;
+}
+
+bool RdbWal::getReplayFrame ( char *type , char *flags , collnum_t *collnum ,
+			      char **data , int32_t *dataSize ) {
+	while ( ! m_replayHaveFrame ) {
+		if ( ! isReplaying() ) return false;
+		if ( m_replayFd < 0 && ! openReplaySegment() ) return false;
+
+		char hdr[s_frameHeaderSize];
+		int32_t n = readFully ( m_replayFd , hdr , sizeof(hdr) );
+		uint32_t size = 0;
+		uint32_t checksum = 0;
+		int16_t cn = 0;
+		if ( n == (int32_t)sizeof(hdr) ) {
+			memcpy ( &size     , hdr     , 4 );
+			memcpy ( &checksum , hdr + 4 , 4 );
+			memcpy ( &cn       , hdr + 10, 2 );
+		}
+		bool ok = ( n == (int32_t)sizeof(hdr) &&
+			    size <= (uint32_t)s_maxFrameSize &&
+			    ( m_replayBuf.reset() , true ) &&
+			    m_replayBuf.reserve ( size , "RdbWal" ) &&
+			    readFully ( m_replayFd , m_replayBuf.getBufStart() , size ) == (int32_t)size &&
+			    getFrameChecksum ( hdr[8] , hdr[9] , cn ,
+					       m_replayBuf.getBufStart() , size ) == checksum );
+		if ( ! ok ) {
+			// a clean end of the segment
+			if ( n != 0 )
+				log(LOG_WARN,"db: %s write-ahead log segment %" PRId32" "
+				    "ends with a partial or corrupt frame, "
+				    "ignoring the rest of it",
+				    m_dbname,m_replaySegments[m_replayIndex]);
+			closeReplaySegment();
+			m_replayIndex++;
+			continue;
+		}
+		m_replayBuf.setLength ( size );
+		m_replayType      = hdr[8];
+		m_replayFlags     = hdr[9];
+		m_replayCollnum   = cn;
+		m_replayHaveFrame = true;
+		m_numReplayedFrames++;
+	}
+	*type     = m_replayType;
+	*flags    = m_replayFlags;
+	*collnum  = m_replayCollnum;
+	*data     = m_replayBuf.getBufStart();
+	*dataSize = m_replayBuf.length();
+	return true;
+}
+
+void RdbWal::endReplay ( ) {
+	closeReplaySegment();
+	m_replayIndex     = (int32_t)m_replaySegments.size();
+	m_replayHaveFrame = false;
+}
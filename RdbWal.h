@@ -0,0 +1,131 @@
+// . write-ahead log of the lists added to the tree/buckets of an Rdb
+// . Rdb::addList() appends every list it added. the appends are buffered
+//   and written and fsync'ed together every "rdb wal sync interval"
+//   milliseconds (group commit), so a crash loses at most that much
+// . the log is kept in numbered segment files, <dbname>-wal<seq>.dat. when
+//   a tree dump starts we rotate to a new segment and when the dump is done
+//   the older segments hold nothing that is not in an rdb file on disk any
+//   more, so they are removed. that is the checkpoint
+// . on startup the segments left over are replayed on top of the saved
+//   tree, if any, so saving the rdb is just committing the log instead of
+//   rewriting the whole tree
+// . only used from the main thread, the fsync is done in a thread
+
+#ifndef GB_RDBWAL_H
+#define GB_RDBWAL_H
+
+#include <inttypes.h>
+#include <vector>
+#include "types.h"
+#include "SafeBuf.h"
+#include "JobScheduler.h"
+
+// frame types
+#define WAL_ADD_LIST 1
+#define WAL_DEL_COLL 2
+
+// frame flags
+#define WAL_HALF_KEYS 0x01
+
+class RdbWal {
+public:
+	RdbWal();
+	~RdbWal();
+
+	// close the current segment and free the buffers, does not commit
+	void reset ( );
+
+	// . find the segments in "dir" left over from before
+	// . a new segment is only created on the first commit
+	// . returns false and sets g_errno on error
+	bool init ( const char *dir , const char *dbname , char keySize );
+
+	bool isInitialized ( ) const { return m_dbname[0] != '\0'; }
+
+	// . buffer a list (in RdbList format) that was added to the tree
+	// . returns false and sets g_errno if out of memory
+	bool addList ( collnum_t collnum , const char *list , int32_t listSize ,
+		       bool useHalfKeys );
+
+	// all records of a collection were removed from the tree
+	bool addDelColl ( collnum_t collnum );
+
+	// . write the buffered frames to the current segment and fsync it
+	// . with useThread the fsync is done in a thread and we return
+	//   before it is done
+	// . returns false and sets g_errno on error
+	bool commit ( bool useThread );
+
+	// bytes appended but not written to the segment file yet
+	int32_t getBufferedBytes ( ) const { return m_buf.length(); }
+
+	// . write what is buffered and start a new segment
+	// . returns the sequence number of the new segment or -1 on error
+	int32_t rotate ( );
+
+	// . remove all segments before "seq", including the ones to replay
+	// . only call this once everything in them is in the rdb files
+	void removeSegmentsBefore ( int32_t seq );
+
+	int32_t getCurrentSeq ( ) const { return m_seq; }
+	int32_t getNumSegments ( ) const { return (int32_t)m_segments.size(); }
+
+	// . the segments found by init() are replayed in order
+	// . getReplayFrame() returns the current frame, the same one until
+	//   skipReplayFrame() is called, so a frame that could not be applied
+	//   yet can be retried
+	// . corrupt or truncated frames at the end of a segment, like from a
+	//   crash in the middle of a write, end the replay of that segment
+	bool isReplaying ( ) const { return m_replayIndex < (int32_t)m_replaySegments.size(); }
+	bool getReplayFrame ( char *type , char *flags , collnum_t *collnum ,
+			      char **data , int32_t *dataSize );
+	void skipReplayFrame ( ) { m_replayHaveFrame = false; }
+	// stop replaying, the segments are kept until removed
+	void endReplay ( );
+
+	int64_t getNumReplayedFrames ( ) const { return m_numReplayedFrames; }
+
+private:
+	RdbWal(const RdbWal&);
+	RdbWal& operator=(const RdbWal&);
+
+	void makeFilename ( char *buf , int32_t bufSize , int32_t seq ) const;
+	bool openSegment ( );
+	bool writeBuf ( );
+	bool appendFrame ( char type , char flags , collnum_t collnum ,
+			   const char *data , int32_t dataSize );
+
+	bool openReplaySegment ( );
+	void closeReplaySegment ( );
+
+	static void syncWrapper_r ( void *state );
+	static void syncDoneWrapper ( void *state , job_exit_t exit_type );
+
+	char     m_dir[1024];
+	char     m_dbname[64];
+	char     m_ks;
+
+	// segment being appended to, -1 until the first commit
+	int      m_fd;
+	int32_t  m_seq;
+	bool     m_needsSync;
+	bool     m_syncing;
+
+	// frames not written to m_fd yet
+	SafeBuf  m_buf;
+
+	// sequence numbers of all segments on disk, ascending
+	std::vector<int32_t> m_segments;
+
+	std::vector<int32_t> m_replaySegments;
+	int32_t  m_replayIndex;
+	int      m_replayFd;
+	bool     m_replayHaveFrame;
+	char     m_replayType;
+	char     m_replayFlags;
+	collnum_t m_replayCollnum;
+	SafeBuf  m_replayBuf;
+	int64_t  m_numReplayedFrames;
+};
+
+#endif // GB_RDBWAL_H
@@ -18,6 +18,7 @@
 #include "Process.h"
 #include "Parms.h"
 #include "max_niceness.h"
+#include "TitleRecDict.h"
 
 Rebalance g_rebalance;
 
@@ -483,28 +484,51 @@ bool Rebalance::gotList ( ) {
 		if ( shard == myShard ) continue;
 		// note it
 		//log("rebal: shard is %" PRId32,shard);
-		// count it
-		m_rebalanceCount++;
 		// otherwise, it does not!
 		//int32_t recSize = m_list.getCurrentRecSize();
 		// copy the full key into "key" buf because might be compressed
 		char key[MAX_KEY_BYTES];
 		m_list.getCurrentKey ( key );
+		// then record
+		int32_t dataSize = rdb->m_fixedDataSize;
+		if ( rdb->m_fixedDataSize == -1 )
+			dataSize = m_list.getCurrentDataSize();
+		char *data = m_list.getCurrentData();
+		// . the other shards do not have our titledb dictionaries, so
+		//   recompress a record compressed with one without it
+		SafeBuf tbuf;
+		if ( rdbId == RDB_TITLEDB &&
+		     getTitleRecDictId ( m_list.getCurrentRec() ,
+					 m_list.getCurrentRecSize() ) ) {
+			RdbBase *tbase = getRdbBase ( RDB_TITLEDB , m_collnum );
+			if ( ! tbase ||
+			     ! recompressTitleRec ( m_list.getCurrentRec() ,
+						    m_list.getCurrentRecSize() ,
+						    tbase->getTitleRecDicts() ,
+						    NULL , &tbuf , NULL ) ) {
+				// leave it here rather than move a record
+				// the other shard can not read
+				log("rebal: could not recompress titlerec of "
+				    "docid %" PRId64": %s",
+				    g_titledb.getDocId((key_t *)key),
+				    mstrerror(g_errno));
+				g_errno = 0;
+				continue;
+			}
+			dataSize = *(int32_t *)(tbuf.getBufStart()+sizeof(key_t));
+			data     = tbuf.getBufStart() + sizeof(key_t) + 4;
+		}
+		// count it
+		m_rebalanceCount++;
 		// store rdbid, no! we supply rdbid below to msg4
 		//m_posMetaList.pushChar ( rdbId );
 		// first key
 		m_posMetaList.safeMemcpy ( key , ks );
-		// then record
-		int32_t dataSize = rdb->m_fixedDataSize;
-		if ( rdb->m_fixedDataSize == -1 ) {
-			dataSize = m_list.getCurrentDataSize();
+		if ( rdb->m_fixedDataSize == -1 )
 			m_posMetaList.pushLong ( dataSize );
-		}
 		// then data
-		if ( dataSize ) {
-			char *data = m_list.getCurrentData();
+		if ( dataSize )
 			m_posMetaList.safeMemcpy ( data , dataSize );
-		}
 		//
 		// NOW DELETE FROM OUR SHARD!
 		//
@@ -29,40 +29,83 @@ void SearchInput::clear ( int32_t niceness ) {
 }
 
 // . make a key for caching the search results page based on this input
-// . do not use all vars, like the m_*ToDisplay should not be included
-key_t SearchInput::makeKey ( ) {
-	// hash the query
-	int32_t n = m_q.getNumTerms();
-	key_t k;
-	k.n1 = 0;
+// . the query is hashed by its terms so case and spacing do not matter
+// . then hash the value of each search parm, not its bytes, since the
+//   string parms are pointers into the request
+// . the parms that only control caching, debugging or logging are left
+//   out so they still share the cached page
+int64_t SearchInput::makeKey ( ) {
+	uint64_t h = 0;
+	// the collections we search
+	h = hash64 ( m_collnumBuf.getBufStart() , m_collnumBuf.length() , h );
 
-	// user defined weights, for weighting each query term separately
+	int32_t n = m_q.getNumTerms();
 	for ( int32_t i = 0 ; i < n ; i++ ) {
-		k.n0 = hash64 ((char *)&m_q.m_qterms[i].m_termId    ,4, k.n0);
-		k.n0 = hash64 ((char *)&m_q.m_qterms[i].m_termSign  ,1, k.n0);
-		k.n0 = hash64 ((char *)&m_q.m_qterms[i].m_userWeight,4, k.n0);
-		k.n0 = hash64 ((char *)&m_q.m_qterms[i].m_userType  ,1, k.n0);
+		QueryTerm *qt = &m_q.m_qterms[i];
+		h = hash64 ((char *)&qt->m_termId    ,sizeof(qt->m_termId),h);
+		h = hash64 ((char *)&qt->m_termSign  ,1, h);
+		h = hash64 ((char *)&qt->m_userWeight,sizeof(qt->m_userWeight),h);
+		h = hash64 ((char *)&qt->m_userType  ,1, h);
 	}
-	// space separated, NULL terminated, list of meta tag names to display
-	if ( m_displayMetas )
-		k.n0 = hash64b ( m_displayMetas          , k.n0 );
-
-	// . now include the hash of the search parameters
-	char *a = ((char *)&m_START) + 4 ; // msg40->m_dpf;
-	char *b =  (char *)&m_END_HASH   ; // msg40->m_topicGroups;
-	int32_t size = b - a; 
-	// and hash it all up
-	k.n0 = hash64 ( a , size , k.n0 );
 	// . boolean queries have operators (AND OR NOT ( ) ) that we need
 	//   to consider in this hash as well. so
 	// . so just hash the whole damn query
 	if ( m_q.m_isBoolean ) {
 		char *q    = m_q.getQuery();
 		int32_t  qlen = m_q.getQueryLen();
-		k.n0 = hash64 ( q , qlen , k.n0 );
+		h = hash64 ( q , qlen , h );
 	}
+	h = hash64 ( (char *)&m_queryLangId , sizeof(m_queryLangId) , h );
 
-	return k;
+	for ( int32_t i = 0 ; i < g_parms.m_numSearchParms ; i++ ) {
+		Parm *m = g_parms.m_searchParms[i];
+		// the query is hashed above, by its terms
+		if ( m->m_off == offsetof(SearchInput,m_query        ) ) continue;
+		if ( m->m_off == offsetof(SearchInput,m_coll         ) ) continue;
+		if ( m->m_off == offsetof(SearchInput,m_useCache     ) ) continue;
+		if ( m->m_off == offsetof(SearchInput,m_rcache       ) ) continue;
+		if ( m->m_off == offsetof(SearchInput,m_wcache       ) ) continue;
+		if ( m->m_off == offsetof(SearchInput,m_debug        ) ) continue;
+		if ( m->m_off == offsetof(SearchInput,m_queryId      ) ) continue;
+		if ( m->m_off == offsetof(SearchInput,m_niceness     ) ) continue;
+		if ( m->m_off == offsetof(SearchInput,m_isMasterAdmin) ) continue;
+		char *x = (char *)this + m->m_off;
+		// keep "a=1&b=" from looking like "a=&b=1"
+		h = hash64 ( (char *)&m->m_off , 4 , h );
+		switch ( m->m_type ) {
+		case TYPE_CHARPTR: {
+			const char *s = *(char **)x;
+			if ( s ) h = hash64b ( s , h );
+			else     h = hash64 ( h , 1 );
+			break;
+		}
+		case TYPE_STRING:
+		case TYPE_STRINGBOX:
+		case TYPE_STRINGNONEMPTY:
+			h = hash64 ( x , strnlen ( x , m->m_size ) , h );
+			break;
+		case TYPE_SAFEBUF: {
+			SafeBuf *sb = (SafeBuf *)x;
+			h = hash64 ( sb->getBufStart() , sb->length() , h );
+			break;
+		}
+		case TYPE_BOOL:
+		case TYPE_CHECKBOX:
+		case TYPE_CHAR:
+		case TYPE_CHAR2:
+			h = hash64 ( x , 1 , h );
+			break;
+		case TYPE_LONG_LONG:
+		case TYPE_DOUBLE:
+			h = hash64 ( x , 8 , h );
+			break;
+		default:
+			// TYPE_LONG, TYPE_FLOAT and friends
+			h = hash64 ( x , 4 , h );
+			break;
+		}
+	}
+	return (int64_t)h;
 }
 
 void SearchInput::test ( ) {
@@ -25,7 +25,7 @@ public:
 	bool set ( class TcpSocket *s , class HttpRequest *hr );
 
 	void  test    ( );
-	key_t makeKey ( ) ;
+	int64_t makeKey ( ) ;
 
 	bool setQueryBuffers ( class HttpRequest *hr ) ;
 
@@ -78,8 +78,8 @@ public:
 	// can be 1 for FORMAT_HTML, 2 = FORMAT_XML, 3=FORMAT_JSON, 4=csv
 	int32_t m_format;
 
-	// used as indicator by SearchInput::makeKey() for generating a
-	// key by hashing the parms between m_START and m_END
+	// used as indicator by SearchInput::test() for checking that all
+	// the parms between m_START and m_END_TEST are covered
 	int32_t   m_START;
 
 
@@ -96,7 +96,7 @@ public:
 
 	char  m_showImages;
 
-	// general parms, not part of makeKey(), but should be serialized
+	// general parms, not part of makeKey()
 	char   m_useCache;                   // msg40
 	char   m_rcache;                     // msg40
 	char   m_wcache;                     // msg40
@@ -107,8 +107,6 @@ public:
 
 	char  *m_displayMetas;               // msg40
 
-	// do not include these in makeKey()
-
 	char  *m_queryCharset;
 
 	char  *m_gbcountry;
@@ -208,8 +206,9 @@ public:
 	//
 	////////
 
-	// . end the section we hash in SearchInput::makeKey()
-	// . we also hash displayMetas and Query into the key
+	// . end of the user parms
+	// . SearchInput::makeKey() hashes the values of the search parms
+	//   and the Query terms
 	int32_t   m_END_HASH;
 
 	// a marker for SearchInput::test()
@@ -6,12 +6,15 @@
 #include "Msg3.h"            //getDiskPageCache()
 #include "RdbCache.h"
 #include "Rdb.h"
+#include "LatencyHistogram.h"
+#include "SafeBuf.h"
 #include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 
 static const time_t dump_interval = 60;
@@ -64,6 +67,8 @@ static pthread_mutex_t mtx_query_timerange_statistics = PTHREAD_MUTEX_INITIALIZE
 
 void Statistics::register_query_time(unsigned term_count, unsigned /*qlang*/, unsigned ms)
 {
+	register_stage_time(stage_query, (uint64_t)ms*1000);
+
 	if(term_count>max_term_count)
 		term_count = max_term_count;
 	
@@ -255,6 +260,75 @@ static void dump_spider_statistics( FILE *fp ) {
 	}
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// Stage latency statistics
+
+//microseconds since the start, never reset since prometheus wants counters
+static LatencyHistogram stage_histograms[Statistics::stage_end];
+
+static const char * const stage_names[] = {
+	"query",
+	"query_msg3a",
+	"query_msg2",
+	"query_msg5",
+	"query_intersect",
+	"query_msg51",
+	"query_msg20",
+	"spider_dns",
+	"spider_robots",
+	"spider_download",
+	"spider_parse",
+	"spider_msg4_add"
+};
+static_assert(sizeof(stage_names)/sizeof(stage_names[0])==Statistics::stage_end, "stage_names does not match latency_stage_t");
+
+//the "le" bucket bounds we export, in microseconds
+static const uint64_t metrics_bucket_bounds[] = {
+	100, 250, 500,
+	1000, 2500, 5000,
+	10000, 25000, 50000,
+	100000, 250000, 500000,
+	1000000, 2500000, 5000000,
+	10000000, 30000000, 60000000
+};
+
+const char *Statistics::get_stage_name(latency_stage_t stage) {
+	return stage_names[stage];
+}
+
+void Statistics::register_stage_time(latency_stage_t stage, uint64_t microseconds) {
+	stage_histograms[stage].record(microseconds);
+}
+
+Statistics::StageTimer::StageTimer(latency_stage_t stage_)
+  : stage(stage_),
+    start_time(gettimeofdayInMicroseconds())
+{
+}
+
+Statistics::StageTimer::~StageTimer() {
+	register_stage_time(stage, gettimeofdayInMicroseconds()-start_time);
+}
+
+void Statistics::print_metrics(SafeBuf *sb) {
+	sb->safePrintf("# HELP gb_stage_latency_seconds Latency of the stages of queries and of spidering documents.\n");
+	sb->safePrintf("# TYPE gb_stage_latency_seconds histogram\n");
+	for(int i=0; i<stage_end; i++) {
+		const LatencyHistogram &h = stage_histograms[i];
+		uint64_t sum = h.getSum();
+		for(size_t j=0; j<sizeof(metrics_bucket_bounds)/sizeof(metrics_bucket_bounds[0]); j++) {
+			sb->safePrintf("gb_stage_latency_seconds_bucket{stage=\"%s\",le=\"%g\"} %" PRIu64 "\n",
+			               stage_names[i],
+			               metrics_bucket_bounds[j]/1000000.0,
+			               h.getCountAtOrBelow(metrics_bucket_bounds[j]));
+		}
+		uint64_t count = h.getCountAtOrBelow(LatencyHistogram::max_trackable_value);
+		sb->safePrintf("gb_stage_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", stage_names[i], count);
+		sb->safePrintf("gb_stage_latency_seconds_sum{stage=\"%s\"} %.6f\n", stage_names[i], sum/1000000.0);
+		sb->safePrintf("gb_stage_latency_seconds_count{stage=\"%s\"} %" PRIu64 "\n", stage_names[i], count);
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // RdbCache statistics
 
@@ -1,6 +1,10 @@
 #ifndef GB_STATISTICS_H
 #define GB_STATISTICS_H
 
+#include <inttypes.h>
+
+class SafeBuf;
+
 namespace Statistics {
 
 bool initialize();
@@ -10,6 +14,42 @@ void register_query_time(unsigned term_count, unsigned qlang, unsigned ms);
 
 void register_spider_time( bool is_new, int error_code, int http_status, unsigned ms );
 
+//The stages of a query and of spidering a document. A latency histogram is
+//kept for each of them.
+enum latency_stage_t {
+	stage_query,                //the whole query (Msg40)
+	stage_query_msg3a,          //docids of all shards (Msg3a fan-out)
+	stage_query_msg2,           //all termlists of a query on a host
+	stage_query_msg5,           //one termlist (or docid range of one)
+	stage_query_intersect,      //PosdbTable::intersectLists10_r()
+	stage_query_msg51,          //clusterdb recs of the top docids
+	stage_query_msg20,          //summaries of a result page
+	stage_spider_dns,
+	stage_spider_robots,        //getting and parsing robots.txt
+	stage_spider_download,
+	stage_spider_parse,         //xml and words of the document
+	stage_spider_msg4_add,      //sending a buffer of meta lists (Msg4)
+	stage_end
+};
+
+const char *get_stage_name(latency_stage_t stage);
+
+//lock-free, may be called from any thread
+void register_stage_time(latency_stage_t stage, uint64_t microseconds);
+
+//times the scope it is declared in
+class StageTimer {
+public:
+	explicit StageTimer(latency_stage_t stage);
+	~StageTimer();
+private:
+	latency_stage_t stage;
+	uint64_t start_time;
+};
+
+//print the stage histograms in the Prometheus text exposition format
+void print_metrics(SafeBuf *sb);
+
 } //namespace
 
 #endif
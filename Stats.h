@@ -141,6 +141,8 @@ class Stats {
 	int32_t m_acksIn     [MAX_MSG_TYPES][2];
 	int32_t m_acksOut    [MAX_MSG_TYPES][2];
 	int32_t m_reroutes   [MAX_MSG_TYPES][2];
+	int32_t m_hedges     [MAX_MSG_TYPES][2]; // hedged requests to twins
+	int32_t m_hedgeWins  [MAX_MSG_TYPES][2]; // twin replied first
 	int32_t m_errors     [MAX_MSG_TYPES][2];
 	int32_t m_timeouts   [MAX_MSG_TYPES][2]; // specific error
 	int32_t m_nomem      [MAX_MSG_TYPES][2]; // specific error
@@ -158,6 +160,12 @@ class Stats {
 	// recomputeCacheMisses
 	int32_t m_icacheTierJumps;
 
+	// search result pages Msg40 served from its results cache, pages it
+	// had to get, and queries that waited for an identical query
+	int32_t m_resultsCacheHits;
+	int32_t m_resultsCacheMisses;
+	int32_t m_resultsCoalesced;
+
 	int32_t m_compressedBytesIn;
 	int32_t m_uncompressedBytesIn;
 
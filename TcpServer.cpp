@@ -2,7 +2,7 @@
 
 #include "TcpServer.h"
 #include "Stats.h"
-#include "Profiler.h"
+#include "HttpServer.h"
 #include "PingServer.h"
 #include "Hostdb.h"
 #include "max_niceness.h"
@@ -20,6 +20,7 @@ static void writeSocketWrapper     ( int sd , void *state ) ;
 static void readTimeoutPollWrapper ( int sd , void *state ) ;
 static void acceptSocketWrapper    ( int sd , void *state ) ;
 static void timePollWrapper        ( int fd , void *state ) ;
+static void readPendingWrapper     ( int fd , void *state ) ;
 
 static const char *getSSLError(SSL *ssl, int ret) {
 	switch (SSL_get_error(ssl, ret)) {
@@ -55,6 +56,7 @@ void TcpServer::reset() {
 		if ( ! s ) continue;
 		destroySocket ( s );
 	}
+	clearSslSessions();
 	// do we got a valid listen socket?
 	if ( m_sock < 0 ) return;
 	// if so, stop listening, may block
@@ -90,6 +92,7 @@ bool TcpServer::init ( void (* requestHandler)(TcpSocket *s) ,
 	// don't be ready until we succeed
 	m_ready = false;
 	m_doReadRateTimeouts = true;
+	m_readPendingRegistered = false;
 	// store the handlers
 	m_requestHandler = requestHandler;
 	m_getMsgSize     = getMsgSize;
@@ -512,6 +515,21 @@ bool TcpServer::gotTcpServerIp ( TcpState *tst , int32_t ip ) {
 	return true;
 }
 
+// . does the mime of the http request or reply in "buf" say
+//   "Connection: Keep-Alive"?
+static bool isKeepAliveMime ( const char *buf , int32_t bufLen ) {
+	if ( ! buf ) return false;
+	const char *end = buf + bufLen;
+	for ( const char *p = buf ; p + 24 <= end ; p++ ) {
+		if ( *p != '\n' ) continue;
+		// end of the mime?
+		if ( p[1] == '\r' || p[1] == '\n' ) return false;
+		if ( strncasecmp ( p + 1 , "Connection: Keep-Alive" , 22 ) == 0 )
+			return true;
+	}
+	return false;
+}
+
 // . returns false if blocked, true otherwise
 // . sets g_errno on error
 // . NOTE: should not be called by user since does not copy "msg"
@@ -525,7 +543,7 @@ bool TcpServer::sendMsg( const char *hostname, int32_t hostnameLen, int32_t ip,
 
 	// . get an unused socket that's pre-connected to this ip/port
 	// . returns NULL if it can't
-	TcpSocket *s = getAvailableSocket ( ip , port );
+	TcpSocket *s = getAvailableSocket ( ip , port , hostname , hostnameLen );
 
 	// . sendMsg(...) returns false if blocked, true otherwise
 	// . it also sets g_errno on error
@@ -619,10 +637,14 @@ bool TcpServer::sendMsg( const char *hostname, int32_t hostnameLen, int32_t ip,
 	s->m_udpSlot          = NULL;
 	s->m_streamingMode    = false;
 	s->m_tunnelMode       = 0;
+	// getMsgSize() unsets this if the reply does not agree
+	s->m_keepAlive        = isKeepAliveMime ( sendBuf , sendBufUsed );
+	s->m_numRequests      = 1;
 
 	// if http request starts with "CONNECT ..." then enter tunnel mode
 	if ( useHttpTunnel ) {
 		s->m_tunnelMode = 1;
+		s->m_keepAlive  = false;
 	}
 
 	// . call the connect routine to try to connect it asap
@@ -695,6 +717,19 @@ bool TcpServer::sendMsg( TcpSocket *s, char *sendBuf, int32_t sendBufSize, int32
 	s->m_timeout          = timeout;
 	s->m_maxTextDocLen    = maxTextDocLen ;
 	s->m_maxOtherDocLen   = maxOtherDocLen ;
+	// . the request handler decides if we can keep an incoming socket
+	//   open, but the reply must tell the client too. error replies and
+	//   replies of unknown length say "Connection: Close"
+	if ( s->m_isIncoming ) {
+		if ( s->m_keepAlive && ! isKeepAliveMime ( sendBuf , sendBufUsed ) )
+			s->m_keepAlive = false;
+	}
+	// . a request on a pooled connection to a web server, getMsgSize()
+	//   unsets m_keepAlive if the reply does not agree
+	else {
+		s->m_keepAlive = isKeepAliveMime ( sendBuf , sendBufUsed );
+		s->m_numRequests++;
+	}
 	// . try to send immediately
 	// . returns false if blocked, true otherwise
 	// . sets g_errno on error (and returns true)
@@ -709,6 +744,8 @@ bool TcpServer::sendMsg( TcpSocket *s, char *sendBuf, int32_t sendBufSize, int32
 	if      ( g_errno      ) { 
 		if ( g_conf.m_logDebugTcp )
 			log("tcp: writeSocket error: %s",mstrerror(g_errno));
+		bool blocked;
+		if ( resendOnNewSocket ( s , &blocked ) ) return ! blocked;
 		destroySocket ( s ); 
 		return true; 
 	}
@@ -726,6 +763,8 @@ bool TcpServer::sendMsg( TcpSocket *s, char *sendBuf, int32_t sendBufSize, int32
 	// we can't close it here any more for some reason the browser truncats
 	// the content we transmit otherwise... i've tried SO_LINGER and 
 	// couldnt get that to work...
+	// . a kept-alive socket is ready for the next request
+	if ( s->m_keepAlive && s->m_readBuf ) { recycleSocket ( s ); return true; }
 	if ( s->m_readBuf ) { s->m_sockState = ST_NEEDS_CLOSE; return true; }
 	// we're blocking on the reply (readBuf is empty)
 	return false;
@@ -733,7 +772,9 @@ bool TcpServer::sendMsg( TcpSocket *s, char *sendBuf, int32_t sendBufSize, int32
 
 // . TcpSockets are 1-1 with socket descriptors
 // . returns NULL if no available sockets w/ this ip/port were found
-TcpSocket *TcpServer::getAvailableSocket ( int32_t ip, int16_t port ) {
+TcpSocket *TcpServer::getAvailableSocket ( int32_t ip, int16_t port ,
+					   const char *hostname ,
+					   int32_t hostnameLen ) {
 	// . search for an available socket already connected to our ip/port
 	for ( int32_t i = 0 ; i <= m_lastFilled ; i++ ) {
 		TcpSocket *s = m_tcpSockets[i];
@@ -741,6 +782,14 @@ TcpSocket *TcpServer::getAvailableSocket ( int32_t ip, int16_t port ) {
 		if ( s->m_ip   != ip   ) continue;
 		if ( s->m_port != port ) continue;
 		if ( ! s->isAvailable()) continue;
+		// kept-alive sockets of clients are not ours to use
+		if ( s->m_isIncoming   ) continue;
+		// the ssl connection was made for the hostname it sent (SNI)
+		if ( s->m_ssl &&
+		     ( ! hostname || ! s->m_hostname ||
+		       (int32_t)strlen ( s->m_hostname ) != hostnameLen ||
+		       strncmp ( s->m_hostname , hostname , hostnameLen ) ) )
+			continue;
 		// reset the start time
 		s->m_startTime      = gettimeofdayInMilliseconds();
 		s->m_lastActionTime = gettimeofdayInMilliseconds();
@@ -1004,6 +1053,7 @@ TcpSocket *TcpServer::wrapSocket ( int sd , int32_t niceness , bool isIncoming )
 	// . use niceness levels of 0 so this server-to-browser traffic takes
 	//   precedence over spider traffic
 	if (g_loop.registerReadCallback (sd,this,readSocketWrapper,niceness)) {
+		s->m_readRegistered = true;
 		return s;
 	}
 
@@ -1198,7 +1248,12 @@ void readSocketWrapper2 ( int sd , void *state ) {
 		return;
 	}
 
-
+	// . an idle pooled connection to a web server is readable, it was
+	//   closed or the server sent something we did not ask for
+	if ( s->isAvailable() && ! s->m_isIncoming ) {
+		THIS->destroySocket ( s );
+		return;
+	}
 
 	if ( s->m_sockState == ST_SSL_HANDSHAKE ) {
 		int r = THIS->sslHandshake ( s );
@@ -1265,6 +1320,7 @@ void readSocketWrapper2 ( int sd , void *state ) {
 	if ( status == -1 ) {
 		// g_errno is not set if it just read 0 bytes
 		//if ( ! g_errno ) { g_process.shutdownAbort(true); }
+		if ( THIS->retryRequest ( s ) ) return;
 		THIS->makeCallback  ( s );
 		THIS->destroySocket ( s ); 
 		return;
@@ -1293,7 +1349,9 @@ void readSocketWrapper2 ( int sd , void *state ) {
 		//	THIS->destroySocket ( s );
 		//else    
 		//	THIS->recycleSocket ( s );
-		THIS->destroySocket ( s );		
+		// . keeps it for the next request to this web server if the
+		//   request and reply said keep-alive, destroys it otherwise
+		THIS->recycleSocket ( s );
 		return;
 	}
 
@@ -1347,6 +1405,16 @@ void readSocketWrapper2 ( int sd , void *state ) {
 	s->m_sockState = ST_WRITING;
 	// tell 'em socket has called the handler
 	s->m_waitingOnHandler = true;
+	// for limiting the requests on a kept-alive socket
+	s->m_numRequests++;
+	// . stop reading until the reply is sent, readSocket() would leave
+	//   the next pipelined request on the socket and the select loop
+	//   would spin on it
+	// . recycleSocket() reads again
+	if ( s->m_readRegistered ) {
+		g_loop.unregisterReadCallback ( sd , THIS , readSocketWrapper );
+		s->m_readRegistered = false;
+	}
 	// . TODO: ensure timeout is set on s in case requestHandler does not
 	//   send on it so it will close in due time
 	// . call the request handler to handle it
@@ -1373,6 +1441,22 @@ int32_t TcpServer::readSocket ( TcpSocket *s ) {
 	}
 	// set our state to reading in case we were ST_AVAILABLE state
 	s->m_sockState = ST_READING;
+	// . the start of the next request on a kept-alive socket may have
+	//   been read with the last one. it might even be all of it.
+	if ( ! s->m_readBuf && s->m_pipeBuf ) {
+		s->m_readBuf     = s->m_pipeBuf;
+		s->m_readBufSize = s->m_pipeBufSize;
+		s->m_readOffset  = s->m_pipeBufUsed;
+		s->m_totalRead   = s->m_pipeBufUsed;
+		s->m_pipeBuf     = NULL;
+		s->m_pipeBufSize = 0;
+		s->m_pipeBufUsed = 0;
+		s->m_readBuf [ s->m_readOffset ] = '\0';
+		if ( ! setTotalToRead ( s ) ) return -1;
+		if ( s->m_totalToRead > 0 &&
+		     s->m_readOffset >= s->m_totalToRead )
+			return splitPipelinedRequest ( s );
+	}
 	// . TODO: support the reception of large messages
 	// . alloc a buffer to read the reply/request
 	// . will grow dynamically if it's not enough
@@ -1520,6 +1604,29 @@ int32_t TcpServer::readSocket ( TcpSocket *s ) {
 	//   a content-length: field a lot of the time
 	//if ( s->m_sendBuf ) goto loop;
 	// otherwise, we read all we needed to so return 1
+	return splitPipelinedRequest ( s );
+}
+
+// . move anything read past the end of an incoming request, the start of
+//   the next pipelined one, from m_readBuf into m_pipeBuf
+// . returns -1 and sets g_errno on error, 1 otherwise
+int32_t TcpServer::splitPipelinedRequest ( TcpSocket *s ) {
+	if ( s->m_sendBuf || ! s->m_isIncoming ) return 1;
+	int32_t extra = s->m_readOffset - s->m_totalToRead;
+	if ( extra <= 0 ) return 1;
+	// room for the \0 and the proxy ip like m_readBuf
+	int32_t size = extra + 1 + 4;
+	if ( size < TCP_READ_BUF_SIZE ) size = TCP_READ_BUF_SIZE;
+	char *buf = (char *)mmalloc ( size , "TcpServer" );
+	if ( ! buf ) return -1;
+	gbmemcpy ( buf , s->m_readBuf + s->m_totalToRead , extra );
+	buf [ extra ] = '\0';
+	s->m_pipeBuf     = buf;
+	s->m_pipeBufSize = size;
+	s->m_pipeBufUsed = extra;
+	s->m_readOffset  = s->m_totalToRead;
+	s->m_totalRead   = s->m_totalToRead;
+	s->m_readBuf [ s->m_readOffset ] = '\0';
 	return 1;
 }
 
@@ -1648,6 +1755,7 @@ void writeSocketWrapper ( int sd , void *state ) {
 			g_errno = 0;
 		else 
 			log("tcp: socket closed while streaming");
+		if ( THIS->retryRequest ( s ) ) return;
 		THIS->makeCallback ( s );
 		THIS->destroySocket ( s ); 
 		return; 
@@ -1684,6 +1792,8 @@ void writeSocketWrapper ( int sd , void *state ) {
 	int32_t status = THIS->writeSocket ( s ) ;
 	// return if it blocked
 	if ( status == 0 ) return;
+	// the pooled connection was closed by the web server?
+	if ( status == -1 && THIS->retryRequest ( s ) ) return;
 	// if write finished, but we're not done reading return
 	if ( status == 1  &&  ! s->m_readBuf ) return;
 	// good?
@@ -1975,6 +2085,9 @@ int32_t TcpServer::writeSocket ( TcpSocket *s ) {
 		return true;
 	}
 
+	// our caller recycles kept-alive sockets after calling the callback
+	if ( s->m_keepAlive ) return 1;
+
 	// close it. without this here the socket only gets
 	// closed for real in the timeout loop.
 	destroySocket ( s );
@@ -2282,6 +2395,8 @@ void TcpServer::destroySocket ( TcpSocket *s ) {
 	if ( s->m_readBuf ) mfree (s->m_readBuf, s->m_readBufSize,"TcpServer");
 	// always free the sendBuf 
 	if ( s->m_sendBuf ) mfree (s->m_sendBuf, s->m_sendBufSize,"TcpServer");
+	if ( s->m_pipeBuf ) mfree (s->m_pipeBuf, s->m_pipeBufSize,"TcpServer");
+	s->m_pipeBuf = NULL;
 	// unregister it with Loop so we don't get any calls about it
 	if ( s->m_writeRegistered ) {
 		g_loop.unregisterWriteCallback ( sd, this, writeSocketWrapper);
@@ -2320,10 +2435,229 @@ void TcpServer::destroySocket ( TcpSocket *s ) {
 //   a keep alive server, and we're open for reading...
 // . if the socket was connected by us then we're hoping the remote host
 //   supports keep alives...
+// . incoming sockets are kept if their request handler set m_keepAlive and
+//   the reply was sent completely
+// . outgoing sockets are kept if the request and the reply said keep-alive
+//   and we read exactly the reply, but only one per ip and port, like
+//   Msg13 downloads from one ip at a time
+// . the rest are destroyed
 void TcpServer::recycleSocket ( TcpSocket *s ) {
-	// mdw... this now just destroys, baby, no more keep-alives
+	// resume the tls session on the next connection to this web server
+	if ( s->m_ssl && ! s->m_isIncoming && s->m_sockState != ST_CLOSE_CALLED )
+		saveSslSession ( s );
+	bool done;
+	if ( s->m_isIncoming )
+		done = ( s->isSending() && s->sendCompleted() );
+	else
+		done = ( s->isReading() && s->readCompleted() &&
+			 s->m_tunnelMode == 0 &&
+			 ! ( s->m_ssl && SSL_pending ( s->m_ssl ) > 0 ) );
+	if ( ! s->m_keepAlive || s->m_streamingMode || ! done ||
+	     ( ! s->m_isIncoming && ! canPoolSocket ( s ) ) ) {
+		destroySocket ( s );
+		return;
+	}
+	if ( g_conf.m_logDebugTcp )
+		log("tcp: keeping sd=%i alive after %" PRId32" requests",
+		    s->m_sd,s->m_numRequests);
+	// free the request and the reply
+	if ( s->m_readBuf ) mfree (s->m_readBuf, s->m_readBufSize,"TcpServer");
+	if ( s->m_sendBuf ) mfree (s->m_sendBuf, s->m_sendBufSize,"TcpServer");
+	s->m_readBuf          = NULL;
+	s->m_readBufSize      = 0;
+	s->m_readOffset       = 0;
+	s->m_totalRead        = 0;
+	s->m_totalToRead      = 0;
+	s->m_sendBuf          = NULL;
+	s->m_sendBufSize      = 0;
+	s->m_sendBufUsed      = 0;
+	s->m_sendOffset       = 0;
+	s->m_totalSent        = 0;
+	s->m_totalToSend      = 0;
+	// the callback was called already, do not call it again when the
+	// client closes the socket
+	s->m_callback         = NULL;
+	s->m_state            = NULL;
+	s->m_waitingOnHandler = false;
+	s->m_keepAlive        = false;
+	s->m_tmp              = NULL;
+	// wait for the next request, readTimeoutPoll() closes it when idle
+	if ( ! s->m_readRegistered ) {
+		if ( ! g_loop.registerReadCallback ( s->m_sd , this ,
+						     readSocketWrapper ,
+						     s->m_niceness ) ) {
+			log("tcp: failed to register kept-alive sd=%i: %s",
+			    s->m_sd,mstrerror(g_errno));
+			destroySocket ( s );
+			return;
+		}
+		s->m_readRegistered = true;
+	}
+	s->m_sockState        = ST_AVAILABLE;
+	s->m_timeout          = g_conf.m_httpKeepAliveTimeout;
+	s->m_lastActionTime   = gettimeofdayInMilliseconds();
+	if ( ! s->m_isIncoming ) {
+		s->m_timeout = g_conf.m_spiderKeepAliveTimeout;
+		return;
+	}
+	// . the next request may be here already but we will not get a
+	//   ready-for-read signal for what was already read off the socket,
+	//   so read it from the loop. not here, we might be in sendMsg().
+	if ( ! s->m_pipeBuf && ! ( s->m_ssl && SSL_pending ( s->m_ssl ) > 0 ) )
+		return;
+	if ( m_readPendingRegistered ) return;
+	if ( ! g_loop.registerSleepCallback ( 0 , this , readPendingWrapper ,
+					      0 , true ) ) {
+		log("tcp: failed to register pipelined read: %s",
+		    mstrerror(g_errno));
+		destroySocket ( s );
+		return;
+	}
+	m_readPendingRegistered = true;
+}
+
+// . keep at most one idle connection per web server ip and port and
+//   "spider max idle sockets" in all
+bool TcpServer::canPoolSocket ( TcpSocket *s ) {
+	int32_t numIdle = 0;
+	for ( int32_t i = 0 ; i <= m_lastFilled ; i++ ) {
+		TcpSocket *t = m_tcpSockets[i];
+		if ( ! t || ! t->isAvailable() || t->m_isIncoming ) continue;
+		if ( t->m_numRequests <= 0 ) continue;
+		if ( t->m_ip == s->m_ip && t->m_port == s->m_port ) return false;
+		numIdle++;
+	}
+	return ( numIdle < g_conf.m_spiderMaxIdleSockets );
+}
+
+// . returns false if "s" is not a pooled connection whose request failed
+//   before we read anything. otherwise "s" is destroyed without calling
+//   its callback and the request is sent again on a new connection.
+// . *blocked is false if that did not block, g_errno is set then
+bool TcpServer::resendOnNewSocket ( TcpSocket *s , bool *blocked ) {
+	if ( s->m_isIncoming || s->m_numRequests < 2 ) return false;
+	if ( s->m_sockState == ST_CLOSE_CALLED ) return false;
+	if ( s->m_readOffset > 0 || ! s->m_sendBuf ) return false;
+	if ( s->m_sendBufUsed != s->m_totalToSend ) return false;
+	if ( s->m_streamingMode || s->m_tunnelMode ) return false;
+	if ( g_conf.m_logDebugTcp )
+		log("tcp: pooled sd=%i to %s was closed, resending: %s",
+		    s->m_sd,iptoa(s->m_ip),mstrerror(g_errno));
+	// sendMsg() checks hostnames are shorter than 254
+	char hostname[256];
+	int32_t hostnameLen = 0;
+	if ( s->m_hostname ) {
+		hostnameLen = strlen ( s->m_hostname );
+		if ( hostnameLen > 254 ) hostnameLen = 254;
+		gbmemcpy ( hostname , s->m_hostname , hostnameLen );
+	}
+	hostname [ hostnameLen ] = '\0';
+	char   *sendBuf        = s->m_sendBuf;
+	int32_t sendBufSize    = s->m_sendBufSize;
+	int32_t sendBufUsed    = s->m_sendBufUsed;
+	int32_t totalToSend    = s->m_totalToSend;
+	void   *state          = s->m_state;
+	void  (*callback)(void *state, TcpSocket *s) = s->m_callback;
+	int32_t timeout        = s->m_timeout;
+	int32_t maxTextDocLen  = s->m_maxTextDocLen;
+	int32_t maxOtherDocLen = s->m_maxOtherDocLen;
+	int32_t ip             = s->m_ip;
+	int16_t port           = s->m_port;
+	// do not free the request we are resending
+	s->m_sendBuf = NULL;
+	s->m_callback = NULL;
+	s->m_state = NULL;
+	g_errno = 0;
 	destroySocket ( s );
-	return;
+	// there is no other idle one to this ip/port, see canPoolSocket()
+	*blocked = ! sendMsg ( hostnameLen ? hostname : NULL , hostnameLen ,
+			       ip , port , sendBuf , sendBufSize , sendBufUsed ,
+			       totalToSend , state , callback , timeout ,
+			       maxTextDocLen , maxOtherDocLen );
+	return true;
+}
+
+// . resendOnNewSocket() from a loop callback where our caller is waiting
+//   for the callback
+// . returns false if "s" is not a pooled connection whose request failed
+bool TcpServer::retryRequest ( TcpSocket *s ) {
+	void  *state = s->m_state;
+	void (*callback)(void *state, TcpSocket *s) = s->m_callback;
+	bool blocked;
+	if ( ! resendOnNewSocket ( s , &blocked ) ) return false;
+	// it had an error without blocking, there is no socket now
+	if ( ! blocked && callback ) callback ( state , NULL );
+	return true;
+}
+
+static int64_t getSslSessionKey ( TcpSocket *s ) {
+	uint64_t h = ((uint64_t)(uint32_t)s->m_ip << 16) | (uint16_t)s->m_port;
+	if ( s->m_hostname )
+		h = hash64 ( s->m_hostname , strlen(s->m_hostname) , h );
+	return (int64_t)h;
+}
+
+void TcpServer::saveSslSession ( TcpSocket *s ) {
+	if ( ! m_useSSL ) return;
+	SSL_SESSION *sess = SSL_get1_session ( s->m_ssl );
+	if ( ! sess ) return;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	if ( ! SSL_SESSION_is_resumable ( sess ) ) {
+		SSL_SESSION_free ( sess );
+		return;
+	}
+#endif
+	if ( ! m_sslSessions.isInitialized() &&
+	     ! m_sslSessions.set ( 8 , sizeof(SSL_SESSION *) , 256 , NULL , 0 ,
+				   false , 0 , "sslsess" ) ) {
+		SSL_SESSION_free ( sess );
+		return;
+	}
+	int64_t key = getSslSessionKey ( s );
+	SSL_SESSION **old = (SSL_SESSION **)m_sslSessions.getValue ( &key );
+	if ( old ) {
+		SSL_SESSION_free ( *old );
+		*old = sess;
+		return;
+	}
+	// do not let it grow forever, they expire on the servers anyway
+	if ( m_sslSessions.getNumUsedSlots() >= MAX_SSL_SESSIONS )
+		clearSslSessions();
+	if ( ! m_sslSessions.addKey ( &key , &sess ) )
+		SSL_SESSION_free ( sess );
+}
+
+void TcpServer::resumeSslSession ( TcpSocket *s ) {
+	if ( ! m_useSSL || s->m_isIncoming ) return;
+	if ( ! m_sslSessions.isInitialized() ) return;
+	int64_t key = getSslSessionKey ( s );
+	SSL_SESSION **sess = (SSL_SESSION **)m_sslSessions.getValue ( &key );
+	if ( ! sess ) return;
+	if ( SSL_set_session ( s->m_ssl , *sess ) != 1 && g_conf.m_logDebugTcp )
+		log("tcp: could not resume ssl session for %s",iptoa(s->m_ip));
+}
+
+void TcpServer::clearSslSessions ( ) {
+	if ( ! m_sslSessions.isInitialized() ) return;
+	for ( int32_t i = 0 ; i < m_sslSessions.getNumSlots() ; i++ ) {
+		if ( m_sslSessions.isEmpty(i) ) continue;
+		SSL_SESSION_free ( *(SSL_SESSION **)m_sslSessions.getValueFromSlot(i) );
+	}
+	m_sslSessions.clear();
+}
+
+// . read the pipelined requests of the recycled sockets
+void readPendingWrapper ( int fd , void *state ) {
+	TcpServer *THIS = (TcpServer *)state;
+	g_loop.unregisterSleepCallback ( THIS , readPendingWrapper );
+	THIS->m_readPendingRegistered = false;
+	for ( int32_t i = 0 ; i <= THIS->m_lastFilled ; i++ ) {
+		TcpSocket *s = THIS->m_tcpSockets[i];
+		if ( ! s || ! s->isAvailable() || ! s->m_isIncoming ) continue;
+		if ( ! s->m_pipeBuf &&
+		     ! ( s->m_ssl && SSL_pending ( s->m_ssl ) > 0 ) ) continue;
+		readSocketWrapper ( s->m_sd , THIS );
+	}
 }
 
 // . called by Loop::runLoop() every one second
@@ -2358,6 +2692,16 @@ void TcpServer::readTimeoutPoll ( ) {
 			destroySocket ( s );
 			continue;
 		}
+		// . close kept-alive sockets that did not get another request
+		// . and pooled connections to web servers we did not reuse
+		if ( s->isAvailable() &&
+		     s->m_numRequests > 0 &&
+		     now - s->m_lastActionTime >= s->m_timeout ) {
+			if ( g_conf.m_logDebugTcp )
+				log("tcp: timeloop: closing idle sd=%i",s->m_sd);
+			destroySocket ( s );
+			continue;
+		}
 		// . if he is sending, that sticks too, so try it!
 		// . or if we're connecting to him...
 		if ( s->isSending() || 
@@ -2756,6 +3100,8 @@ int TcpServer::sslHandshake ( TcpSocket *s ) {
 		s->m_ssl = SSL_new(g_httpServer.m_ssltcp.m_ctx);
 		SSL_set_fd(s->m_ssl, s->m_sd);
 		SSL_set_connect_state(s->m_ssl);
+		// skip the full handshake if we were here before
+		resumeSslSession ( s );
 	}
 
 	// set hostname for SNI
@@ -29,10 +29,14 @@
 #include "MsgC.h"           // for udp-only, non-blocking dns lookups
 #include "TcpSocket.h"            
 #include "Loop.h"      // g_loop.registerRead/WriteCallback()
+#include "HashTableX.h"
 
 // raised from 5k to 15k in case we are a spider compression proxy
 #define MAX_TCP_SOCKS 15000
 
+// tls sessions of web servers we keep for resuming, see saveSslSession()
+#define MAX_SSL_SESSIONS 10000
+
 class TcpServer {
 
 	friend class HttpServer;
@@ -131,6 +135,19 @@ class TcpServer {
 
 	void       recycleSocket      ( TcpSocket *s ) ;
 
+	// . a pooled connection to a web server may have been closed while
+	//   idle. send the request of "s" again on a new one if so.
+	// . returns false if that was not the case
+	bool       resendOnNewSocket  ( TcpSocket *s , bool *blocked ) ;
+	bool       retryRequest       ( TcpSocket *s ) ;
+	// can "s" be kept as an idle connection to a web server?
+	bool       canPoolSocket      ( TcpSocket *s ) ;
+
+	// tls sessions of the web servers we download from
+	void       saveSslSession     ( TcpSocket *s ) ;
+	void       resumeSslSession   ( TcpSocket *s ) ;
+	void       clearSslSessions   ( ) ;
+
 	// only wrappers should call this 
 	int32_t       connectSocket      ( TcpSocket *s ) ;
 
@@ -143,11 +160,13 @@ class TcpServer {
 
 	// private:
 
-	TcpSocket *getAvailableSocket ( int32_t ip, int16_t port ) ;
+	TcpSocket *getAvailableSocket ( int32_t ip, int16_t port ,
+					const char *hostname , int32_t hostnameLen ) ;
 	TcpSocket *getNewSocket       ( ) ;
 	TcpSocket *wrapSocket         ( int sd , int32_t niceness, bool incoming);
 	bool       closeLeastUsed     ( int32_t maxIdleTime = -1 ) ;
 	bool       setTotalToRead     ( TcpSocket *s ) ;
+	int32_t    splitPipelinedRequest ( TcpSocket *s ) ;
 
 	int sslHandshake ( TcpSocket *s ) ;
 
@@ -205,6 +224,12 @@ class TcpServer {
 	// ready to go or not
 	bool m_ready;
 
+	// is readPendingWrapper() registered to read pipelined requests?
+	bool m_readPendingRegistered;
+
+	// resumable SSL_SESSION ptrs by hash of ip, port and hostname
+	HashTableX m_sslSessions;
+
 	int32_t m_numOpen;
 	int32_t m_numClosed;
 };
@@ -122,7 +122,21 @@ class TcpSocket {
 	char        m_niceness;
 	char        m_streamingMode;
 
+	// . keep an incoming connection open after the reply is sent and
+	//   read the next request from it, set by the request handler
+	// . m_numRequests is how many requests were read on it so far
+	char        m_keepAlive;
+	int32_t     m_numRequests;
+	// . bytes read past the end of the current request, the start of the
+	//   next pipelined request. becomes m_readBuf once we reply
+	char       *m_pipeBuf;
+	int32_t     m_pipeBufSize;
+	int32_t     m_pipeBufUsed;
+
 	bool m_writeRegistered;
+	// . an incoming socket is not read from while its request is being
+	//   handled and the reply sent
+	bool m_readRegistered;
 
 	int32_t m_shutdownStart;
 
@@ -0,0 +1,324 @@
+#include "gb-include.h"
+
+#include "TermFreqTable.h"
+#include "RdbList.h"
+#include "Posdb.h"
+#include "hash.h"
+#include "Log.h"
+#include "Mem.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const uint32_t s_magic   = 0x46544247; // "GBTF"
+static const uint32_t s_version = 1;
+
+// default dimensions, about 6MB per collection
+static const uint32_t s_defaultNumSlots    = 1<<17;
+static const uint32_t s_defaultSketchDepth = 4;
+static const uint32_t s_defaultSketchWidth = 1<<18;
+
+// terms in at least this many docs are counted exactly
+static const int64_t s_exactThreshold = 1000;
+
+// the header is padded to this so the slots are 16 byte aligned
+static const size_t s_headerSize = 32;
+
+struct TermFreqTable::Header {
+	uint32_t m_magic;
+	uint32_t m_version;
+	uint32_t m_numSlots;    // power of 2
+	uint32_t m_numUsed;
+	uint32_t m_sketchDepth;
+	uint32_t m_sketchWidth; // power of 2
+};
+
+static size_t getBufSize ( uint32_t numSlots , uint32_t depth , uint32_t width ) {
+	return s_headerSize + (size_t)numSlots * 16 + (size_t)depth * width * sizeof(int32_t);
+}
+
+TermFreqTable::TermFreqTable()
+  : m_buf(NULL), m_bufSize(0), m_isMapped(false), m_needsSave(false),
+    m_header(NULL), m_slots(NULL), m_sketch(NULL)
+{
+}
+
+TermFreqTable::~TermFreqTable() {
+	reset();
+}
+
+void TermFreqTable::reset ( ) {
+	if ( m_buf ) {
+		if ( m_isMapped ) munmap ( m_buf , m_bufSize );
+		else              mfree ( m_buf , m_bufSize , "TermFreqTable" );
+	}
+	m_buf       = NULL;
+	m_bufSize   = 0;
+	m_isMapped  = false;
+	m_needsSave = false;
+	m_header    = NULL;
+	m_slots     = NULL;
+	m_sketch    = NULL;
+}
+
+bool TermFreqTable::init ( ) {
+	return allocate ( s_defaultNumSlots , s_defaultSketchDepth ,
+			  s_defaultSketchWidth );
+}
+
+bool TermFreqTable::allocate ( uint32_t numSlots , uint32_t depth , uint32_t width ) {
+	reset();
+	m_bufSize = getBufSize ( numSlots , depth , width );
+	m_buf = (char *)mcalloc ( m_bufSize , "TermFreqTable" );
+	if ( ! m_buf ) {
+		m_bufSize = 0;
+		return false;
+	}
+	m_header = (Header *)m_buf;
+	m_header->m_magic       = s_magic;
+	m_header->m_version     = s_version;
+	m_header->m_numSlots    = numSlots;
+	m_header->m_numUsed     = 0;
+	m_header->m_sketchDepth = depth;
+	m_header->m_sketchWidth = width;
+	setPointers();
+	m_needsSave = true;
+	return true;
+}
+
+void TermFreqTable::setPointers ( ) {
+	m_header = (Header *)m_buf;
+	m_slots  = (Slot *)(m_buf + s_headerSize);
+	m_sketch = (int32_t *)(m_buf + s_headerSize + (size_t)m_header->m_numSlots * 16);
+}
+
+int32_t TermFreqTable::getNumExactTerms ( ) const {
+	return m_header ? m_header->m_numUsed : 0;
+}
+
+// . slot keys are termId+1 so an all zero slot is empty
+// . returns the slot for termId or the empty slot it would go in
+TermFreqTable::Slot *TermFreqTable::findSlot ( int64_t termId ) const {
+	int64_t key  = termId + 1;
+	uint32_t mask = m_header->m_numSlots - 1;
+	uint32_t n    = hash64h ( (uint64_t)termId , 0x9e3779b97f4a7c15ULL ) & mask;
+	for ( ; ; n = (n + 1) & mask ) {
+		Slot *slot = &m_slots[n];
+		if ( slot->m_termId == key || slot->m_termId == 0 )
+			return slot;
+	}
+}
+
+int64_t TermFreqTable::getSketchCount ( int64_t termId ) const {
+	uint32_t width = m_header->m_sketchWidth;
+	int64_t min = INT64_MAX;
+	for ( uint32_t i = 0 ; i < m_header->m_sketchDepth ; i++ ) {
+		uint32_t n = hash64h ( (uint64_t)termId , i + 1 ) & (width - 1);
+		int64_t c = m_sketch[ (size_t)i * width + n ];
+		if ( c < min ) min = c;
+	}
+	return min > 0 ? min : 0;
+}
+
+void TermFreqTable::addSketchCount ( int64_t termId , int64_t delta ) {
+	uint32_t width = m_header->m_sketchWidth;
+	for ( uint32_t i = 0 ; i < m_header->m_sketchDepth ; i++ ) {
+		uint32_t n = hash64h ( (uint64_t)termId , i + 1 ) & (width - 1);
+		m_sketch[ (size_t)i * width + n ] += (int32_t)delta;
+	}
+}
+
+void TermFreqTable::addTermFreq ( int64_t termId , int64_t delta ) {
+	if ( ! m_buf || delta == 0 ) return;
+	Slot *slot = findSlot ( termId );
+	if ( slot->m_termId ) {
+		slot->m_count += delta;
+		m_needsSave = true;
+		return;
+	}
+	// . the sketch counters are shared by many terms, taking one off
+	//   could make another term's count too low
+	// . so the sketch over-estimates deleted docs until the next rebuild
+	if ( delta < 0 ) return;
+	m_needsSave = true;
+	// promote the term to an exact count once it gets frequent, keep
+	// the hash table at most 75% full
+	int64_t count = getSketchCount ( termId ) + delta;
+	if ( count >= s_exactThreshold &&
+	     m_header->m_numUsed < m_header->m_numSlots / 4 * 3 ) {
+		slot->m_termId = termId + 1;
+		slot->m_count  = count;
+		m_header->m_numUsed++;
+		return;
+	}
+	addSketchCount ( termId , delta );
+}
+
+int64_t TermFreqTable::getTermFreq ( int64_t termId ) const {
+	if ( ! m_buf ) return 0;
+	const Slot *slot = findSlot ( termId );
+	if ( slot->m_termId ) return slot->m_count > 0 ? slot->m_count : 0;
+	return getSketchCount ( termId );
+}
+
+// . the change in the number of documents from the keys of a docid
+// . a doc with both kinds of keys was reindexed and still has the term
+static int64_t getDocDelta ( bool hasPos , bool hasNeg ) {
+	if ( hasPos && hasNeg ) return 0;
+	return hasPos ? 1 : -1;
+}
+
+void TermFreqTable::addPosdbList ( RdbList *list ) {
+	if ( ! m_buf ) return;
+	int64_t curTermId = -1;
+	int64_t curDocId  = -1;
+	bool    hasPos    = false;
+	bool    hasNeg    = false;
+	int64_t count     = 0;
+	char key[MAX_KEY_BYTES];
+	for ( list->resetListPtr() ; ! list->isExhausted() ;
+	      list->skipCurrentRecord() ) {
+		list->getCurrentKey ( key );
+		int64_t termId = Posdb::getTermId ( key );
+		int64_t docId  = Posdb::getDocId  ( key );
+		// only count each doc once, not every word position
+		if ( termId != curTermId || docId != curDocId ) {
+			if ( curDocId >= 0 ) count += getDocDelta ( hasPos , hasNeg );
+			curDocId = docId;
+			hasPos   = false;
+			hasNeg   = false;
+		}
+		if ( termId != curTermId ) {
+			if ( curTermId >= 0 ) addTermFreq ( curTermId , count );
+			curTermId = termId;
+			count     = 0;
+		}
+		if ( KEYNEG ( key ) ) hasNeg = true;
+		else                  hasPos = true;
+	}
+	if ( curDocId >= 0 ) count += getDocDelta ( hasPos , hasNeg );
+	if ( curTermId >= 0 ) addTermFreq ( curTermId , count );
+	list->resetListPtr();
+}
+
+int64_t TermFreqTable::countPosdbDocs ( RdbList *list ) {
+	int64_t curDocId = -1;
+	bool    hasPos   = false;
+	bool    hasNeg   = false;
+	int64_t count    = 0;
+	char key[MAX_KEY_BYTES];
+	for ( list->resetListPtr() ; ! list->isExhausted() ;
+	      list->skipCurrentRecord() ) {
+		list->getCurrentKey ( key );
+		int64_t docId = Posdb::getDocId ( key );
+		if ( docId != curDocId ) {
+			if ( curDocId >= 0 ) count += getDocDelta ( hasPos , hasNeg );
+			curDocId = docId;
+			hasPos   = false;
+			hasNeg   = false;
+		}
+		if ( KEYNEG ( key ) ) hasNeg = true;
+		else                  hasPos = true;
+	}
+	if ( curDocId >= 0 ) count += getDocDelta ( hasPos , hasNeg );
+	list->resetListPtr();
+	return count;
+}
+
+void TermFreqTable::addTable ( const TermFreqTable *other ) {
+	if ( ! m_buf || ! other->m_buf ) return;
+	for ( uint32_t i = 0 ; i < other->m_header->m_numSlots ; i++ ) {
+		const Slot *slot = &other->m_slots[i];
+		if ( slot->m_termId )
+			addTermFreq ( slot->m_termId - 1 , slot->m_count );
+	}
+	if ( other->m_header->m_sketchDepth != m_header->m_sketchDepth ||
+	     other->m_header->m_sketchWidth != m_header->m_sketchWidth ) {
+		log(LOG_WARN,"posdb: term freq sketch dimensions differ, "
+		    "not adding sketch counts");
+		return;
+	}
+	size_t n = (size_t)m_header->m_sketchDepth * m_header->m_sketchWidth;
+	for ( size_t i = 0 ; i < n ; i++ )
+		m_sketch[i] += other->m_sketch[i];
+	m_needsSave = true;
+}
+
+bool TermFreqTable::load ( const char *filename ) {
+	reset();
+	int fd = open ( filename , O_RDONLY );
+	if ( fd < 0 ) {
+		// not having a table yet is fine
+		if ( errno == ENOENT ) return false;
+		log(LOG_WARN,"posdb: open %s: %s",filename,mstrerror(errno));
+		return false;
+	}
+	struct stat st;
+	if ( fstat ( fd , &st ) != 0 || st.st_size < (off_t)s_headerSize ) {
+		log(LOG_WARN,"posdb: bad term freq table %s",filename);
+		close ( fd );
+		return false;
+	}
+	// private mapping, our updates are only written back by save()
+	void *p = mmap ( NULL , st.st_size , PROT_READ|PROT_WRITE ,
+			 MAP_PRIVATE , fd , 0 );
+	close ( fd );
+	if ( p == MAP_FAILED ) {
+		log(LOG_WARN,"posdb: mmap %s: %s",filename,mstrerror(errno));
+		return false;
+	}
+	m_buf      = (char *)p;
+	m_bufSize  = st.st_size;
+	m_isMapped = true;
+	m_header   = (Header *)m_buf;
+	if ( m_header->m_magic != s_magic ||
+	     m_header->m_version != s_version ||
+	     ( m_header->m_numSlots & (m_header->m_numSlots - 1) ) ||
+	     ( m_header->m_sketchWidth & (m_header->m_sketchWidth - 1) ) ||
+	     m_bufSize != getBufSize ( m_header->m_numSlots ,
+				       m_header->m_sketchDepth ,
+				       m_header->m_sketchWidth ) ) {
+		log(LOG_WARN,"posdb: term freq table %s is corrupt or from "
+		    "another version, ignoring it",filename);
+		reset();
+		return false;
+	}
+	setPointers();
+	m_needsSave = false;
+	log(LOG_INFO,"posdb: loaded %s with %" PRId32" exact terms",
+	    filename, getNumExactTerms());
+	return true;
+}
+
+bool TermFreqTable::save ( const char *filename ) {
+	if ( ! m_buf ) return true;
+	char tmp[1024];
+	snprintf ( tmp , sizeof(tmp) , "%s.saving" , filename );
+	int fd = open ( tmp , O_WRONLY|O_CREAT|O_TRUNC , getFileCreationFlags() );
+	if ( fd < 0 ) {
+		log(LOG_WARN,"posdb: open %s: %s",tmp,mstrerror(errno));
+		return false;
+	}
+	size_t done = 0;
+	while ( done < m_bufSize ) {
+		ssize_t n = write ( fd , m_buf + done , m_bufSize - done );
+		if ( n < 0 ) {
+			if ( errno == EINTR ) continue;
+			log(LOG_WARN,"posdb: write %s: %s",tmp,mstrerror(errno));
+			close ( fd );
+			unlink ( tmp );
+			return false;
+		}
+		done += n;
+	}
+	close ( fd );
+	// a mapping of the old file stays valid after the rename
+	if ( rename ( tmp , filename ) != 0 ) {
+		log(LOG_WARN,"posdb: rename %s: %s",tmp,mstrerror(errno));
+		unlink ( tmp );
+		return false;
+	}
+	m_needsSave = false;
+	return true;
+}
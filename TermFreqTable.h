@@ -0,0 +1,90 @@
+// . per-collection table of posdb term frequencies, ie. the number of
+//   documents on this host that have a termid
+// . replaces walking the RdbMap of every posdb file for every query term in
+//   Posdb::getTermFreq()
+// . frequent terms are counted exactly in an open addressing hash table, the
+//   rest go into a count-min sketch which only over-estimates by a small
+//   fraction of the total count, which is not enough to move the weight of
+//   a rare term
+// . rebuilt from the merged list on a merge of all posdb files and then kept
+//   up to date with the lists dumped from the tree
+// . the counts drift up between those merges: a reindexed doc whose keys
+//   were all dumped positive again counts twice, and deleted docs of a
+//   term in the sketch are not taken off since the counters are shared.
+//   merges of only some of the files do not touch the table
+// . the keys still in the tree are not in the table, Posdb::getTermFreq()
+//   counts their docs with countPosdbDocs()
+// . the table is one flat buffer, so the saved file is mmap'ed at startup
+
+#ifndef GB_TERMFREQTABLE_H
+#define GB_TERMFREQTABLE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+class RdbList;
+
+class TermFreqTable {
+public:
+	TermFreqTable();
+	~TermFreqTable();
+
+	// allocate an empty table with the default dimensions
+	bool init ( );
+	void reset ( );
+
+	bool isEmpty ( ) const { return m_buf == NULL; }
+
+	// . count the documents in a posdb list as dumped or merged to disk
+	// . a docid with only negative keys counts as -1, with both kinds as 0
+	void addPosdbList ( RdbList *list );
+
+	// the change in the number of documents from the keys of a single
+	// termid, counted like addPosdbList()
+	static int64_t countPosdbDocs ( RdbList *list );
+
+	// a negative delta only applies to the exactly counted terms
+	void addTermFreq ( int64_t termId , int64_t delta );
+
+	// add all counts of "other" into this table
+	void addTable ( const TermFreqTable *other );
+
+	// . number of documents having termId
+	// . constant time: one hash table probe or a few sketch counters
+	int64_t getTermFreq ( int64_t termId ) const;
+
+	int32_t getNumExactTerms ( ) const;
+
+	bool load ( const char *filename );
+	bool save ( const char *filename );
+
+	bool needsSave ( ) const { return m_needsSave; }
+
+private:
+	TermFreqTable(const TermFreqTable&);
+	TermFreqTable& operator=(const TermFreqTable&);
+
+	struct Header;
+	struct Slot {
+		int64_t m_termId; // 0 = empty slot
+		int64_t m_count;
+	};
+
+	bool allocate ( uint32_t numSlots , uint32_t depth , uint32_t width );
+	void setPointers ( );
+
+	Slot *findSlot ( int64_t termId ) const;
+	int64_t getSketchCount ( int64_t termId ) const;
+	void addSketchCount ( int64_t termId , int64_t delta );
+
+	char    *m_buf;
+	size_t   m_bufSize;
+	bool     m_isMapped;
+	bool     m_needsSave;
+
+	Header  *m_header;
+	Slot    *m_slots;
+	int32_t *m_sketch;
+};
+
+#endif // GB_TERMFREQTABLE_H
@@ -0,0 +1,533 @@
+#include "gb-include.h"
+
+#include "TermListCache.h"
+#include "Msg5.h"
+#include "RdbList.h"
+#include "Posdb.h"
+#include "Collectiondb.h"
+#include "RdbBase.h"
+#include "Rdb.h"
+#include "Conf.h"
+#include "Mem.h"
+#include "Log.h"
+#include "max_niceness.h"
+#include <algorithm>
+#include <sys/mman.h>
+
+TermListCache g_termListCache;
+
+// add a skip point every this many bytes of a termlist
+static const int32_t s_skipDistance = 16384;
+
+// halve the access counts after this many accesses
+static const uint32_t s_decayInterval = 65536;
+
+// or when we are tracking this many terms
+static const size_t s_maxTrackedTerms = 1000000;
+
+static const size_t s_hugePageSize = 2*1024*1024;
+
+TermListCache::TermListCache()
+  : m_entries(),
+    m_accessCounts(),
+    m_tooBig(),
+    m_accessesSinceDecay(0),
+    m_memUsed(0),
+    m_numHits(0),
+    m_numMisses(0),
+    m_loadMsg5(NULL),
+    m_loadList(NULL),
+    m_loading(false),
+    m_loadCollnum(-1),
+    m_loadTermId(0),
+    m_loadMaxSize(0),
+    m_loadCancelled(false)
+{
+}
+
+TermListCache::~TermListCache() {
+	// the Msg5 and the lists are freed by reset() at shutdown, freeing
+	// them here after g_mem is gone would only upset the accounting
+}
+
+void TermListCache::reset ( ) {
+	for ( auto it = m_entries.begin() ; it != m_entries.end() ; ++it )
+		freeEntry ( &it->second );
+	m_entries.clear();
+	m_accessCounts.clear();
+	m_tooBig.clear();
+	m_accessesSinceDecay = 0;
+	m_memUsed = 0;
+	// can not free the Msg5 while it is reading, just forget the result
+	if ( m_loading ) {
+		m_loadCancelled = true;
+		return;
+	}
+	if ( m_loadMsg5 ) {
+		mdelete ( m_loadMsg5 , sizeof(Msg5) , "TermListCache" );
+		delete m_loadMsg5;
+		m_loadMsg5 = NULL;
+	}
+	if ( m_loadList ) {
+		mdelete ( m_loadList , sizeof(RdbList) , "TermListCache" );
+		delete m_loadList;
+		m_loadList = NULL;
+	}
+}
+
+// the largest termlist we cache, so a single term can not take it all
+static int32_t getMaxListSize ( ) {
+	int64_t max = g_conf.m_termListCacheMaxMem / 4;
+	if ( max > 0x7fffffff ) max = 0x7fffffff;
+	return (int32_t)max;
+}
+
+uint32_t TermListCache::noteAccess ( uint64_t key ) {
+	uint32_t count = ++m_accessCounts[key];
+	if ( ++m_accessesSinceDecay >= s_decayInterval ||
+	     m_accessCounts.size() > s_maxTrackedTerms ) {
+		decayAccessCounts();
+		count = getAccessCount ( key );
+	}
+	return count;
+}
+
+uint32_t TermListCache::getAccessCount ( uint64_t key ) const {
+	auto it = m_accessCounts.find ( key );
+	if ( it == m_accessCounts.end() ) return 0;
+	return it->second;
+}
+
+void TermListCache::decayAccessCounts ( ) {
+	m_accessesSinceDecay = 0;
+	for ( auto it = m_accessCounts.begin() ; it != m_accessCounts.end() ; ) {
+		it->second >>= 1;
+		if ( it->second ) {
+			++it;
+			continue;
+		}
+		// forgotten terms may be tried again later
+		m_tooBig.erase ( it->first );
+		it = m_accessCounts.erase ( it );
+	}
+}
+
+bool TermListCache::isCached ( collnum_t collnum , int64_t termId ) const {
+	return m_entries.find ( makeCacheKey(collnum,termId) ) != m_entries.end();
+}
+
+// . the keys of the posdb tree in [startKey,endKey], adds and deletes
+// . returns false if there are none
+static bool getTreeList ( collnum_t collnum , const char *startKey ,
+			  const char *endKey , RdbList *list ) {
+	CollectionRec *cr = g_collectiondb.getRec ( collnum );
+	RdbBase *base = cr ? cr->getBase ( RDB_POSDB ) : NULL;
+	if ( ! base ) return false;
+	Rdb *rdb = base->m_rdb;
+	bool status;
+	if ( rdb->useTree() )
+		status = rdb->getTree()->getList ( collnum , startKey , endKey ,
+						   -1 , list , NULL , NULL ,
+						   base->useHalfKeys() );
+	else
+		status = rdb->m_buckets.getList ( collnum , startKey , endKey ,
+						  -1 , list , NULL , NULL ,
+						  base->useHalfKeys() );
+	if ( ! status ) {
+		log(LOG_WARN,"query: termlist cache: could not get keys from "
+		    "the tree: %s",mstrerror(g_errno));
+		g_errno = 0;
+		return false;
+	}
+	return ! list->isEmpty();
+}
+
+bool TermListCache::getList ( collnum_t collnum , int64_t termId ,
+			      const char *startKey , const char *endKey ,
+			      int32_t minRecSizes , bool includeTree ,
+			      int32_t numFiles , RdbList *list ) {
+	if ( g_conf.m_termListCacheMaxMem <= 0 ) return false;
+	// we have the keys of all the files or none
+	if ( numFiles != -1 ) return false;
+
+	uint64_t key = makeCacheKey ( collnum , termId );
+	uint32_t count = noteAccess ( key );
+
+	auto it = m_entries.find ( key );
+	if ( it == m_entries.end() ) {
+		m_numMisses++;
+		if ( ! m_loading &&
+		     count >= (uint32_t)g_conf.m_termListCacheMinHits &&
+		     m_tooBig.find ( key ) == m_tooBig.end() )
+			startLoad ( collnum , termId );
+		return false;
+	}
+	m_numHits++;
+
+	// . find the bytes covering the docid range using the skip points
+	// . the first skip point is always at offset 0
+	const Entry &e = it->second;
+	int64_t docId0 = Posdb::getDocId ( startKey );
+	int64_t docId1 = Posdb::getDocId ( endKey );
+	int32_t start = 0;
+	int32_t end   = e.m_size;
+	for ( size_t i = 1 ; i < e.m_skip.size() ; i++ ) {
+		if ( e.m_skip[i].m_docId <= docId0 )
+			start = e.m_skip[i].m_offset;
+		if ( e.m_skip[i].m_docId > docId1 ) {
+			end = e.m_skip[i].m_offset;
+			break;
+		}
+	}
+
+	// if the range starts at a 12 byte key make it a full key again
+	int32_t firstKeySize = Posdb::getKeySize ( e.m_buf + start );
+	int32_t size = end - start;
+	if ( firstKeySize == 12 ) size += 6;
+
+	char *buf = (char *)mmalloc ( size , "RdbList" );
+	if ( ! buf ) {
+		// just read it from posdb then
+		g_errno = 0;
+		return false;
+	}
+	if ( firstKeySize == 12 ) {
+		memcpy ( buf , e.m_buf + start , 12 );
+		buf[0] &= 0xfd;
+		memcpy ( buf + 12 , e.m_hi , 6 );
+		memcpy ( buf + 18 , e.m_buf + start + 12 , end - start - 12 );
+	}
+	else
+		memcpy ( buf , e.m_buf + start , end - start );
+
+	// . the newer keys in the tree go on top of the cached ones
+	// . the cached part is constrained to [startKey,endKey] first
+	RdbList treeList;
+	bool hasTree = includeTree &&
+		       getTreeList ( collnum , startKey , endKey , &treeList );
+	RdbList cached;
+	RdbList *dst = hasTree ? &cached : list;
+
+	dst->set ( buf ,
+		   size ,
+		   buf ,
+		   size ,
+		   startKey ,
+		   endKey ,
+		   0 ,     // fixeddatasize
+		   true ,  // owndata
+		   true ,  // usehalfkeys
+		   18 );   // keysize
+	char endKeyCopy[18];
+	memcpy ( endKeyCopy , endKey , sizeof(endKeyCopy) ); //constrain() modifies endkey
+	dst->constrain ( startKey ,
+			 endKeyCopy ,
+			 hasTree ? -1 : minRecSizes ,
+			 0 ,     // hintOffset
+			 NULL ,  // hintKey
+			 "" ,    // filename
+			 0 );    // niceness
+	if ( ! hasTree ) return true;
+
+	RdbList *lists[2] = { &cached , &treeList };
+	if ( ! list->prepareForMerge ( lists , 2 , minRecSizes ) ) {
+		// just read it from posdb then
+		g_errno = 0;
+		return false;
+	}
+	list->merge_r ( lists , 2 , startKey , endKey , minRecSizes ,
+			true , // remove negative keys
+			RDB_POSDB , 0 );
+	return true;
+}
+
+bool TermListCache::setEntry ( Entry *e , const char *data , int32_t size ) {
+	if ( size < 18 || Posdb::getKeySize ( data ) != 18 ) {
+		log(LOG_LOGIC,"query: termlist cache: list does not start with "
+		    "a full key");
+		return false;
+	}
+	e->m_buf = (char *)mmalloc ( size , "TermListCache" );
+	if ( ! e->m_buf ) {
+		g_errno = 0;
+		return false;
+	}
+	memcpy ( e->m_buf , data , size );
+	e->m_size = size;
+	memcpy ( e->m_hi , data + 12 , 6 );
+
+	// ask for transparent huge pages for the aligned part of big lists
+	// to save on tlb misses when intersecting them
+	if ( g_conf.m_termListCacheUseHugePages && (size_t)size >= 2*s_hugePageSize ) {
+		uintptr_t a = ((uintptr_t)e->m_buf + s_hugePageSize - 1) & ~(s_hugePageSize-1);
+		uintptr_t b = ((uintptr_t)e->m_buf + size) & ~(s_hugePageSize-1);
+		if ( b > a ) madvise ( (void *)a , b - a , MADV_HUGEPAGE );
+	}
+
+	// skip points go on the first key of a docid, which is a 12 byte key
+	// except for the very first key
+	e->m_skip.clear();
+	int32_t lastSkip = -s_skipDistance;
+	char key[18];
+	for ( int32_t off = 0 ; off < size ; ) {
+		int32_t ks = Posdb::getKeySize ( e->m_buf + off );
+		if ( ks != 6 && off - lastSkip >= s_skipDistance ) {
+			memcpy ( key , e->m_buf + off , ks == 18 ? 18 : 12 );
+			if ( ks == 12 ) memcpy ( key + 12 , e->m_hi , 6 );
+			SkipPoint sp;
+			sp.m_docId  = Posdb::getDocId ( key );
+			sp.m_offset = off;
+			e->m_skip.push_back ( sp );
+			lastSkip = off;
+		}
+		off += ks;
+	}
+
+	m_memUsed += size;
+	return true;
+}
+
+void TermListCache::freeEntry ( Entry *e ) {
+	if ( e->m_buf ) {
+		mfree ( e->m_buf , e->m_size , "TermListCache" );
+		m_memUsed -= e->m_size;
+	}
+	e->m_buf  = NULL;
+	e->m_size = 0;
+	e->m_skip.clear();
+}
+
+void TermListCache::removeEntry ( std::unordered_map<uint64_t,Entry>::iterator it ) {
+	freeEntry ( &it->second );
+	m_entries.erase ( it );
+}
+
+// . evict terms accessed less than "accessCount" times until "size" fits
+// . evicts nothing if that is not enough
+bool TermListCache::makeRoom ( int32_t size , uint32_t accessCount ) {
+	int64_t need = m_memUsed + size - g_conf.m_termListCacheMaxMem;
+	if ( need <= 0 ) return true;
+
+	std::vector< std::pair<uint32_t,uint64_t> > colder;
+	for ( auto it = m_entries.begin() ; it != m_entries.end() ; ++it ) {
+		uint32_t c = getAccessCount ( it->first );
+		if ( c < accessCount ) colder.push_back ( std::make_pair(c,it->first) );
+	}
+	std::sort ( colder.begin() , colder.end() );
+
+	int64_t freed = 0;
+	size_t n = 0;
+	for ( ; n < colder.size() && freed < need ; n++ )
+		freed += m_entries[colder[n].second].m_size;
+	if ( freed < need ) return false;
+
+	for ( size_t i = 0 ; i < n ; i++ )
+		removeEntry ( m_entries.find ( colder[i].second ) );
+	return true;
+}
+
+bool TermListCache::addList ( collnum_t collnum , int64_t termId , RdbList *list ) {
+	int32_t size = list->getListSize();
+	if ( size <= 0 || size > getMaxListSize() ) return false;
+
+	uint64_t key = makeCacheKey ( collnum , termId );
+	auto it = m_entries.find ( key );
+	if ( it != m_entries.end() ) removeEntry ( it );
+
+	if ( ! makeRoom ( size , getAccessCount ( key ) ) ) return false;
+
+	Entry e;
+	if ( ! setEntry ( &e , list->getList() , size ) ) return false;
+	m_entries[key] = e;
+
+	log(LOG_DEBUG,"query: termlist cache: added termid %" PRId64" "
+	    "collnum %" PRId32" size=%" PRId32". now %" PRId32" lists, "
+	    "%" PRId64" bytes.",
+	    termId, (int32_t)collnum, size, getNumLists(), m_memUsed);
+	return true;
+}
+
+// . "run" is all the keys of one termid in a dumped list
+// . the dumped keys are newer than the cached ones, so negative keys
+//   annihilate the cached positive keys and everything else is a union
+bool TermListCache::mergeIntoEntry ( uint64_t key , const char *run , int32_t runSize ) {
+	auto it = m_entries.find ( key );
+	if ( it == m_entries.end() ) return false;
+	Entry &e = it->second;
+
+	int64_t termId = (int64_t)(key & 0xffffffffffffULL);
+	char startKey[18];
+	char endKey[18];
+	Posdb::makeStartKey ( startKey , termId );
+	Posdb::makeEndKey   ( endKey   , termId );
+
+	RdbList cached;
+	RdbList dumped;
+	cached.set ( e.m_buf , e.m_size , e.m_buf , e.m_size ,
+		     startKey , endKey , 0 , false , true , 18 );
+	dumped.set ( (char *)run , runSize , (char *)run , runSize ,
+		     startKey , endKey , 0 , false , true , 18 );
+	RdbList *lists[2] = { &cached , &dumped };
+
+	RdbList merged;
+	if ( ! merged.prepareForMerge ( lists , 2 , -1 ) ) {
+		log(LOG_WARN,"query: termlist cache: could not merge dumped "
+		    "keys of termid %" PRId64": %s",termId,mstrerror(g_errno));
+		g_errno = 0;
+		removeEntry ( it );
+		return false;
+	}
+	merged.merge_r ( lists , 2 , startKey , endKey , -1 ,
+			 true , // remove negative keys
+			 RDB_POSDB , 0 );
+
+	removeEntry ( it );
+	int32_t size = merged.getListSize();
+	if ( size <= 0 || size > getMaxListSize() ) return false;
+	if ( ! makeRoom ( size , getAccessCount ( key ) ) ) return false;
+
+	Entry ne;
+	if ( ! setEntry ( &ne , merged.getList() , size ) ) return false;
+	m_entries[key] = ne;
+	return true;
+}
+
+void TermListCache::addDumpedList ( collnum_t collnum , RdbList *list ) {
+	// . a termlist being read may miss the dumped keys, the tree was not
+	//   part of the read
+	// . it will be loaded again on a later access
+	if ( m_loading && m_loadCollnum == collnum )
+		m_loadCancelled = true;
+
+	if ( m_entries.empty() ) return;
+
+	// . a new termid always starts with a full 18 byte key, 12 and 6 byte
+	//   keys share the termid with the key before
+	// . merge each run of keys of a cached termid
+	const char *p   = list->getList();
+	const char *end = p + list->getListSize();
+	const char *runStart = NULL;
+	uint64_t runKey = 0;
+	bool runCached = false;
+	for ( ; p < end ; p += Posdb::getKeySize ( p ) ) {
+		if ( Posdb::getKeySize ( p ) != 18 ) continue;
+		uint64_t key = makeCacheKey ( collnum , Posdb::getTermId ( p ) );
+		if ( runStart && key == runKey ) continue;
+		if ( runStart && runCached )
+			mergeIntoEntry ( runKey , runStart , p - runStart );
+		runStart  = p;
+		runKey    = key;
+		runCached = m_entries.find ( key ) != m_entries.end();
+	}
+	if ( runStart && runCached )
+		mergeIntoEntry ( runKey , runStart , end - runStart );
+}
+
+void TermListCache::removeCollection ( collnum_t collnum ) {
+	for ( auto it = m_entries.begin() ; it != m_entries.end() ; ) {
+		if ( (collnum_t)(it->first >> 48) != collnum ) {
+			++it;
+			continue;
+		}
+		freeEntry ( &it->second );
+		it = m_entries.erase ( it );
+	}
+	if ( m_loading && m_loadCollnum == collnum )
+		m_loadCancelled = true;
+}
+
+void TermListCache::startLoad ( collnum_t collnum , int64_t termId ) {
+	// is there room for it if it were of average size?
+	if ( ! m_entries.empty() && m_memUsed >= g_conf.m_termListCacheMaxMem ) {
+		uint32_t count = getAccessCount ( makeCacheKey(collnum,termId) );
+		bool colder = false;
+		for ( auto it = m_entries.begin() ; it != m_entries.end() ; ++it ) {
+			if ( getAccessCount ( it->first ) < count ) {
+				colder = true;
+				break;
+			}
+		}
+		if ( ! colder ) return;
+	}
+
+	if ( ! m_loadMsg5 ) {
+		try {
+			m_loadMsg5 = new Msg5;
+			mnew ( m_loadMsg5 , sizeof(Msg5) , "TermListCache" );
+			m_loadList = new RdbList;
+			mnew ( m_loadList , sizeof(RdbList) , "TermListCache" );
+		} catch ( std::bad_alloc & ) {
+			log(LOG_WARN,"query: termlist cache: new failed");
+			return;
+		}
+	}
+
+	m_loading       = true;
+	m_loadCancelled = false;
+	m_loadCollnum   = collnum;
+	m_loadTermId    = termId;
+	m_loadMaxSize   = getMaxListSize();
+	Posdb::makeStartKey ( m_loadStartKey , termId );
+	Posdb::makeEndKey   ( m_loadEndKey   , termId );
+
+	log(LOG_DEBUG,"query: termlist cache: loading termid %" PRId64" "
+	    "collnum %" PRId32,termId,(int32_t)collnum);
+
+	if ( ! m_loadMsg5->getList ( RDB_POSDB ,
+				     collnum ,
+				     m_loadList ,
+				     m_loadStartKey ,
+				     m_loadEndKey ,
+				     m_loadMaxSize ,
+				     false , // include tree? merged in on a hit
+				     false , // addtocache
+				     0 ,     // maxcacheage
+				     0 ,     // start file num
+				     -1 ,    // num files
+				     this ,
+				     gotLoadListWrapper ,
+				     MAX_NICENESS ,
+				     false , // error correction
+				     NULL ,  // cachekeyptr
+				     0 ,     // retrynum
+				     -1 ,    // maxretries
+				     true ,  // compensateformerge?
+				     -1 ,    // syncpoint
+				     false , // isrealmerge?
+				     true ) ) // allow disk page cache?
+		return;
+	gotLoadList();
+}
+
+void TermListCache::gotLoadListWrapper ( void *state , RdbList *list , Msg5 *msg5 ) {
+	TermListCache *that = static_cast<TermListCache*>(state);
+	that->gotLoadList();
+}
+
+void TermListCache::gotLoadList ( ) {
+	m_loading = false;
+	uint64_t key = makeCacheKey ( m_loadCollnum , m_loadTermId );
+
+	if ( g_errno ) {
+		log(LOG_WARN,"query: termlist cache: error reading termid "
+		    "%" PRId64": %s",m_loadTermId,mstrerror(g_errno));
+		g_errno = 0;
+	}
+	else if ( m_loadCancelled || ! g_collectiondb.getRec ( m_loadCollnum ) ) {
+		// collection was deleted or we were reset while reading
+	}
+	else if ( m_loadList->getListSize() >= m_loadMaxSize ) {
+		// only got part of it, do not try again for a while
+		m_tooBig[key] = true;
+		log(LOG_DEBUG,"query: termlist cache: termid %" PRId64" is too "
+		    "big to cache",m_loadTermId);
+	}
+	else if ( m_loadList->getListSize() > 0 ) {
+		addList ( m_loadCollnum , m_loadTermId , m_loadList );
+	}
+
+	m_loadList->freeList();
+	m_loadMsg5->reset();
+
+	m_loadCancelled = false;
+}
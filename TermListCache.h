@@ -0,0 +1,127 @@
+// . in-memory cache of complete posdb termlists for the most queried terms
+// . Msg2 asks us before reading a termlist from posdb. every lookup counts
+//   as an access of the term and once a term is accessed often enough its
+//   whole termlist is read in the background and kept in memory
+// . unlike HighFrequencyTermShortcuts, which serves a static, truncated
+//   list from a pre-generated file for stop words, the lists in here are
+//   complete and exact, so the results are the same as reading posdb
+// . the entries are pinned: they are only replaced by a term that is
+//   accessed more often, never by recency. the access counts are halved
+//   periodically so terms that went out of fashion make room again
+// . the entries hold the keys in the posdb files only. the keys in the
+//   posdb tree are merged in on every hit, so adds and deletes show up
+//   right away. the lists dumped from the tree are merged into the entries
+//   so they stay up to date with the files
+// . reads of only some of the files bypass the cache
+// . only used from the main thread
+
+#ifndef GB_TERMLISTCACHE_H
+#define GB_TERMLISTCACHE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <unordered_map>
+#include <vector>
+#include "types.h"
+
+class RdbList;
+class Msg5;
+
+class TermListCache {
+public:
+	TermListCache();
+	~TermListCache();
+
+	void reset ( );
+
+	// . if we have the termlist of termId, set "list" to its keys in
+	//   [startKey,endKey], with those in the tree if "includeTree", and
+	//   return true
+	// . otherwise note the access and maybe start loading the termlist
+	// . "numFiles" is as for Msg5, we only serve reads of all the files
+	bool getList ( collnum_t collnum , int64_t termId ,
+		       const char *startKey , const char *endKey ,
+		       int32_t minRecSizes , bool includeTree ,
+		       int32_t numFiles , RdbList *list );
+
+	// . store the complete termlist of termId, evicting colder terms
+	// . returns false if it is too big or no colder term can be evicted
+	bool addList ( collnum_t collnum , int64_t termId , RdbList *list );
+
+	// . merge a posdb list dumped from the tree into the cached termlists
+	// . must be called before the dumped keys are deleted from the tree
+	void addDumpedList ( collnum_t collnum , RdbList *list );
+
+	// drop all termlists of a deleted or reset collection
+	void removeCollection ( collnum_t collnum );
+
+	bool isCached ( collnum_t collnum , int64_t termId ) const;
+
+	int32_t getNumLists ( ) const { return (int32_t)m_entries.size(); }
+	int64_t getMemUsed  ( ) const { return m_memUsed; }
+	int64_t getNumHits  ( ) const { return m_numHits; }
+	int64_t getNumMisses( ) const { return m_numMisses; }
+
+private:
+	TermListCache(const TermListCache&);
+	TermListCache& operator=(const TermListCache&);
+
+	struct SkipPoint {
+		int64_t m_docId;
+		int32_t m_offset; // of the first key of m_docId
+	};
+
+	struct Entry {
+		char    *m_buf;
+		int32_t  m_size;
+		// high 6 bytes of the keys, ie. the termid part
+		char     m_hi[6];
+		// every s_skipDistance bytes or so, for reading docid ranges
+		// without scanning the whole list
+		std::vector<SkipPoint> m_skip;
+	};
+
+	static uint64_t makeCacheKey ( collnum_t collnum , int64_t termId ) {
+		return ((uint64_t)(uint16_t)collnum << 48) |
+			((uint64_t)termId & 0xffffffffffffULL);
+	}
+
+	uint32_t noteAccess ( uint64_t key );
+	uint32_t getAccessCount ( uint64_t key ) const;
+	void decayAccessCounts ( );
+
+	bool setEntry ( Entry *e , const char *data , int32_t size );
+	void freeEntry ( Entry *e );
+	void removeEntry ( std::unordered_map<uint64_t,Entry>::iterator it );
+	bool makeRoom ( int32_t size , uint32_t accessCount );
+
+	bool mergeIntoEntry ( uint64_t key , const char *run , int32_t runSize );
+
+	void startLoad ( collnum_t collnum , int64_t termId );
+	static void gotLoadListWrapper ( void *state , RdbList *list , Msg5 *msg5 );
+	void gotLoadList ( );
+
+	std::unordered_map<uint64_t,Entry>    m_entries;
+	std::unordered_map<uint64_t,uint32_t> m_accessCounts;
+	// terms we should not try to load again until their count decays
+	std::unordered_map<uint64_t,bool>     m_tooBig;
+	uint32_t m_accessesSinceDecay;
+	int64_t  m_memUsed;
+	int64_t  m_numHits;
+	int64_t  m_numMisses;
+
+	// the one termlist being loaded in the background
+	Msg5      *m_loadMsg5;
+	RdbList   *m_loadList;
+	bool       m_loading;
+	collnum_t  m_loadCollnum;
+	int64_t    m_loadTermId;
+	int32_t    m_loadMaxSize;
+	char       m_loadStartKey[18];
+	char       m_loadEndKey[18];
+	bool       m_loadCancelled;
+};
+
+extern TermListCache g_termListCache;
+
+#endif // GB_TERMLISTCACHE_H
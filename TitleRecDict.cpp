@@ -0,0 +1,488 @@
+#include "gb-include.h"
+
+#include "TitleRecDict.h"
+#include "RdbList.h"
+#include "Titledb.h"
+#include "Log.h"
+#include "Mem.h"
+#include "Errno.h"
+#include "zlib.h"
+#include <algorithm>
+#include <vector>
+
+// titlerec layout: key, dataSize, uncompressed size, compressed data
+static const int32_t s_hdrSize = sizeof(key_t) + 4 + 4;
+
+// the training sample and the held out sample together
+static const int32_t s_maxSampleSize = 4*1024*1024;
+
+// the dictionary only helps the first 32k of a record, so sample the
+// beginnings of more records instead of whole big ones
+static const int32_t s_maxSampleRecSize = 16*1024;
+
+// length of the strings counted by the trainer and of the segments
+// it picks for the dictionary
+static const int32_t s_dmerSize    = 8;
+static const int32_t s_segmentSize = 256;
+
+static const int32_t s_freqBits = 20;
+
+TitleRecDicts::TitleRecDicts() {
+	m_numDicts  = 0;
+	m_dir[0]    = '\0';
+	m_dbname[0] = '\0';
+}
+
+TitleRecDicts::~TitleRecDicts() {
+	reset();
+}
+
+void TitleRecDicts::reset() {
+	for ( int32_t i = 0 ; i < m_numDicts ; i++ ) {
+		mdelete ( m_dicts[i] , sizeof(TitleRecDict) , "TitleRecDict" );
+		delete m_dicts[i];
+	}
+	m_numDicts = 0;
+}
+
+void TitleRecDicts::getFilename ( int32_t n , char *buf , int32_t bufSize ) const {
+	snprintf ( buf , bufSize , "%s/%s-dict%" PRId32".dat" , m_dir , m_dbname , n );
+}
+
+bool TitleRecDicts::load ( const char *dir , const char *dbname ) {
+	reset();
+	strncpy ( m_dir , dir , sizeof(m_dir) - 1 );
+	m_dir[sizeof(m_dir)-1] = '\0';
+	strncpy ( m_dbname , dbname , sizeof(m_dbname) - 1 );
+	m_dbname[sizeof(m_dbname)-1] = '\0';
+
+	for ( int32_t n = 0 ; n < MAX_TITLEREC_DICTS ; n++ ) {
+		char filename[1024];
+		getFilename ( n , filename , sizeof(filename) );
+		SafeBuf sb;
+		// 0 means the file does not exist, we are done
+		int32_t size = sb.fillFromFile ( filename );
+		if ( size == 0 ) break;
+		if ( size < 0 || size > TITLEREC_DICT_SIZE ) {
+			log( LOG_WARN, "db: Bad titledb dictionary %s.", filename );
+			return false;
+		}
+		TitleRecDict *dict;
+		try { dict = new TitleRecDict; }
+		catch ( ... ) {
+			g_errno = ENOMEM;
+			log( LOG_WARN, "db: Could not allocate titledb dictionary." );
+			return false;
+		}
+		mnew ( dict , sizeof(TitleRecDict) , "TitleRecDict" );
+		dict->m_buf.stealBuf ( &sb );
+		dict->m_id = adler32 ( adler32(0,NULL,0) ,
+				       (const Bytef *)dict->m_buf.getBufStart() ,
+				       dict->m_buf.getLength() );
+		m_dicts[m_numDicts++] = dict;
+	}
+
+	if ( m_numDicts ) {
+		log( LOG_INFO, "db: Loaded %" PRId32" titledb dictionaries from %s.",
+		     m_numDicts, m_dir );
+	}
+	return true;
+}
+
+bool TitleRecDicts::add ( const char *buf , int32_t bufSize ) {
+	if ( m_numDicts >= MAX_TITLEREC_DICTS ) {
+		log( LOG_WARN, "db: Already have %" PRId32" titledb dictionaries in %s.",
+		     m_numDicts, m_dir );
+		return false;
+	}
+
+	TitleRecDict *dict;
+	try { dict = new TitleRecDict; }
+	catch ( ... ) {
+		g_errno = ENOMEM;
+		log( LOG_WARN, "db: Could not allocate titledb dictionary." );
+		return false;
+	}
+	mnew ( dict , sizeof(TitleRecDict) , "TitleRecDict" );
+	if ( ! dict->m_buf.safeMemcpy ( buf , bufSize ) ) {
+		mdelete ( dict , sizeof(TitleRecDict) , "TitleRecDict" );
+		delete dict;
+		return false;
+	}
+	dict->m_id = adler32 ( adler32(0,NULL,0) , (const Bytef *)buf , bufSize );
+
+	// . write it under a temp name first, a half written dictionary
+	//   would be loaded as a different one after a crash
+	char filename[1024];
+	getFilename ( m_numDicts , filename , sizeof(filename) );
+	char tmp[1100];
+	snprintf ( tmp , sizeof(tmp) , "%s.saving" , filename );
+	if ( dict->m_buf.save ( tmp ) != bufSize || rename ( tmp , filename ) != 0 ) {
+		log( LOG_WARN, "db: Could not save titledb dictionary %s: %s",
+		     filename, mstrerror(errno) );
+		unlink ( tmp );
+		mdelete ( dict , sizeof(TitleRecDict) , "TitleRecDict" );
+		delete dict;
+		return false;
+	}
+
+	m_dicts[m_numDicts++] = dict;
+	return true;
+}
+
+const TitleRecDict *TitleRecDicts::getDict ( uint32_t id ) const {
+	// newest first, that is the one most records use
+	for ( int32_t i = m_numDicts - 1 ; i >= 0 ; i-- ) {
+		if ( m_dicts[i]->m_id == id ) return m_dicts[i];
+	}
+	return NULL;
+}
+
+TitleRecDictTrainer::TitleRecDictTrainer() {
+	m_numSamples = 0;
+}
+
+bool TitleRecDictTrainer::isFull ( ) const {
+	return m_sample.getLength() + m_heldOut.getLength() >= s_maxSampleSize;
+}
+
+void TitleRecDictTrainer::addSample ( const char *ubuf , int32_t ubufSize ) {
+	if ( isFull() ) return;
+	int32_t size = ubufSize;
+	if ( size > s_maxSampleRecSize ) size = s_maxSampleRecSize;
+	// every tenth record is held out
+	SafeBuf *sb   = &m_sample;
+	SafeBuf *ends = &m_sampleEnds;
+	if ( m_numSamples % 10 == 9 ) {
+		sb   = &m_heldOut;
+		ends = &m_heldOutEnds;
+	}
+	if ( ! sb->safeMemcpy ( ubuf , size ) ) return;
+	int32_t end = sb->getLength();
+	if ( ! ends->safeMemcpy ( &end , 4 ) ) {
+		sb->setLength ( end - size );
+		return;
+	}
+	m_numSamples++;
+}
+
+static inline uint32_t hashDmer ( const char *p ) {
+	uint64_t v;
+	memcpy ( &v , p , 8 );
+	return (uint32_t)( ( v * 0x9e3779b97f4a7c15ULL ) >> ( 64 - s_freqBits ) );
+}
+
+namespace {
+struct Segment {
+	int32_t  m_offset;
+	uint64_t m_score;
+	bool operator< ( const Segment &s ) const { return m_score < s.m_score; }
+};
+}
+
+bool TitleRecDictTrainer::train ( TitleRecDict *dict ) {
+	const char *sample = m_sample.getBufStart();
+	int32_t sampleSize = m_sample.getLength();
+	if ( sampleSize < 2 * TITLEREC_DICT_SIZE ) {
+		g_errno = EBUFTOOSMALL;
+		return false;
+	}
+
+	// . number of samples each 8 byte string is in
+	// . collisions in the hash just add a little noise
+	int32_t numSlots = 1 << s_freqBits;
+	uint32_t *freqs = (uint32_t *)mcalloc ( numSlots * 4 , "trdfreq" );
+	uint32_t *seen  = (uint32_t *)mcalloc ( numSlots * 4 , "trdseen" );
+	if ( ! freqs || ! seen ) {
+		if ( freqs ) mfree ( freqs , numSlots * 4 , "trdfreq" );
+		if ( seen  ) mfree ( seen  , numSlots * 4 , "trdseen" );
+		return false;
+	}
+	const int32_t *ends = (const int32_t *)m_sampleEnds.getBufStart();
+	int32_t numSamples = m_sampleEnds.getLength() / 4;
+	int32_t start = 0;
+	for ( int32_t s = 0 ; s < numSamples ; s++ ) {
+		for ( int32_t p = start ; p + s_dmerSize <= ends[s] ; p++ ) {
+			uint32_t h = hashDmer ( sample + p );
+			if ( seen[h] == (uint32_t)s + 1 ) continue;
+			seen[h] = s + 1;
+			freqs[h]++;
+		}
+		start = ends[s];
+	}
+	mfree ( seen , numSlots * 4 , "trdseen" );
+
+	// . split the sample into one epoch per segment we want and take the
+	//   best segment of each, so the dictionary covers the whole sample
+	// . a segment's score is the sum of the counts of its strings, the
+	//   counts of the strings of a picked segment are zeroed so the other
+	//   segments do not pick the same strings again
+	int32_t numSegments = TITLEREC_DICT_SIZE / s_segmentSize;
+	int32_t epochSize   = sampleSize / numSegments;
+	int32_t numDmers    = s_segmentSize - s_dmerSize + 1;
+	std::vector<Segment> segments;
+	for ( int32_t e = 0 ; e < numSegments ; e++ ) {
+		int32_t a = e * epochSize;
+		int32_t b = a + epochSize - s_segmentSize;
+		uint64_t score = 0;
+		for ( int32_t i = 0 ; i < numDmers ; i++ )
+			score += freqs[hashDmer(sample + a + i)];
+		Segment best;
+		best.m_offset = a;
+		best.m_score  = score;
+		for ( int32_t w = a ; w < b ; w++ ) {
+			score -= freqs[hashDmer(sample + w)];
+			score += freqs[hashDmer(sample + w + numDmers)];
+			if ( score <= best.m_score ) continue;
+			best.m_offset = w + 1;
+			best.m_score  = score;
+		}
+		if ( best.m_score == 0 ) continue;
+		segments.push_back ( best );
+		for ( int32_t i = 0 ; i < numDmers ; i++ )
+			freqs[hashDmer(sample + best.m_offset + i)] = 0;
+	}
+	mfree ( freqs , numSlots * 4 , "trdfreq" );
+
+	// the best segments go last, closest to the data
+	std::stable_sort ( segments.begin() , segments.end() );
+	dict->m_buf.purge();
+	for ( size_t i = 0 ; i < segments.size() ; i++ ) {
+		if ( ! dict->m_buf.safeMemcpy ( sample + segments[i].m_offset ,
+						s_segmentSize ) )
+			return false;
+	}
+	dict->m_id = adler32 ( adler32(0,NULL,0) ,
+			       (const Bytef *)dict->m_buf.getBufStart() ,
+			       dict->m_buf.getLength() );
+	return true;
+}
+
+int64_t TitleRecDictTrainer::getHeldOutSize ( const TitleRecDict *dict ) const {
+	const char *p = m_heldOut.getBufStart();
+	const int32_t *ends = (const int32_t *)m_heldOutEnds.getBufStart();
+	int32_t numHeldOut = m_heldOutEnds.getLength() / 4;
+	SafeBuf cbuf;
+	if ( ! cbuf.reserve ( s_maxSampleRecSize * 2 , "trdcbuf" ) ) return -1;
+	int64_t total = 0;
+	int32_t start = 0;
+	for ( int32_t i = 0 ; i < numHeldOut ; i++ ) {
+		uint32_t size = cbuf.getCapacity();
+		int err = gbcompressTitleRec ( (unsigned char *)cbuf.getBufStart() , &size ,
+					       (const unsigned char *)p + start ,
+					       ends[i] - start , dict , Z_DEFAULT_COMPRESSION );
+		if ( err != Z_OK ) return -1;
+		total += size;
+		start = ends[i];
+	}
+	return total;
+}
+
+int gbcompressTitleRec ( unsigned char *dest , uint32_t *destLen ,
+			 const unsigned char *source , uint32_t sourceLen ,
+			 const TitleRecDict *dict , int level ) {
+	z_stream stream;
+	memset ( &stream , 0 , sizeof(stream) );
+	stream.next_in   = (Bytef *)source;
+	stream.avail_in  = (uInt)sourceLen;
+	stream.next_out  = dest;
+	stream.avail_out = (uInt)*destLen;
+
+	// zlib format, gzip has no room for a dictionary id
+	int err = deflateInit2 ( &stream , level , Z_DEFLATED , 15 , 8 ,
+				 Z_DEFAULT_STRATEGY );
+	if ( err != Z_OK ) return err;
+
+	if ( dict ) {
+		err = deflateSetDictionary ( &stream ,
+					     (const Bytef *)dict->m_buf.getBufStart() ,
+					     dict->m_buf.getLength() );
+		if ( err != Z_OK ) {
+			deflateEnd ( &stream );
+			return err;
+		}
+	}
+
+	err = deflate ( &stream , Z_FINISH );
+	if ( err != Z_STREAM_END ) {
+		deflateEnd ( &stream );
+		return err == Z_OK ? Z_BUF_ERROR : err;
+	}
+	*destLen = stream.total_out;
+	return deflateEnd ( &stream );
+}
+
+int gbuncompressTitleRec ( unsigned char *dest , uint32_t *destLen ,
+			   const unsigned char *source , uint32_t sourceLen ,
+			   const TitleRecDicts *dicts ) {
+	z_stream stream;
+	memset ( &stream , 0 , sizeof(stream) );
+	stream.next_in   = (Bytef *)source;
+	stream.avail_in  = (uInt)sourceLen;
+	stream.next_out  = dest;
+	stream.avail_out = (uInt)*destLen;
+
+	// gzip or zlib
+	int err = inflateInit2 ( &stream , 47 );
+	if ( err != Z_OK ) return err;
+
+	err = inflate ( &stream , Z_FINISH );
+	if ( err == Z_NEED_DICT ) {
+		// zlib put the id of the dictionary in stream.adler
+		const TitleRecDict *dict = dicts ? dicts->getDict ( stream.adler ) : NULL;
+		if ( ! dict ) {
+			log( LOG_WARN, "db: Missing titledb dictionary %08" PRIx32".",
+			     (uint32_t)stream.adler );
+			inflateEnd ( &stream );
+			return Z_DATA_ERROR;
+		}
+		err = inflateSetDictionary ( &stream ,
+					     (const Bytef *)dict->m_buf.getBufStart() ,
+					     dict->m_buf.getLength() );
+		if ( err == Z_OK ) err = inflate ( &stream , Z_FINISH );
+	}
+	if ( err != Z_STREAM_END ) {
+		inflateEnd ( &stream );
+		if ( err == Z_NEED_DICT ||
+		     ( err == Z_BUF_ERROR && stream.avail_in == 0 ) )
+			return Z_DATA_ERROR;
+		return err;
+	}
+	*destLen = stream.total_out;
+	return inflateEnd ( &stream );
+}
+
+uint32_t getTitleRecDictId ( const char *rec , int32_t recSize ) {
+	if ( recSize < s_hdrSize + 6 ) return 0;
+	if ( ( rec[0] & 0x01 ) == 0x00 ) return 0;
+	const unsigned char *p = (const unsigned char *)rec + s_hdrSize;
+	// a zlib header with the FDICT flag, gzip starts with 0x1f 0x8b
+	if ( ( p[0] & 0x0f ) != Z_DEFLATED ) return 0;
+	if ( ( p[0] * 256 + p[1] ) % 31 != 0 ) return 0;
+	if ( ! ( p[1] & 0x20 ) ) return 0;
+	return ( (uint32_t)p[2] << 24 ) | ( (uint32_t)p[3] << 16 ) |
+	       ( (uint32_t)p[4] <<  8 ) |   (uint32_t)p[5];
+}
+
+bool recompressTitleRec ( const char *rec , int32_t recSize ,
+			  const TitleRecDicts *dicts , const TitleRecDict *dict ,
+			  SafeBuf *out , TitleRecDictTrainer *sample ) {
+	if ( recSize < s_hdrSize ) {
+		g_errno = EBADTITLEREC;
+		return false;
+	}
+	int32_t dataSize  = *(const int32_t *)(rec + sizeof(key_t));
+	int32_t ubufSize  = *(const int32_t *)(rec + sizeof(key_t) + 4);
+	if ( dataSize < 4 || dataSize + (int32_t)sizeof(key_t) + 4 != recSize ||
+	     ubufSize <= 0 || ubufSize > 100*1024*1024 ) {
+		g_errno = EBADTITLEREC;
+		return false;
+	}
+
+	char *ubuf = (char *)mmalloc ( ubufSize , "trdubuf" );
+	if ( ! ubuf ) return false;
+	uint32_t realSize = ubufSize;
+	int err = gbuncompressTitleRec ( (unsigned char *)ubuf , &realSize ,
+					 (const unsigned char *)rec + s_hdrSize ,
+					 dataSize - 4 , dicts );
+	if ( err != Z_OK || realSize != (uint32_t)ubufSize ) {
+		mfree ( ubuf , ubufSize , "trdubuf" );
+		g_errno = EUNCOMPRESSERROR;
+		return false;
+	}
+
+	if ( sample ) sample->addSample ( ubuf , ubufSize );
+
+	if ( out ) {
+		// see XmlDoc::setTitleRecBuf()
+		int32_t need = ((int64_t)ubufSize * 1001LL) / 1000LL + 13 + 12;
+		if ( ! out->reserve ( s_hdrSize + need , "trdout" ) ) {
+			mfree ( ubuf , ubufSize , "trdubuf" );
+			return false;
+		}
+		char *p = out->getBuf();
+		uint32_t size = need;
+		err = gbcompressTitleRec ( (unsigned char *)p + s_hdrSize , &size ,
+					   (const unsigned char *)ubuf , ubufSize ,
+					   dict , Z_DEFAULT_COMPRESSION );
+		if ( err != Z_OK ) {
+			mfree ( ubuf , ubufSize , "trdubuf" );
+			g_errno = ECOMPRESSFAILED;
+			return false;
+		}
+		memcpy ( p , rec , sizeof(key_t) );
+		*(int32_t *)(p + sizeof(key_t))     = size + 4;
+		*(int32_t *)(p + sizeof(key_t) + 4) = ubufSize;
+		out->setLength ( out->getLength() + s_hdrSize + size );
+	}
+
+	mfree ( ubuf , ubufSize , "trdubuf" );
+	return true;
+}
+
+bool recompressTitledbList ( RdbList *list , const TitleRecDicts *dicts ,
+			     const TitleRecDict *dict ,
+			     TitleRecDictTrainer *trainer ) {
+	if ( list->isEmpty() ) return true;
+
+	// just sampling
+	if ( ! dict ) {
+		for ( list->resetListPtr() ; ! list->isExhausted() ; list->skipCurrentRecord() ) {
+			if ( ! trainer || trainer->isFull() ) break;
+			char *rec = list->getCurrentRec();
+			if ( KEYNEG(rec) ) continue;
+			// a corrupt record is just not sampled
+			if ( ! recompressTitleRec ( rec , list->getCurrentRecSize() ,
+						    dicts , NULL , NULL , trainer ) )
+				g_errno = 0;
+		}
+		list->resetListPtr();
+		return true;
+	}
+
+	SafeBuf out;
+	if ( ! out.reserve ( list->getListSize() , "trdlist" ) ) return false;
+	for ( list->resetListPtr() ; ! list->isExhausted() ; list->skipCurrentRecord() ) {
+		char   *rec     = list->getCurrentRec();
+		int32_t recSize = list->getCurrentRecSize();
+		TitleRecDictTrainer *sample = trainer && ! trainer->isFull() ? trainer : NULL;
+		if ( ! KEYNEG(rec) ) {
+			if ( getTitleRecDictId ( rec , recSize ) != dict->m_id ) {
+				if ( recompressTitleRec ( rec , recSize , dicts , dict ,
+							  &out , sample ) )
+					continue;
+				// keep a record we can not read as it is
+				log( LOG_WARN, "db: Could not recompress titlerec of docid "
+				     "%" PRId64": %s", g_titledb.getDocId((key_t *)rec),
+				     mstrerror(g_errno) );
+				g_errno = 0;
+			}
+			else if ( sample ) {
+				if ( ! recompressTitleRec ( rec , recSize , dicts , NULL ,
+							    NULL , sample ) )
+					g_errno = 0;
+			}
+		}
+		if ( ! out.safeMemcpy ( rec , recSize ) ) {
+			list->resetListPtr();
+			return false;
+		}
+	}
+
+	char startKey[MAX_KEY_BYTES];
+	char endKey[MAX_KEY_BYTES];
+	char lastKey[MAX_KEY_BYTES];
+	bool lastKeyValid = list->isLastKeyValid();
+	list->getStartKey ( startKey );
+	list->getEndKey ( endKey );
+	if ( lastKeyValid ) KEYSET ( lastKey , list->getLastKey() , list->m_ks );
+
+	int32_t outSize  = out.getLength();
+	int32_t outAlloc = out.getCapacity();
+	char   *outBuf   = out.getBufStart();
+	out.detachBuf();
+	list->set ( outBuf , outSize , outBuf , outAlloc , startKey , endKey ,
+		    list->getFixedDataSize() , true , list->useHalfKeys() , list->m_ks );
+	if ( lastKeyValid ) list->setLastKey ( lastKey );
+	return true;
+}
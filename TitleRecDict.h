@@ -0,0 +1,138 @@
+// . zlib preset dictionaries for compressing titlerecs
+// . titlerecs are compressed one document at a time, so the compressor
+//   starts every record knowing nothing about html. a preset dictionary of
+//   the byte strings common to the collection's documents lets it encode
+//   those as back references from the first byte on
+// . a dictionary is trained per collection from a sample of the titlerecs
+//   read by a titledb merge and saved next to the titledb files as
+//   titledb-dict<n>.dat. a new one is only kept if it compresses a held out
+//   part of the sample better than the current one
+// . the following titledb merges recompress the records with the current
+//   dictionary. dictionaries are never deleted since older records still
+//   refer to them
+// . the data of such a record is in zlib format with the FDICT flag and the
+//   adler32 of the dictionary in its header, the data of older records is
+//   in gzip format, gbuncompressTitleRec() reads both
+// . dictionaries are local to a host, so records are recompressed without
+//   one before they are sent to another host, see Msg22
+
+#ifndef GB_TITLERECDICT_H
+#define GB_TITLERECDICT_H
+
+#include <inttypes.h>
+#include "SafeBuf.h"
+
+class RdbList;
+
+// zlib only looks back 32k - 262 bytes, so a bigger dictionary is not used
+#define TITLEREC_DICT_SIZE 32000
+
+// we stop training new dictionaries for a collection after this many
+#define MAX_TITLEREC_DICTS 64
+
+class TitleRecDict {
+public:
+	// adler32 of the dictionary, zlib stores it in the data header
+	uint32_t m_id;
+	SafeBuf  m_buf;
+};
+
+// all the dictionaries of a collection's titledb, the last one is current
+class TitleRecDicts {
+public:
+	TitleRecDicts();
+	~TitleRecDicts();
+
+	void reset();
+
+	// load <dir>/<dbname>-dict0.dat, <dbname>-dict1.dat, ...
+	bool load ( const char *dir , const char *dbname );
+
+	// save "dict" as the next dictionary file and make it current
+	bool add ( const char *dict , int32_t dictSize );
+
+	const TitleRecDict *getDict ( uint32_t id ) const;
+
+	const TitleRecDict *getCurrentDict ( ) const {
+		return m_numDicts ? m_dicts[m_numDicts-1] : NULL; }
+
+	int32_t getNumDicts ( ) const { return m_numDicts; }
+
+private:
+	TitleRecDicts(const TitleRecDicts&);
+	TitleRecDicts& operator=(const TitleRecDicts&);
+
+	void getFilename ( int32_t n , char *buf , int32_t bufSize ) const;
+
+	TitleRecDict *m_dicts[MAX_TITLEREC_DICTS];
+	int32_t       m_numDicts;
+	char          m_dir[1024];
+	char          m_dbname[64];
+};
+
+// . trains a dictionary from the titlerecs of a merge
+// . the samples are the beginning of the uncompressed records, every tenth
+//   one is held out to evaluate the trained dictionary
+class TitleRecDictTrainer {
+public:
+	TitleRecDictTrainer();
+
+	bool isFull ( ) const;
+
+	// add the beginning of an uncompressed titlerec to the sample
+	void addSample ( const char *ubuf , int32_t ubufSize );
+
+	int32_t getNumSamples ( ) const { return m_numSamples; }
+
+	// . pick the segments of the sample whose 8 byte strings are in the
+	//   most records, the way zstd's COVER algorithm does it
+	// . fills "dict" with up to TITLEREC_DICT_SIZE bytes, the most useful
+	//   at the end where zlib reaches them with the shortest distances
+	// . returns false and sets g_errno on error
+	bool train ( TitleRecDict *dict );
+
+	// compressed size of the held out samples with "dict" (may be NULL)
+	int64_t getHeldOutSize ( const TitleRecDict *dict ) const;
+
+private:
+	SafeBuf m_sample;      // the training samples concatenated
+	SafeBuf m_sampleEnds;  // int32_t end offset of each training sample
+	SafeBuf m_heldOut;     // the held out samples concatenated
+	SafeBuf m_heldOutEnds; // int32_t end offset of each held out sample
+	int32_t m_numSamples;
+};
+
+// . like gbcompress(), but zlib format and with "dict" as the preset
+//   dictionary if not NULL
+int gbcompressTitleRec ( unsigned char *dest , uint32_t *destLen ,
+			 const unsigned char *source , uint32_t sourceLen ,
+			 const TitleRecDict *dict , int level );
+
+// . like gbuncompress(), but looks up the dictionary in "dicts" if the data
+//   was compressed with one
+// . returns Z_DATA_ERROR if we do not have the dictionary
+int gbuncompressTitleRec ( unsigned char *dest , uint32_t *destLen ,
+			   const unsigned char *source , uint32_t sourceLen ,
+			   const TitleRecDicts *dicts );
+
+// . the id of the dictionary a titlerec's data was compressed with
+// . returns 0 if it was compressed without one
+uint32_t getTitleRecDictId ( const char *rec , int32_t recSize );
+
+// . append "rec" to "out" recompressed with "dict", or without a
+//   dictionary if "dict" is NULL
+// . if "sample" is not NULL the uncompressed record is added to it
+// . returns false and sets g_errno on error
+bool recompressTitleRec ( const char *rec , int32_t recSize ,
+			  const TitleRecDicts *dicts , const TitleRecDict *dict ,
+			  SafeBuf *out , TitleRecDictTrainer *sample );
+
+// . recompress the titlerecs of a merged list with "dict" and sample them
+//   into "trainer", either may be NULL
+// . records already compressed with "dict" are kept as they are
+// . returns false and sets g_errno on error
+bool recompressTitledbList ( RdbList *list , const TitleRecDicts *dicts ,
+			     const TitleRecDict *dict ,
+			     TitleRecDictTrainer *trainer );
+
+#endif // GB_TITLERECDICT_H
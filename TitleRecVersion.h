@@ -12,6 +12,11 @@
 //#define TITLEREC_CURRENT_VERSION  122
 
 // normalize url encoded url (url encode, strip params)
-#define TITLEREC_CURRENT_VERSION    123
+//#define TITLEREC_CURRENT_VERSION    123
+
+// data is compressed in zlib instead of gzip format, so a titledb merge can
+// recompress it with a collection's dictionary. see TitleRecDict.h. the data
+// header tells the format, so records of older versions are still read.
+#define TITLEREC_CURRENT_VERSION    124
 
 #endif // GB_TITLERECVERSION_H
@@ -2,7 +2,6 @@
 
 #include "UdpServer.h"
 #include "Dns.h"      // g_dnsDistributed.extractHostname()
-#include "Profiler.h"
 #include "Stats.h"
 #include "Proxy.h"
 #include "Process.h"
@@ -1980,7 +1979,8 @@ bool UdpServer::makeCallback_ass ( UdpSlot *slot ) {
 
 	// i've seen a bunch of msg20 handlers called in a row take over 
 	// 10 seconds and the heartbeat gets starved and dumps core
-	if ( slot->getMsgType() == msg_type_20 )
+	if ( slot->getMsgType() == msg_type_20 ||
+	     slot->getMsgType() == msg_type_21 )
 		g_process.callHeartbeat();
 
 	// g_errno was set from m_errno before calling the handler, but to
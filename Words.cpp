@@ -7,6 +7,7 @@
 #include "HashTableX.h"
 #include "Sections.h"
 #include "XmlNode.h" // getTagLen()
+#include "HtmlScan.h"
 #include "Sanity.h"
 
 
@@ -56,57 +57,6 @@ bool Words::set( char *s, int32_t slen, bool computeWordIds, int32_t niceness )
 	return status;
 }
 
-// a quickie
-// this url gives a m_preCount that is too low. why?
-// http://go.tfol.com/163/speed.asp
-static int32_t countWords ( const char *p , int32_t plen ) {
-	const char *pend  = p + plen;
-	int32_t  count = 1;
-
-	while ( p < pend ) {
-
-		// sequence of punct
-		for  ( ; p < pend && ! is_alnum_utf8 (p) ; p += getUtf8CharSize(p) ) {
-			// in case being set from xml tags, count as words now
-			if ( *p == '<' ) {
-				count++;
-			}
-		}
-		count++;
-
-		// sequence of alnum
-		for  ( ; p < pend && is_alnum_utf8 (p) ; p += getUtf8CharSize(p) )
-			;
-
-		count++;
-
-	};
-	// some extra for good meaure
-	return count+10;
-}
-
-static int32_t countWords ( const char *p ) {
-	int32_t  count = 1;
-
-	while ( *p ) {
-		// sequence of punct
-		for  ( ; *p && ! is_alnum_utf8 (p) ; p += getUtf8CharSize(p) ) {
-			// in case being set from xml tags, count as words now
-			if ( *p=='<') count++; 
-		}
-		count++;
-
-		// sequence of alnum
-		for  ( ; *p && is_alnum_utf8 (p) ; p += getUtf8CharSize(p) )
-			;
-
-		count++;
-
-	}
-	// some extra for good meaure
-	return count+10;
-}
-
 bool Words::set( Xml *xml, bool computeWordIds, int32_t niceness, int32_t node1, int32_t node2 ) {
 	// prevent setting with the same string
 	if ( m_xml == xml ) gbshutdownLogicError();
@@ -134,11 +84,13 @@ bool Words::set( Xml *xml, bool computeWordIds, int32_t niceness, int32_t node1,
 	// sanity check
 	if ( node1 > node2 ) gbshutdownLogicError();
 
-	char *start = xml->getNode(node1);
-	char *end = xml->getNode( node2 - 1 ) + xml->getNodeLen( node2 - 1 );
-	int32_t  size  = end - start;
-
-	m_preCount = countWords( start , size );
+	// . Xml::set() bounded the words of each text node while scanning
+	//   for its end, so just add those up. tags are one word each.
+	// . some extra for good meaure
+	m_preCount = 10;
+	for ( int32_t k = node1; k < node2; ++k ) {
+		m_preCount += xml->isTag( k ) ? 1 : xml->getMaxNumWords( k );
+	}
 
 	// allocate based on the approximate count
 	if ( !allocateWordBuffers( m_preCount, true ) ) {
@@ -197,14 +149,17 @@ bool Words::set( Xml *xml, bool computeWordIds, int32_t niceness, int32_t node1,
 bool Words::set( char *s, bool computeWordIds, int32_t niceness ) {
 	reset();
 
-	// determine rough upper bound on number of words by counting
+	// determine upper bound on number of words by counting
 	// punct/alnum boundaries
-	m_preCount = countWords ( s );
+	int32_t slen = strlen ( s );
+	htmlScanText ( s , s + slen , false , &m_preCount );
+	// some extra for good meaure
+	m_preCount += 10;
 	if ( !allocateWordBuffers( m_preCount ) ) {
 		return false;
 	}
 
-	return addWords( s, 0x7fffffff, computeWordIds, niceness );
+	return addWords( s, slen, computeWordIds, niceness );
 }
 
 bool Words::addWords( char *s, int32_t nodeLen, bool computeWordIds, int32_t niceness ) {
@@ -212,6 +167,8 @@ bool Words::addWords( char *s, int32_t nodeLen, bool computeWordIds, int32_t nic
 	int32_t  j;
 	int32_t  wlen;
 	int32_t badCount = 0;
+	// the end of the node, the loops below also stop at a \0
+	const char *send = s + nodeLen;
 
 	bool hadApostrophe = false;
 
@@ -262,6 +219,10 @@ bool Words::addWords( char *s, int32_t nodeLen, bool computeWordIds, int32_t nic
 
 		// it is a punct word, find end of it
 		char *start = s+i;
+		// skip the ascii punct quickly, the loop below does the rest
+		if ( ! m_hasTags ) {
+			i += htmlAsciiPunctRun ( s + i , send );
+		}
 		for ( ; s[i] ; i += getUtf8CharSize(s+i)) {
 			// stop on < if we got tags
 			if ( s[i] == '<' && m_hasTags ) {
@@ -315,6 +276,8 @@ bool Words::addWords( char *s, int32_t nodeLen, bool computeWordIds, int32_t nic
 	// get an alnum word
 	j = i;
  again:
+	// skip the ascii alnums quickly, the loop below does the rest
+	i += htmlAsciiAlnumRun ( s + i , send );
 	for ( ; s[i] ; i += getUtf8CharSize(s+i) ) {
 		// breathe
 		QUICKPOLL(niceness);
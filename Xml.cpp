@@ -205,6 +205,7 @@ bool Xml::getCompoundName ( int32_t node , SafeBuf *sb ) {
 
 
 #include "HttpMime.h" // CT_JSON
+#include "HtmlScan.h"
 
 // "s" must be in utf8
 bool Xml::set( char *s, int32_t slen, int32_t version, int32_t niceness, char contentType ) {
@@ -253,6 +254,7 @@ bool Xml::set( char *s, int32_t slen, int32_t version, int32_t niceness, char co
 		xd->m_hasBackTag = false;
 		xd->m_hash       = 0;
 		xd->m_pairTagNum = -1;
+		htmlScanText ( s , s + slen , false , &xd->m_maxNumWords );
 		m_numNodes++;
 		return true;
 	}
@@ -275,18 +277,8 @@ bool Xml::set( char *s, int32_t slen, int32_t version, int32_t niceness, char co
 	/// Shouldn't all string be valid utf-8 at this point?
 	// . replacing NULL bytes with spaces in the buffer
 	// . utf8 should never have any 0 bytes in it either!
-	for ( i = 0 ; i < slen ; i++ ) {
-		if ( !s[i] ) {
-			s[i] = ' ';
-		}
-	}
-
-	// counting the max num nodes
-	for ( i = 0 ; s[i] ; i++ ) {
-		if ( s[i] == '<' ) {
-			m_maxNumNodes++;
-		}
-	}
+	// . counting the max num nodes in the same pass
+	m_maxNumNodes += htmlPrepareContent ( s , slen );
 
 	// account for the text (non-tag) nodes (padding nodes between tags)
 	m_maxNumNodes *= 2 ;
@@ -346,7 +338,7 @@ bool Xml::set( char *s, int32_t slen, int32_t version, int32_t niceness, char co
 		XmlNode *xi = &m_nodes[m_numNodes];
 
 		// set that node
-		i += xi->set( &m_xml[i], pureXml );
+		i += xi->set( &m_xml[i], &m_xml[m_xmlLen], pureXml );
 
 		// set his parent xml node if is xml
 		xi->m_parent = parent;
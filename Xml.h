@@ -86,6 +86,11 @@ public:
 		return m_nodes[n].m_nodeId;
 	}
 
+	// most words Words::addWords() makes of text node "n"
+	int32_t getMaxNumWords( int32_t n ) const {
+		return m_nodes[n].m_maxNumWords;
+	}
+
 	// get all nodes!
 	XmlNode *getNodes() {
 		return m_nodes;
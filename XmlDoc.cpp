@@ -2,6 +2,7 @@
 #include "hash.h"
 #include "XmlDoc.h"
 #include "Conf.h"
+#include "ConverterPool.h"
 #include "Query.h"     // getFieldCode()
 #include "Clusterdb.h" // g_clusterdb
 #include "iana_charset.h"
@@ -38,6 +39,7 @@
 #include "JobScheduler.h"
 #include "Process.h"
 #include "Statistics.h"
+#include "TitleRecDict.h"
 
 
 #ifdef _VALGRIND_
@@ -119,6 +121,8 @@ void XmlDoc::reset ( ) {
 
 	m_ipStartTime = 0;
 	m_ipEndTime   = 0;
+	m_robotsStartTime = 0;
+	m_xmlParseUs  = 0;
 
 	m_isImporting = false;
 
@@ -975,12 +979,20 @@ bool XmlDoc::set2 ( char    *titleRec ,
 	// debug msg
 
 	setStatus( "Uncompressing title rec." );
+	// the dictionaries of our collection, in case it was recompressed
+	// with one by a titledb merge
+	const TitleRecDicts *dicts = NULL;
+	CollectionRec *cr = g_collectiondb.getRec ( m_collnum );
+	RdbBase *tbase = cr ? cr->getBase ( RDB_TITLEDB ) : NULL;
+	if ( tbase ) dicts = tbase->getTitleRecDicts();
+
 	// . uncompress the data into m_ubuf
 	// . m_ubufSize should remain unchanged since we stored it
-	int err = gbuncompress ( (unsigned char *)  m_ubuf ,
-				 (uint32_t *) &realSize   ,
-				 (unsigned char *)  p ,
-				 (uint32_t  ) (dataSize - 4) );
+	int err = gbuncompressTitleRec ( (unsigned char *)  m_ubuf ,
+					 (uint32_t *) &realSize   ,
+					 (unsigned char *)  p ,
+					 (uint32_t  ) (dataSize - 4) ,
+					 dicts );
 	// hmmmm...
 	if ( err == Z_BUF_ERROR ) {
 		log("db: Buffer is too small to hold uncompressed "
@@ -2916,10 +2928,13 @@ bool XmlDoc::setTitleRecBuf ( SafeBuf *tbuf, int64_t docId, int64_t uh48 ){
 	// . uncompress the data into ubuf
 	// . this will reset cbufSize to a smaller value probably
 	// . "size" is set to how many bytes we wrote into "cbuf + hdrSize"
-	int err = gbcompress ( (unsigned char *)cbuf + hdrSize,
-			       (uint32_t *)&size,
-			       (unsigned char *)ubuf ,
-			       (uint32_t  )need1 );
+	// . zlib format, a titledb merge may recompress it with a dictionary
+	int err = gbcompressTitleRec ( (unsigned char *)cbuf + hdrSize,
+				       (uint32_t *)&size,
+				       (unsigned char *)ubuf ,
+				       (uint32_t  )need1 ,
+				       NULL ,
+				       Z_DEFAULT_COMPRESSION );
 
 	// free the buf we were trying to compress now
 	mfree ( ubuf , need1 , "trub" );
@@ -3260,6 +3275,7 @@ Xml *XmlDoc::getXml ( ) {
 	if ( ! ct || ct == (void *)-1 ) return (Xml *)ct;
 
 	int64_t start = logQueryTimingStart();
+	uint64_t parseStart = gettimeofdayInMicroseconds();
 
 	// set it
 	if ( !m_xml.set( *u8, u8len, m_version, m_niceness, *ct ) ) {
@@ -3267,6 +3283,7 @@ Xml *XmlDoc::getXml ( ) {
 		return NULL;
 	}
 
+	m_xmlParseUs = gettimeofdayInMicroseconds() - parseStart;
 	logQueryTimingEnd( __func__, start );
 
 	m_xmlValid = true;
@@ -3632,12 +3649,17 @@ Words *XmlDoc::getWords ( ) {
 	setStatus ( "getting words");
 
 	int64_t start = logQueryTimingStart();
+	uint64_t parseStart = gettimeofdayInMicroseconds();
 
 	// now set what we need
 	if ( !m_words.set( xml, true, m_niceness ) ) {
 		return NULL;
 	}
 
+	// the parse stage of a spidered doc is the xml and the words
+	if ( ! m_setFromTitleRec )
+		Statistics::register_stage_time ( Statistics::stage_spider_parse,
+			m_xmlParseUs + gettimeofdayInMicroseconds() - parseStart );
 	logQueryTimingEnd( __func__, start );
 
 	m_wordsValid = true;
@@ -7032,6 +7054,9 @@ int32_t *XmlDoc::getIp ( ) {
     	return (int32_t *)-1;
 	}
 
+	Statistics::register_stage_time ( Statistics::stage_spider_dns,
+		( gettimeofdayInMillisecondsGlobal() - m_ipStartTime ) * 1000 );
+
 	// wrap it up
 	int32_t *rval2 = gotIp ( true );
 	logTrace( g_conf.m_logTraceXmlDoc, "END, return [%s]", rval2 ? iptoa(*rval2) : "NULL");
@@ -7047,6 +7072,8 @@ void gotIpWrapper ( void *state , int32_t ip ) {
 	THIS->m_ipEndTime = gettimeofdayInMillisecondsGlobal();
 
 	logTrace( g_conf.m_logTraceXmlDoc, "Got IP [%s]. Took %" PRId64" msec", iptoa(ip), THIS->m_ipEndTime - THIS->m_ipStartTime);
+	Statistics::register_stage_time ( Statistics::stage_spider_dns,
+		( THIS->m_ipEndTime - THIS->m_ipStartTime ) * 1000 );
 
 	// wrap it up
 	THIS->gotIp ( true );
@@ -7256,6 +7283,8 @@ bool *XmlDoc::getIsAllowed ( ) {
 	// . for robots.txt it should only cache the portion of the doc
 	//   relevant to our user agent!
 	// . getHttpReply() should use msg13 to get cached reply!
+	if ( ! m_robotsStartTime )
+		m_robotsStartTime = gettimeofdayInMillisecondsGlobal();
 	XmlDoc **ped = getExtraDoc ( m_extraUrl.getUrl() , 3600 );
 	if ( ! ped || ped == (void *)-1 )
 	{
@@ -7301,6 +7330,8 @@ bool *XmlDoc::getIsAllowed ( ) {
 	// save this
 	m_robotsTxtLen = contentLen;
 	m_robotsTxtLenValid = true;
+	Statistics::register_stage_time ( Statistics::stage_spider_robots,
+		( gettimeofdayInMillisecondsGlobal() - m_robotsStartTime ) * 1000 );
 
 	// get content
 	char *content = *pcontent;
@@ -8288,6 +8319,8 @@ char **XmlDoc::gotHttpReply ( ) {
 	// update m_downloadEndTime if we should, used for sameIpWait
 	m_downloadEndTime      = gettimeofdayInMillisecondsGlobal();
 	m_downloadEndTimeValid = true;
+	Statistics::register_stage_time ( Statistics::stage_spider_download,
+		( m_downloadEndTime - m_downloadStartTime ) * 1000 );
 
 	// make it so
 	g_errno = saved;
@@ -9662,8 +9695,6 @@ static void filterStartWrapper_r ( void *state ) {
 
 // sets m_errno on error
 void XmlDoc::filterStart_r ( bool amThread ) {
-	// get thread id
-	pthread_t id = pthread_self();
 	// sanity check
 	if ( ! m_contentTypeValid ) { g_process.shutdownAbort(true); }
 	// shortcut
@@ -9672,123 +9703,77 @@ void XmlDoc::filterStart_r ( bool amThread ) {
 	// assume none
 	m_filteredContentLen = 0;
 
-	//if ( amThread ) id = pthread_self();
-	//else            id = getpid();
-	// pass the input to the program through this file
-	// rather than a pipe, since popen() seems broken
-	char in[1024];
-	snprintf(in,1023,"%sin.%" PRId64, g_hostdb.m_dir , (int64_t)id );
-	unlink ( in );
-	// collect the output from the filter from this file
-	char out[1024];
-	snprintf ( out , 1023,"%sout.%" PRId64, g_hostdb.m_dir, (int64_t)id );
-	unlink ( out );
-	// ignore errno from those unlinks
-	errno = 0;
-	// open the input file
- retry11:
-	int fd = open ( in , O_WRONLY | O_CREAT , getFileCreationFlags() );
-	if ( fd < 0 ) {
-		// valgrind
-		if ( errno == EINTR ) goto retry11;
-		m_errno = errno;
-		log("build: Could not open file %s for writing: %s.",
-		    in,mstrerror(m_errno));
-		return;
-	}
 	// we are in a thread, this must be valid!
 	if ( ! m_mimeValid ) { g_process.shutdownAbort(true);}
 
- retry12:
-	// write the content into the input file
-	int32_t w = write ( fd , m_content , m_contentLen );
-	// valgrind
-	if ( w < 0 && errno == EINTR ) goto retry12;
-	// did we get an error
-	if ( w != m_contentLen ) {
-		//int32_t w = fwrite ( m_buf , 1 , m_bufLen , pd );
-		//if ( w != m_bufLen ) {
-		m_errno = errno;
-		log("build: Error writing to %s: %s.",in,
-		    mstrerror(m_errno));
-		close(fd);
-		return;
-	}
-	// close the file
-	close ( fd );
-
 	// shortcut
 	char *wdir = g_hostdb.m_dir;
 
+	// . the converter worker writes the content to a file and passes
+	//   its name as $1, the converter's stdout is the filtered content
+	// . the worker enforces the time and memory limits that we used to
+	//   do with ulimit and timeout
+	ConverterRequest req;
+	memset ( &req, 0, sizeof(req) );
+	req.m_inputAsFile = 1;
+	req.m_maxMemKB    = 25000;
+	req.m_maxCpu      = 30;
+	req.m_nice        = 19;
+
 	char cmd[2048] = {};
 
 	if (ctype == CT_PDF) {
-		snprintf(cmd, 2047, "%sgbconvert.sh %s %s %s", wdir, g_contentTypeStrings[ctype], in, out);
+		// gbconvert.sh has its own limits
+		snprintf(cmd, 2047, "exec %sgbconvert.sh %s \"$1\" /dev/stdout", wdir, g_contentTypeStrings[ctype]);
+		req.m_maxMemKB = 0;
+		req.m_maxCpu   = 0;
+		req.m_nice     = 0;
+		req.m_timeout  = 40;
 	} else if ( ctype == CT_DOC ) {
 		// "wdir" include trailing '/'? not sure
-		snprintf(cmd, 2047, "ulimit -v 25000 ; ulimit -t 30 ; export ANTIWORDHOME=%s/antiword-dir ; timeout 30s nice -n 19 %s/antiword %s> %s" , wdir , wdir , in , out );
+		snprintf(cmd, 2047, "export ANTIWORDHOME=%s/antiword-dir ; exec %s/antiword \"$1\"" , wdir , wdir );
+		req.m_timeout = 30;
 	} else if ( ctype == CT_XLS ) {
-		snprintf(cmd, 2047, "ulimit -v 25000 ; ulimit -t 30 ; timeout 10s nice -n 19 %s/xlhtml %s > %s" , wdir , in , out );
+		snprintf(cmd, 2047, "exec %s/xlhtml \"$1\"" , wdir );
+		req.m_timeout = 10;
 	// this is too buggy for now... causes hanging threads because it
-	// hangs, so i added 'timeout 10s' but that only works on newer
-	// linux version, so it'll just error out otherwise.
+	// hangs, so the worker kills it after 10 seconds
 	} else if ( ctype == CT_PPT ) {
-		snprintf(cmd, 2047, "ulimit -v 25000 ; ulimit -t 30 ; timeout 10s nice -n 19 %s/ppthtml %s > %s" , wdir , in , out );
+		snprintf(cmd, 2047, "exec %s/ppthtml \"$1\"" , wdir );
+		req.m_timeout = 10;
 	} else if ( ctype == CT_PS  ) {
-		snprintf(cmd, 2047, "ulimit -v 25000 ; ulimit -t 30; timeout 10s nice -n 19 %s/pstotext %s > %s" , wdir , in , out );
+		snprintf(cmd, 2047, "exec %s/pstotext \"$1\"" , wdir );
+		req.m_timeout = 10;
 	} else {
 		g_process.shutdownAbort(true);
 	}
 
-	// breach sanity check
-	//if ( strlen(cmd) > 2040 ) { g_process.shutdownAbort(true); }
-
-	// execute it
-	int retVal = gbsystem ( cmd );
-	if ( retVal == -1 ) {
-		log( LOG_WARN, "gb: system(%s) : %s", cmd, mstrerror( g_errno ) );
-	}
-
-	// all done with input file
-	// clean up the binary input file from disk
-	if ( unlink ( in ) != 0 ) {
-		// log error
-		log( LOG_WARN, "gbfilter: unlink(%s): %s",in, strerror(errno));
+	// sanity -- need room to store a \0
+	if ( m_filteredContentAllocSize < 2 ) { g_process.shutdownAbort(true); }
+	// to read - leave room for \0
+	int32_t toRead = m_filteredContentAllocSize - 1;
 
-		// ignore it, since it was not a processing error per se
-		errno = 0;
-	}
+	req.m_cmdLen        = strlen ( cmd );
+	req.m_inputSize     = m_contentLen;
+	req.m_maxOutputSize = toRead;
 
-retry13:
-	fd = open ( out , O_RDONLY );
-	if ( fd < 0 ) {
-		// valgrind
-		if ( errno == EINTR ) goto retry13;
+	// execute it
+	ConverterReply reply;
+	if ( ! g_converterPool.convert ( &req, cmd, m_content,
+					 m_filteredContent, &reply ) ) {
 		m_errno = errno;
-		log( LOG_WARN, "gbfilter: Could not open file %s for reading: %s.", out,mstrerror(m_errno));
+		log( LOG_WARN, "gbfilter: Could not convert with %s: %s",
+		     cmd, mstrerror( m_errno ) );
 		return;
 	}
-	// sanity -- need room to store a \0
-	if ( m_filteredContentAllocSize < 2 ) { g_process.shutdownAbort(true); }
-	// to read - leave room for \0
-	int32_t toRead = m_filteredContentAllocSize - 1;
-retry14:
-	// read right from pipe descriptor
-	int32_t r = read (fd, m_filteredContent,toRead);
-	// note errors
-	if ( r < 0 ) {
-		// valgrind
-		if ( errno == EINTR ) goto retry14;
-		log( LOG_WARN, "gbfilter: reading output: %s",mstrerror(errno));
-		// this is often bad fd from an oom error, so ignore it
-		//m_errno = errno;
-		errno = 0;
-		r = 0;
-	}
-	// clean up shop
-	close ( fd );
-	// delete output file
-	unlink ( out );
+	// like before, keep whatever it output before it was killed
+	if ( reply.m_errno ) {
+		log( LOG_WARN, "gbfilter: %s: %s", cmd,
+		     mstrerror( reply.m_errno ) );
+	}
+
+	int32_t r = reply.m_outputSize;
+	if ( r > toRead ) r = toRead;
 
 	// validate now
 	m_filteredContentValid = 1;
@@ -9805,20 +9790,11 @@ retry14:
 
 	// . at this point we got the filtered content
 	// . bitch if we didn't allocate enough space
-	if ( r > 0 && r == toRead )
+	if ( reply.m_outputSize > toRead )
 		log(LOG_LOGIC,"build: Had to truncate document to %" PRId32" bytes "
 		    "because did not allocate enough space for filter. "
 		    "This should never happen. It is a hack that should be "
 		    "fixed right.", toRead );
-
-	// if we got something, then we're done
-	//if ( r > 0 ) return;
-	// otherwise, free it up
-	// . NO! not in a thread!!
-	//mfree ( m_filteredContent , m_filteredContentAllocSize, "fcas" );
-	//m_filteredContent          = NULL;
-	//m_filteredContentLen       = 0;
-	//m_filteredContentAllocSize = 0;
 }
 
 
@@ -486,6 +486,10 @@ public:
 	uint64_t m_ipStartTime;
 	uint64_t m_ipEndTime;
 
+	// for the robots.txt and parse stage times of Statistics
+	uint64_t m_robotsStartTime;
+	uint64_t m_xmlParseUs;
+
 	bool m_updatedMetaData;
 
 	void copyFromOldDoc ( class XmlDoc *od ) ;
@@ -8,6 +8,7 @@
 #include "Synonyms.h"
 #include "Process.h"
 #include "Posdb.h"
+#include "FlatHashTable.h"
 
 #ifdef _VALGRIND_
 #include <valgrind/memcheck.h>
@@ -897,9 +898,9 @@ bool XmlDoc::hashLinks ( HashTableX *tt ) {
 	// shortcuts
 	bool isRSSFeed = *getIsRSS();
 
-	char dbuf[8*4*1024];
-	HashTableX dedup;
-	dedup.set( 8,0,1024,dbuf,8*4*1024,false,m_niceness,"hldt");
+	char dbuf[(1+8)*1024];
+	FlatHashTable<8> dedup;
+	dedup.set( 8,0,1024,dbuf,sizeof(dbuf),false,m_niceness,"hldt");
 
 	CollectionRec *cr = getCollRec();
 	if ( ! cr ) {
@@ -1,6 +1,7 @@
 #include "gb-include.h"
 
 #include "XmlNode.h"
+#include "HtmlScan.h"
 #include "Mem.h"
 #include "Sanity.h"
 
@@ -212,8 +213,7 @@ NodeType g_nodes[] = {
 
 // . called by Xml class
 // . returns the length of the node
-// . TODO: "node" is now guaranteed to be \0 terminated -- make this faster
-int32_t XmlNode::set( char *node, bool pureXml ) {
+int32_t XmlNode::set( char *node, const char *end, bool pureXml ) {
 	// save head of node
 	m_node = node;
 
@@ -262,14 +262,9 @@ int32_t XmlNode::set( char *node, bool pureXml ) {
 		m_node       = node;
 		m_hasBackTag = false;
 		m_hash       = 0;
-		int32_t i = 0;
 
-		// inc i as int32_t as it's NOT the beginning of a tag
-		while ( node[i] && ( node[i] != '<' || !isTagStart( node + i ) ) ) {
-			++i;
-		}
-
-		m_nodeLen = i;
+		// find the next tag and bound the words in between
+		m_nodeLen = htmlScanText ( node , end , true , &m_maxNumWords );
 		m_pairTagNum = -1;
 
 		return m_nodeLen;
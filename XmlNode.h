@@ -246,8 +246,8 @@ public:
 	// . sets m_node,m_nodeLen,m_hash,m_isBreaking,m_nodeId
 	// . returns the length of the node
 	// . pureXml is true if node cannot be an html tag, except comment
-	//int32_t set ( char *node , bool pureXml );
-	int32_t set (char *node , bool pureXml );
+	// . "end" is the \0 at the end of the content
+	int32_t set ( char *node , const char *end , bool pureXml );
 
 	// . called by set() to get the length of a COMMENT node (and set it)
 	int32_t setCommentNode ( char *node );
@@ -263,6 +263,7 @@ public:
 
 	char *m_node;	  // tag data, or text data if not a tag
 	int32_t m_nodeLen; // m_nodeLen is in bytes
+	int32_t m_maxNumWords; // iff text node, for sizing the Words arrays
 	char *m_tagName;   // iff this node is a tag
 	int32_t m_tagNameLen;
 	int64_t m_hash;	// iff this node is a tag
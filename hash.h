@@ -135,6 +135,15 @@ inline uint64_t hash64Lower_a ( const char *s, int32_t len,
 	return h;
 }
 
+// . lower case 8 ascii chars at once, like to_lower_a() on each
+// . "x" must not have the high bit of any byte set
+inline uint64_t toLower8_a ( uint64_t x ) {
+	// high bit of each byte set if it is >= 'A', or > 'Z'
+	uint64_t geA = x + 0x3f3f3f3f3f3f3f3fULL;
+	uint64_t gtZ = x + 0x2525252525252525ULL;
+	return x | ( ( geA & ~gtZ & 0x8080808080808080ULL ) >> 2 );
+}
+
 // utf8
 inline uint64_t hash64Lower_utf8 ( const char *p, int32_t len, uint64_t startHash ) {
 	uint64_t h = startHash;
@@ -144,6 +153,20 @@ inline uint64_t hash64Lower_utf8 ( const char *p, int32_t len, uint64_t startHas
 	UChar32 x;
 	UChar32 y;
 	for ( ; p < pend ; p += cs ) {
+		// . 8 ascii chars at a time, most words are all ascii
+		// . hashes the same as the one char at a time below
+		if ( p + 8 <= pend ) {
+			uint64_t w;
+			memcpy ( &w , p , 8 );
+			if ( ! ( w & 0x8080808080808080ULL ) ) {
+				w = toLower8_a ( w );
+				// first char is the low byte
+				for ( int32_t k = 0 ; k < 8 ; k++ , w >>= 8 )
+					h ^= g_hashtab [i++][(uint8_t)w];
+				cs = 8;
+				continue;
+			}
+		}
 		// get the size
 		cs = getUtf8CharSize(p);
 		// deal with one ascii char quickly
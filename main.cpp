@@ -45,6 +45,7 @@
 #include "Title.h"
 #include "Speller.h"
 #include "SummaryCache.h"
+#include "ConverterPool.h"
 
 // include all msgs that have request handlers, cuz we register them with g_udp
 #include "Msg0.h"
@@ -61,7 +62,6 @@
 #include "Unicode.h"
 
 #include "Msg1f.h"
-#include "Profiler.h"
 #include "Blaster.h"
 #include "Proxy.h"
 
@@ -184,6 +184,11 @@ extern void tryToSyncWrapper ( int fd , void *state ) ;
 int main2 ( int argc , char *argv[] ) ;
 
 int main ( int argc , char *argv[] ) {
+	// a converter worker started by ConverterPool. it needs none of the
+	// initialization below.
+	if ( argc >= 2 && strcmp ( argv[1] , "convertworker" ) == 0 )
+		return ConverterPool::workerMain ( argc >= 3 ? argv[2] : NULL );
+
 	int ret = main2 ( argc , argv );
 
 	// returns 1 if failed, 0 on successful/graceful exit
@@ -355,6 +360,25 @@ int main2 ( int argc , char *argv[] ) {
 			"hosts.conf.\n\n"
 			*/
 
+			"blasterreplay [-c <n>] [-r <schedule>] [-w <secs>] "
+			"[-b <baseurl>] [-o <prefix>] <file>\n"
+			"\tReplay the queries in <file> against a running "
+			"instance with open-loop arrivals. Lines are urls, "
+			"paths relative to <baseurl> (default "
+			"http://127.0.0.1:8000) or json objects with a url, "
+			"path, q or query member. -c is the max number of "
+			"outstanding requests (default 32). <schedule> is a "
+			"comma separated list of <qps>:<secs> or "
+			"<qps1>-<qps2>:<secs> (ramp) steps (default 10:60). "
+			"Queries in the first -w seconds are not measured. "
+			"Writes <prefix>.results and <prefix>.hgrm "
+			"(default prefix is replay).\n\n"
+
+			"blastercompare <file1> <file2>\n"
+			"\tCompare latency percentiles, error rates and "
+			"result lists of two blasterreplay .results "
+			"files.\n\n"
+
 			"installgb [hostId]\n"
 			"\tLike above, but install just the gb executable.\n\n"
 
@@ -1010,6 +1034,49 @@ int main2 ( int argc , char *argv[] ) {
 		return 0;
 	}
 
+	if ( strcmp ( cmd , "blasterreplay" ) == 0 ) {
+		int32_t i=cmdarg+1;
+		int32_t maxOutstanding=32;
+		int32_t warmupSecs=0;
+		const char *schedule="10:60";
+		const char *baseUrl="http://127.0.0.1:8000";
+		const char *outPrefix="replay";
+		while ( i+1 < argc && argv[i][0]=='-' ) {
+			if ( strcmp (argv[i],"-c") == 0 )
+				maxOutstanding=atoi(argv[i+1]);
+			else if ( strcmp (argv[i],"-r") == 0 )
+				schedule=argv[i+1];
+			else if ( strcmp (argv[i],"-w") == 0 )
+				warmupSecs=atoi(argv[i+1]);
+			else if ( strcmp (argv[i],"-b") == 0 )
+				baseUrl=argv[i+1];
+			else if ( strcmp (argv[i],"-o") == 0 )
+				outPrefix=argv[i+1];
+			else {
+				log("blaster: unknown option %s",argv[i]);
+				return 1;
+			}
+			i+=2;
+		}
+		if ( i >= argc ) {
+			log("blaster: no query file given");
+			return 1;
+		}
+		g_conf.m_maxMem = 2000000000;
+		g_blaster.runReplay ( argv[i], baseUrl, maxOutstanding,
+				      schedule, warmupSecs, outPrefix );
+		return 1;
+	}
+
+	if ( strcmp ( cmd , "blastercompare" ) == 0 ) {
+		if ( cmdarg+2 >= argc ) {
+			log("blaster: usage: blastercompare <file1> <file2>");
+			return 1;
+		}
+		return Blaster::compareReplayRuns ( argv[cmdarg+1],
+						    argv[cmdarg+2] ) ? 0 : 1;
+	}
+
 	if ( strcmp ( cmd , "blasterdiff" ) == 0 ) {
 		int32_t i=cmdarg+1;
 		bool verbose=false;
@@ -1467,10 +1534,17 @@ int main2 ( int argc , char *argv[] ) {
 		return 1;
 	}
 
-	if ( ! g_jobScheduler.initialize(g_conf.m_maxCpuThreads, g_conf.m_maxIOThreads, g_conf.m_maxExternalThreads, wakeupPollLoop)) {
+	if ( ! g_jobScheduler.initialize(g_conf.m_maxCpuThreads, g_conf.m_maxIOThreads, g_conf.m_maxExternalThreads, wakeupPollLoop, g_conf.m_pinJobThreads)) {
 		log( LOG_ERROR, "db: JobScheduler init failed." );
 		return 1;
 	}
+	// keep threads free for the queries so they do not wait behind merges
+	g_jobScheduler.set_thread_type_limits(thread_type_query_read,      0, g_conf.m_queryThreadsReserved);
+	g_jobScheduler.set_thread_type_limits(thread_type_query_constrain, 0, g_conf.m_queryThreadsReserved);
+	g_jobScheduler.set_thread_type_limits(thread_type_query_merge,     0, g_conf.m_queryThreadsReserved);
+	g_jobScheduler.set_thread_type_limits(thread_type_query_intersect, 0, g_conf.m_queryThreadsReserved);
+	g_jobScheduler.set_thread_type_limits(thread_type_query_summary,   0, g_conf.m_queryThreadsReserved);
+	g_jobScheduler.set_thread_type_limits(thread_type_file_merge,      g_conf.m_maxMergeThreads, 0);
 	
 	//if ( ! g_hostdb.validateIps ( &g_conf ) ) {
 	//	log("db: Failed to validate ips." ); return 1;}
@@ -1806,6 +1880,12 @@ int main2 ( int argc , char *argv[] ) {
 		g_loop.init();
 	}
 
+	// . log through the log writer thread from now on
+	// . start it after forking, the child would not have it
+	if ( ! g_log.startWriterThread() ) {
+		log( LOG_WARN, "db: Log writer thread failed to start. Logging synchronously." );
+	}
+
 	// initialize threads down here now so it logs to the logfile and
 	// not stderr
 	//if ( ( ! cmd || !cmd[0]) && ! g_jobScheduler.initialize()     ) {
@@ -2010,6 +2090,12 @@ int main2 ( int argc , char *argv[] ) {
 	if ( ! g_collectiondb.addRdbBaseToAllRdbsForEachCollRec ( ) ) {
 		log("db: Collectiondb init failed." ); return 1; }
 
+	// replay the write-ahead logs on top of the saved trees, this needs
+	// the rdb bases of the collections
+	for ( int32_t i = 0 ; i < g_process.m_numRdbs ; i++ ) {
+		g_process.m_rdbs[i]->replayWal();
+	}
+
 	//Load the high-frequency term shortcuts (if they exist)
 	g_hfts.load();
 	
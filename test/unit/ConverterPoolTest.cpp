@@ -0,0 +1,133 @@
+#include "gtest/gtest.h"
+#include "ConverterPool.h"
+#include "Conf.h"
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+// . the pool spawns this test binary as its "convertworker", see
+//   GigablastTest.cpp, and the converters are little shell commands
+// . with one external thread there is one worker, #0
+class ConverterPoolTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		// a dead worker's pipe must not kill us
+		signal(SIGPIPE, SIG_IGN);
+		g_conf.m_maxExternalThreads = 1;
+		m_pool = new ConverterPool;
+		m_pool->m_extraTimeoutMS = 500;
+	}
+	void TearDown() {
+		m_pool->reset();
+		delete m_pool;
+	}
+
+	bool convert(const char *cmd, const char *input, int32_t maxOutputSize, int32_t timeout) {
+		ConverterRequest req;
+		memset(&req, 0, sizeof(req));
+		req.m_cmdLen        = strlen(cmd);
+		req.m_inputSize     = strlen(input);
+		req.m_maxOutputSize = maxOutputSize;
+		req.m_timeout       = timeout;
+		memset(m_out, 0, sizeof(m_out));
+		memset(&m_reply, 0, sizeof(m_reply));
+		return m_pool->convert(&req, cmd, input, m_out, &m_reply);
+	}
+
+	ConverterPool *m_pool;
+	ConverterReply m_reply;
+	char m_out[1000];
+};
+
+static int64_t getElapsedMS(const timespec &start) {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)(now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+}
+
+TEST_F(ConverterPoolTest, Success) {
+	EXPECT_EQ(-1, m_pool->getWorkerPid(0));
+	ASSERT_TRUE(convert("tr a-z A-Z", "hello world", 100, 10));
+	EXPECT_EQ(0, m_reply.m_errno);
+	EXPECT_TRUE(WIFEXITED(m_reply.m_status));
+	EXPECT_EQ(0, WEXITSTATUS(m_reply.m_status));
+	EXPECT_EQ(11, m_reply.m_outputSize);
+	EXPECT_STREQ("HELLO WORLD", m_out);
+	pid_t pid = m_pool->getWorkerPid(0);
+	EXPECT_GT(pid, 0);
+
+	// the worker is reused
+	ASSERT_TRUE(convert("exit 3", "", 100, 10));
+	EXPECT_TRUE(WIFEXITED(m_reply.m_status));
+	EXPECT_EQ(3, WEXITSTATUS(m_reply.m_status));
+	EXPECT_EQ(0, m_reply.m_outputSize);
+	EXPECT_EQ(pid, m_pool->getWorkerPid(0));
+}
+
+// the worker kills a converter that runs too long and stays usable
+TEST_F(ConverterPoolTest, ConverterTimeout) {
+	ASSERT_TRUE(convert("cat", "warm up", 100, 10));
+	pid_t pid = m_pool->getWorkerPid(0);
+
+	timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ASSERT_TRUE(convert("echo partial; sleep 10", "", 100, 1));
+	EXPECT_LT(getElapsedMS(start), 5000);
+	EXPECT_EQ(ETIMEDOUT, m_reply.m_errno);
+	EXPECT_TRUE(WIFSIGNALED(m_reply.m_status));
+	EXPECT_STREQ("partial\n", m_out);
+	EXPECT_EQ(pid, m_pool->getWorkerPid(0));
+
+	ASSERT_TRUE(convert("cat", "still works", 100, 10));
+	EXPECT_STREQ("still works", m_out);
+}
+
+// a worker that does not answer in time is killed and respawned
+TEST_F(ConverterPoolTest, HungWorkerKilledAndRespawned) {
+	ASSERT_TRUE(convert("cat", "warm up", 100, 10));
+	pid_t pid = m_pool->getWorkerPid(0);
+	ASSERT_GT(pid, 0);
+	kill(pid, SIGSTOP);
+
+	timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	EXPECT_FALSE(convert("cat", "hung", 100, 1));
+	EXPECT_EQ(ETIMEDOUT, errno);
+	EXPECT_LT(getElapsedMS(start), 5000);
+	EXPECT_EQ(-1, m_pool->getWorkerPid(0));
+
+	ASSERT_TRUE(convert("cat", "respawned", 100, 10));
+	EXPECT_STREQ("respawned", m_out);
+	EXPECT_GT(m_pool->getWorkerPid(0), 0);
+	EXPECT_NE(pid, m_pool->getWorkerPid(0));
+}
+
+// a worker that died is killed and respawned
+TEST_F(ConverterPoolTest, DeadWorkerRespawned) {
+	ASSERT_TRUE(convert("cat", "warm up", 100, 10));
+	pid_t pid = m_pool->getWorkerPid(0);
+	ASSERT_GT(pid, 0);
+	kill(pid, SIGKILL);
+
+	EXPECT_FALSE(convert("cat", "dead", 100, 10));
+	EXPECT_EQ(-1, m_pool->getWorkerPid(0));
+
+	ASSERT_TRUE(convert("cat", "respawned", 100, 10));
+	EXPECT_STREQ("respawned", m_out);
+	EXPECT_NE(pid, m_pool->getWorkerPid(0));
+}
+
+// we only get up to m_maxOutputSize bytes but learn the full size
+TEST_F(ConverterPoolTest, OversizedOutputTruncated) {
+	ASSERT_TRUE(convert("head -c 100000 /dev/zero | tr '\\0' x", "", 10, 10));
+	EXPECT_EQ(0, m_reply.m_errno);
+	EXPECT_EQ(100000, m_reply.m_outputSize);
+	EXPECT_STREQ("xxxxxxxxxx", m_out);
+	pid_t pid = m_pool->getWorkerPid(0);
+
+	// the rest of the output was not left in the pipe
+	ASSERT_TRUE(convert("echo next", "", 100, 10));
+	EXPECT_STREQ("next\n", m_out);
+	EXPECT_EQ(pid, m_pool->getWorkerPid(0));
+}
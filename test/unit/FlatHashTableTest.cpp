@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+
+#include "FlatHashTable.h"
+#include <map>
+#include <stdlib.h>
+
+TEST(FlatHashTableTest, AddFindRemove) {
+	FlatHashTable<8> ht;
+	ASSERT_TRUE(ht.set(8, 4, 16, NULL, 0, false, 0, "fhttest"));
+	EXPECT_TRUE(ht.isInitialized());
+	EXPECT_TRUE(ht.isTableEmpty());
+
+	for(int64_t i = 0; i < 1000; i++) {
+		int32_t val = (int32_t)i * 3;
+		ASSERT_TRUE(ht.addKey(&i, &val));
+	}
+	EXPECT_EQ(1000, ht.getNumUsedSlots());
+	// grew past 7/8 full
+	EXPECT_TRUE(ht.getNumSlots() * 7 >= 1000 * 8);
+
+	for(int64_t i = 0; i < 1000; i++) {
+		int32_t *val = (int32_t *)ht.getValue(&i);
+		ASSERT_TRUE(val != NULL);
+		EXPECT_EQ((int32_t)i * 3, *val);
+	}
+	int64_t missing = 1000;
+	EXPECT_FALSE(ht.isInTable(&missing));
+	EXPECT_TRUE(ht.getValue(&missing) == NULL);
+
+	// adding again replaces the value
+	int64_t k = 5;
+	int32_t val = 7;
+	ASSERT_TRUE(ht.addKey(&k, &val));
+	EXPECT_EQ(1000, ht.getNumUsedSlots());
+	EXPECT_EQ(7, *(int32_t *)ht.getValue(&k));
+
+	for(int64_t i = 0; i < 1000; i += 2)
+		ASSERT_TRUE(ht.removeKey(&i));
+	EXPECT_EQ(500, ht.getNumUsedSlots());
+	for(int64_t i = 0; i < 1000; i++)
+		EXPECT_EQ((i & 1) != 0, ht.isInTable(&i));
+
+	ht.clear();
+	EXPECT_TRUE(ht.isTableEmpty());
+	EXPECT_FALSE(ht.isInTable(&k));
+}
+
+TEST(FlatHashTableTest, OddKeySizeAndBuffer) {
+	// 5 byte keys like the posdb docid whitelist, in a caller buffer
+	char buf[(1+5)*64];
+	FlatHashTable<5> ht;
+	ASSERT_TRUE(ht.set(5, 0, 64, buf, sizeof(buf), false, 0, "fhttest"));
+	char key[5] = { 1, 2, 3, 4, 5 };
+	ASSERT_TRUE(ht.addKey(key));
+	EXPECT_TRUE(ht.isInTable(key));
+	key[4] = 6;
+	EXPECT_FALSE(ht.isInTable(key));
+
+	// growing out of the buffer keeps the keys
+	for(int32_t i = 0; i < 200; i++) {
+		memcpy(key, &i, 4);
+		key[4] = 9;
+		ASSERT_TRUE(ht.addKey(key));
+	}
+	EXPECT_EQ(201, ht.getNumSlotsUsed());
+	for(int32_t i = 0; i < 200; i++) {
+		memcpy(key, &i, 4);
+		key[4] = 9;
+		EXPECT_TRUE(ht.isInTable(key));
+	}
+}
+
+TEST(FlatHashTableTest, IterateSlots) {
+	FlatHashTable<4> ht;
+	ASSERT_TRUE(ht.set(4, 4, 0, NULL, 0, false, 0, "fhttest"));
+	int64_t sum = 0;
+	for(int32_t i = 1; i <= 100; i++) {
+		ASSERT_TRUE(ht.addKey(&i, &i));
+		sum += i;
+	}
+	int64_t keySum = 0, valSum = 0;
+	int32_t count = 0;
+	for(int32_t i = 0; i < ht.getNumSlots(); i++) {
+		if(ht.isEmpty(i)) continue;
+		keySum += *(const int32_t *)ht.getKeyFromSlot(i);
+		valSum += *(const int32_t *)ht.getValueFromSlot(i);
+		count++;
+	}
+	EXPECT_EQ(100, count);
+	EXPECT_EQ(sum, keySum);
+	EXPECT_EQ(sum, valSum);
+}
+
+TEST(FlatHashTableTest, RandomOps) {
+	// lots of adds and removes so there are deleted slots to probe past
+	FlatHashTable<8> ht;
+	ASSERT_TRUE(ht.set(8, 8, 32, NULL, 0, false, 0, "fhttest"));
+	std::map<int64_t, int64_t> ref;
+	srand(1234);
+	for(int32_t i = 0; i < 200000; i++) {
+		int64_t k = rand() % 3000;
+		int64_t v = rand();
+		switch(rand() % 3) {
+		case 0:
+			ASSERT_TRUE(ht.addKey(&k, &v));
+			ref[k] = v;
+			break;
+		case 1:
+			ht.removeKey(&k);
+			ref.erase(k);
+			break;
+		default: {
+			int64_t *found = (int64_t *)ht.getValue(&k);
+			std::map<int64_t, int64_t>::iterator it = ref.find(k);
+			ASSERT_EQ(it != ref.end(), found != NULL);
+			if(found) {
+				EXPECT_EQ(it->second, *found);
+			}
+		}
+		}
+	}
+	EXPECT_EQ((int32_t)ref.size(), ht.getNumSlotsUsed());
+	// deleted slots did not make it grow without bound
+	EXPECT_TRUE(ht.getNumSlots() <= 8192);
+}
@@ -4,8 +4,14 @@
 #include "Unicode.h"
 #include "hash.h"
 #include "Conf.h"
+#include "ConverterPool.h"
+#include <string.h>
 
 int main(int argc, char **argv) {
+	// we are the converter worker ConverterPoolTest spawned
+	if ( argc >= 2 && strcmp ( argv[1] , "convertworker" ) == 0 )
+		return ConverterPool::workerMain ( argc >= 3 ? argv[2] : NULL );
+
 	// initialize Gigablast
 	g_conf.m_maxMem = 1000000000LL;
 
@@ -0,0 +1,102 @@
+#include "gtest/gtest.h"
+#include "HedgeLatency.h"
+#include "Multicast.h"
+#include "Hostdb.h"
+#include "Conf.h"
+
+TEST(HedgeLatencyTest, NoDelayUntilEnoughSamples) {
+	g_conf.m_hedgePercentile = 95;
+	HedgeLatency hl;
+	for(uint32_t i=1; i<HedgeLatency::s_minSamples; i++)
+		hl.record(50);
+	EXPECT_EQ(-1, hl.getDelay());
+	for(int i=0; i<64; i++)
+		hl.record(50);
+	// the bucket 50 falls in is at most 8% wide
+	EXPECT_GE(hl.getDelay(), 50);
+	EXPECT_LE(hl.getDelay(), 54);
+}
+
+TEST(HedgeLatencyTest, Percentile) {
+	g_conf.m_hedgePercentile = 90;
+	HedgeLatency hl;
+	// one slow request in 20 does not move the 90th percentile
+	for(uint32_t i=0; i<HedgeLatency::s_windowSize; i++)
+		hl.record(i % 20 == 0 ? 1000 : 20);
+	EXPECT_GE(hl.getDelay(), 20);
+	EXPECT_LE(hl.getDelay(), 22);
+	// the next window replaces it
+	for(uint32_t i=0; i<HedgeLatency::s_windowSize; i++)
+		hl.record(i % 5 == 0 ? 20 : 100);
+	EXPECT_GE(hl.getDelay(), 100);
+	EXPECT_LE(hl.getDelay(), 108);
+}
+
+TEST(HedgeLatencyTest, Clamped) {
+	g_conf.m_hedgePercentile = 50;
+	HedgeLatency fast;
+	HedgeLatency slow;
+	for(uint32_t i=0; i<HedgeLatency::s_windowSize; i++) {
+		fast.record(0);
+		slow.record(60000);
+	}
+	EXPECT_EQ(HedgeLatency::s_minDelay, fast.getDelay());
+	EXPECT_EQ(HedgeLatency::s_maxDelay, slow.getDelay());
+}
+
+TEST(HedgeLatencyTest, PerHostAndMsgType) {
+	EXPECT_TRUE(getHedgeLatency(0, msg_type_1) == NULL);
+	EXPECT_TRUE(getHedgeLatency(-1, msg_type_39) == NULL);
+	EXPECT_TRUE(getHedgeLatency(1, msg_type_39) != getHedgeLatency(2, msg_type_39));
+	EXPECT_TRUE(getHedgeLatency(1, msg_type_39) != getHedgeLatency(1, msg_type_20));
+	EXPECT_TRUE(getHedgeLatency(1, msg_type_39) == getHedgeLatency(1, msg_type_39));
+}
+
+// the hedge for a request fires after the usual response time of the host
+// the request went to, not the one of the other hosts
+TEST(HedgeLatencyTest, HedgeFiresAfterTheHostsDelay) {
+	g_conf.m_useHedgedRequests = true;
+	g_conf.m_hedgePercentile = 95;
+	Host fastHost;
+	Host slowHost;
+	Host newHost;
+	fastHost.m_hostId = 100;
+	slowHost.m_hostId = 101;
+	newHost.m_hostId  = 102;
+	for(uint32_t i=0; i<HedgeLatency::s_windowSize; i++) {
+		getHedgeLatency(fastHost.m_hostId, msg_type_39)->record(10);
+		getHedgeLatency(slowHost.m_hostId, msg_type_39)->record(300);
+	}
+
+	Multicast *m = new Multicast;
+	m->m_msgType         = msg_type_39;
+	m->m_niceness        = 0;
+	m->m_numHosts        = 2;
+	m->m_replyBuf        = NULL;
+	m->m_redirectTimeout = -1;
+
+	m->m_lastLaunchHost = &fastHost;
+	EXPECT_GE(m->getHedgeDelay(), 10);
+	EXPECT_LE(m->getHedgeDelay(), 11);
+
+	m->m_lastLaunchHost = &slowHost;
+	EXPECT_GE(m->getHedgeDelay(), 300);
+	EXPECT_LE(m->getHedgeDelay(), 324);
+
+	// nothing known about this host yet
+	m->m_lastLaunchHost = &newHost;
+	EXPECT_EQ(-1, m->getHedgeDelay());
+
+	// never for spider traffic or without a twin
+	m->m_lastLaunchHost = &fastHost;
+	m->m_niceness = 1;
+	EXPECT_EQ(-1, m->getHedgeDelay());
+	m->m_niceness = 0;
+	m->m_numHosts = 1;
+	EXPECT_EQ(-1, m->getHedgeDelay());
+	m->m_numHosts = 2;
+	g_conf.m_useHedgedRequests = false;
+	EXPECT_EQ(-1, m->getHedgeDelay());
+
+	delete m;
+}
@@ -0,0 +1,56 @@
+#include "gtest/gtest.h"
+#include "Hostdb.h"
+#include <string.h>
+
+class HostdbLoadTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		memset(&m_host, 0, sizeof(m_host));
+	}
+	Hostdb m_hostdb;
+	Host m_host;
+};
+
+TEST_F(HostdbLoadTest, NoReplies) {
+	EXPECT_EQ(0, m_hostdb.getLoadScore(&m_host, msg_type_39, 1000));
+	m_hostdb.noteRequestSent(&m_host, msg_type_39);
+	EXPECT_EQ(0, m_hostdb.getLoadScore(&m_host, msg_type_39, 1000));
+	// a cancelled request says nothing about the host
+	m_hostdb.noteReplyReceived(&m_host, msg_type_39, -1, 1000);
+	EXPECT_EQ(0, m_host.m_outstanding[msg_type_39]);
+	EXPECT_EQ(0, m_hostdb.getLoadScore(&m_host, msg_type_39, 1000));
+}
+
+TEST_F(HostdbLoadTest, MovingAverage) {
+	m_hostdb.noteRequestSent(&m_host, msg_type_39);
+	m_hostdb.noteReplyReceived(&m_host, msg_type_39, 100, 1000);
+	EXPECT_DOUBLE_EQ(100, m_hostdb.getLoadScore(&m_host, msg_type_39, 1000));
+	for (int i = 0; i < 50; i++) {
+		m_hostdb.noteRequestSent(&m_host, msg_type_39);
+		m_hostdb.noteReplyReceived(&m_host, msg_type_39, 10, 1000);
+	}
+	EXPECT_NEAR(10, m_hostdb.getLoadScore(&m_host, msg_type_39, 1000), 0.1);
+	// other msg types are separate
+	EXPECT_EQ(0, m_hostdb.getLoadScore(&m_host, msg_type_20, 1000));
+}
+
+TEST_F(HostdbLoadTest, Outstanding) {
+	m_hostdb.noteRequestSent(&m_host, msg_type_20);
+	m_hostdb.noteReplyReceived(&m_host, msg_type_20, 20, 1000);
+	m_hostdb.noteRequestSent(&m_host, msg_type_20);
+	m_hostdb.noteRequestSent(&m_host, msg_type_20);
+	EXPECT_EQ(2, m_host.m_outstanding[msg_type_20]);
+	EXPECT_DOUBLE_EQ(60, m_hostdb.getLoadScore(&m_host, msg_type_20, 1000));
+	// never goes negative, ie. if the host was replaced meanwhile
+	for (int i = 0; i < 3; i++)
+		m_hostdb.noteReplyReceived(&m_host, msg_type_20, -1, 1000);
+	EXPECT_EQ(0, m_host.m_outstanding[msg_type_20]);
+}
+
+TEST_F(HostdbLoadTest, Aging) {
+	m_hostdb.noteRequestSent(&m_host, msg_type_0);
+	m_hostdb.noteReplyReceived(&m_host, msg_type_0, 400, 1000);
+	EXPECT_DOUBLE_EQ(400, m_hostdb.getLoadScore(&m_host, msg_type_0, 6000));
+	// a slow host gets another chance after a while
+	EXPECT_DOUBLE_EQ(200, m_hostdb.getLoadScore(&m_host, msg_type_0, 11000));
+}
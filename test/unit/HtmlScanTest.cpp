@@ -0,0 +1,97 @@
+#include "gtest/gtest.h"
+
+#include "HtmlScan.h"
+#include "Xml.h"
+#include "Words.h"
+#include "HttpMime.h" // CT_HTML
+#include <string>
+
+TEST(HtmlScanTest, PrepareContent) {
+	std::string s("<a>b<c> d\0e<<f", 14);
+	s += std::string(40, 'x') + std::string("<\0<", 3);
+	EXPECT_EQ(6, htmlPrepareContent(&s[0], s.size()));
+	EXPECT_EQ(std::string::npos, s.find('\0'));
+	EXPECT_EQ(' ', s[9]);
+	EXPECT_EQ(' ', s[s.size()-2]);
+}
+
+TEST(HtmlScanTest, StopAtTag) {
+	// the first '<' is not a tag, the second one is past the first 16 bytes
+	const char *s = "a < b is true, or so they say<b>bold</b>";
+	int32_t maxNumWords;
+	EXPECT_EQ(29, htmlScanText(s, s + strlen(s), true, &maxNumWords));
+	// not stopping at tags
+	EXPECT_EQ((int32_t)strlen(s), htmlScanText(s, s + strlen(s), false, &maxNumWords));
+	// a tag right at the start of a block
+	const char *s2 = "0123456789abcdef<p>";
+	EXPECT_EQ(16, htmlScanText(s2, s2 + strlen(s2), true, &maxNumWords));
+	EXPECT_EQ(1, maxNumWords);
+}
+
+TEST(HtmlScanTest, MaxNumWords) {
+	const char *texts[] = {
+		"hello world",
+		"  leading and trailing spaces  ",
+		"c++ and c# and a+ are languages, c++! c#. a+?",
+		"1,000,000 and 3.14159 and 1,234abc and 3.5x",
+		"we're dave's friends, aren't we'",
+		"caf\xc3\xa9 na\xc3\xafve r\xc3\xa9sum\xc3\xa9 \xe2\x80\x94 \xe2\x80\x9cquoted\xe2\x80\x9d",
+		"\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe6\x96\x87\xe7\xab\xa0" "abc\xe0\xb8\xa0\xe0\xb8\xb2\xe0\xb8\xa9\xe0\xb8\xb2",
+		// broken utf8
+		"abc\xe3" "def ghi\xc3\x80\x80jkl \xff\xfe mno\x80pq",
+		"a.b.c.d.e.f.g.h.i.j.k.l.m.n.o.p.q.r.s.t.u.v.w.x.y.z.0.1.2.3.4.5.6.7.8.9",
+	};
+	for(size_t i=0; i<sizeof(texts)/sizeof(texts[0]); i++) {
+		std::string s(texts[i]);
+		int32_t maxNumWords;
+		htmlScanText(s.c_str(), s.c_str() + s.size(), false, &maxNumWords);
+		Words words;
+		ASSERT_TRUE(words.set(&s[0], true, 0));
+		EXPECT_TRUE(words.getNumWords() <= maxNumWords);
+		// and nothing was cut off
+		int32_t n = words.getNumWords();
+		ASSERT_TRUE(n > 0);
+		EXPECT_EQ(&s[0] + s.size(), words.getWord(n-1) + words.getWordLen(n-1));
+	}
+}
+
+TEST(HtmlScanTest, WordsFromXml) {
+	char html[] = "<html><body><p>Hello <b>big</b> world, c++ rocks</p>"
+		      "<p>a < b</p><script>var x = '<p>';</script>caf\xc3\xa9</body></html>";
+	Xml xml;
+	ASSERT_TRUE(xml.set(html, strlen(html), 0, 0, CT_HTML));
+	Words words;
+	ASSERT_TRUE(words.set(&xml, true, 0));
+	int32_t numTags = 0;
+	std::string text;
+	for(int32_t i=0; i<words.getNumWords(); i++) {
+		if(words.getTagId(i)) {
+			numTags++;
+			continue;
+		}
+		text.append(words.getWord(i), words.getWordLen(i));
+	}
+	EXPECT_EQ(xml.getNumNodes(), numTags + 5);
+	EXPECT_EQ(std::string("Hello big world, c++ rocksa < bcaf\xc3\xa9"), text);
+	EXPECT_TRUE(words.getNumWords() <= words.getPreCount());
+}
+
+TEST(HtmlScanTest, AsciiRuns) {
+	const char *s = "abcdefghijklmnopqrstuvwxyz0123456789ABC def";
+	const char *end = s + strlen(s);
+	EXPECT_EQ(39, htmlAsciiAlnumRun(s, end));
+	EXPECT_EQ(0, htmlAsciiAlnumRun(s + 39, end));
+	EXPECT_EQ(1, htmlAsciiPunctRun(s + 39, end));
+	// not past the end
+	EXPECT_EQ(20, htmlAsciiAlnumRun(s, s + 20));
+
+	const char *s2 = " , . ; : ! ? - / ( ) [ ] { } caf\xc3\xa9";
+	EXPECT_EQ(29, htmlAsciiPunctRun(s2, s2 + strlen(s2)));
+	EXPECT_EQ(3, htmlAsciiAlnumRun(s2 + 29, s2 + strlen(s2)));
+
+	// stops at non-ascii and \0
+	std::string s3 = std::string(20, ' ') + "\xe2\x80\x94" + std::string(20, ' ');
+	EXPECT_EQ(20, htmlAsciiPunctRun(s3.c_str(), s3.c_str() + s3.size()));
+	std::string s4 = std::string(18, '-') + std::string(1, '\0') + std::string(20, ' ');
+	EXPECT_EQ(18, htmlAsciiPunctRun(s4.c_str(), s4.c_str() + s4.size()));
+}
@@ -0,0 +1,133 @@
+#include "JobScheduler.h"
+#include "Conf.h"
+#include "Mem.h"
+#include "BigFile.h"
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+
+static void msleep(int msecs) {
+	struct timespec ts;
+	ts.tv_sec = msecs/1000;
+	ts.tv_nsec = (msecs%1000)*1000000;
+	nanosleep(&ts,NULL);
+}
+
+static std::atomic<int> merges_running(0);
+static std::atomic<int> max_merges_running(0);
+static std::atomic<int> merges_started(0);
+static void start_routine_merge(void *) {
+	merges_started++;
+	int n = ++merges_running;
+	int m = max_merges_running;
+	while(n>m && !max_merges_running.compare_exchange_weak(m,n))
+		;
+	msleep(100);
+	merges_running--;
+}
+
+static std::atomic<bool> query_started(false);
+static void start_routine_query(void *) {
+	query_started = true;
+}
+
+static std::atomic<int> jobs_done(0);
+static void start_routine_short(void *) {
+	msleep(1);
+	jobs_done++;
+}
+
+static JobScheduler *recursive_js;
+static void start_routine_recursive(void *) {
+	//jobs submitted from a pool thread go into its own queue and
+	//are stolen by the others
+	for(int i=0; i<20; i++)
+		recursive_js->submit(start_routine_short, NULL, NULL, thread_type_query_intersect, 0, 0);
+}
+
+static void finish_routine(void *, job_exit_t) {
+}
+
+int main(void) {
+	g_conf.m_maxMem = 1000000000LL;
+	g_mem.m_memtablesize = 8194*1024;
+	g_mem.init();
+
+	//verify that a type is capped
+	{
+		JobScheduler js;
+		js.initialize(4,0,0);
+		js.set_thread_type_limits(thread_type_file_merge,2,0);
+
+		for(int i=0; i<6; i++)
+			js.submit(start_routine_merge, finish_routine, NULL, thread_type_file_merge, 0, 0);
+
+		msleep(50);
+		assert(merges_running==2);
+		msleep(400);
+		assert(merges_started==6);
+		assert(max_merges_running==2);
+
+		js.cleanup_finished_jobs();
+		js.finalize();
+	}
+
+	//verify that the reserved threads are kept for the query jobs
+	{
+		merges_started = 0;
+		JobScheduler js;
+		js.initialize(2,0,0);
+		js.set_thread_type_limits(thread_type_query_intersect,0,1);
+
+		//no query job has been seen yet so both threads may merge
+		js.submit(start_routine_merge, finish_routine, NULL, thread_type_file_merge, 0, 0);
+		js.submit(start_routine_merge, finish_routine, NULL, thread_type_file_merge, 0, 0);
+		msleep(50);
+		assert(merges_started==2);
+		msleep(100);
+
+		js.submit(start_routine_query, finish_routine, NULL, thread_type_query_intersect, 0, 0);
+		msleep(50);
+		assert(query_started);
+
+		//now one thread is kept for the queries
+		merges_started = 0;
+		js.submit(start_routine_merge, finish_routine, NULL, thread_type_file_merge, 0, 0);
+		js.submit(start_routine_merge, finish_routine, NULL, thread_type_file_merge, 0, 0);
+		msleep(50);
+		assert(merges_started==1);
+		assert(js.num_queued_jobs()==1);
+		query_started = false;
+		js.submit(start_routine_query, finish_routine, NULL, thread_type_query_intersect, 0, 0);
+		msleep(20);
+		assert(query_started);
+		msleep(200);
+		assert(merges_started==2);
+
+		js.cleanup_finished_jobs();
+		js.finalize();
+	}
+
+	//verify that idle threads steal the jobs of a busy one, pinned or not
+	for(int pin=0; pin<2; pin++) {
+		jobs_done = 0;
+		JobScheduler js;
+		js.initialize(4,2,1,0,pin!=0);
+		recursive_js = &js;
+
+		for(int i=0; i<5; i++)
+			js.submit(start_routine_recursive, finish_routine, NULL, thread_type_query_intersect, 0, 0);
+		for(int i=0; i<1000 && jobs_done<100; i++)
+			msleep(10);
+		assert(jobs_done==100);
+		assert(js.num_queued_jobs()==0);
+
+		js.cleanup_finished_jobs();
+		js.finalize();
+	}
+
+	printf("success\n");
+	return 0;
+}
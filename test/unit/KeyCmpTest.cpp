@@ -0,0 +1,113 @@
+#include "gtest/gtest.h"
+#include "Conf.h"
+#include "RdbList.h"
+#include "Rdb.h"
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+
+// random key that often shares its high bytes with other keys, so the
+// compares have to look at the low bytes too
+static void makeRandomKey(char *key, char ks) {
+	for(int32_t i=0; i<ks; i++)
+		key[i] = (rand() % 4 == 0) ? (char)rand() : 0;
+}
+
+template <char KS>
+static void testKeyCmp() {
+	for(int32_t i=0; i<100000; i++) {
+		char k1[KS], k2[KS];
+		makeRandomKey(k1, KS);
+		if(rand() % 2) {
+			memcpy(k2, k1, KS);
+			int32_t j = rand() % KS;
+			k2[j] = (char)rand();
+		} else {
+			makeRandomKey(k2, KS);
+		}
+		EXPECT_EQ(KEYCMP(k1, k2, KS), KEYCMP<KS>(k1, k2));
+		EXPECT_EQ(KEYCMP(k1, k2, KS), KEYCMP<KS>(k1, k2, KS));
+		EXPECT_EQ(KEYCMPNEGEQ(k1, k2, KS), KEYCMPNEGEQ<KS>(k1, k2, KS));
+		EXPECT_EQ(0, KEYCMP<KS>(k1, k1));
+	}
+}
+
+TEST(KeyCmpTest, MatchesRuntimeKeySize) {
+	srand(42);
+	testKeyCmp<12>();
+	testKeyCmp<16>();
+	testKeyCmp<18>();
+	testKeyCmp<24>();
+	testKeyCmp<28>();
+}
+
+TEST(KeyCmpTest, KeySizeSwitch) {
+	char k1[MAX_KEY_BYTES] = {};
+	char k2[MAX_KEY_BYTES] = {};
+	k1[0] = 1;
+	for(char ks : {(char)6, (char)8, (char)12, (char)16, (char)18, (char)24, (char)28}) {
+		EXPECT_EQ(1, KEYSIZE_SWITCH(ks, KEYCMP, k1, k2, ks));
+		if(ks >= 12) {
+			EXPECT_EQ(0, KEYSIZE_SWITCH(ks, KEYCMPNEGEQ, k1, k2, ks));
+		}
+	}
+}
+
+typedef std::map<std::string, bool> Keys; // big endian positive key -> is negative
+
+// a key with the bytes of "k" in reverse, so std::string compares like KEYCMP
+static std::string toKey(const std::string &k, bool isNeg) {
+	std::string key(k.rbegin(), k.rend());
+	if(isNeg) key[0] &= 0xfe;
+	else      key[0] |= 0x01;
+	return key;
+}
+
+static void makeList(RdbList *list, const Keys &keys, char ks) {
+	list->set(NULL, 0, NULL, 0, 0, true, false, ks);
+	for(Keys::const_iterator it=keys.begin(); it!=keys.end(); ++it)
+		ASSERT_TRUE(list->addRecord(toKey(it->first, it->second).data(), 0, NULL));
+}
+
+static void testMerge(char ks) {
+	Keys expected;
+	RdbList lists[4];
+	RdbList *listPtrs[4];
+	for(int32_t i=0; i<4; i++) {
+		Keys keys;
+		for(int32_t j=0; j<500; j++) {
+			std::string k(ks, '\0');
+			k[0] = (char)(rand() % 64);
+			k[ks-1] = (char)(rand() % 256);
+			k[ks-1] |= 0x01;
+			keys[k] = (rand() % 5 == 0);
+		}
+		for(Keys::iterator it=keys.begin(); it!=keys.end(); ++it)
+			expected[it->first] = it->second;
+		makeList(&lists[i], keys, ks);
+		listPtrs[i] = &lists[i];
+	}
+	Keys positive;
+	for(Keys::iterator it=expected.begin(); it!=expected.end(); ++it)
+		if(!it->second)
+			positive[it->first] = false;
+	RdbList expectedList;
+	makeList(&expectedList, positive, ks);
+
+	RdbList list;
+	list.set(NULL, 0, NULL, 0, 0, true, false, ks);
+	ASSERT_TRUE(list.prepareForMerge(listPtrs, 4, -1));
+	list.merge_r(listPtrs, 4, KEYMIN(), KEYMAX(), -1, true, RDB_NONE, 0);
+	ASSERT_EQ(expectedList.getListSize(), list.getListSize());
+	EXPECT_EQ(0, memcmp(expectedList.getList(), list.getList(), list.getListSize()));
+}
+
+// merge_r() for each key size instance
+TEST(KeyCmpTest, Merge) {
+	srand(42);
+	testMerge(12);
+	testMerge(16);
+	testMerge(24);
+	testMerge(28);
+}
@@ -0,0 +1,68 @@
+#include "gtest/gtest.h"
+#include "LatencyHistogram.h"
+
+TEST(LatencyHistogramTest, IndexRoundTrip) {
+	for(uint64_t v=0; v<100000; v++) {
+		size_t i = LatencyHistogram::valueToIndex(v);
+		EXPECT_LE(LatencyHistogram::lowestEquivalentValue(i), v);
+		EXPECT_GE(LatencyHistogram::highestEquivalentValue(i), v);
+	}
+	EXPECT_EQ(LatencyHistogram::bucket_count-1, LatencyHistogram::valueToIndex(LatencyHistogram::max_trackable_value));
+	EXPECT_EQ(LatencyHistogram::bucket_count-1, LatencyHistogram::valueToIndex(UINT64_MAX));
+}
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+	for(uint64_t v=0; v<LatencyHistogram::sub_bucket_count; v++) {
+		size_t i = LatencyHistogram::valueToIndex(v);
+		EXPECT_EQ(v, LatencyHistogram::lowestEquivalentValue(i));
+		EXPECT_EQ(v, LatencyHistogram::highestEquivalentValue(i));
+	}
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+	LatencyHistogram h;
+	EXPECT_EQ(0, h.getValueAtPercentile(50.0));
+	for(uint64_t v=1; v<=10000; v++)
+		h.record(v);
+	EXPECT_EQ(10000, h.getCount());
+	EXPECT_EQ(1, h.getMin());
+	EXPECT_EQ(10000, h.getMax());
+	EXPECT_NEAR(5000.5, h.getMean(), 0.001);
+
+	//within the 1/64 relative precision of the histogram
+	EXPECT_NEAR(5000, h.getValueAtPercentile(50.0), 5000/64.0);
+	EXPECT_NEAR(9900, h.getValueAtPercentile(99.0), 9900/64.0);
+	EXPECT_NEAR(9990, h.getValueAtPercentile(99.9), 9990/64.0);
+	EXPECT_EQ(10000, h.getValueAtPercentile(100.0));
+}
+
+TEST(LatencyHistogramTest, AddAndReset) {
+	LatencyHistogram h1, h2;
+	h1.record(10, 3);
+	h2.record(1000);
+	h2.record(5);
+	h1.add(h2);
+	EXPECT_EQ(5, h1.getCount());
+	EXPECT_EQ(5, h1.getMin());
+	EXPECT_EQ(1000, h1.getMax());
+	EXPECT_EQ(10, h1.getValueAtPercentile(50.0));
+
+	h1.reset();
+	EXPECT_EQ(0, h1.getCount());
+	EXPECT_EQ(0, h1.getMin());
+	EXPECT_EQ(0, h1.getMax());
+}
+
+TEST(LatencyHistogramTest, CountAtOrBelow) {
+	LatencyHistogram h;
+	EXPECT_EQ(0, h.getCountAtOrBelow(1000));
+	for(uint64_t v=1; v<=10000; v++)
+		h.record(v);
+	EXPECT_EQ(50005000, h.getSum());
+	EXPECT_EQ(100, h.getCountAtOrBelow(100));
+	EXPECT_EQ(10000, h.getCountAtOrBelow(10000));
+	EXPECT_EQ(10000, h.getCountAtOrBelow(UINT64_MAX));
+	// within the precision of the buckets
+	uint64_t c = h.getCountAtOrBelow(5000);
+	EXPECT_TRUE(c >= 5000 && c <= 5000 + 5000/64);
+}
@@ -0,0 +1,148 @@
+#include "gtest/gtest.h"
+#include "Linkdb.h"
+#include "Msg20.h"
+#include "Conf.h"
+#include "SafeBuf.h"
+#include "fctypes.h"
+#include <string.h>
+
+// the Msg20Reply of an inlinker like we get it from its titlerec
+static void makeReply(Msg20Reply *r, int64_t docId, const char *url, const char *linkText) {
+	r->reset();
+	r->m_docId         = docId;
+	r->m_ip            = 0x01020304 + (int32_t)docId;
+	r->m_firstIp       = r->m_ip;
+	r->m_siteRank      = 3;
+	r->m_wordPosStart  = 12;
+	r->m_numOutlinks   = 40;
+	r->m_firstSpidered = 1400000000;
+	r->m_lastSpidered  = 1500000000;
+	r->m_language      = 1;
+	r->m_hopcount      = 2;
+	r->ptr_ubuf        = (char *)url;
+	r->size_ubuf       = strlen(url) + 1;
+	r->ptr_linkText    = (char *)linkText;
+	r->size_linkText   = strlen(linkText) + 1;
+	r->ptr_surroundingText  = (char *)"read more about it";
+	r->size_surroundingText = 19;
+}
+
+static Msg25 *newMsg25() {
+	Msg25 *m = new Msg25;
+	m->m_mode          = MODE_PAGELINKINFO;
+	m->m_niceness      = 0;
+	m->m_url           = (char *)"http://linkee.com/";
+	m->m_numDocIds     = 2;
+	m->m_cblocks       = 2;
+	m->m_uniqueIps     = 2;
+	m->m_reusedInlinks = 0;
+	m->m_oldLinkInfo   = NULL;
+	return m;
+}
+
+static LinkInfo *makeInfo(Msg25 *m, Msg20Reply **replies, int32_t n, int32_t lastUpdated, SafeBuf *buf) {
+	return makeLinkInfo("main", 0x05060708, 10, replies, n, 0, true, 1234, lastUpdated, false, 0, m, buf);
+}
+
+static LinkInfo *makeOldInfo(Msg25 *m, int32_t lastUpdated, SafeBuf *buf) {
+	Msg20Reply r[2];
+	makeReply(&r[0], 100, "http://a.com/", "red widgets");
+	makeReply(&r[1], 101, "http://b.com/page.html", "blue widgets");
+	Msg20Reply *replies[2] = { &r[0], &r[1] };
+	return makeInfo(m, replies, 2, lastUpdated, buf);
+}
+
+TEST(LinkdbTest, ReusedInlinkSameAsMsg20) {
+	g_conf.m_linkInfoReuseMaxAge = 7;
+	int32_t now = getTimeGlobal();
+	Msg25 *m = newMsg25();
+	SafeBuf oldBuf;
+	LinkInfo *old = makeOldInfo(m, now - 86400, &oldBuf);
+	ASSERT_TRUE(old != NULL);
+	ASSERT_EQ(2, old->getNumLinkTexts());
+
+	m->m_oldLinkInfo = old;
+	ASSERT_TRUE(m->setOldInlinkTable());
+	Msg20Reply *replies[2];
+	int64_t docIds[2] = { 100, 101 };
+	for(int32_t j=0; j<2; j++) {
+		Inlink **k = (Inlink **)m->m_oldInlinkTable.getValue(&docIds[j]);
+		ASSERT_TRUE(k != NULL);
+		// the ip and site rank in the linkdb key
+		ASSERT_TRUE(m->reuseOldInlink(*k, j, (*k)->m_ip, (*k)->m_siteRank));
+		replies[j] = m->m_msg20s[j].m_r;
+	}
+	EXPECT_EQ(2, m->m_reusedInlinks);
+
+	// the same link info as getting the summaries of the inlinkers again
+	SafeBuf newBuf;
+	LinkInfo *info = makeInfo(m, replies, 2, now - 86400, &newBuf);
+	ASSERT_TRUE(info != NULL);
+	ASSERT_EQ(oldBuf.length(), newBuf.length());
+	EXPECT_EQ(0, memcmp(oldBuf.getBufStart(), newBuf.getBufStart(), oldBuf.length()));
+	delete m;
+}
+
+TEST(LinkdbTest, NewerIpAndSiteRank) {
+	g_conf.m_linkInfoReuseMaxAge = 7;
+	Msg25 *m = newMsg25();
+	SafeBuf oldBuf;
+	LinkInfo *old = makeOldInfo(m, getTimeGlobal(), &oldBuf);
+	ASSERT_TRUE(old != NULL);
+	Inlink *k = old->getNextInlink(NULL);
+	ASSERT_TRUE(m->reuseOldInlink(k, 0, 0x0a0b0c0d, 5));
+	Msg20Reply *r = m->m_msg20s[0].m_r;
+	EXPECT_EQ(0x0a0b0c0d, r->m_ip);
+	EXPECT_EQ(5, r->m_siteRank);
+	EXPECT_EQ(k->m_docId, r->m_docId);
+	EXPECT_STREQ(k->getLinkText(), r->ptr_linkText);
+	delete m;
+}
+
+TEST(LinkdbTest, OldInlinksNotReusedPastMaxAge) {
+	g_conf.m_linkInfoReuseMaxAge = 7;
+	int32_t now = getTimeGlobal();
+	Msg25 *m = newMsg25();
+	int64_t docId = 100;
+
+	SafeBuf recentBuf;
+	m->m_oldLinkInfo = makeOldInfo(m, now - 6 * 86400, &recentBuf);
+	ASSERT_TRUE(m->setOldInlinkTable());
+	EXPECT_TRUE(m->m_oldInlinkTable.getValue(&docId) != NULL);
+
+	SafeBuf staleBuf;
+	m->m_oldLinkInfo = makeOldInfo(m, now - 8 * 86400, &staleBuf);
+	ASSERT_TRUE(m->setOldInlinkTable());
+	EXPECT_EQ(0, m->m_oldInlinkTable.getNumSlots());
+
+	// reuse is off
+	g_conf.m_linkInfoReuseMaxAge = 0;
+	m->m_oldLinkInfo = (LinkInfo *)recentBuf.getBufStart();
+	ASSERT_TRUE(m->setOldInlinkTable());
+	EXPECT_EQ(0, m->m_oldInlinkTable.getNumSlots());
+	g_conf.m_linkInfoReuseMaxAge = 7;
+
+	// only for the link info of a page
+	m->m_mode = MODE_SITELINKINFO;
+	ASSERT_TRUE(m->setOldInlinkTable());
+	EXPECT_EQ(0, m->m_oldInlinkTable.getNumSlots());
+	delete m;
+}
+
+TEST(LinkdbTest, RecycledInlinksNotReused) {
+	g_conf.m_linkInfoReuseMaxAge = 7;
+	Msg25 *m = newMsg25();
+	// the first inlinker was not in linkdb anymore last time
+	Msg20Reply r[2];
+	makeReply(&r[0], 100, "http://a.com/", "red widgets");
+	makeReply(&r[1], 101, "http://b.com/page.html", "blue widgets");
+	r[0].m_recycled = 1;
+	Msg20Reply *replies[2] = { &r[0], &r[1] };
+	SafeBuf buf;
+	m->m_oldLinkInfo = makeInfo(m, replies, 2, getTimeGlobal(), &buf);
+	ASSERT_TRUE(m->setOldInlinkTable());
+	int64_t docIds[2] = { 100, 101 };
+	EXPECT_TRUE(m->m_oldInlinkTable.getValue(&docIds[0]) == NULL);
+	EXPECT_TRUE(m->m_oldInlinkTable.getValue(&docIds[1]) != NULL);
+	delete m;
+}
@@ -0,0 +1,118 @@
+#include "gtest/gtest.h"
+#include "Conf.h"
+#include "Log.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static const char *s_logFile = "/tmp/gb_log_test.log";
+static const int s_numThreads = 4;
+static const int s_numMsgs = 5000;
+
+static void *logThread(void *arg) {
+	int t = (int)(intptr_t)arg;
+	for(int i=0; i<s_numMsgs; i++)
+		logf(LOG_INFO, "logtest: thread %d msg %d", t, i);
+	return NULL;
+}
+
+static std::vector<std::string> readLines() {
+	std::vector<std::string> lines;
+	std::ifstream in(s_logFile);
+	std::string line;
+	while(std::getline(in, line))
+		lines.push_back(line);
+	return lines;
+}
+
+class LogTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		unlink(s_logFile);
+		g_conf.m_logAsynchronously = true;
+		ASSERT_TRUE(g_log.init(s_logFile));
+		ASSERT_TRUE(g_log.startWriterThread());
+	}
+	void TearDown() {
+		g_log.stopWriterThread();
+		g_log.init("/dev/stdout");
+		unlink(s_logFile);
+	}
+};
+
+TEST_F(LogTest, AllThreadsInOrder) {
+	pthread_t tids[s_numThreads];
+	for(int t=0; t<s_numThreads; t++)
+		ASSERT_EQ(0, pthread_create(&tids[t], NULL, logThread, (void*)(intptr_t)t));
+	for(int t=0; t<s_numThreads; t++)
+		pthread_join(tids[t], NULL);
+	g_log.stopWriterThread();
+
+	// info msgs are never dropped, each thread's msgs are in order
+	int next[s_numThreads] = {};
+	for(const std::string &line : readLines()) {
+		size_t pos = line.find("logtest: thread ");
+		if(pos == std::string::npos)
+			continue;
+		int t, i;
+		ASSERT_EQ(2, sscanf(line.c_str() + pos, "logtest: thread %d msg %d", &t, &i));
+		ASSERT_TRUE(t >= 0 && t < s_numThreads);
+		EXPECT_EQ(next[t], i);
+		next[t] = i + 1;
+	}
+	for(int t=0; t<s_numThreads; t++)
+		EXPECT_EQ(s_numMsgs, next[t]);
+}
+
+TEST_F(LogTest, DroppedDebugMsgsAreCounted) {
+	uint64_t numDropped = g_log.getNumDropped();
+	const int numMsgs = 50000;
+	for(int i=0; i<numMsgs; i++)
+		logf(LOG_DEBUG, "logtest: debug msg %d", i);
+	g_log.stopWriterThread();
+	numDropped = g_log.getNumDropped() - numDropped;
+
+	int numLogged = 0;
+	bool sawDropped = false;
+	for(const std::string &line : readLines()) {
+		if(line.find("logtest: debug msg ") != std::string::npos)
+			numLogged++;
+		if(line.find("log: Dropped ") != std::string::npos)
+			sawDropped = true;
+	}
+	EXPECT_EQ((uint64_t)numMsgs, numLogged + numDropped);
+	EXPECT_EQ(numDropped > 0, sawDropped);
+}
+
+TEST_F(LogTest, SynchronousWhenDisabled) {
+	g_conf.m_logAsynchronously = false;
+	logf(LOG_INFO, "logtest: sync msg");
+	// written before returning, without waiting for the writer thread
+	std::vector<std::string> lines = readLines();
+	ASSERT_FALSE(lines.empty());
+	EXPECT_NE(std::string::npos, lines.back().find("logtest: sync msg"));
+	g_conf.m_logAsynchronously = true;
+}
+
+static void *logSyncThread(void *) {
+	logf(LOG_INFO, "logtest: from a new thread");
+	return NULL;
+}
+
+// keep last, there is no going back to the rings
+TEST_F(LogTest, SynchronousAfterCrash) {
+	logf(LOG_INFO, "logtest: before the crash");
+	g_log.logSynchronously();
+	// a thread that never logged writes its msg itself, after what is
+	// still in the rings
+	pthread_t tid;
+	ASSERT_EQ(0, pthread_create(&tid, NULL, logSyncThread, NULL));
+	pthread_join(tid, NULL);
+	std::vector<std::string> lines = readLines();
+	ASSERT_TRUE(lines.size() >= 2);
+	EXPECT_NE(std::string::npos, lines[lines.size()-2].find("logtest: before the crash"));
+	EXPECT_NE(std::string::npos, lines.back().find("logtest: from a new thread"));
+}
@@ -0,0 +1,126 @@
+#include "gtest/gtest.h"
+#include "Msg20.h"
+#include "Mem.h"
+#include "Errno.h"
+#include <string.h>
+#include <string>
+
+static const char *s_queries[3] = { "foo", "bar baz", "qux" };
+
+static void makeRequest(Msg20Request *req, int64_t docId, const char *qbuf) {
+	req->reset();
+	req->m_docId     = docId;
+	req->m_collnum   = 3;
+	req->ptr_qbuf    = (char *)qbuf;
+	req->size_qbuf   = strlen(qbuf) + 1;
+}
+
+static void addRequests(Msg20Batch *b, Msg20 *m) {
+	for(int32_t i=0; i<3; i++) {
+		Msg20Request req;
+		makeRequest(&req, 100+i, s_queries[i]);
+		ASSERT_TRUE(b->addRequest(&m[i], &req));
+	}
+}
+
+// a serialized Msg20Reply like the host making the summary sends back
+static char *makeSummary(int64_t docId, const char *title, int32_t *size) {
+	Msg20Reply r;
+	r.reset();
+	r.m_docId    = docId;
+	r.ptr_tbuf   = (char *)title;
+	r.size_tbuf  = strlen(title) + 1;
+	*size = r.getStoredSize();
+	char *buf = (char *)mmalloc(*size, "Msg20Test");
+	EXPECT_EQ(*size, r.serialize(buf, *size));
+	return buf;
+}
+
+TEST(Msg20Test, BatchRequest) {
+	Msg20 *m = new Msg20[3];
+	Msg20Batch b;
+	addRequests(&b, m);
+	EXPECT_EQ(3, b.m_numMsg20s);
+	EXPECT_TRUE(m[0].m_launched);
+	EXPECT_EQ(100, m[0].getRequestDocId());
+
+	// what the receiving host does with it
+	std::string buf(b.m_request.getBufStart(), b.m_request.length());
+	Msg20Request *reqs[MAX_MSG20_BATCH];
+	ASSERT_EQ(3, Msg20Batch::parseRequest(&buf[0], buf.size(), reqs));
+	for(int32_t i=0; i<3; i++) {
+		EXPECT_EQ(100+i, reqs[i]->m_docId);
+		EXPECT_EQ(3, reqs[i]->m_collnum);
+		EXPECT_STREQ(s_queries[i], reqs[i]->ptr_qbuf);
+	}
+
+	// a truncated request is bad
+	std::string truncated(b.m_request.getBufStart(), b.m_request.length() - 8);
+	EXPECT_EQ(-1, Msg20Batch::parseRequest(&truncated[0], truncated.size(), reqs));
+	EXPECT_EQ(-1, Msg20Batch::parseRequest(NULL, 0, reqs));
+	delete[] m;
+}
+
+TEST(Msg20Test, BatchReply) {
+	// the second summary was not found
+	int32_t errnos[3] = { 0, ENOTFOUND, 0 };
+	char *replies[3];
+	int32_t replySizes[3];
+	replies[0] = makeSummary(100, "first title", &replySizes[0]);
+	replies[1] = NULL;
+	replySizes[1] = 0;
+	replies[2] = makeSummary(102, "third", &replySizes[2]);
+	const char spans[16] = "query spans";
+	int32_t size = 0;
+	char *reply = Msg20Batch::makeReply(3, errnos, replies, replySizes, spans, sizeof(spans), &size);
+	ASSERT_TRUE(reply != NULL);
+	mfree(replies[0], replySizes[0], "Msg20Test");
+	mfree(replies[2], replySizes[2], "Msg20Test");
+
+	{
+		Msg20 *m = new Msg20[3];
+		Msg20Batch b;
+		addRequests(&b, m);
+		b.setReply(reply, size);
+		for(int32_t i=0; i<3; i++)
+			EXPECT_TRUE(m[i].m_gotReply);
+		ASSERT_TRUE(m[0].m_r != NULL);
+		EXPECT_EQ(0, m[0].m_errno);
+		EXPECT_EQ(100, m[0].m_r->m_docId);
+		EXPECT_STREQ("first title", m[0].m_r->ptr_tbuf);
+		EXPECT_EQ(ENOTFOUND, m[1].m_errno);
+		EXPECT_TRUE(m[1].m_r == NULL);
+		ASSERT_TRUE(m[2].m_r != NULL);
+		EXPECT_EQ(102, m[2].m_r->m_docId);
+		EXPECT_STREQ("third", m[2].m_r->ptr_tbuf);
+		EXPECT_EQ((int32_t)sizeof(spans), b.m_spans.length());
+		EXPECT_EQ(0, memcmp(spans, b.m_spans.getBufStart(), sizeof(spans)));
+		delete[] m;
+	}
+
+	// a truncated reply fails the summaries that are not all there
+	{
+		Msg20 *m = new Msg20[3];
+		Msg20Batch b;
+		addRequests(&b, m);
+		b.setReply(reply, 8 + 8 + replySizes[0]);
+		EXPECT_EQ(0, m[0].m_errno);
+		EXPECT_EQ(ECORRUPTDATA, m[1].m_errno);
+		EXPECT_EQ(ECORRUPTDATA, m[2].m_errno);
+		delete[] m;
+	}
+
+	// a reply for another number of requests
+	{
+		Msg20 *m = new Msg20[3];
+		Msg20Batch b;
+		addRequests(&b, m);
+		b.m_numMsg20s = 2;
+		b.setReply(reply, size);
+		EXPECT_EQ(ECORRUPTDATA, m[0].m_errno);
+		EXPECT_EQ(ECORRUPTDATA, m[1].m_errno);
+		delete[] m;
+	}
+
+	mfree(reply, size, "Msg20Reply");
+}
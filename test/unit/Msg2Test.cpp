@@ -0,0 +1,62 @@
+#include "gtest/gtest.h"
+#include "Posdb.h"
+#include "Msg2.h"
+
+TEST(Msg2Test, DocIdRangesFew) {
+	int64_t docIds[] = { 5, 17, 1000 };
+	int64_t start[MAX_PARTIAL_READ_RANGES];
+	int64_t end[MAX_PARTIAL_READ_RANGES];
+	// one range per docid
+	ASSERT_EQ(3, Msg2::getDocIdRanges(docIds, 3, MAX_PARTIAL_READ_RANGES, start, end));
+	for(int32_t i=0; i<3; i++) {
+		EXPECT_EQ(docIds[i], start[i]);
+		EXPECT_EQ(docIds[i], end[i]);
+	}
+	EXPECT_EQ(0, Msg2::getDocIdRanges(docIds, 0, MAX_PARTIAL_READ_RANGES, start, end));
+}
+
+TEST(Msg2Test, DocIdRangesBiggestGaps) {
+	// three clusters, split at the two biggest gaps
+	int64_t docIds[] = { 10, 11, 13, 500, 502, 503, 504, 9000, 9001 };
+	const int32_t n = sizeof(docIds)/sizeof(docIds[0]);
+	int64_t start[3];
+	int64_t end[3];
+	ASSERT_EQ(3, Msg2::getDocIdRanges(docIds, n, 3, start, end));
+	EXPECT_EQ(10, start[0]);
+	EXPECT_EQ(13, end[0]);
+	EXPECT_EQ(500, start[1]);
+	EXPECT_EQ(504, end[1]);
+	EXPECT_EQ(9000, start[2]);
+	EXPECT_EQ(9001, end[2]);
+
+	// a single range covers them all
+	ASSERT_EQ(1, Msg2::getDocIdRanges(docIds, n, 1, start, end));
+	EXPECT_EQ(10, start[0]);
+	EXPECT_EQ(9001, end[0]);
+}
+
+TEST(Msg2Test, DocIdRangesCoverAll) {
+	srand(7);
+	int64_t docIds[1000];
+	int64_t d = 0;
+	for(int32_t i=0; i<1000; i++) {
+		d += 1 + rand() % 100000;
+		docIds[i] = d;
+	}
+	int64_t start[MAX_PARTIAL_READ_RANGES];
+	int64_t end[MAX_PARTIAL_READ_RANGES];
+	int32_t n = Msg2::getDocIdRanges(docIds, 1000, MAX_PARTIAL_READ_RANGES, start, end);
+	ASSERT_EQ(MAX_PARTIAL_READ_RANGES, n);
+	// the ranges are in order, do not overlap and have every docid
+	int32_t k = 0;
+	for(int32_t r=0; r<n; r++) {
+		EXPECT_TRUE(start[r] <= end[r]);
+		if(r > 0) {
+			EXPECT_TRUE(end[r-1] < start[r]);
+		}
+		EXPECT_EQ(docIds[k], start[r]);
+		while(k < 1000 && docIds[k] <= end[r]) k++;
+		EXPECT_EQ(docIds[k-1], end[r]);
+	}
+	EXPECT_EQ(1000, k);
+}
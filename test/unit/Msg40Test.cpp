@@ -0,0 +1,143 @@
+#include "gtest/gtest.h"
+#include "Msg40.h"
+#include "SearchInput.h"
+#include "Parms.h"
+#include "Conf.h"
+#include "Lang.h"
+#include <unistd.h>
+
+class Msg40Test : public ::testing::Test {
+protected:
+	void SetUp() {
+		if(g_parms.m_numSearchParms == 0)
+			g_parms.init();
+		g_conf.m_searchResultsMaxCacheMem = 1000000;
+		g_conf.m_searchResultsMaxCacheAge = 60;
+	}
+};
+
+static void setSearchInput(SearchInput *si, const char *query, collnum_t collnum) {
+	si->clear(0);
+	ASSERT_TRUE(si->m_q.set2(query, langEnglish, true));
+	si->m_collnumBuf.safeMemcpy(&collnum, sizeof(collnum));
+	// set() detects it, it is not cleared
+	si->m_queryLangId = langEnglish;
+	si->m_rcache = 1;
+	si->m_wcache = 1;
+}
+
+TEST_F(Msg40Test, MakeKey) {
+	SearchInput a, b;
+	setSearchInput(&a, "red widgets", 0);
+	setSearchInput(&b, "red widgets", 0);
+	EXPECT_EQ(a.makeKey(), b.makeKey());
+
+	// parms that only control caching or debugging share the page
+	b.m_debug  = 1;
+	b.m_rcache = 0;
+	EXPECT_EQ(a.makeKey(), b.makeKey());
+
+	// parms that change the results do not
+	b.m_docsWanted = 20;
+	EXPECT_NE(a.makeKey(), b.makeKey());
+	b.m_docsWanted = a.m_docsWanted;
+	b.m_queryLangId = langGerman;
+	EXPECT_NE(a.makeKey(), b.makeKey());
+
+	SearchInput c;
+	setSearchInput(&c, "blue widgets", 0);
+	EXPECT_NE(a.makeKey(), c.makeKey());
+	SearchInput d;
+	setSearchInput(&d, "red widgets", 1);
+	EXPECT_NE(a.makeKey(), d.makeKey());
+}
+
+TEST_F(Msg40Test, ExpiresAfterMaxAge) {
+	g_conf.m_searchResultsMaxCacheAge = 1;
+	SearchInput si;
+	setSearchInput(&si, "expiring query", 0);
+
+	Msg40 *a = new Msg40;
+	a->m_si = &si;
+	EXPECT_FALSE(a->checkResultsCache());
+	// an empty page of results
+	a->addToResultsCache();
+	a->releaseResultsWaiters();
+	delete a;
+
+	Msg40 *b = new Msg40;
+	b->m_si = &si;
+	EXPECT_TRUE(b->checkResultsCache());
+	delete b;
+
+	usleep(1100000);
+	Msg40 *c = new Msg40;
+	c->m_si = &si;
+	EXPECT_FALSE(c->checkResultsCache());
+	c->releaseResultsWaiters();
+	delete c;
+}
+
+TEST_F(Msg40Test, InvalidatedByCollection) {
+	SearchInput si;
+	setSearchInput(&si, "invalidated query", 3);
+
+	Msg40 *a = new Msg40;
+	a->m_si = &si;
+	EXPECT_FALSE(a->checkResultsCache());
+	a->addToResultsCache();
+	a->releaseResultsWaiters();
+	delete a;
+
+	Msg40::invalidateResultsCache(3);
+	Msg40 *b = new Msg40;
+	b->m_si = &si;
+	EXPECT_FALSE(b->checkResultsCache());
+	b->releaseResultsWaiters();
+	delete b;
+}
+
+static int s_numCallbacks = 0;
+static void gotResults(void *state) {
+	s_numCallbacks++;
+}
+
+TEST_F(Msg40Test, IdenticalQueryWaitsForTheFirst) {
+	SearchInput si;
+	setSearchInput(&si, "popular query", 0);
+
+	Msg40 *leader = new Msg40;
+	leader->m_si = &si;
+	EXPECT_FALSE(leader->checkResultsCache());
+	EXPECT_TRUE(leader->m_isResultsLeader);
+
+	Msg40 *waiter = new Msg40;
+	waiter->m_si       = &si;
+	waiter->m_state    = NULL;
+	waiter->m_callback = gotResults;
+	EXPECT_FALSE(waiter->checkResultsCache());
+	EXPECT_FALSE(waiter->m_isResultsLeader);
+	EXPECT_EQ(leader, waiter->m_resultsLeader);
+	EXPECT_EQ(waiter, leader->m_firstWaiter);
+
+	// another query is not held up
+	SearchInput other;
+	setSearchInput(&other, "unpopular query", 0);
+	Msg40 *third = new Msg40;
+	third->m_si = &other;
+	EXPECT_FALSE(third->checkResultsCache());
+	EXPECT_TRUE(third->m_isResultsLeader);
+	third->releaseResultsWaiters();
+	delete third;
+
+	// the leader is done, the waiter gets its page without running
+	s_numCallbacks = 0;
+	leader->addToResultsCache();
+	leader->releaseResultsWaiters();
+	EXPECT_EQ(1, s_numCallbacks);
+	EXPECT_TRUE(waiter->m_resultsLeader == NULL);
+	EXPECT_TRUE(leader->m_firstWaiter == NULL);
+	EXPECT_EQ(0, waiter->getCachedTime());
+	delete waiter;
+	delete leader;
+}
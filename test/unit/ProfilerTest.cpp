@@ -0,0 +1,84 @@
+#include "gtest/gtest.h"
+#include "Conf.h"
+#include "Profiler.h"
+#include <signal.h>
+#include <string.h>
+#include <pthread.h>
+#include <string>
+
+static void sigprofHandler(int signo, siginfo_t *info, void *context) {
+	g_profiler.getStackFrame(context);
+}
+
+static volatile uint64_t s_sum;
+
+__attribute__((noinline)) void profilerTestBusyLoop(int64_t ms) {
+	int64_t end = gettimeofdayInMillisecondsLocal() + ms;
+	uint64_t sum = 0;
+	while(gettimeofdayInMillisecondsLocal() < end) {
+		for(int32_t i=0; i<10000; i++)
+			sum = sum * 31 + i;
+	}
+	s_sum = sum;
+}
+
+__attribute__((noinline)) static void *profilerTestThread(void *) {
+	profilerTestBusyLoop(300);
+	return NULL;
+}
+
+static void installHandler() {
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_SIGINFO;
+	sa.sa_sigaction = sigprofHandler;
+	sigaction(SIGPROF, &sa, NULL);
+}
+
+TEST(ProfilerTest, GetFnName) {
+	const char *name = g_profiler.getFnName((uint64_t)&profilerTestBusyLoop + 4);
+	ASSERT_TRUE(name != NULL);
+	EXPECT_STREQ("profilerTestBusyLoop", name);
+	// without the parameter list
+	name = g_profiler.getFnName((uint64_t)&installHandler);
+	ASSERT_TRUE(name != NULL);
+	EXPECT_STREQ("installHandler", name);
+	EXPECT_TRUE(g_profiler.getFnName(1) == NULL);
+}
+
+TEST(ProfilerTest, SamplesAllThreads) {
+	installHandler();
+	ASSERT_TRUE(g_profiler.startRealTimeProfiler(1000));
+	pthread_t tid;
+	ASSERT_EQ(0, pthread_create(&tid, NULL, profilerTestThread, NULL));
+	profilerTestBusyLoop(300);
+	pthread_join(tid, NULL);
+	g_profiler.stopRealTimeProfiler(true);
+
+	EXPECT_TRUE(g_profiler.getNumSamples() > 20);
+	EXPECT_EQ(0, g_profiler.getNumDropped());
+
+	SafeBuf sb;
+	ASSERT_TRUE(g_profiler.printCollapsedStacks(&sb));
+	std::string collapsed(sb.getBufStart(), sb.length());
+	EXPECT_TRUE(collapsed.find("\nmain;") != std::string::npos || collapsed.compare(0, 5, "main;") == 0);
+	EXPECT_TRUE(collapsed.find(";profilerTestBusyLoop") != std::string::npos);
+	EXPECT_TRUE(collapsed.find("threads;") != std::string::npos);
+	EXPECT_TRUE(collapsed.find("profilerTestThread;profilerTestBusyLoop") != std::string::npos);
+	// the signal handler is not in the stacks
+	EXPECT_TRUE(collapsed.find("sigprofHandler") == std::string::npos);
+	EXPECT_TRUE(collapsed.find("getStackFrame") == std::string::npos);
+
+	SafeBuf html;
+	ASSERT_TRUE(g_profiler.printFlameGraph(&html));
+	EXPECT_TRUE(strstr(html.getBufStart(), ">profilerTestBusyLoop<") != NULL);
+
+	// cleared
+	g_profiler.stopRealTimeProfiler(false);
+	EXPECT_EQ(0, g_profiler.getNumSamples());
+	sb.purge();
+	ASSERT_TRUE(g_profiler.printCollapsedStacks(&sb));
+	EXPECT_EQ(0, sb.length());
+	g_profiler.reset();
+}
@@ -0,0 +1,159 @@
+#include "gtest/gtest.h"
+#include "QueryTrace.h"
+#include "Conf.h"
+#include <string.h>
+
+static const QuerySpan *getSpan(const QueryTrace &trace, int32_t i) {
+	return reinterpret_cast<const QuerySpan*>(trace.getSpans()) + i;
+}
+
+TEST(QueryTraceTest, NotStarted) {
+	QueryTrace trace;
+	EXPECT_FALSE(trace.isStarted());
+	trace.addSpan(span_msg2, 1, 0, 100, 200);
+	EXPECT_EQ(0, trace.getNumSpans());
+	EXPECT_EQ(0, trace.getSpansSize());
+}
+
+TEST(QueryTraceTest, AddSpan) {
+	QueryTrace trace;
+	trace.start(123, span_msg39, 4);
+	EXPECT_TRUE(trace.isStarted());
+	EXPECT_EQ(123, trace.getTraceId());
+	ASSERT_EQ(1, trace.getNumSpans());
+	EXPECT_EQ(span_msg39, getSpan(trace, 0)->m_type);
+	EXPECT_EQ(0, getSpan(trace, 0)->m_depth);
+	EXPECT_EQ(0, getSpan(trace, 0)->m_startUs);
+	EXPECT_EQ(4, getSpan(trace, 0)->m_arg);
+
+	uint64_t startUs = trace.getStartUs();
+	trace.addSpan(span_msg2, 1, 2, startUs + 100, startUs + 600);
+	ASSERT_EQ(2, trace.getNumSpans());
+	EXPECT_EQ((int32_t)sizeof(QuerySpan) * 2, trace.getSpansSize());
+	const QuerySpan *span = getSpan(trace, 1);
+	EXPECT_EQ(span_msg2, span->m_type);
+	EXPECT_EQ(1, span->m_depth);
+	EXPECT_EQ(2, span->m_arg);
+	EXPECT_EQ(100, span->m_startUs);
+	EXPECT_EQ(500, span->m_durationUs);
+
+	// an end before the start is an empty span
+	trace.addSpan(span_msg5, 2, 0, startUs + 700, startUs + 650);
+	EXPECT_EQ(0, getSpan(trace, 2)->m_durationUs);
+
+	trace.endRootSpan();
+	EXPECT_GE(getSpan(trace, 0)->m_durationUs, 0);
+
+	trace.reset();
+	EXPECT_FALSE(trace.isStarted());
+	EXPECT_EQ(0, trace.getNumSpans());
+}
+
+TEST(QueryTraceTest, AddReplySpans) {
+	// what a host sent back, relative to when it got the request
+	QuerySpan reply[2];
+	memset(reply, 0, sizeof(reply));
+	reply[0].m_type = span_msg39;
+	reply[0].m_durationUs = 1000;
+	reply[0].m_hostId = 7;
+	reply[1].m_type = span_intersect;
+	reply[1].m_depth = 1;
+	reply[1].m_startUs = 200;
+	reply[1].m_durationUs = 300;
+	reply[1].m_hostId = 7;
+
+	QueryTrace trace;
+	trace.start(1, span_query, 0);
+	uint64_t startUs = trace.getStartUs();
+	// a round trip of 2000us, the host had it 1000us in the middle of it
+	trace.addReplySpans((const char *)reply, sizeof(reply), startUs + 1000, startUs + 3000, 3);
+	ASSERT_EQ(3, trace.getNumSpans());
+	EXPECT_EQ(span_msg39, getSpan(trace, 1)->m_type);
+	EXPECT_EQ(1500, getSpan(trace, 1)->m_startUs);
+	EXPECT_EQ(3, getSpan(trace, 1)->m_depth);
+	EXPECT_EQ(7, getSpan(trace, 1)->m_hostId);
+	EXPECT_EQ(span_intersect, getSpan(trace, 2)->m_type);
+	EXPECT_EQ(1700, getSpan(trace, 2)->m_startUs);
+	EXPECT_EQ(4, getSpan(trace, 2)->m_depth);
+	EXPECT_EQ(300, getSpan(trace, 2)->m_durationUs);
+
+	// the host took longer than the round trip, its clock is off
+	trace.addReplySpans((const char *)reply, sizeof(reply), startUs + 1000, startUs + 1500, 3);
+	ASSERT_EQ(5, trace.getNumSpans());
+	EXPECT_EQ(1000, getSpan(trace, 3)->m_startUs);
+
+	// bad span types are skipped
+	reply[1].m_type = span_end;
+	trace.addReplySpans((const char *)reply, sizeof(reply), startUs, startUs + 1000, 1);
+	EXPECT_EQ(6, trace.getNumSpans());
+}
+
+TEST(QueryTraceTest, MaxSpans) {
+	QueryTrace trace;
+	trace.start(1, span_msg21, 5);
+	trace.setMaxSpans(3);
+	uint64_t startUs = trace.getStartUs();
+	for(int32_t i = 0; i < 5; i++)
+		trace.addSpan(span_summary, 1, i, startUs, startUs + 10);
+	EXPECT_EQ(3, trace.getNumSpans());
+	EXPECT_EQ(3, trace.getNumDropped());
+	EXPECT_EQ(1, getSpan(trace, 2)->m_arg);
+
+	QuerySpan reply[2];
+	memset(reply, 0, sizeof(reply));
+	trace.addReplySpans((const char *)reply, sizeof(reply), startUs, startUs + 10, 1);
+	EXPECT_EQ(3, trace.getNumSpans());
+	EXPECT_EQ(5, trace.getNumDropped());
+}
+
+TEST(QueryTraceTest, SampleTraceId) {
+	float savedPercent = g_conf.m_queryTraceSamplePercent;
+	g_conf.m_queryTraceSamplePercent = 0.0;
+	for(int32_t i = 0; i < 100; i++)
+		EXPECT_EQ(0, QueryTrace::sampleTraceId(false));
+	EXPECT_NE(0, QueryTrace::sampleTraceId(true));
+	g_conf.m_queryTraceSamplePercent = 100.0;
+	for(int32_t i = 0; i < 100; i++)
+		EXPECT_NE(0, QueryTrace::sampleTraceId(false));
+	g_conf.m_queryTraceSamplePercent = savedPercent;
+}
+
+TEST(QueryTraceTest, KeepSlowTraces) {
+	int32_t savedMinTime = g_conf.m_queryTraceMinTime;
+	QueryTrace::resetKept();
+
+	// too fast to keep
+	g_conf.m_queryTraceMinTime = 1000000;
+	QueryTrace trace;
+	trace.start(0x1234, span_query, 0);
+	trace.finish("fast query");
+	EXPECT_FALSE(trace.isStarted());
+
+	SafeBuf sb;
+	ASSERT_TRUE(QueryTrace::printTraces(&sb, "main", 0));
+	EXPECT_TRUE(strstr(sb.getBufStart(), "No traces.") != NULL);
+	EXPECT_TRUE(strstr(sb.getBufStart(), "fast query") == NULL);
+
+	// kept
+	g_conf.m_queryTraceMinTime = 0;
+	trace.start(0x5678, span_query, 0);
+	uint64_t startUs = trace.getStartUs();
+	trace.addSpan(span_msg3a, 1, 0, startUs, startUs + 10);
+	trace.finish("slow <query>");
+
+	sb.purge();
+	ASSERT_TRUE(QueryTrace::printTraces(&sb, "main", 0));
+	EXPECT_TRUE(strstr(sb.getBufStart(), "No traces.") == NULL);
+	EXPECT_TRUE(strstr(sb.getBufStart(), "slow &lt;query&gt;") != NULL);
+	EXPECT_TRUE(strstr(sb.getBufStart(), "/admin/perf?c=main&qtrace=22136>") != NULL);
+	EXPECT_TRUE(strstr(sb.getBufStart(), "msg3a") == NULL);
+
+	// the waterfall of it
+	sb.purge();
+	ASSERT_TRUE(QueryTrace::printTraces(&sb, "main", 0x5678));
+	EXPECT_TRUE(strstr(sb.getBufStart(), ">query<") != NULL);
+	EXPECT_TRUE(strstr(sb.getBufStart(), ">msg3a<") != NULL);
+
+	QueryTrace::resetKept();
+	g_conf.m_queryTraceMinTime = savedMinTime;
+}
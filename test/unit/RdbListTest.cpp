@@ -0,0 +1,144 @@
+#include "gtest/gtest.h"
+#include "Posdb.h"
+#include "RdbList.h"
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+static const int64_t s_termId = 0x123456789aLL;
+
+struct PosdbKeyLess {
+	bool operator()(const std::string &a, const std::string &b) const {
+		return KEYCMP(a.data(), b.data(), 18) < 0;
+	}
+};
+
+typedef std::map<std::string, bool, PosdbKeyLess> PosdbKeys; // positive key -> is negative
+
+static std::string makeKey(int64_t docId, int32_t wordPos, bool isDelKey) {
+	char key[18];
+	Posdb::makeKey(key, s_termId, docId, wordPos, 0, 0, 0, 0, 0, 0, 0, false, isDelKey, false);
+	return std::string(key, 18);
+}
+
+// random keys of a few docids so the lists overlap a lot
+static PosdbKeys makeRandomKeys(int32_t numKeys, int32_t numDocIds) {
+	PosdbKeys keys;
+	for(int32_t i=0; i<numKeys; i++) {
+		int64_t docId = 1000 + rand() % numDocIds;
+		int32_t wordPos = rand() % 8;
+		keys[makeKey(docId, wordPos, false)] = (rand() % 5 == 0);
+	}
+	return keys;
+}
+
+static void makeList(RdbList *list, const PosdbKeys &keys) {
+	list->set(NULL, 0, NULL, 0, 0, true, true, 18);
+	for(PosdbKeys::const_iterator it=keys.begin(); it!=keys.end(); ++it) {
+		std::string k = it->first;
+		if(it->second) k[0] &= 0xfe;
+		ASSERT_TRUE(list->addRecord(k.data(), 0, NULL));
+	}
+}
+
+static std::string getLastKey(RdbList *list) {
+	char key[18];
+	for(list->resetListPtr(); !list->isExhausted(); list->skipCurrentRecord())
+		list->getCurrentKey(key);
+	return std::string(key, 18);
+}
+
+class PosdbMergeTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		srand(42);
+		m_numLists = 0;
+		PosdbKeys expected;
+		for(int32_t i=0; i<8; i++) {
+			// the lists are from the oldest to the newest, a newer key
+			// replaces an older one
+			PosdbKeys keys = makeRandomKeys(200 + rand() % 2000, 400);
+			for(PosdbKeys::iterator it=keys.begin(); it!=keys.end(); ++it)
+				expected[it->first] = it->second;
+			makeList(&m_lists[i], keys);
+			m_listPtrs[m_numLists++] = &m_lists[i];
+		}
+		// the merge of them all without the negative keys
+		PosdbKeys positive;
+		for(PosdbKeys::iterator it=expected.begin(); it!=expected.end(); ++it)
+			if(!it->second)
+				positive[it->first] = false;
+		makeList(&m_expected, positive);
+		Posdb::makeStartKey(m_startKey, s_termId);
+		Posdb::makeEndKey(m_endKey, s_termId);
+	}
+
+	void merge(RdbList *list, int32_t minRecSizes) {
+		list->set(NULL, 0, NULL, 0, 0, true, true, 18);
+		ASSERT_TRUE(list->prepareForMerge(m_listPtrs, m_numLists, minRecSizes));
+		list->posdbMerge_r(m_listPtrs, m_numLists, m_startKey, m_endKey, list->m_mergeMinListSize, true, 0);
+	}
+
+	RdbList m_lists[8];
+	RdbList *m_listPtrs[8];
+	int32_t m_numLists;
+	RdbList m_expected;
+	char m_startKey[18];
+	char m_endKey[18];
+};
+
+TEST_F(PosdbMergeTest, MergeAll) {
+	RdbList list;
+	merge(&list, -1);
+	ASSERT_EQ(m_expected.getListSize(), list.getListSize());
+	EXPECT_EQ(0, memcmp(m_expected.getList(), list.getList(), list.getListSize()));
+	ASSERT_TRUE(list.isLastKeyValid());
+	EXPECT_EQ(0, memcmp(getLastKey(&m_expected).data(), list.getLastKey(), 18));
+	EXPECT_EQ(0, memcmp(m_endKey, list.getEndKey(), 18));
+}
+
+TEST_F(PosdbMergeTest, MergeTruncated) {
+	RdbList list;
+	merge(&list, m_expected.getListSize() / 3);
+	ASSERT_TRUE(list.getListSize() >= m_expected.getListSize() / 3);
+	ASSERT_TRUE(list.getListSize() < m_expected.getListSize());
+	// the same keys as the full merge, up to the end key
+	EXPECT_EQ(0, memcmp(m_expected.getList(), list.getList(), list.getListSize()));
+	EXPECT_TRUE(KEYCMP(list.getEndKey(), m_endKey, 18) < 0);
+	EXPECT_TRUE(KEYCMP(list.getLastKey(), list.getEndKey(), 18) <= 0);
+}
+
+TEST_F(PosdbMergeTest, MergeRanges) {
+	// split in docid ranges, the way Msg5 does it
+	const int32_t numRanges = 4;
+	char splitKeys[numRanges-1][18];
+	for(int32_t i=0; i<numRanges-1; i++)
+		Posdb::makeStartKey(splitKeys[i], s_termId, 1000 + 100*(i+1));
+	RdbList ranges[numRanges];
+	RdbList *rangePtrs[numRanges];
+	for(int32_t i=0; i<numRanges; i++) {
+		const char *startKey = i>0 ? splitKeys[i-1] : NULL;
+		const char *stopKey  = i<numRanges-1 ? splitKeys[i] : NULL;
+		ASSERT_TRUE(ranges[i].posdbMergeRange_r(m_listPtrs, m_numLists, startKey, stopKey, true));
+		rangePtrs[i] = &ranges[i];
+	}
+
+	RdbList list;
+	list.set(NULL, 0, NULL, 0, 0, true, true, 18);
+	ASSERT_TRUE(list.prepareForMerge(m_listPtrs, m_numLists, -1));
+	list.posdbAddMergedRanges(rangePtrs, numRanges, m_startKey, m_endKey);
+	ASSERT_EQ(m_expected.getListSize(), list.getListSize());
+	EXPECT_EQ(0, memcmp(m_expected.getList(), list.getList(), list.getListSize()));
+	EXPECT_EQ(0, memcmp(getLastKey(&m_expected).data(), list.getLastKey(), 18));
+
+	// the list can be read back
+	int32_t numKeys = 0;
+	for(list.resetListPtr(); !list.isExhausted(); list.skipCurrentRecord())
+		numKeys++;
+	int32_t expectedNumKeys = 0;
+	for(m_expected.resetListPtr(); !m_expected.isExhausted(); m_expected.skipCurrentRecord())
+		expectedNumKeys++;
+	EXPECT_EQ(expectedNumKeys, numKeys);
+}
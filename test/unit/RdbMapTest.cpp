@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+#include "RdbMap.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const int32_t s_pageSize = 1024;
+static const int32_t s_recSize  = 100;
+
+class RdbMapTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		strcpy(m_dir, "/tmp/gbmaptestXXXXXX");
+		ASSERT_TRUE(mkdtemp(m_dir) != NULL);
+	}
+	void TearDown() {
+		std::string cmd = std::string("rm -rf ") + m_dir;
+		system(cmd.c_str());
+	}
+
+	static key_t makeKey(int32_t i) {
+		key_t k;
+		k.n1 = i / 5000;
+		k.n0 = ((uint64_t)i << 1) | 1;
+		return k;
+	}
+
+	// add enough records for a few full segments and a partial one
+	void fillMap(RdbMap *map, int32_t numRecs) {
+		map->set(m_dir, "testdb0001.map", 0, false, sizeof(key_t), s_pageSize);
+		for(int32_t i=0; i<numRecs; i++) {
+			key_t k = makeKey(i);
+			ASSERT_TRUE(map->addRecord(k, NULL, s_recSize));
+		}
+	}
+
+	// the data file just has to be as big as the map says
+	void makeDataFile(BigFile *file, int64_t size) {
+		std::string filename = std::string(m_dir) + "/testdb0001.dat";
+		int fd = open(filename.c_str(), O_RDWR|O_CREAT, 0644);
+		ASSERT_TRUE(fd >= 0);
+		ASSERT_EQ(0, ftruncate(fd, size));
+		close(fd);
+		ASSERT_TRUE(file->set(m_dir, "testdb0001.dat"));
+	}
+
+	void expectSameMap(RdbMap *a, RdbMap *b) {
+		ASSERT_EQ(a->getNumPages(), b->getNumPages());
+		EXPECT_EQ(a->getFileSize(), b->getFileSize());
+		EXPECT_EQ(a->getNumPositiveRecs(), b->getNumPositiveRecs());
+		for(int32_t i=0; i<=a->getNumPages(); i++) {
+			char ka[MAX_KEY_BYTES], kb[MAX_KEY_BYTES];
+			a->getKey(i, ka);
+			b->getKey(i, kb);
+			ASSERT_EQ(0, memcmp(ka, kb, sizeof(key_t)));
+			if(i<a->getNumPages()) {
+				ASSERT_EQ(a->getOffset(i), b->getOffset(i));
+			}
+		}
+	}
+
+	char m_dir[64];
+};
+
+TEST_F(RdbMapTest, PackedSegments) {
+	RdbMap map;
+	int32_t numRecs = (3*PAGES_PER_SEGMENT+100)*s_pageSize/s_recSize;
+	fillMap(&map, numRecs);
+	int32_t numPages = map.getNumPages();
+	ASSERT_TRUE(numPages > 3*PAGES_PER_SEGMENT);
+	// the full segments are packed
+	EXPECT_TRUE(map.getMemAlloced() < (int64_t)(4*PAGES_PER_SEGMENT*(sizeof(key_t)+2)*3/4));
+
+	// random and sequential access see the same keys
+	for(int32_t i=numPages-1; i>=0; i-=7) {
+		char k1[MAX_KEY_BYTES], k2[MAX_KEY_BYTES];
+		map.getKey(i, k1);
+		int64_t off = map.getAbsoluteOffset(i);
+		// the first whole record on the page
+		key_t k = makeKey((int32_t)(off/s_recSize));
+		EXPECT_EQ(0, memcmp(k1, &k, sizeof(key_t)));
+		for(int32_t j=0; j<=i; j+=PAGES_PER_SEGMENT/2)
+			map.getKey(j, k2);
+		map.getKey(i, k2);
+		EXPECT_EQ(0, memcmp(k1, k2, sizeof(key_t)));
+	}
+
+	// the page of a key
+	key_t k = makeKey(numRecs/2);
+	int32_t page = map.getPage((char*)&k);
+	EXPECT_EQ((int64_t)(numRecs/2)*s_recSize/s_pageSize, page);
+}
+
+TEST_F(RdbMapTest, WriteAndReadPacked) {
+	RdbMap map;
+	int32_t numRecs = (2*PAGES_PER_SEGMENT+100)*s_pageSize/s_recSize;
+	fillMap(&map, numRecs);
+	ASSERT_TRUE(map.writeMap(false));
+
+	BigFile dataFile;
+	makeDataFile(&dataFile, map.getFileSize());
+	RdbMap map2;
+	map2.set(m_dir, "testdb0001.map", 0, false, sizeof(key_t), s_pageSize);
+	ASSERT_TRUE(map2.readMap(&dataFile));
+	expectSameMap(&map, &map2);
+
+	// we can keep adding to a map we read, like when resuming a merge
+	for(int32_t i=numRecs; i<numRecs+PAGES_PER_SEGMENT*s_pageSize/s_recSize; i++) {
+		key_t k = makeKey(i);
+		ASSERT_TRUE(map.addRecord(k, NULL, s_recSize));
+		ASSERT_TRUE(map2.addRecord(k, NULL, s_recSize));
+	}
+	expectSameMap(&map, &map2);
+}
+
+TEST_F(RdbMapTest, ReadOldFormat) {
+	RdbMap map;
+	int32_t numRecs = (2*PAGES_PER_SEGMENT+100)*s_pageSize/s_recSize;
+	fillMap(&map, numRecs);
+
+	// the map file as it used to be written, unpacked keys
+	std::string filename = std::string(m_dir) + "/testdb0001.map";
+	FILE *f = fopen(filename.c_str(), "w");
+	ASSERT_TRUE(f != NULL);
+	int64_t hdr[4] = { map.getFileSize(), 0, map.getNumPositiveRecs(), map.getNumNegativeRecs() };
+	fwrite(hdr, 8, 4, f);
+	char lastKey[MAX_KEY_BYTES];
+	map.getLastKey(lastKey);
+	fwrite(lastKey, sizeof(key_t), 1, f);
+	for(int32_t seg=0; seg*PAGES_PER_SEGMENT<map.getNumPages(); seg++) {
+		int32_t first = seg*PAGES_PER_SEGMENT;
+		int32_t end = std::min(first+PAGES_PER_SEGMENT, map.getNumPages());
+		for(int32_t i=first; i<end; i++)
+			fwrite(map.getKeyPtr(i), sizeof(key_t), 1, f);
+		for(int32_t i=first; i<end; i++) {
+			int16_t off = map.getOffset(i);
+			fwrite(&off, 2, 1, f);
+		}
+	}
+	fclose(f);
+
+	BigFile dataFile;
+	makeDataFile(&dataFile, map.getFileSize());
+	RdbMap map2;
+	map2.set(m_dir, "testdb0001.map", 0, false, sizeof(key_t), s_pageSize);
+	ASSERT_TRUE(map2.readMap(&dataFile));
+	expectSameMap(&map, &map2);
+	EXPECT_EQ(map.getMemAlloced(), map2.getMemAlloced());
+}
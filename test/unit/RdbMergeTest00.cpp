@@ -0,0 +1,163 @@
+#include "RdbMerge.h"
+#include "RdbBase.h"
+#include "Rdb.h"
+#include "Titledb.h"
+#include "TitleRecDict.h"
+#include "Collectiondb.h"
+#include "Hostdb.h"
+#include "JobScheduler.h"
+#include "Msg5.h"
+#include "XmlDoc.h"
+#include "Process.h"
+#include "Conf.h"
+#include "Mem.h"
+#include "hash.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+
+extern RdbMerge g_merge;
+
+// html of the same site, so the pages share most of their markup
+static std::string makeDoc(int32_t i) {
+	char buf[256];
+	std::string doc = "<!DOCTYPE html><html><head><meta charset=\"utf-8\">";
+	snprintf(buf, sizeof(buf), "<title>Article %d about widgets</title></head>", (int)i);
+	doc += buf;
+	doc += "<body><div id=\"header\"><ul class=\"nav\"><li><a href=\"/\">Home</a></li>"
+		"<li><a href=\"/products\">Products</a></li></ul></div><div id=\"content\">";
+	for(int32_t j=0; j<20; j++) {
+		snprintf(buf, sizeof(buf), "<p>Paragraph %d of article %d, widget number %d.</p>",
+			 (int)j, (int)i, (int)((i * 31 + j * 7) % 100000));
+		doc += buf;
+	}
+	return doc + "</div></body></html>";
+}
+
+// a titlerec of "data", compressed the way it was before dictionaries
+static std::string makeTitleRec(int64_t docId, const std::string &data) {
+	uint32_t size = data.size() * 2 + 64;
+	std::string rec(sizeof(key_t) + 8 + size, '\0');
+	int err = gbcompress((unsigned char *)&rec[sizeof(key_t) + 8], &size,
+			     (unsigned char *)data.data(), data.size());
+	assert(err == Z_OK);
+	key_t k = g_titledb.makeKey(docId, 0, false);
+	memcpy(&rec[0], &k, sizeof(key_t));
+	*(int32_t *)&rec[sizeof(key_t)]     = size + 4;
+	*(int32_t *)&rec[sizeof(key_t) + 4] = data.size();
+	rec.resize(sizeof(key_t) + 8 + size);
+	return rec;
+}
+
+// verify that a titledb merge with dictionary compression on, where the
+// recompression runs in a job thread, ends when the start key rolls over
+// and does not merge the files again into the target
+int main(void) {
+	g_conf.m_maxMem = 1000000000LL;
+	g_mem.m_memtablesize = 8194*1024;
+	g_mem.init();
+	hashinit();
+	g_process.m_powerIsOn = true;
+	// we are host #0 as far as adding to an rdb is concerned
+	settimeofdayInMillisecondsGlobal(gettimeofdayInMillisecondsLocal());
+
+	char dir[64];
+	strcpy(dir, "/tmp/gbmergetestXXXXXX");
+	assert(mkdtemp(dir) != NULL);
+	snprintf(g_hostdb.m_dir, sizeof(g_hostdb.m_dir), "%s/", dir);
+	g_conf.m_titleRecDicts = true;
+	g_conf.m_titledbMaxTreeMem = 10000000;
+	assert(g_titledb.init());
+
+	static CollectionRec cr;
+	strcpy(cr.m_coll, "test");
+	cr.m_collLen = 4;
+	cr.m_collnum = 0;
+	// no merge after a dump, we start it
+	cr.m_titledbMinFilesToMerge = 50;
+	assert(g_collectiondb.setRecPtr(0, &cr));
+	char collDir[128];
+	snprintf(collDir, sizeof(collDir), "%s/coll.test.0", dir);
+	assert(mkdir(collDir, 0755) == 0);
+
+	// a dictionary for the merge to recompress with
+	{
+		TitleRecDictTrainer trainer;
+		for(int32_t i=0; i<500; i++) {
+			std::string doc = makeDoc(10000 + i);
+			trainer.addSample(doc.data(), doc.size());
+		}
+		TitleRecDict dict;
+		assert(trainer.train(&dict));
+		TitleRecDicts dicts;
+		assert(dicts.load(collDir, "titledb"));
+		assert(dicts.add(dict.m_buf.getBufStart(), dict.m_buf.getLength()));
+	}
+	assert(g_titledb.getRdb()->addRdbBase2(0));
+	RdbBase *base = g_titledb.getRdb()->getBase(0);
+	assert(base->getTitleRecDicts()->getNumDicts() == 1);
+	uint32_t dictId = base->getTitleRecDicts()->getCurrentDict()->m_id;
+
+	// two files with interleaved docids
+	const int32_t numDocs = 50;
+	for(int32_t f=0; f<2; f++) {
+		RdbList list;
+		list.set(NULL, 0, NULL, 0, -1, true, false, sizeof(key_t));
+		for(int32_t i=0; i<numDocs; i++) {
+			std::string rec = makeTitleRec(1000 + i*2 + f, makeDoc(i*2 + f));
+			assert(list.addRecord(&rec[0], rec.size() - sizeof(key_t) - 4, &rec[sizeof(key_t) + 4]));
+		}
+		assert(g_titledb.getRdb()->addList((collnum_t)0, &list, 1));
+		assert(g_titledb.getRdb()->dumpTree(1));
+	}
+	assert(base->getNumFiles() == 2);
+
+	// no i/o threads, so only the recompression is done in a job thread
+	g_jobScheduler.initialize(1, 0, 0);
+	base->attemptMerge(1, true, true, 2);
+	for(int32_t i=0; i<1000 && (g_merge.isMerging() || base->isMerging()); i++) {
+		usleep(10000);
+		g_jobScheduler.cleanup_finished_jobs();
+	}
+	assert(!g_merge.isMerging());
+	assert(base->getNumFiles() == 1);
+	g_jobScheduler.finalize();
+
+	// every record once, in order, recompressed with the dictionary
+	key_t startKey;
+	key_t endKey;
+	startKey.setMin();
+	endKey.setMax();
+	RdbList list;
+	Msg5 msg5;
+	assert(msg5.getList(RDB_TITLEDB, 0, &list, startKey, endKey, 10000000,
+			    false, false, 0, 0, -1, NULL, NULL, 0, false, NULL, 0, -1, true, -1LL));
+	int32_t n = 0;
+	for(list.resetListPtr(); !list.isExhausted(); list.skipCurrentRecord(), n++) {
+		char *rec = list.getCurrentRec();
+		int32_t recSize = list.getCurrentRecSize();
+		key_t k = *(key_t *)rec;
+		assert(g_titledb.getDocId(&k) == 1000 + n);
+		assert(getTitleRecDictId(rec, recSize) == dictId);
+		std::string doc = makeDoc(n);
+		std::string data(*(int32_t *)(rec + sizeof(key_t) + 4), '\0');
+		uint32_t size = data.size();
+		assert(gbuncompressTitleRec((unsigned char *)&data[0], &size,
+					    (unsigned char *)rec + sizeof(key_t) + 8,
+					    recSize - sizeof(key_t) - 8,
+					    base->getTitleRecDicts()) == Z_OK);
+		data.resize(size);
+		assert(data == doc);
+	}
+	assert(n == 2*numDocs);
+
+	std::string cmd = std::string("rm -rf ") + dir;
+	system(cmd.c_str());
+
+	printf("success\n");
+	return 0;
+}
@@ -0,0 +1,190 @@
+#include "gtest/gtest.h"
+#include "RdbWal.h"
+#include "JobScheduler.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+
+class RdbWalTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		strcpy(m_dir, "/tmp/gbwaltestXXXXXX");
+		ASSERT_TRUE(mkdtemp(m_dir) != NULL);
+	}
+	void TearDown() {
+		std::string cmd = std::string("rm -rf ") + m_dir;
+		system(cmd.c_str());
+	}
+	std::string segment(int32_t seq) {
+		char filename[1200];
+		snprintf(filename, sizeof(filename), "%s/testdb-wal%06d.dat", m_dir, (int)seq);
+		return filename;
+	}
+	char m_dir[64];
+};
+
+TEST_F(RdbWalTest, AppendAndReplay) {
+	{
+		RdbWal wal;
+		ASSERT_TRUE(wal.init(m_dir, "testdb", 12));
+		EXPECT_FALSE(wal.isReplaying());
+		ASSERT_TRUE(wal.addList(3, "0123456789ab", 12, false));
+		ASSERT_TRUE(wal.addDelColl(4));
+		ASSERT_TRUE(wal.addList(5, "abcdef", 6, true));
+		// nothing is written until the commit
+		EXPECT_NE(0, access(segment(1).c_str(), F_OK));
+		ASSERT_TRUE(wal.commit(false));
+		EXPECT_EQ(0, access(segment(1).c_str(), F_OK));
+		EXPECT_EQ(0, wal.getBufferedBytes());
+	}
+
+	RdbWal wal;
+	ASSERT_TRUE(wal.init(m_dir, "testdb", 12));
+	EXPECT_TRUE(wal.isReplaying());
+	EXPECT_EQ(2, wal.getCurrentSeq());
+
+	char type, flags;
+	collnum_t collnum;
+	char *data;
+	int32_t dataSize;
+	ASSERT_TRUE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+	EXPECT_EQ(WAL_ADD_LIST, type);
+	EXPECT_EQ(0, flags);
+	EXPECT_EQ(3, collnum);
+	EXPECT_EQ(std::string("0123456789ab"), std::string(data, dataSize));
+	// the same frame until it is skipped
+	ASSERT_TRUE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+	EXPECT_EQ(3, collnum);
+	wal.skipReplayFrame();
+
+	ASSERT_TRUE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+	EXPECT_EQ(WAL_DEL_COLL, type);
+	EXPECT_EQ(4, collnum);
+	EXPECT_EQ(0, dataSize);
+	wal.skipReplayFrame();
+
+	ASSERT_TRUE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+	EXPECT_EQ(WAL_ADD_LIST, type);
+	EXPECT_EQ(WAL_HALF_KEYS, flags);
+	EXPECT_EQ(std::string("abcdef"), std::string(data, dataSize));
+	wal.skipReplayFrame();
+
+	EXPECT_FALSE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+	EXPECT_FALSE(wal.isReplaying());
+	EXPECT_EQ(3, wal.getNumReplayedFrames());
+}
+
+TEST_F(RdbWalTest, TornFrameEndsSegment) {
+	{
+		RdbWal wal;
+		ASSERT_TRUE(wal.init(m_dir, "testdb", 12));
+		ASSERT_TRUE(wal.addList(1, "first", 5, false));
+		ASSERT_TRUE(wal.addList(1, "second", 6, false));
+		ASSERT_TRUE(wal.commit(false));
+	}
+	// chop off the end of the last frame like a crash during the write
+	std::string filename = segment(1);
+	FILE *f = fopen(filename.c_str(), "r");
+	ASSERT_TRUE(f != NULL);
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+	ASSERT_EQ(0, truncate(filename.c_str(), size - 2));
+
+	RdbWal wal;
+	ASSERT_TRUE(wal.init(m_dir, "testdb", 12));
+	char type, flags;
+	collnum_t collnum;
+	char *data;
+	int32_t dataSize;
+	ASSERT_TRUE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+	EXPECT_EQ(std::string("first"), std::string(data, dataSize));
+	wal.skipReplayFrame();
+	EXPECT_FALSE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+}
+
+TEST_F(RdbWalTest, RotateAndCheckpoint) {
+	RdbWal wal;
+	ASSERT_TRUE(wal.init(m_dir, "testdb", 12));
+	// nothing written yet, so nothing to rotate away from
+	EXPECT_EQ(1, wal.rotate());
+
+	ASSERT_TRUE(wal.addList(1, "first", 5, false));
+	ASSERT_TRUE(wal.commit(false));
+	int32_t seq = wal.rotate();
+	EXPECT_EQ(2, seq);
+	ASSERT_TRUE(wal.addList(1, "second", 6, false));
+	ASSERT_TRUE(wal.commit(false));
+	EXPECT_EQ(2, wal.getNumSegments());
+
+	// the dump that started at the rotation completed
+	wal.removeSegmentsBefore(seq);
+	EXPECT_EQ(1, wal.getNumSegments());
+	EXPECT_NE(0, access(segment(1).c_str(), F_OK));
+	EXPECT_EQ(0, access(segment(2).c_str(), F_OK));
+
+	// only the newer segment is replayed
+	RdbWal wal2;
+	ASSERT_TRUE(wal2.init(m_dir, "testdb", 12));
+	char type, flags;
+	collnum_t collnum;
+	char *data;
+	int32_t dataSize;
+	ASSERT_TRUE(wal2.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+	EXPECT_EQ(std::string("second"), std::string(data, dataSize));
+	wal2.skipReplayFrame();
+	EXPECT_FALSE(wal2.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+}
+
+// a rotation while the fsync of the segment is still running in a thread
+TEST_F(RdbWalTest, RotateWhileSyncing) {
+	g_jobScheduler.initialize(2, 0, 0);
+	{
+		RdbWal wal;
+		ASSERT_TRUE(wal.init(m_dir, "testdb", 12));
+		ASSERT_TRUE(wal.addList(1, "first", 5, false));
+		ASSERT_TRUE(wal.commit(true));
+		EXPECT_EQ(2, wal.rotate());
+		ASSERT_TRUE(wal.addList(1, "second", 6, false));
+		ASSERT_TRUE(wal.commit(true));
+		ASSERT_TRUE(wal.addList(1, "third", 5, false));
+		EXPECT_EQ(3, wal.rotate());
+		for(int i=0; i<50; i++) {
+			usleep(10000);
+			g_jobScheduler.cleanup_finished_jobs();
+		}
+	}
+	g_jobScheduler.finalize();
+
+	RdbWal wal;
+	ASSERT_TRUE(wal.init(m_dir, "testdb", 12));
+	const char *expected[3] = { "first", "second", "third" };
+	char type, flags;
+	collnum_t collnum;
+	char *data;
+	int32_t dataSize;
+	for(int i=0; i<3; i++) {
+		ASSERT_TRUE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+		EXPECT_EQ(std::string(expected[i]), std::string(data, dataSize));
+		wal.skipReplayFrame();
+	}
+	EXPECT_FALSE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+}
+
+TEST_F(RdbWalTest, OtherKeySizeIsSkipped) {
+	{
+		RdbWal wal;
+		ASSERT_TRUE(wal.init(m_dir, "testdb", 12));
+		ASSERT_TRUE(wal.addList(1, "first", 5, false));
+		ASSERT_TRUE(wal.commit(false));
+	}
+	RdbWal wal;
+	ASSERT_TRUE(wal.init(m_dir, "testdb", 18));
+	char type, flags;
+	collnum_t collnum;
+	char *data;
+	int32_t dataSize;
+	EXPECT_FALSE(wal.getReplayFrame(&type, &flags, &collnum, &data, &dataSize));
+}
@@ -0,0 +1,44 @@
+#include "Statistics.h"
+#include <assert.h>
+#include <string.h>
+
+#include "Conf.h"
+#include "Mem.h"
+#include "SafeBuf.h"
+
+
+int main(void) {
+	g_conf.m_maxMem = 1000000000LL;
+	g_mem.m_memtablesize = 8194*1024;
+	g_mem.init();
+
+	assert(strcmp(Statistics::get_stage_name(Statistics::stage_query_msg2),"query_msg2")==0);
+
+	Statistics::register_stage_time(Statistics::stage_query_msg2, 50);
+	Statistics::register_stage_time(Statistics::stage_query_msg2, 3000);
+	Statistics::register_stage_time(Statistics::stage_query_msg2, 2000000);
+	Statistics::register_query_time(2, 2, 21);
+	{
+		Statistics::StageTimer timer(Statistics::stage_spider_parse);
+	}
+
+	SafeBuf sb;
+	Statistics::print_metrics(&sb);
+	sb.nullTerm();
+	const char *p = sb.getBufStart();
+
+	assert(strstr(p,"# TYPE gb_stage_latency_seconds histogram\n"));
+	//the buckets are cumulative
+	assert(strstr(p,"gb_stage_latency_seconds_bucket{stage=\"query_msg2\",le=\"0.0001\"} 1\n"));
+	assert(strstr(p,"gb_stage_latency_seconds_bucket{stage=\"query_msg2\",le=\"0.005\"} 2\n"));
+	assert(strstr(p,"gb_stage_latency_seconds_bucket{stage=\"query_msg2\",le=\"2.5\"} 3\n"));
+	assert(strstr(p,"gb_stage_latency_seconds_bucket{stage=\"query_msg2\",le=\"+Inf\"} 3\n"));
+	assert(strstr(p,"gb_stage_latency_seconds_count{stage=\"query_msg2\"} 3\n"));
+	assert(strstr(p,"gb_stage_latency_seconds_sum{stage=\"query_msg2\"} 2.00"));
+	//register_query_time() also feeds the query stage
+	assert(strstr(p,"gb_stage_latency_seconds_count{stage=\"query\"} 1\n"));
+	assert(strstr(p,"gb_stage_latency_seconds_count{stage=\"spider_parse\"} 1\n"));
+	assert(strstr(p,"gb_stage_latency_seconds_count{stage=\"spider_dns\"} 0\n"));
+
+	return 0;
+}
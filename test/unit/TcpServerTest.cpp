@@ -0,0 +1,386 @@
+#include "gtest/gtest.h"
+#include "TcpServer.h"
+#include "HttpServer.h"
+#include "HttpRequest.h"
+#include "Loop.h"
+#include "Mem.h"
+#include "Conf.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <string.h>
+#include <string>
+
+static int32_t     s_numRequests = 0;
+static bool        s_readRegistered = true;
+static std::string s_request;
+static std::string s_pipelined;
+
+static void handleRequest(TcpSocket *s) {
+	s_numRequests++;
+	s_readRegistered = s->m_readRegistered;
+	s_request.assign(s->m_readBuf, s->m_readOffset);
+	s_pipelined.assign(s->m_pipeBuf ? s->m_pipeBuf : "", s->m_pipeBufUsed);
+}
+
+class TcpServerTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		if(!s_tcp) {
+			ASSERT_TRUE(g_loop.init());
+			s_tcp = new TcpServer;
+			// no listening socket
+			ASSERT_TRUE(s_tcp->init(handleRequest, getMsgSize, NULL, -1));
+		}
+		g_conf.m_httpKeepAliveTimeout = 60000;
+		s_numRequests = 0;
+		s_request.clear();
+		s_pipelined.clear();
+		ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, m_fds));
+	}
+
+	void TearDown() {
+		bool wrapped = ( s_tcp->m_tcpSockets[m_fds[0]] != NULL );
+		for(int32_t i=0; i<=s_tcp->m_lastFilled; i++)
+			if(s_tcp->m_tcpSockets[i])
+				s_tcp->destroySocket(s_tcp->m_tcpSockets[i]);
+		if(!wrapped) close(m_fds[0]);
+		if(m_fds[1] >= 0) close(m_fds[1]);
+	}
+
+	// the socket of a client connected to us
+	TcpSocket *accept() {
+		TcpSocket *s = s_tcp->wrapSocket(m_fds[0], 0, true);
+		if(s) s->m_this = s_tcp;
+		return s;
+	}
+
+	void clientSends(const char *data) {
+		ASSERT_EQ((ssize_t)strlen(data), write(m_fds[1], data, strlen(data)));
+	}
+
+	std::string clientReads() {
+		return readFrom(m_fds[1]);
+	}
+
+	static std::string readFrom(int fd) {
+		char buf[1024];
+		ssize_t n = read(fd, buf, sizeof(buf));
+		return std::string(buf, n > 0 ? n : 0);
+	}
+
+	// what the loop does when the socket is readable
+	void readable() {
+		g_loop.callCallbacks_ass(true, m_fds[0]);
+	}
+
+	static bool sendReply(TcpSocket *s, const char *reply) {
+		int32_t len = strlen(reply);
+		char *buf = (char *)mmalloc(len, "TcpServer");
+		memcpy(buf, reply, len);
+		return s_tcp->sendMsg(s, buf, len, len, len, NULL, NULL);
+	}
+
+	static TcpServer *s_tcp;
+	int m_fds[2];
+};
+
+TcpServer *TcpServerTest::s_tcp = NULL;
+
+static const char s_get1[] = "GET /a HTTP/1.1\r\nHost: x\r\n\r\n";
+static const char s_get2[] = "GET /b HTTP/1.1\r\nHost: x\r\n\r\n";
+static const char s_reply[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: Keep-Alive\r\n\r\nok";
+
+TEST_F(TcpServerTest, SplitPipelinedRequest) {
+	TcpSocket *s = accept();
+	ASSERT_TRUE(s != NULL);
+	// both requests arrive in one packet, the second one only partially
+	std::string both = std::string(s_get1) + std::string(s_get2, 20);
+	clientSends(both.c_str());
+	readable();
+	EXPECT_EQ(1, s_numRequests);
+	EXPECT_EQ(s_get1, s_request);
+	EXPECT_EQ(std::string(s_get2, 20), s_pipelined);
+
+	// the rest of it does not start another request while the first one
+	// is being handled
+	clientSends(s_get2 + 20);
+	readable();
+	EXPECT_EQ(1, s_numRequests);
+
+	// it is read once the reply is sent
+	s->m_keepAlive = true;
+	EXPECT_TRUE(sendReply(s, s_reply));
+	EXPECT_EQ(s_reply, clientReads());
+	EXPECT_TRUE(s->isAvailable());
+	EXPECT_TRUE(s->m_pipeBuf != NULL);
+	readable();
+	EXPECT_EQ(2, s_numRequests);
+	EXPECT_EQ(s_get2, s_request);
+	EXPECT_EQ("", s_pipelined);
+	EXPECT_TRUE(s->m_pipeBuf == NULL);
+}
+
+TEST_F(TcpServerTest, PipelinedRequestReadWithTheFirst) {
+	TcpSocket *s = accept();
+	ASSERT_TRUE(s != NULL);
+	std::string both = std::string(s_get1) + s_get2;
+	clientSends(both.c_str());
+	readable();
+	EXPECT_EQ(1, s_numRequests);
+	EXPECT_EQ(s_get2, s_pipelined);
+
+	// there is nothing more on the socket, the loop reads the second
+	// request from what was read with the first
+	s->m_keepAlive = true;
+	EXPECT_TRUE(sendReply(s, s_reply));
+	EXPECT_TRUE(s_tcp->m_readPendingRegistered);
+	g_loop.callCallbacks_ass(true, MAX_NUM_FDS, gettimeofdayInMilliseconds() + 1000);
+	EXPECT_FALSE(s_tcp->m_readPendingRegistered);
+	EXPECT_EQ(2, s_numRequests);
+	EXPECT_EQ(s_get2, s_request);
+}
+
+TEST_F(TcpServerTest, NotReadWhileHandlingRequest) {
+	TcpSocket *s = accept();
+	ASSERT_TRUE(s != NULL);
+	EXPECT_TRUE(s->m_readRegistered);
+	clientSends(s_get1);
+	readable();
+	EXPECT_EQ(1, s_numRequests);
+	// the handler is called after the socket is taken out of the loop
+	EXPECT_FALSE(s_readRegistered);
+	EXPECT_FALSE(s->m_readRegistered);
+
+	// an impatient client
+	clientSends(s_get2);
+	readable();
+	EXPECT_EQ(1, s_numRequests);
+	EXPECT_EQ(s_get1, s_request);
+
+	s->m_keepAlive = true;
+	EXPECT_TRUE(sendReply(s, s_reply));
+	EXPECT_TRUE(s->m_readRegistered);
+	readable();
+	EXPECT_EQ(2, s_numRequests);
+	EXPECT_EQ(s_get2, s_request);
+}
+
+TEST_F(TcpServerTest, ClosedAfterReplyWithoutKeepAlive) {
+	TcpSocket *s = accept();
+	ASSERT_TRUE(s != NULL);
+	clientSends(s_get1);
+	readable();
+	EXPECT_EQ(1, s_numRequests);
+
+	// the handler wants to keep it but the reply says otherwise
+	s->m_keepAlive = true;
+	sendReply(s, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: Close\r\n\r\nok");
+	EXPECT_FALSE(s->m_keepAlive);
+	EXPECT_EQ(ST_NEEDS_CLOSE, s->m_sockState);
+}
+
+static bool isKeepAliveRequest(const char *req) {
+	HttpRequest r;
+	std::string buf(req);
+	if(!r.set(&buf[0], buf.size(), (TcpSocket *)NULL)) return false;
+	return r.isKeepAlive();
+}
+
+TEST_F(TcpServerTest, PersistentRequest) {
+	EXPECT_TRUE (isKeepAliveRequest("GET / HTTP/1.1\r\nHost: x\r\n\r\n"));
+	EXPECT_FALSE(isKeepAliveRequest("GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n"));
+	EXPECT_FALSE(isKeepAliveRequest("GET / HTTP/1.0\r\nHost: x\r\n\r\n"));
+	EXPECT_TRUE (isKeepAliveRequest("GET / HTTP/1.0\r\nHost: x\r\nConnection: Keep-Alive\r\n\r\n"));
+}
+
+// would we keep the connection to the web server after this reply?
+static bool isKeepAliveReply(const char *reply, int32_t *size = NULL) {
+	TcpSocket s;
+	memset(&s, 0, sizeof(s));
+	s.m_keepAlive = true;
+	s.m_maxTextDocLen = -1;
+	s.m_maxOtherDocLen = -1;
+	std::string buf(reply);
+	int32_t n = getMsgSize(&buf[0], buf.size(), &s);
+	if(size) *size = n;
+	return s.m_keepAlive;
+}
+
+TEST_F(TcpServerTest, PersistentReply) {
+	int32_t size;
+	EXPECT_TRUE (isKeepAliveReply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok", &size));
+	EXPECT_EQ(40, size);
+	EXPECT_FALSE(isKeepAliveReply("HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok"));
+	EXPECT_FALSE(isKeepAliveReply("HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok"));
+	EXPECT_TRUE (isKeepAliveReply("HTTP/1.0 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nok"));
+	// we could not tell where the reply ends
+	EXPECT_FALSE(isKeepAliveReply("HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\nok"));
+	// never has content
+	EXPECT_TRUE (isKeepAliveReply("HTTP/1.1 304 Not Modified\r\nDate: x\r\n\r\n", &size));
+	EXPECT_EQ(38, size);
+}
+
+static int32_t     s_numReplies = 0;
+static std::string s_gotReply;
+
+static void gotReply(void *state, TcpSocket *s) {
+	s_numReplies++;
+	s_gotReply.assign(s && s->m_readBuf ? s->m_readBuf : "", s ? s->m_readOffset : 0);
+}
+
+static const char s_webRequest[] = "GET / HTTP/1.1\r\nHost: x\r\nConnection: Keep-Alive\r\n\r\n";
+
+// the connections to web servers
+class TcpServerPoolTest : public TcpServerTest {
+protected:
+	void SetUp() {
+		TcpServerTest::SetUp();
+		g_conf.m_spiderMaxIdleSockets   = 10;
+		g_conf.m_spiderKeepAliveTimeout = 60000;
+		s_numReplies = 0;
+		s_gotReply.clear();
+		m_ip = inet_addr("127.0.0.1");
+		// somewhere to connect to when a new connection is needed
+		m_listenSd = socket(AF_INET, SOCK_STREAM, 0);
+		struct sockaddr_in name;
+		memset(&name, 0, sizeof(name));
+		name.sin_family = AF_INET;
+		name.sin_addr.s_addr = m_ip;
+		ASSERT_EQ(0, bind(m_listenSd, (sockaddr *)&name, sizeof(name)));
+		ASSERT_EQ(0, listen(m_listenSd, 4));
+		socklen_t len = sizeof(name);
+		ASSERT_EQ(0, getsockname(m_listenSd, (sockaddr *)&name, &len));
+		m_port = ntohs(name.sin_port);
+	}
+
+	void TearDown() {
+		TcpServerTest::TearDown();
+		close(m_listenSd);
+	}
+
+	// a connection to the web server kept after "numRequests" requests
+	TcpSocket *pooledSocket(int32_t numRequests) {
+		TcpSocket *s = s_tcp->wrapSocket(m_fds[0], 0, false);
+		if(!s) return NULL;
+		s->m_this        = s_tcp;
+		s->m_ip          = m_ip;
+		s->m_port        = m_port;
+		s->m_sockState   = ST_AVAILABLE;
+		s->m_numRequests = numRequests;
+		return s;
+	}
+
+	bool sendRequest() {
+		int32_t len = strlen(s_webRequest);
+		char *buf = (char *)mmalloc(len, "TcpServer");
+		memcpy(buf, s_webRequest, len);
+		return s_tcp->sendMsg(NULL, 0, m_ip, m_port, buf, len, len, len, NULL, gotReply, 60000, -1, -1);
+	}
+
+	// the sockets to the web server other than "s"
+	TcpSocket *getOtherSocket(TcpSocket *s) {
+		for(int32_t i=0; i<=s_tcp->m_lastFilled; i++) {
+			TcpSocket *t = s_tcp->m_tcpSockets[i];
+			if(!t || t == s || t->m_isIncoming) continue;
+			if(t->m_ip == m_ip && t->m_port == m_port) return t;
+		}
+		return NULL;
+	}
+
+	int32_t m_ip;
+	int16_t m_port;
+	int     m_listenSd;
+};
+
+TEST_F(TcpServerPoolTest, PooledSocketReused) {
+	TcpSocket *s = pooledSocket(1);
+	ASSERT_TRUE(s != NULL);
+	EXPECT_TRUE(s_tcp->getAvailableSocket(m_ip, m_port, NULL, 0) == s);
+	EXPECT_TRUE(s_tcp->getAvailableSocket(m_ip, m_port + 1, NULL, 0) == NULL);
+
+	EXPECT_FALSE(sendRequest());
+	EXPECT_EQ(2, s->m_numRequests);
+	EXPECT_EQ(s_webRequest, clientReads());
+	clientSends("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+	readable();
+	EXPECT_EQ(1, s_numReplies);
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok", s_gotReply);
+	// kept for the next request
+	EXPECT_TRUE(s->isAvailable());
+	EXPECT_TRUE(s->m_readRegistered);
+
+	// only one idle connection per web server
+	TcpSocket other;
+	memset(&other, 0, sizeof(other));
+	other.m_ip   = m_ip;
+	other.m_port = m_port;
+	EXPECT_FALSE(s_tcp->canPoolSocket(&other));
+	other.m_port = m_port + 1;
+	EXPECT_TRUE(s_tcp->canPoolSocket(&other));
+
+	EXPECT_FALSE(sendRequest());
+	EXPECT_EQ(3, s->m_numRequests);
+	EXPECT_EQ(s_webRequest, clientReads());
+	EXPECT_TRUE(getOtherSocket(s) == NULL);
+}
+
+TEST_F(TcpServerPoolTest, ResentWhenClosedBeforeReply) {
+	TcpSocket *s = pooledSocket(1);
+	ASSERT_TRUE(s != NULL);
+	EXPECT_FALSE(sendRequest());
+	EXPECT_EQ(s_webRequest, clientReads());
+	// the web server closed the idle connection before it got the request
+	close(m_fds[1]);
+	m_fds[1] = -1;
+	readable();
+	EXPECT_EQ(0, s_numReplies);
+
+	// sent again on a new connection
+	TcpSocket *t = getOtherSocket(NULL);
+	ASSERT_TRUE(t != NULL);
+	EXPECT_EQ(1, t->m_numRequests);
+	int conn = accept4(m_listenSd, NULL, NULL, 0);
+	ASSERT_TRUE(conn >= 0);
+	struct pollfd pfd = { conn, POLLIN, 0 };
+	for(int32_t i=0; i<20 && poll(&pfd, 1, 50) == 0; i++)
+		g_loop.callCallbacks_ass(false, t->m_sd);
+	EXPECT_EQ(s_webRequest, readFrom(conn));
+	const char *reply = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+	EXPECT_EQ((ssize_t)strlen(reply), write(conn, reply, strlen(reply)));
+	g_loop.callCallbacks_ass(true, t->m_sd);
+	EXPECT_EQ(1, s_numReplies);
+	EXPECT_EQ(reply, s_gotReply);
+	close(conn);
+}
+
+TEST_F(TcpServerPoolTest, NotResentAfterPartialReply) {
+	TcpSocket *s = pooledSocket(1);
+	ASSERT_TRUE(s != NULL);
+	EXPECT_FALSE(sendRequest());
+	EXPECT_EQ(s_webRequest, clientReads());
+	// the web server got the request, it may not be safe to send it again
+	clientSends("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nok");
+	close(m_fds[1]);
+	m_fds[1] = -1;
+	readable();
+	EXPECT_EQ(1, s_numReplies);
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nok", s_gotReply);
+	EXPECT_TRUE(getOtherSocket(NULL) == NULL);
+}
+
+TEST_F(TcpServerPoolTest, NotResentOnNewConnection) {
+	// the first request on a connection did not go to an idle one
+	TcpSocket *s = pooledSocket(0);
+	ASSERT_TRUE(s != NULL);
+	EXPECT_FALSE(sendRequest());
+	EXPECT_EQ(1, s->m_numRequests);
+	close(m_fds[1]);
+	m_fds[1] = -1;
+	readable();
+	EXPECT_EQ(1, s_numReplies);
+	EXPECT_EQ("", s_gotReply);
+	EXPECT_TRUE(getOtherSocket(NULL) == NULL);
+}
@@ -0,0 +1,130 @@
+#include "gtest/gtest.h"
+#include "TermFreqTable.h"
+#include "Posdb.h"
+#include "RdbList.h"
+#include <unistd.h>
+
+// a posdb list of "numPos" positions of each doc, the docs in "negDocIds"
+// with negative keys and those in "bothDocIds" with one of each
+static void makeList(RdbList *list, int64_t termId, int64_t firstDocId, int64_t lastDocId,
+		     int32_t numPos, int64_t negDocId, int64_t bothDocId) {
+	char sk[18], ek[18];
+	Posdb::makeStartKey(sk, termId);
+	Posdb::makeEndKey(ek, termId);
+	list->set(NULL, 0, NULL, 0, 0, true, true, 18);
+	list->set(sk, ek);
+	for(int64_t docId=firstDocId; docId<=lastDocId; docId++) {
+		for(int32_t pos=1; pos<=numPos; pos++) {
+			bool isDelKey = docId==negDocId || (docId==bothDocId && pos==1);
+			char key[18];
+			Posdb::makeKey(key, termId, docId, pos, 0, 0, 0, 0, 0, 0, 0, false, isDelKey, false);
+			list->addRecord(key, 0, NULL);
+		}
+	}
+}
+
+TEST(TermFreqTableTest, EmptyTable) {
+	TermFreqTable tft;
+	EXPECT_TRUE(tft.isEmpty());
+	EXPECT_EQ(0, tft.getTermFreq(12345));
+
+	ASSERT_TRUE(tft.init());
+	EXPECT_FALSE(tft.isEmpty());
+	EXPECT_EQ(0, tft.getTermFreq(12345));
+	EXPECT_EQ(0, tft.getNumExactTerms());
+}
+
+TEST(TermFreqTableTest, ExactAndSketchCounts) {
+	TermFreqTable tft;
+	ASSERT_TRUE(tft.init());
+
+	// rare terms go in the sketch, which never under-estimates
+	for(int64_t termId=1; termId<=1000; termId++)
+		tft.addTermFreq(termId, termId%7+1);
+	for(int64_t termId=1; termId<=1000; termId++)
+		EXPECT_LE(termId%7+1, tft.getTermFreq(termId));
+	EXPECT_EQ(0, tft.getNumExactTerms());
+
+	// frequent terms are counted exactly
+	tft.addTermFreq(0x123456789aLL, 5000);
+	EXPECT_EQ(1, tft.getNumExactTerms());
+	EXPECT_LE(5000, tft.getTermFreq(0x123456789aLL));
+	int64_t before = tft.getTermFreq(0x123456789aLL);
+	tft.addTermFreq(0x123456789aLL, -100);
+	EXPECT_EQ(before-100, tft.getTermFreq(0x123456789aLL));
+
+	// deletes can not make it negative
+	tft.addTermFreq(0x123456789aLL, -1000000);
+	EXPECT_EQ(0, tft.getTermFreq(0x123456789aLL));
+}
+
+TEST(TermFreqTableTest, SketchIsNotDecremented) {
+	TermFreqTable tft;
+	ASSERT_TRUE(tft.init());
+	tft.addTermFreq(42, 10);
+	tft.addTermFreq(42, -5);
+	EXPECT_LE(10, tft.getTermFreq(42));
+	EXPECT_EQ(0, tft.getNumExactTerms());
+}
+
+TEST(TermFreqTableTest, AddPosdbList) {
+	TermFreqTable tft;
+	ASSERT_TRUE(tft.init());
+	RdbList list;
+	makeList(&list, 0x123456789aLL, 1, 2000, 3, -1, -1);
+	tft.addPosdbList(&list);
+	EXPECT_EQ(1, tft.getNumExactTerms());
+	EXPECT_EQ(2000, tft.getTermFreq(0x123456789aLL));
+
+	// doc 5 deleted, doc 6 reindexed, doc 3000 added
+	makeList(&list, 0x123456789aLL, 5, 6, 3, 5, 6);
+	tft.addPosdbList(&list);
+	EXPECT_EQ(1999, tft.getTermFreq(0x123456789aLL));
+	makeList(&list, 0x123456789aLL, 3000, 3000, 3, -1, -1);
+	tft.addPosdbList(&list);
+	EXPECT_EQ(2000, tft.getTermFreq(0x123456789aLL));
+}
+
+TEST(TermFreqTableTest, CountPosdbDocs) {
+	RdbList list;
+	makeList(&list, 42, 1, 10, 4, -1, -1);
+	EXPECT_EQ(10, TermFreqTable::countPosdbDocs(&list));
+	makeList(&list, 42, 1, 10, 4, 3, 7);
+	EXPECT_EQ(7, TermFreqTable::countPosdbDocs(&list));
+}
+
+TEST(TermFreqTableTest, AddTable) {
+	TermFreqTable t1, t2;
+	ASSERT_TRUE(t1.init());
+	ASSERT_TRUE(t2.init());
+	t1.addTermFreq(42, 3000);
+	t2.addTermFreq(42, 2000);
+	t2.addTermFreq(43, 7);
+	t1.addTable(&t2);
+	EXPECT_EQ(5000, t1.getTermFreq(42));
+	EXPECT_LE(7, t1.getTermFreq(43));
+}
+
+TEST(TermFreqTableTest, SaveLoad) {
+	const char *filename = "termfreqtabletest.dat";
+	{
+		TermFreqTable tft;
+		ASSERT_TRUE(tft.init());
+		tft.addTermFreq(42, 3000);
+		tft.addTermFreq(43, 7);
+		EXPECT_TRUE(tft.needsSave());
+		ASSERT_TRUE(tft.save(filename));
+		EXPECT_FALSE(tft.needsSave());
+	}
+	TermFreqTable tft;
+	ASSERT_TRUE(tft.load(filename));
+	EXPECT_EQ(3000, tft.getTermFreq(42));
+	EXPECT_LE(7, tft.getTermFreq(43));
+	// updates of a loaded table stay private until saved
+	tft.addTermFreq(42, 1);
+	EXPECT_EQ(3001, tft.getTermFreq(42));
+	unlink(filename);
+
+	EXPECT_FALSE(tft.load(filename));
+	EXPECT_TRUE(tft.isEmpty());
+}
@@ -0,0 +1,158 @@
+#include "gtest/gtest.h"
+#include "Conf.h"
+#include "Posdb.h"
+#include "RdbList.h"
+#include "TermListCache.h"
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const int64_t s_termId = 0x123456789aLL;
+
+static void makeKey(char *key, int64_t docId, int32_t wordPos, bool isDelKey) {
+	Posdb::makeKey(key, s_termId, docId, wordPos, 0, 0, 0, 0, 0, 0, 0, false, isDelKey, false);
+}
+
+// compress the keys of one termid the way posdb stores them
+static void makeList(RdbList *list, const std::vector<std::string> &keys) {
+	std::string buf;
+	const char *prev = NULL;
+	for(size_t i=0; i<keys.size(); i++) {
+		const char *k = keys[i].data();
+		if(prev && Posdb::getDocId(prev)==Posdb::getDocId(k)) {
+			buf.append(k, 6);
+			buf[buf.size()-6] |= 0x06;
+		} else if(prev) {
+			buf.append(k, 12);
+			buf[buf.size()-12] |= 0x02;
+		} else
+			buf.append(k, 18);
+		prev = k;
+	}
+	char sk[18], ek[18];
+	Posdb::makeStartKey(sk, s_termId);
+	Posdb::makeEndKey(ek, s_termId);
+	char *p = (char*)mmalloc(buf.size(), "RdbList");
+	memcpy(p, buf.data(), buf.size());
+	list->set(p, buf.size(), p, buf.size(), sk, ek, 0, true, true, 18);
+}
+
+static std::vector<std::string> makeKeys(int64_t firstDocId, int64_t lastDocId) {
+	std::vector<std::string> keys;
+	for(int64_t docId=firstDocId; docId<=lastDocId; docId++) {
+		for(int32_t pos=1; pos<=3; pos++) {
+			char key[18];
+			makeKey(key, docId, pos, false);
+			keys.push_back(std::string(key, 18));
+		}
+	}
+	return keys;
+}
+
+static std::vector<int64_t> getDocIds(RdbList *list) {
+	std::vector<int64_t> docIds;
+	char key[18];
+	for(list->resetListPtr(); !list->isExhausted(); list->skipCurrentRecord()) {
+		list->getCurrentKey(key);
+		if(docIds.empty() || docIds.back()!=Posdb::getDocId(key))
+			docIds.push_back(Posdb::getDocId(key));
+	}
+	return docIds;
+}
+
+class TermListCacheTest : public ::testing::Test {
+protected:
+	void SetUp() {
+		g_conf.m_termListCacheMaxMem = 10000000;
+		// never start loading lists from posdb in here
+		g_conf.m_termListCacheMinHits = 1000000;
+		g_conf.m_termListCacheUseHugePages = false;
+	}
+	void TearDown() {
+		m_cache.reset();
+	}
+	TermListCache m_cache;
+};
+
+TEST_F(TermListCacheTest, DocIdRange) {
+	RdbList list;
+	makeList(&list, makeKeys(1, 5000));
+	ASSERT_TRUE(m_cache.addList(0, s_termId, &list));
+	EXPECT_TRUE(m_cache.isCached(0, s_termId));
+	EXPECT_FALSE(m_cache.isCached(1, s_termId));
+
+	// a range in the middle of the list, past a few skip points
+	char sk[18], ek[18];
+	Posdb::makeStartKey(sk, s_termId, 3000);
+	Posdb::makeEndKey(ek, s_termId, 3999);
+	RdbList result;
+	ASSERT_TRUE(m_cache.getList(0, s_termId, sk, ek, -1, true, -1, &result));
+	std::vector<int64_t> docIds = getDocIds(&result);
+	ASSERT_EQ(1000U, docIds.size());
+	EXPECT_EQ(3000, docIds.front());
+	EXPECT_EQ(3999, docIds.back());
+
+	// the whole list
+	Posdb::makeStartKey(sk, s_termId);
+	Posdb::makeEndKey(ek, s_termId);
+	ASSERT_TRUE(m_cache.getList(0, s_termId, sk, ek, -1, true, -1, &result));
+	EXPECT_EQ(list.getListSize(), result.getListSize());
+	EXPECT_EQ(0, memcmp(list.getList(), result.getList(), list.getListSize()));
+
+	EXPECT_EQ(2, m_cache.getNumHits());
+	EXPECT_FALSE(m_cache.getList(1, s_termId, sk, ek, -1, true, -1, &result));
+	EXPECT_EQ(1, m_cache.getNumMisses());
+
+	// we do not know which keys are in which file
+	EXPECT_FALSE(m_cache.getList(0, s_termId, sk, ek, -1, true, 1, &result));
+	EXPECT_EQ(2, m_cache.getNumHits());
+}
+
+TEST_F(TermListCacheTest, AddDumpedList) {
+	RdbList list;
+	makeList(&list, makeKeys(10, 20));
+	ASSERT_TRUE(m_cache.addList(0, s_termId, &list));
+
+	// delete doc 15, add doc 30
+	std::vector<std::string> dumped;
+	for(int32_t pos=1; pos<=3; pos++) {
+		char key[18];
+		makeKey(key, 15, pos, true);
+		dumped.push_back(std::string(key, 18));
+	}
+	std::vector<std::string> added = makeKeys(30, 30);
+	dumped.insert(dumped.end(), added.begin(), added.end());
+	RdbList dumpedList;
+	makeList(&dumpedList, dumped);
+	m_cache.addDumpedList(0, &dumpedList);
+
+	char sk[18], ek[18];
+	Posdb::makeStartKey(sk, s_termId);
+	Posdb::makeEndKey(ek, s_termId);
+	RdbList result;
+	ASSERT_TRUE(m_cache.getList(0, s_termId, sk, ek, -1, true, -1, &result));
+	std::vector<int64_t> docIds = getDocIds(&result);
+	ASSERT_EQ(11U, docIds.size());
+	EXPECT_EQ(14, docIds[4]);
+	EXPECT_EQ(16, docIds[5]);
+	EXPECT_EQ(30, docIds.back());
+}
+
+TEST_F(TermListCacheTest, Eviction) {
+	RdbList list;
+	makeList(&list, makeKeys(1, 1000));
+	// room for four lists
+	g_conf.m_termListCacheMaxMem = list.getListSize()*4+100;
+	for(collnum_t collnum=0; collnum<4; collnum++)
+		ASSERT_TRUE(m_cache.addList(collnum, s_termId, &list));
+	EXPECT_TRUE(m_cache.addList(0, s_termId, &list));
+	EXPECT_EQ(4, m_cache.getNumLists());
+	// a list of the same popularity can not push out another one
+	EXPECT_FALSE(m_cache.addList(4, s_termId, &list));
+	EXPECT_FALSE(m_cache.isCached(4, s_termId));
+
+	m_cache.removeCollection(0);
+	EXPECT_EQ(3, m_cache.getNumLists());
+	EXPECT_EQ(list.getListSize()*3, m_cache.getMemUsed());
+	EXPECT_TRUE(m_cache.addList(4, s_termId, &list));
+}
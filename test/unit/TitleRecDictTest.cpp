@@ -0,0 +1,229 @@
+#include "gtest/gtest.h"
+#include "Conf.h"
+#include "TitleRecDict.h"
+#include "Titledb.h"
+#include "RdbList.h"
+#include "XmlDoc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+
+static const char *s_dir = "/tmp/gb_titlerecdict_test";
+
+// html of the same site, so the pages share most of their markup
+static std::string makeDoc(int32_t i) {
+	char buf[256];
+	std::string doc = "<!DOCTYPE html><html><head><meta charset=\"utf-8\">"
+		"<link rel=\"stylesheet\" href=\"/static/css/site.css\">"
+		"<script src=\"/static/js/jquery.min.js\"></script>";
+	snprintf(buf, sizeof(buf), "<title>Article %d about widgets</title></head>", (int)i);
+	doc += buf;
+	doc += "<body><div id=\"header\"><ul class=\"nav\"><li><a href=\"/\">Home</a></li>"
+		"<li><a href=\"/products\">Products</a></li><li><a href=\"/about\">About us</a></li>"
+		"<li><a href=\"/contact\">Contact</a></li></ul></div><div id=\"content\">";
+	for(int32_t j=0; j<20; j++) {
+		snprintf(buf, sizeof(buf), "<p>Paragraph %d of article %d, widget number %d.</p>",
+			 (int)j, (int)i, rand() % 100000);
+		doc += buf;
+	}
+	doc += "</div><div id=\"footer\"><p>Copyright Widget Corporation. All rights "
+		"reserved.</p><a href=\"/privacy\">Privacy policy</a></div></body></html>";
+	return doc;
+}
+
+static void train(TitleRecDict *dict, TitleRecDictTrainer *trainer) {
+	for(int32_t i=0; i<2000; i++) {
+		std::string doc = makeDoc(i);
+		trainer->addSample(doc.data(), doc.size());
+	}
+	ASSERT_TRUE(trainer->train(dict));
+}
+
+// a titlerec of "data", compressed the way it was before dictionaries
+static std::string makeTitleRec(int64_t docId, const std::string &data) {
+	uint32_t size = data.size() * 2 + 64;
+	std::string rec(sizeof(key_t) + 8 + size, '\0');
+	if(gbcompress((unsigned char *)&rec[sizeof(key_t) + 8], &size,
+		      (unsigned char *)data.data(), data.size()) != Z_OK)
+		return std::string();
+	key_t k = g_titledb.makeKey(docId, 0, false);
+	memcpy(&rec[0], &k, sizeof(key_t));
+	*(int32_t *)&rec[sizeof(key_t)]     = size + 4;
+	*(int32_t *)&rec[sizeof(key_t) + 4] = data.size();
+	rec.resize(sizeof(key_t) + 8 + size);
+	return rec;
+}
+
+static std::string uncompress(const std::string &rec, const TitleRecDicts *dicts, int *err) {
+	std::string data(*(const int32_t *)&rec[sizeof(key_t) + 4], '\0');
+	uint32_t size = data.size();
+	*err = gbuncompressTitleRec((unsigned char *)&data[0], &size,
+				    (const unsigned char *)rec.data() + sizeof(key_t) + 8,
+				    rec.size() - sizeof(key_t) - 8, dicts);
+	data.resize(size);
+	return data;
+}
+
+TEST(TitleRecDictTest, TrainedDictCompressesBetter) {
+	srand(42);
+	TitleRecDict dict;
+	TitleRecDictTrainer trainer;
+	train(&dict, &trainer);
+	EXPECT_LT(0, dict.m_buf.getLength());
+	EXPECT_GE(TITLEREC_DICT_SIZE, dict.m_buf.getLength());
+
+	int64_t plainSize = trainer.getHeldOutSize(NULL);
+	int64_t dictSize  = trainer.getHeldOutSize(&dict);
+	ASSERT_TRUE(dictSize > 0);
+	EXPECT_LT(dictSize, plainSize * 3 / 4);
+}
+
+TEST(TitleRecDictTest, TooSmallSample) {
+	TitleRecDict dict;
+	TitleRecDictTrainer trainer;
+	std::string doc = makeDoc(0);
+	trainer.addSample(doc.data(), doc.size());
+	EXPECT_FALSE(trainer.train(&dict));
+}
+
+TEST(TitleRecDictTest, SaveAndLoad) {
+	srand(42);
+	system("rm -rf /tmp/gb_titlerecdict_test");
+	ASSERT_EQ(0, mkdir(s_dir, 0755));
+
+	TitleRecDict dict;
+	TitleRecDictTrainer trainer;
+	train(&dict, &trainer);
+
+	TitleRecDicts dicts;
+	ASSERT_TRUE(dicts.load(s_dir, "titledb"));
+	EXPECT_EQ(0, dicts.getNumDicts());
+	EXPECT_TRUE(dicts.getCurrentDict() == NULL);
+	ASSERT_TRUE(dicts.add("<html><head>", 12));
+	ASSERT_TRUE(dicts.add(dict.m_buf.getBufStart(), dict.m_buf.getLength()));
+	EXPECT_EQ(dict.m_id, dicts.getCurrentDict()->m_id);
+
+	TitleRecDicts loaded;
+	ASSERT_TRUE(loaded.load(s_dir, "titledb"));
+	ASSERT_EQ(2, loaded.getNumDicts());
+	EXPECT_EQ(dict.m_id, loaded.getCurrentDict()->m_id);
+	ASSERT_TRUE(loaded.getDict(dict.m_id) != NULL);
+	EXPECT_EQ(dict.m_buf.getLength(), loaded.getDict(dict.m_id)->m_buf.getLength());
+	EXPECT_TRUE(loaded.getDict(dict.m_id + 1) == NULL);
+
+	system("rm -rf /tmp/gb_titlerecdict_test");
+}
+
+TEST(TitleRecDictTest, RecompressTitleRec) {
+	srand(42);
+	system("rm -rf /tmp/gb_titlerecdict_test");
+	ASSERT_EQ(0, mkdir(s_dir, 0755));
+	TitleRecDicts dicts;
+	ASSERT_TRUE(dicts.load(s_dir, "titledb"));
+	{
+		TitleRecDict dict;
+		TitleRecDictTrainer trainer;
+		train(&dict, &trainer);
+		ASSERT_TRUE(dicts.add(dict.m_buf.getBufStart(), dict.m_buf.getLength()));
+	}
+	const TitleRecDict *dict = dicts.getCurrentDict();
+
+	std::string data = makeDoc(5000);
+	std::string rec = makeTitleRec(123456, data);
+	ASSERT_FALSE(rec.empty());
+	EXPECT_EQ(0, getTitleRecDictId(rec.data(), rec.size()));
+
+	// with the dictionary
+	SafeBuf sb;
+	ASSERT_TRUE(recompressTitleRec(rec.data(), rec.size(), &dicts, dict, &sb, NULL));
+	std::string drec(sb.getBufStart(), sb.getLength());
+	EXPECT_EQ(dict->m_id, getTitleRecDictId(drec.data(), drec.size()));
+	EXPECT_LT(drec.size(), rec.size());
+	EXPECT_EQ(0, memcmp(rec.data(), drec.data(), sizeof(key_t)));
+	int err;
+	EXPECT_EQ(data, uncompress(drec, &dicts, &err));
+	EXPECT_EQ(Z_OK, err);
+	uncompress(drec, NULL, &err);
+	EXPECT_EQ(Z_DATA_ERROR, err);
+
+	// and back without it, for another host
+	sb.purge();
+	ASSERT_TRUE(recompressTitleRec(drec.data(), drec.size(), &dicts, NULL, &sb, NULL));
+	std::string prec(sb.getBufStart(), sb.getLength());
+	EXPECT_EQ(0, getTitleRecDictId(prec.data(), prec.size()));
+	EXPECT_EQ(data, uncompress(prec, NULL, &err));
+	EXPECT_EQ(Z_OK, err);
+	// gbuncompress() reads it too
+	std::string pdata(data.size(), '\0');
+	uint32_t psize = pdata.size();
+	EXPECT_EQ(Z_OK, gbuncompress((unsigned char *)&pdata[0], &psize,
+				     (unsigned char *)&prec[sizeof(key_t) + 8],
+				     prec.size() - sizeof(key_t) - 8));
+	EXPECT_EQ(data, pdata);
+
+	system("rm -rf /tmp/gb_titlerecdict_test");
+}
+
+TEST(TitleRecDictTest, RecompressTitledbList) {
+	srand(42);
+	system("rm -rf /tmp/gb_titlerecdict_test");
+	ASSERT_EQ(0, mkdir(s_dir, 0755));
+	TitleRecDicts dicts;
+	ASSERT_TRUE(dicts.load(s_dir, "titledb"));
+	{
+		TitleRecDict dict;
+		TitleRecDictTrainer trainer;
+		train(&dict, &trainer);
+		ASSERT_TRUE(dicts.add(dict.m_buf.getBufStart(), dict.m_buf.getLength()));
+	}
+	const TitleRecDict *dict = dicts.getCurrentDict();
+
+	std::string docs[10];
+	RdbList list;
+	list.set(NULL, 0, NULL, 0, -1, true, false, sizeof(key_t));
+	for(int32_t i=0; i<10; i++) {
+		// a negative key
+		if(i == 3) {
+			key_t k = g_titledb.makeKey(1000 + i, 0, true);
+			ASSERT_TRUE(list.addRecord((char *)&k, 0, NULL));
+			continue;
+		}
+		docs[i] = makeDoc(i);
+		std::string rec = makeTitleRec(1000 + i, docs[i]);
+		ASSERT_TRUE(list.addRecord(&rec[0], rec.size() - sizeof(key_t) - 4,
+					   &rec[sizeof(key_t) + 4]));
+	}
+	int32_t oldSize = list.getListSize();
+
+	TitleRecDictTrainer trainer;
+	ASSERT_TRUE(recompressTitledbList(&list, &dicts, dict, &trainer));
+	EXPECT_EQ(9, trainer.getNumSamples());
+	EXPECT_LT(list.getListSize(), oldSize);
+
+	int32_t i = 0;
+	for(list.resetListPtr(); !list.isExhausted(); list.skipCurrentRecord(), i++) {
+		char *rec = list.getCurrentRec();
+		key_t k = *(key_t *)rec;
+		EXPECT_EQ(1000 + i, g_titledb.getDocId(&k));
+		if(i == 3) {
+			EXPECT_TRUE(KEYNEG(rec));
+			continue;
+		}
+		std::string srec(rec, list.getCurrentRecSize());
+		EXPECT_EQ(dict->m_id, getTitleRecDictId(srec.data(), srec.size()));
+		int err;
+		EXPECT_EQ(docs[i], uncompress(srec, &dicts, &err));
+		EXPECT_EQ(Z_OK, err);
+	}
+	EXPECT_EQ(10, i);
+
+	// a second pass keeps the records as they are
+	std::string before(list.getList(), list.getListSize());
+	ASSERT_TRUE(recompressTitledbList(&list, &dicts, dict, NULL));
+	EXPECT_EQ(before, std::string(list.getList(), list.getListSize()));
+
+	system("rm -rf /tmp/gb_titlerecdict_test");
+}
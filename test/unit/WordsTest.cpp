@@ -1,6 +1,8 @@
 #include "gtest/gtest.h"
 
 #include "Words.h"
+#include "hash.h"
+#include <string>
 
 TEST(WordsTest, VerifySize) {
 	// set c to a curling quote in unicode
@@ -28,3 +30,33 @@ TEST(WordsTest, VerifySize) {
 	// is that punct
 	EXPECT_TRUE(is_punct_utf8(p));
 }
+
+TEST(WordsTest, AsciiWordIds) {
+	char s[] = "The QUICK brown Fox-jumps over the lazy dog's back, "
+		   "Internationalization and c++ in 1,000 or 3.14 Caf\xc3\xa9 NA\xc3\x8fVE";
+	Words words;
+	ASSERT_TRUE(words.set(s, true, 0));
+
+	const char *expected[] = {
+		"The", " ", "QUICK", " ", "brown", " ", "Fox", "-", "jumps", " ", "over", " ",
+		"the", " ", "lazy", " ", "dog's", " ", "back", ", ", "Internationalization", " ",
+		"and", " ", "c++", " ", "in", " ", "1,000", " ", "or", " ", "3.14", " ",
+		"Caf\xc3\xa9", " ", "NA\xc3\x8fVE"
+	};
+	int32_t numExpected = sizeof(expected)/sizeof(expected[0]);
+	ASSERT_EQ(numExpected, words.getNumWords());
+	for(int32_t i=0; i<numExpected && i<words.getNumWords(); i++) {
+		EXPECT_EQ(std::string(expected[i]), std::string(words.getWord(i), words.getWordLen(i)));
+	}
+
+	// same ids as hashing one char at a time
+	EXPECT_EQ(hash64Lower_utf8("internationalization"), (uint64_t)words.getWordId(20));
+	EXPECT_EQ(words.getWordId(0), words.getWordId(12));
+	EXPECT_EQ(hash64Lower_utf8("caf\xc3\xa9"), (uint64_t)words.getWordId(34));
+	EXPECT_EQ(hash64Lower_utf8("na\xc3\xafve"), (uint64_t)words.getWordId(36));
+	uint64_t h = 0;
+	const char *w = "Internationalization";
+	for(int32_t i=0; w[i]; i++)
+		h ^= g_hashtab[(uint8_t)i][(uint8_t)to_lower_a(w[i])];
+	EXPECT_EQ(h, (uint64_t)words.getWordId(20));
+}
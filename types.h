@@ -712,4 +712,113 @@ static inline const char *KEYMAX() {
 }
 
 
+// . compile-time key size versions of KEYCMP(), KEYCMPNEGEQ() and KEYSET()
+// . the hot loops of RdbList, RdbTree, RdbBuckets and RdbMap are templates
+//   on the key size that use these, and KEYSIZE_SWITCH() picks the instance
+//   once per call instead of branching on the key size for every key
+// . the keys are little endian, so a key compares like an unsigned integer.
+//   we compare the high 16 bytes then the low 16 bytes, which overlap, as
+//   128 bit integers. the overlap is equal by then so it does not matter.
+// . a KS of 0 means the key size is only known at runtime, the 3 argument
+//   versions then use the runtime "keySize"
+static inline unsigned __int128 KEYLOAD128 ( const char *k ) {
+	unsigned __int128 v;
+	memcpy ( &v , k , 16 );
+	return v;
+}
+
+static inline uint64_t KEYLOAD64 ( const char *k ) {
+	uint64_t v;
+	memcpy ( &v , k , 8 );
+	return v;
+}
+
+template <char KS>
+inline char KEYCMP ( const char *k1, const char *k2 ) {
+	return KEYCMP ( k1 , k2 , KS );
+}
+
+template <>
+inline char KEYCMP<12> ( const char *k1, const char *k2 ) {
+	uint64_t a = KEYLOAD64 ( k1 + 4 );
+	uint64_t b = KEYLOAD64 ( k2 + 4 );
+	if ( a != b ) return a < b ? -1 : 1;
+	a = KEYLOAD64 ( k1 );
+	b = KEYLOAD64 ( k2 );
+	return ( a > b ) - ( a < b );
+}
+
+template <>
+inline char KEYCMP<16> ( const char *k1, const char *k2 ) {
+	unsigned __int128 a = KEYLOAD128 ( k1 );
+	unsigned __int128 b = KEYLOAD128 ( k2 );
+	return ( a > b ) - ( a < b );
+}
+
+template <>
+inline char KEYCMP<18> ( const char *k1, const char *k2 ) {
+	unsigned __int128 a = KEYLOAD128 ( k1 + 2 );
+	unsigned __int128 b = KEYLOAD128 ( k2 + 2 );
+	if ( a != b ) return a < b ? -1 : 1;
+	uint16_t c = *(const uint16_t *)k1;
+	uint16_t d = *(const uint16_t *)k2;
+	return ( c > d ) - ( c < d );
+}
+
+template <>
+inline char KEYCMP<24> ( const char *k1, const char *k2 ) {
+	unsigned __int128 a = KEYLOAD128 ( k1 + 8 );
+	unsigned __int128 b = KEYLOAD128 ( k2 + 8 );
+	if ( a != b ) return a < b ? -1 : 1;
+	a = KEYLOAD128 ( k1 );
+	b = KEYLOAD128 ( k2 );
+	return ( a > b ) - ( a < b );
+}
+
+template <>
+inline char KEYCMP<28> ( const char *k1, const char *k2 ) {
+	unsigned __int128 a = KEYLOAD128 ( k1 + 12 );
+	unsigned __int128 b = KEYLOAD128 ( k2 + 12 );
+	if ( a != b ) return a < b ? -1 : 1;
+	a = KEYLOAD128 ( k1 );
+	b = KEYLOAD128 ( k2 );
+	return ( a > b ) - ( a < b );
+}
+
+template <char KS>
+inline char KEYCMP ( const char *k1, const char *k2, char keySize ) {
+	return KS ? KEYCMP<KS> ( k1 , k2 ) : KEYCMP ( k1 , k2 , keySize );
+}
+
+// like KEYCMP() but a negative key equals its positive key
+template <char KS>
+inline char KEYCMPNEGEQ ( const char *k1, const char *k2, char keySize ) {
+	if ( ! KS ) return KEYCMPNEGEQ ( k1 , k2 , keySize );
+	char a[KS ? KS : 1];
+	char b[KS ? KS : 1];
+	memcpy ( a , k1 , KS );
+	memcpy ( b , k2 , KS );
+	a[0] |= 0x01;
+	b[0] |= 0x01;
+	return KEYCMP<KS> ( a , b );
+}
+
+template <char KS>
+inline void KEYSET ( char *k1, const char *k2, char keySize ) {
+	if ( KS ) memcpy ( k1 , k2 , KS );
+	else      KEYSET ( k1 , k2 , keySize );
+}
+
+// . call "f<KS>(...)" with KS being the key size "ks" if we have an
+//   instance for it, otherwise with KS of 0
+// . "f" must be the name of a function template on "char KS"
+#define KEYSIZE_SWITCH(ks,f,...)                      \
+	( (ks) == 18 ? f<18> ( __VA_ARGS__ ) :        \
+	  (ks) == 12 ? f<12> ( __VA_ARGS__ ) :        \
+	  (ks) == 16 ? f<16> ( __VA_ARGS__ ) :        \
+	  (ks) == 24 ? f<24> ( __VA_ARGS__ ) :        \
+	  (ks) == 28 ? f<28> ( __VA_ARGS__ ) :        \
+	               f<0>  ( __VA_ARGS__ ) )
+
+
 #endif // GB_TYPES_H